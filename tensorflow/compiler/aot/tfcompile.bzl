@@ -361,7 +361,10 @@ def tf_library(
             # needed.
             "//tensorflow/compiler/xla/service/cpu:runtime_conv2d",
             "//tensorflow/compiler/xla/service/cpu:runtime_custom_call_status",
+            "//tensorflow/compiler/xla/service/cpu:runtime_flash_attention",
             "//tensorflow/compiler/xla/service/cpu:runtime_key_value_sort",
+            "//tensorflow/compiler/xla/service/cpu:runtime_low_precision_conv2d",
+            "//tensorflow/compiler/xla/service/cpu:runtime_low_precision_matmul",
             "//tensorflow/compiler/xla/service/cpu:runtime_matmul",
             "//tensorflow/compiler/xla/service/cpu:runtime_topk",
             "//tensorflow/compiler/xla/service/cpu:runtime_single_threaded_conv2d",
@@ -15,6 +15,9 @@ limitations under the License.
 
 #include "tensorflow/compiler/jit/build_xla_ops_pass.h"
 
+#include <optional>
+#include <vector>
+
 #include "absl/algorithm/container.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_join.h"
@@ -25,10 +28,13 @@ limitations under the License.
 #include "tensorflow/cc/ops/control_flow_ops.h"
 #include "tensorflow/cc/ops/functional_ops.h"
 #include "tensorflow/cc/ops/logging_ops.h"
+#include "tensorflow/cc/ops/math_ops.h"
 #include "tensorflow/compiler/jit/defs.h"
 #include "tensorflow/compiler/jit/device_util.h"
 #include "tensorflow/compiler/jit/encapsulate_subgraphs_pass.h"
 #include "tensorflow/compiler/jit/flags.h"
+#include "tensorflow/compiler/jit/shape_bucketing.h"
+#include "tensorflow/compiler/jit/shape_inference.h"
 #include "tensorflow/compiler/jit/xla_cluster_util.h"
 #include "tensorflow/compiler/tf2xla/cc/ops/xla_jit_ops.h"
 #include "tensorflow/compiler/tf2xla/xla_op_registry.h"
@@ -62,14 +68,23 @@ struct DebuggingOpts {
   bool check_output_numerics;
 };
 
-void MoveOutgoingEdges(Graph* g, Node* old_node, Node* new_node) {
+// Moves the outgoing edges of `old_node` to `new_node`, with the data edges
+// from output `i` of `old_node` moved to `new_outputs[i]`.
+void MoveOutgoingEdges(Graph* g, Node* old_node, Node* new_node,
+                       absl::Span<const Output> new_outputs) {
   std::vector<const Edge*> out_edges(old_node->out_edges().begin(),
                                      old_node->out_edges().end());
   for (const Edge* edge : out_edges) {
     // TODO(sanjoy): This does not update NodeDef inputs.  To be able to update
     // NodeDef inputs we first need to fix encapsulate_subgraphs_pass to fix up
     // the NodeDef inputs to the function call nodes.
-    g->AddEdge(new_node, edge->src_output(), edge->dst(), edge->dst_input());
+    if (edge->IsControlEdge()) {
+      g->AddControlEdge(new_node, edge->dst());
+    } else {
+      const Output& new_output = new_outputs[edge->src_output()];
+      g->AddEdge(new_output.node(), new_output.index(), edge->dst(),
+                 edge->dst_input());
+    }
     g->RemoveEdge(edge);
   }
 }
@@ -112,8 +127,9 @@ Operation DataToControl(const Scope& scope, Output data) {
 }
 
 // Replaces each outgoing edge from `old_node` with a merge node that merges in
-// the corresponding output from `new_node`.
-void MergeOutgoingDataEdges(const Scope& s, Node* old_node, Node* new_node,
+// the corresponding output from `new_outputs`.
+void MergeOutgoingDataEdges(const Scope& s, Node* old_node,
+                            absl::Span<const Output> new_outputs,
                             absl::string_view cluster_name,
                             const DebuggingOpts& debugging_opts) {
   if (!s.status().ok()) {
@@ -130,7 +146,8 @@ void MergeOutgoingDataEdges(const Scope& s, Node* old_node, Node* new_node,
     int oidx = e->src_output();
     Output merged_output = merged_outputs[oidx];
     if (merged_output.node() == nullptr) {
-      Output new_output(new_node, oidx);
+      Output new_output = new_outputs[oidx];
+      Node* new_node = new_output.node();
       if (debugging_opts.print_outputs) {
         string cpu_device = "/job:localhost/replica:0/task:0/device:CPU:0";
         ops::Print print_op(s.WithOpName("print_", oidx)
@@ -401,6 +418,131 @@ std::vector<Output> GetXlaRunArgs(const Scope& s,
   return xla_run_args;
 }
 
+// Returns how the non-constant inputs and the outputs of the cluster described
+// by `cluster_info` can be bucketed along their first dimension, given the
+// shapes inferred for the graph, or std::nullopt if they can't.
+std::optional<ShapeBucketingInfo> GetShapeBucketing(
+    const XlaClusterInfo& cluster_info,
+    const FunctionLibraryDefinition& flib_def,
+    const GraphShapeInfo& shape_info) {
+  // Constant inputs would be compiled in, and resource updates can't be
+  // sliced.
+  if (!cluster_info.constant_inputs.empty() ||
+      !cluster_info.resource_inputs.empty() ||
+      cluster_info.non_constant_inputs.empty()) {
+    return std::nullopt;
+  }
+  std::vector<PartialTensorShape> arg_shapes;
+  for (const Output& o : cluster_info.non_constant_inputs) {
+    auto it = shape_info.find(o.node()->name());
+    if (it == shape_info.end() || o.index() >= it->second.size()) {
+      return std::nullopt;
+    }
+    arg_shapes.push_back(it->second[o.index()].shape);
+  }
+  StatusOr<std::optional<ShapeBucketingInfo>> bucketing =
+      AnalyzeShapeBucketing(cluster_info.function, arg_shapes, flib_def);
+  if (!bucketing.ok()) {
+    VLOG(1) << "Not bucketing the shapes of " << cluster_info.function.name()
+            << ": " << bucketing.status();
+    return std::nullopt;
+  }
+  return *std::move(bucketing);
+}
+
+// Returns the smallest of the sizes `bucket_size * 2^k` which is at least
+// `num_rows`, as a vector of size 1.
+Output GeometricShapeBucket(const Scope& s, int64_t bucket_size,
+                            Output num_rows) {
+  std::vector<int32> sizes;
+  for (int64_t size = bucket_size; size < kint32max; size *= 2) {
+    sizes.push_back(size);
+  }
+  sizes.push_back(kint32max);
+  const int64_t num_sizes = sizes.size();
+  Tensor bucket_sizes(DT_INT32, TensorShape({num_sizes}));
+  absl::c_copy(sizes, bucket_sizes.flat<int32>().data());
+  Output bucket_sizes_const = ops::Const(s, bucket_sizes);
+  // Keeps the sizes holding `num_rows`, and takes the smallest of them.
+  Output holding_sizes = ops::SelectV2(
+      s, ops::GreaterEqual(s, bucket_sizes_const, num_rows), bucket_sizes_const,
+      kint32max);
+  return ops::Min(s.WithOpName("shape_bucket_num_padded_rows"), holding_sizes,
+                  /*axis=*/0, ops::Min::KeepDims(true));
+}
+
+// Pads the inputs of `bucketing.padded_args` along their first dimension to
+// the next multiple of `bucket_size`, or to the geometric bucket holding them
+// if `geometric`, and returns their number of rows before padding as a vector
+// of size 1.
+//
+// If the padded inputs don't have the same number of rows, e.g. because one of
+// them has a single row which is broadcast, none of them is padded and the
+// returned number of rows is -1, so that SliceFromShapeBucket keeps all rows.
+Output PadToShapeBucket(const Scope& s, const ShapeBucketingInfo& bucketing,
+                        int64_t bucket_size, bool geometric,
+                        std::vector<Output>* inputs) {
+  std::vector<Output> input_rows;
+  for (int i = 0, end = inputs->size(); i < end; ++i) {
+    if (!bucketing.padded_args[i]) continue;
+    ops::Shape shape(s.WithOpName("shape_bucket_input_shape_", i),
+                     (*inputs)[i]);
+    input_rows.push_back(ops::Slice(s.WithOpName("shape_bucket_num_rows_", i),
+                                    shape, {0}, {1}));
+  }
+  Output num_rows = input_rows.front();
+  Output num_padded_rows;
+  if (geometric) {
+    num_padded_rows = GeometricShapeBucket(s, bucket_size, num_rows);
+  } else {
+    const int32 bucket = bucket_size;
+    num_padded_rows = ops::Mul(
+        s.WithOpName("shape_bucket_num_padded_rows"),
+        ops::FloorDiv(s, ops::Add(s, num_rows, bucket - 1), bucket), bucket);
+  }
+  Output num_padding_rows =
+      ops::Sub(s.WithOpName("shape_bucket_num_padding_rows"), num_padded_rows,
+               num_rows);
+  if (input_rows.size() > 1) {
+    ops::Concat all_rows(s, input_rows, /*axis=*/0);
+    ops::Equal same_rows(
+        s.WithOpName("shape_bucket_same_rows"),
+        ops::Min(s, all_rows, /*axis=*/0, ops::Min::KeepDims(true)),
+        ops::Max(s, all_rows, /*axis=*/0, ops::Max::KeepDims(true)));
+    num_padding_rows = ops::SelectV2(s, same_rows, num_padding_rows, 0);
+    num_rows = ops::SelectV2(s, same_rows, num_rows, -1);
+  }
+  for (int i = 0, end = inputs->size(); i < end; ++i) {
+    if (!bucketing.padded_args[i]) continue;
+    // Paddings of {{0, num_padding_rows}, {0, 0}, ...}.
+    Tensor rows_padding(DT_INT32, TensorShape({bucketing.arg_ranks[i], 2}));
+    rows_padding.flat<int32>().setZero();
+    rows_padding.matrix<int32>()(0, 1) = 1;
+    ops::Mul paddings(s.WithOpName("shape_bucket_paddings_", i),
+                      ops::Const(s, rows_padding), num_padding_rows);
+    (*inputs)[i] = ops::Pad(s.WithOpName("shape_bucket_input_", i),
+                            (*inputs)[i], paddings);
+  }
+  return num_rows;
+}
+
+// Slices the first `num_rows` rows of `outputs`, computed on inputs padded by
+// PadToShapeBucket, or keeps all of them if `num_rows` is -1.
+void SliceFromShapeBucket(const Scope& s, const ShapeBucketingInfo& bucketing,
+                          Output num_rows, std::vector<Output>* outputs) {
+  for (int i = 0, end = outputs->size(); i < end; ++i) {
+    const int rank = bucketing.result_ranks[i];
+    Tensor begin(DT_INT32, TensorShape({rank}));
+    begin.flat<int32>().setZero();
+    Tensor other_dims(DT_INT32, TensorShape({rank - 1}));
+    other_dims.flat<int32>().setConstant(-1);
+    ops::Concat size(s.WithOpName("shape_bucket_output_size_", i),
+                     {num_rows, ops::Const(s, other_dims)}, /*axis=*/0);
+    (*outputs)[i] = ops::Slice(s.WithOpName("shape_bucket_output_", i),
+                               (*outputs)[i], ops::Const(s, begin), size);
+  }
+}
+
 StatusOr<MemoryTypeVector> GetOutputMemoryTypes(const Scope& root, Node* n) {
   MemoryTypeVector input_mtypes, output_mtypes;
   DeviceType device_type("");
@@ -467,10 +609,16 @@ Status ReplaceNodeWithXlaCompileAndXlaRun(
     jit::DeviceInfoCache* device_info_cache,
     const GraphOptimizationPassOptions& options,
     const FunctionLibraryDefinition& flib_def, bool lazy_compilation_enabled,
-    const DebuggingOpts& debugging_opts, Graph* g, Node* n) {
+    const DebuggingOpts& debugging_opts, const GraphShapeInfo* shape_info,
+    Graph* g, Node* n) {
   XlaClusterInfo cluster_info;
   TF_RETURN_IF_ERROR(GetXlaClusterInfo(n, &cluster_info));
 
+  std::optional<ShapeBucketingInfo> bucketing;
+  if (shape_info != nullptr) {
+    bucketing = GetShapeBucketing(cluster_info, flib_def, *shape_info);
+  }
+
   TF_ASSIGN_OR_RETURN(
       jit::DeviceId device,
       InferDeviceForCluster(device_info_cache, n, cluster_info.function.name(),
@@ -491,6 +639,18 @@ Status ReplaceNodeWithXlaCompileAndXlaRun(
                    .WithDevice(n->requested_device())
                    .WithAssignedDevice(device_name_str);
 
+  // With shape bucketing, _XlaCompile and _XlaRun see the padded inputs, while
+  // the TF function call of lazy compilation keeps the original ones.
+  Output num_rows;
+  if (bucketing.has_value()) {
+    VLOG(2) << "Bucketing the shapes of " << cluster_info.function.name();
+    const BuildXlaOpsPassFlags& flags = *GetBuildXlaOpsPassFlags();
+    num_rows =
+        PadToShapeBucket(root, *bucketing, flags.tf_xla_shape_bucket_size,
+                         flags.tf_xla_geometric_shape_buckets,
+                         &cluster_info.non_constant_inputs);
+  }
+
   ops::_XlaCompile xla_compile(root.WithOpName("xla_compile"),
                                /*constants=*/cluster_info.constant_inputs,
                                /*args=*/cluster_info.non_constant_inputs,
@@ -513,9 +673,15 @@ Status ReplaceNodeWithXlaCompileAndXlaRun(
     // cluster.
     ops::_XlaRun xla_run(root.WithOpName("xla_run"), xla_run_args,
                          xla_compile.key, n->output_types());
+    std::vector<Output> xla_run_outputs(xla_run.results.begin(),
+                                        xla_run.results.end());
+    if (bucketing.has_value()) {
+      SliceFromShapeBucket(root, *bucketing, num_rows, &xla_run_outputs);
+    }
+    TF_RETURN_IF_ERROR(root.status());
 
     MoveOutgoingEdges(g, /*old_node=*/n,
-                      /*new_node=*/xla_run.operation.node());
+                      /*new_node=*/xla_run.operation.node(), xla_run_outputs);
     g->RemoveNode(n);
   } else {
     // "Lazy" compilation: an _XlaCompile invocation may decide not to compile
@@ -537,12 +703,16 @@ Status ReplaceNodeWithXlaCompileAndXlaRun(
 
     ops::_XlaRun xla_run(root.WithOpName("xla_run"), xla_run_args,
                          predicated_compilation_key, n->output_types());
+    std::vector<Output> xla_run_outputs(xla_run.results.begin(),
+                                        xla_run.results.end());
+    if (bucketing.has_value()) {
+      SliceFromShapeBucket(root, *bucketing, num_rows, &xla_run_outputs);
+    }
 
     MergeOutgoingControlEdges(root, /*old_node=*/n,
                               /*new_node=*/xla_run.operation.node());
 
-    MergeOutgoingDataEdges(root, /*old_node=*/n,
-                           /*new_node=*/xla_run.operation.node(),
+    MergeOutgoingDataEdges(root, /*old_node=*/n, xla_run_outputs,
                            cluster_info.function.name(), debugging_opts);
 
     TF_RETURN_IF_ERROR(root.status());
@@ -604,10 +774,24 @@ Status BuildXlaOpsPass::Run(const GraphOptimizationPassOptions& options) {
   VLOG(1) << "check_input_numerics = " << debugging_opts.check_input_numerics;
   VLOG(1) << "check_output_numerics = " << debugging_opts.check_output_numerics;
 
+  // The shapes of the cluster inputs tell which clusters have a dynamic first
+  // dimension to bucket.
+  std::optional<GraphShapeInfo> shape_info;
+  if (flags.tf_xla_shape_bucket_size > 0 && !xla_compiled_kernels.empty()) {
+    shape_info.emplace();
+    Status status = InferShapes(graph, /*arg_shapes=*/{}, options.flib_def,
+                                &*shape_info);
+    if (!status.ok()) {
+      VLOG(1) << "Not bucketing shapes: " << status;
+      shape_info.reset();
+    }
+  }
+
   for (Node* n : xla_compiled_kernels) {
     TF_RETURN_IF_ERROR(ReplaceNodeWithXlaCompileAndXlaRun(
         &device_info_cache, options, *options.flib_def,
-        lazy_compilation_enabled, debugging_opts, graph, n));
+        lazy_compilation_enabled, debugging_opts,
+        shape_info.has_value() ? &*shape_info : nullptr, graph, n));
   }
 
   if (VLOG_IS_ON(1)) {
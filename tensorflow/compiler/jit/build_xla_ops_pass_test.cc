@@ -21,6 +21,7 @@ limitations under the License.
 #include "tensorflow/cc/ops/standard_ops.h"
 #include "tensorflow/compiler/jit/defs.h"
 #include "tensorflow/compiler/jit/encapsulate_subgraphs_pass.h"
+#include "tensorflow/compiler/jit/flags.h"
 #include "tensorflow/compiler/jit/node_matchers.h"
 #include "tensorflow/compiler/jit/test_util.h"
 #include "tensorflow/core/common_runtime/device_factory.h"
@@ -50,6 +51,7 @@ using ::tensorflow::testing::FindNodeByName;
 using ::tensorflow::testing::matchers::Attr;
 using ::tensorflow::testing::matchers::CtrlDeps;
 using ::tensorflow::testing::matchers::Inputs;
+using ::tensorflow::testing::matchers::Name;
 using ::tensorflow::testing::matchers::NodeWith;
 using ::tensorflow::testing::matchers::Op;
 using ::tensorflow::testing::matchers::Out;
@@ -257,6 +259,100 @@ TEST_F(BuildXlaOpsTest, NoExtraMergeForEdgeToSink) {
                                 NodeWith(Op("NoOp")))));
 }
 
+TEST_F(BuildXlaOpsTest, PadsInputsToShapeBucket) {
+  const char* kXlaDeviceName = "/job:worker/replica:0/task:0/device:XLA_CPU:0";
+  Scope root = Scope::NewRootScope().WithDevice(kXlaDeviceName).ExitOnError();
+
+  FunctionDefLibrary fdef_lib;
+  *fdef_lib.add_function() = FunctionDefHelper::Create(
+      /*function_name=*/"cluster_0", /*in_def=*/{"in: float"},
+      /*out_def=*/{"out: float"},
+      /*attr_def=*/{},
+      /*node_def=*/{{{"out"}, "Relu", {"in"}, {{"T", DT_FLOAT}}}},
+      /*ret_def=*/{{"out", "out:activations:0"}});
+  TF_ASSERT_OK(root.graph()->AddFunctionLibrary(fdef_lib));
+
+  Node* call;
+  TF_ASSERT_OK(MakeXlaCompiledKernel(root.graph(), "cluster_0", "C", &call));
+  call->set_requested_device(kXlaDeviceName);
+  call->AddAttr(kXlaHasReferenceVarsAttr, false);
+  auto input = ops::Placeholder(
+      root.WithOpName("input"), DT_FLOAT,
+      ops::Placeholder::Shape(PartialTensorShape({-1, 4})));
+  root.graph()->AddEdge(input.node(), 0, call, 0);
+  TF_ASSERT_OK(root.DoShapeInference(call));
+  auto output = ops::Identity(root.WithOpName("output"), Output(call));
+
+  BuildXlaOpsPassFlags* flags = GetBuildXlaOpsPassFlags();
+  const int64_t old_bucket_size = flags->tf_xla_shape_bucket_size;
+  flags->tf_xla_shape_bucket_size = 8;
+  std::unique_ptr<Graph> graph;
+  Status status = BuildXlaOps(root, fdef_lib, &graph);
+  flags->tf_xla_shape_bucket_size = old_bucket_size;
+  TF_ASSERT_OK(status);
+
+  auto padded_input =
+      NodeWith(Op("Pad"), Inputs(Out(NodeWith(Op("Placeholder"))), _));
+  auto xla_run = NodeWith(Op("_XlaRun"), Inputs(Out(padded_input), _));
+  auto sliced_output = NodeWith(Op("Slice"), Inputs(Out(xla_run), _, _));
+
+  Node* output_new = FindNodeByName(graph.get(), "output");
+  ASSERT_NE(output_new, nullptr);
+  EXPECT_THAT(output_new,
+              NodeWith(Op("Identity"), Inputs(Out(sliced_output))));
+}
+
+TEST_F(BuildXlaOpsTest, DoesNotPadBroadcastInputsToShapeBucket) {
+  const char* kXlaDeviceName = "/job:worker/replica:0/task:0/device:XLA_CPU:0";
+  Scope root = Scope::NewRootScope().WithDevice(kXlaDeviceName).ExitOnError();
+
+  FunctionDefLibrary fdef_lib;
+  *fdef_lib.add_function() = FunctionDefHelper::Create(
+      /*function_name=*/"cluster_0", /*in_def=*/{"in: float", "bias: float"},
+      /*out_def=*/{"out: float"},
+      /*attr_def=*/{},
+      /*node_def=*/{{{"out"}, "AddV2", {"in", "bias"}, {{"T", DT_FLOAT}}}},
+      /*ret_def=*/{{"out", "out:z:0"}});
+  TF_ASSERT_OK(root.graph()->AddFunctionLibrary(fdef_lib));
+
+  Node* call;
+  TF_ASSERT_OK(MakeXlaCompiledKernel(root.graph(), "cluster_0", "C", &call));
+  call->set_requested_device(kXlaDeviceName);
+  call->AddAttr(kXlaHasReferenceVarsAttr, false);
+  auto input = ops::Placeholder(
+      root.WithOpName("input"), DT_FLOAT,
+      ops::Placeholder::Shape(PartialTensorShape({-1, 4})));
+  auto bias = ops::Placeholder(
+      root.WithOpName("bias"), DT_FLOAT,
+      ops::Placeholder::Shape(PartialTensorShape({1, 4})));
+  root.graph()->AddEdge(input.node(), 0, call, 0);
+  root.graph()->AddEdge(bias.node(), 0, call, 1);
+  TF_ASSERT_OK(root.DoShapeInference(call));
+  auto output = ops::Identity(root.WithOpName("output"), Output(call));
+
+  BuildXlaOpsPassFlags* flags = GetBuildXlaOpsPassFlags();
+  const int64_t old_bucket_size = flags->tf_xla_shape_bucket_size;
+  flags->tf_xla_shape_bucket_size = 8;
+  std::unique_ptr<Graph> graph;
+  Status status = BuildXlaOps(root, fdef_lib, &graph);
+  flags->tf_xla_shape_bucket_size = old_bucket_size;
+  TF_ASSERT_OK(status);
+
+  // Only the input with a dynamic first dimension is padded, and the bias is
+  // broadcast along its rows.
+  auto padded_input =
+      NodeWith(Op("Pad"), Inputs(Out(NodeWith(Name("input"))), _));
+  auto xla_run =
+      NodeWith(Op("_XlaRun"),
+               Inputs(Out(padded_input), Out(NodeWith(Name("bias"))), _));
+  auto sliced_output = NodeWith(Op("Slice"), Inputs(Out(xla_run), _, _));
+
+  Node* output_new = FindNodeByName(graph.get(), "output");
+  ASSERT_NE(output_new, nullptr);
+  EXPECT_THAT(output_new,
+              NodeWith(Op("Identity"), Inputs(Out(sliced_output))));
+}
+
 #ifdef GOOGLE_CUDA
 FunctionDefLibrary CreateFunctionDefLibWithInt32Input(const string& name) {
   FunctionDefLibrary fdef_lib;
@@ -16,13 +16,17 @@ limitations under the License.
 #ifndef TENSORFLOW_COMPILER_JIT_DEVICE_COMPILATION_CACHE_H_
 #define TENSORFLOW_COMPILER_JIT_DEVICE_COMPILATION_CACHE_H_
 
+#include <algorithm>
 #include <cstdint>
+#include <deque>
 #include <memory>
 #include <optional>
 #include <string>
 #include <utility>
 #include <variant>
+#include <vector>
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/strings/str_cat.h"
 #include "tensorflow/compiler/jit/device_compilation_cluster_signature.h"
 #include "tensorflow/compiler/jit/xla_compile_util.h"
@@ -34,12 +38,27 @@ namespace tensorflow {
 // Cache to store compiled HLO, executables and related metadata keyed by
 // `DeviceCompilationClusterSignature`. The cache owns the stored
 // CompilationResults and Executables.
-// Currently no cache eviction policy is implemented and the cache grows without
-// bound.
+//
+// If `max_entries` is positive, inserting an entry into a full cache evicts
+// the entry with the lowest priority, other than the entries being compiled
+// asynchronously. Priorities follow LFU with dynamic aging: an entry's priority
+// is its request count plus the age of the cache when it was last requested,
+// and the age of the cache becomes the priority of each evicted entry. Entries
+// requested often are kept, but stop being favored once they are no longer
+// requested, and a newly inserted entry isn't evicted before the entries that
+// were inserted earlier with the same number of requests. The request counts of
+// the most recently evicted entries are remembered, so that a signature which
+// keeps being evicted still reaches the lazy compilation threshold.
+//
+// Evicted entries holding a CompilationResult or an Executable are kept until
+// no Value refers to them anymore, and are then handed out by
+// TakeUnusedEvictedEntries() to be destroyed once the device no longer runs
+// their executables.
 template <typename ExecutableType>
 class DeviceCompilationCache {
  public:
-  DeviceCompilationCache() = default;
+  explicit DeviceCompilationCache(int64_t max_entries = 0)
+      : max_entries_(max_entries) {}
   ~DeviceCompilationCache() = default;
 
   using Key = DeviceCompilationClusterSignature;
@@ -49,6 +68,9 @@ class DeviceCompilationCache {
     int64_t request_count = 0;
     const XlaCompiler::CompilationResult* compilation_result = nullptr;
     ExecutableType* executable = nullptr;
+    // Keeps `compilation_result` and `executable` alive, even if the entry is
+    // evicted from the cache.
+    std::shared_ptr<const void> holder;
   };
 
   // Returns std::nullopt if value for the supplied key is not found. If a value
@@ -63,12 +85,25 @@ class DeviceCompilationCache {
   // `executable` and associates them with the provided `key`. Takes ownership
   // of `compilation_result` and `executable`. Does not increment the
   // corresponding `request_count`. Only arguments that are not std::nullopt are
-  // updated in the cache.
-  void Store(const Key& key, std::optional<DeviceCompileState> compile_state,
-             std::optional<Status> compilation_status,
-             std::optional<std::unique_ptr<XlaCompiler::CompilationResult>>
-                 compilation_result,
-             std::optional<std::unique_ptr<ExecutableType>> executable);
+  // updated in the cache. Returns a holder of the updated entry, as in Value.
+  std::shared_ptr<const void> Store(
+      const Key& key, std::optional<DeviceCompileState> compile_state,
+      std::optional<Status> compilation_status,
+      std::optional<std::unique_ptr<XlaCompiler::CompilationResult>>
+          compilation_result,
+      std::optional<std::unique_ptr<ExecutableType>> executable);
+
+  // Returns whether the cache has an entry for `key`, without counting it as a
+  // request.
+  bool Contains(const Key& key) const;
+
+  // Removes the evicted entries which hold a CompilationResult or an Executable
+  // that no Value refers to anymore, and returns them. The caller must keep
+  // them alive until the device is done running their executables.
+  std::vector<std::shared_ptr<const void>> TakeUnusedEvictedEntries();
+
+  // Returns the number of entries evicted so far.
+  int64_t num_evictions() const;
 
   std::string DebugString() const;
 
@@ -95,6 +130,12 @@ class DeviceCompilationCache {
     // executable has been built.
     std::unique_ptr<ExecutableType> executable TF_GUARDED_BY(mu);
 
+    // The age of the cache and the sequence number of the request when the
+    // entry was last requested. Guarded by the `compile_cache_mu_` of the
+    // cache.
+    int64_t age = 0;
+    int64_t last_request = 0;
+
     std::string DebugString() const {
       mutex_lock lock(mu);
       return absl::StrCat(
@@ -105,19 +146,65 @@ class DeviceCompilationCache {
     }
   };
 
+  // Returns the value of `entry` after counting a request for it.
+  static Value Request(std::shared_ptr<Entry> entry);
+
+  // Returns the entry for `key`, inserting an empty one if needed, and marks
+  // it as requested now. Inserting may evict another entry if the cache is
+  // full.
+  std::shared_ptr<Entry> FindOrInsert(const Key& key)
+      TF_EXCLUSIVE_LOCKS_REQUIRED(compile_cache_mu_);
+
+  // Evicts the entry with the lowest priority, other than `keep` and the
+  // entries being compiled, if there is one.
+  void EvictLowestPriority(const Key& keep)
+      TF_EXCLUSIVE_LOCKS_REQUIRED(compile_cache_mu_);
+
+  const int64_t max_entries_;
+
   mutable mutex compile_cache_mu_;
-  absl::flat_hash_map<Key, std::unique_ptr<Entry>, Key::Hash> cache_
+  // Entries are shared so that a thread that has looked up an entry can still
+  // use it after the entry has been evicted.
+  absl::flat_hash_map<Key, std::shared_ptr<Entry>, Key::Hash> cache_
+      TF_GUARDED_BY(compile_cache_mu_);
+  int64_t num_evictions_ TF_GUARDED_BY(compile_cache_mu_) = 0;
+
+  // The priority of the last evicted entry.
+  int64_t age_ TF_GUARDED_BY(compile_cache_mu_) = 0;
+  mutable int64_t num_requests_ TF_GUARDED_BY(compile_cache_mu_) = 0;
+
+  // The request counts of the last `max_entries_` evicted entries, and their
+  // keys in the order they were evicted.
+  absl::flat_hash_map<Key, int64_t, Key::Hash> evicted_request_counts_
+      TF_GUARDED_BY(compile_cache_mu_);
+  std::deque<Key> evicted_keys_ TF_GUARDED_BY(compile_cache_mu_);
+
+  // Evicted entries holding a CompilationResult or an Executable.
+  std::vector<std::shared_ptr<Entry>> evicted_entries_
       TF_GUARDED_BY(compile_cache_mu_);
 
   TF_DISALLOW_COPY_AND_ASSIGN(DeviceCompilationCache);
 };
 
+template <typename ExecutableType>
+typename DeviceCompilationCache<ExecutableType>::Value
+DeviceCompilationCache<ExecutableType>::Request(std::shared_ptr<Entry> entry) {
+  mutex_lock lock(entry->mu);
+  Value value = {/*compile_state=*/entry->compile_state,
+                 /*compilation_status=*/entry->compilation_status,
+                 /*request_count=*/++entry->request_count,
+                 /*compilation_result=*/entry->compilation_result.get(),
+                 /*executable=*/entry->executable.get(),
+                 /*holder=*/entry};
+  return value;
+}
+
 template <typename ExecutableType>
 std::optional<typename DeviceCompilationCache<ExecutableType>::Value>
 DeviceCompilationCache<ExecutableType>::Lookup(const Key& key) const {
   // The outer lock protects the existence of the cache entry. It does not
   // protect the contents of the cache entry.
-  Entry* entry;
+  std::shared_ptr<Entry> entry;
   {
     mutex_lock lock(compile_cache_mu_);
     // Find cache entry.
@@ -126,16 +213,12 @@ DeviceCompilationCache<ExecutableType>::Lookup(const Key& key) const {
       return std::nullopt;
     }
 
-    entry = it->second.get();
+    entry = it->second;
+    entry->age = age_;
+    entry->last_request = ++num_requests_;
   }
 
-  mutex_lock lock(entry->mu);
-  Value value = {/*compile_state=*/entry->compile_state,
-                 /*compilation_status=*/entry->compilation_status,
-                 /*request_count=*/++entry->request_count,
-                 /*compilation_result=*/entry->compilation_result.get(),
-                 /*executable=*/entry->executable.get()};
-  return value;
+  return Request(std::move(entry));
 }
 
 template <typename ExecutableType>
@@ -143,37 +226,28 @@ typename DeviceCompilationCache<ExecutableType>::Value
 DeviceCompilationCache<ExecutableType>::LookupOrCreate(const Key& key) {
   // The outer lock protects the existence of the cache entry. It does not
   // protect the contents of the cache entry.
-  Entry* entry;
+  std::shared_ptr<Entry> entry;
   {
     mutex_lock lock(compile_cache_mu_);
     // Emplace empty cache entry if not found.
-    auto it = cache_.emplace(key, std::make_unique<Entry>()).first;
-    entry = it->second.get();
+    entry = FindOrInsert(key);
   }
 
-  mutex_lock lock(entry->mu);
-  Value value = {/*compile_state=*/entry->compile_state,
-                 /*compilation_status=*/entry->compilation_status,
-                 /*request_count=*/++entry->request_count,
-                 /*compilation_result=*/entry->compilation_result.get(),
-                 /*executable=*/entry->executable.get()};
-  return value;
+  return Request(std::move(entry));
 }
 
 template <typename ExecutableType>
-void DeviceCompilationCache<ExecutableType>::Store(
+std::shared_ptr<const void> DeviceCompilationCache<ExecutableType>::Store(
     const Key& key, std::optional<DeviceCompileState> compile_state,
     std::optional<Status> compilation_status,
     std::optional<std::unique_ptr<XlaCompiler::CompilationResult>>
         compilation_result,
     std::optional<std::unique_ptr<ExecutableType>> executable) {
-  Entry* entry;
-  {
-    mutex_lock lock(compile_cache_mu_);
-    // Emplace empty cache entry if not found.
-    auto it = cache_.emplace(key, std::make_unique<Entry>()).first;
-    entry = it->second.get();
-  }
+  // Hold the outer lock while updating the entry, so that an entry which is
+  // about to be marked as being compiled can't be evicted in the meantime.
+  mutex_lock cache_lock(compile_cache_mu_);
+  // Emplace empty cache entry if not found.
+  std::shared_ptr<Entry> entry = FindOrInsert(key);
 
   {
     mutex_lock lock(entry->mu);
@@ -190,6 +264,111 @@ void DeviceCompilationCache<ExecutableType>::Store(
       entry->executable = std::move(*executable);
     }
   }
+  return entry;
+}
+
+template <typename ExecutableType>
+bool DeviceCompilationCache<ExecutableType>::Contains(const Key& key) const {
+  mutex_lock lock(compile_cache_mu_);
+  return cache_.contains(key);
+}
+
+template <typename ExecutableType>
+std::vector<std::shared_ptr<const void>>
+DeviceCompilationCache<ExecutableType>::TakeUnusedEvictedEntries() {
+  std::vector<std::shared_ptr<const void>> unused;
+  mutex_lock lock(compile_cache_mu_);
+  // Evicted entries can only be referenced through existing Values, so an entry
+  // that is only referenced here can't be used again.
+  auto used_end = std::partition(
+      evicted_entries_.begin(), evicted_entries_.end(),
+      [](const std::shared_ptr<Entry>& entry) {
+        return entry.use_count() > 1;
+      });
+  unused.assign(used_end, evicted_entries_.end());
+  evicted_entries_.erase(used_end, evicted_entries_.end());
+  return unused;
+}
+
+template <typename ExecutableType>
+std::shared_ptr<typename DeviceCompilationCache<ExecutableType>::Entry>
+DeviceCompilationCache<ExecutableType>::FindOrInsert(const Key& key) {
+  auto [it, inserted] = cache_.emplace(key, nullptr);
+  if (!inserted) {
+    it->second->age = age_;
+    it->second->last_request = ++num_requests_;
+    return it->second;
+  }
+  auto entry = std::make_shared<Entry>();
+  it->second = entry;
+  auto evicted = evicted_request_counts_.find(key);
+  if (evicted != evicted_request_counts_.end()) {
+    mutex_lock lock(entry->mu);
+    entry->request_count = evicted->second;
+  }
+  if (max_entries_ > 0 &&
+      static_cast<int64_t>(cache_.size()) > max_entries_) {
+    // `it` may be invalidated by the eviction.
+    EvictLowestPriority(key);
+  }
+  // The new entry starts at the age reached by the eviction.
+  entry->age = age_;
+  entry->last_request = ++num_requests_;
+  return entry;
+}
+
+template <typename ExecutableType>
+void DeviceCompilationCache<ExecutableType>::EvictLowestPriority(
+    const Key& keep) {
+  auto victim = cache_.end();
+  int64_t victim_priority = 0;
+  for (auto it = cache_.begin(); it != cache_.end(); ++it) {
+    if (it->first == keep) continue;
+    Entry& entry = *it->second;
+    mutex_lock lock(entry.mu);
+    if (entry.compile_state == DeviceCompileState::kCompiling) continue;
+    const int64_t priority = entry.age + entry.request_count;
+    if (victim == cache_.end() || priority < victim_priority ||
+        (priority == victim_priority &&
+         entry.last_request < victim->second->last_request)) {
+      victim = it;
+      victim_priority = priority;
+    }
+  }
+  if (victim == cache_.end()) return;
+
+  Entry& entry = *victim->second;
+  bool holds_results;
+  int64_t request_count;
+  {
+    mutex_lock lock(entry.mu);
+    holds_results =
+        entry.compilation_result != nullptr || entry.executable != nullptr;
+    request_count = entry.request_count;
+  }
+  VLOG(3) << "Evicting " << victim->first.HumanString()
+          << " from the compilation cache, request count " << request_count
+          << ", priority " << victim_priority;
+  age_ = victim_priority;
+  if (evicted_request_counts_.insert_or_assign(victim->first, request_count)
+          .second) {
+    evicted_keys_.push_back(victim->first);
+    if (static_cast<int64_t>(evicted_keys_.size()) > max_entries_) {
+      evicted_request_counts_.erase(evicted_keys_.front());
+      evicted_keys_.pop_front();
+    }
+  }
+  if (holds_results) {
+    evicted_entries_.push_back(std::move(victim->second));
+  }
+  cache_.erase(victim);
+  ++num_evictions_;
+}
+
+template <typename ExecutableType>
+int64_t DeviceCompilationCache<ExecutableType>::num_evictions() const {
+  mutex_lock lock(compile_cache_mu_);
+  return num_evictions_;
 }
 
 template <typename ExecutableType>
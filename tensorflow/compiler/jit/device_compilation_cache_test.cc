@@ -22,6 +22,7 @@ limitations under the License.
 #include <vector>
 
 #include <gtest/gtest.h>
+#include "absl/strings/str_cat.h"
 #include "tensorflow/core/platform/errors.h"
 #include "tensorflow/core/platform/test.h"
 #include "tensorflow/tsl/protobuf/error_codes.pb.h"
@@ -216,5 +217,102 @@ TEST(DeviceCompilationCacheTest, StoreMultipleEntries) {
   EXPECT_EQ(cache_value_2->executable->data, "bar_exe");
 }
 
+TEST(DeviceCompilationCacheTest, EvictsLeastRequestedUncompiledEntry) {
+  auto cache = std::make_unique<Cache>(/*max_entries=*/2);
+
+  TF_ASSERT_OK_AND_ASSIGN(auto key1, BuildSampleSignature("foo"));
+  TF_ASSERT_OK_AND_ASSIGN(auto key2, BuildSampleSignature("bar"));
+  TF_ASSERT_OK_AND_ASSIGN(auto key3, BuildSampleSignature("baz"));
+
+  cache->LookupOrCreate(key1);
+  cache->LookupOrCreate(key1);
+  cache->LookupOrCreate(key2);
+  cache->LookupOrCreate(key3);
+
+  EXPECT_EQ(cache->num_evictions(), 1);
+  EXPECT_TRUE(cache->Lookup(key1).has_value());
+  EXPECT_FALSE(cache->Lookup(key2).has_value());
+  EXPECT_TRUE(cache->Lookup(key3).has_value());
+}
+
+TEST(DeviceCompilationCacheTest, DoesNotEvictEntriesBeingCompiled) {
+  auto cache = std::make_unique<Cache>(/*max_entries=*/1);
+
+  TF_ASSERT_OK_AND_ASSIGN(auto key1, BuildSampleSignature("foo"));
+  TF_ASSERT_OK_AND_ASSIGN(auto key2, BuildSampleSignature("bar"));
+
+  cache->Store(key1, DeviceCompileState::kCompiling, std::nullopt,
+               std::nullopt, std::nullopt);
+  cache->LookupOrCreate(key2);
+
+  EXPECT_EQ(cache->num_evictions(), 0);
+  EXPECT_TRUE(cache->Contains(key1));
+  EXPECT_TRUE(cache->Contains(key2));
+}
+
+TEST(DeviceCompilationCacheTest, EvictedCompiledEntryOutlivesItsValues) {
+  auto cache = std::make_unique<Cache>(/*max_entries=*/1);
+
+  TF_ASSERT_OK_AND_ASSIGN(auto key1, BuildSampleSignature("foo"));
+  TF_ASSERT_OK_AND_ASSIGN(auto key2, BuildSampleSignature("bar"));
+
+  cache->Store(key1, DeviceCompileState::kCompiled, OkStatus(),
+               std::make_unique<XlaCompiler::CompilationResult>(),
+               std::make_unique<FakeExecutable>("foo_exe"));
+  auto cache_value = cache->Lookup(key1);
+  ASSERT_TRUE(cache_value.has_value());
+  cache->LookupOrCreate(key2);
+
+  EXPECT_EQ(cache->num_evictions(), 1);
+  EXPECT_FALSE(cache->Contains(key1));
+  EXPECT_EQ(cache_value->executable->data, "foo_exe");
+  EXPECT_TRUE(cache->TakeUnusedEvictedEntries().empty());
+
+  cache_value.reset();
+  EXPECT_EQ(cache->TakeUnusedEvictedEntries().size(), 1);
+  EXPECT_TRUE(cache->TakeUnusedEvictedEntries().empty());
+}
+
+TEST(DeviceCompilationCacheTest, RestoresRequestCountOfEvictedEntry) {
+  auto cache = std::make_unique<Cache>(/*max_entries=*/1);
+
+  TF_ASSERT_OK_AND_ASSIGN(auto key1, BuildSampleSignature("foo"));
+  TF_ASSERT_OK_AND_ASSIGN(auto key2, BuildSampleSignature("bar"));
+
+  cache->LookupOrCreate(key1);
+  cache->LookupOrCreate(key1);
+  cache->LookupOrCreate(key2);
+  EXPECT_FALSE(cache->Contains(key1));
+
+  Cache::Value cache_value = cache->LookupOrCreate(key1);
+  EXPECT_EQ(cache_value.request_count, 3);
+  EXPECT_EQ(cache->num_evictions(), 2);
+}
+
+TEST(DeviceCompilationCacheTest, AgesOutEntriesNoLongerRequested) {
+  auto cache = std::make_unique<Cache>(/*max_entries=*/2);
+
+  TF_ASSERT_OK_AND_ASSIGN(auto key1, BuildSampleSignature("foo"));
+  cache->LookupOrCreate(key1);
+  cache->LookupOrCreate(key1);
+  cache->LookupOrCreate(key1);
+
+  // Each new signature first evicts the previous one, which was requested
+  // less, until the cache has aged enough for `key1` to be evicted.
+  for (int i = 0; i < 3; ++i) {
+    TF_ASSERT_OK_AND_ASSIGN(auto key,
+                            BuildSampleSignature(absl::StrCat("bar", i)));
+    cache->LookupOrCreate(key);
+    EXPECT_TRUE(cache->Contains(key));
+  }
+  EXPECT_EQ(cache->num_evictions(), 2);
+  EXPECT_TRUE(cache->Contains(key1));
+
+  TF_ASSERT_OK_AND_ASSIGN(auto key, BuildSampleSignature("baz"));
+  cache->LookupOrCreate(key);
+  EXPECT_EQ(cache->num_evictions(), 3);
+  EXPECT_FALSE(cache->Contains(key1));
+}
+
 }  // namespace
 }  // namespace tensorflow
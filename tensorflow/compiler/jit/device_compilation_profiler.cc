@@ -194,6 +194,17 @@ bool DeviceCompilationProfiler::ShouldCompileCluster(
   return reached_compile_threshold;
 }
 
+void DeviceCompilationProfiler::RegisterAsyncCompilationFallback(
+    const NameAttrList& function) {
+  metrics::IncrementXlaAsyncCompilationFallbacks();
+
+  mutex_lock lock(mu_);
+  auto it =
+      cluster_compile_stats_.emplace(function.name(), ClusterCompileStats{})
+          .first;
+  ++it->second.async_fallback_count;
+}
+
 void DeviceCompilationProfiler::IncrementOngoingAsyncCompilations() {
   mutex_lock lock(mu_);
   num_ongoing_compilations_++;
@@ -41,6 +41,11 @@ class DeviceCompilationProfiler : public ResourceBase {
     // Cumulative time spent compiling the cluster.
     int64_t cumulative_compile_time_us = 0;
 
+    // The number of executions that took the fallback path instead of waiting
+    // for an asynchronous compilation of the cluster, i.e. compile stalls
+    // avoided.
+    int64_t async_fallback_count = 0;
+
     // True if we have decided that this cluster is too dynamic (i.e. its shapes
     // change too frequently) to profitably JIT compile.  Once a cluster is
     // tagged megamorphic, it stays megamorphic forever.
@@ -51,6 +56,7 @@ class DeviceCompilationProfiler : public ResourceBase {
           "DeviceCompilationProfiler::ClusterCompileStats {compile_count=",
           compile_count, ", execution_count=", execution_count,
           ", cumulative_compile_time_us=", cumulative_compile_time_us,
+          ", async_fallback_count=", async_fallback_count,
           ", is_megamorphic=", is_megamorphic, "}");
     }
   };
@@ -78,6 +84,10 @@ class DeviceCompilationProfiler : public ResourceBase {
                              int64_t compile_time_us,
                              bool used_persistent_cache);
 
+  // Registers an execution of the cluster that runs in the TF executor while
+  // its asynchronous compilation is queued or ongoing.
+  void RegisterAsyncCompilationFallback(const NameAttrList& function);
+
   void IncrementOngoingAsyncCompilations();
   void DecrementOngoingAsyncCompilations();
   int64_t GetNumOngoingAsyncCompilations() const;
@@ -105,6 +105,21 @@ TEST(DeviceCompilationProfilerTest, OngoingAsyncCompilations) {
   EXPECT_EQ(profiler->GetNumOngoingAsyncCompilations(), 0);
 }
 
+TEST(DeviceCompilationProfilerTest, RegisterAsyncCompilationFallback) {
+  DeviceCompilationProfiler* profiler = new DeviceCompilationProfiler();
+  core::ScopedUnref profiler_ref(profiler);
+
+  NameAttrList function;
+  function.set_name("TestFunc");
+
+  for (int i = 0; i < 3; ++i) {
+    profiler->RegisterAsyncCompilationFallback(function);
+  }
+  TF_ASSERT_OK_AND_ASSIGN(auto stats, profiler->GetCompileStats(function));
+  EXPECT_EQ(stats.async_fallback_count, 3);
+  EXPECT_EQ(stats.execution_count, 0);
+}
+
 TEST(DeviceCompilationProfilerTest, ShouldCompileClusterNotFound) {
   DeviceCompilationProfiler* profiler = new DeviceCompilationProfiler();
   core::ScopedUnref profiler_ref(profiler);
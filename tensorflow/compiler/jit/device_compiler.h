@@ -25,6 +25,7 @@ limitations under the License.
 #include <vector>
 
 #include "absl/base/call_once.h"
+#include "absl/cleanup/cleanup.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/types/optional.h"
 #include "absl/types/span.h"
@@ -98,13 +99,19 @@ class DeviceCompiler : public ResourceBase {
   // `ExecutableType` and sets `out_executable` to point to it. The
   // resulting executable pointer may be null if the computation has no
   // non-constant outputs.
+  //
+  // If `out_holder` is non-null, it is set to a reference keeping the
+  // compilation result and the executable alive until it is released, even if
+  // they are evicted from the cache in the meantime. Without it, they are only
+  // guaranteed to stay alive if the cache is unbounded.
   Status CompileIfNeeded(
       const XlaCompiler::Options& options, const NameAttrList& function,
       const std::vector<XlaCompiler::Argument>& args,
       const XlaCompiler::CompileOptions& compile_options,
       DeviceCompileMode compile_mode, DeviceCompilationProfiler* profiler,
       const XlaCompiler::CompilationResult** out_compilation_result,
-      ExecutableType** out_executable);
+      ExecutableType** out_executable,
+      std::shared_ptr<const void>* out_holder = nullptr);
 
   // As above, but for a single op.
   Status CompileSingleOpIfNeeded(
@@ -113,7 +120,8 @@ class DeviceCompiler : public ResourceBase {
       const XlaCompiler::CompileOptions& compile_options, OpKernelContext* ctx,
       DeviceCompilationProfiler* profiler,
       const XlaCompiler::CompilationResult** out_compilation_result,
-      ExecutableType** out_executable);
+      ExecutableType** out_executable,
+      std::shared_ptr<const void>* out_holder = nullptr);
 
   ClientType* client() const { return compiler_client_->client(); }
   const DeviceType& device_type() const { return persistor_->device_type(); }
@@ -131,7 +139,7 @@ class DeviceCompiler : public ResourceBase {
       DeviceCompileMode compile_mode, OpKernelContext* ctx,
       DeviceCompilationProfiler* profiler,
       const XlaCompiler::CompilationResult** out_compilation_result,
-      ExecutableType** out_executable);
+      ExecutableType** out_executable, std::shared_ptr<const void>* out_holder);
 
   StatusOr<typename DeviceCompilationCache<ExecutableType>::Value>
   CompileStrict(
@@ -153,6 +161,11 @@ class DeviceCompiler : public ResourceBase {
                              OpKernelContext* ctx,
                              DeviceCompilationProfiler* profiler);
 
+  // Drops the mutexes of the signatures evicted from the cache that are no
+  // longer in use, and destroys the evicted executables that are no longer
+  // referenced once the device is done running them.
+  void ReleaseEvictedEntries();
+
   std::unique_ptr<DeviceExecutablePersistor<ExecutableType, ClientType>>
       persistor_;
   std::unique_ptr<DeviceCompilerClient<ExecutableType, ClientType>>
@@ -163,9 +176,13 @@ class DeviceCompiler : public ResourceBase {
   std::unique_ptr<thread::ThreadPool> async_compiler_threads_;
 
   mutex cluster_mutexes_mu_;
-  absl::flat_hash_map<DeviceCompilationClusterSignature, std::unique_ptr<mutex>,
+  // The mutexes are shared so that they can be dropped along with the evicted
+  // cache entries while a compilation still holds them.
+  absl::flat_hash_map<DeviceCompilationClusterSignature, std::shared_ptr<mutex>,
                       DeviceCompilationClusterSignature::Hash>
       cluster_mutexes_ TF_GUARDED_BY(cluster_mutexes_mu_);
+  // The number of cache evictions when the mutexes were last pruned.
+  int64_t num_evictions_pruned_ TF_GUARDED_BY(cluster_mutexes_mu_) = 0;
 
   TF_DISALLOW_COPY_AND_ASSIGN(DeviceCompiler);
 };
@@ -204,7 +221,8 @@ DeviceCompiler<ExecutableType, ClientType>::DeviceCompiler(
         compiler_client)
     : persistor_(std::move(persistor)),
       compiler_client_(std::move(compiler_client)) {
-  cache_ = std::make_unique<DeviceCompilationCache<ExecutableType>>();
+  cache_ = std::make_unique<DeviceCompilationCache<ExecutableType>>(
+      GetMarkForCompilationPassFlags()->tf_xla_compilation_cache_max_entries);
   async_compiler_threads_ = std::make_unique<tensorflow::thread::ThreadPool>(
       tensorflow::Env::Default(), "async_compiler_threads",
       kNumAsyncDeviceCompilerThreads);
@@ -241,10 +259,11 @@ Status DeviceCompiler<ExecutableType, ClientType>::CompileIfNeeded(
     const XlaCompiler::CompileOptions& compile_options,
     DeviceCompileMode compile_mode, DeviceCompilationProfiler* profiler,
     const XlaCompiler::CompilationResult** out_compilation_result,
-    ExecutableType** out_executable) {
+    ExecutableType** out_executable, std::shared_ptr<const void>* out_holder) {
   return CompileImpl(compile_options, options, function, args,
                      CompileScope::kFunction, compile_mode, /*ctx=*/nullptr,
-                     profiler, out_compilation_result, out_executable);
+                     profiler, out_compilation_result, out_executable,
+                     out_holder);
 }
 
 template <typename ExecutableType, typename ClientType>
@@ -254,7 +273,7 @@ Status DeviceCompiler<ExecutableType, ClientType>::CompileSingleOpIfNeeded(
     const XlaCompiler::CompileOptions& compile_options, OpKernelContext* ctx,
     DeviceCompilationProfiler* profiler,
     const XlaCompiler::CompilationResult** out_compilation_result,
-    ExecutableType** out_executable) {
+    ExecutableType** out_executable, std::shared_ptr<const void>* out_holder) {
   const NodeDef& def = ctx->op_kernel().def();
   NameAttrList name;
   name.set_name(def.op());
@@ -265,7 +284,7 @@ Status DeviceCompiler<ExecutableType, ClientType>::CompileSingleOpIfNeeded(
   name.mutable_attr()->erase("_class");
   return CompileImpl(compile_options, options, name, args, CompileScope::kOp,
                      DeviceCompileMode::kStrict, ctx, profiler,
-                     out_compilation_result, out_executable);
+                     out_compilation_result, out_executable, out_holder);
 }
 
 template <typename ExecutableType, typename ClientType>
@@ -326,8 +345,13 @@ DeviceCompiler<ExecutableType, ClientType>::CompileStrict(
 
   cache_value.compilation_result = out_compilation_result.get();
   cache_value.executable = out_executable.get();
-  cache_->Store(sig, cache_value.compile_state, cache_value.compilation_status,
-                std::move(out_compilation_result), std::move(out_executable));
+  // The entry may have been evicted and recreated while compiling, so hold the
+  // one receiving the results.
+  cache_value.holder =
+      cache_->Store(sig, cache_value.compile_state,
+                    cache_value.compilation_status,
+                    std::move(out_compilation_result),
+                    std::move(out_executable));
 
   const uint64 compile_end_us = env->NowMicros();
   const uint64 compile_time_us = compile_end_us - compile_start_us;
@@ -391,7 +415,7 @@ Status DeviceCompiler<ExecutableType, ClientType>::CompileImpl(
     DeviceCompileMode compile_mode, OpKernelContext* ctx,
     DeviceCompilationProfiler* profiler,
     const XlaCompiler::CompilationResult** out_compilation_result,
-    ExecutableType** out_executable) {
+    ExecutableType** out_executable, std::shared_ptr<const void>* out_holder) {
   DCHECK_NE(out_executable, nullptr);
   VLOG(2) << "DeviceCompiler::Compile " << DebugString();
 
@@ -404,13 +428,18 @@ Status DeviceCompiler<ExecutableType, ClientType>::CompileImpl(
   TF_ASSIGN_OR_RETURN(auto signature,
                       DeviceCompilationClusterSignature::Build(function, args));
 
+  // Entries evicted by this compilation are released once the cluster mutex
+  // below is no longer held.
+  auto release_evicted_entries =
+      absl::MakeCleanup([this] { ReleaseEvictedEntries(); });
+
   // The outer lock protects the existence of the mutex in the map.
-  mutex* cluster_mutex;
+  std::shared_ptr<mutex> cluster_mutex;
   {
     mutex_lock lock(cluster_mutexes_mu_);
-    auto it =
-        cluster_mutexes_.emplace(signature, std::make_unique<mutex>()).first;
-    cluster_mutex = it->second.get();
+    auto [it, inserted] = cluster_mutexes_.emplace(signature, nullptr);
+    if (inserted) it->second = std::make_shared<mutex>();
+    cluster_mutex = it->second;
   }
 
   profiler->RegisterExecution(function);
@@ -422,8 +451,6 @@ Status DeviceCompiler<ExecutableType, ClientType>::CompileImpl(
   }
 
   // Acquire the cache entry lock and compile, if necessary.
-  // TODO(phawkins): this locking will need to be restructured when we implement
-  // cache eviction.
   mutex_lock cluster_compile_lock(*cluster_mutex);
   auto cache_value = cache_->LookupOrCreate(signature);
 
@@ -465,17 +492,20 @@ Status DeviceCompiler<ExecutableType, ClientType>::CompileImpl(
       TF_RETURN_IF_ERROR(CompileAsynchronous(signature, compile_options,
                                              options, args, function, scope,
                                              ctx, profiler));
+      profiler->RegisterAsyncCompilationFallback(function);
       return OkStatus();
     } else {
       VLOG(2) << "Instantly compiling for signature: " << human_signature;
       TF_ASSIGN_OR_RETURN(
           cache_value,
           CompileStrict(signature, compile_options, options, args, function,
-                        cache_value, scope, ctx, profiler, cluster_mutex));
+                        cache_value, scope, ctx, profiler,
+                        cluster_mutex.get()));
     }
   } else if (state == DeviceCompileState::kCompiling) {
     VLOG(2) << "Ongoing asynchronous compilation for signature: "
             << human_signature;
+    profiler->RegisterAsyncCompilationFallback(function);
     return OkStatus();
   } else if (state == DeviceCompileState::kCompiled) {
     VLOG(2) << "Already Compiled for signature: " << human_signature;
@@ -484,9 +514,41 @@ Status DeviceCompiler<ExecutableType, ClientType>::CompileImpl(
   TF_RETURN_IF_ERROR(cache_value.compilation_status);
   *out_compilation_result = cache_value.compilation_result;
   *out_executable = cache_value.executable;
+  if (out_holder != nullptr) {
+    *out_holder = std::move(cache_value.holder);
+  }
   return OkStatus();
 }
 
+template <typename ExecutableType, typename ClientType>
+void DeviceCompiler<ExecutableType, ClientType>::ReleaseEvictedEntries() {
+  {
+    mutex_lock lock(cluster_mutexes_mu_);
+    const int64_t num_evictions = cache_->num_evictions();
+    if (num_evictions != num_evictions_pruned_) {
+      num_evictions_pruned_ = num_evictions;
+      // Mutexes are only copied out of the map under `cluster_mutexes_mu_`, so
+      // one referenced by the map alone isn't held, and a new one is created if
+      // its signature is requested again.
+      absl::erase_if(cluster_mutexes_, [&](const auto& signature_and_mutex) {
+        return signature_and_mutex.second.use_count() == 1 &&
+               !cache_->Contains(signature_and_mutex.first);
+      });
+    }
+  }
+
+  std::vector<std::shared_ptr<const void>> evicted_entries =
+      cache_->TakeUnusedEvictedEntries();
+  if (evicted_entries.empty()) return;
+  VLOG(2) << "Releasing " << evicted_entries.size()
+          << " evicted compilation cache entries";
+  // Executions may still be running the evicted executables on the device, as
+  // with the ones destroyed along with the cache.
+  async_compiler_threads_->Schedule([this, evicted_entries] {
+    compiler_client_->WaitForProgramsToFinish();
+  });
+}
+
 }  // namespace tensorflow
 
 #endif  // TENSORFLOW_COMPILER_JIT_DEVICE_COMPILER_H_
@@ -154,7 +154,12 @@ void AppendMarkForCompilationPassFlagsInternal(std::vector<Flag>* flag_list) {
       Flag("tf_xla_persistent_cache_prefix",
            &mark_for_compilation_flags->tf_xla_persistent_cache_prefix,
            "Specifies the persistance cache prefix. Default is "
-           "\"xla_compile_cache\"")};
+           "\"xla_compile_cache\""),
+      Flag("tf_xla_compilation_cache_max_entries",
+           &mark_for_compilation_flags->tf_xla_compilation_cache_max_entries,
+           "If positive, bounds the number of entries of the XLA compilation "
+           "cache by evicting the least frequently requested entries. "
+           "Defaults to 0 (unbounded).")};
   flag_list->insert(flag_list->end(), new_flags.begin(), new_flags.end());
 }
 
@@ -165,7 +170,9 @@ void AllocateAndParseJitRtFlags() {
   jitrt_flags->enable_crash_reproducer = false;
   jitrt_flags->enable_xla_cpu_transformations = false;
   jitrt_flags->log_query_of_death = false;
+  jitrt_flags->max_specializations = 0;
   jitrt_flags->pack_matmul = false;
+  jitrt_flags->specialization_threshold = 1;
   jitrt_flags->vectorize = false;
   jitrt_flag_list = new std::vector<Flag>({
       Flag("always_specialize", &jitrt_flags->always_specialize, ""),
@@ -176,7 +183,13 @@ void AllocateAndParseJitRtFlags() {
       Flag("enable_xla_cpu_transformations",
            &jitrt_flags->enable_xla_cpu_transformations, ""),
       Flag("log_query_of_death", &jitrt_flags->log_query_of_death, ""),
+      Flag("max_specializations", &jitrt_flags->max_specializations,
+           "Maximum number of executables specialized to the operand shapes "
+           "of a cluster with a default executable. 0 means unbounded."),
       Flag("pack_matmul", &jitrt_flags->pack_matmul, ""),
+      Flag("specialization_threshold", &jitrt_flags->specialization_threshold,
+           "Number of calls with the same operand shapes before a cluster "
+           "with a default executable is specialized to them."),
       Flag("vectorize", &jitrt_flags->vectorize, ""),
   });
   xla::ParseFlagsFromEnvAndDieIfUnknown("TF_JITRT_FLAGS", *jitrt_flag_list);
@@ -189,6 +202,8 @@ void AllocateAndParseFlags() {
   build_ops_flags->tf_xla_check_cluster_input_numerics = false;
   build_ops_flags->tf_xla_check_cluster_output_numerics = false;
   build_ops_flags->tf_xla_disable_constant_folding = false;
+  build_ops_flags->tf_xla_shape_bucket_size = 0;
+  build_ops_flags->tf_xla_geometric_shape_buckets = false;
 
   mark_for_compilation_flags = new MarkForCompilationPassFlags;
   mark_for_compilation_flags->xla_auto_jit_flag.optimization_level_single_gpu =
@@ -210,6 +225,7 @@ void AllocateAndParseFlags() {
   mark_for_compilation_flags->tf_xla_disable_strict_signature_checks = false;
   mark_for_compilation_flags->tf_xla_persistent_cache_prefix =
       "xla_compile_cache";
+  mark_for_compilation_flags->tf_xla_compilation_cache_max_entries = 0;
 
   device_flags = new XlaDeviceFlags;
   device_flags->tf_xla_compile_on_demand = false;
@@ -254,6 +270,19 @@ void AllocateAndParseFlags() {
             &build_ops_flags->tf_xla_disable_constant_folding,
             "If true then disables constant folding on TF graph before XLA "
             "compilation."),
+       Flag("tf_xla_shape_bucket_size",
+            &build_ops_flags->tf_xla_shape_bucket_size,
+            "If positive, the inputs of the XLA clusters which compute their "
+            "outputs row by row along a dynamic first dimension are padded "
+            "along it to a multiple of this size, and their outputs sliced "
+            "back, so that the clusters are compiled once per bucket of "
+            "sizes. Defaults to 0 (no bucketing)."),
+       Flag("tf_xla_geometric_shape_buckets",
+            &build_ops_flags->tf_xla_geometric_shape_buckets,
+            "If true, the shape buckets of tf_xla_shape_bucket_size grow "
+            "geometrically: the first dimension is padded to the smallest "
+            "multiple of tf_xla_shape_bucket_size by a power of two that "
+            "holds it."),
 
        Flag("tf_xla_compile_on_demand", &device_flags->tf_xla_compile_on_demand,
             "Switch a device into 'on-demand' mode, where instead of "
@@ -101,6 +101,11 @@ struct MarkForCompilationPassFlags {
 
   // Specifies the persistance cache prefix. Default is "xla_compile_cache"
   string tf_xla_persistent_cache_prefix;
+
+  // If positive, bounds the number of entries of the in-memory XLA compilation
+  // cache by evicting the least frequently requested entries. Defaults to 0,
+  // i.e. unbounded.
+  int64_t tf_xla_compilation_cache_max_entries;
 };
 
 // Flags associated with the XLA bridge's xla_device module.
@@ -149,6 +154,18 @@ struct BuildXlaOpsPassFlags {
   // Disables all constant folding. The primary use for this is for testing to
   // guarantee that tests are run on XLA and not on TF's CPU implementation.
   bool tf_xla_disable_constant_folding;
+
+  // If positive, the inputs of the clusters that compute their outputs row by
+  // row along a dynamic first dimension are padded along it to a multiple of
+  // this size, and their outputs sliced back, so that the clusters are only
+  // compiled once per bucket of sizes. Defaults to 0, i.e. no bucketing.
+  int64_t tf_xla_shape_bucket_size;
+
+  // If true, the shape buckets grow geometrically from
+  // tf_xla_shape_bucket_size, i.e. are multiples of it by powers of two, so
+  // that the clusters are compiled a logarithmic number of times in the sizes
+  // they see, and at most twice as many rows are computed.
+  bool tf_xla_geometric_shape_buckets;
 };
 
 // Flags for common MLIR configurations.
@@ -164,6 +181,13 @@ struct JitRtFlags {
   bool always_specialize;
   bool cost_driven_async_parallel_for;
 
+  // Unless `always_specialize` is set, the number of calls with the same
+  // operand shapes that run the shape-polymorphic default executable before a
+  // specialized executable is compiled for them, and the maximum number of
+  // specialized executables per cluster (0 means unbounded).
+  int32 specialization_threshold;
+  int32 max_specializations;
+
   // Enables tracking of the "live" JitRt queries to, on a crash, identify the
   // "query of death". See TfJitRtQueryOfDeathLogger.
   bool log_query_of_death;
@@ -83,15 +83,21 @@ auto* xla_launch_counter = monitoring::Counter<1>::New(
 // the initial values for the resource variables (and cannot snapshot them again
 // during execution) because otherwise we risk observing a different snapshot
 // with shapes different from what we compiled for.
+//
+// `executable_holder` keeps the executable and the compilation result alive
+// while the closure waits for its _XlaRun, should they be evicted from the
+// compilation cache in the meantime.
 class XlaExecutableClosure {
  public:
   explicit XlaExecutableClosure(
       xla::LocalClient* client, xla::LocalExecutable* executable,
       const XlaCompiler::CompilationResult* compilation_result,
+      std::shared_ptr<const void> executable_holder,
       ResourceVarsSnapshot resource_var_snapshots, int num_constant_args)
       : client_(client),
         executable_(executable),
         compilation_result_(compilation_result),
+        executable_holder_(std::move(executable_holder)),
         resource_var_snapshots_(std::move(resource_var_snapshots)),
         num_constant_args_(num_constant_args) {}
 
@@ -112,6 +118,7 @@ class XlaExecutableClosure {
   xla::LocalClient* client_;
   xla::LocalExecutable* executable_;
   const XlaCompiler::CompilationResult* compilation_result_;
+  std::shared_ptr<const void> executable_holder_;
   ResourceVarsSnapshot resource_var_snapshots_;
   int num_constant_args_;
 
@@ -251,7 +258,8 @@ static Status CompileToLocalExecutable(
     DeviceCompileMode compile_mode, bool may_alias_resource_update,
     xla::LocalClient** client,
     const XlaCompiler::CompilationResult** compilation_result,
-    xla::LocalExecutable** executable) {
+    xla::LocalExecutable** executable,
+    std::shared_ptr<const void>* executable_holder) {
   // We store information about the JIT-compiled XLA computation
   // in the ResourceMgr.
   ResourceMgr* rm = ctx->resource_manager();
@@ -295,7 +303,7 @@ static Status CompileToLocalExecutable(
 
   return xla_device_compiler->CompileIfNeeded(
       options, function, args, compile_options, compile_mode, profiler,
-      compilation_result, executable);
+      compilation_result, executable, executable_holder);
 }
 
 // Get-or-create thread pool for a given collective.
@@ -328,6 +336,7 @@ void XlaLocalLaunchBase::ComputeAsync(OpKernelContext* ctx, DoneCallback done) {
   xla::LocalClient* client;
   const XlaCompiler::CompilationResult* compilation_result;
   xla::LocalExecutable* executable;
+  std::shared_ptr<const void> executable_holder;
   std::vector<XlaCompiler::Argument> xla_compiler_args;
 
   // Note that here we assume the shape of the variables don't change between
@@ -358,12 +367,13 @@ void XlaLocalLaunchBase::ComputeAsync(OpKernelContext* ctx, DoneCallback done) {
       ctx, function_, /*has_ref_vars=*/has_ref_vars_, platform_info_,
       xla_compiler_args, DeviceCompileMode::kStrict,
       /*may_alias_resource_update=*/true, &client, &compilation_result,
-      &executable);
+      &executable, &executable_holder);
   OP_REQUIRES_OK_ASYNC(ctx, status, done);
 
   // Continuation of the execution, may be run in a different thread.
-  auto run_xla_cluster = [ctx, client, executable, compilation_result, done,
-                          inputs, resources = resources_]() {
+  auto run_xla_cluster = [ctx, client, executable, compilation_result,
+                          executable_holder, done, inputs,
+                          resources = resources_]() {
     auto platform_info = XlaPlatformInfoFromDevice(ctx->device());
     std::vector<VariableInfo> variable_infos;
     std::set<int> variables_updated;
@@ -518,6 +528,7 @@ void XlaCompileOp::Compute(OpKernelContext* ctx) {
   xla::LocalClient* client;
   const XlaCompiler::CompilationResult* kernel;
   xla::LocalExecutable* executable;
+  std::shared_ptr<const void> executable_holder;
   ResourceVarsSnapshot variables_snapshot;
 
   std::vector<const Tensor*> inputs = InputsFromContext(ctx);
@@ -550,7 +561,8 @@ void XlaCompileOp::Compute(OpKernelContext* ctx) {
     // unlocking them in XlaRun may lead to deadlocks.
     const Status status = CompileToLocalExecutable(
         ctx, function_, has_ref_vars_, platform_info_, args, compile_mode,
-        /*may_alias_resource_update=*/false, &client, &kernel, &executable);
+        /*may_alias_resource_update=*/false, &client, &kernel, &executable,
+        &executable_holder);
     if (compile_mode != DeviceCompileMode::kLazy ||
         status.code() != error::UNIMPLEMENTED) {
       OP_REQUIRES_OK(ctx, status);
@@ -592,8 +604,8 @@ void XlaCompileOp::Compute(OpKernelContext* ctx) {
   // variables.
   XlaExecutableClosureStore::KeyT key =
       XlaExecutableClosureStore::Global()->Produce(XlaExecutableClosure(
-          client, executable, kernel, std::move(variables_snapshot),
-          constants_.size()));
+          client, executable, kernel, std::move(executable_holder),
+          std::move(variables_snapshot), constants_.size()));
 
   Tensor compilation_key(cpu_allocator, DT_STRING, TensorShape({}));
   compilation_key.flat<tstring>()(0) = key;
@@ -0,0 +1,355 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/compiler/jit/shape_bucketing.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/strings/string_view.h"
+#include "tensorflow/compiler/jit/shape_inference.h"
+#include "tensorflow/compiler/xla/status_macros.h"
+#include "tensorflow/compiler/xla/union_find.h"
+#include "tensorflow/core/common_runtime/function_body.h"
+#include "tensorflow/core/common_runtime/function_def_utils.h"
+#include "tensorflow/core/framework/node_def_util.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/graph/algorithm.h"
+#include "tensorflow/core/graph/graph.h"
+
+namespace tensorflow {
+namespace {
+
+// The value of `row_arg` for tensors which don't depend on the arguments.
+constexpr int kInvariant = -1;
+
+// Elementwise ops, with broadcasting for the ones taking several operands.
+bool IsElementwiseOp(absl::string_view op) {
+  static const auto* const kOps = new absl::flat_hash_set<absl::string_view>({
+      "Abs",          "Acos",              "Acosh",        "Add",
+      "AddN",         "AddV2",             "Asin",         "Asinh",
+      "Atan",         "Atanh",             "BiasAdd",      "Cast",
+      "Ceil",         "ClipByValue",       "Cos",          "Cosh",
+      "Div",          "DivNoNan",          "Elu",          "Equal",
+      "Erf",          "Erfc",              "Exp",          "Expm1",
+      "Floor",        "FloorDiv",          "FloorMod",     "Greater",
+      "GreaterEqual", "Identity",          "IsFinite",     "IsInf",
+      "IsNan",        "LeakyRelu",         "Less",         "LessEqual",
+      "Log",          "Log1p",             "LogicalAnd",   "LogicalNot",
+      "LogicalOr",    "Maximum",           "Minimum",      "Mod",
+      "Mul",          "MulNoNan",          "Neg",          "NotEqual",
+      "Pow",          "RealDiv",           "Reciprocal",   "Relu",
+      "Relu6",        "Round",             "Rsqrt",        "SelectV2",
+      "Selu",         "Sigmoid",           "Sign",         "Sin",
+      "Sinh",         "Softplus",          "Softsign",     "Sqrt",
+      "Square",       "SquaredDifference", "StopGradient", "Sub",
+      "Tan",          "Tanh",              "Xdivy",        "Xlogy",
+  });
+  return kOps->contains(op);
+}
+
+// Ops whose first input is a batch of independent samples along its first
+// dimension, e.g. convolutions, while their other inputs are weights or sizes.
+bool IsBatchOp(absl::string_view op) {
+  static const auto* const kOps = new absl::flat_hash_set<absl::string_view>({
+      "AvgPool",
+      "AvgPool3D",
+      "Conv2D",
+      "Conv3D",
+      "DepthwiseConv2dNative",
+      "MaxPool",
+      "MaxPool3D",
+      "MaxPoolV2",
+  });
+  return kOps->contains(op);
+}
+
+// Ops reducing their first input along the axes given by their second input.
+bool IsReductionOp(absl::string_view op) {
+  static const auto* const kOps = new absl::flat_hash_set<absl::string_view>({
+      "All",
+      "Any",
+      "ArgMax",
+      "ArgMin",
+      "EuclideanNorm",
+      "Max",
+      "Mean",
+      "Min",
+      "Prod",
+      "Sum",
+  });
+  return kOps->contains(op);
+}
+
+// Infers which tensors of a cluster are computed row by row along the first
+// dimension of its arguments.
+class RowwiseAnalysis {
+ public:
+  // Only the arguments whose first dimension is unknown in `arg_shapes` are
+  // row-wise, the others are invariant.
+  RowwiseAnalysis(const Graph& graph, const GraphShapeInfo& shape_info,
+                  absl::Span<const PartialTensorShape> arg_shapes)
+      : shape_info_(shape_info),
+        row_arg_(graph.num_node_ids(), kInvariant),
+        arg_rows_(arg_shapes.size()) {
+    for (int i = 0; i < arg_shapes.size(); ++i) {
+      padded_args_.push_back(arg_shapes[i].dim_size(0) < 0);
+      arg_rows_[i].Get() = i;
+    }
+  }
+
+  // Returns whether `n` is row-wise, or invariant, and records which. Its
+  // inputs must have been visited.
+  bool Visit(const Node& n);
+
+  // Returns whether the row-wise tensors all have the same number of rows.
+  bool HaveSameRows();
+
+  // Returns which arguments are row-wise, and so padded.
+  const std::vector<bool>& padded_args() const { return padded_args_; }
+
+  // Returns the rank of output `index` of `n`, or -1 if it is unknown.
+  int Rank(const Node& n, int index) const;
+
+  bool IsRowwise(const Edge& e) const {
+    return row_arg_[e.src()->id()] != kInvariant;
+  }
+
+ private:
+  // Returns whether the ranks of the operands of elementwise op `n` broadcast
+  // its row-wise operands along their first dimension.
+  bool BroadcastsRows(const Node& n,
+                      absl::Span<const Edge* const> inputs) const;
+
+  // Returns whether the axes given by input `e` may include the first
+  // dimension of a tensor of rank `rank`, i.e. unless they are constant and
+  // don't.
+  bool MayIncludeRows(const Edge& e, int rank) const;
+
+  bool IsRowwiseOp(const Node& n, absl::Span<const Edge* const> inputs) const;
+
+  const GraphShapeInfo& shape_info_;
+  // For each argument, whether it is row-wise.
+  std::vector<bool> padded_args_;
+  // For each node, the argument whose rows it follows, or kInvariant.
+  std::vector<int> row_arg_;
+  // The arguments which must have the same number of rows.
+  std::vector<UnionFind<int>> arg_rows_;
+};
+
+bool RowwiseAnalysis::HaveSameRows() {
+  // The value of a set of arguments is one of them.
+  int rows = -1;
+  for (int i = 0; i < padded_args_.size(); ++i) {
+    if (!padded_args_[i]) continue;
+    if (rows == -1) {
+      rows = arg_rows_[i].Get();
+    } else if (arg_rows_[i].Get() != rows) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int RowwiseAnalysis::Rank(const Node& n, int index) const {
+  auto it = shape_info_.find(n.name());
+  if (it == shape_info_.end() || index >= it->second.size()) return -1;
+  const PartialTensorShape& shape = it->second[index].shape;
+  return shape.unknown_rank() ? -1 : shape.dims();
+}
+
+bool RowwiseAnalysis::BroadcastsRows(
+    const Node& n, absl::Span<const Edge* const> inputs) const {
+  const int rank = Rank(n, 0);
+  if (rank < 1) return false;
+  for (const Edge* e : inputs) {
+    const int input_rank = Rank(*e->src(), e->src_output());
+    if (IsRowwise(*e)) {
+      if (input_rank != rank) return false;
+    } else if (input_rank < 0 || input_rank > rank) {
+      return false;
+    } else if (input_rank == rank) {
+      // An invariant operand of the same rank must broadcast along the rows.
+      const PartialTensorShape& shape =
+          shape_info_.at(e->src()->name())[e->src_output()].shape;
+      if (shape.dim_size(0) != 1) return false;
+    }
+  }
+  return true;
+}
+
+bool RowwiseAnalysis::MayIncludeRows(const Edge& e, int rank) const {
+  if (rank < 1 || !e.src()->IsConstant()) return true;
+  const TensorProto* proto;
+  Tensor axes;
+  if (!TryGetNodeAttr(e.src()->attrs(), "value", &proto) ||
+      !axes.FromProto(*proto)) {
+    return true;
+  }
+  for (int64_t i = 0; i < axes.NumElements(); ++i) {
+    int64_t axis;
+    if (axes.dtype() == DT_INT32) {
+      axis = axes.flat<int32>()(i);
+    } else if (axes.dtype() == DT_INT64) {
+      axis = axes.flat<int64_t>()(i);
+    } else {
+      return true;
+    }
+    if (axis == 0 || axis == -rank) return true;
+  }
+  return false;
+}
+
+bool RowwiseAnalysis::IsRowwiseOp(const Node& n,
+                                  absl::Span<const Edge* const> inputs) const {
+  const std::string& op = n.type_string();
+  if (IsElementwiseOp(op)) {
+    return BroadcastsRows(n, inputs);
+  }
+  if (op == "Softmax" || op == "LogSoftmax") {
+    // Normalizes along the last dimension, which must not be the rows.
+    return Rank(n, 0) >= 2;
+  }
+  if (op == "MatMul") {
+    bool transpose_a;
+    return inputs.size() == 2 && IsRowwise(*inputs[0]) &&
+           !IsRowwise(*inputs[1]) &&
+           TryGetNodeAttr(n.attrs(), "transpose_a", &transpose_a) &&
+           !transpose_a;
+  }
+  if (IsBatchOp(op)) {
+    return IsRowwise(*inputs[0]) &&
+           std::none_of(inputs.begin() + 1, inputs.end(),
+                        [&](const Edge* e) { return IsRowwise(*e); });
+  }
+  if (IsReductionOp(op)) {
+    return inputs.size() == 2 && IsRowwise(*inputs[0]) &&
+           !IsRowwise(*inputs[1]) &&
+           !MayIncludeRows(*inputs[1],
+                           Rank(*inputs[0]->src(), inputs[0]->src_output()));
+  }
+  if (op == "ConcatV2") {
+    const Edge* axis = inputs.back();
+    return Rank(n, 0) >= 1 && !IsRowwise(*axis) &&
+           !MayIncludeRows(*axis, Rank(n, 0)) &&
+           std::all_of(inputs.begin(), inputs.end() - 1,
+                       [&](const Edge* e) { return IsRowwise(*e); });
+  }
+  return false;
+}
+
+bool RowwiseAnalysis::Visit(const Node& n) {
+  if (n.IsArg()) {
+    int index;
+    if (!TryGetNodeAttr(n.attrs(), "index", &index) || index < 0 ||
+        index >= arg_rows_.size()) {
+      return false;
+    }
+    row_arg_[n.id()] = padded_args_[index] ? index : kInvariant;
+    return true;
+  }
+  if (n.op_def().is_stateful() || n.IsControlFlow()) {
+    return false;
+  }
+
+  std::vector<const Edge*> inputs;
+  if (!n.input_edges(&inputs).ok()) return false;
+  // Nodes which don't depend on the arguments stay invariant, e.g. constants.
+  if (std::none_of(inputs.begin(), inputs.end(),
+                   [&](const Edge* e) { return IsRowwise(*e); })) {
+    row_arg_[n.id()] = kInvariant;
+    return true;
+  }
+  if (!IsRowwiseOp(n, inputs)) {
+    VLOG(3) << "Shape bucketing: " << n.name() << " (" << n.type_string()
+            << ") may mix the rows of its inputs";
+    return false;
+  }
+
+  int arg = kInvariant;
+  for (const Edge* e : inputs) {
+    if (!IsRowwise(*e)) continue;
+    const int input_arg = row_arg_[e->src()->id()];
+    if (arg == kInvariant) {
+      arg = input_arg;
+    } else {
+      // The operands of a row-wise op have the same number of rows.
+      arg_rows_[arg].Merge(&arg_rows_[input_arg]);
+    }
+  }
+  row_arg_[n.id()] = arg;
+  return true;
+}
+
+}  // namespace
+
+StatusOr<std::optional<ShapeBucketingInfo>> AnalyzeShapeBucketing(
+    const NameAttrList& function,
+    absl::Span<const PartialTensorShape> arg_shapes,
+    const FunctionLibraryDefinition& flib_def) {
+  ShapeBucketingInfo info;
+  std::map<int, InferredShape> inferred_arg_shapes;
+  bool has_dynamic_rows = false;
+  for (int i = 0; i < arg_shapes.size(); ++i) {
+    const PartialTensorShape& shape = arg_shapes[i];
+    if (shape.unknown_rank() || shape.dims() == 0) return {std::nullopt};
+    has_dynamic_rows |= shape.dim_size(0) < 0;
+    inferred_arg_shapes[i].shape = shape;
+    info.arg_ranks.push_back(shape.dims());
+  }
+  if (!has_dynamic_rows) return {std::nullopt};
+
+  const FunctionDef* fdef = flib_def.Find(function.name());
+  TF_RET_CHECK(fdef) << "Could not find " << function.name();
+  std::unique_ptr<FunctionBody> fbody;
+  TF_RETURN_IF_ERROR(FunctionDefToBodyHelper(
+      *fdef, AttrSlice(&function.attr()), &flib_def, &fbody));
+  if (fbody->arg_nodes.size() != arg_shapes.size()) return {std::nullopt};
+
+  GraphShapeInfo shape_info;
+  TF_RETURN_IF_ERROR(InferShapes(fbody->graph, inferred_arg_shapes, &flib_def,
+                                 &shape_info));
+
+  RowwiseAnalysis analysis(*fbody->graph, shape_info, arg_shapes);
+  std::vector<Node*> order;
+  GetReversePostOrder(*fbody->graph, &order);
+  info.result_ranks.resize(fbody->ret_nodes.size(), -1);
+  for (Node* n : order) {
+    if (!n->IsOp()) continue;
+    if (!n->IsRetval()) {
+      if (!analysis.Visit(*n)) return {std::nullopt};
+      continue;
+    }
+    // Results must have the rows of the arguments, to be sliced back.
+    const Edge* e;
+    int index;
+    TF_RETURN_IF_ERROR(n->input_edge(0, &e));
+    TF_RETURN_IF_ERROR(GetNodeAttr(n->attrs(), "index", &index));
+    TF_RET_CHECK(index >= 0 && index < info.result_ranks.size());
+    if (!analysis.IsRowwise(*e)) return {std::nullopt};
+    info.result_ranks[index] = analysis.Rank(*e->src(), e->src_output());
+    if (info.result_ranks[index] < 1) return {std::nullopt};
+  }
+  if (!analysis.HaveSameRows()) return {std::nullopt};
+  info.padded_args = analysis.padded_args();
+  return {std::move(info)};
+}
+
+}  // namespace tensorflow
@@ -0,0 +1,68 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_COMPILER_JIT_SHAPE_BUCKETING_H_
+#define TENSORFLOW_COMPILER_JIT_SHAPE_BUCKETING_H_
+
+#include <optional>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "tensorflow/compiler/xla/statusor.h"
+#include "tensorflow/core/framework/attr_value.pb.h"
+#include "tensorflow/core/framework/function.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+
+namespace tensorflow {
+
+// The ranks of the arguments and results of a cluster that can be computed on
+// arguments padded along their first dimension, see AnalyzeShapeBucketing.
+struct ShapeBucketingInfo {
+  std::vector<int> arg_ranks;
+  std::vector<int> result_ranks;
+  // Whether each argument is padded, i.e. whether its first dimension is the
+  // dynamic batch dimension. The other arguments, e.g. a bias of shape [1, n]
+  // broadcast along the rows, are passed as they are.
+  std::vector<bool> padded_args;
+};
+
+// Returns whether the cluster function `function`, called with arguments of
+// shapes `arg_shapes`, computes its results row by row along the first
+// dimension of its arguments, i.e. whether padding its arguments whose first
+// dimension is unknown with the same number of rows along that dimension only
+// pads its results with as many rows, leaving the other rows unchanged.
+//
+// That is the case when the first dimension is a batch (or sequence) dimension
+// that the cluster doesn't mix, e.g. for elementwise ops, reductions over the
+// other dimensions, MatMul by constant weights or convolutions. Arguments with
+// a known first dimension are not padded, and may only be broadcast along the
+// rows. The analysis is conservative: it only accepts a known set of ops. It
+// also requires the first dimension of at least one argument to be unknown in
+// `arg_shapes`, since bucketing is pointless otherwise.
+//
+// The padded arguments are only known to have the same number of rows if they
+// have any. Without broadcasting, the cluster would fail otherwise, but an
+// argument with a single row may be broadcast, so callers must only pad the
+// arguments when they have the same number of rows.
+//
+// Returns std::nullopt if the cluster can't be bucketed.
+StatusOr<std::optional<ShapeBucketingInfo>> AnalyzeShapeBucketing(
+    const NameAttrList& function,
+    absl::Span<const PartialTensorShape> arg_shapes,
+    const FunctionLibraryDefinition& flib_def);
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_COMPILER_JIT_SHAPE_BUCKETING_H_
@@ -0,0 +1,144 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/compiler/jit/shape_bucketing.h"
+
+#include <optional>
+#include <vector>
+
+#include "tensorflow/core/framework/function.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace {
+
+using FDH = FunctionDefHelper;
+
+// f(x) = (Relu(x * w + b), Sum(x, axis)) for float x of shape [?, 4].
+FunctionDef RowwiseFunction(int axis) {
+  return FDH::Create(
+      "Rowwise", {"x: float"}, {"y: float", "z: float"}, {},
+      {{{"w"},
+        "Const",
+        {},
+        {{"dtype", DT_FLOAT},
+         {"value", test::AsTensor<float>({1, 2, 3, 4, 5, 6, 7, 8},
+                                         TensorShape({4, 2}))}}},
+       FDH::Const<float>("b", {0.5f, -0.5f}),
+       FDH::Const<int32>("axis", axis),
+       {{"matmul"},
+        "MatMul",
+        {"x", "w:output:0"},
+        {{"T", DT_FLOAT}, {"transpose_a", false}, {"transpose_b", false}}},
+       {{"add"}, "BiasAdd", {"matmul:product:0", "b:output:0"},
+        {{"T", DT_FLOAT}}},
+       {{"relu"}, "Relu", {"add:output:0"}, {{"T", DT_FLOAT}}},
+       {{"sum"},
+        "Sum",
+        {"x", "axis:output:0"},
+        {{"T", DT_FLOAT}, {"Tidx", DT_INT32}, {"keep_dims", false}}}},
+      {{"y", "relu:activations:0"}, {"z", "sum:output:0"}});
+}
+
+StatusOr<std::optional<ShapeBucketingInfo>> Analyze(
+    const FunctionDef& fdef, std::vector<PartialTensorShape> arg_shapes) {
+  FunctionDefLibrary fdef_lib;
+  *fdef_lib.add_function() = fdef;
+  FunctionLibraryDefinition flib_def(OpRegistry::Global(), fdef_lib);
+  NameAttrList function;
+  function.set_name(fdef.signature().name());
+  return AnalyzeShapeBucketing(function, arg_shapes, flib_def);
+}
+
+TEST(ShapeBucketingTest, BucketsRowwiseCluster) {
+  TF_ASSERT_OK_AND_ASSIGN(std::optional<ShapeBucketingInfo> info,
+                          Analyze(RowwiseFunction(/*axis=*/1),
+                                  {PartialTensorShape({-1, 4})}));
+  ASSERT_TRUE(info.has_value());
+  EXPECT_EQ(info->arg_ranks, std::vector<int>({2}));
+  EXPECT_EQ(info->result_ranks, std::vector<int>({2, 1}));
+  EXPECT_EQ(info->padded_args, std::vector<bool>({true}));
+}
+
+TEST(ShapeBucketingTest, RejectsReductionOverRows) {
+  TF_ASSERT_OK_AND_ASSIGN(std::optional<ShapeBucketingInfo> info,
+                          Analyze(RowwiseFunction(/*axis=*/0),
+                                  {PartialTensorShape({-1, 4})}));
+  EXPECT_FALSE(info.has_value());
+}
+
+TEST(ShapeBucketingTest, RejectsStaticShapes) {
+  TF_ASSERT_OK_AND_ASSIGN(std::optional<ShapeBucketingInfo> info,
+                          Analyze(RowwiseFunction(/*axis=*/1),
+                                  {PartialTensorShape({8, 4})}));
+  EXPECT_FALSE(info.has_value());
+}
+
+TEST(ShapeBucketingTest, RejectsMatMulOfTwoArguments) {
+  FunctionDef fdef = FDH::Create(
+      "Gram", {"x: float", "y: float"}, {"z: float"}, {},
+      {{{"matmul"},
+        "MatMul",
+        {"x", "y"},
+        {{"T", DT_FLOAT}, {"transpose_a", false}, {"transpose_b", true}}}},
+      {{"z", "matmul:product:0"}});
+  TF_ASSERT_OK_AND_ASSIGN(std::optional<ShapeBucketingInfo> info,
+                          Analyze(fdef, {PartialTensorShape({-1, 4}),
+                                         PartialTensorShape({-1, 4})}));
+  EXPECT_FALSE(info.has_value());
+}
+
+TEST(ShapeBucketingTest, RequiresArgumentsWithTheSameRows) {
+  FunctionDef fdef = FDH::Create(
+      "TwoResults", {"x: float", "y: float"}, {"u: float", "v: float"}, {},
+      {{{"u"}, "Relu", {"x"}, {{"T", DT_FLOAT}}},
+       {{"v"}, "Relu", {"y"}, {{"T", DT_FLOAT}}}},
+      {{"u", "u:activations:0"}, {"v", "v:activations:0"}});
+  TF_ASSERT_OK_AND_ASSIGN(
+      std::optional<ShapeBucketingInfo> info,
+      Analyze(fdef, {PartialTensorShape({-1, 4}), PartialTensorShape({-1})}));
+  EXPECT_FALSE(info.has_value());
+}
+
+// f(x, y) = x + y.
+FunctionDef AddFunction() {
+  return FDH::Create("Add", {"x: float", "y: float"}, {"z: float"}, {},
+                     {{{"z"}, "AddV2", {"x", "y"}, {{"T", DT_FLOAT}}}},
+                     {{"z", "z:z:0"}});
+}
+
+TEST(ShapeBucketingTest, DoesNotPadBroadcastArguments) {
+  TF_ASSERT_OK_AND_ASSIGN(
+      std::optional<ShapeBucketingInfo> info,
+      Analyze(AddFunction(),
+              {PartialTensorShape({-1, 4}), PartialTensorShape({1, 4})}));
+  ASSERT_TRUE(info.has_value());
+  EXPECT_EQ(info->padded_args, std::vector<bool>({true, false}));
+  EXPECT_EQ(info->result_ranks, std::vector<int>({2}));
+}
+
+TEST(ShapeBucketingTest, RejectsArgumentsWithStaticRows) {
+  // The rows of x would have to be the 8 rows of y.
+  TF_ASSERT_OK_AND_ASSIGN(
+      std::optional<ShapeBucketingInfo> info,
+      Analyze(AddFunction(),
+              {PartialTensorShape({-1, 4}), PartialTensorShape({8, 4})}));
+  EXPECT_FALSE(info.has_value());
+}
+
+}  // namespace
+}  // namespace tensorflow
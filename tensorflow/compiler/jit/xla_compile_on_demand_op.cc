@@ -106,7 +106,8 @@ Status XlaCompileOnDemandOp::Compile(
     OpKernelContext* ctx, const XlaCompiler::CompilationResult** result,
     XlaDeviceCompiler** xla_device_compiler,
     DeviceCompilationProfiler** profiler, ResourceVarsSnapshot* variable_args,
-    xla::LocalExecutable** executable) {
+    xla::LocalExecutable** executable,
+    std::shared_ptr<const void>* executable_holder) {
   TF_ASSIGN_OR_RETURN(std::vector<int> constant_input_indices,
                       GetConstantInputIndicesFromContext(ctx));
   std::vector<const Tensor*> inputs = InputsFromContext(ctx);
@@ -163,19 +164,21 @@ Status XlaCompileOnDemandOp::Compile(
 
   return (*xla_device_compiler)
       ->CompileSingleOpIfNeeded(options, *args, compile_options, ctx, *profiler,
-                                result, executable);
+                                result, executable, executable_holder);
 }
 
 void XlaCompileOnDemandOp::Compute(OpKernelContext* ctx) {
   const XlaCompiler::CompilationResult* result;
   xla::LocalExecutable* executable;
+  std::shared_ptr<const void> executable_holder;
   ResourceVarsSnapshot variable_args;
   XlaDeviceCompiler* xla_device_compiler;
   DeviceCompilationProfiler* profiler;
   OP_REQUIRES(ctx, ctx->function_library(),
               errors::Internal("Function library missing"));
   OP_REQUIRES_OK(ctx, Compile(ctx, &result, &xla_device_compiler, &profiler,
-                              &variable_args, &executable));
+                              &variable_args, &executable,
+                              &executable_holder));
 
   // Hold the reference to the XLA device compiler and profiler during
   // evaluation. (We could probably free them sooner because the ResourceMgr
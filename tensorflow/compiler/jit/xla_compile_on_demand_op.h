@@ -19,6 +19,8 @@ limitations under the License.
 #ifndef TENSORFLOW_COMPILER_JIT_XLA_COMPILE_ON_DEMAND_OP_H_
 #define TENSORFLOW_COMPILER_JIT_XLA_COMPILE_ON_DEMAND_OP_H_
 
+#include <memory>
+
 #include "tensorflow/compiler/jit/device_compilation_profiler.h"
 #include "tensorflow/compiler/jit/xla_device.h"
 #include "tensorflow/compiler/jit/xla_launch_util.h"
@@ -50,7 +52,8 @@ class XlaCompileOnDemandOp : public OpKernel {
                      xla_device_compiler,
                  DeviceCompilationProfiler** profiler,
                  ResourceVarsSnapshot* variable_args,
-                 xla::LocalExecutable** executable);
+                 xla::LocalExecutable** executable,
+                 std::shared_ptr<const void>* executable_holder);
 
   Status Run(OpKernelContext* ctx,
              DeviceCompiler<xla::LocalExecutable, xla::LocalClient>*
@@ -0,0 +1,302 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// End-to-end tests and benchmarks of the shape bucketing of auto-clustered
+// graphs with a dynamic batch dimension, on the _XlaCompile / _XlaRun path to
+// the XLA:CPU compiler.
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "tensorflow/cc/framework/ops.h"
+#include "tensorflow/cc/ops/array_ops.h"
+#include "tensorflow/cc/ops/standard_ops.h"
+#include "tensorflow/compiler/jit/defs.h"
+#include "tensorflow/compiler/jit/flags.h"
+#include "tensorflow/compiler/jit/xla_activity_listener.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+#include "tensorflow/core/public/session.h"
+
+namespace tensorflow {
+namespace {
+
+constexpr int kNumFeatures = 16;
+
+// Counts the JIT compilations of XLA clusters.
+class CompileCountListener : public XlaActivityListener {
+ public:
+  Status Listen(
+      const XlaAutoClusteringActivity& auto_clustering_activity) override {
+    return OkStatus();
+  }
+
+  Status Listen(
+      const XlaJitCompilationActivity& jit_compilation_activity) override {
+    ++num_compiles_;
+    return OkStatus();
+  }
+
+  Status Listen(const XlaOptimizationRemark& optimization_remark) override {
+    return OkStatus();
+  }
+
+  int64_t num_compiles() const { return num_compiles_; }
+
+ private:
+  std::atomic<int64_t> num_compiles_{0};
+};
+
+CompileCountListener* GetCompileCountListener() {
+  static CompileCountListener* listener = [] {
+    auto listener = std::make_unique<CompileCountListener>();
+    CompileCountListener* result = listener.get();
+    RegisterXlaActivityListener(std::move(listener));
+    return result;
+  }();
+  return listener;
+}
+
+// A two layer perceptron on a batch of rows of kNumFeatures features.
+//
+// The rows are fed through an EnsureShape that isn't clustered, since feeds
+// lose their static shape, so that the cluster sees their dynamic batch
+// dimension.
+GraphDef CreateGraphDef() {
+  Scope root = Scope::NewRootScope().ExitOnError().WithAssignedDevice(
+      "/job:localhost/replica:0/task:0/device:CPU:0");
+  auto x = ops::Placeholder(root.WithOpName("x"), DT_FLOAT);
+  auto rows = ops::EnsureShape(root.WithOpName("rows"), x,
+                               PartialTensorShape({-1, kNumFeatures}));
+  rows.node()->AddAttr(kXlaCompileAttr, false);
+
+  Output h = rows;
+  for (int i = 0; i < 2; ++i) {
+    Tensor w(DT_FLOAT, TensorShape({kNumFeatures, kNumFeatures}));
+    w.flat<float>().setRandom();
+    Tensor b(DT_FLOAT, TensorShape({kNumFeatures}));
+    b.flat<float>().setRandom();
+    h = ops::MatMul(root.WithOpName(absl::StrCat("matmul_", i)), h,
+                    ops::Const(root, w));
+    h = ops::BiasAdd(root.WithOpName(absl::StrCat("bias_add_", i)), h,
+                     ops::Const(root, b));
+    h = ops::Relu(root.WithOpName(absl::StrCat("relu_", i)), h);
+  }
+  ops::Identity(root.WithOpName("y"), h);
+
+  GraphDef graph_def;
+  root.graph()->ToGraphDef(&graph_def);
+  return graph_def;
+}
+
+// Adds a bias of `bias_rows` rows to a batch of rows, followed by enough
+// elementwise ops to be clustered. Both are fed, and `bias_rows` is 1, so that
+// the bias is broadcast along the rows, or -1, so that it looks like the rows
+// to the cluster.
+GraphDef CreateBroadcastGraphDef(int64_t bias_rows) {
+  Scope root = Scope::NewRootScope().ExitOnError().WithAssignedDevice(
+      "/job:localhost/replica:0/task:0/device:CPU:0");
+  auto x = ops::Placeholder(root.WithOpName("x"), DT_FLOAT);
+  auto rows = ops::EnsureShape(root.WithOpName("rows"), x,
+                               PartialTensorShape({-1, kNumFeatures}));
+  rows.node()->AddAttr(kXlaCompileAttr, false);
+  auto b = ops::Placeholder(root.WithOpName("b"), DT_FLOAT);
+  auto bias = ops::EnsureShape(root.WithOpName("bias"), b,
+                               PartialTensorShape({bias_rows, kNumFeatures}));
+  bias.node()->AddAttr(kXlaCompileAttr, false);
+
+  Output h = ops::AddV2(root.WithOpName("add"), rows, bias);
+  h = ops::Relu(root.WithOpName("relu"), h);
+  h = ops::Mul(root.WithOpName("square"), h, h);
+  h = ops::Tanh(root.WithOpName("tanh"), h);
+  ops::Identity(root.WithOpName("y"), h);
+
+  GraphDef graph_def;
+  root.graph()->ToGraphDef(&graph_def);
+  return graph_def;
+}
+
+std::unique_ptr<Session> CreateSession(const GraphDef& graph_def, bool jit) {
+  // The global JIT level only applies to the CPU with this flag.
+  GetMarkForCompilationPassFlags()->tf_xla_cpu_global_jit = true;
+  SessionOptions options;
+  options.config.mutable_graph_options()
+      ->mutable_optimizer_options()
+      ->set_global_jit_level(jit ? OptimizerOptions::ON_2
+                                 : OptimizerOptions::OFF);
+  std::unique_ptr<Session> session(NewSession(options));
+  TF_CHECK_OK(session->Create(graph_def));
+  return session;
+}
+
+Tensor Rows(int num_rows) {
+  Tensor rows(DT_FLOAT, TensorShape({num_rows, kNumFeatures}));
+  rows.flat<float>().setRandom();
+  return rows;
+}
+
+Tensor Run(Session* session,
+           const std::vector<std::pair<std::string, Tensor>>& feeds) {
+  std::vector<Tensor> outputs;
+  TF_CHECK_OK(
+      session->Run(feeds, {"y:0"}, /*target_node_names=*/{}, &outputs));
+  return outputs[0];
+}
+
+Tensor Run(Session* session, const Tensor& rows) {
+  return Run(session, {{"x", rows}});
+}
+
+// Sets the shape bucketing flags for the lifetime of the object.
+class ShapeBucketingFlags {
+ public:
+  ShapeBucketingFlags(int64_t bucket_size, bool geometric)
+      : flags_(GetBuildXlaOpsPassFlags()), saved_flags_(*flags_) {
+    flags_->tf_xla_shape_bucket_size = bucket_size;
+    flags_->tf_xla_geometric_shape_buckets = geometric;
+  }
+  ~ShapeBucketingFlags() { *flags_ = saved_flags_; }
+
+ private:
+  BuildXlaOpsPassFlags* flags_;
+  BuildXlaOpsPassFlags saved_flags_;
+};
+
+// Runs the graph with batch sizes 1 to `max_rows`, checks the results against
+// TF and returns the number of compilations.
+int64_t CountCompiles(int64_t bucket_size, bool geometric, int max_rows) {
+  ShapeBucketingFlags flags(bucket_size, geometric);
+  const GraphDef graph_def = CreateGraphDef();
+  std::unique_ptr<Session> session = CreateSession(graph_def, /*jit=*/true);
+  std::unique_ptr<Session> tf_session =
+      CreateSession(graph_def, /*jit=*/false);
+  const int64_t num_compiles = GetCompileCountListener()->num_compiles();
+  for (int num_rows = 1; num_rows <= max_rows; ++num_rows) {
+    Tensor rows = Rows(num_rows);
+    // Lazy compilation only compiles a signature on its second request.
+    for (int i = 0; i < 2; ++i) {
+      test::ExpectClose(Run(session.get(), rows), Run(tf_session.get(), rows),
+                        /*atol=*/1e-4, /*rtol=*/1e-4);
+    }
+  }
+  return GetCompileCountListener()->num_compiles() - num_compiles;
+}
+
+TEST(XlaCpuShapeBucketingTest, CompilesEachShapeWithoutBuckets) {
+  EXPECT_EQ(CountCompiles(/*bucket_size=*/0, /*geometric=*/false,
+                          /*max_rows=*/8),
+            8);
+}
+
+TEST(XlaCpuShapeBucketingTest, CompilesEachBucket) {
+  EXPECT_EQ(CountCompiles(/*bucket_size=*/4, /*geometric=*/false,
+                          /*max_rows=*/8),
+            2);
+}
+
+TEST(XlaCpuShapeBucketingTest, CompilesEachGeometricBucket) {
+  // Buckets of 1, 2, 4 and 8 rows.
+  EXPECT_EQ(CountCompiles(/*bucket_size=*/1, /*geometric=*/true,
+                          /*max_rows=*/8),
+            4);
+}
+
+// Runs the broadcast graph with batch sizes 1 to `max_rows` and a bias of one
+// row, checks the results against TF and returns the number of compilations.
+int64_t CountBroadcastCompiles(int64_t bias_rows, int64_t bucket_size,
+                               bool geometric, int max_rows) {
+  ShapeBucketingFlags flags(bucket_size, geometric);
+  const GraphDef graph_def = CreateBroadcastGraphDef(bias_rows);
+  std::unique_ptr<Session> session = CreateSession(graph_def, /*jit=*/true);
+  std::unique_ptr<Session> tf_session =
+      CreateSession(graph_def, /*jit=*/false);
+  const Tensor bias = Rows(1);
+  const int64_t num_compiles = GetCompileCountListener()->num_compiles();
+  for (int num_rows = 1; num_rows <= max_rows; ++num_rows) {
+    const std::vector<std::pair<std::string, Tensor>> feeds = {
+        {"x", Rows(num_rows)}, {"b", bias}};
+    for (int i = 0; i < 2; ++i) {
+      test::ExpectClose(Run(session.get(), feeds),
+                        Run(tf_session.get(), feeds), /*atol=*/1e-4,
+                        /*rtol=*/1e-4);
+    }
+  }
+  return GetCompileCountListener()->num_compiles() - num_compiles;
+}
+
+TEST(XlaCpuShapeBucketingTest, BroadcastsStaticBiasAlongBuckets) {
+  // Only the rows are padded, and the bias of shape [1, kNumFeatures] is
+  // broadcast along the padded rows.
+  EXPECT_EQ(CountBroadcastCompiles(/*bias_rows=*/1, /*bucket_size=*/4,
+                                   /*geometric=*/false, /*max_rows=*/8),
+            2);
+}
+
+TEST(XlaCpuShapeBucketingTest, BroadcastsStaticBiasAlongGeometricBuckets) {
+  // Buckets of 1, 2, 4 and 8 rows.
+  EXPECT_EQ(CountBroadcastCompiles(/*bias_rows=*/1, /*bucket_size=*/1,
+                                   /*geometric=*/true, /*max_rows=*/8),
+            4);
+}
+
+TEST(XlaCpuShapeBucketingTest, DoesNotPadDynamicInputsWithDifferentRows) {
+  // The bias has a dynamic first dimension but a single row, so padding it
+  // like the rows would break its broadcast: the inputs are only padded when
+  // they have the same number of rows, i.e. for the batch of one row.
+  EXPECT_EQ(CountBroadcastCompiles(/*bias_rows=*/-1, /*bucket_size=*/4,
+                                   /*geometric=*/false, /*max_rows=*/8),
+            8);
+}
+
+// Runs batches of 1 to 64 rows in turn, and reports the number of compilations
+// and the steady-state time per batch. Without buckets, the cluster goes
+// megamorphic after 10 compilations and falls back to TF.
+void BM_DynamicBatch(::testing::benchmark::State& state) {
+  constexpr int kMaxRows = 64;
+  ShapeBucketingFlags flags(/*bucket_size=*/state.range(0),
+                            /*geometric=*/state.range(1));
+  std::unique_ptr<Session> session =
+      CreateSession(CreateGraphDef(), /*jit=*/true);
+  std::vector<Tensor> batches;
+  for (int num_rows = 1; num_rows <= kMaxRows; ++num_rows) {
+    batches.push_back(Rows(num_rows));
+  }
+
+  const int64_t num_compiles = GetCompileCountListener()->num_compiles();
+  for (int i = 0; i < 2; ++i) {
+    for (const Tensor& rows : batches) Run(session.get(), rows);
+  }
+  state.counters["num_compiled"] =
+      GetCompileCountListener()->num_compiles() - num_compiles;
+
+  int64_t i = 0;
+  for (auto s : state) {
+    Run(session.get(), batches[i++ % kMaxRows]);
+  }
+}
+
+BENCHMARK(BM_DynamicBatch)
+    ->ArgPair(0, false)
+    ->ArgPair(8, false)
+    ->ArgPair(4, true);
+
+}  // namespace
+}  // namespace tensorflow
@@ -54,9 +54,8 @@ mlir::LogicalResult FreeReturnedMemref(const ResultConversionCtx& ctx,
   return mlir::success();
 }
 
-JitExecutable& CreateJitExecutable(
-    const HostContext& host, llvm::StringRef mlir_input,
-    llvm::StringRef function_name, bool lower_from_tensorflow,
+JitExecutable::Options GetJitExecutableOptions(
+    const HostContext& host, bool lower_from_tensorflow,
     const TfJitRtPipelineOptions& tf_jitrt_opts) {
   // Options for the default JitRt compilation pipeline (lowering to LLVM).
   CompilationPipelineOptions copts;
@@ -79,6 +78,15 @@ JitExecutable& CreateJitExecutable(
       CreateJitRtSpecializationPipeline;
   opts.compiler.calling_convention = xla::runtime::DefaultCallingConvention(
       mlir::bufferization::BufferizeTypeConverter());
+  return opts;
+}
+
+JitExecutable& CreateJitExecutable(
+    const HostContext& host, llvm::StringRef mlir_input,
+    llvm::StringRef function_name, bool lower_from_tensorflow,
+    const TfJitRtPipelineOptions& tf_jitrt_opts) {
+  JitExecutable::Options opts =
+      GetJitExecutableOptions(host, lower_from_tensorflow, tf_jitrt_opts);
 
   // Cache all jit executables, otherwise different benchmark runs will produce
   // different .so files and the same compiled function will have different
@@ -86,8 +94,8 @@ JitExecutable& CreateJitExecutable(
   static auto* cache = new llvm::StringMap<std::unique_ptr<JitExecutable>>();
 
   std::string key =
-      llvm::formatv("{0}/{1}/{2}", mlir_input.data(), copts.num_worker_threads,
-                    hash_value(tf_jitrt_opts));
+      llvm::formatv("{0}/{1}/{2}", mlir_input.data(),
+                    host.GetNumWorkerThreads(), hash_value(tf_jitrt_opts));
 
   // Compile and cache MLIR function.
   auto it = cache->find(key);
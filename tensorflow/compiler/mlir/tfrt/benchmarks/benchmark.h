@@ -91,6 +91,13 @@ mlir::LogicalResult FreeReturnedMemref(const ResultConversionCtx&,
                                        const Type* runtime_type,
                                        void* result_ptr);
 
+// Returns options for compiling serialized mlir modules into JIT executables
+// with the TFRT JitRt compilation pipeline, that always specialize executables
+// to the arguments. `tf_jitrt_opts` must outlive all compilations.
+JitExecutable::Options GetJitExecutableOptions(
+    const HostContext& host, bool lower_from_tensorflow,
+    const TfJitRtPipelineOptions& tf_jitrt_opts);
+
 // Compile serialized mlir module and convert entrypoint function into TFRT JIT
 // executable.
 JitExecutable& CreateJitExecutable(const HostContext& host,
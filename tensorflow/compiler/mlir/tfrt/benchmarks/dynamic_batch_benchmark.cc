@@ -0,0 +1,171 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <utility>
+
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "tensorflow/compiler/mlir/tfrt/benchmarks/benchmark.h"
+#include "tensorflow/compiler/mlir/tfrt/utils/host_context.h"
+
+namespace tensorflow {
+
+using ::tfrt::AsyncValue;
+using ::tfrt::AsyncValuePtr;
+using ::tfrt::RCReference;
+using ::tfrt::jitrt::HostContextAsyncTaskRunner;
+using ::tfrt::jitrt::RemainingResultsConverter;
+using ::xla::runtime::ArgumentConstraint;
+using ::xla::runtime::ArgumentsRef;
+using ::xla::runtime::Executable;
+
+// A cluster with a dynamic batch dimension, as produced by auto-clustering a
+// model served with varying batch sizes.
+static const char* mlir_input = R"(
+func.func @compute(%arg0: tensor<?x256xf32>) -> tensor<?x256xf32> {
+  %0 = "tf.Tanh"(%arg0) : (tensor<?x256xf32>) -> tensor<?x256xf32>
+  %1 = "tf.AddV2"(%0, %arg0)
+       : (tensor<?x256xf32>, tensor<?x256xf32>) -> tensor<?x256xf32>
+  func.return %1 : tensor<?x256xf32>
+}
+)";
+
+static constexpr int64_t kInnerDim = 256;
+static constexpr int64_t kMaxBatch = 512;
+
+// Returns the next batch size of a request stream where most requests come
+// with a few hot batch sizes, and the rest with arbitrary batch sizes.
+static int64_t NextBatchSize(std::mt19937& rng) {
+  static constexpr std::array<int64_t, 3> kHotBatchSizes = {1, 32, 128};
+  if (std::uniform_int_distribution<int>(0, 9)(rng) != 0)
+    return kHotBatchSizes[rng() % kHotBatchSizes.size()];
+  return std::uniform_int_distribution<int64_t>(1, kMaxBatch)(rng);
+}
+
+// Runs the cluster on a stream of batch sizes with the specialization mode
+// `state.range(0)`:
+//   0: specialize to every batch size (always specialize, today's default).
+//   1: never specialize, and run the shape-polymorphic default executable.
+//   2: specialize only to batch sizes seen `state.range(1)` times.
+//
+// Reports the number and total time of compilations (including the default
+// executable), and the steady-state latency after a warm-up stream.
+static void BM_DynamicBatch(::testing::benchmark::State& state) {
+  std::unique_ptr<HostContext> host = CreateSingleThreadedHostContext();
+
+  TfJitRtPipelineOptions tf_jitrt_opts;
+  JitExecutable::Options opts = GetJitExecutableOptions(
+      *host, /*lower_from_tensorflow=*/true, tf_jitrt_opts);
+  switch (state.range(0)) {
+    case 0:
+      opts.specialization = JitExecutable::Specialization::kAlways;
+      break;
+    case 1:
+      opts.specialization = JitExecutable::Specialization::kDisabled;
+      break;
+    default:
+      opts.specialization = JitExecutable::Specialization::kEnabled;
+      opts.specialization_threshold = state.range(1);
+  }
+
+  int64_t num_compiled = 0;
+  absl::Duration compile_time;
+  auto runner = [&](size_t, absl::Span<const ArgumentConstraint>,
+                    ArgumentsRef, JitExecutable::CompilationTask task,
+                    JitExecutable::UserData) {
+    absl::Time start = absl::Now();
+    task();
+    compile_time += absl::Now() - start;
+    ++num_compiled;
+  };
+
+  absl::Time start = absl::Now();
+  absl::StatusOr<JitExecutable> jit_executable = JitExecutable::Instantiate(
+      mlir_input, "compute", opts, "benchmark", std::move(runner));
+  if (!jit_executable.ok())
+    LOG(FATAL) << "Failed to instantiate JitExecutable: "
+               << jit_executable.status().message();
+  if (!jit_executable->DefaultExecutable().IsError()) {
+    compile_time += absl::Now() - start;
+    ++num_compiled;
+  }
+
+  Eigen::Tensor<float, 2, Eigen::RowMajor> input(kMaxBatch, kInnerDim);
+  input.setRandom();
+
+  HostContextAsyncTaskRunner async_task_runner(host.get());
+  Executable::ExecuteOpts execute_opts;
+  execute_opts.async_task_runner = &async_task_runner;
+
+  auto execute = [&](int64_t batch_size) {
+    std::array<MemrefDesc, 1> operands = {MemrefDesc(
+        xla::PrimitiveType::F32, input.data(), 0, {batch_size, kInnerDim},
+        {kInnerDim, 1})};
+
+    absl::StatusOr<AsyncValuePtr<Executable>> executable =
+        jit_executable->GetExecutable(operands);
+    if (!executable.ok())
+      LOG(FATAL) << "Failed to get executable: "
+                 << executable.status().message();
+    host->Await({executable->CopyRef()});
+    CHECK(!executable->IsError())
+        << "Failed to compile executable: " << executable->GetError().message();
+
+    llvm::SmallVector<RCReference<AsyncValue>> result_values(1);
+    RemainingResults results(result_values);
+    ResultConversionCtx result_ctx({input.data()});
+    RemainingResultsConverter<ResultConversionCtx> converter(results,
+                                                             result_ctx);
+    converter.AddConversion(FreeReturnedMemref);
+
+    Executable::CallFrame call_frame;
+    if (auto st = (*executable)->InitializeCallFrame(operands, &call_frame);
+        !st.ok())
+      LOG(FATAL) << "Failed to initialize call frame: " << st.message();
+    (*executable)->Execute(call_frame, execute_opts);
+    if (auto st = (*executable)->ReturnResults(converter, &call_frame);
+        !st.ok())
+      LOG(FATAL) << "Failed to return results: " << st.message();
+  };
+
+  // Warm up on a stream that hits all hot batch sizes many times, and keep
+  // drawing from the same stream in the benchmark loop, so that new batch
+  // sizes keep arriving.
+  std::mt19937 rng(42);
+  for (int i = 0; i < 1000; ++i) execute(NextBatchSize(rng));
+
+  int64_t num_rows = 0;
+  for (auto _ : state) {
+    int64_t batch_size = NextBatchSize(rng);
+    execute(batch_size);
+    num_rows += batch_size;
+  }
+
+  state.SetItemsProcessed(num_rows * kInnerDim);
+  state.counters["num_compiled"] = num_compiled;
+  state.counters["compile_ms"] = absl::ToDoubleMilliseconds(compile_time);
+}
+
+BENCHMARK(BM_DynamicBatch)
+    ->Args({0, 1})
+    ->Args({1, 1})
+    ->Args({2, 2})
+    ->Args({2, 16});
+
+}  // namespace tensorflow
@@ -15,6 +15,7 @@ limitations under the License.
 
 #define EIGEN_USE_THREADS
 
+#include <algorithm>
 #include <memory>
 #include <string>
 #include <utility>
@@ -460,6 +461,10 @@ static Expected<AsyncValuePtr<JitExecutable>> CompileImpl(
     opts.specialization = GetJitRtFlags().always_specialize
                               ? JitExecutable::Specialization::kAlways
                               : JitExecutable::Specialization::kEnabled;
+    opts.specialization_threshold =
+        std::max(GetJitRtFlags().specialization_threshold, 1);
+    opts.max_specializations =
+        std::max(GetJitRtFlags().max_specializations, 0);
 
     // Register dialects and interfaces required for the compilation pipeline.
     opts.compiler.register_dialects =
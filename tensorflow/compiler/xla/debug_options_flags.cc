@@ -105,6 +105,7 @@ DebugOptions DefaultDebugOptionsIgnoringFlags() {
   opts.set_xla_gpu_enable_latency_hiding_scheduler(false);
 
   opts.set_xla_cpu_enable_mlir_tiling_and_fusion(false);
+  opts.set_xla_cpu_enable_flash_attention(true);
 
   opts.set_xla_partitioning_algorithm(
       DebugOptions::PARTITIONING_ALGORITHM_NOOP);
@@ -874,6 +875,39 @@ void MakeDebugOptionsFlags(std::vector<tsl::Flag>* flag_list,
       DebugOptions::PartitioningAlgorithm_Name(
           debug_options->xla_partitioning_algorithm()),
       "The partitioning algorithm to be used in the PartitionAssignment pass"));
+  flag_list->push_back(tsl::Flag(
+      "xla_cpu_object_cache_dir",
+      string_setter_for(&DebugOptions::set_xla_cpu_object_cache_dir),
+      debug_options->xla_cpu_object_cache_dir(),
+      "If non-empty, caches XLA:CPU object files in this directory and reuses "
+      "them across compilations of the same LLVM module."));
+  flag_list->push_back(tsl::Flag(
+      "xla_cpu_enable_flash_attention",
+      bool_setter_for(&DebugOptions::set_xla_cpu_enable_flash_attention),
+      debug_options->xla_cpu_enable_flash_attention(),
+      "Rewrite F32 scaled dot-product attention into a blocked runtime call "
+      "that does not materialize the attention scores."));
+  flag_list->push_back(tsl::Flag(
+      "xla_cpu_temp_buffer_pool_size",
+      int32_setter_for(&DebugOptions::set_xla_cpu_temp_buffer_pool_size),
+      debug_options->xla_cpu_temp_buffer_pool_size(),
+      "Number of preallocated temp buffer blocks each XLA:CPU executable "
+      "keeps for concurrent executions. 0 allocates temp buffers on every "
+      "execution."));
+  flag_list->push_back(tsl::Flag(
+      "xla_cpu_profile_feedback_file",
+      string_setter_for(&DebugOptions::set_xla_cpu_profile_feedback_file),
+      debug_options->xla_cpu_profile_feedback_file(),
+      "Path to an hlo_execution_profile_data file dumped by a run of the same "
+      "module with --xla_hlo_profile. XLA:CPU uses the measured cycles for "
+      "fusion and parallel task assignment."));
+  flag_list->push_back(tsl::Flag(
+      "xla_cpu_memory_limit_bytes",
+      int64_setter_for(&DebugOptions::set_xla_cpu_memory_limit_bytes),
+      debug_options->xla_cpu_memory_limit_bytes(),
+      "If positive, XLA:CPU schedules modules to minimize peak memory and "
+      "rematerializes values until the predicted peak fits in this many "
+      "bytes."));
 }  // NOLINT(readability/fn_size)
 
 // Allocates flag_values and flag_objects; this function must not be called more
@@ -15,6 +15,7 @@ limitations under the License.
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cstdint>
 #include <cstdlib>
 #include <functional>
@@ -22,6 +23,7 @@ limitations under the License.
 #include <optional>
 #include <string>
 #include <string_view>
+#include <thread>  // NOLINT
 #include <tuple>
 #include <utility>
 #include <vector>
@@ -636,6 +638,104 @@ TEST(ExecutableTest, AsyncExecute) {
   EXPECT_EQ(result.get(), 42);
 }
 
+TEST(ExecutableTest, SpecializeHotArguments) {
+  absl::string_view module = R"(
+    func.func @test(%arg0: memref<?xf32>) {
+      return
+    }
+  )";
+
+  JitExecutable::Options opts;
+  opts.specialization = JitExecutable::Specialization::kEnabled;
+  opts.specialization_threshold = 2;
+  opts.max_specializations = 1;
+  opts.compiler.register_dialects = RegisterXlaRuntimeTestlibDialects;
+  opts.compiler.create_compilation_pipeline = CreateXlaRuntimeTestlibPipeline;
+
+  int num_compiled = 0;
+  auto runner = [&](size_t, absl::Span<const ArgumentConstraint>,
+                    ArgumentsRef, JitExecutable::CompilationTask task,
+                    JitExecutable::UserData) {
+    ++num_compiled;
+    task();
+  };
+
+  StatusOr<JitExecutable> jit_executable =
+      JitExecutable::Instantiate(module, "test", opts, "", runner);
+  ASSERT_TRUE(jit_executable.ok()) << jit_executable.status().message();
+  ASSERT_FALSE(jit_executable->DefaultExecutable().IsError());
+  AsyncValue* default_executable =
+      jit_executable->DefaultExecutable().value();
+
+  auto get_executable = [&](int64_t size) {
+    std::vector<MemrefDesc> args;
+    args.emplace_back(PrimitiveType::F32, nullptr, 0,
+                      std::array<int64_t, 1>{size},
+                      std::array<int64_t, 1>{1});
+    StatusOr<AsyncValuePtr<Executable>> executable =
+        jit_executable->GetExecutable(args);
+    CHECK(executable.ok()) << executable.status().message();
+    return executable->value();
+  };
+
+  // The first call with a shape is served by the default executable, and the
+  // second one compiles a specialization for it.
+  EXPECT_EQ(get_executable(4), default_executable);
+  EXPECT_EQ(num_compiled, 0);
+  EXPECT_EQ(get_executable(4), default_executable);
+  EXPECT_EQ(num_compiled, 1);
+  EXPECT_NE(get_executable(4), default_executable);
+
+  // Other shapes are never specialized once there are `max_specializations`.
+  for (int i = 0; i < 3; ++i) EXPECT_EQ(get_executable(8), default_executable);
+  EXPECT_EQ(num_compiled, 1);
+}
+
+TEST(ExecutableTest, BoundSpecializationsOfConcurrentCalls) {
+  absl::string_view module = R"(
+    func.func @test(%arg0: memref<?xf32>) {
+      return
+    }
+  )";
+
+  JitExecutable::Options opts;
+  opts.specialization = JitExecutable::Specialization::kEnabled;
+  opts.max_specializations = 2;
+  opts.compiler.register_dialects = RegisterXlaRuntimeTestlibDialects;
+  opts.compiler.create_compilation_pipeline = CreateXlaRuntimeTestlibPipeline;
+
+  std::atomic<int> num_compiled = 0;
+  auto runner = [&](size_t, absl::Span<const ArgumentConstraint>,
+                    ArgumentsRef, JitExecutable::CompilationTask task,
+                    JitExecutable::UserData) {
+    ++num_compiled;
+    task();
+  };
+
+  StatusOr<JitExecutable> jit_executable =
+      JitExecutable::Instantiate(module, "test", opts, "", runner);
+  ASSERT_TRUE(jit_executable.ok()) << jit_executable.status().message();
+
+  // Every thread calls with the same few shapes in a different order, so that
+  // the calls race both for the same and for different specializations.
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&, t] {
+      for (int i = 0; i < 16; ++i) {
+        std::vector<MemrefDesc> args;
+        args.emplace_back(PrimitiveType::F32, nullptr, 0,
+                          std::array<int64_t, 1>{(t + i) % 4 + 1},
+                          std::array<int64_t, 1>{1});
+        CHECK(jit_executable->GetExecutable(args).ok());
+      }
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+
+  // Calls that lost the race for a specialization don't use up the bound.
+  EXPECT_EQ(num_compiled, opts.max_specializations);
+}
+
 //===----------------------------------------------------------------------===//
 // Performance benchmarks are below.
 //===----------------------------------------------------------------------===//
@@ -186,7 +186,8 @@ JitExecutable::JitExecutable(std::string_view mlir_module, Options opts,
       has_default_executable_(default_executable.has_value()),
       memory_region_name_(memory_region_name),
       runner_(std::move(runner)),
-      specializations_(std::make_unique<Specializations>()) {
+      specializations_(std::make_unique<Specializations>()),
+      call_counts_(std::make_unique<CallCounts>()) {
   // Initialize default executable if it is available.
   if (has_default_executable_) {
     default_executable_ =
@@ -227,10 +228,10 @@ static llvm::hash_code CombineWithValueConstraineOperands(
 // pointers?) to keep the most commonly used specialization available without
 // doing a lookup in the AsyncValuesCache.
 //
-// TODO(ezhulenev): The number of specializations should be bounded, ideally we
-// should only keep N most common specializations, and for everything else
-// fall back on the default executable. However what to do if default executable
-// is not available, and the number of specializations is above N?
+// TODO(ezhulenev): The number of specializations can be bounded only if the
+// default executable is available (see `max_specializations`). What to do if
+// default executable is not available, and the number of specializations is
+// above N?
 StatusOr<AsyncValuePtr<Executable>> JitExecutable::GetExecutable(
     ArgumentsRef arguments, UserData user_data,
     const SpecializationListener* listener) {
@@ -301,6 +302,19 @@ StatusOr<AsyncValuePtr<Executable>> JitExecutable::GetExecutable(
     return cached;
   }
 
+  // Keep using the default executable until the arguments are hot enough. A
+  // specialization reserved by `ShouldSpecialize` is released below if this
+  // call doesn't end up allocating it.
+  bool reserved = false;
+  if (opts_.specialization == Specialization::kEnabled &&
+      has_default_executable_) {
+    if (!ShouldSpecialize(*hash)) return DefaultExecutable();
+    reserved = true;
+  }
+  auto release = [&] {
+    if (reserved) ReleaseSpecialization();
+  };
+
   // Instantiation from the source and specialization are cheap, so we do it in
   // the caller thread. We only use compilation runner for expensive part.
 
@@ -309,6 +323,7 @@ StatusOr<AsyncValuePtr<Executable>> JitExecutable::GetExecutable(
       JitCompiler::Instantiate(opts_.compiler, mlir_module_, {fn.name});
 
   if (!compiler.ok()) {
+    release();
     llvm::errs() << compiler.status().message();
     assert(false && "parsing mlir module must always succeed at this point");
     return compiler.status();
@@ -320,6 +335,7 @@ StatusOr<AsyncValuePtr<Executable>> JitExecutable::GetExecutable(
   if (auto specialized = (*compiler)->Specialize(0, arguments, *symbolic_shapes,
                                                  fn.constraints, listener);
       !specialized.ok()) {
+    release();
     return InternalError("failed to specialize executable: %s",
                          specialized.message());
   }
@@ -329,7 +345,10 @@ StatusOr<AsyncValuePtr<Executable>> JitExecutable::GetExecutable(
   Specializations::Entry entry = specializations_->Allocate(*hash);
 
   // We lost the race; some other invocation will do the compilation.
-  if (!entry.allocated) return entry.ptr;
+  if (!entry.allocated) {
+    release();
+    return entry.ptr;
+  }
 
   // Get the specialization id from the size of the specializations cache.
   size_t specialization = entry.size - 1;
@@ -361,6 +380,44 @@ StatusOr<AsyncValuePtr<Executable>> JitExecutable::GetExecutable(
     return has_default_executable_ ? DefaultExecutable() : entry.ptr;
 }
 
+bool JitExecutable::ShouldSpecialize(llvm::hash_code hash) {
+  // Specialize all arguments without taking a lock if it is not bounded.
+  if (opts_.specialization_threshold <= 1 && opts_.max_specializations == 0)
+    return true;
+
+  // Stop counting cold arguments when there are too many of them, so that a
+  // stream of distinct shapes can't grow the counts without bound.
+  static constexpr size_t kMaxCountedArguments = 4096;
+
+  // The bound is checked and the specialization reserved under the same lock,
+  // so concurrent callers can't reserve more than `max_specializations`.
+  absl::MutexLock lock(&call_counts_->mu);
+  if (opts_.max_specializations != 0 &&
+      call_counts_->num_specializations >= opts_.max_specializations)
+    return false;
+
+  if (opts_.specialization_threshold > 1) {
+    if (call_counts_->counts.size() >= kMaxCountedArguments &&
+        !call_counts_->counts.count(hash))
+      call_counts_->counts.clear();
+    if (++call_counts_->counts[hash] < opts_.specialization_threshold)
+      return false;
+    call_counts_->counts.erase(hash);
+  }
+
+  ++call_counts_->num_specializations;
+  return true;
+}
+
+void JitExecutable::ReleaseSpecialization() {
+  if (opts_.specialization_threshold <= 1 && opts_.max_specializations == 0)
+    return;
+
+  absl::MutexLock lock(&call_counts_->mu);
+  assert(call_counts_->num_specializations > 0);
+  --call_counts_->num_specializations;
+}
+
 AsyncValueRef<Chain> JitExecutable::AllExecutablesCompiled() const {
   return specializations_->AllAvailable();
 }
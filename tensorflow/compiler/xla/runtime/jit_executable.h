@@ -24,7 +24,10 @@ limitations under the License.
 #include <utility>
 #include <vector>
 
+#include "absl/base/thread_annotations.h"
 #include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "llvm/ADT/DenseMap.h"
 #include "tensorflow/compiler/xla/mlir/runtime/transforms/jit_compiler.h"
 #include "tensorflow/compiler/xla/runtime/async_values_cache.h"  // IWYU pragma: keep
 #include "tensorflow/compiler/xla/runtime/constraints.h"
@@ -59,6 +62,21 @@ class JitExecutable {
     // What level of specialization is enabled at runtime.
     Specialization specialization = Specialization::kAlways;
 
+    // With `kEnabled` specialization and a default executable, the number of
+    // calls with the same arguments (i.e. symbolic shapes and constrained
+    // values) that are served by the default executable before a specialized
+    // executable is compiled for them. This keeps shape-polymorphic programs
+    // that see many distinct shapes (e.g. dynamic batch or sequence length)
+    // from recompiling for every shape, while hot shapes still get
+    // specialized. Ignored if there is no default executable.
+    unsigned specialization_threshold = 1;
+
+    // With `kEnabled` specialization and a default executable, the maximum
+    // number of specialized executables, after which all calls with arguments
+    // that are not yet specialized fall back on the default executable. Zero
+    // means that the number of specializations is not bounded.
+    unsigned max_specializations = 0;
+
     // Options for the XLA runtime JitCompiler.
     JitCompiler::Options compiler;
   };
@@ -232,6 +250,25 @@ class JitExecutable {
   // Executables specialized for the arguments shapes or/and values.
   using Specializations = AsyncValuesCache<llvm::hash_code, Executable>;
   std::unique_ptr<Specializations> specializations_;
+
+  // Returns true if the arguments with the given hash should be specialized,
+  // and false if they should be handled by the default executable according
+  // to `specialization_threshold` and `max_specializations` options. Returning
+  // true reserves one of the `max_specializations`.
+  bool ShouldSpecialize(llvm::hash_code hash);
+
+  // Releases a specialization reserved by `ShouldSpecialize` that was not
+  // allocated, because the specialization failed or another call allocated it.
+  void ReleaseSpecialization();
+
+  // Counts the calls with arguments that are not yet specialized, and the
+  // specializations reserved by `ShouldSpecialize`.
+  struct CallCounts {
+    absl::Mutex mu;
+    llvm::DenseMap<llvm::hash_code, unsigned> counts ABSL_GUARDED_BY(mu);
+    unsigned num_specializations ABSL_GUARDED_BY(mu) = 0;
+  };
+  std::unique_ptr<CallCounts> call_counts_;
 };
 
 }  // namespace runtime
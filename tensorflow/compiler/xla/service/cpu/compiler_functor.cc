@@ -22,15 +22,19 @@ limitations under the License.
 #include <utility>
 #include <vector>
 
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Analysis/TargetLibraryInfo.h"
 #include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Config/llvm-config.h"
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/MC/MCContext.h"
 #include "llvm/Object/ObjectFile.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/StandardInstrumentations.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/SmallVectorMemoryBuffer.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Target/TargetMachine.h"
@@ -41,7 +45,10 @@ limitations under the License.
 #include "tensorflow/compiler/xla/statusor.h"
 #include "tensorflow/compiler/xla/types.h"
 #include "tensorflow/compiler/xla/util.h"
+#include "tensorflow/tsl/platform/env.h"
+#include "tensorflow/tsl/platform/fingerprint.h"
 #include "tensorflow/tsl/platform/logging.h"
+#include "tensorflow/tsl/platform/path.h"
 
 namespace xla {
 namespace cpu {
@@ -97,6 +104,41 @@ llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>> CompilerFunctor::operator()(
     pre_optimization_hook_(module);
   }
 
+  // The DataFlowSanitizer pass depends on the contents of the ABI list files,
+  // which are not part of the cache key.
+  std::string cache_path;
+  if (!object_cache_dir_.empty() && !dfsan_enabled_) {
+    cache_path = ObjectCachePath(module);
+  }
+
+  std::unique_ptr<llvm::MemoryBuffer> memory_buffer;
+  if (!cache_path.empty()) {
+    memory_buffer = LoadCachedObjectFile(cache_path);
+    VLOG(1) << "Object cache " << (memory_buffer ? "hit" : "miss") << " for "
+            << module.getModuleIdentifier() << ": " << cache_path;
+  }
+  if (!memory_buffer) {
+    memory_buffer = EmitObjectFile(module);
+    if (!cache_path.empty()) {
+      StoreCachedObjectFile(cache_path, *memory_buffer);
+    }
+  }
+
+  if (post_codegen_hook_) {
+    llvm::Expected<std::unique_ptr<llvm::object::ObjectFile>> obj_file =
+        llvm::object::ObjectFile::createObjectFile(*memory_buffer);
+    if (obj_file) {
+      post_codegen_hook_(*obj_file.get());
+    } else {
+      LOG(WARNING) << "Could convert memory buffer to object file!";
+    }
+  }
+
+  return std::move(memory_buffer);
+}
+
+std::unique_ptr<llvm::MemoryBuffer> CompilerFunctor::EmitObjectFile(
+    llvm::Module& module) {
   llvm::OptimizationLevel opt_level;
   if (optimize_for_size_) {
     opt_level = llvm::OptimizationLevel::Os;
@@ -185,20 +227,81 @@ llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>> CompilerFunctor::operator()(
   target_machine_->addPassesToEmitMC(codegen_passes, mc_context, ostream);
   codegen_passes.run(module);
 
-  std::unique_ptr<llvm::MemoryBuffer> memory_buffer(
+  return std::unique_ptr<llvm::MemoryBuffer>(
       new llvm::SmallVectorMemoryBuffer(std::move(stream_buffer)));
+}
 
-  if (post_codegen_hook_) {
-    llvm::Expected<std::unique_ptr<llvm::object::ObjectFile>> obj_file =
-        llvm::object::ObjectFile::createObjectFile(*memory_buffer);
-    if (obj_file) {
-      post_codegen_hook_(*obj_file.get());
-    } else {
-      LOG(WARNING) << "Could convert memory buffer to object file!";
-    }
+std::string CompilerFunctor::ObjectCachePath(const llvm::Module& module) const {
+  // Everything that changes the emitted object file for a given module goes
+  // into the key: the IR itself, the target machine, the codegen options and
+  // the LLVM version.
+  std::string key;
+  llvm::raw_string_ostream key_stream(key);
+  key_stream << LLVM_VERSION_STRING << "\n"
+             << target_machine_->getTargetTriple().str() << "\n"
+             << target_machine_->getTargetCPU() << "\n"
+             << target_machine_->getTargetFeatureString() << "\n"
+             << opt_level_ << optimize_for_size_ << disable_expensive_passes_
+             << fast_math_flags_.allowReassoc() << fast_math_flags_.noNaNs()
+             << fast_math_flags_.noInfs() << fast_math_flags_.noSignedZeros()
+             << fast_math_flags_.allowReciprocal()
+             << fast_math_flags_.allowContract()
+             << fast_math_flags_.approxFunc() << "\n";
+  module.print(key_stream, /*AAW=*/nullptr);
+  key_stream.flush();
+
+  tsl::Fprint128 fingerprint = tsl::Fingerprint128(key);
+  return tsl::io::JoinPath(
+      object_cache_dir_,
+      absl::StrFormat("%016x%016x.o", fingerprint.high64, fingerprint.low64));
+}
+
+std::unique_ptr<llvm::MemoryBuffer> CompilerFunctor::LoadCachedObjectFile(
+    const std::string& path) const {
+  // Object files are read without a null terminator so that LLVM maps them
+  // into memory instead of copying them.
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer =
+      llvm::MemoryBuffer::getFile(path, /*IsText=*/false,
+                                  /*RequiresNullTerminator=*/false);
+  if (!buffer) {
+    return nullptr;
+  }
+  llvm::Expected<std::unique_ptr<llvm::object::ObjectFile>> obj_file =
+      llvm::object::ObjectFile::createObjectFile(**buffer);
+  if (!obj_file) {
+    LOG(WARNING) << "Ignoring invalid cached object file " << path << ": "
+                 << llvm::toString(obj_file.takeError());
+    return nullptr;
   }
+  return std::move(*buffer);
+}
 
-  return std::move(memory_buffer);
+void CompilerFunctor::StoreCachedObjectFile(
+    const std::string& path, const llvm::MemoryBuffer& object_file) const {
+  // Write to a temporary file and rename it into place, so that concurrent
+  // compilations of the same module never observe a partial object file.
+  tsl::Env* env = tsl::Env::Default();
+  Status status = env->RecursivelyCreateDir(object_cache_dir_);
+  std::string tmp_path = path;
+  if (status.ok() && !env->CreateUniqueFileName(&tmp_path, ".tmp")) {
+    status = InternalError("Could not create a temporary file name");
+  }
+  if (status.ok()) {
+    status = tsl::WriteStringToFile(
+        env, tmp_path,
+        absl::string_view(object_file.getBufferStart(),
+                          object_file.getBufferSize()));
+  }
+  if (status.ok()) {
+    status = env->RenameFile(tmp_path, path);
+    if (!status.ok()) {
+      env->DeleteFile(tmp_path).IgnoreError();
+    }
+  }
+  if (!status.ok()) {
+    LOG(WARNING) << "Failed to store object file in " << path << ": "
+                 << status;
+  }
 }
 
 }  // namespace cpu
@@ -46,7 +46,8 @@ class CompilerFunctor : public llvm::orc::IRCompileLayer::IRCompiler {
       std::function<void(const llvm::object::ObjectFile&)> post_codegen_hook =
           nullptr,
       bool dfsan_enabled = false,
-      const std::vector<std::string>& dfsan_abi_list_files = {})
+      const std::vector<std::string>& dfsan_abi_list_files = {},
+      std::string object_cache_dir = "")
       : IRCompiler(llvm::orc::IRSymbolMapper::ManglingOptions()),
         target_machine_(target_machine),
         opt_level_(opt_level),
@@ -57,13 +58,37 @@ class CompilerFunctor : public llvm::orc::IRCompileLayer::IRCompiler {
         post_optimization_hook_(std::move(post_optimization_hook)),
         post_codegen_hook_(std::move(post_codegen_hook)),
         dfsan_enabled_(dfsan_enabled),
-        dfsan_abi_list_files_(dfsan_abi_list_files) {}
+        dfsan_abi_list_files_(dfsan_abi_list_files),
+        object_cache_dir_(std::move(object_cache_dir)) {}
 
   // Compile a Module to an ObjectFile.
+  //
+  // If an object cache directory is set, the object file is first looked up
+  // there under a key derived from the unoptimized module, the target machine
+  // and the codegen options, and LLVM optimization and codegen are skipped on
+  // a hit. Object files produced on a miss are added to the cache. The
+  // post-optimization hook only runs on misses, so callers that need it must
+  // not set a cache directory.
   llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>> operator()(
       llvm::Module& module) override;
 
  private:
+  // Runs the LLVM optimization pipeline and codegen over `module`.
+  std::unique_ptr<llvm::MemoryBuffer> EmitObjectFile(llvm::Module& module);
+
+  // Returns the path of the cache entry for `module`.
+  std::string ObjectCachePath(const llvm::Module& module) const;
+
+  // Returns the cached object file at `path`, or nullptr if there is no valid
+  // object file there.
+  std::unique_ptr<llvm::MemoryBuffer> LoadCachedObjectFile(
+      const std::string& path) const;
+
+  // Writes `object_file` to `path`. Failures are logged and otherwise ignored,
+  // since the cache is only an optimization.
+  void StoreCachedObjectFile(const std::string& path,
+                             const llvm::MemoryBuffer& object_file) const;
+
   llvm::TargetMachine* target_machine_;
   const unsigned opt_level_;
   const bool optimize_for_size_;
@@ -74,6 +99,7 @@ class CompilerFunctor : public llvm::orc::IRCompileLayer::IRCompiler {
   std::function<void(const llvm::object::ObjectFile&)> post_codegen_hook_;
   const bool dfsan_enabled_ = false;
   const std::vector<std::string> dfsan_abi_list_files_;
+  const std::string object_cache_dir_;
 };
 
 }  // namespace cpu
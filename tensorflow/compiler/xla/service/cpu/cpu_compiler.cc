@@ -31,6 +31,7 @@ limitations under the License.
 // IWYU pragma: no_include "llvm/Config/Disassemblers.def.inc"
 // IWYU pragma: no_include "llvm/Config/Targets.def.inc"
 
+#include "absl/algorithm/container.h"
 #include "absl/base/call_once.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/strings/str_cat.h"
@@ -97,6 +98,7 @@ limitations under the License.
 #include "tensorflow/compiler/xla/service/batch_dot_simplification.h"
 #include "tensorflow/compiler/xla/service/batchnorm_expander.h"
 #include "tensorflow/compiler/xla/service/bfloat16_normalization.h"
+#include "tensorflow/compiler/xla/service/bfloat16_support.h"
 #include "tensorflow/compiler/xla/service/bitcast_dtypes_expander.h"
 #include "tensorflow/compiler/xla/service/broadcast_canonicalizer.h"
 #include "tensorflow/compiler/xla/service/buffer_assignment.h"
@@ -118,9 +120,12 @@ limitations under the License.
 #include "tensorflow/compiler/xla/service/cpu/cpu_options.h"
 #include "tensorflow/compiler/xla/service/cpu/cpu_shape_verifier.h"
 #include "tensorflow/compiler/xla/service/cpu/dot_op_emitter.h"
+#include "tensorflow/compiler/xla/service/cpu/flash_attention_rewriter.h"
 #include "tensorflow/compiler/xla/service/cpu/hlo_xla_runtime_pipeline.h"
+#include "tensorflow/compiler/xla/service/cpu/ir_emission_utils.h"
 #include "tensorflow/compiler/xla/service/cpu/ir_emitter.h"
 #include "tensorflow/compiler/xla/service/cpu/parallel_task_assignment.h"
+#include "tensorflow/compiler/xla/service/cpu/profile_feedback.h"
 #include "tensorflow/compiler/xla/service/cpu/runtime/collectives.h"
 #include "tensorflow/compiler/xla/service/cpu/runtime/custom_call.h"
 #include "tensorflow/compiler/xla/service/cpu/runtime/fft_call.h"
@@ -136,6 +141,7 @@ limitations under the License.
 #include "tensorflow/compiler/xla/service/eigh_expander.h"
 #include "tensorflow/compiler/xla/service/flatten_call_graph.h"
 #include "tensorflow/compiler/xla/service/gather_expander.h"
+#include "tensorflow/compiler/xla/service/heap_simulator.h"
 #include "tensorflow/compiler/xla/service/hlo.pb.h"
 #include "tensorflow/compiler/xla/service/hlo_constant_folding.h"
 #include "tensorflow/compiler/xla/service/hlo_cse.h"
@@ -144,6 +150,7 @@ limitations under the License.
 #include "tensorflow/compiler/xla/service/hlo_ordering.h"
 #include "tensorflow/compiler/xla/service/hlo_pass_fix.h"
 #include "tensorflow/compiler/xla/service/hlo_pass_pipeline.h"
+#include "tensorflow/compiler/xla/service/hlo_rematerialization.h"
 #include "tensorflow/compiler/xla/service/hlo_verifier.h"
 #include "tensorflow/compiler/xla/service/indexed_array_analysis.h"
 #include "tensorflow/compiler/xla/service/llvm_compiler.h"
@@ -536,6 +543,53 @@ void AddHloVerifier(HloPassPipeline* pipeline, bool allow_sparse_shapes,
   }
 }
 
+// Keeps bf16 x bf16 matrix multiplications and convolutions in bf16, with an
+// f32 result, so that they are lowered to __xla_cpu_runtime_MatMulBF16F32 and
+// __xla_cpu_runtime_ConvBF16F32. All other bf16 operations are still
+// normalized to f32.
+class CpuBfloat16Support : public BFloat16Support {
+ public:
+  bool SupportsBF16Operand(const HloInstruction& hlo,
+                           int64_t operand_index) const override {
+    return BFloat16Support::SupportsBF16Operand(hlo, operand_index) ||
+           IsBF16Gemm(hlo) || IsBF16Convolution(hlo);
+  }
+
+  bool SupportsMixedPrecisions(const HloInstruction& hlo) const override {
+    return BFloat16Support::SupportsMixedPrecisions(hlo) || IsBF16Gemm(hlo) ||
+           IsBF16Convolution(hlo);
+  }
+
+ private:
+  // Returns whether `hlo` is a convolution that IsLowPrecisionConvolution
+  // accepts once its result is changed to f32.
+  static bool IsBF16Convolution(const HloInstruction& hlo) {
+    return (hlo.shape().element_type() == BF16 ||
+            hlo.shape().element_type() == F32) &&
+           IsLowPrecisionConvolution(hlo, /*result_type=*/F32);
+  }
+
+  // Returns whether `hlo` is a dot that IsLowPrecisionGemm accepts once its
+  // result is changed to f32.
+  static bool IsBF16Gemm(const HloInstruction& hlo) {
+    if (hlo.opcode() != HloOpcode::kDot || hlo.shape().rank() != 2 ||
+        (hlo.shape().element_type() != BF16 &&
+         hlo.shape().element_type() != F32)) {
+      return false;
+    }
+    const DotDimensionNumbers& dnums = hlo.dot_dimension_numbers();
+    return absl::c_all_of(hlo.operands(),
+                          [](const HloInstruction* operand) {
+                            return operand->shape().element_type() == BF16 &&
+                                   operand->shape().rank() == 2;
+                          }) &&
+           dnums.lhs_batch_dimensions_size() == 0 &&
+           dnums.lhs_contracting_dimensions_size() == 1 &&
+           absl::c_count(hlo.precision_config().operand_precision(),
+                         PrecisionConfig::PACKED_NIBBLE) == 0;
+  }
+};
+
 }  // namespace
 
 Status CpuCompiler::RunHloPassesThroughLayoutAssn(
@@ -574,7 +628,15 @@ Status CpuCompiler::RunHloPassesThroughLayoutAssn(
   HloPassPipeline pipeline("HLO passes through layout assignment");
   AddHloVerifier(&pipeline, allow_sparse_shapes_);
 
-  pipeline.AddPass<OperandUpcaster>();
+  // Matrix multiplications and convolutions of s8 into s32 and of bf16 into
+  // f32 are lowered to runtime kernels that take the narrow operands. The
+  // MLIR pipeline has no such lowering.
+  HloPredicate upcast_operands =
+      [is_mlir_compile](const HloInstruction* instr) {
+        return is_mlir_compile || (!IsLowPrecisionGemm(*instr) &&
+                                   !IsLowPrecisionConvolution(*instr));
+      };
+  pipeline.AddPass<OperandUpcaster>(upcast_operands);
   pipeline.AddPass<ResultCaster>();
 
   // Expand random number generation.
@@ -614,7 +676,8 @@ Status CpuCompiler::RunHloPassesThroughLayoutAssn(
   // support BF16 operations without directly implementing a BF16 lowering for
   // most ops.
   BFloat16Support bf16;
-  pipeline.AddPass<BFloat16Normalization>(&bf16);
+  CpuBfloat16Support cpu_bf16;
+  pipeline.AddPass<BFloat16Normalization>(is_mlir_compile ? &bf16 : &cpu_bf16);
   // After canonicalization, there may be more batch dots that can be
   // simplified.
   pipeline.AddPass<BatchDotSimplification>();
@@ -671,6 +734,13 @@ Status CpuCompiler::RunHloPassesThroughLayoutAssn(
         });
   }
 
+  // Matches attention before TreeReductionRewriter splits up the softmax
+  // reductions. Lowered to a libcall, like topk below.
+  if (!is_mlir_compile &&
+      module->config().debug_options().xla_cpu_enable_flash_attention()) {
+    pipeline.AddPass<FlashAttentionRewriter>();
+  }
+
   // Run the following passes to a fixed point.
   [&pipeline = pipeline.AddPass<HloPassFix<HloPassPipeline>>("simplification"),
    this] {
@@ -730,6 +800,19 @@ Status CpuCompiler::RunHloPassesThroughLayoutAssn(
 
   pipeline.AddPass<OptimizationBarrierExpander>();
   pipeline.AddPass<TupleSimplifier>();
+  // Upcasts the operands of mixed precision dots that the passes above turned
+  // into something other than a low precision GEMM, e.g. a batch dot, and of
+  // mixed precision convolutions that are not in the NHWC / HWIO form of the
+  // runtime kernels, e.g. because ConvCanonicalization only rewrites the
+  // entry computation.
+  pipeline.AddPass<OperandUpcaster>(
+      [upcast_operands,
+       target_machine_features](const HloInstruction* instr) {
+        return upcast_operands(instr) ||
+               (instr->opcode() == HloOpcode::kConvolution &&
+                !PotentiallyImplementedAsEigenConvolution(
+                    *instr, *target_machine_features));
+      });
 
   // Layout assignment uses alias analysis, which requires the call graph to be
   // flattened.
@@ -776,8 +859,18 @@ Status CpuCompiler::RunHloPassesAfterLayoutAssn(
 
   pipeline.AddPass<ReshapeDecomposer>();
 
+  // Measured cycles from an earlier profiled run of this module, if any.
+  std::unique_ptr<ProfileFeedback> profile_feedback;
+  const std::string& profile_feedback_file =
+      module->config().debug_options().xla_cpu_profile_feedback_file();
+  if (!profile_feedback_file.empty()) {
+    TF_ASSIGN_OR_RETURN(
+        profile_feedback,
+        ProfileFeedback::LoadForModule(profile_feedback_file, *module));
+  }
+
   // Add a fusion pass now that layout assignment is done.
-  pipeline.AddPass<CpuInstructionFusion>();
+  pipeline.AddPass<CpuInstructionFusion>(profile_feedback.get());
 
   // The LayoutAssignment pass may leave behind kCopy instructions which are
   // duplicate or NOPs, so remove them with algebraic simplification and CSE.
@@ -801,6 +894,29 @@ Status CpuCompiler::RunHloPassesAfterLayoutAssn(
     pipeline.AddPass<HloCSE>(/*is_layout_sensitive=*/true);
   }();
 
+  // Under a memory limit, schedule the module to minimize its peak memory and
+  // rematerialize values that are live across the peak. This happens before
+  // ParallelTaskAssigner because outlined calls cannot be rematerialized. The
+  // passes below keep the schedule, so they run in a pipeline of their own
+  // that does not verify it after every pass, and the schedule is updated at
+  // the end.
+  const int64_t memory_limit_bytes =
+      module->config().debug_options().xla_cpu_memory_limit_bytes();
+  HloPassPipeline scheduled_pipeline("HLO passes after rematerialization");
+  HloPassPipeline* tail_pipeline = &pipeline;
+  if (memory_limit_bytes > 0) {
+    pipeline.AddPass<HloMemoryScheduler>(
+        BufferSizeBytesFunction(),
+        ComputationSchedulerToModuleScheduler(DefaultMemoryScheduler));
+    pipeline.AddPass<HloRematerialization>(
+        ShapeSizeBytesFunction(), memory_limit_bytes, /*sizes=*/nullptr,
+        HloRematerialization::RematerializationPass::kPostFusion,
+        /*block_size_limit=*/1, /*block_rematerialization_factor=*/1,
+        /*compact_shape_function=*/nullptr,
+        HloRematerialization::RematerializationMode::kRecomputeOnly);
+    tail_pipeline = &scheduled_pipeline;
+  }
+
   // Outline ops in the entry computation into calls to subcomputations.
   const int max_parallelism =
       module->config().intra_op_parallelism_threads() > 0
@@ -812,8 +928,15 @@ Status CpuCompiler::RunHloPassesAfterLayoutAssn(
     // and thread synchronization dependencies which would likely increase
     // binary size (and most AOT applications are single-threaded).
     // TODO(b/29630486) Support multi-threaded AOT.
-    pipeline.AddPass<ParallelTaskAssigner>(
-        max_parallelism, ShapeSizeBytesFunction(), target_machine_features);
+    //
+    // ParallelForkJoin hands out partitions to threads dynamically, so loops
+    // are split into a few partitions per thread: threads that finish early or
+    // start late (e.g. when other executables share the pool) then balance the
+    // load instead of waiting for one oversized straggler.
+    constexpr int kPartitionsPerThread = 4;
+    tail_pipeline->AddPass<ParallelTaskAssigner>(
+        max_parallelism * kPartitionsPerThread, ShapeSizeBytesFunction(),
+        target_machine_features, profile_feedback.get());
   }
   // Copy insertion should be performed immediately before IR emission to
   // avoid inserting unnecessary copies (later pass adds an instruction which
@@ -821,10 +944,16 @@ Status CpuCompiler::RunHloPassesAfterLayoutAssn(
   // an instruction which materializes a value). DCE must be run immediately
   // before (and sometime after) copy insertion, to avoid dead code from
   // interfering with the rewrites.
-  pipeline.AddPass<HloDCE>();
-  pipeline.AddPass<CopyInsertion>();
-  pipeline.AddPass<HloDCE>();
-  return pipeline.Run(module).status();
+  tail_pipeline->AddPass<HloDCE>();
+  tail_pipeline->AddPass<CopyInsertion>();
+  tail_pipeline->AddPass<HloDCE>();
+  TF_RETURN_IF_ERROR(pipeline.Run(module).status());
+  if (memory_limit_bytes <= 0) {
+    return OkStatus();
+  }
+  TF_RETURN_IF_ERROR(scheduled_pipeline.Run(module).status());
+  // Places the copies inserted above, and drops the instructions removed.
+  return module->schedule().Update();
 }
 
 Status CpuCompiler::RunHloPasses(HloModule* module, bool is_aot_compile,
@@ -845,6 +974,59 @@ int64_t memory_alignment(LogicalBuffer::Color) {
   return cpu_function_runtime::MinAlign();
 }
 
+// Returns the order to emit the instructions of `module` in. Modules compiled
+// under xla_cpu_memory_limit_bytes keep the schedule they were rematerialized
+// against, others are scheduled with `algorithm`.
+StatusOr<HloSchedule> ScheduleModuleForEmission(
+    HloModule* module, const LogicalBuffer::SizeFunction& size_function,
+    const ModuleSchedulerAlgorithm& algorithm = {}) {
+  if (module->has_schedule() &&
+      module->config().debug_options().xla_cpu_memory_limit_bytes() > 0) {
+    return module->schedule();
+  }
+  return ScheduleModule(module, size_function, algorithm);
+}
+
+// Reports the peak memory that the heap simulator predicts for `schedule`
+// next to the memory that `assignment` actually allocates, which adds
+// fragmentation to it, for modules compiled under xla_cpu_memory_limit_bytes.
+// Warns if the temp buffers alone exceed the limit.
+Status ReportPeakMemory(const HloModule& module, const HloSchedule& schedule,
+                        const BufferAssignment& assignment,
+                        const LogicalBuffer::SizeFunction& size_function) {
+  const int64_t memory_limit_bytes =
+      module.config().debug_options().xla_cpu_memory_limit_bytes();
+  if (memory_limit_bytes <= 0) {
+    return OkStatus();
+  }
+  TF_ASSIGN_OR_RETURN(
+      int64_t predicted_bytes,
+      HeapSimulator::MinimumMemoryForModule(schedule, size_function));
+  int64_t parameter_bytes = 0;
+  int64_t temp_bytes = 0;
+  for (const BufferAllocation& allocation : assignment.Allocations()) {
+    if (allocation.is_constant() || allocation.is_thread_local()) {
+      continue;
+    }
+    (allocation.is_entry_computation_parameter() ? parameter_bytes
+                                                 : temp_bytes) +=
+        allocation.size();
+  }
+  VLOG(1) << "Peak memory of " << module.name() << ": predicted "
+          << HumanReadableNumBytes(predicted_bytes) << ", allocated "
+          << HumanReadableNumBytes(parameter_bytes + temp_bytes) << " ("
+          << HumanReadableNumBytes(parameter_bytes) << " of parameters)";
+  if (temp_bytes > memory_limit_bytes) {
+    LOG(WARNING) << "Temp buffers of " << module.name() << " take "
+                 << HumanReadableNumBytes(temp_bytes)
+                 << ", more than the memory limit of "
+                 << HumanReadableNumBytes(memory_limit_bytes)
+                 << ". The predicted peak including parameters was "
+                 << HumanReadableNumBytes(predicted_bytes) << ".";
+  }
+  return OkStatus();
+}
+
 llvm::TargetOptions CompilerTargetOptions(
     const HloModuleConfig& module_config) {
   llvm::TargetOptions target_options;
@@ -968,10 +1150,11 @@ StatusOr<std::unique_ptr<BufferAssignment>> CpuCompiler::AssignBuffers(
   // Select an order for emitting the HLO instructions for each computation.
   // Using this sequence enables tighter buffer liveness analysis and reduced
   // memory usage (as compared to using DependencyHloOrdering).
-  TF_ASSIGN_OR_RETURN(HloSchedule schedule,
-                      ScheduleModule(module, BufferSizeBytesFunction(),
-                                     ComputationSchedulerToModuleScheduler(
-                                         DFSMemoryScheduler)));
+  TF_ASSIGN_OR_RETURN(
+      HloSchedule schedule,
+      ScheduleModuleForEmission(
+          module, BufferSizeBytesFunction(),
+          ComputationSchedulerToModuleScheduler(DFSMemoryScheduler)));
   TF_RETURN_IF_ERROR(module->set_schedule(std::move(schedule)));
 
   // Run buffer allocation on the HLO graph.
@@ -1198,6 +1381,17 @@ CpuCompiler::CompileLegacyCpuExecutable(std::unique_ptr<HloModule> module) {
       GetIRModuleHooks(*module, user_pre_optimization_hook_,
                        user_post_optimization_hook_);
 
+  // Cached object files skip LLVM optimization, so the optimized IR would never
+  // reach the post-optimization hook or the IR dumps.
+  std::string object_cache_dir =
+      module->config().debug_options().xla_cpu_object_cache_dir();
+  if (!object_cache_dir.empty() &&
+      (user_post_optimization_hook_ || DumpingEnabledForHloModule(*module))) {
+    VLOG(1) << "Not using the object cache for " << module->name()
+            << " since its optimized IR is hooked or dumped";
+    object_cache_dir.clear();
+  }
+
   // Compile must be thread-safe so create a new LLVM context for the module.
   mlir::MLIRContext mlir_context;
   LoadMLIRDialects(mlir_context);
@@ -1212,7 +1406,7 @@ CpuCompiler::CompileLegacyCpuExecutable(std::unique_ptr<HloModule> module) {
       module->config().debug_options().xla_llvm_disable_expensive_passes(),
       llvm_ir::GetCpuFastMathFlags(module->config()), pre_optimization_ir_hook,
       post_optimization_ir_hook,
-      OrcJITPostCompilationHook::Create(module.get()));
+      OrcJITPostCompilationHook::Create(module.get()), object_cache_dir);
   if (!jit) {
     return InternalError("Creating JIT failed: %s",
                          llvm::toString(jit.takeError()));
@@ -1241,10 +1435,11 @@ CpuCompiler::CompileLegacyCpuExecutable(std::unique_ptr<HloModule> module) {
   // Select an order for emitting the HLO instructions for each
   // computation. Using this sequence enables tighter buffer liveness analysis
   // and reduced memory usage (as compared to using DependencyHloOrdering).
-  TF_ASSIGN_OR_RETURN(HloSchedule schedule,
-                      ScheduleModule(module.get(), BufferSizeBytesFunction(),
-                                     ComputationSchedulerToModuleScheduler(
-                                         DFSMemoryScheduler)));
+  TF_ASSIGN_OR_RETURN(
+      HloSchedule schedule,
+      ScheduleModuleForEmission(
+          module.get(), BufferSizeBytesFunction(),
+          ComputationSchedulerToModuleScheduler(DFSMemoryScheduler)));
 
   // Run buffer allocation on the HLO graph.
   TF_ASSIGN_OR_RETURN(
@@ -1253,6 +1448,8 @@ CpuCompiler::CompileLegacyCpuExecutable(std::unique_ptr<HloModule> module) {
                           std::make_unique<SequentialHloOrdering>(schedule),
                           BufferSizeBytesFunction(), memory_alignment,
                           /*allocate_buffers_for_constants=*/true));
+  TF_RETURN_IF_ERROR(ReportPeakMemory(*module, schedule, *assignment,
+                                      BufferSizeBytesFunction()));
   DumpHloModuleIfEnabled(*module, *assignment,
                          absl::StrCat("cpu_", kAfterOptimizationsDumpName));
 
@@ -1564,8 +1761,9 @@ CpuCompiler::CompileAheadOfTime(std::unique_ptr<HloModuleGroup> module_group,
         RunHloPasses(module, /*is_aot_compile=*/true, target_machine.get(),
                      /*is_mlir_compile=*/options.use_mlir_hlo_lowering()));
 
-    TF_ASSIGN_OR_RETURN(HloSchedule schedule,
-                        ScheduleModule(module, BufferSizeBytesFunction()));
+    TF_ASSIGN_OR_RETURN(
+        HloSchedule schedule,
+        ScheduleModuleForEmission(module, BufferSizeBytesFunction()));
 
     // Run buffer analysis on the HLO graph. This analysis figures out which
     // temporary buffers are required to run the computation.
@@ -1575,6 +1773,8 @@ CpuCompiler::CompileAheadOfTime(std::unique_ptr<HloModuleGroup> module_group,
                             std::make_unique<SequentialHloOrdering>(schedule),
                             BufferSizeBytesFunction(), memory_alignment,
                             /*allocate_buffers_for_constants=*/true));
+    TF_RETURN_IF_ERROR(ReportPeakMemory(*module, schedule, *assignment,
+                                        BufferSizeBytesFunction()));
     // BufferAssignment::ToString() includes a header, so no need for us to
     // print one ourselves.
     if (DumpingEnabledForHloModule(*module)) {
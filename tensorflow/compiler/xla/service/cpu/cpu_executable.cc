@@ -33,6 +33,7 @@ limitations under the License.
 #include "llvm/ExecutionEngine/Orc/IRCompileLayer.h"
 #include "mlir/Dialect/Func/IR/FuncOps.h"  // from @llvm-project
 #include "mlir/Parser/Parser.h"  // from @llvm-project
+#include "tensorflow/compiler/xla/cpu_function_runtime.h"
 #include "tensorflow/compiler/xla/hlo/ir/hlo_computation.h"
 #include "tensorflow/compiler/xla/hlo/ir/hlo_module.h"
 #include "tensorflow/compiler/xla/mlir/runtime/transforms/compiler.h"
@@ -92,6 +93,7 @@ CpuExecutable::CpuExecutable(
   VLOG(1) << "compute_function_ at address "
           << reinterpret_cast<void*>(compute_function_);
   jit_->DoneCompiling();
+  InitializeTempBufferPool();
 }
 
 CpuExecutable::CpuExecutable(
@@ -120,10 +122,37 @@ CpuExecutable::~CpuExecutable() {
   }
 }
 
+void CpuExecutable::InitializeTempBufferPool() {
+  if (!assignment_ || !has_module()) return;
+  const int capacity =
+      module().config().debug_options().xla_cpu_temp_buffer_pool_size();
+  if (capacity <= 0) return;
+
+  temp_buffer_offsets_.assign(assignment_->Allocations().size(), -1);
+  int64_t block_size = 0;
+  for (const BufferAllocation& allocation : assignment_->Allocations()) {
+    if (allocation.is_entry_computation_parameter() ||
+        allocation.is_constant() || allocation.is_thread_local() ||
+        allocation.maybe_live_out() || allocation.size() == 0) {
+      continue;
+    }
+    temp_buffer_offsets_[allocation.index()] = block_size;
+    block_size += RoundUpTo<int64_t>(allocation.size(),
+                                     cpu_function_runtime::Align());
+  }
+  if (block_size == 0) return;
+
+  VLOG(2) << "Pooling " << block_size << " bytes of temp buffers for module "
+          << module().name() << " in up to " << capacity << " blocks";
+  temp_buffer_pool_ = std::make_unique<TempBufferPool>(
+      block_size, cpu_function_runtime::Align(), capacity);
+}
+
 static StatusOr<MaybeOwningDeviceMemory> MemoryForAllocation(
     const BufferAllocation& allocation,
     absl::Span<ExecutionInput const> arguments,
-    se::DeviceMemoryAllocator* memory_allocator, int device_ordinal) {
+    se::DeviceMemoryAllocator* memory_allocator, int device_ordinal,
+    char* pooled_memory) {
   VLOG(3) << allocation.ToString();
   if (allocation.is_entry_computation_parameter()) {
     se::DeviceMemoryBase out = arguments[allocation.parameter_number()]
@@ -143,6 +172,14 @@ static StatusOr<MaybeOwningDeviceMemory> MemoryForAllocation(
   }
 
   int64_t buffer_size = allocation.size();
+  if (pooled_memory != nullptr) {
+    VLOG(3) << "buffer pooled " << buffer_size << " bytes [" << pooled_memory
+            << "]";
+    ABSL_ANNOTATE_MEMORY_IS_INITIALIZED(pooled_memory, buffer_size);
+    return MaybeOwningDeviceMemory{se::DeviceMemoryBase{
+        pooled_memory, static_cast<uint64_t>(buffer_size)}};
+  }
+
   TF_ASSIGN_OR_RETURN(se::OwningDeviceMemory out,
                       memory_allocator->Allocate(device_ordinal, buffer_size));
   VLOG(3) << "buffer allocated " << buffer_size << " bytes [" << out->opaque()
@@ -158,17 +195,27 @@ static StatusOr<MaybeOwningDeviceMemory> MemoryForAllocation(
 
 StatusOr<std::vector<MaybeOwningDeviceMemory>> CpuExecutable::CreateBufferTable(
     se::DeviceMemoryAllocator* memory_allocator, int device_ordinal,
-    absl::Span<ExecutionInput const> arguments) {
+    absl::Span<ExecutionInput const> arguments,
+    TempBufferPool::Block* temp_block) {
   std::vector<MaybeOwningDeviceMemory> buffers(
       assignment_->Allocations().size());
   VLOG(3) << "Allocating " << assignment_->Allocations().size()
           << " allocations for module " << module().name();
+  if (temp_buffer_pool_) {
+    *temp_block = temp_buffer_pool_->Acquire();
+    VLOG(3) << (temp_block->data() ? "Checked out pooled temp buffers"
+                                   : "Temp buffer pool exhausted");
+  }
   for (BufferAllocation::Index i = 0; i < assignment_->Allocations().size();
        ++i) {
     const BufferAllocation& allocation = assignment_->GetAllocation(i);
+    char* pooled_memory = nullptr;
+    if (temp_block->data() != nullptr && temp_buffer_offsets_[i] >= 0) {
+      pooled_memory = temp_block->data() + temp_buffer_offsets_[i];
+    }
     TF_ASSIGN_OR_RETURN(
         buffers[i], MemoryForAllocation(allocation, arguments, memory_allocator,
-                                        device_ordinal));
+                                        device_ordinal, pooled_memory));
   }
 
   if (VLOG_IS_ON(3)) {
@@ -608,10 +655,17 @@ StatusOr<ExecutionOutput> CpuExecutable::ExecuteAsyncOnStream(
       run_options->stream()->implementation());
   se::Stream* stream = run_options->stream();
   se::DeviceMemoryAllocator* memory_allocator = run_options->allocator();
+  uint64_t allocation_start_nanos = tsl::Env::Default()->NowNanos();
+  auto temp_block = std::make_shared<TempBufferPool::Block>();
   TF_ASSIGN_OR_RETURN(
       std::vector<MaybeOwningDeviceMemory> buffers,
       CreateBufferTable(memory_allocator, stream->parent()->device_ordinal(),
-                        arguments));
+                        arguments, temp_block.get()));
+  if (ExecutionProfile* profile =
+          run_options->run_options().execution_profile()) {
+    profile->set_buffer_allocation_time_ns(tsl::Env::Default()->NowNanos() -
+                                           allocation_start_nanos);
+  }
 
   TF_ASSIGN_OR_RETURN(
       ExecutionOutput result,
@@ -631,6 +685,8 @@ StatusOr<ExecutionOutput> CpuExecutable::ExecuteAsyncOnStream(
     CpuExecutable* executable;
     ServiceExecutableRunOptions run_options;
     std::shared_ptr<std::vector<MaybeOwningDeviceMemory>> task_buffers;
+    // Returned to the pool once the task has run and been destroyed.
+    std::shared_ptr<TempBufferPool::Block> temp_block;
     HloExecutionProfile* hlo_execution_profile;
 
     Status operator()() {
@@ -642,7 +698,7 @@ StatusOr<ExecutionOutput> CpuExecutable::ExecuteAsyncOnStream(
       AsyncRunTask{this, *run_options,
                    std::make_shared<std::vector<MaybeOwningDeviceMemory>>(
                        std::move(buffers)),
-                   hlo_execution_profile});
+                   std::move(temp_block), hlo_execution_profile});
 
   MarkToBeReleasedArguments(absl::MakeSpan(arguments), result);
   return std::move(result);
@@ -32,6 +32,7 @@ limitations under the License.
 #include "tensorflow/compiler/xla/runtime/jit_executable.h"
 #include "tensorflow/compiler/xla/service/buffer_assignment.h"
 #include "tensorflow/compiler/xla/service/cpu/simple_orc_jit.h"
+#include "tensorflow/compiler/xla/service/cpu/temp_buffer_pool.h"
 #include "tensorflow/compiler/xla/service/cpu/xla_framework.h"
 #include "tensorflow/compiler/xla/service/custom_call_status_internal.h"
 #include "tensorflow/compiler/xla/service/executable.h"
@@ -249,9 +250,18 @@ class CpuExecutable : public Executable {
   //
   //  - buffers_to_free: buffers whose ownership was donated by the caller that
   //    are to be freed by the caller.
+  //
+  // If a block can be checked out of `temp_buffer_pool_`, the temp buffers
+  // point into it instead of being allocated, and the block is returned in
+  // `temp_block`. It must be kept alive until the computation has run.
   StatusOr<std::vector<MaybeOwningDeviceMemory>> CreateBufferTable(
       se::DeviceMemoryAllocator* memory_allocator, int device_ordinal,
-      absl::Span<ExecutionInput const> arguments);
+      absl::Span<ExecutionInput const> arguments,
+      TempBufferPool::Block* temp_block);
+
+  // Lays out the temp allocations of `assignment_` in one block and creates
+  // `temp_buffer_pool_`, if enabled by the debug options.
+  void InitializeTempBufferPool();
 
   // Creates an Execution output holding ScopedShapedBuffer for holding the
   // result of the computation, moving buffers out of allocated_buffers and into
@@ -291,6 +301,14 @@ class CpuExecutable : public Executable {
   // If not null, XLA Runtime is enabled.
   std::unique_ptr<XlaRuntimeCpuExecutable> xla_runtime_executable_;
 
+  // Offset of each allocation within a block of `temp_buffer_pool_`, or -1
+  // for allocations that are not pooled (parameters, constants, thread-local
+  // and live-out allocations).
+  std::vector<int64_t> temp_buffer_offsets_;
+
+  // If not null, executions check their temp buffers out of this pool.
+  std::unique_ptr<TempBufferPool> temp_buffer_pool_;
+
   CpuExecutable(const CpuExecutable&) = delete;
   CpuExecutable& operator=(const CpuExecutable&) = delete;
 };
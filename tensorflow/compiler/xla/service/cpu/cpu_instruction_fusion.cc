@@ -15,6 +15,8 @@ limitations under the License.
 
 #include "tensorflow/compiler/xla/service/cpu/cpu_instruction_fusion.h"
 
+#include <optional>
+
 #include "tensorflow/compiler/xla/hlo/ir/hlo_opcode.h"
 #include "tensorflow/compiler/xla/service/fusion_node_indexing_evaluation.h"
 #include "tensorflow/compiler/xla/service/llvm_ir/fused_ir_emitter.h"
@@ -91,7 +93,8 @@ FusionDecision CpuInstructionFusion::ShouldFuse(HloInstruction* consumer,
 
   // Cost condition: not fuse (simple, expensive producers) and (consumers who
   // reuse operand elements).
-  if (producer->opcode() != HloOpcode::kFusion && is_expensive(*producer) &&
+  if (producer->opcode() != HloOpcode::kFusion &&
+      IsExpensiveToRecompute(*producer) &&
       ReusesOperandElements(consumer, operand_index)) {
     return "Fusion is not profitable.";
   }
@@ -190,6 +193,22 @@ FusionDecision CpuInstructionFusion::ShouldFuse(HloInstruction* consumer,
   return "Not fusing: not found a fusible case";
 }
 
+bool CpuInstructionFusion::IsExpensiveToRecompute(
+    const HloInstruction& producer) {
+  if (profile_feedback_ != nullptr) {
+    std::optional<int64_t> cycles = profile_feedback_->GetCycles(producer);
+    if (cycles.has_value()) {
+      // About what streaming an element back from memory costs. Producers
+      // that are cheaper than that are memory bound, and recomputing them
+      // beats materializing them.
+      constexpr int64_t kMaxRecomputeCyclesPerElement = 2;
+      return *cycles > kMaxRecomputeCyclesPerElement *
+                           ShapeUtil::ElementsIn(producer.shape());
+    }
+  }
+  return is_expensive(producer);
+}
+
 HloInstruction::FusionKind CpuInstructionFusion::ChooseKind(
     const HloInstruction* producer, const HloInstruction* consumer) {
   return CanBeOutputFused(producer, consumer)
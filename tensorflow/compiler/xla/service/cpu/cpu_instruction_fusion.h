@@ -18,6 +18,7 @@ limitations under the License.
 
 #include "absl/container/flat_hash_map.h"
 #include "tensorflow/compiler/xla/hlo/ir/hlo_instruction.h"
+#include "tensorflow/compiler/xla/service/cpu/profile_feedback.h"
 #include "tensorflow/compiler/xla/service/fusion_node_indexing_evaluation.h"
 #include "tensorflow/compiler/xla/service/instruction_fusion.h"
 
@@ -26,8 +27,12 @@ namespace cpu {
 
 class CpuInstructionFusion : public InstructionFusion {
  public:
-  CpuInstructionFusion()
-      : InstructionFusion(CpuInstructionFusion::IsExpensive) {}
+  // If `profile_feedback` is not null, the measured cost of unfused producers
+  // decides whether recomputing them in a fusion is expensive.
+  explicit CpuInstructionFusion(
+      const ProfileFeedback* profile_feedback = nullptr)
+      : InstructionFusion(CpuInstructionFusion::IsExpensive),
+        profile_feedback_(profile_feedback) {}
   ~CpuInstructionFusion() override = default;
 
   using HloPassInterface::Run;
@@ -48,6 +53,12 @@ class CpuInstructionFusion : public InstructionFusion {
   HloInstruction* FuseInstruction(HloInstruction* fusion_instruction,
                                   HloInstruction* producer) override;
 
+  // Returns whether recomputing `producer` for every use of its elements
+  // costs more than reading it from memory.
+  bool IsExpensiveToRecompute(const HloInstruction& producer);
+
+  const ProfileFeedback* profile_feedback_;
+
   // Keep track of the number of times each instruction inside a fusion node is
   // indexed with different index vectors.
   absl::flat_hash_map<const HloInstruction*, FusionNodeIndexingEvaluation>
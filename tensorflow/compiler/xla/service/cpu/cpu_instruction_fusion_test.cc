@@ -18,9 +18,12 @@ limitations under the License.
 #include <algorithm>
 #include <memory>
 #include <set>
+#include <string>
 
 #include "absl/strings/str_cat.h"
 #include "absl/types/span.h"
+#include "tensorflow/compiler/xla/service/cpu/profile_feedback.h"
+#include "tensorflow/compiler/xla/service/hlo_execution_profile_data.pb.h"
 #include "tensorflow/compiler/xla/service/hlo_matchers.h"
 #include "tensorflow/compiler/xla/service/transpose_folding.h"
 #include "tensorflow/compiler/xla/shape.h"
@@ -901,6 +904,68 @@ ENTRY main {
               Not(op::Fusion()));
 }
 
+// Returns a profile in which entry instruction `name` took `cycles`.
+ProfileFeedback MakeProfileFeedback(const HloModule& module,
+                                    const std::string& name, int64_t cycles) {
+  HloExecutionProfileData profile;
+  auto* printer_data = profile.mutable_printer_data();
+  printer_data->set_entry_computation(module.entry_computation()->name());
+  auto* computation_info = printer_data->add_computation_infos();
+  computation_info->set_name(module.entry_computation()->name());
+  auto* instruction_info = computation_info->add_instruction_infos();
+  instruction_info->set_name(name);
+  instruction_info->set_profile_index(0);
+  profile.add_profile_counters(cycles);
+  return ProfileFeedback(profile);
+}
+
+TEST_F(InstructionFusionTest, ProfiledCheapProducerFusedIntoReusingConsumer) {
+  absl::string_view module_string = R"(
+HloModule module
+
+ENTRY main {
+  p = f32[1024]{0} parameter(0)
+  e = f32[1024]{0} exponential(p)
+  ROOT b = f32[1024,64]{1,0} broadcast(e), dimensions={0}
+}
+)";
+
+  // Exponential is expensive to recompute for each of the 64 broadcast
+  // copies by default.
+  TF_ASSERT_OK_AND_ASSIGN(auto module,
+                          ParseAndReturnVerifiedModule(module_string));
+  TF_ASSERT_OK_AND_ASSIGN(bool fused_something,
+                          CpuInstructionFusion().Run(module.get()));
+  EXPECT_FALSE(fused_something);
+
+  // Measured at about a cycle per element, it is cheaper to recompute.
+  ProfileFeedback cheap = MakeProfileFeedback(*module, "e", /*cycles=*/1024);
+  TF_ASSERT_OK_AND_ASSIGN(fused_something,
+                          CpuInstructionFusion(&cheap).Run(module.get()));
+  EXPECT_TRUE(fused_something);
+  EXPECT_THAT(module->entry_computation()->root_instruction(), op::Fusion());
+}
+
+TEST_F(InstructionFusionTest, ProfiledExpensiveProducerNotFused) {
+  absl::string_view module_string = R"(
+HloModule module
+
+ENTRY main {
+  p = f32[1024]{0} parameter(0)
+  e = f32[1024]{0} exponential(p)
+  ROOT b = f32[1024,64]{1,0} broadcast(e), dimensions={0}
+}
+)";
+
+  TF_ASSERT_OK_AND_ASSIGN(auto module,
+                          ParseAndReturnVerifiedModule(module_string));
+  ProfileFeedback expensive =
+      MakeProfileFeedback(*module, "e", /*cycles=*/64 * 1024);
+  TF_ASSERT_OK_AND_ASSIGN(bool fused_something,
+                          CpuInstructionFusion(&expensive).Run(module.get()));
+  EXPECT_FALSE(fused_something);
+}
+
 TEST_F(InstructionFusionTest, FuseReduceMinor) {
   absl::string_view module_string = R"(
 HloModule module
@@ -144,6 +144,16 @@ extern const char* const kStatusIsSuccessSymbolName =
 extern const char* const kKeyValueSortSymbolName =
     "__xla_cpu_runtime_KeyValueSort";
 extern const char* const kTopKF32SymbolName = "__xla_cpu_runtime_TopKF32";
+extern const char* const kFlashAttentionF32SymbolName =
+    "__xla_cpu_runtime_FlashAttentionF32";
+extern const char* const kMatMulS8S32SymbolName =
+    "__xla_cpu_runtime_MatMulS8S32";
+extern const char* const kMatMulBF16F32SymbolName =
+    "__xla_cpu_runtime_MatMulBF16F32";
+extern const char* const kConvS8S32SymbolName =
+    "__xla_cpu_runtime_ConvS8S32";
+extern const char* const kConvBF16F32SymbolName =
+    "__xla_cpu_runtime_ConvBF16F32";
 extern const char* const kTracingStartSymbolName =
     "__xla_cpu_runtime_TracingStart";
 extern const char* const kTracingEndSymbolName = "__xla_cpu_runtime_TracingEnd";
@@ -81,6 +81,11 @@ extern const char* const kPrintfToStderrSymbolName;
 extern const char* const kStatusIsSuccessSymbolName;
 extern const char* const kKeyValueSortSymbolName;
 extern const char* const kTopKF32SymbolName;
+extern const char* const kFlashAttentionF32SymbolName;
+extern const char* const kMatMulS8S32SymbolName;
+extern const char* const kMatMulBF16F32SymbolName;
+extern const char* const kConvS8S32SymbolName;
+extern const char* const kConvBF16F32SymbolName;
 extern const char* const kAllReduceSymbolName;
 extern const char* const kCollectivePermuteSymbolName;
 extern const char* const kPartitionIdSymbolName;
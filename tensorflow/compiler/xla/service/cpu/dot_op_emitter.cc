@@ -18,8 +18,10 @@ limitations under the License.
 #include <memory>
 #include <vector>
 
+#include "absl/algorithm/container.h"
 #include "absl/strings/str_cat.h"
 #include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Constants.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Value.h"
@@ -112,6 +114,13 @@ enum class DotImplementationStrategy {
   // GEMM -- we expose this flexibility as flexibility in the contraction
   // dimensions, but we can also see this as flexibility in the input layouts.
   kEigen,
+
+  // The dot operation multiplies s8 matrices into an s32 result or bf16
+  // matrices into an f32 result, and is lowered into a call to the low
+  // precision runtime kernels without upcasting the operands. Like kEigen, the
+  // two inputs and the output have to be row major but either input may be
+  // transposed.
+  kLowPrecisionGemm,
 };
 
 // Returns the implementation strategy for a dot with the configuration
@@ -580,6 +589,7 @@ Status DotOpEmitter::Emit() {
       return EmitLinalgMatmul();
 
     case DotImplementationStrategy::kEigen:
+    case DotImplementationStrategy::kLowPrecisionGemm:
       return EmitCallToRuntime();
   }
 }
@@ -804,6 +814,7 @@ Status DotOpEmitter::EmitCallToRuntime() {
   bool use_mkl_dnn = hlo_module_config_.debug_options().xla_cpu_use_mkl_dnn();
   bool use_acl = hlo_module_config_.debug_options().xla_cpu_use_acl();
   PrimitiveType type = target_array_.GetShape().element_type();
+  PrimitiveType operand_type = lhs_array_.GetShape().element_type();
   llvm::Function* function = b_->GetInsertBlock()->getParent();
   llvm::Module* module = function->getParent();
   llvm::Type* float_type;
@@ -816,6 +827,11 @@ Status DotOpEmitter::EmitCallToRuntime() {
       float_type = b_->getHalfTy();
       break;
     case F32:
+      if (operand_type == BF16) {
+        fn_name = runtime::kMatMulBF16F32SymbolName;
+        float_type = b_->getFloatTy();
+        break;
+      }
       fn_name =
           multi_threaded
               ? (use_mkl_dnn ? runtime::kMKLMatMulF32SymbolName
@@ -848,6 +864,11 @@ Status DotOpEmitter::EmitCallToRuntime() {
       float_type = llvm_ir::PrimitiveTypeToIrType(C128, module);
       break;
     case S32:
+      if (operand_type == S8) {
+        fn_name = runtime::kMatMulS8S32SymbolName;
+        float_type = b_->getInt32Ty();
+        break;
+      }
       fn_name = multi_threaded
                     ? runtime::kEigenMatMulS32SymbolName
                     : runtime::kEigenSingleThreadedMatMulS32SymbolName;
@@ -859,12 +880,18 @@ Status DotOpEmitter::EmitCallToRuntime() {
   }
 
   llvm::Type* float_ptr_type = float_type->getPointerTo();
+  // The operands of low precision GEMMs are narrower than the result.
+  llvm::Type* operand_ptr_type =
+      operand_type == type
+          ? float_ptr_type
+          : llvm_ir::PrimitiveTypeToIrType(operand_type, module)
+                ->getPointerTo();
   llvm::Type* int64_type = b_->getInt64Ty();
   llvm::Type* int32_type = b_->getInt32Ty();
   llvm::Type* int8_ptr_type = b_->getInt8Ty()->getPointerTo();
   llvm::FunctionType* matmul_type = llvm::FunctionType::get(
       b_->getVoidTy(),
-      {int8_ptr_type, float_ptr_type, float_ptr_type, float_ptr_type,
+      {int8_ptr_type, float_ptr_type, operand_ptr_type, operand_ptr_type,
        int64_type, int64_type, int64_type, int32_type, int32_type},
       /*isVarArg=*/false);
 
@@ -902,12 +929,21 @@ Status DotOpEmitter::EmitCallToRuntime() {
     std::swap(transpose_lhs, transpose_rhs);
   }
 
+  // The low precision kernels have no single-threaded variants, and instead
+  // run on the calling thread if they are not passed the run options.
+  llvm::Value* run_options =
+      b_->CreateBitCast(executable_run_options_value_, int8_ptr_type);
+  if (operand_type != type && !multi_threaded) {
+    run_options = llvm::ConstantPointerNull::get(
+        llvm::cast<llvm::PointerType>(int8_ptr_type));
+  }
+
   b_->CreateCall(
       matmul_func,
-      {b_->CreateBitCast(executable_run_options_value_, int8_ptr_type),
+      {run_options,
        b_->CreateBitCast(target_array_.GetBasePointer(), float_ptr_type),
-       b_->CreateBitCast(lhs->GetBasePointer(), float_ptr_type),
-       b_->CreateBitCast(rhs->GetBasePointer(), float_ptr_type),
+       b_->CreateBitCast(lhs->GetBasePointer(), operand_ptr_type),
+       b_->CreateBitCast(rhs->GetBasePointer(), operand_ptr_type),
        b_->getInt64(mat_mult_dims.m), b_->getInt64(mat_mult_dims.n),
        b_->getInt64(mat_mult_dims.k), b_->getInt32(transpose_lhs),
        b_->getInt32(transpose_rhs)});
@@ -1152,6 +1188,30 @@ bool IsAlignedGemm(const DotInfo& dot_info,
                        dot_info.result_shape, target_machine_features);
 }
 
+// Returns whether `dot_info` multiplies s8 matrices into an s32 result or bf16
+// matrices into an f32 result.
+bool IsLowPrecisionGemm(const DotInfo& dot_info) {
+  if (!IsRank2(dot_info.lhs_shape) || !IsRank2(dot_info.rhs_shape) ||
+      !IsRank2(dot_info.result_shape) ||
+      dot_info.dim_nums.lhs_batch_dimensions_size() != 0 ||
+      dot_info.dim_nums.lhs_contracting_dimensions_size() != 1 ||
+      dot_info.dim_nums.rhs_contracting_dimensions_size() != 1) {
+    return false;
+  }
+  PrimitiveType operand_type = dot_info.lhs_shape.element_type();
+  if (dot_info.rhs_shape.element_type() != operand_type) {
+    return false;
+  }
+  switch (operand_type) {
+    case S8:
+      return dot_info.result_shape.element_type() == S32;
+    case BF16:
+      return dot_info.result_shape.element_type() == F32;
+    default:
+      return false;
+  }
+}
+
 bool CanEmitTiledLlvmIrGemm(
     const HloModuleConfig& config, const DotInfo& dot_info,
     const TargetMachineFeatures& target_machine_features) {
@@ -1196,6 +1256,12 @@ bool CanEmitTiledLlvmIrGemm(
 DotImplementationStrategy GetDotImplementationStrategy(
     const HloModuleConfig& config, const DotInfo& dot_info,
     const TargetMachineFeatures& target_machine_features) {
+  // The other strategies expect the operands to have the type of the result,
+  // which CpuCompiler only skips upcasting them to for these dots.
+  if (IsLowPrecisionGemm(dot_info)) {
+    return DotImplementationStrategy::kLowPrecisionGemm;
+  }
+
   PrimitiveType element_type = dot_info.result_shape.element_type();
   // Any Matrix-Vector product of floating point or integral type, or
   // a transpose-dot fusion of the same can be lowered to a tiled LLVM
@@ -1478,7 +1544,8 @@ bool DotImplementationCanHandleTranspose(
 
   return impl_strategy == DotImplementationStrategy::kNaiveLlvmIr ||
          impl_strategy == DotImplementationStrategy::kTiledLlvmIrGemv ||
-         impl_strategy == DotImplementationStrategy::kEigen;
+         impl_strategy == DotImplementationStrategy::kEigen ||
+         impl_strategy == DotImplementationStrategy::kLowPrecisionGemm;
 }
 
 bool DotOperandsAndResultMustHaveRowMajorLayout(
@@ -1496,7 +1563,15 @@ bool DotOperandsAndResultMustHaveRowMajorLayout(
                                    DotInfo(dot_instr), target_machine_features);
 
   return impl_strategy == DotImplementationStrategy::kTiledLlvmIrGemm ||
-         impl_strategy == DotImplementationStrategy::kEigen;
+         impl_strategy == DotImplementationStrategy::kEigen ||
+         impl_strategy == DotImplementationStrategy::kLowPrecisionGemm;
+}
+
+bool IsLowPrecisionGemm(const HloInstruction& dot) {
+  return dot.opcode() == HloOpcode::kDot &&
+         absl::c_count(dot.precision_config().operand_precision(),
+                       PrecisionConfig::PACKED_NIBBLE) == 0 &&
+         IsLowPrecisionGemm(DotInfo(dot));
 }
 
 Status EmitDotOperation(const HloInstruction& dot,
@@ -42,6 +42,12 @@ bool DotImplementationCanHandleTranspose(
     const HloInstruction& dot_instr,
     const TargetMachineFeatures& target_machine_features);
 
+// Returns true if `dot` is a matrix multiplication of s8 operands into an s32
+// result or of bf16 operands into an f32 result. These are lowered to the
+// kernels in runtime_low_precision_matmul.h, so their operands must not be
+// upcast to the result type.
+bool IsLowPrecisionGemm(const HloInstruction& dot);
+
 // Returns the index for an operand to `hlo` that should ideally be column
 // major.  Returns nullopt if there is no such operand or if `hlo` is not a dot
 // or a fusion containing a dot.
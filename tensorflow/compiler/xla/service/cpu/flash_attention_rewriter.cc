@@ -0,0 +1,249 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/compiler/xla/service/cpu/flash_attention_rewriter.h"
+
+#include <limits>
+#include <vector>
+
+#include "absl/algorithm/container.h"
+#include "absl/types/span.h"
+#include "tensorflow/compiler/xla/hlo/ir/hlo_computation.h"
+#include "tensorflow/compiler/xla/hlo/ir/hlo_instruction.h"
+#include "tensorflow/compiler/xla/hlo/ir/hlo_opcode.h"
+#include "tensorflow/compiler/xla/literal_util.h"
+#include "tensorflow/compiler/xla/service/cpu/ir_emission_utils.h"
+#include "tensorflow/compiler/xla/shape_util.h"
+#include "tensorflow/tsl/platform/errors.h"
+#include "tensorflow/tsl/platform/logging.h"
+
+namespace xla {
+namespace cpu {
+namespace {
+
+bool IsF32(const HloInstruction* instr) {
+  return instr->shape().element_type() == F32;
+}
+
+// Returns true if `dot` is a matrix multiplication over leading batch
+// dimensions that contracts the last dimension of the lhs with dimension
+// `rhs_contracting_dim` of the rhs.
+bool IsBatchedMatMul(const HloInstruction* dot, int64_t rhs_contracting_dim) {
+  if (dot->opcode() != HloOpcode::kDot) {
+    return false;
+  }
+  const int64_t rank = dot->shape().rank();
+  if (rank < 2 || dot->operand(0)->shape().rank() != rank ||
+      dot->operand(1)->shape().rank() != rank) {
+    return false;
+  }
+  std::vector<int64_t> batch_dims(rank - 2);
+  absl::c_iota(batch_dims, 0);
+  const DotDimensionNumbers& dnums = dot->dot_dimension_numbers();
+  return absl::c_equal(dnums.lhs_batch_dimensions(), batch_dims) &&
+         absl::c_equal(dnums.rhs_batch_dimensions(), batch_dims) &&
+         dnums.lhs_contracting_dimensions_size() == 1 &&
+         dnums.lhs_contracting_dimensions(0) == rank - 1 &&
+         dnums.rhs_contracting_dimensions_size() == 1 &&
+         dnums.rhs_contracting_dimensions(0) == rhs_contracting_dim;
+}
+
+// If `reduce` reduces the last dimension of a single array with a `opcode`
+// computation, returns that array. Returns nullptr otherwise.
+HloInstruction* LastDimReduceOperand(HloInstruction* reduce,
+                                     HloOpcode opcode) {
+  if (reduce->opcode() != HloOpcode::kReduce || reduce->operand_count() != 2) {
+    return nullptr;
+  }
+  HloInstruction* operand = reduce->mutable_operand(0);
+  if (reduce->dimensions() !=
+      std::vector<int64_t>{operand->shape().rank() - 1}) {
+    return nullptr;
+  }
+  const HloInstruction* root = reduce->to_apply()->root_instruction();
+  if (root->opcode() != opcode ||
+      root->operand(0)->opcode() != HloOpcode::kParameter ||
+      root->operand(1)->opcode() != HloOpcode::kParameter) {
+    return nullptr;
+  }
+  return operand;
+}
+
+// If `broadcast` broadcasts an array along the last dimension, returns that
+// array. Returns nullptr otherwise.
+HloInstruction* RowBroadcastOperand(HloInstruction* broadcast) {
+  if (broadcast->opcode() != HloOpcode::kBroadcast) {
+    return nullptr;
+  }
+  std::vector<int64_t> dims(broadcast->shape().rank() - 1);
+  absl::c_iota(dims, 0);
+  return broadcast->dimensions() == dims ? broadcast->mutable_operand(0)
+                                         : nullptr;
+}
+
+// If `broadcast` broadcasts an f32[] value, returns that value. Returns
+// nullptr otherwise.
+HloInstruction* ScalarBroadcastOperand(HloInstruction* broadcast) {
+  if (broadcast->opcode() != HloOpcode::kBroadcast ||
+      !ShapeUtil::IsScalarWithElementType(broadcast->operand(0)->shape(),
+                                          F32)) {
+    return nullptr;
+  }
+  return broadcast->mutable_operand(0);
+}
+
+// Returns true if `init` is a constant no greater than any finite f32.
+bool IsMaxIdentity(const HloInstruction* init) {
+  return init->opcode() == HloOpcode::kConstant &&
+         init->literal().GetAsDouble({}).value_or(0) <=
+             std::numeric_limits<float>::lowest();
+}
+
+bool IsZero(const HloInstruction* init) {
+  return init->opcode() == HloOpcode::kConstant && init->literal().IsZero({});
+}
+
+// Returns true if every user of `instr` is in `users`, so that `instr` becomes
+// dead once they are removed.
+bool HasOnlyUsers(const HloInstruction* instr,
+                  absl::Span<const HloInstruction* const> users) {
+  if (instr == instr->parent()->root_instruction()) {
+    return false;
+  }
+  return absl::c_all_of(instr->users(), [&](const HloInstruction* user) {
+    return absl::c_linear_search(users, user);
+  });
+}
+
+// Rewrites `out` into a flash attention custom call if it is the final dot of
+// a scaled dot-product attention.
+StatusOr<bool> TryRewriteAttention(HloInstruction* out) {
+  if (!IsBatchedMatMul(out, out->shape().rank() - 2) || !IsF32(out)) {
+    return false;
+  }
+  HloInstruction* probs = out->mutable_operand(0);
+  HloInstruction* value = out->mutable_operand(1);
+  if (probs->opcode() != HloOpcode::kDivide || !IsF32(probs) ||
+      !IsF32(value)) {
+    return false;
+  }
+
+  // probs = exp / broadcast(reduce_sum(exp))
+  HloInstruction* exp = probs->mutable_operand(0);
+  HloInstruction* sum_broadcast = probs->mutable_operand(1);
+  HloInstruction* sum = RowBroadcastOperand(sum_broadcast);
+  if (exp->opcode() != HloOpcode::kExp || sum == nullptr ||
+      LastDimReduceOperand(sum, HloOpcode::kAdd) != exp ||
+      !IsZero(sum->operand(1))) {
+    return false;
+  }
+
+  // exp = exp(scores - broadcast(reduce_max(scores)))
+  HloInstruction* centered = exp->mutable_operand(0);
+  if (centered->opcode() != HloOpcode::kSubtract) {
+    return false;
+  }
+  HloInstruction* scores = centered->mutable_operand(0);
+  HloInstruction* max_broadcast = centered->mutable_operand(1);
+  HloInstruction* max = RowBroadcastOperand(max_broadcast);
+  if (max == nullptr ||
+      LastDimReduceOperand(max, HloOpcode::kMaximum) != scores ||
+      !IsMaxIdentity(max->operand(1))) {
+    return false;
+  }
+
+  // scores = dot(query, key), optionally multiplied or divided by a scalar.
+  HloInstruction* query_key = scores;
+  HloInstruction* scale_broadcast = nullptr;
+  HloInstruction* scale = nullptr;
+  bool reciprocal_scale = false;
+  if (scores->opcode() == HloOpcode::kMultiply ||
+      scores->opcode() == HloOpcode::kDivide) {
+    reciprocal_scale = scores->opcode() == HloOpcode::kDivide;
+    int64_t dot_index = 0;
+    if (!reciprocal_scale &&
+        scores->operand(0)->opcode() == HloOpcode::kBroadcast) {
+      dot_index = 1;
+    }
+    query_key = scores->mutable_operand(dot_index);
+    scale_broadcast = scores->mutable_operand(1 - dot_index);
+    scale = ScalarBroadcastOperand(scale_broadcast);
+    if (scale == nullptr) {
+      return false;
+    }
+  }
+  if (!IsBatchedMatMul(query_key, query_key->shape().rank() - 1)) {
+    return false;
+  }
+  HloInstruction* query = query_key->mutable_operand(0);
+  HloInstruction* key = query_key->mutable_operand(1);
+  if (!IsF32(query) || !IsF32(key)) {
+    return false;
+  }
+
+  // The rewrite only pays off if the intermediates disappear.
+  if (!HasOnlyUsers(probs, {out}) || !HasOnlyUsers(sum_broadcast, {probs}) ||
+      !HasOnlyUsers(sum, {sum_broadcast}) ||
+      !HasOnlyUsers(exp, {probs, sum}) || !HasOnlyUsers(centered, {exp}) ||
+      !HasOnlyUsers(max_broadcast, {centered}) ||
+      !HasOnlyUsers(max, {max_broadcast}) ||
+      !HasOnlyUsers(scores, {centered, max})) {
+    return false;
+  }
+  if (scale != nullptr && (!HasOnlyUsers(query_key, {scores}) ||
+                           !HasOnlyUsers(scale_broadcast, {scores}))) {
+    return false;
+  }
+
+  HloComputation* computation = out->parent();
+  if (scale == nullptr || reciprocal_scale) {
+    HloInstruction* one = computation->AddInstruction(
+        HloInstruction::CreateConstant(LiteralUtil::CreateR0<float>(1.0f)));
+    scale = scale == nullptr
+                ? one
+                : computation->AddInstruction(HloInstruction::CreateBinary(
+                      one->shape(), HloOpcode::kDivide, one, scale));
+  }
+  HloInstruction* attention =
+      computation->AddInstruction(HloInstruction::CreateCustomCall(
+          out->shape(), {query, key, value, scale},
+          kFlashAttentionCustomCallTarget));
+  VLOG(2) << "Rewriting " << out->ToString() << " to "
+          << attention->ToString();
+  TF_RETURN_IF_ERROR(computation->ReplaceInstruction(out, attention));
+  return true;
+}
+
+}  // namespace
+
+StatusOr<bool> FlashAttentionRewriter::Run(
+    HloModule* module,
+    const absl::flat_hash_set<absl::string_view>& execution_threads) {
+  bool changed = false;
+  for (HloComputation* computation :
+       module->MakeNonfusionComputations(execution_threads)) {
+    // A rewrite only removes instructions that precede the rewritten dot in
+    // post order, which have been visited already.
+    for (HloInstruction* instruction :
+         computation->MakeInstructionPostOrder()) {
+      TF_ASSIGN_OR_RETURN(bool rewritten, TryRewriteAttention(instruction));
+      changed |= rewritten;
+    }
+  }
+  return changed;
+}
+
+}  // namespace cpu
+}  // namespace xla
@@ -0,0 +1,51 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_COMPILER_XLA_SERVICE_CPU_FLASH_ATTENTION_REWRITER_H_
+#define TENSORFLOW_COMPILER_XLA_SERVICE_CPU_FLASH_ATTENTION_REWRITER_H_
+
+#include "tensorflow/compiler/xla/hlo/ir/hlo_module.h"
+#include "tensorflow/compiler/xla/service/hlo_pass_interface.h"
+
+namespace xla {
+namespace cpu {
+
+// An HLO pass that replaces F32 scaled dot-product attention
+//
+//   scores = dot(query, key)              [batch..., q, k], contracting on the
+//                                         last dimension of query and key
+//   probs  = softmax(scale * scores)      over the last dimension
+//   out    = dot(probs, value)            [batch..., q, v]
+//
+// with a kFlashAttentionCustomCallTarget custom call, which is lowered to a
+// runtime call that never materializes the [batch..., q, k] score array. The
+// softmax must be the numerically stable expansion that subtracts the row
+// maximum, and the intermediate values must have no users outside the
+// pattern.
+class FlashAttentionRewriter : public HloModulePass {
+ public:
+  ~FlashAttentionRewriter() override = default;
+  absl::string_view name() const override { return "flash-attention-rewriter"; }
+
+  using HloPassInterface::Run;
+  StatusOr<bool> Run(
+      HloModule* module,
+      const absl::flat_hash_set<absl::string_view>& execution_threads) override;
+};
+
+}  // namespace cpu
+}  // namespace xla
+
+#endif  // TENSORFLOW_COMPILER_XLA_SERVICE_CPU_FLASH_ATTENTION_REWRITER_H_
@@ -0,0 +1,145 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/compiler/xla/service/cpu/flash_attention_rewriter.h"
+
+#include <string>
+
+#include "absl/strings/str_replace.h"
+#include "tensorflow/compiler/xla/service/cpu/ir_emission_utils.h"
+#include "tensorflow/compiler/xla/service/hlo_matchers.h"
+#include "tensorflow/compiler/xla/tests/hlo_test_base.h"
+
+namespace op = xla::testing::opcode_matchers;
+
+namespace xla {
+namespace cpu {
+namespace {
+
+using FlashAttentionRewriterTest = HloTestBase;
+
+// Attention over [batch, heads, seq, head_dim] with the scores computed as
+// `$scores` from `qk`.
+constexpr char kAttentionTemplate[] = R"(
+HloModule Attention
+
+max {
+  a = f32[] parameter(0)
+  b = f32[] parameter(1)
+  ROOT m = f32[] maximum(a, b)
+}
+
+add {
+  a = f32[] parameter(0)
+  b = f32[] parameter(1)
+  ROOT s = f32[] add(a, b)
+}
+
+ENTRY main {
+  q = f32[2,4,32,16] parameter(0)
+  k = f32[2,4,48,16] parameter(1)
+  v = f32[2,4,48,8] parameter(2)
+  qk = f32[2,4,32,48] dot(q, k), lhs_batch_dims={0,1}, rhs_batch_dims={0,1},
+    lhs_contracting_dims={3}, rhs_contracting_dims={3}
+  c = f32[] constant(0.25)
+  c_b = f32[2,4,32,48] broadcast(c), dimensions={}
+  scores = $scores
+  neg_inf = f32[] constant(-inf)
+  row_max = f32[2,4,32] reduce(scores, neg_inf), dimensions={3}, to_apply=max
+  row_max_b = f32[2,4,32,48] broadcast(row_max), dimensions={0,1,2}
+  centered = f32[2,4,32,48] subtract(scores, row_max_b)
+  e = f32[2,4,32,48] exponential(centered)
+  zero = f32[] constant(0)
+  row_sum = f32[2,4,32] reduce(e, zero), dimensions={3}, to_apply=add
+  row_sum_b = f32[2,4,32,48] broadcast(row_sum), dimensions={0,1,2}
+  probs = f32[2,4,32,48] divide(e, row_sum_b)
+  ROOT out = f32[2,4,32,8] dot(probs, v), lhs_batch_dims={0,1},
+    rhs_batch_dims={0,1}, lhs_contracting_dims={3}, rhs_contracting_dims={2}
+}
+)";
+
+std::string AttentionHlo(const std::string& scores) {
+  return absl::StrReplaceAll(kAttentionTemplate, {{"$scores", scores}});
+}
+
+TEST_F(FlashAttentionRewriterTest, RewritesScaledAttention) {
+  TF_ASSERT_OK_AND_ASSIGN(
+      auto module, ParseAndReturnVerifiedModule(
+                       AttentionHlo("f32[2,4,32,48] multiply(c_b, qk)")));
+  EXPECT_TRUE(FlashAttentionRewriter().Run(module.get()).value());
+
+  const HloInstruction* root = module->entry_computation()->root_instruction();
+  EXPECT_THAT(root, op::CustomCall(op::Parameter(0), op::Parameter(1),
+                                   op::Parameter(2), op::Constant()));
+  EXPECT_EQ(root->custom_call_target(), kFlashAttentionCustomCallTarget);
+  EXPECT_EQ(root->operand(3)->literal().GetFirstElement<float>(), 0.25f);
+  // Only the inputs, the scale and the custom call are left.
+  EXPECT_EQ(module->entry_computation()->instruction_count(), 5);
+}
+
+TEST_F(FlashAttentionRewriterTest, RewritesDividedScores) {
+  TF_ASSERT_OK_AND_ASSIGN(
+      auto module, ParseAndReturnVerifiedModule(
+                       AttentionHlo("f32[2,4,32,48] divide(qk, c_b)")));
+  EXPECT_TRUE(FlashAttentionRewriter().Run(module.get()).value());
+  EXPECT_THAT(module->entry_computation()->root_instruction(),
+              op::CustomCall(op::Parameter(0), op::Parameter(1),
+                             op::Parameter(2),
+                             op::Divide(op::Constant(), op::Constant())));
+}
+
+TEST_F(FlashAttentionRewriterTest, RewritesUnscaledAttention) {
+  TF_ASSERT_OK_AND_ASSIGN(
+      auto module, ParseAndReturnVerifiedModule(
+                       AttentionHlo("f32[2,4,32,48] copy(qk)")));
+  // Folds the copy so the softmax reads the dot directly.
+  HloInstruction* scores =
+      module->entry_computation()->GetInstructionWithName("scores");
+  TF_ASSERT_OK(scores->ReplaceAllUsesWith(scores->mutable_operand(0)));
+  TF_ASSERT_OK(module->entry_computation()->RemoveInstruction(scores));
+  EXPECT_TRUE(FlashAttentionRewriter().Run(module.get()).value());
+
+  const HloInstruction* root = module->entry_computation()->root_instruction();
+  EXPECT_THAT(root, op::CustomCall(op::Parameter(0), op::Parameter(1),
+                                   op::Parameter(2), op::Constant()));
+  EXPECT_EQ(root->operand(3)->literal().GetFirstElement<float>(), 1.0f);
+}
+
+TEST_F(FlashAttentionRewriterTest, KeepsAttentionWithSharedScores) {
+  // The scores are also returned, so they have to be materialized anyway.
+  std::string hlo = AttentionHlo("f32[2,4,32,48] multiply(qk, c_b)");
+  hlo = absl::StrReplaceAll(
+      hlo, {{"ROOT out = f32[2,4,32,8]", "out = f32[2,4,32,8]"},
+            {"rhs_contracting_dims={2}\n}",
+             "rhs_contracting_dims={2}\n  ROOT t = (f32[2,4,32,8], "
+             "f32[2,4,32,48]) tuple(out, scores)\n}"}});
+  TF_ASSERT_OK_AND_ASSIGN(auto module, ParseAndReturnVerifiedModule(hlo));
+  EXPECT_FALSE(FlashAttentionRewriter().Run(module.get()).value());
+}
+
+TEST_F(FlashAttentionRewriterTest, KeepsSoftmaxOverOtherDimension) {
+  std::string hlo = absl::StrReplaceAll(
+      AttentionHlo("f32[2,4,32,48] multiply(qk, c_b)"),
+      {{"row_max = f32[2,4,32] reduce(scores, neg_inf), dimensions={3}",
+        "row_max = f32[2,4,48] reduce(scores, neg_inf), dimensions={2}"},
+       {"row_max_b = f32[2,4,32,48] broadcast(row_max), dimensions={0,1,2}",
+        "row_max_b = f32[2,4,32,48] broadcast(row_max), dimensions={0,1,3}"}});
+  TF_ASSERT_OK_AND_ASSIGN(auto module, ParseAndReturnVerifiedModule(hlo));
+  EXPECT_FALSE(FlashAttentionRewriter().Run(module.get()).value());
+}
+
+}  // namespace
+}  // namespace cpu
+}  // namespace xla
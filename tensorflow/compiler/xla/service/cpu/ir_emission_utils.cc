@@ -58,8 +58,12 @@ bool PotentiallyImplementedAsEigenConvolution(
            TargetMachineFeatures::kEigenExpectedTensorAlignment;
   };
 
-  if (!is_aligned(input_shape) || !is_aligned(kernel_shape) ||
-      !is_aligned(output_shape)) {
+  // The low precision kernels don't need aligned tensors, and there is no
+  // other lowering of them that accumulates in the result type.
+  const bool low_precision = IsLowPrecisionConvolution(convolution);
+  if (!low_precision &&
+      (!is_aligned(input_shape) || !is_aligned(kernel_shape) ||
+       !is_aligned(output_shape))) {
     return false;
   }
 
@@ -67,13 +71,15 @@ bool PotentiallyImplementedAsEigenConvolution(
       ShapeUtil::IsZeroElementArray(kernel_shape)) {
     return false;
   }
-  // Make sure input and kernel has the same data type.
-  CHECK(
-      ShapeUtil::SameElementTypeIgnoringFpPrecision(input_shape, kernel_shape));
-  // TODO(b/65408531): Explore using Eigen dot for complex64 type.
-  PrimitiveType primitive_type = input_shape.element_type();
-  if (primitive_type != F16 && primitive_type != F32) {
-    return false;
+  if (!low_precision) {
+    // Make sure input and kernel has the same data type.
+    CHECK(ShapeUtil::SameElementTypeIgnoringFpPrecision(input_shape,
+                                                        kernel_shape));
+    // TODO(b/65408531): Explore using Eigen dot for complex64 type.
+    PrimitiveType primitive_type = input_shape.element_type();
+    if (primitive_type != F16 && primitive_type != F32) {
+      return false;
+    }
   }
   if (window_util::HasWindowReversal(convolution.window())) {
     return false;
@@ -110,5 +116,37 @@ bool PotentiallyImplementedAsEigenConvolution(
              kernel_shape.dimensions_size() - 1;
 }
 
+bool IsLowPrecisionConvolution(const HloInstruction& convolution) {
+  return IsLowPrecisionConvolution(convolution,
+                                   convolution.shape().element_type());
+}
+
+bool IsLowPrecisionConvolution(const HloInstruction& convolution,
+                               PrimitiveType result_type) {
+  if (convolution.opcode() != HloOpcode::kConvolution ||
+      convolution.feature_group_count() != 1 ||
+      convolution.batch_group_count() != 1 ||
+      window_util::HasWindowReversal(convolution.window())) {
+    return false;
+  }
+  const int64_t num_spatial_dims = convolution.convolution_dimension_numbers()
+                                       .input_spatial_dimensions_size();
+  if (num_spatial_dims < 1 || num_spatial_dims > 2) {
+    return false;
+  }
+  PrimitiveType operand_type = convolution.operand(0)->shape().element_type();
+  if (convolution.operand(1)->shape().element_type() != operand_type) {
+    return false;
+  }
+  switch (operand_type) {
+    case S8:
+      return result_type == S32;
+    case BF16:
+      return result_type == F32;
+    default:
+      return false;
+  }
+}
+
 }  // namespace cpu
 }  // namespace xla
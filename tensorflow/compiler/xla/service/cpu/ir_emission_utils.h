@@ -16,6 +16,7 @@ limitations under the License.
 #ifndef TENSORFLOW_COMPILER_XLA_SERVICE_CPU_IR_EMISSION_UTILS_H_
 #define TENSORFLOW_COMPILER_XLA_SERVICE_CPU_IR_EMISSION_UTILS_H_
 
+#include "absl/strings/string_view.h"
 #include "llvm/IR/Value.h"
 #include "tensorflow/compiler/xla/hlo/ir/hlo_instruction.h"
 #include "tensorflow/compiler/xla/service/cpu/target_machine_features.h"
@@ -27,11 +28,28 @@ bool PotentiallyImplementedAsEigenConvolution(
     const HloInstruction& convolution,
     const TargetMachineFeatures& target_machine_features);
 
+// Returns true if `convolution` is a 1D or 2D convolution of s8 operands into
+// an s32 result or of bf16 operands into an f32 result, without feature or
+// batch groups. Once in NHWC / HWIO form, these are lowered to the kernels in
+// runtime_low_precision_conv2d.h, so their operands must not be upcast to the
+// result type.
+bool IsLowPrecisionConvolution(const HloInstruction& convolution);
+
+// As above, but as if the result of `convolution` had type `result_type`.
+bool IsLowPrecisionConvolution(const HloInstruction& convolution,
+                               PrimitiveType result_type);
+
 // Computes the minimum alignment guaranteed for a tensor of shape `shape` on
 // the target machine.
 int64_t GetMinimumAlignmentForArray(
     const Shape& shape, const TargetMachineFeatures& target_machine_features);
 
+// Target of the custom calls created by FlashAttentionRewriter. Operands are
+// the query, key and value arrays and the f32[] softmax scale; the IR emitter
+// lowers the call to __xla_cpu_runtime_FlashAttentionF32.
+inline constexpr absl::string_view kFlashAttentionCustomCallTarget =
+    "__cpu$FlashAttention";
+
 // Dynamic loop bounds are specified as an array of dimension index
 // [start, limit) pairs of ir values (one for each partitioned outer dimension).
 //
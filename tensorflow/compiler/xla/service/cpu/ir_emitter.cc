@@ -63,6 +63,7 @@ limitations under the License.
 #include "tensorflow/compiler/xla/service/cpu/ir_emission_utils.h"
 #include "tensorflow/compiler/xla/service/cpu/ir_function.h"
 #include "tensorflow/compiler/xla/service/cpu/parallel_loop_emitter.h"
+#include "tensorflow/compiler/xla/service/cpu/runtime_key_value_sort.h"
 #include "tensorflow/compiler/xla/service/elemental_ir_emitter.h"
 #include "tensorflow/compiler/xla/service/llvm_ir/buffer_assignment_util.h"
 #include "tensorflow/compiler/xla/service/llvm_ir/dynamic_update_slice_util.h"
@@ -555,6 +556,62 @@ Status IrEmitter::HandleOutfeed(HloInstruction* outfeed) {
   return OkStatus();
 }
 
+namespace {
+// Returns how the runtime can order the keys of `sort` without calling its
+// comparator, i.e. whether the comparator only compares the keys with LT or
+// GT. Sets `descending` for GT.
+SortKeyKind GetSortKeyKind(const HloSortInstruction& sort, bool* descending) {
+  const HloInstruction* root = sort.to_apply()->root_instruction();
+  if (root->opcode() != HloOpcode::kCompare) {
+    return kSortKeyGeneric;
+  }
+  const HloInstruction* lhs = root->operand(0);
+  const HloInstruction* rhs = root->operand(1);
+  if (lhs->opcode() != HloOpcode::kParameter ||
+      rhs->opcode() != HloOpcode::kParameter) {
+    return kSortKeyGeneric;
+  }
+  bool swapped;
+  if (lhs->parameter_number() == 0 && rhs->parameter_number() == 1) {
+    swapped = false;
+  } else if (lhs->parameter_number() == 1 && rhs->parameter_number() == 0) {
+    swapped = true;
+  } else {
+    return kSortKeyGeneric;
+  }
+  const auto* compare = Cast<HloCompareInstruction>(root);
+  switch (compare->direction()) {
+    case ComparisonDirection::kLt:
+      *descending = swapped;
+      break;
+    case ComparisonDirection::kGt:
+      *descending = !swapped;
+      break;
+    default:
+      return kSortKeyGeneric;
+  }
+  switch (sort.keys()->shape().element_type()) {
+    case S8:
+    case S16:
+    case S32:
+    case S64:
+      return kSortKeySigned;
+    case U8:
+    case U16:
+    case U32:
+    case U64:
+      return kSortKeyUnsigned;
+    case F32:
+    case F64:
+      return compare->order() == ComparisonOrder::kTotal
+                 ? kSortKeyFloatTotalOrder
+                 : kSortKeyFloat;
+    default:
+      return kSortKeyGeneric;
+  }
+}
+}  // namespace
+
 Status IrEmitter::HandleSort(HloInstruction* hlo) {
   const HloSortInstruction* sort = Cast<HloSortInstruction>(hlo);
   TF_RETURN_IF_ERROR(EmitTargetAddressForOp(sort));
@@ -637,13 +694,15 @@ Status IrEmitter::HandleSort(HloInstruction* hlo) {
   auto less_than_function =
       FindOrDie(emitted_functions_,
                 ComputationToEmit{sort->to_apply(), allow_reassociation_});
+  bool key_descending = false;
+  SortKeyKind key_kind = GetSortKeyKind(*sort, &key_descending);
   EmitCallToFunc(
       runtime::kKeyValueSortSymbolName,
       {b_.getInt64(higher_dimensions), b_.getInt64(sort_dimension_elements),
        b_.getInt64(lower_dimensions), values,
        b_.getInt32(sort->operand_count()), sizes, b_.getInt1(sort->is_stable()),
        GetExecutableRunOptionsArgument(), GetProfileCountersArgument(),
-       less_than_function},
+       less_than_function, b_.getInt32(key_kind), b_.getInt1(key_descending)},
       b_.getVoidTy());
 
   if (sort->values_count() > 0) {
@@ -871,7 +930,8 @@ Status IrEmitter::HandleDot(HloInstruction* dot) {
   TF_RETURN_IF_ERROR(ElementTypesSameAndSupported(
       /*instruction=*/*dot, /*operands=*/{lhs, rhs},
       /*supported_types=*/
-      {PRED, S8, U8, S16, U16, S32, U32, S64, U64, F16, F32, F64, C64, C128}));
+      {PRED, S8, U8, S16, U16, S32, U32, S64, U64, F16, BF16, F32, F64, C64,
+       C128}));
   const DotDimensionNumbers& dnums = dot->dot_dimension_numbers();
 
   if (dnums.lhs_contracting_dimensions_size() != 1) {
@@ -907,7 +967,8 @@ Status IrEmitter::HandleConvolution(HloInstruction* convolution) {
   TF_RETURN_IF_ERROR(ElementTypesSameAndSupported(
       /*instruction=*/*convolution, /*operands=*/{lhs, rhs},
       /*supported_types=*/
-      {PRED, S8, U8, S16, U16, S32, U32, S64, U64, F16, F32, F64, C64, C128}));
+      {PRED, S8, U8, S16, U16, S32, U32, S64, U64, F16, BF16, F32, F64, C64,
+       C128}));
 
   // TODO(tonywy): Add PotentiallyImplementedAsMKLConvolution to support
   // different data layouts.
@@ -987,9 +1048,21 @@ Status IrEmitter::HandleConvolution(HloInstruction* convolution) {
       }
 
       PrimitiveType primitive_type = lhs->shape().element_type();
+      const bool low_precision = IsLowPrecisionConvolution(*convolution);
       llvm::Type* ir_ptr_type = primitive_type == F16
                                     ? b_.getHalfTy()->getPointerTo()
                                     : b_.getFloatTy()->getPointerTo();
+      // The operands of low precision convolutions are narrower than the
+      // result.
+      llvm::Type* operand_ptr_type = ir_ptr_type;
+      if (low_precision) {
+        ir_ptr_type = llvm_ir::PrimitiveTypeToIrType(
+                          convolution_shape.element_type(), module_)
+                          ->getPointerTo();
+        operand_ptr_type =
+            llvm_ir::PrimitiveTypeToIrType(primitive_type, module_)
+                ->getPointerTo();
+      }
       bool multi_threaded =
           hlo_module_config_.debug_options().xla_cpu_multi_thread_eigen();
       bool use_mkl_dnn =
@@ -1011,7 +1084,11 @@ Status IrEmitter::HandleConvolution(HloInstruction* convolution) {
       // TODO(b/78639006) Singlethread MKL conv2d is not implemented due to the
       // potential race condition by setting the omp_num_threads.
       const char* fn_name;
-      if (input_dims.size() == 2) {
+      if (low_precision) {
+        TF_RET_CHECK(input_dims.size() == 2);
+        fn_name = primitive_type == S8 ? runtime::kConvS8S32SymbolName
+                                       : runtime::kConvBF16F32SymbolName;
+      } else if (input_dims.size() == 2) {
         fn_name =
             primitive_type == F16
                 ? (multi_threaded
@@ -1039,11 +1116,18 @@ Status IrEmitter::HandleConvolution(HloInstruction* convolution) {
         LOG(WARNING) << "Using Eigen instead of MKL-DNN for single-threaded "
                         "convolution.";
       }
+      // The low precision kernels have no single-threaded variants, and
+      // instead run on the calling thread if they are not passed the run
+      // options.
+      llvm::Value* run_options = GetExecutableRunOptionsArgument();
+      if (low_precision && !multi_threaded) {
+        run_options = llvm::Constant::getNullValue(run_options->getType());
+      }
       std::vector<llvm::Value*> args = {
-          GetExecutableRunOptionsArgument(),
+          run_options,
           BitCast(GetEmittedValueFor(convolution), ir_ptr_type),
-          BitCast(lhs_address, ir_ptr_type),
-          BitCast(rhs_address, ir_ptr_type),
+          BitCast(lhs_address, operand_ptr_type),
+          BitCast(rhs_address, operand_ptr_type),
           b_.getInt64(input_batch),
       };
       for (int64_t d : input_dims) {
@@ -1080,6 +1164,12 @@ Status IrEmitter::HandleConvolution(HloInstruction* convolution) {
       return OkStatus();
     }
   }
+  // The elemental convolution accumulates in the operand type, which
+  // CpuCompiler only keeps narrower than the result for the convolutions
+  // above.
+  TF_RET_CHECK(!IsLowPrecisionConvolution(*convolution))
+      << "Low precision convolution not in NHWC / HWIO form: "
+      << convolution->ToString();
   // This is a completely un-optimized version of convolution just to
   // have an early version that works. E.g. the input index and
   // padding calculation is not hoisted out of the inner loop.
@@ -2428,6 +2518,49 @@ Status IrEmitter::HandleTopK(HloInstruction* hlo) {
   return OkStatus();
 }
 
+Status IrEmitter::HandleFlashAttention(HloInstruction* hlo) {
+  TF_RETURN_IF_ERROR(EmitTargetAddressForOp(hlo));
+  const Shape& query_shape = hlo->operand(0)->shape();
+  const Shape& key_shape = hlo->operand(1)->shape();
+  const Shape& value_shape = hlo->operand(2)->shape();
+  TF_RET_CHECK(hlo->shape().element_type() == F32);
+  for (const Shape* shape : {&hlo->shape(), &query_shape, &key_shape,
+                             &value_shape}) {
+    TF_RET_CHECK(LayoutUtil::IsMonotonicWithDim0Major(shape->layout()));
+  }
+  TF_RET_CHECK(
+      ShapeUtil::IsScalarWithElementType(hlo->operand(3)->shape(), F32));
+
+  const int64_t rank = query_shape.rank();
+  int64_t batch_size = 1;
+  for (int64_t i = 0; i < rank - 2; ++i) {
+    batch_size *= query_shape.dimensions(i);
+  }
+
+  // Without a multi-threaded Eigen the runtime computes everything on the
+  // calling thread.
+  llvm::Value* run_options = GetExecutableRunOptionsArgument();
+  if (!hlo_module_config_.debug_options().xla_cpu_multi_thread_eigen()) {
+    run_options = llvm::Constant::getNullValue(run_options->getType());
+  }
+  llvm::Type* float_ptr_type = b_.getFloatTy()->getPointerTo();
+  llvm::Value* scale =
+      Load(b_.getFloatTy(),
+           BitCast(GetEmittedValueFor(hlo->operand(3)), float_ptr_type));
+  EmitCallToFunc(
+      runtime::kFlashAttentionF32SymbolName,
+      {run_options, BitCast(GetEmittedValueFor(hlo), float_ptr_type),
+       BitCast(GetEmittedValueFor(hlo->operand(0)), float_ptr_type),
+       BitCast(GetEmittedValueFor(hlo->operand(1)), float_ptr_type),
+       BitCast(GetEmittedValueFor(hlo->operand(2)), float_ptr_type), scale,
+       b_.getInt64(batch_size), b_.getInt64(query_shape.dimensions(rank - 2)),
+       b_.getInt64(key_shape.dimensions(rank - 2)),
+       b_.getInt64(query_shape.dimensions(rank - 1)),
+       b_.getInt64(value_shape.dimensions(rank - 1))},
+      b_.getVoidTy());
+  return OkStatus();
+}
+
 Status IrEmitter::HandleCustomCall(HloInstruction* custom_call) {
   if (custom_call->custom_call_target() == "PadToStatic") {
     return HandlePadToStatic(custom_call);
@@ -2438,6 +2571,9 @@ Status IrEmitter::HandleCustomCall(HloInstruction* custom_call) {
   if (custom_call->custom_call_target() == "TopK") {
     return HandleTopK(custom_call);
   }
+  if (custom_call->custom_call_target() == kFlashAttentionCustomCallTarget) {
+    return HandleFlashAttention(custom_call);
+  }
 
   absl::Span<HloInstruction* const> operands(custom_call->operands());
   llvm::Type* i8_ptr_type = b_.getInt8PtrTy();
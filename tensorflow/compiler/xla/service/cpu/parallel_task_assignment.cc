@@ -17,7 +17,11 @@ limitations under the License.
 
 #include <algorithm>
 #include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
 
+#include "absl/algorithm/container.h"
 #include "absl/strings/str_cat.h"
 #include "tensorflow/compiler/xla/hlo/ir/hlo_computation.h"
 #include "tensorflow/compiler/xla/hlo/ir/hlo_instruction.h"
@@ -109,10 +113,42 @@ class DefaultCostModel : public ParallelCostModel {
   const std::unique_ptr<HloCostAnalysis> cost_analysis_;
 };
 
+// Uses the cycles measured by a profiled run of the module, and falls back to
+// another cost model for instructions that were not profiled.
+class ProfiledCostModel : public ParallelCostModel {
+ public:
+  ProfiledCostModel(const int64_t max_parallelism,
+                    const ProfileFeedback* profile_feedback,
+                    std::unique_ptr<ParallelCostModel> fallback)
+      : max_parallelism_(max_parallelism),
+        profile_feedback_(profile_feedback),
+        fallback_(std::move(fallback)) {}
+  ~ProfiledCostModel() override {}
+
+  int64_t GetParallelTaskCount(HloInstruction* instruction) override {
+    std::optional<int64_t> cycles = profile_feedback_->GetCycles(*instruction);
+    if (!cycles.has_value()) {
+      return fallback_->GetParallelTaskCount(instruction);
+    }
+    // Keep tasks long enough that handing them to the thread pool, which
+    // takes a few microseconds, stays a small fraction of their run time.
+    const int64_t kMinCyclesPerTask = 100000;
+    // Return target parallel task count in [1, max_parallelism_].
+    return std::min(max_parallelism_,
+                    std::max(int64_t{1}, *cycles / kMinCyclesPerTask));
+  }
+
+ private:
+  const int64_t max_parallelism_;
+  const ProfileFeedback* profile_feedback_;
+  const std::unique_ptr<ParallelCostModel> fallback_;
+};
+
 ParallelTaskAssignment::ParallelTaskAssignment(
     const int64_t max_parallelism,
     const HloCostAnalysis::ShapeSizeFunction& shape_size, HloModule* module,
-    const TargetMachineFeatures* target_machine_features)
+    const TargetMachineFeatures* target_machine_features,
+    const ProfileFeedback* profile_feedback)
     : target_machine_features_(*target_machine_features) {
   VLOG(1) << "ParallelTaskAssignment max_parallelism: " << max_parallelism;
   // Run cost analysis on 'module'.
@@ -129,6 +165,10 @@ ParallelTaskAssignment::ParallelTaskAssignment(
     // HLOs like CustomCall are not yet implemented in the HloCostAnalysis).
     cost_model_.reset(new SimpleCostModel(max_parallelism, shape_size));
   }
+  if (profile_feedback != nullptr) {
+    cost_model_.reset(new ProfiledCostModel(max_parallelism, profile_feedback,
+                                            std::move(cost_model_)));
+  }
 }
 
 int64_t ParallelTaskAssignment::GetTargetParallelTaskCount(
@@ -233,11 +273,28 @@ bool ParallelTaskAssigner::AssignParallelTasksHelper(
       continue;
     }
 
+    // If the module is already scheduled, the call takes the place of
+    // 'instruction' in the schedule and its computation gets a schedule of its
+    // own. Look up the position before outlining deletes 'instruction'.
+    std::vector<HloInstruction*> sequence;
+    int64_t position = -1;
+    if (module->has_schedule()) {
+      sequence = module->schedule().sequence(computation).instructions();
+      position = absl::c_find(sequence, instruction) - sequence.begin();
+    }
+
     // Outline 'instruction' in 'computation' for parallel task assignment.
     auto* call = module->OutlineExpressionFromComputation(
         {instruction}, absl::StrCat("parallel_", instruction->name()),
         computation);
 
+    if (module->has_schedule()) {
+      sequence[position] = call;
+      module->schedule().set_sequence(computation, sequence);
+      module->schedule().set_sequence(
+          call->to_apply(), call->to_apply()->MakeInstructionPostOrder());
+    }
+
     // Set assigned dimension partitioning to 'instruction'.
     auto* new_root = call->to_apply()->root_instruction();
     BackendConfig backend_config;
@@ -256,9 +313,9 @@ bool ParallelTaskAssigner::AssignParallelTasksHelper(
 
 void ParallelTaskAssigner::ComputeTargetParallelTasks(
     HloModule* module, HloToParallelTasks* hlo_to_parallel_tasks) {
-  ParallelTaskAssignment parallel_task_assignment(max_parallelism_,
-                                                  shape_size_function_, module,
-                                                  &target_machine_features_);
+  ParallelTaskAssignment parallel_task_assignment(
+      max_parallelism_, shape_size_function_, module,
+      &target_machine_features_, profile_feedback_);
 
   // Compute parallel task counts for all instructions in 'module'.
   for (auto* computation : module->MakeNonfusionComputations()) {
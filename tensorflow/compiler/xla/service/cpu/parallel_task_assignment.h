@@ -18,6 +18,7 @@ limitations under the License.
 
 #include "absl/container/flat_hash_map.h"
 #include "tensorflow/compiler/xla/hlo/ir/hlo_module.h"
+#include "tensorflow/compiler/xla/service/cpu/profile_feedback.h"
 #include "tensorflow/compiler/xla/service/cpu/target_machine_features.h"
 #include "tensorflow/compiler/xla/service/hlo_cost_analysis.h"
 #include "tensorflow/compiler/xla/service/hlo_pass_interface.h"
@@ -39,10 +40,13 @@ class ParallelTaskAssignment {
   // 'shape_size': shape size function used by HloCostAnalysis during parallel
   //               task assignment.
   // 'module': the containing HloModule.
+  // 'profile_feedback': if not null, measured cycles used in place of the
+  //                     HloCostAnalysis estimates where available.
   ParallelTaskAssignment(const int64_t max_parallelism,
                          const HloCostAnalysis::ShapeSizeFunction& shape_size,
                          HloModule* module,
-                         const TargetMachineFeatures* target_machine_features);
+                         const TargetMachineFeatures* target_machine_features,
+                         const ProfileFeedback* profile_feedback = nullptr);
   ~ParallelTaskAssignment() {}
 
   // Computes and returns the target parallel task count for 'instruction'.
@@ -66,12 +70,16 @@ class ParallelTaskAssigner : public HloModulePass {
   // 'max_parallelism': the maximum parallel task count per instruction.
   // 'shape_size': shape size function used by HloCostAnalysis during parallel
   //               task assignment.
+  // 'profile_feedback': if not null, measured cycles used in place of the
+  //                     HloCostAnalysis estimates where available.
   ParallelTaskAssigner(const int64_t max_parallelism,
                        const HloCostAnalysis::ShapeSizeFunction& shape_size,
-                       const TargetMachineFeatures* target_machine_features)
+                       const TargetMachineFeatures* target_machine_features,
+                       const ProfileFeedback* profile_feedback = nullptr)
       : max_parallelism_(max_parallelism),
         shape_size_function_(shape_size),
-        target_machine_features_(*target_machine_features) {}
+        target_machine_features_(*target_machine_features),
+        profile_feedback_(profile_feedback) {}
   ~ParallelTaskAssigner() override {}
 
   absl::string_view name() const override {
@@ -107,6 +115,7 @@ class ParallelTaskAssigner : public HloModulePass {
   int64_t max_parallelism_;
   HloCostAnalysis::ShapeSizeFunction shape_size_function_;
   const TargetMachineFeatures& target_machine_features_;
+  const ProfileFeedback* profile_feedback_;
 };
 
 }  // namespace cpu
@@ -16,7 +16,9 @@ limitations under the License.
 #include "tensorflow/compiler/xla/service/cpu/parallel_task_assignment.h"
 
 #include "tensorflow/compiler/xla/service/cpu/cpu_executable.h"
+#include "tensorflow/compiler/xla/service/cpu/profile_feedback.h"
 #include "tensorflow/compiler/xla/service/cpu/target_machine_features_fake.h"
+#include "tensorflow/compiler/xla/service/hlo_execution_profile_data.pb.h"
 #include "tensorflow/compiler/xla/test.h"
 #include "tensorflow/compiler/xla/tests/hlo_test_base.h"
 #include "tensorflow/tsl/lib/core/status_test_util.h"
@@ -40,11 +42,30 @@ class ParallelTaskAssignmentTest : public HloTestBase {
           return cpu::TargetMachineFeatures::kEigenExpectedTensorAlignment;
         }) {}
 
-  StatusOr<bool> RunParallelTaskAssigner(HloModule* module) {
+  StatusOr<bool> RunParallelTaskAssigner(
+      HloModule* module,
+      const cpu::ProfileFeedback* profile_feedback = nullptr) {
     return cpu::ParallelTaskAssigner(max_parallelism_, shape_size_func_,
-                                     &target_machine_features_)
+                                     &target_machine_features_,
+                                     profile_feedback)
         .Run(module);
   }
+
+  // Returns a profile in which entry instruction `name` took `cycles`.
+  static cpu::ProfileFeedback MakeProfileFeedback(const HloModule& module,
+                                                  const std::string& name,
+                                                  int64_t cycles) {
+    HloExecutionProfileData profile;
+    auto* printer_data = profile.mutable_printer_data();
+    printer_data->set_entry_computation(module.entry_computation()->name());
+    auto* computation_info = printer_data->add_computation_infos();
+    computation_info->set_name(module.entry_computation()->name());
+    auto* instruction_info = computation_info->add_instruction_infos();
+    instruction_info->set_name(name);
+    instruction_info->set_profile_index(0);
+    profile.add_profile_counters(cycles);
+    return cpu::ProfileFeedback(profile);
+  }
 };
 
 TEST_F(ParallelTaskAssignmentTest, DotOperationNotParallelized) {
@@ -206,5 +227,76 @@ TEST_F(ParallelTaskAssignmentTest, ConstantNotParallelized) {
   EXPECT_FALSE(changed);
 }
 
+TEST_F(ParallelTaskAssignmentTest, ProfiledCheapInstructionNotParallelized) {
+  constexpr char hlo_string[] = R"(
+  HloModule TestTaskParallel_profiled_cheap
+    ENTRY main {
+      x = f32[1024,1024] parameter(0)
+      y = f32[1024,1024] parameter(1)
+      ROOT add = f32[1024,1024] add(x, y)
+    }
+  )";
+
+  TF_ASSERT_OK_AND_ASSIGN(std::unique_ptr<HloModule> m,
+                          ParseAndReturnVerifiedModule(hlo_string));
+  cpu::ProfileFeedback profile_feedback =
+      MakeProfileFeedback(*m, "add", /*cycles=*/50000);
+  TF_ASSERT_OK_AND_ASSIGN(bool changed,
+                          RunParallelTaskAssigner(m.get(), &profile_feedback));
+  EXPECT_FALSE(changed);
+}
+
+TEST_F(ParallelTaskAssignmentTest, ProfiledExpensiveInstructionParallelized) {
+  constexpr char hlo_string[] = R"(
+  HloModule TestTaskParallel_profiled_expensive
+    ENTRY main {
+      x = f32[64,64] parameter(0)
+      ROOT exp = f32[64,64] exponential(x)
+    }
+  )";
+
+  TF_ASSERT_OK_AND_ASSIGN(std::unique_ptr<HloModule> m,
+                          ParseAndReturnVerifiedModule(hlo_string));
+  cpu::ProfileFeedback profile_feedback =
+      MakeProfileFeedback(*m, "exp", /*cycles=*/10000000);
+  TF_ASSERT_OK_AND_ASSIGN(bool changed,
+                          RunParallelTaskAssigner(m.get(), &profile_feedback));
+  EXPECT_TRUE(changed);
+}
+
+TEST_F(ParallelTaskAssignmentTest, OutlinedInstructionsKeepTheirScheduledOrder) {
+  constexpr char hlo_string[] = R"(
+  HloModule TestTaskParallel_scheduled
+    ENTRY main {
+      x = f32[1024,1024] parameter(0)
+      y = f32[1024,1024] parameter(1)
+      exp_x = f32[1024,1024] exponential(x)
+      exp_y = f32[1024,1024] exponential(y)
+      ROOT tuple = (f32[1024,1024], f32[1024,1024]) tuple(exp_x, exp_y)
+    }
+  )";
+
+  TF_ASSERT_OK_AND_ASSIGN(std::unique_ptr<HloModule> m,
+                          ParseAndReturnVerifiedModule(hlo_string));
+  HloSchedule schedule(m.get());
+  schedule.set_sequence(
+      m->entry_computation(),
+      {FindInstruction(m.get(), "x"), FindInstruction(m.get(), "y"),
+       FindInstruction(m.get(), "exp_y"), FindInstruction(m.get(), "exp_x"),
+       FindInstruction(m.get(), "tuple")});
+  TF_ASSERT_OK(m->set_schedule(schedule));
+
+  TF_ASSERT_OK_AND_ASSIGN(bool changed, RunParallelTaskAssigner(m.get()));
+  EXPECT_TRUE(changed);
+  TF_ASSERT_OK(m->schedule().Verify());
+  const std::vector<HloInstruction*>& sequence =
+      m->schedule().sequence(m->entry_computation()).instructions();
+  ASSERT_EQ(sequence.size(), 5);
+  EXPECT_EQ(sequence[2]->opcode(), HloOpcode::kCall);
+  EXPECT_EQ(sequence[2]->operand(0)->name(), "y");
+  EXPECT_EQ(sequence[3]->opcode(), HloOpcode::kCall);
+  EXPECT_EQ(sequence[3]->operand(0)->name(), "x");
+}
+
 }  // namespace
 }  // namespace xla
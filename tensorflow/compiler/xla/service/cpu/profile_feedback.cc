@@ -0,0 +1,88 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/compiler/xla/service/cpu/profile_feedback.h"
+
+#include <string>
+#include <utility>
+
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "tensorflow/compiler/xla/hlo/ir/hlo_computation.h"
+#include "tensorflow/tsl/platform/env.h"
+#include "tensorflow/tsl/platform/errors.h"
+#include "tensorflow/tsl/platform/logging.h"
+
+namespace xla {
+namespace cpu {
+
+ProfileFeedback::ProfileFeedback(const HloExecutionProfileData& profile)
+    : entry_computation_name_(profile.printer_data().entry_computation()) {
+  const auto& counters = profile.profile_counters();
+  for (const auto& computation_info :
+       profile.printer_data().computation_infos()) {
+    const bool is_entry = computation_info.name() == entry_computation_name_;
+    for (const auto& instruction_info : computation_info.instruction_infos()) {
+      const int64_t index = instruction_info.profile_index();
+      if (instruction_info.name().empty() || index < 0 ||
+          index >= counters.size()) {
+        continue;
+      }
+      if (is_entry) {
+        cycles_[instruction_info.name()] = counters[index];
+        continue;
+      }
+      // ParallelTaskAssigner outlines an entry instruction `x` into the
+      // computation `parallel_x` as `x.clone`. Every task adds its cycles to
+      // the counter of `x.clone`.
+      absl::string_view name = instruction_info.name();
+      if (absl::ConsumeSuffix(&name, ".clone") &&
+          computation_info.name() == absl::StrCat("parallel_", name)) {
+        cycles_[std::string(name)] = counters[index];
+      }
+    }
+  }
+}
+
+/*static*/ StatusOr<std::unique_ptr<ProfileFeedback>>
+ProfileFeedback::LoadForModule(const std::string& path,
+                               const HloModule& module) {
+  HloExecutionProfileData profile;
+  TF_RETURN_IF_ERROR(tsl::ReadBinaryProto(tsl::Env::Default(), path, &profile));
+  auto feedback = std::make_unique<ProfileFeedback>(profile);
+  if (feedback->entry_computation_name() !=
+      module.entry_computation()->name()) {
+    VLOG(1) << "Ignoring profile " << path << " collected for "
+            << feedback->entry_computation_name() << " in module "
+            << module.name();
+    return std::unique_ptr<ProfileFeedback>();
+  }
+  VLOG(1) << "Using " << feedback->cycles_.size()
+          << " instruction profiles from " << path << " for module "
+          << module.name();
+  return std::move(feedback);
+}
+
+std::optional<int64_t> ProfileFeedback::GetCycles(
+    const HloInstruction& instruction) const {
+  if (!instruction.parent()->IsEntryComputation()) return std::nullopt;
+  auto it = cycles_.find(instruction.name());
+  if (it == cycles_.end()) return std::nullopt;
+  return it->second;
+}
+
+}  // namespace cpu
+}  // namespace xla
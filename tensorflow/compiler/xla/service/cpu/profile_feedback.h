@@ -0,0 +1,69 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_COMPILER_XLA_SERVICE_CPU_PROFILE_FEEDBACK_H_
+#define TENSORFLOW_COMPILER_XLA_SERVICE_CPU_PROFILE_FEEDBACK_H_
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+#include "tensorflow/compiler/xla/hlo/ir/hlo_instruction.h"
+#include "tensorflow/compiler/xla/hlo/ir/hlo_module.h"
+#include "tensorflow/compiler/xla/service/hlo_execution_profile_data.pb.h"
+#include "tensorflow/compiler/xla/statusor.h"
+
+namespace xla {
+namespace cpu {
+
+// Cycle counts measured by a previous run of the same module with
+// --xla_hlo_profile, which XLA:CPU uses in place of static cost estimates
+// when it recompiles the module.
+//
+// The profile is the "hlo_execution_profile_data" file dumped by a profiled
+// run. Instructions are matched by name, which is stable as long as the HLO
+// passes before the lookup make the same decisions as in the profiled
+// compilation.
+class ProfileFeedback {
+ public:
+  explicit ProfileFeedback(const HloExecutionProfileData& profile);
+
+  // Loads the profile in `path` for `module`. Returns nullptr if the profile
+  // was collected for a module with a different entry computation.
+  static StatusOr<std::unique_ptr<ProfileFeedback>> LoadForModule(
+      const std::string& path, const HloModule& module);
+
+  // Returns the cycles one execution of `instruction` took in the profiled
+  // run, or nullopt if it was not profiled. For an instruction that was split
+  // into parallel tasks, this is the sum over all tasks. Only instructions of
+  // the entry computation are looked up, since instructions in loop bodies
+  // and other called computations are profiled over all of their calls.
+  std::optional<int64_t> GetCycles(const HloInstruction& instruction) const;
+
+  const std::string& entry_computation_name() const {
+    return entry_computation_name_;
+  }
+
+ private:
+  std::string entry_computation_name_;
+  absl::flat_hash_map<std::string, int64_t> cycles_;
+};
+
+}  // namespace cpu
+}  // namespace xla
+
+#endif  // TENSORFLOW_COMPILER_XLA_SERVICE_CPU_PROFILE_FEEDBACK_H_
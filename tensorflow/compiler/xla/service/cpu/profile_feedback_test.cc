@@ -0,0 +1,124 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/compiler/xla/service/cpu/profile_feedback.h"
+
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "tensorflow/compiler/xla/tests/hlo_test_base.h"
+#include "tensorflow/tsl/lib/core/status_test_util.h"
+#include "tensorflow/tsl/platform/env.h"
+#include "tensorflow/tsl/platform/test.h"
+
+namespace xla {
+namespace cpu {
+namespace {
+
+using ProfileFeedbackTest = HloTestBase;
+
+constexpr char kHloText[] = R"(
+HloModule Profiled
+
+body {
+  p = f32[16] parameter(0)
+  ROOT neg = f32[16] negate(p)
+}
+
+cond {
+  p = f32[16] parameter(0)
+  ROOT done = pred[] constant(false)
+}
+
+ENTRY main {
+  x = f32[1024] parameter(0)
+  exp = f32[1024] exponential(x)
+  add = f32[1024] add(exp, x)
+  y = f32[16] parameter(1)
+  ROOT loop = f32[16] while(y), condition=cond, body=body
+}
+)";
+
+// Returns the profile of a run in which `add` was split into parallel tasks.
+HloExecutionProfileData MakeProfile() {
+  HloExecutionProfileData profile;
+  auto* printer_data = profile.mutable_printer_data();
+  printer_data->set_entry_computation("main");
+  auto add_instruction = [&](HloProfilePrinterData::HloComputationInfo* info,
+                             const std::string& name, int64_t cycles) {
+    auto* instruction_info = info->add_instruction_infos();
+    instruction_info->set_name(name);
+    instruction_info->set_profile_index(profile.profile_counters_size());
+    profile.add_profile_counters(cycles);
+  };
+  auto* entry = printer_data->add_computation_infos();
+  entry->set_name("main");
+  add_instruction(entry, "exp", 1000);
+  add_instruction(entry, "call", 300);
+  auto* parallel_add = printer_data->add_computation_infos();
+  parallel_add->set_name("parallel_add");
+  add_instruction(parallel_add, "add.clone", 1200);
+  auto* body = printer_data->add_computation_infos();
+  body->set_name("body");
+  add_instruction(body, "neg", 5000);
+  return profile;
+}
+
+TEST_F(ProfileFeedbackTest, LooksUpEntryInstructions) {
+  TF_ASSERT_OK_AND_ASSIGN(auto module, ParseAndReturnVerifiedModule(kHloText));
+  ProfileFeedback feedback(MakeProfile());
+  HloComputation* entry = module->entry_computation();
+
+  EXPECT_EQ(feedback.GetCycles(*entry->GetInstructionWithName("exp")), 1000);
+  // Summed over the parallel tasks of the outlined clone.
+  EXPECT_EQ(feedback.GetCycles(*entry->GetInstructionWithName("add")), 1200);
+  EXPECT_EQ(feedback.GetCycles(*entry->GetInstructionWithName("x")),
+            std::nullopt);
+  // Loop bodies are profiled over all iterations, so they are not used.
+  HloInstruction* neg =
+      module->GetComputationWithName("body")->GetInstructionWithName("neg");
+  EXPECT_EQ(feedback.GetCycles(*neg), std::nullopt);
+}
+
+TEST_F(ProfileFeedbackTest, LoadsProfileForMatchingModule) {
+  TF_ASSERT_OK_AND_ASSIGN(auto module, ParseAndReturnVerifiedModule(kHloText));
+  std::string path;
+  ASSERT_TRUE(tsl::Env::Default()->LocalTempFilename(&path));
+  TF_ASSERT_OK(tsl::WriteBinaryProto(tsl::Env::Default(), path, MakeProfile()));
+
+  TF_ASSERT_OK_AND_ASSIGN(std::unique_ptr<ProfileFeedback> feedback,
+                          ProfileFeedback::LoadForModule(path, *module));
+  ASSERT_NE(feedback, nullptr);
+  EXPECT_EQ(feedback->GetCycles(
+                *module->entry_computation()->GetInstructionWithName("exp")),
+            1000);
+
+  // A profile of another module is ignored.
+  HloExecutionProfileData other = MakeProfile();
+  other.mutable_printer_data()->set_entry_computation("other");
+  TF_ASSERT_OK(tsl::WriteBinaryProto(tsl::Env::Default(), path, other));
+  TF_ASSERT_OK_AND_ASSIGN(feedback,
+                          ProfileFeedback::LoadForModule(path, *module));
+  EXPECT_EQ(feedback, nullptr);
+
+  EXPECT_FALSE(
+      ProfileFeedback::LoadForModule(path + ".missing", *module).ok());
+  TF_ASSERT_OK(tsl::Env::Default()->DeleteFile(path));
+}
+
+}  // namespace
+}  // namespace cpu
+}  // namespace xla
@@ -0,0 +1,152 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/compiler/xla/service/cpu/runtime_flash_attention.h"
+
+#define EIGEN_USE_THREADS
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "absl/base/attributes.h"
+#include "absl/base/dynamic_annotations.h"
+#include "third_party/eigen3/Eigen/Core"
+#include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
+#include "tensorflow/compiler/xla/executable_run_options.h"
+
+namespace {
+
+using RowMajorMatrix =
+    Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+using ConstMatrixMap = Eigen::Map<const RowMajorMatrix>;
+using MatrixMap = Eigen::Map<RowMajorMatrix>;
+
+// Number of query rows processed together. Each block is an independent unit
+// of work for the thread pool.
+constexpr int64_t kQueryBlockSize = 64;
+
+// Number of keys per softmax step. The kQueryBlockSize x kKeyBlockSize score
+// block (64KB) stays in L2 while it is exponentiated and multiplied by the
+// value block.
+constexpr int64_t kKeyBlockSize = 256;
+
+// Computes the attention output for `query_rows` queries of one batch
+// element. `scores` is scratch space of at least query_rows x kKeyBlockSize.
+void AttentionBlock(const float* query, const float* key, const float* value,
+                    float* out, float scale, int64_t query_rows,
+                    int64_t key_length, int64_t head_dim, int64_t value_dim,
+                    RowMajorMatrix* scores, Eigen::VectorXf* row_max,
+                    Eigen::VectorXf* row_sum) {
+  ConstMatrixMap q(query, query_rows, head_dim);
+  MatrixMap o(out, query_rows, value_dim);
+  o.setZero();
+  row_max->head(query_rows).setConstant(
+      -std::numeric_limits<float>::infinity());
+  row_sum->head(query_rows).setZero();
+
+  for (int64_t key_begin = 0; key_begin < key_length;
+       key_begin += kKeyBlockSize) {
+    const int64_t keys = std::min(kKeyBlockSize, key_length - key_begin);
+    ConstMatrixMap k(key + key_begin * head_dim, keys, head_dim);
+    ConstMatrixMap v(value + key_begin * value_dim, keys, value_dim);
+    auto s = scores->topLeftCorner(query_rows, keys);
+    s.noalias() = scale * (q * k.transpose());
+
+    // Online softmax: rescale what was accumulated for earlier key blocks to
+    // the new running maximum before adding this block.
+    for (int64_t i = 0; i < query_rows; ++i) {
+      const float block_max = s.row(i).maxCoeff();
+      const float new_max = std::max((*row_max)(i), block_max);
+      if (new_max == -std::numeric_limits<float>::infinity()) {
+        // Every score so far is -inf; keep the row at zero weight.
+        s.row(i).setZero();
+        continue;
+      }
+      const float correction = std::exp((*row_max)(i) - new_max);
+      s.row(i) = (s.row(i).array() - new_max).exp();
+      (*row_sum)(i) = (*row_sum)(i) * correction + s.row(i).sum();
+      o.row(i) *= correction;
+      (*row_max)(i) = new_max;
+    }
+    o.noalias() += s * v;
+  }
+
+  o.array().colwise() /= row_sum->head(query_rows).array();
+}
+
+}  // namespace
+
+ABSL_ATTRIBUTE_NO_SANITIZE_MEMORY void __xla_cpu_runtime_FlashAttentionF32(
+    const void* run_options_ptr, float* out, const float* query,
+    const float* key, const float* value, float scale, int64_t batch_size,
+    int64_t query_length, int64_t key_length, int64_t head_dim,
+    int64_t value_dim) {
+  // The inputs are managed by the JIT code, so msan can't tell they are
+  // initialized.
+  ABSL_ANNOTATE_MEMORY_IS_INITIALIZED(
+      query, batch_size * query_length * head_dim * sizeof(float));
+  ABSL_ANNOTATE_MEMORY_IS_INITIALIZED(
+      key, batch_size * key_length * head_dim * sizeof(float));
+  ABSL_ANNOTATE_MEMORY_IS_INITIALIZED(
+      value, batch_size * key_length * value_dim * sizeof(float));
+
+  // Without keys, the softmax denominator is zero while the attention is an
+  // empty sum, as it is in the unfused lowering.
+  if (key_length == 0) {
+    std::fill_n(out, batch_size * query_length * value_dim, 0.0f);
+    return;
+  }
+
+  const int64_t query_blocks =
+      (query_length + kQueryBlockSize - 1) / kQueryBlockSize;
+  auto run_blocks = [&](Eigen::Index first, Eigen::Index last) {
+    RowMajorMatrix scores(kQueryBlockSize, kKeyBlockSize);
+    Eigen::VectorXf row_max(kQueryBlockSize);
+    Eigen::VectorXf row_sum(kQueryBlockSize);
+    for (Eigen::Index block = first; block < last; ++block) {
+      const int64_t b = block / query_blocks;
+      const int64_t query_begin = (block % query_blocks) * kQueryBlockSize;
+      const int64_t query_rows =
+          std::min(kQueryBlockSize, query_length - query_begin);
+      AttentionBlock(query + (b * query_length + query_begin) * head_dim,
+                     key + b * key_length * head_dim,
+                     value + b * key_length * value_dim,
+                     out + (b * query_length + query_begin) * value_dim, scale,
+                     query_rows, key_length, head_dim, value_dim, &scores,
+                     &row_max, &row_sum);
+    }
+  };
+
+  const int64_t num_blocks = batch_size * query_blocks;
+  const xla::ExecutableRunOptions* run_options =
+      static_cast<const xla::ExecutableRunOptions*>(run_options_ptr);
+  if (run_options == nullptr ||
+      run_options->intra_op_thread_pool() == nullptr || num_blocks == 1) {
+    run_blocks(0, num_blocks);
+    return;
+  }
+
+  // Per query block: two matrix products over all keys, plus the exponentials.
+  const double flops_per_block =
+      2.0 * kQueryBlockSize * key_length * (head_dim + value_dim) +
+      10.0 * kQueryBlockSize * key_length;
+  const Eigen::TensorOpCost cost(
+      /*bytes_loaded=*/sizeof(float) * key_length * (head_dim + value_dim),
+      /*bytes_stored=*/sizeof(float) * kQueryBlockSize * value_dim,
+      /*compute_cycles=*/flops_per_block);
+  run_options->intra_op_thread_pool()->parallelFor(num_blocks, cost,
+                                                   run_blocks);
+}
@@ -0,0 +1,42 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_COMPILER_XLA_SERVICE_CPU_RUNTIME_FLASH_ATTENTION_H_
+#define TENSORFLOW_COMPILER_XLA_SERVICE_CPU_RUNTIME_FLASH_ATTENTION_H_
+
+#include <stdint.h>
+
+extern "C" {
+
+// Computes `batch_size` scaled dot-product attentions
+//
+//   out = softmax(scale * query * key^T) * value
+//
+// with the softmax taken over the keys. For each batch element, 'query' is a
+// row-major query_length x head_dim matrix, 'key' is key_length x head_dim,
+// 'value' is key_length x value_dim and 'out' is query_length x value_dim;
+// batch elements are stored contiguously. Without keys, 'out' is zero.
+//
+// Keys are processed in blocks with an online softmax, so the
+// query_length x key_length score matrix is never materialized. Work is split
+// over the intra-op thread pool of 'run_options_ptr' if it is not null.
+extern void __xla_cpu_runtime_FlashAttentionF32(
+    const void* /* xla::ExecutableRunOptions* */ run_options_ptr, float* out,
+    const float* query, const float* key, const float* value, float scale,
+    int64_t batch_size, int64_t query_length, int64_t key_length,
+    int64_t head_dim, int64_t value_dim);
+}
+
+#endif  // TENSORFLOW_COMPILER_XLA_SERVICE_CPU_RUNTIME_FLASH_ATTENTION_H_
@@ -0,0 +1,134 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#define EIGEN_USE_THREADS
+#include "tensorflow/compiler/xla/service/cpu/runtime_flash_attention.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
+#include "tensorflow/compiler/xla/executable_run_options.h"
+#include "tensorflow/tsl/platform/test.h"
+
+namespace xla {
+namespace cpu {
+namespace {
+
+struct AttentionDims {
+  int64_t batch_size, query_length, key_length, head_dim, value_dim;
+};
+
+// Computes the attention with the softmax written out, as the unfused
+// lowering does.
+std::vector<float> ReferenceAttention(const std::vector<float>& query,
+                                      const std::vector<float>& key,
+                                      const std::vector<float>& value,
+                                      float scale, const AttentionDims& dims) {
+  std::vector<float> out(dims.batch_size * dims.query_length * dims.value_dim);
+  std::vector<double> scores(dims.key_length);
+  for (int64_t b = 0; b < dims.batch_size; ++b) {
+    for (int64_t i = 0; i < dims.query_length; ++i) {
+      double max = -std::numeric_limits<double>::infinity();
+      for (int64_t j = 0; j < dims.key_length; ++j) {
+        double score = 0;
+        for (int64_t d = 0; d < dims.head_dim; ++d) {
+          score += static_cast<double>(
+                       query[(b * dims.query_length + i) * dims.head_dim + d]) *
+                   key[(b * dims.key_length + j) * dims.head_dim + d];
+        }
+        scores[j] = scale * score;
+        max = std::max(max, scores[j]);
+      }
+      double sum = 0;
+      for (int64_t j = 0; j < dims.key_length; ++j) {
+        scores[j] = std::exp(scores[j] - max);
+        sum += scores[j];
+      }
+      for (int64_t d = 0; d < dims.value_dim; ++d) {
+        double result = 0;
+        for (int64_t j = 0; j < dims.key_length; ++j) {
+          result += scores[j] / sum *
+                    value[(b * dims.key_length + j) * dims.value_dim + d];
+        }
+        out[(b * dims.query_length + i) * dims.value_dim + d] = result;
+      }
+    }
+  }
+  return out;
+}
+
+void ExpectMatchesReference(const AttentionDims& dims,
+                            const ExecutableRunOptions* run_options) {
+  std::mt19937 generator(0);
+  std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+  auto random = [&](int64_t size) {
+    std::vector<float> values(size);
+    for (float& x : values) x = distribution(generator);
+    return values;
+  };
+  const std::vector<float> query =
+      random(dims.batch_size * dims.query_length * dims.head_dim);
+  const std::vector<float> key =
+      random(dims.batch_size * dims.key_length * dims.head_dim);
+  const std::vector<float> value =
+      random(dims.batch_size * dims.key_length * dims.value_dim);
+  const float scale = 1.0f / std::sqrt(static_cast<float>(dims.head_dim));
+
+  const std::vector<float> expected =
+      ReferenceAttention(query, key, value, scale, dims);
+  std::vector<float> out(expected.size(), NAN);
+  __xla_cpu_runtime_FlashAttentionF32(
+      run_options, out.data(), query.data(), key.data(), value.data(), scale,
+      dims.batch_size, dims.query_length, dims.key_length, dims.head_dim,
+      dims.value_dim);
+  for (int64_t i = 0; i < out.size(); ++i) {
+    ASSERT_NEAR(out[i], expected[i], 1e-5)
+        << dims.query_length << "x" << dims.key_length << " at " << i;
+  }
+}
+
+// Partial query and key blocks, keys spanning several blocks, and no keys,
+// for which the output is zero as with the unfused lowering.
+std::vector<AttentionDims> TestDims() {
+  return {{1, 1, 1, 4, 4},
+          {2, 17, 33, 8, 5},
+          {1, 130, 600, 16, 16},
+          {3, 70, 0, 8, 4}};
+}
+
+TEST(FlashAttentionTest, MatchesReference) {
+  for (const AttentionDims& dims : TestDims()) {
+    ExpectMatchesReference(dims, /*run_options=*/nullptr);
+  }
+}
+
+TEST(FlashAttentionTest, MatchesReferenceOnThreadPool) {
+  Eigen::ThreadPool pool(4);
+  Eigen::ThreadPoolDevice device(&pool, pool.NumThreads());
+  ExecutableRunOptions run_options;
+  run_options.set_intra_op_thread_pool(&device);
+  for (const AttentionDims& dims : TestDims()) {
+    ExpectMatchesReference(dims, &run_options);
+  }
+}
+
+}  // namespace
+}  // namespace cpu
+}  // namespace xla
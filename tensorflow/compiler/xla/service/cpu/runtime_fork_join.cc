@@ -17,6 +17,11 @@ limitations under the License.
 
 #define EIGEN_USE_THREADS
 
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
 #include "absl/base/dynamic_annotations.h"
 #include "absl/strings/str_format.h"
 #include "absl/strings/str_join.h"
@@ -29,9 +34,75 @@ limitations under the License.
 using ComputeFunctionType = void (*)(void*, const void*, const void**, void**,
                                      void*, int64_t*, uint64_t*);
 
-// Dispatches 'num_partitions - 1' calls to 'function_ptr' in parallel.
-// Calls 'function_ptr' for first partition inline.
-// Uses blocking counter to synchronize threads after parallel calls complete.
+namespace {
+
+// Number of ParallelForkJoin calls currently in flight in this process, across
+// all executables sharing the intra-op thread pool. Used to keep concurrent
+// executions from each asking the pool for all of its threads.
+std::atomic<int32_t> num_active_fork_joins{0};
+
+// State shared between the calling thread and the helper tasks of one
+// ParallelForkJoin call. Helpers that are scheduled after all partitions have
+// been claimed may start running after the call has returned, so the state is
+// reference counted rather than living on the caller's stack.
+struct ForkJoinState {
+  ForkJoinState(ComputeFunctionType function, void* result_ptr,
+                const void* run_options_ptr, void** buffer_table,
+                uint64_t* prof_counters, int32_t num_partitions,
+                int64_t* partitions, int64_t stride)
+      : function(function),
+        result_ptr(result_ptr),
+        run_options_ptr(run_options_ptr),
+        buffer_table(buffer_table),
+        prof_counters(prof_counters),
+        num_partitions(num_partitions),
+        partitions(partitions),
+        stride(stride),
+        statuses(num_partitions),
+        pending(num_partitions) {}
+
+  // Claims and runs partitions until none are left. Partitions are claimed one
+  // at a time, so threads that start late or run on a loaded core take fewer
+  // of them instead of holding up the whole loop.
+  ABSL_ATTRIBUTE_NO_SANITIZE_MEMORY void RunPartitions() {
+    for (int32_t i = next_partition.fetch_add(1, std::memory_order_relaxed);
+         i < num_partitions;
+         i = next_partition.fetch_add(1, std::memory_order_relaxed)) {
+      function(result_ptr, run_options_ptr, nullptr, buffer_table,
+               &statuses[i], &partitions[i * stride], prof_counters);
+      VLOG(3) << "ParallelForkJoin partition " << i << " done.";
+      pending.DecrementCount();
+    }
+  }
+
+  const ComputeFunctionType function;
+  void* const result_ptr;
+  const void* const run_options_ptr;
+  void** const buffer_table;
+  uint64_t* const prof_counters;
+  const int32_t num_partitions;
+  int64_t* const partitions;
+  const int64_t stride;
+
+  std::vector<XlaCustomCallStatus> statuses;
+  std::atomic<int32_t> next_partition{0};
+  tsl::BlockingCounter pending;
+};
+
+}  // namespace
+
+// Runs 'num_partitions' calls to 'function_ptr' in parallel and returns when
+// all of them have finished.
+//
+// Partitions are not bound to threads. The caller and up to
+// 'num_partitions - 1' helper tasks scheduled on the intra-op thread pool all
+// claim partitions from a shared counter until none are left. The caller keeps
+// running partitions instead of blocking, so the call makes progress even when
+// every pool thread is busy (for instance when it is itself running on a pool
+// thread, or when other executables saturate the pool); it only waits for
+// partitions that helpers have already started. The number of helpers is
+// limited to the pool's share available to each of the ParallelForkJoin calls
+// currently in flight.
 //
 // The 'partitions' array has a total number of elements equal to
 // 'num_partitions * num_partitioned_dims * 2' (the '2' is necessary to specify
@@ -80,27 +151,29 @@ ABSL_ATTRIBUTE_NO_SANITIZE_MEMORY void __xla_cpu_runtime_ParallelForkJoin(
   // Compute partition stride in 'partitions' array.
   const int64_t stride = 2 * num_partitioned_dims;
 
-  std::vector<XlaCustomCallStatus> statuses(num_partitions);
-
-  // Dispatch 'num_partitions - 1' compute functions to run in parallel.
-  tsl::BlockingCounter bc(num_partitions - 1);
-  for (int32_t i = 1; i < num_partitions; ++i) {
-    const int64_t offset = i * stride;
-    run_options->intra_op_thread_pool()->enqueueNoNotification(
-        [i, function, result_ptr, run_options_ptr, buffer_table, prof_counters,
-         partitions, offset, &bc, &statuses]() {
-          function(result_ptr, run_options_ptr, nullptr, buffer_table,
-                   &statuses[i], &partitions[offset], prof_counters);
-          bc.DecrementCount();
-          VLOG(3) << "ParallelForkJoin partition " << i << " done.";
-        });
+  auto state = std::make_shared<ForkJoinState>(
+      function, result_ptr, run_options_ptr, buffer_table, prof_counters,
+      num_partitions, partitions, stride);
+
+  // Split the pool between the fork-joins that are currently running; the
+  // calling thread is one of the workers of this one.
+  const int32_t num_active =
+      num_active_fork_joins.fetch_add(1, std::memory_order_relaxed) + 1;
+  const Eigen::ThreadPoolDevice* thread_pool =
+      run_options->intra_op_thread_pool();
+  const int32_t num_helpers = std::min(
+      num_partitions - 1, std::max(1, thread_pool->numThreads() / num_active));
+
+  for (int32_t i = 0; i < num_helpers; ++i) {
+    thread_pool->enqueueNoNotification([state]() { state->RunPartitions(); });
   }
 
-  // Call first compute function inline.
-  function(result_ptr, run_options_ptr, params, buffer_table, &statuses[0],
-           &partitions[0], prof_counters);
-  VLOG(3) << "ParallelForkJoin partition 0 done.";
-  bc.Wait();
+  // Help while waiting, then wait for the partitions claimed by helpers.
+  state->RunPartitions();
+  state->pending.Wait();
+  num_active_fork_joins.fetch_sub(1, std::memory_order_relaxed);
+
+  std::vector<XlaCustomCallStatus>& statuses = state->statuses;
 
   // Collect all error messages (if any).
   std::vector<std::pair<int32_t, absl::string_view>> error_messages;
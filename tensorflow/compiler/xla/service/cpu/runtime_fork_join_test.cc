@@ -0,0 +1,214 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#define EIGEN_USE_THREADS
+#include "tensorflow/compiler/xla/service/cpu/runtime_fork_join.h"
+
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
+#include "tensorflow/compiler/xla/executable_run_options.h"
+#include "tensorflow/compiler/xla/service/cpu/runtime_custom_call_status.h"
+#include "tensorflow/compiler/xla/service/custom_call_status_internal.h"
+#include "tensorflow/tsl/platform/blocking_counter.h"
+#include "tensorflow/tsl/platform/cpu_info.h"
+#include "tensorflow/tsl/platform/env.h"
+#include "tensorflow/tsl/platform/test.h"
+#include "tensorflow/tsl/platform/test_benchmark.h"
+#include "tensorflow/tsl/platform/threadpool.h"
+
+namespace xla {
+namespace {
+
+// Builds the 'partitions' array for splitting [0, size) into 'num_partitions'
+// contiguous ranges along a single dimension.
+std::vector<int64_t> MakePartitions(int64_t size, int32_t num_partitions) {
+  std::vector<int64_t> partitions;
+  for (int32_t i = 0; i < num_partitions; ++i) {
+    partitions.push_back(size * i / num_partitions);
+    partitions.push_back(size * (i + 1) / num_partitions);
+  }
+  return partitions;
+}
+
+// Increments buffer_table[0][j] for each j of the partition.
+void CountPartition(void* /*result*/, const void* /*run_options*/,
+                    const void** /*params*/, void** buffer_table,
+                    void* /*status*/, int64_t* partition,
+                    uint64_t* /*prof_counters*/) {
+  auto* counts = static_cast<std::atomic<int32_t>*>(buffer_table[0]);
+  for (int64_t j = partition[0]; j < partition[1]; ++j) {
+    counts[j].fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+// Fails on odd partitions.
+void FailOddPartitions(void* /*result*/, const void* /*run_options*/,
+                       const void** /*params*/, void** /*buffer_table*/,
+                       void* status, int64_t* partition,
+                       uint64_t* /*prof_counters*/) {
+  if (partition[0] % 2 == 1) {
+    std::string message = absl::StrCat("odd ", partition[0]);
+    XlaCustomCallStatusSetFailure(static_cast<XlaCustomCallStatus*>(status),
+                                  message.data(), message.size());
+  }
+}
+
+class ParallelForkJoinTest : public ::testing::Test {
+ protected:
+  ParallelForkJoinTest()
+      : pool_(tsl::Env::Default(), "XLAEigen", /*num_threads=*/4),
+        device_(pool_.AsEigenThreadPool(), pool_.NumThreads()) {
+    run_options_.set_intra_op_thread_pool(&device_);
+  }
+
+  void ForkJoin(void* function, std::vector<int64_t>& partitions,
+                void** buffer_table, XlaCustomCallStatus* status) {
+    __xla_cpu_runtime_ParallelForkJoin(
+        /*result_ptr=*/nullptr, &run_options_, /*params=*/nullptr,
+        buffer_table, status, /*prof_counters=*/nullptr,
+        partitions.size() / 2, partitions.data(),
+        /*num_partitioned_dims=*/1, function);
+  }
+
+  tsl::thread::ThreadPool pool_;
+  Eigen::ThreadPoolDevice device_;
+  ExecutableRunOptions run_options_;
+};
+
+TEST_F(ParallelForkJoinTest, RunsEachPartitionOnce) {
+  const int64_t size = 1000;
+  for (int32_t num_partitions : {2, 3, 4, 17, 64}) {
+    std::vector<std::atomic<int32_t>> counts(size);
+    std::vector<int64_t> partitions = MakePartitions(size, num_partitions);
+    void* buffer_table[] = {counts.data()};
+    XlaCustomCallStatus status;
+    ForkJoin(reinterpret_cast<void*>(&CountPartition), partitions,
+             buffer_table, &status);
+    EXPECT_TRUE(__xla_cpu_runtime_StatusIsSuccess(&status));
+    for (int64_t j = 0; j < size; ++j) {
+      ASSERT_EQ(counts[j].load(), 1) << j << " of " << num_partitions;
+    }
+  }
+}
+
+TEST_F(ParallelForkJoinTest, JoinsPartitionErrors) {
+  std::vector<int64_t> partitions = MakePartitions(4, 4);
+  XlaCustomCallStatus status;
+  ForkJoin(reinterpret_cast<void*>(&FailOddPartitions), partitions,
+           /*buffer_table=*/nullptr, &status);
+  EXPECT_EQ(CustomCallStatusGetMessage(&status).value(),
+            "Partition 1 error: odd 1\nPartition 3 error: odd 3");
+}
+
+TEST_F(ParallelForkJoinTest, NestedInAllPoolThreads) {
+  // Every pool thread calls ParallelForkJoin, so no helper task can start
+  // until the callers return. The callers must run their partitions
+  // themselves instead of waiting for the pool.
+  const int64_t size = 256;
+  const int num_callers = pool_.NumThreads();
+  std::vector<std::vector<std::atomic<int32_t>>> counts(num_callers);
+  tsl::BlockingCounter done(num_callers);
+  for (int i = 0; i < num_callers; ++i) {
+    counts[i] = std::vector<std::atomic<int32_t>>(size);
+    pool_.Schedule([this, i, size, &counts, &done]() {
+      std::vector<int64_t> partitions = MakePartitions(size, 8);
+      void* buffer_table[] = {counts[i].data()};
+      XlaCustomCallStatus status;
+      ForkJoin(reinterpret_cast<void*>(&CountPartition), partitions,
+               buffer_table, &status);
+      done.DecrementCount();
+    });
+  }
+  done.Wait();
+  for (int i = 0; i < num_callers; ++i) {
+    for (int64_t j = 0; j < size; ++j) {
+      ASSERT_EQ(counts[i][j].load(), 1);
+    }
+  }
+}
+
+// Performance benchmarks below.
+
+// Computes a sum per element whose length grows along the partitioned
+// dimension, so later partitions are stragglers.
+void SkewedWork(void* /*result*/, const void* /*run_options*/,
+                const void** /*params*/, void** buffer_table,
+                void* /*status*/, int64_t* partition,
+                uint64_t* /*prof_counters*/) {
+  float* out = static_cast<float*>(buffer_table[0]);
+  for (int64_t j = partition[0]; j < partition[1]; ++j) {
+    float acc = 0.0f;
+    const int64_t iterations = 100 + 4 * j;
+    for (int64_t k = 0; k < iterations; ++k) {
+      acc += std::sqrt(static_cast<float>(k + j));
+    }
+    out[j] = acc;
+  }
+}
+
+// Runs 'num_tenants' concurrent ParallelForkJoin calls, as independent
+// executables serving requests would, on one intra-op pool sized to the
+// machine.
+void BM_ConcurrentForkJoin(::testing::benchmark::State& state) {
+  const int num_tenants = state.range(0);
+  const int32_t num_partitions = state.range(1);
+  const int64_t size = 4096;
+
+  const int num_threads = tsl::port::MaxParallelism();
+  tsl::thread::ThreadPool pool(tsl::Env::Default(), "XLAEigen", num_threads);
+  Eigen::ThreadPoolDevice device(pool.AsEigenThreadPool(), pool.NumThreads());
+  ExecutableRunOptions run_options;
+  run_options.set_intra_op_thread_pool(&device);
+  tsl::thread::ThreadPool callers(tsl::Env::Default(), "Tenants", num_tenants);
+
+  std::vector<int64_t> partitions = MakePartitions(size, num_partitions);
+  std::vector<std::vector<float>> outputs(num_tenants,
+                                          std::vector<float>(size));
+
+  for (auto s : state) {
+    tsl::BlockingCounter done(num_tenants);
+    for (int i = 0; i < num_tenants; ++i) {
+      callers.Schedule([&, i]() {
+        void* buffer_table[] = {outputs[i].data()};
+        std::vector<int64_t> tenant_partitions = partitions;
+        XlaCustomCallStatus status;
+        __xla_cpu_runtime_ParallelForkJoin(
+            /*result_ptr=*/nullptr, &run_options, /*params=*/nullptr,
+            buffer_table, &status, /*prof_counters=*/nullptr, num_partitions,
+            tenant_partitions.data(), /*num_partitioned_dims=*/1,
+            reinterpret_cast<void*>(&SkewedWork));
+        done.DecrementCount();
+      });
+    }
+    done.Wait();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          num_tenants);
+}
+
+BENCHMARK(BM_ConcurrentForkJoin)
+    ->UseRealTime()
+    ->ArgPair(1, 8)
+    ->ArgPair(1, 64)
+    ->ArgPair(4, 8)
+    ->ArgPair(4, 64)
+    ->ArgPair(16, 8)
+    ->ArgPair(16, 64);
+
+}  // namespace
+}  // namespace xla
@@ -14,20 +14,346 @@ limitations under the License.
 ==============================================================================*/
 #include "tensorflow/compiler/xla/service/cpu/runtime_key_value_sort.h"
 
+#define EIGEN_USE_THREADS
+
 #include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <cstring>
+#include <functional>
 #include <memory>
 #include <numeric>
-#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include "absl/base/dynamic_annotations.h"
 #include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
+#include "tensorflow/compiler/xla/executable_run_options.h"
+
+namespace {
+
+using xla::cpu::SortKeyKind;
+
+// Sorts with fewer elements than this are not split across threads.
+constexpr int64_t kMinParallelSortElements = 1 << 15;
+
+// Describes the [a, b, c] shapes passed to __xla_cpu_runtime_KeyValueSort.
+struct SortShape {
+  int64_t a;
+  int64_t b;
+  int64_t c;
+  char** values;
+  int32_t values_count;
+  const int32_t* sizes;
+
+  int64_t num_rows() const { return a * c; }
+
+  // 'row' can be split into two values which index into the 'c' dimension and
+  // the 'a' dimension, respectively. 'row' % 'c' is the index into the 'c'
+  // dimension, 'row' / 'c' is the index into the 'a' dimension. When
+  // calculating the base offset, we need to multiply the index into the 'a'
+  // dimension with 'b' * 'c'.
+  // 'row' / 'c' * 'c' * 'b' = ('row' - 'row' % 'c') * 'b'.
+  int64_t base_offset(int64_t row) const {
+    return row % c + (row - row % c) * b;
+  }
+
+  // Returns the address of the 'i'-th element of 'row' in values[value].
+  char* element(int32_t value, int64_t base_offset, int64_t i) const {
+    return values[value] + (base_offset + i * c) * sizes[value];
+  }
+};
+
+// Runs 'fn(i)' for all i in [0, n) on 'device' and the calling thread, and
+// returns when all of them are done. The calling thread claims items like the
+// pool threads do, so this finishes even if it is called from every pool
+// thread at once.
+void ParallelFor(const Eigen::ThreadPoolDevice* device, int64_t n,
+                 const std::function<void(int64_t)>& fn) {
+  struct State {
+    explicit State(int64_t n) : done(static_cast<unsigned int>(n)) {}
+    std::atomic<int64_t> next{0};
+    Eigen::Barrier done;
+  };
+  auto state = std::make_shared<State>(n);
+  // Tasks that start after all items were claimed return without touching
+  // 'fn', which may be gone by then.
+  auto run = [state, n, fn = &fn]() {
+    for (int64_t i = state->next.fetch_add(1); i < n;
+         i = state->next.fetch_add(1)) {
+      (*fn)(i);
+      state->done.Notify();
+    }
+  };
+  for (int64_t i = 1; i < n; ++i) {
+    device->enqueueNoNotification([run]() { run(); });
+  }
+  run();
+  state->done.Wait();
+}
+
+template <int64_t kSize>
+void PermuteValue(char* data, int64_t stride, const int64_t* indices,
+                  int64_t n, char* scratch) {
+  for (int64_t i = 0; i < n; ++i) {
+    std::memcpy(scratch + i * kSize, data + indices[i] * stride, kSize);
+  }
+  if (stride == kSize) {
+    std::memcpy(data, scratch, n * kSize);
+    return;
+  }
+  for (int64_t i = 0; i < n; ++i) {
+    std::memcpy(data + i * stride, scratch + i * kSize, kSize);
+  }
+}
+
+// Reorders all values of 'row' so that the 'i'-th element is the
+// 'indices[i]'-th element before. 'scratch' is resized as needed.
+void PermuteRow(const SortShape& shape, int64_t base_offset,
+                const int64_t* indices, std::vector<char>* scratch) {
+  const int64_t n = shape.b;
+  for (int32_t value = 0; value < shape.values_count; ++value) {
+    const int64_t size = shape.sizes[value];
+    scratch->resize(std::max<size_t>(scratch->size(), n * size));
+    char* data = shape.element(value, base_offset, 0);
+    const int64_t stride = shape.c * size;
+    switch (size) {
+      case 1:
+        PermuteValue<1>(data, stride, indices, n, scratch->data());
+        break;
+      case 2:
+        PermuteValue<2>(data, stride, indices, n, scratch->data());
+        break;
+      case 4:
+        PermuteValue<4>(data, stride, indices, n, scratch->data());
+        break;
+      case 8:
+        PermuteValue<8>(data, stride, indices, n, scratch->data());
+        break;
+      default:
+        for (int64_t i = 0; i < n; ++i) {
+          std::memcpy(scratch->data() + i * size,
+                      data + indices[i] * stride, size);
+        }
+        for (int64_t i = 0; i < n; ++i) {
+          std::memcpy(data + i * stride, scratch->data() + i * size, size);
+        }
+    }
+  }
+}
+
+// Sorts [data, data + n) with a merge sort whose chunks and merges run on
+// 'device'. 'device' may be null, in which case this is std::sort.
+template <typename Entry>
+void ParallelSort(Entry* data, int64_t n,
+                  const Eigen::ThreadPoolDevice* device) {
+  int64_t num_chunks = 1;
+  if (device != nullptr) {
+    while (num_chunks * 2 <= device->numThreads() &&
+           n / (num_chunks * 2) >= kMinParallelSortElements) {
+      num_chunks *= 2;
+    }
+  }
+  if (num_chunks == 1) {
+    std::sort(data, data + n);
+    return;
+  }
+
+  auto bound = [&](int64_t chunk) { return n * chunk / num_chunks; };
+  ParallelFor(device, num_chunks, [&](int64_t chunk) {
+    std::sort(data + bound(chunk), data + bound(chunk + 1));
+  });
+
+  // Merge pairs of sorted runs until a single one is left.
+  std::vector<Entry> buffer(n);
+  Entry* src = data;
+  Entry* dst = buffer.data();
+  for (int64_t width = 1; width < num_chunks; width *= 2) {
+    ParallelFor(device, num_chunks / (2 * width), [&](int64_t pair) {
+      int64_t lo = bound(2 * pair * width);
+      int64_t mid = bound((2 * pair + 1) * width);
+      int64_t hi = bound((2 * pair + 2) * width);
+      std::merge(src + lo, src + mid, src + mid, src + hi, dst + lo);
+    });
+    std::swap(src, dst);
+  }
+  if (src != data) {
+    std::copy(src, src + n, data);
+  }
+}
+
+// Maps keys of type T to unsigned integers of the same width whose ascending
+// order is the order of the keys, or the reverse order if 'descending' is set.
+template <typename T>
+struct OrderedKey {
+  using Bits = std::make_unsigned_t<
+      std::conditional_t<std::is_floating_point_v<T>,
+                         std::conditional_t<sizeof(T) == 4, int32_t, int64_t>,
+                         T>>;
+  static constexpr Bits kSignBit = Bits{1} << (sizeof(T) * 8 - 1);
+
+  static Bits Map(T key, SortKeyKind kind, bool descending) {
+    Bits bits;
+    if constexpr (std::is_floating_point_v<T>) {
+      // IEEE comparisons treat -0 and +0 as equal.
+      if (kind == xla::cpu::kSortKeyFloat && key == 0) key = 0;
+      std::memcpy(&bits, &key, sizeof(T));
+      bits = (bits & kSignBit) ? ~bits : (bits | kSignBit);
+    } else if constexpr (std::is_signed_v<T>) {
+      bits = static_cast<Bits>(key) ^ kSignBit;
+    } else {
+      bits = key;
+    }
+    return descending ? static_cast<Bits>(~bits) : bits;
+  }
+};
+
+// Sorts every row by its keys in values[0] without calling the comparator.
+// Entries pair the mapped key with the index of the element, so ties are kept
+// in their original order by any sorting algorithm.
+template <typename T>
+void SortByKey(const SortShape& shape, SortKeyKind kind, bool descending,
+               const Eigen::ThreadPoolDevice* device) {
+  using Bits = typename OrderedKey<T>::Bits;
+  const int64_t n = shape.b;
+  // Keys of up to 32 bits are packed with their index into an integer, which
+  // is faster to sort than a pair.
+  const bool pack = sizeof(T) <= 4 && n <= (int64_t{1} << 32);
+
+  auto sort_rows = [&](int64_t begin, int64_t end,
+                       const Eigen::ThreadPoolDevice* row_device) {
+    std::vector<uint64_t> packed;
+    std::vector<std::pair<Bits, int64_t>> pairs;
+    std::vector<int64_t> indices(n);
+    std::vector<char> scratch;
+    for (int64_t row = begin; row < end; ++row) {
+      const int64_t base_offset = shape.base_offset(row);
+      auto key = [&](int64_t i) {
+        T value;
+        std::memcpy(&value, shape.element(0, base_offset, i), sizeof(T));
+        return OrderedKey<T>::Map(value, kind, descending);
+      };
+      if (pack) {
+        packed.resize(n);
+        for (int64_t i = 0; i < n; ++i) {
+          packed[i] = (static_cast<uint64_t>(key(i)) << 32) | i;
+        }
+        ParallelSort(packed.data(), n, row_device);
+        for (int64_t i = 0; i < n; ++i) {
+          indices[i] = packed[i] & 0xFFFFFFFF;
+        }
+      } else {
+        pairs.resize(n);
+        for (int64_t i = 0; i < n; ++i) {
+          pairs[i] = {key(i), i};
+        }
+        ParallelSort(pairs.data(), n, row_device);
+        for (int64_t i = 0; i < n; ++i) {
+          indices[i] = pairs[i].second;
+        }
+      }
+      PermuteRow(shape, base_offset, indices.data(), &scratch);
+    }
+  };
+
+  // Rows are sorted in parallel if there are enough of them to keep the pool
+  // busy. Otherwise every row is split across the pool on its own.
+  const int64_t num_rows = shape.num_rows();
+  if (device != nullptr && num_rows >= device->numThreads() &&
+      num_rows * n >= kMinParallelSortElements) {
+    const int64_t num_tasks = device->numThreads();
+    ParallelFor(device, num_tasks, [&](int64_t task) {
+      sort_rows(num_rows * task / num_tasks, num_rows * (task + 1) / num_tasks,
+                /*row_device=*/nullptr);
+    });
+  } else {
+    sort_rows(0, num_rows, device);
+  }
+}
+
+template <typename T>
+bool HasNaN(const SortShape& shape) {
+  for (int64_t row = 0; row < shape.num_rows(); ++row) {
+    const int64_t base_offset = shape.base_offset(row);
+    for (int64_t i = 0; i < shape.b; ++i) {
+      T value;
+      std::memcpy(&value, shape.element(0, base_offset, i), sizeof(T));
+      if (std::isnan(value)) return true;
+    }
+  }
+  return false;
+}
+
+// Sorts by the keys if their type is supported. Returns false if the
+// comparator has to be called instead.
+bool TrySortByKey(const SortShape& shape, SortKeyKind kind, bool descending,
+                  const Eigen::ThreadPoolDevice* device) {
+  switch (kind) {
+    case xla::cpu::kSortKeySigned:
+      switch (shape.sizes[0]) {
+        case 1:
+          SortByKey<int8_t>(shape, kind, descending, device);
+          return true;
+        case 2:
+          SortByKey<int16_t>(shape, kind, descending, device);
+          return true;
+        case 4:
+          SortByKey<int32_t>(shape, kind, descending, device);
+          return true;
+        case 8:
+          SortByKey<int64_t>(shape, kind, descending, device);
+          return true;
+      }
+      return false;
+    case xla::cpu::kSortKeyUnsigned:
+      switch (shape.sizes[0]) {
+        case 1:
+          SortByKey<uint8_t>(shape, kind, descending, device);
+          return true;
+        case 2:
+          SortByKey<uint16_t>(shape, kind, descending, device);
+          return true;
+        case 4:
+          SortByKey<uint32_t>(shape, kind, descending, device);
+          return true;
+        case 8:
+          SortByKey<uint64_t>(shape, kind, descending, device);
+          return true;
+      }
+      return false;
+    case xla::cpu::kSortKeyFloat:
+    case xla::cpu::kSortKeyFloatTotalOrder:
+      // IEEE comparisons with NaN are not a strict weak order, so rows with
+      // NaN keys keep whatever order the comparator produces.
+      switch (shape.sizes[0]) {
+        case 4:
+          if (kind == xla::cpu::kSortKeyFloat && HasNaN<float>(shape)) {
+            return false;
+          }
+          SortByKey<float>(shape, kind, descending, device);
+          return true;
+        case 8:
+          if (kind == xla::cpu::kSortKeyFloat && HasNaN<double>(shape)) {
+            return false;
+          }
+          SortByKey<double>(shape, kind, descending, device);
+          return true;
+      }
+      return false;
+    default:
+      return false;
+  }
+}
+
+}  // namespace
 
 ABSL_ATTRIBUTE_NO_SANITIZE_MEMORY void __xla_cpu_runtime_KeyValueSort(
     int64_t a, int64_t b, int64_t c, char** values, int32_t values_count,
     int32_t* values_primitive_type_size_in_bytes, bool is_stable,
     char* run_options, int64_t* prof_counters,
-    void (*less_than)(char*, char*, char**, char**, int64_t*)) {
+    void (*less_than)(char*, char*, char**, char**, int64_t*),
+    int32_t key_kind, bool key_descending) {
   // 'values' and 'values_primitive_type_size_in_bytes' are managed by the JIT
   // code, so msan can't tell they are initialized.
   ABSL_ANNOTATE_MEMORY_IS_INITIALIZED(values, values_count * sizeof(char*));
@@ -42,39 +368,32 @@ ABSL_ATTRIBUTE_NO_SANITIZE_MEMORY void __xla_cpu_runtime_KeyValueSort(
   // many rows that we need to sort. We iterate through these, calculate a
   // 'base_offset' value which points to the first element in that row, and add
   // i * c for accessing the 'i'-th element in that row.
+  SortShape shape{a, b, c, values, values_count,
+                  values_primitive_type_size_in_bytes};
 
-  int64_t sort_dimension_elements = b;
-  int64_t num_iteration_elements = a * c;
-  int64_t sort_dimension_offset = c;
+  const Eigen::ThreadPoolDevice* device = nullptr;
+  if (run_options != nullptr) {
+    device = reinterpret_cast<const xla::ExecutableRunOptions*>(run_options)
+                 ->intra_op_thread_pool();
+  }
+  if (TrySortByKey(shape, static_cast<SortKeyKind>(key_kind), key_descending,
+                   device)) {
+    return;
+  }
 
+  int64_t sort_dimension_elements = b;
   std::unique_ptr<int64_t[]> indices(new int64_t[sort_dimension_elements]);
   std::unique_ptr<char*[]> comparison_values(new char*[2 * values_count]);
-  std::iota(indices.get(), indices.get() + sort_dimension_elements, 0);
-  std::unique_ptr<std::string[]> reordered_values(
-      new std::string[sort_dimension_elements]);
-  for (int64_t index = 0; index < num_iteration_elements; ++index) {
-    // If the sort should be stable, we have to reinitialize indices to iota to
-    // guarantee that we still keep the relative order in case of ties.
-    if (is_stable && index > 0) {
-      std::iota(indices.get(), indices.get() + sort_dimension_elements, 0);
-    }
-    // 'index' can be split into two values which index into the 'c' dimension
-    // and the 'a' dimension, respectively. 'index' % 'c' is the index into the
-    // 'c' dimension, 'index' / 'c' is the index into the 'a' dimension. When
-    // calculating the base offset, we need to multiply the index into the 'a'
-    // dimension with 'b' * 'c'.
-    // 'index' / 'c' * 'c' * 'b' = ('index' - 'index' % 'c') * 'b'.
-    int64_t base_offset =
-        index % sort_dimension_offset +
-        (index - index % sort_dimension_offset) * sort_dimension_elements;
+  std::vector<char> scratch;
+  for (int64_t index = 0; index < shape.num_rows(); ++index) {
+    // Reinitialize indices to iota, which also keeps the relative order of
+    // ties if the sort should be stable.
+    std::iota(indices.get(), indices.get() + sort_dimension_elements, 0);
+    int64_t base_offset = shape.base_offset(index);
     auto compare_function = [&](int64_t a, int64_t b) -> bool {
       for (int32_t i = 0; i < values_count; ++i) {
-        int64_t memory_index_lhs = (base_offset + a * sort_dimension_offset) *
-                                   values_primitive_type_size_in_bytes[i];
-        int64_t memory_index_rhs = (base_offset + b * sort_dimension_offset) *
-                                   values_primitive_type_size_in_bytes[i];
-        comparison_values[i * 2] = values[i] + memory_index_lhs;
-        comparison_values[i * 2 + 1] = values[i] + memory_index_rhs;
+        comparison_values[i * 2] = shape.element(i, base_offset, a);
+        comparison_values[i * 2 + 1] = shape.element(i, base_offset, b);
       }
       char result = 0;  // Overwritten by less_than.
       less_than(&result, run_options, comparison_values.get(), nullptr,
@@ -90,22 +409,6 @@ ABSL_ATTRIBUTE_NO_SANITIZE_MEMORY void __xla_cpu_runtime_KeyValueSort(
     }
 
     // Reorder the values according to the order defined by 'indices'.
-    for (int32_t idx = 0; idx < values_count; ++idx) {
-      for (int64_t i = 0; i < sort_dimension_elements; ++i) {
-        int64_t memory_index =
-            (base_offset + indices[i] * sort_dimension_offset) *
-            values_primitive_type_size_in_bytes[idx];
-
-        reordered_values[i] =
-            std::string(values[idx] + memory_index,
-                        values_primitive_type_size_in_bytes[idx]);
-      }
-      for (int64_t i = 0; i < sort_dimension_elements; ++i) {
-        int64_t memory_index = (base_offset + i * sort_dimension_offset) *
-                               values_primitive_type_size_in_bytes[idx];
-        memcpy(values[idx] + memory_index, reordered_values[i].c_str(),
-               values_primitive_type_size_in_bytes[idx]);
-      }
-    }
+    PermuteRow(shape, base_offset, indices.get(), &scratch);
   }
 }
@@ -18,7 +18,25 @@ limitations under the License.
 
 #include <stdint.h>
 
-#include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
+namespace xla {
+namespace cpu {
+
+// Describes the keys in values[0] when the comparator of a sort only compares
+// them with LT or GT. This lets the runtime sort them without calling the
+// comparator.
+enum SortKeyKind : int32_t {
+  // The comparator has to be called.
+  kSortKeyGeneric = 0,
+  kSortKeySigned = 1,
+  kSortKeyUnsigned = 2,
+  // Floating point keys compared with IEEE semantics.
+  kSortKeyFloat = 3,
+  // Floating point keys compared with -NaN < -Inf < -0 < +0 < +Inf < +NaN.
+  kSortKeyFloatTotalOrder = 4,
+};
+
+}  // namespace cpu
+}  // namespace xla
 
 extern "C" {
 
@@ -36,11 +54,19 @@ extern "C" {
 // - pointers to the parameter buffers (char**)
 // - pointers to the buffer tables = nullptr for thread local functions (char**)
 // - profile counters = 'prof_counters' (int64_t*)
+//
+// If 'key_kind' is not kSortKeyGeneric, 'less_than' is known to be equivalent
+// to comparing values[0] in ascending order, or in descending order if
+// 'key_descending' is set. The sort then compares the keys directly, and
+// splits large sorts across the intra-op thread pool of 'run_options'. The
+// result is the same as with 'less_than', except that ties are always kept in
+// their original order.
 extern void __xla_cpu_runtime_KeyValueSort(
     int64_t a, int64_t b, int64_t c, char** values, int32_t values_count,
     int32_t* values_primitive_type_size_in_bytes, bool is_stable,
     char* run_options, int64_t* prof_counters,
-    void (*less_than)(char*, char*, char**, char**, int64_t*));
+    void (*less_than)(char*, char*, char**, char**, int64_t*),
+    int32_t key_kind, bool key_descending);
 }
 
 #endif  // TENSORFLOW_COMPILER_XLA_SERVICE_CPU_RUNTIME_KEY_VALUE_SORT_H_
@@ -0,0 +1,235 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#define EIGEN_USE_THREADS
+#include "tensorflow/compiler/xla/service/cpu/runtime_key_value_sort.h"
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+#include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
+#include "tensorflow/compiler/xla/executable_run_options.h"
+#include "tensorflow/tsl/platform/cpu_info.h"
+#include "tensorflow/tsl/platform/env.h"
+#include "tensorflow/tsl/platform/test.h"
+#include "tensorflow/tsl/platform/test_benchmark.h"
+#include "tensorflow/tsl/platform/threadpool.h"
+
+namespace xla {
+namespace cpu {
+namespace {
+
+// A comparator as emitted for compare(p0, p1), direction=LT or GT.
+template <typename T, bool kDescending>
+void CompareKeys(char* result, char* /*run_options*/, char** params,
+                 char** /*buffer_table*/, int64_t* /*prof_counters*/) {
+  T lhs;
+  T rhs;
+  std::memcpy(&lhs, params[0], sizeof(T));
+  std::memcpy(&rhs, params[1], sizeof(T));
+  *result = kDescending ? lhs > rhs : lhs < rhs;
+}
+
+// Keys of [a, b, c] in values[0], with the positions of the keys as an s32
+// and an f64 payload.
+template <typename T>
+struct SortInput {
+  SortInput(int64_t a, int64_t b, int64_t c, int range, uint32_t seed)
+      : a(a), b(b), c(c), keys(a * b * c), indices(a * b * c),
+        doubles(a * b * c) {
+    std::mt19937 generator(seed);
+    for (int64_t i = 0; i < a * b * c; ++i) {
+      int64_t key = generator() % range;
+      if (std::is_signed_v<T>) key -= range / 2;
+      keys[i] = static_cast<T>(key);
+      // Mix in negative zeros, which compare equal to positive ones.
+      if (std::is_floating_point_v<T> && i % 7 == 0) keys[i] = -keys[i] * 0;
+    }
+    std::iota(indices.begin(), indices.end(), 0);
+    std::iota(doubles.begin(), doubles.end(), 0.5);
+  }
+
+  template <bool kDescending>
+  void Sort(int32_t key_kind, ExecutableRunOptions* run_options) {
+    char* values[] = {reinterpret_cast<char*>(keys.data()),
+                      reinterpret_cast<char*>(indices.data()),
+                      reinterpret_cast<char*>(doubles.data())};
+    int32_t sizes[] = {sizeof(T), sizeof(int32_t), sizeof(double)};
+    __xla_cpu_runtime_KeyValueSort(
+        a, b, c, values, /*values_count=*/3, sizes, /*is_stable=*/true,
+        reinterpret_cast<char*>(run_options), /*prof_counters=*/nullptr,
+        &CompareKeys<T, kDescending>, key_kind, kDescending);
+  }
+
+  bool operator==(const SortInput& other) const {
+    return std::memcmp(keys.data(), other.keys.data(),
+                       keys.size() * sizeof(T)) == 0 &&
+           indices == other.indices && doubles == other.doubles;
+  }
+
+  int64_t a, b, c;
+  std::vector<T> keys;
+  std::vector<int32_t> indices;
+  std::vector<double> doubles;
+};
+
+class KeyValueSortTest : public ::testing::Test {
+ protected:
+  KeyValueSortTest()
+      : pool_(tsl::Env::Default(), "XLAEigen", /*num_threads=*/4),
+        device_(pool_.AsEigenThreadPool(), pool_.NumThreads()) {
+    run_options_.set_intra_op_thread_pool(&device_);
+  }
+
+  // Checks that sorting by key gives the result of a stable sort with the
+  // comparator, for a sort dimension in the middle, a single large row that
+  // is merge sorted in parallel, and many rows sorted in parallel.
+  template <typename T, bool kDescending>
+  void ExpectSortByKeyMatchesComparator(int32_t key_kind) {
+    for (auto [a, b, c] : {std::array<int64_t, 3>{3, 17, 5},
+                           std::array<int64_t, 3>{1, 200000, 1},
+                           std::array<int64_t, 3>{64, 3000, 1}}) {
+      for (int range : {5, 1000000}) {
+        SortInput<T> expected(a, b, c, range, /*seed=*/a + b + c);
+        SortInput<T> actual = expected;
+        expected.template Sort<kDescending>(kSortKeyGeneric, &run_options_);
+        actual.template Sort<kDescending>(key_kind, &run_options_);
+        EXPECT_TRUE(actual == expected)
+            << "[" << a << ", " << b << ", " << c << "] range " << range;
+      }
+    }
+  }
+
+  tsl::thread::ThreadPool pool_;
+  Eigen::ThreadPoolDevice device_;
+  ExecutableRunOptions run_options_;
+};
+
+TEST_F(KeyValueSortTest, SignedKeys) {
+  ExpectSortByKeyMatchesComparator<int8_t, false>(kSortKeySigned);
+  ExpectSortByKeyMatchesComparator<int32_t, false>(kSortKeySigned);
+  ExpectSortByKeyMatchesComparator<int32_t, true>(kSortKeySigned);
+  ExpectSortByKeyMatchesComparator<int64_t, true>(kSortKeySigned);
+}
+
+TEST_F(KeyValueSortTest, UnsignedKeys) {
+  ExpectSortByKeyMatchesComparator<uint16_t, true>(kSortKeyUnsigned);
+  ExpectSortByKeyMatchesComparator<uint64_t, false>(kSortKeyUnsigned);
+}
+
+TEST_F(KeyValueSortTest, FloatKeys) {
+  ExpectSortByKeyMatchesComparator<float, false>(kSortKeyFloat);
+  ExpectSortByKeyMatchesComparator<float, true>(kSortKeyFloat);
+  ExpectSortByKeyMatchesComparator<double, false>(kSortKeyFloat);
+}
+
+TEST_F(KeyValueSortTest, FloatTotalOrderKeys) {
+  SortInput<float> input(/*a=*/1, /*b=*/6, /*c=*/1, /*range=*/1, /*seed=*/0);
+  const float kInf = std::numeric_limits<float>::infinity();
+  const float kNaN = std::numeric_limits<float>::quiet_NaN();
+  input.keys = {kNaN, 0.0f, -kInf, -0.0f, 1.0f, -kNaN};
+  input.Sort</*kDescending=*/false>(kSortKeyFloatTotalOrder, &run_options_);
+  EXPECT_TRUE(std::isnan(input.keys[0]) && std::signbit(input.keys[0]));
+  EXPECT_EQ(input.keys[1], -kInf);
+  EXPECT_TRUE(input.keys[2] == 0.0f && std::signbit(input.keys[2]));
+  EXPECT_TRUE(input.keys[3] == 0.0f && !std::signbit(input.keys[3]));
+  EXPECT_EQ(input.keys[4], 1.0f);
+  EXPECT_TRUE(std::isnan(input.keys[5]) && !std::signbit(input.keys[5]));
+  EXPECT_EQ(input.indices, std::vector<int32_t>({5, 2, 3, 1, 4, 0}));
+}
+
+TEST_F(KeyValueSortTest, NaNKeysUseComparator) {
+  SortInput<float> expected(/*a=*/1, /*b=*/100, /*c=*/1, /*range=*/10,
+                            /*seed=*/0);
+  expected.keys[50] = std::numeric_limits<float>::quiet_NaN();
+  SortInput<float> actual = expected;
+  expected.Sort</*kDescending=*/false>(kSortKeyGeneric, &run_options_);
+  actual.Sort</*kDescending=*/false>(kSortKeyFloat, &run_options_);
+  EXPECT_EQ(actual.indices, expected.indices);
+}
+
+TEST_F(KeyValueSortTest, WithoutThreadPool) {
+  SortInput<int32_t> expected(/*a=*/1, /*b=*/100000, /*c=*/1,
+                              /*range=*/1000, /*seed=*/0);
+  SortInput<int32_t> actual = expected;
+  expected.Sort</*kDescending=*/true>(kSortKeyGeneric, nullptr);
+  actual.Sort</*kDescending=*/true>(kSortKeySigned, nullptr);
+  EXPECT_TRUE(actual == expected);
+}
+
+// Performance benchmarks below.
+
+// Argsorts 'num_rows' rows of 'n' f32 keys with an s32 iota payload, calling
+// the comparator (`by_key` = 0) or comparing the keys directly (`by_key` =
+// 1).
+void BM_Argsort(::testing::benchmark::State& state) {
+  const int64_t num_rows = state.range(0);
+  const int64_t n = state.range(1);
+  const bool by_key = state.range(2);
+
+  tsl::thread::ThreadPool pool(tsl::Env::Default(), "XLAEigen",
+                               tsl::port::MaxParallelism());
+  Eigen::ThreadPoolDevice device(pool.AsEigenThreadPool(), pool.NumThreads());
+  ExecutableRunOptions run_options;
+  run_options.set_intra_op_thread_pool(&device);
+
+  std::mt19937 generator(0);
+  std::uniform_real_distribution<float> distribution;
+  std::vector<float> input(num_rows * n);
+  for (float& key : input) key = distribution(generator);
+  std::vector<float> keys(num_rows * n);
+  std::vector<int32_t> indices(num_rows * n);
+
+  for (auto s : state) {
+    state.PauseTiming();
+    keys = input;
+    for (int64_t row = 0; row < num_rows; ++row) {
+      std::iota(indices.begin() + row * n, indices.begin() + (row + 1) * n, 0);
+    }
+    state.ResumeTiming();
+    char* values[] = {reinterpret_cast<char*>(keys.data()),
+                      reinterpret_cast<char*>(indices.data())};
+    int32_t sizes[] = {sizeof(float), sizeof(int32_t)};
+    __xla_cpu_runtime_KeyValueSort(
+        num_rows, n, /*c=*/1, values, /*values_count=*/2, sizes,
+        /*is_stable=*/true, reinterpret_cast<char*>(&run_options),
+        /*prof_counters=*/nullptr, &CompareKeys<float, false>,
+        by_key ? kSortKeyFloat : kSortKeyGeneric, /*key_descending=*/false);
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          num_rows * n);
+}
+
+BENCHMARK(BM_Argsort)
+    ->UseRealTime()
+    ->Args({1, 1 << 10, 0})
+    ->Args({1, 1 << 10, 1})
+    ->Args({1, 1 << 20, 0})
+    ->Args({1, 1 << 20, 1})
+    ->Args({1024, 1 << 10, 0})
+    ->Args({1024, 1 << 10, 1})
+    ->Args({64, 1 << 16, 0})
+    ->Args({64, 1 << 16, 1});
+
+}  // namespace
+}  // namespace cpu
+}  // namespace xla
@@ -0,0 +1,233 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/compiler/xla/service/cpu/runtime_low_precision_conv2d.h"
+
+#define EIGEN_USE_THREADS
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "absl/base/dynamic_annotations.h"
+#include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
+#include "tensorflow/compiler/xla/executable_run_options.h"
+#include "tensorflow/compiler/xla/service/cpu/runtime_lightweight_check.h"
+
+namespace xla {
+namespace cpu {
+namespace internal {
+namespace {
+
+// Upper bound on the size of the patches gathered for one matrix
+// multiplication, which keeps the memory of large convolutions bounded.
+constexpr int64_t kMaxPatchBytes = 4 << 20;
+
+// Returns the index into the undilated input of the dilated and padded
+// position `dilated`, or -1 if it is in the padding or between two dilated
+// input values.
+int64_t InputIndex(int64_t dilated, int64_t dilation, int64_t size) {
+  if (dilated < 0 || dilated % dilation != 0) return -1;
+  const int64_t index = dilated / dilation;
+  return index < size ? index : -1;
+}
+
+// Gathers the patches of the output pixels [pixel, pixel + num_pixels) into
+// the columns of the column-major (kernel_rows * kernel_cols * channels) x
+// num_pixels matrix `patches`, in the HWI order of the kernel.
+template <typename T>
+void GatherPatches(const T* input, const LowPrecisionConvDims& dims,
+                   int64_t pixel, int64_t num_pixels, T* patches) {
+  const int64_t channels = dims.input_channels;
+  const int64_t patch_size = dims.kernel_rows * dims.kernel_cols * channels;
+  const int64_t image_pixels = dims.output_rows * dims.output_cols;
+  for (int64_t j = 0; j < num_pixels; ++j) {
+    const int64_t p = pixel + j;
+    const int64_t batch = p / image_pixels;
+    const int64_t output_row = (p % image_pixels) / dims.output_cols;
+    const int64_t output_col = p % dims.output_cols;
+    const T* image =
+        input + batch * dims.input_rows * dims.input_cols * channels;
+    T* patch = patches + j * patch_size;
+    for (int64_t kr = 0; kr < dims.kernel_rows; ++kr) {
+      const int64_t row = InputIndex(output_row * dims.row_stride -
+                                         dims.padding_top +
+                                         kr * dims.rhs_row_dilation,
+                                     dims.lhs_row_dilation, dims.input_rows);
+      for (int64_t kc = 0; kc < dims.kernel_cols; ++kc, patch += channels) {
+        const int64_t col = InputIndex(output_col * dims.col_stride -
+                                           dims.padding_left +
+                                           kc * dims.rhs_col_dilation,
+                                       dims.lhs_col_dilation, dims.input_cols);
+        if (row < 0 || col < 0) {
+          std::fill_n(patch, channels, T(0));
+        } else {
+          std::copy_n(image + (row * dims.input_cols + col) * channels,
+                      channels, patch);
+        }
+      }
+    }
+  }
+}
+
+// Returns whether every output pixel reads exactly the input pixel at the same
+// position, so that the input is its own patch matrix.
+bool IsPointwise(const LowPrecisionConvDims& dims) {
+  return dims.kernel_rows == 1 && dims.kernel_cols == 1 &&
+         dims.row_stride == 1 && dims.col_stride == 1 &&
+         dims.padding_top == 0 && dims.padding_left == 0 &&
+         dims.lhs_row_dilation == 1 && dims.lhs_col_dilation == 1 &&
+         dims.output_rows == dims.input_rows &&
+         dims.output_cols == dims.input_cols;
+}
+
+// The output is the column-major filters x pixels matrix kernel * patches,
+// where the HWIO kernel is a column-major filters x (rows * cols * channels)
+// matrix as it is.
+template <typename Input, typename Output, typename MatMul>
+void LowPrecisionConv(const void* run_options_ptr, Output* out,
+                      const Input* lhs, const Input* rhs,
+                      const LowPrecisionConvDims& dims, MatMul matmul) {
+  const int64_t filters = dims.kernel_filters;
+  const int64_t patch_size =
+      dims.kernel_rows * dims.kernel_cols * dims.input_channels;
+  const int64_t num_pixels =
+      dims.input_batch * dims.output_rows * dims.output_cols;
+  if (IsPointwise(dims)) {
+    matmul(run_options_ptr, out, rhs, lhs, filters, num_pixels, patch_size);
+    return;
+  }
+
+  const int64_t chunk = std::clamp<int64_t>(
+      kMaxPatchBytes / std::max<int64_t>(patch_size * sizeof(Input), 1), 1,
+      num_pixels);
+  std::vector<Input> patches(chunk * patch_size);
+  const xla::ExecutableRunOptions* run_options =
+      static_cast<const xla::ExecutableRunOptions*>(run_options_ptr);
+  for (int64_t pixel = 0; pixel < num_pixels; pixel += chunk) {
+    const int64_t n = std::min(chunk, num_pixels - pixel);
+    auto gather = [&](Eigen::Index begin, Eigen::Index end) {
+      GatherPatches(lhs, dims, pixel + begin, end - begin,
+                    patches.data() + begin * patch_size);
+    };
+    if (run_options != nullptr &&
+        run_options->intra_op_thread_pool() != nullptr) {
+      run_options->intra_op_thread_pool()->parallelFor(
+          n,
+          Eigen::TensorOpCost(/*bytes_loaded=*/patch_size * sizeof(Input),
+                              /*bytes_stored=*/patch_size * sizeof(Input),
+                              /*compute_cycles=*/patch_size),
+          gather);
+    } else {
+      gather(0, n);
+    }
+    matmul(run_options_ptr, out + pixel * filters, rhs, patches.data(),
+           filters, n, patch_size);
+  }
+}
+
+}  // namespace
+
+void ConvS8S32(LowPrecisionMatMulKernel kernel, const void* run_options_ptr,
+               int32_t* out, const int8_t* lhs, const int8_t* rhs,
+               const LowPrecisionConvDims& dims) {
+  LowPrecisionConv(
+      run_options_ptr, out, lhs, rhs, dims,
+      [kernel](const void* run_options_ptr, int32_t* out, const int8_t* lhs,
+               const int8_t* rhs, int64_t m, int64_t n, int64_t k) {
+        MatMulS8S32(kernel, run_options_ptr, out, lhs, rhs, m, n, k,
+                    /*transpose_lhs=*/false, /*transpose_rhs=*/false);
+      });
+}
+
+void ConvBF16F32(LowPrecisionMatMulKernel kernel, const void* run_options_ptr,
+                 float* out, const Eigen::bfloat16* lhs,
+                 const Eigen::bfloat16* rhs,
+                 const LowPrecisionConvDims& dims) {
+  LowPrecisionConv(
+      run_options_ptr, out, lhs, rhs, dims,
+      [kernel](const void* run_options_ptr, float* out,
+               const Eigen::bfloat16* lhs, const Eigen::bfloat16* rhs,
+               int64_t m, int64_t n, int64_t k) {
+        MatMulBF16F32(kernel, run_options_ptr, out, lhs, rhs, m, n, k,
+                      /*transpose_lhs=*/false, /*transpose_rhs=*/false);
+      });
+}
+
+}  // namespace internal
+}  // namespace cpu
+}  // namespace xla
+
+namespace {
+
+xla::cpu::internal::LowPrecisionConvDims ConvDims(
+    int64_t input_batch, int64_t input_rows, int64_t input_cols,
+    int64_t input_channels, int64_t kernel_rows, int64_t kernel_cols,
+    int64_t kernel_channels, int64_t kernel_filters, int64_t output_rows,
+    int64_t output_cols, int64_t row_stride, int64_t col_stride,
+    int64_t padding_top, int64_t padding_left, int64_t lhs_row_dilation,
+    int64_t lhs_col_dilation, int64_t rhs_row_dilation,
+    int64_t rhs_col_dilation, int64_t feature_group_count) {
+  XLA_LIGHTWEIGHT_CHECK(feature_group_count == 1);
+  XLA_LIGHTWEIGHT_CHECK(kernel_channels == input_channels);
+  return {input_batch,      input_rows,       input_cols,
+          input_channels,   kernel_rows,      kernel_cols,
+          kernel_filters,   output_rows,      output_cols,
+          row_stride,       col_stride,       padding_top,
+          padding_left,     lhs_row_dilation, lhs_col_dilation,
+          rhs_row_dilation, rhs_col_dilation};
+}
+
+}  // namespace
+
+using xla::cpu::internal::LowPrecisionMatMulKernel;
+
+ABSL_ATTRIBUTE_NO_SANITIZE_MEMORY void __xla_cpu_runtime_ConvS8S32(
+    const void* run_options_ptr, int32_t* out, int8_t* lhs, int8_t* rhs,
+    int64_t input_batch, int64_t input_rows, int64_t input_cols,
+    int64_t input_channels, int64_t kernel_rows, int64_t kernel_cols,
+    int64_t kernel_channels, int64_t kernel_filters, int64_t output_rows,
+    int64_t output_cols, int64_t row_stride, int64_t col_stride,
+    int64_t padding_top, int64_t padding_bottom, int64_t padding_left,
+    int64_t padding_right, int64_t lhs_row_dilation, int64_t lhs_col_dilation,
+    int64_t rhs_row_dilation, int64_t rhs_col_dilation,
+    int64_t feature_group_count) {
+  xla::cpu::internal::ConvS8S32(
+      LowPrecisionMatMulKernel::kAvx512, run_options_ptr, out, lhs, rhs,
+      ConvDims(input_batch, input_rows, input_cols, input_channels,
+               kernel_rows, kernel_cols, kernel_channels, kernel_filters,
+               output_rows, output_cols, row_stride, col_stride, padding_top,
+               padding_left, lhs_row_dilation, lhs_col_dilation,
+               rhs_row_dilation, rhs_col_dilation, feature_group_count));
+}
+
+ABSL_ATTRIBUTE_NO_SANITIZE_MEMORY void __xla_cpu_runtime_ConvBF16F32(
+    const void* run_options_ptr, float* out, Eigen::bfloat16* lhs,
+    Eigen::bfloat16* rhs, int64_t input_batch, int64_t input_rows,
+    int64_t input_cols, int64_t input_channels, int64_t kernel_rows,
+    int64_t kernel_cols, int64_t kernel_channels, int64_t kernel_filters,
+    int64_t output_rows, int64_t output_cols, int64_t row_stride,
+    int64_t col_stride, int64_t padding_top, int64_t padding_bottom,
+    int64_t padding_left, int64_t padding_right, int64_t lhs_row_dilation,
+    int64_t lhs_col_dilation, int64_t rhs_row_dilation,
+    int64_t rhs_col_dilation, int64_t feature_group_count) {
+  xla::cpu::internal::ConvBF16F32(
+      LowPrecisionMatMulKernel::kAvx512, run_options_ptr, out, lhs, rhs,
+      ConvDims(input_batch, input_rows, input_cols, input_channels,
+               kernel_rows, kernel_cols, kernel_channels, kernel_filters,
+               output_rows, output_cols, row_stride, col_stride, padding_top,
+               padding_left, lhs_row_dilation, lhs_col_dilation,
+               rhs_row_dilation, rhs_col_dilation, feature_group_count));
+}
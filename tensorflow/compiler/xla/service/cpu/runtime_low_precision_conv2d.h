@@ -0,0 +1,87 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_COMPILER_XLA_SERVICE_CPU_RUNTIME_LOW_PRECISION_CONV2D_H_
+#define TENSORFLOW_COMPILER_XLA_SERVICE_CPU_RUNTIME_LOW_PRECISION_CONV2D_H_
+
+#include <stdint.h>
+
+#include "tensorflow/compiler/xla/service/cpu/runtime_low_precision_matmul.h"
+#include "third_party/eigen3/Eigen/Core"
+
+extern "C" {
+
+// Convolutions of an NHWC input with an HWIO kernel into an NHWC output, with
+// the arguments of __xla_cpu_runtime_EigenConv2DF32, but with narrow inputs
+// and a wide accumulator. The patches of the input are gathered a bounded
+// number of output pixels at a time and multiplied with the kernel by the
+// kernels of __xla_cpu_runtime_MatMulS8S32 and
+// __xla_cpu_runtime_MatMulBF16F32, so that they use the AVX512-VNNI and
+// AVX512-BF16 instructions too. 'feature_group_count' must be 1.
+extern void __xla_cpu_runtime_ConvS8S32(
+    const void* /* xla::ExecutableRunOptions* */ run_options_ptr, int32_t* out,
+    int8_t* lhs, int8_t* rhs, int64_t input_batch, int64_t input_rows,
+    int64_t input_cols, int64_t input_channels, int64_t kernel_rows,
+    int64_t kernel_cols, int64_t kernel_channels, int64_t kernel_filters,
+    int64_t output_rows, int64_t output_cols, int64_t row_stride,
+    int64_t col_stride, int64_t padding_top, int64_t padding_bottom,
+    int64_t padding_left, int64_t padding_right, int64_t lhs_row_dilation,
+    int64_t lhs_col_dilation, int64_t rhs_row_dilation,
+    int64_t rhs_col_dilation, int64_t feature_group_count);
+
+extern void __xla_cpu_runtime_ConvBF16F32(
+    const void* /* xla::ExecutableRunOptions* */ run_options_ptr, float* out,
+    Eigen::bfloat16* lhs, Eigen::bfloat16* rhs, int64_t input_batch,
+    int64_t input_rows, int64_t input_cols, int64_t input_channels,
+    int64_t kernel_rows, int64_t kernel_cols, int64_t kernel_channels,
+    int64_t kernel_filters, int64_t output_rows, int64_t output_cols,
+    int64_t row_stride, int64_t col_stride, int64_t padding_top,
+    int64_t padding_bottom, int64_t padding_left, int64_t padding_right,
+    int64_t lhs_row_dilation, int64_t lhs_col_dilation,
+    int64_t rhs_row_dilation, int64_t rhs_col_dilation,
+    int64_t feature_group_count);
+
+}  // extern "C"
+
+namespace xla {
+namespace cpu {
+namespace internal {
+
+// The geometry of a convolution, in the order of the runtime arguments.
+struct LowPrecisionConvDims {
+  int64_t input_batch, input_rows, input_cols, input_channels;
+  int64_t kernel_rows, kernel_cols, kernel_filters;
+  int64_t output_rows, output_cols;
+  int64_t row_stride, col_stride;
+  int64_t padding_top, padding_left;
+  int64_t lhs_row_dilation, lhs_col_dilation;
+  int64_t rhs_row_dilation, rhs_col_dilation;
+};
+
+// The convolutions behind the runtime functions above, with the matrix
+// multiplication kernel selectable for tests.
+void ConvS8S32(LowPrecisionMatMulKernel kernel, const void* run_options_ptr,
+               int32_t* out, const int8_t* lhs, const int8_t* rhs,
+               const LowPrecisionConvDims& dims);
+
+void ConvBF16F32(LowPrecisionMatMulKernel kernel, const void* run_options_ptr,
+                 float* out, const Eigen::bfloat16* lhs,
+                 const Eigen::bfloat16* rhs, const LowPrecisionConvDims& dims);
+
+}  // namespace internal
+}  // namespace cpu
+}  // namespace xla
+
+#endif  // TENSORFLOW_COMPILER_XLA_SERVICE_CPU_RUNTIME_LOW_PRECISION_CONV2D_H_
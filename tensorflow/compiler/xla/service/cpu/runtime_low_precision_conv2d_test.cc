@@ -0,0 +1,262 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#define EIGEN_USE_THREADS
+#include "tensorflow/compiler/xla/service/cpu/runtime_low_precision_conv2d.h"
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
+#include "tensorflow/compiler/xla/executable_run_options.h"
+#include "tensorflow/compiler/xla/service/cpu/runtime_conv2d.h"
+#include "tensorflow/tsl/platform/cpu_info.h"
+#include "tensorflow/tsl/platform/env.h"
+#include "tensorflow/tsl/platform/test.h"
+#include "tensorflow/tsl/platform/test_benchmark.h"
+#include "tensorflow/tsl/platform/threadpool.h"
+
+namespace xla {
+namespace cpu {
+namespace internal {
+namespace {
+
+// Returns the kernels that can run on this CPU.
+std::vector<LowPrecisionMatMulKernel> Kernels(bool has_avx512_kernel) {
+  std::vector<LowPrecisionMatMulKernel> kernels = {
+      LowPrecisionMatMulKernel::kEigen};
+  if (has_avx512_kernel) kernels.push_back(LowPrecisionMatMulKernel::kAvx512);
+  return kernels;
+}
+
+// Returns the output size of a dimension, as XLA's shape inference does.
+int64_t OutputSize(int64_t input, int64_t kernel, int64_t stride,
+                   int64_t padding, int64_t lhs_dilation,
+                   int64_t rhs_dilation) {
+  const int64_t dilated_input = (input - 1) * lhs_dilation + 1 + padding;
+  const int64_t dilated_kernel = (kernel - 1) * rhs_dilation + 1;
+  if (dilated_input < dilated_kernel) return 0;
+  return (dilated_input - dilated_kernel) / stride + 1;
+}
+
+// Computes the convolution with the definition of XLA's convolution.
+template <typename T>
+std::vector<double> ReferenceConv(const std::vector<T>& input,
+                                  const std::vector<T>& kernel,
+                                  const LowPrecisionConvDims& dims) {
+  std::vector<double> out(dims.input_batch * dims.output_rows *
+                          dims.output_cols * dims.kernel_filters);
+  int64_t index = 0;
+  for (int64_t b = 0; b < dims.input_batch; ++b) {
+    for (int64_t oy = 0; oy < dims.output_rows; ++oy) {
+      for (int64_t ox = 0; ox < dims.output_cols; ++ox) {
+        for (int64_t f = 0; f < dims.kernel_filters; ++f) {
+          double sum = 0;
+          for (int64_t ky = 0; ky < dims.kernel_rows; ++ky) {
+            for (int64_t kx = 0; kx < dims.kernel_cols; ++kx) {
+              const int64_t y = oy * dims.row_stride - dims.padding_top +
+                                ky * dims.rhs_row_dilation;
+              const int64_t x = ox * dims.col_stride - dims.padding_left +
+                                kx * dims.rhs_col_dilation;
+              if (y < 0 || x < 0 || y % dims.lhs_row_dilation != 0 ||
+                  x % dims.lhs_col_dilation != 0 ||
+                  y / dims.lhs_row_dilation >= dims.input_rows ||
+                  x / dims.lhs_col_dilation >= dims.input_cols) {
+                continue;
+              }
+              for (int64_t c = 0; c < dims.input_channels; ++c) {
+                const int64_t input_index =
+                    ((b * dims.input_rows + y / dims.lhs_row_dilation) *
+                         dims.input_cols +
+                     x / dims.lhs_col_dilation) *
+                        dims.input_channels +
+                    c;
+                const int64_t kernel_index =
+                    ((ky * dims.kernel_cols + kx) * dims.input_channels + c) *
+                        dims.kernel_filters +
+                    f;
+                sum += static_cast<double>(input[input_index]) *
+                       static_cast<double>(kernel[kernel_index]);
+              }
+            }
+          }
+          out[index++] = sum;
+        }
+      }
+    }
+  }
+  return out;
+}
+
+// The geometries of the tests: pointwise, padded, strided and dilated
+// convolutions, and one whose patches are gathered in several chunks.
+std::vector<LowPrecisionConvDims> TestDims() {
+  struct Geometry {
+    int64_t batch, rows, cols, channels, kernel_rows, kernel_cols, filters;
+    int64_t stride, padding, lhs_dilation, rhs_dilation;
+  };
+  std::vector<LowPrecisionConvDims> dims;
+  for (const Geometry& g : std::vector<Geometry>{
+           {2, 7, 5, 3, 1, 1, 4, 1, 0, 1, 1},
+           {1, 8, 8, 16, 3, 3, 33, 1, 2, 1, 1},
+           {2, 9, 7, 5, 3, 2, 8, 2, 1, 1, 1},
+           {1, 9, 9, 4, 3, 3, 6, 1, 2, 1, 2},
+           {1, 5, 4, 3, 2, 2, 5, 1, 1, 2, 1},
+           {1, 1, 17, 7, 1, 3, 9, 1, 1, 1, 1},
+           {1, 128, 128, 64, 3, 3, 16, 1, 2, 1, 1}}) {
+    const int64_t output_rows =
+        OutputSize(g.rows, g.kernel_rows, g.stride, g.padding, g.lhs_dilation,
+                   g.rhs_dilation);
+    const int64_t output_cols =
+        OutputSize(g.cols, g.kernel_cols, g.stride, g.padding, g.lhs_dilation,
+                   g.rhs_dilation);
+    dims.push_back({g.batch, g.rows, g.cols, g.channels, g.kernel_rows,
+                    g.kernel_cols, g.filters, output_rows, output_cols,
+                    g.stride, g.stride, g.padding / 2, g.padding / 2,
+                    g.lhs_dilation, g.lhs_dilation, g.rhs_dilation,
+                    g.rhs_dilation});
+  }
+  return dims;
+}
+
+class LowPrecisionConvTest : public ::testing::Test {
+ protected:
+  LowPrecisionConvTest()
+      : pool_(tsl::Env::Default(), "XLAEigen", /*num_threads=*/4),
+        device_(pool_.AsEigenThreadPool(), pool_.NumThreads()) {
+    run_options_.set_intra_op_thread_pool(&device_);
+  }
+
+  tsl::thread::ThreadPool pool_;
+  Eigen::ThreadPoolDevice device_;
+  ExecutableRunOptions run_options_;
+};
+
+TEST_F(LowPrecisionConvTest, S8S32MatchesReference) {
+  std::mt19937 generator(0);
+  std::uniform_int_distribution<int> distribution(-128, 127);
+  for (const LowPrecisionConvDims& dims : TestDims()) {
+    std::vector<int8_t> input(dims.input_batch * dims.input_rows *
+                              dims.input_cols * dims.input_channels);
+    std::vector<int8_t> kernel(dims.kernel_rows * dims.kernel_cols *
+                               dims.input_channels * dims.kernel_filters);
+    for (int8_t& x : input) x = distribution(generator);
+    for (int8_t& x : kernel) x = distribution(generator);
+    std::vector<double> expected = ReferenceConv(input, kernel, dims);
+    for (LowPrecisionMatMulKernel k : Kernels(HasAvx512S8S32Kernel())) {
+      std::vector<int32_t> out(expected.size(), -1);
+      ConvS8S32(k, &run_options_, out.data(), input.data(), kernel.data(),
+                dims);
+      for (int64_t i = 0; i < out.size(); ++i) {
+        ASSERT_EQ(out[i], expected[i])
+            << "kernel " << static_cast<int>(k) << " input " << dims.input_rows
+            << "x" << dims.input_cols << " at " << i;
+      }
+    }
+  }
+}
+
+TEST_F(LowPrecisionConvTest, BF16F32MatchesReference) {
+  std::mt19937 generator(0);
+  std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+  for (const LowPrecisionConvDims& dims : TestDims()) {
+    std::vector<Eigen::bfloat16> input(dims.input_batch * dims.input_rows *
+                                       dims.input_cols * dims.input_channels);
+    std::vector<Eigen::bfloat16> kernel(dims.kernel_rows * dims.kernel_cols *
+                                        dims.input_channels *
+                                        dims.kernel_filters);
+    for (auto& x : input) x = Eigen::bfloat16(distribution(generator));
+    for (auto& x : kernel) x = Eigen::bfloat16(distribution(generator));
+    std::vector<double> expected = ReferenceConv(input, kernel, dims);
+    const int64_t patch_size =
+        dims.kernel_rows * dims.kernel_cols * dims.input_channels;
+    for (LowPrecisionMatMulKernel k : Kernels(HasAvx512BF16F32Kernel())) {
+      std::vector<float> out(expected.size(), NAN);
+      ConvBF16F32(k, &run_options_, out.data(), input.data(), kernel.data(),
+                  dims);
+      for (int64_t i = 0; i < out.size(); ++i) {
+        ASSERT_NEAR(out[i], expected[i], 1e-6 * patch_size)
+            << "kernel " << static_cast<int>(k) << " input " << dims.input_rows
+            << "x" << dims.input_cols << " at " << i;
+      }
+    }
+  }
+}
+
+// Performance benchmarks below.
+
+// Runs a 3x3 convolution of a 56x56 image with `channels` input and output
+// channels with the s8 (`type` = 0) or bf16 (`type` = 1) kernels, or with
+// Eigen in f32 (`type` = 2), which is what they are upcast to without them.
+void BM_LowPrecisionConv(::testing::benchmark::State& state) {
+  const int64_t channels = state.range(0);
+  const int type = state.range(1);
+  constexpr int64_t kSize = 56;
+
+  tsl::thread::ThreadPool pool(tsl::Env::Default(), "XLAEigen",
+                               tsl::port::MaxParallelism());
+  Eigen::ThreadPoolDevice device(pool.AsEigenThreadPool(), pool.NumThreads());
+  ExecutableRunOptions run_options;
+  run_options.set_intra_op_thread_pool(&device);
+
+  const int64_t input_size = kSize * kSize * channels;
+  const int64_t kernel_size = 9 * channels * channels;
+  std::vector<int8_t> s8_input(input_size, 3), s8_kernel(kernel_size, 2);
+  std::vector<int32_t> s32_out(input_size);
+  std::vector<Eigen::bfloat16> bf16_input(input_size, Eigen::bfloat16(0.5f));
+  std::vector<Eigen::bfloat16> bf16_kernel(kernel_size, Eigen::bfloat16(0.5f));
+  std::vector<float> f32_input(input_size, 0.5f), f32_kernel(kernel_size, 0.5f);
+  std::vector<float> f32_out(input_size);
+
+  for (auto s : state) {
+    switch (type) {
+      case 0:
+        __xla_cpu_runtime_ConvS8S32(
+            &run_options, s32_out.data(), s8_input.data(), s8_kernel.data(),
+            1, kSize, kSize, channels, 3, 3, channels, channels, kSize, kSize,
+            1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1);
+        break;
+      case 1:
+        __xla_cpu_runtime_ConvBF16F32(
+            &run_options, f32_out.data(), bf16_input.data(),
+            bf16_kernel.data(), 1, kSize, kSize, channels, 3, 3, channels,
+            channels, kSize, kSize, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1);
+        break;
+      default:
+        __xla_cpu_runtime_EigenConv2DF32(
+            &run_options, f32_out.data(), f32_input.data(), f32_kernel.data(),
+            1, kSize, kSize, channels, 3, 3, channels, channels, kSize, kSize,
+            1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1);
+    }
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * 2 *
+                          input_size * 9 * channels);
+}
+
+BENCHMARK(BM_LowPrecisionConv)
+    ->UseRealTime()
+    ->Args({64, 0})
+    ->Args({64, 1})
+    ->Args({64, 2})
+    ->Args({256, 0})
+    ->Args({256, 1})
+    ->Args({256, 2});
+
+}  // namespace
+}  // namespace internal
+}  // namespace cpu
+}  // namespace xla
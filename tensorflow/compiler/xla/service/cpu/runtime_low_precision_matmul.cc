@@ -0,0 +1,427 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/compiler/xla/service/cpu/runtime_low_precision_matmul.h"
+
+#define EIGEN_USE_THREADS
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "absl/base/dynamic_annotations.h"
+#include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
+#include "tensorflow/compiler/xla/executable_run_options.h"
+#include "tensorflow/tsl/platform/cpu_info.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define XLA_CPU_LOW_PRECISION_MATMUL_AVX512 1
+#include <immintrin.h>
+#endif
+
+namespace xla {
+namespace cpu {
+namespace internal {
+namespace {
+
+// s8 x s8 -> s32. VPDPBUSD multiplies unsigned by signed bytes, so the lhs is
+// packed with an offset of 128 that is subtracted again as 128 times the sum
+// of the rhs column. Both steps wrap, which keeps the result exact modulo
+// 2^32 like the s32 dot it replaces.
+struct S8S32 {
+  using Input = int8_t;
+  using PackedLhs = uint8_t;
+  using PackedRhs = int8_t;
+  using Output = int32_t;
+  static constexpr int64_t kGroup = 4;
+  static constexpr bool kHasLhsOffset = true;
+
+  static PackedLhs PackLhs(Input x) { return static_cast<uint8_t>(x) ^ 0x80; }
+  static PackedLhs LhsPadding() { return 0x80; }
+  static PackedRhs PackRhs(Input x) { return x; }
+};
+
+// bf16 x bf16 -> f32, with the bf16 values packed as their bits.
+struct BF16F32 {
+  using Input = Eigen::bfloat16;
+  using PackedLhs = uint16_t;
+  using PackedRhs = uint16_t;
+  using Output = float;
+  static constexpr int64_t kGroup = 2;
+  static constexpr bool kHasLhsOffset = false;
+
+  static uint16_t Bits(Input x) {
+    uint16_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    return bits;
+  }
+  static PackedLhs PackLhs(Input x) { return Bits(x); }
+  static PackedLhs LhsPadding() { return 0; }
+  static PackedRhs PackRhs(Input x) { return Bits(x); }
+};
+
+#if defined(XLA_CPU_LOW_PRECISION_MATMUL_AVX512)
+
+// The result is computed in tiles of kRows x kCols, which the AVX512 kernels
+// keep in 2 x 8 vector registers. The inputs are packed so that a tile reads
+// both operands sequentially: the lhs into panels of kRows rows and the rhs
+// into panels of kCols columns, with the contracting dimension split into
+// groups of the kGroup values that one dot product instruction reduces per
+// 32-bit lane.
+constexpr int64_t kRows = 32;
+constexpr int64_t kCols = 8;
+
+// Tiles are computed in blocks of kBlockRows x kBlockCols, so that an lhs
+// panel is reused for all rhs panels of a block, and the blocks are split
+// over the thread pool.
+constexpr int64_t kBlockRows = 8 * kRows;
+constexpr int64_t kBlockCols = 8 * kCols;
+
+int64_t CeilOfRatio(int64_t a, int64_t b) { return (a + b - 1) / b; }
+
+// The operands of one call, with element accessors that apply the transposes.
+template <typename Traits>
+struct Problem {
+  using Input = typename Traits::Input;
+
+  Input Lhs(int64_t i, int64_t p) const {
+    return transpose_lhs ? lhs[p + i * k] : lhs[i + p * m];
+  }
+  Input Rhs(int64_t p, int64_t j) const {
+    return transpose_rhs ? rhs[j + p * n] : rhs[p + j * k];
+  }
+
+  const Input* lhs;
+  const Input* rhs;
+  int64_t m, n, k;
+  bool transpose_lhs, transpose_rhs;
+  // Number of groups of the contracting dimension, which is padded with
+  // zeros in the rhs.
+  int64_t groups;
+};
+
+// Packs the lhs rows [row, row + kRows) into [groups][kRows][kGroup] order.
+// Rows past the end are padded with values that contribute nothing.
+template <typename Traits>
+void PackLhsPanel(const Problem<Traits>& problem, int64_t row,
+                  typename Traits::PackedLhs* packed) {
+  constexpr int64_t kGroup = Traits::kGroup;
+  std::fill_n(packed, problem.groups * kRows * kGroup, Traits::LhsPadding());
+  const int64_t rows = std::min(kRows, problem.m - row);
+  for (int64_t p = 0; p < problem.k; ++p) {
+    typename Traits::PackedLhs* group =
+        packed + (p / kGroup) * kRows * kGroup + p % kGroup;
+    for (int64_t r = 0; r < rows; ++r) {
+      group[r * kGroup] = Traits::PackLhs(problem.Lhs(row + r, p));
+    }
+  }
+}
+
+// Packs the rhs columns [col, col + kCols) into [groups][kCols][kGroup] order
+// and, if the lhs has an offset, stores the column sums in `column_sums`.
+template <typename Traits>
+void PackRhsPanel(const Problem<Traits>& problem, int64_t col,
+                  typename Traits::PackedRhs* packed, int32_t* column_sums) {
+  constexpr int64_t kGroup = Traits::kGroup;
+  std::fill_n(packed, problem.groups * kCols * kGroup,
+              typename Traits::PackedRhs{0});
+  const int64_t cols = std::min(kCols, problem.n - col);
+  for (int64_t c = 0; c < cols; ++c) {
+    int32_t sum = 0;
+    for (int64_t p = 0; p < problem.k; ++p) {
+      typename Traits::Input value = problem.Rhs(p, col + c);
+      packed[((p / kGroup) * kCols + c) * kGroup + p % kGroup] =
+          Traits::PackRhs(value);
+      if constexpr (Traits::kHasLhsOffset) sum += static_cast<int32_t>(value);
+    }
+    column_sums[c] = sum;
+  }
+  if constexpr (Traits::kHasLhsOffset) {
+    std::fill(column_sums + cols, column_sums + kCols, 0);
+  }
+}
+
+// Computes the rows x cols corner of a tile into `out`, which has a leading
+// dimension of `ldc`.
+template <typename Traits>
+using TileKernel = void (*)(const typename Traits::PackedLhs* lhs,
+                            const typename Traits::PackedRhs* rhs,
+                            const int32_t* column_sums, int64_t groups,
+                            typename Traits::Output* out, int64_t ldc,
+                            int64_t rows, int64_t cols);
+
+__attribute__((target("avx512f"))) __mmask16 RowMask(int64_t rows) {
+  if (rows >= 16) return 0xFFFF;
+  if (rows <= 0) return 0;
+  return static_cast<__mmask16>((1u << rows) - 1);
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vnni"))) void Avx512TileS8S32(
+    const uint8_t* lhs, const int8_t* rhs, const int32_t* column_sums,
+    int64_t groups, int32_t* out, int64_t ldc, int64_t rows, int64_t cols) {
+  __m512i acc[2][kCols];
+  for (int64_t c = 0; c < kCols; ++c) {
+    acc[0][c] = _mm512_setzero_si512();
+    acc[1][c] = _mm512_setzero_si512();
+  }
+  for (int64_t g = 0; g < groups; ++g) {
+    const __m512i a0 = _mm512_loadu_si512(lhs + g * kRows * 4);
+    const __m512i a1 = _mm512_loadu_si512(lhs + g * kRows * 4 + 64);
+    const int8_t* b = rhs + g * kCols * 4;
+    for (int64_t c = 0; c < kCols; ++c) {
+      int32_t b_group;
+      std::memcpy(&b_group, b + c * 4, sizeof(b_group));
+      const __m512i b_value = _mm512_set1_epi32(b_group);
+      acc[0][c] = _mm512_dpbusd_epi32(acc[0][c], a0, b_value);
+      acc[1][c] = _mm512_dpbusd_epi32(acc[1][c], a1, b_value);
+    }
+  }
+  const __mmask16 mask0 = RowMask(rows);
+  const __mmask16 mask1 = RowMask(rows - 16);
+  for (int64_t c = 0; c < cols; ++c) {
+    const __m512i offset = _mm512_set1_epi32(
+        static_cast<int32_t>(static_cast<uint32_t>(column_sums[c]) << 7));
+    _mm512_mask_storeu_epi32(out + c * ldc, mask0,
+                             _mm512_sub_epi32(acc[0][c], offset));
+    _mm512_mask_storeu_epi32(out + c * ldc + 16, mask1,
+                             _mm512_sub_epi32(acc[1][c], offset));
+  }
+}
+
+__attribute__((target("avx512f,avx512bf16"))) void Avx512TileBF16F32(
+    const uint16_t* lhs, const uint16_t* rhs, const int32_t* /*column_sums*/,
+    int64_t groups, float* out, int64_t ldc, int64_t rows, int64_t cols) {
+  __m512 acc[2][kCols];
+  for (int64_t c = 0; c < kCols; ++c) {
+    acc[0][c] = _mm512_setzero_ps();
+    acc[1][c] = _mm512_setzero_ps();
+  }
+  for (int64_t g = 0; g < groups; ++g) {
+    const __m512bh a0 = (__m512bh)_mm512_loadu_si512(lhs + g * kRows * 2);
+    const __m512bh a1 =
+        (__m512bh)_mm512_loadu_si512(lhs + g * kRows * 2 + 32);
+    const uint16_t* b = rhs + g * kCols * 2;
+    for (int64_t c = 0; c < kCols; ++c) {
+      int32_t b_group;
+      std::memcpy(&b_group, b + c * 2, sizeof(b_group));
+      const __m512bh b_value = (__m512bh)_mm512_set1_epi32(b_group);
+      acc[0][c] = _mm512_dpbf16_ps(acc[0][c], a0, b_value);
+      acc[1][c] = _mm512_dpbf16_ps(acc[1][c], a1, b_value);
+    }
+  }
+  const __mmask16 mask0 = RowMask(rows);
+  const __mmask16 mask1 = RowMask(rows - 16);
+  for (int64_t c = 0; c < cols; ++c) {
+    _mm512_mask_storeu_ps(out + c * ldc, mask0, acc[0][c]);
+    _mm512_mask_storeu_ps(out + c * ldc + 16, mask1, acc[1][c]);
+  }
+}
+
+// Runs fn(i) for i in [0, n), on the intra-op thread pool if there is one.
+template <typename Fn>
+void ParallelFor(const void* run_options_ptr, int64_t n,
+                 const Eigen::TensorOpCost& cost, Fn fn) {
+  const xla::ExecutableRunOptions* run_options =
+      static_cast<const xla::ExecutableRunOptions*>(run_options_ptr);
+  auto run_range = [&](Eigen::Index begin, Eigen::Index end) {
+    for (Eigen::Index i = begin; i < end; ++i) fn(i);
+  };
+  if (run_options == nullptr ||
+      run_options->intra_op_thread_pool() == nullptr || n <= 1) {
+    run_range(0, n);
+    return;
+  }
+  run_options->intra_op_thread_pool()->parallelFor(n, cost, run_range);
+}
+
+template <typename Traits>
+void TiledMatMul(TileKernel<Traits> tile_kernel, const void* run_options_ptr,
+                 typename Traits::Output* out,
+                 const typename Traits::Input* lhs,
+                 const typename Traits::Input* rhs, int64_t m, int64_t n,
+                 int64_t k, bool transpose_lhs, bool transpose_rhs) {
+  if (m == 0 || n == 0) return;
+  constexpr int64_t kGroup = Traits::kGroup;
+  Problem<Traits> problem{lhs,           rhs,
+                          m,             n,
+                          k,             transpose_lhs,
+                          transpose_rhs, CeilOfRatio(k, kGroup)};
+  const int64_t lhs_panels = CeilOfRatio(m, kRows);
+  const int64_t rhs_panels = CeilOfRatio(n, kCols);
+  const int64_t lhs_panel_size = problem.groups * kRows * kGroup;
+  const int64_t rhs_panel_size = problem.groups * kCols * kGroup;
+
+  std::vector<typename Traits::PackedLhs> packed_lhs(lhs_panels *
+                                                     lhs_panel_size);
+  std::vector<typename Traits::PackedRhs> packed_rhs(rhs_panels *
+                                                     rhs_panel_size);
+  std::vector<int32_t> column_sums(rhs_panels * kCols);
+
+  ParallelFor(
+      run_options_ptr, lhs_panels + rhs_panels,
+      Eigen::TensorOpCost(/*bytes_loaded=*/kRows * k * sizeof(*lhs),
+                          /*bytes_stored=*/lhs_panel_size,
+                          /*compute_cycles=*/kRows * k),
+      [&](int64_t i) {
+        if (i < lhs_panels) {
+          PackLhsPanel(problem, i * kRows,
+                       packed_lhs.data() + i * lhs_panel_size);
+          return;
+        }
+        i -= lhs_panels;
+        PackRhsPanel(problem, i * kCols, packed_rhs.data() + i * rhs_panel_size,
+                     column_sums.data() + i * kCols);
+      });
+
+  const int64_t row_blocks = CeilOfRatio(m, kBlockRows);
+  const int64_t col_blocks = CeilOfRatio(n, kBlockCols);
+  ParallelFor(
+      run_options_ptr, row_blocks * col_blocks,
+      Eigen::TensorOpCost(
+          /*bytes_loaded=*/(kBlockRows + kBlockCols) * k * sizeof(*lhs),
+          /*bytes_stored=*/kBlockRows * kBlockCols * sizeof(*out),
+          /*compute_cycles=*/kBlockRows * kBlockCols * k / 16.0),
+      [&](int64_t block) {
+        const int64_t row_begin = (block % row_blocks) * kBlockRows;
+        const int64_t col_begin = (block / row_blocks) * kBlockCols;
+        const int64_t row_end = std::min(m, row_begin + kBlockRows);
+        const int64_t col_end = std::min(n, col_begin + kBlockCols);
+        for (int64_t row = row_begin; row < row_end; row += kRows) {
+          for (int64_t col = col_begin; col < col_end; col += kCols) {
+            tile_kernel(packed_lhs.data() + (row / kRows) * lhs_panel_size,
+                        packed_rhs.data() + (col / kCols) * rhs_panel_size,
+                        column_sums.data() + col, problem.groups,
+                        out + row + col * m, m, std::min(kRows, m - row),
+                        std::min(kCols, n - col));
+          }
+        }
+      });
+}
+
+#endif  // XLA_CPU_LOW_PRECISION_MATMUL_AVX512
+
+// Multiplies copies of the operands widened to the output type with Eigen,
+// which is what the dot would have been upcast to without these kernels.
+template <typename Traits>
+void EigenMatMul(const void* run_options_ptr, typename Traits::Output* out,
+                 const typename Traits::Input* lhs,
+                 const typename Traits::Input* rhs, int64_t m, int64_t n,
+                 int64_t k, bool transpose_lhs, bool transpose_rhs) {
+  using Output = typename Traits::Output;
+  if (k == 0) {
+    std::fill_n(out, m * n, Output{0});
+    return;
+  }
+  const std::vector<Output> wide_lhs(lhs, lhs + m * k);
+  const std::vector<Output> wide_rhs(rhs, rhs + k * n);
+  const Eigen::TensorMap<Eigen::Tensor<const Output, 2>> A(
+      wide_lhs.data(), transpose_lhs ? k : m, transpose_lhs ? m : k);
+  const Eigen::TensorMap<Eigen::Tensor<const Output, 2>> B(
+      wide_rhs.data(), transpose_rhs ? n : k, transpose_rhs ? k : n);
+  Eigen::TensorMap<Eigen::Tensor<Output, 2>> C(out, m, n);
+
+  typedef typename Eigen::Tensor<Output, 2>::DimensionPair DimPair;
+  const Eigen::array<DimPair, 1> dims(
+      {DimPair(transpose_lhs ? 0 : 1, transpose_rhs ? 1 : 0)});
+  const xla::ExecutableRunOptions* run_options =
+      static_cast<const xla::ExecutableRunOptions*>(run_options_ptr);
+  if (run_options != nullptr &&
+      run_options->intra_op_thread_pool() != nullptr) {
+    C.device(*run_options->intra_op_thread_pool()) = A.contract(B, dims);
+  } else {
+    C = A.contract(B, dims);
+  }
+}
+
+}  // namespace
+
+bool HasAvx512S8S32Kernel() {
+#if defined(XLA_CPU_LOW_PRECISION_MATMUL_AVX512)
+  static const bool supported =
+      tsl::port::TestCPUFeature(tsl::port::CPUFeature::AVX512F) &&
+      tsl::port::TestCPUFeature(tsl::port::CPUFeature::AVX512BW) &&
+      tsl::port::TestCPUFeature(tsl::port::CPUFeature::AVX512_VNNI);
+  return supported;
+#else
+  return false;
+#endif
+}
+
+bool HasAvx512BF16F32Kernel() {
+#if defined(XLA_CPU_LOW_PRECISION_MATMUL_AVX512)
+  static const bool supported =
+      tsl::port::TestCPUFeature(tsl::port::CPUFeature::AVX512F) &&
+      tsl::port::TestCPUFeature(tsl::port::CPUFeature::AVX512_BF16);
+  return supported;
+#else
+  return false;
+#endif
+}
+
+void MatMulS8S32(LowPrecisionMatMulKernel kernel, const void* run_options_ptr,
+                 int32_t* out, const int8_t* lhs, const int8_t* rhs, int64_t m,
+                 int64_t n, int64_t k, bool transpose_lhs, bool transpose_rhs) {
+#if defined(XLA_CPU_LOW_PRECISION_MATMUL_AVX512)
+  if (kernel == LowPrecisionMatMulKernel::kAvx512 && HasAvx512S8S32Kernel()) {
+    TiledMatMul<S8S32>(&Avx512TileS8S32, run_options_ptr, out, lhs, rhs, m, n,
+                       k, transpose_lhs, transpose_rhs);
+    return;
+  }
+#endif
+  EigenMatMul<S8S32>(run_options_ptr, out, lhs, rhs, m, n, k, transpose_lhs,
+                     transpose_rhs);
+}
+
+void MatMulBF16F32(LowPrecisionMatMulKernel kernel,
+                   const void* run_options_ptr, float* out,
+                   const Eigen::bfloat16* lhs, const Eigen::bfloat16* rhs,
+                   int64_t m, int64_t n, int64_t k, bool transpose_lhs,
+                   bool transpose_rhs) {
+#if defined(XLA_CPU_LOW_PRECISION_MATMUL_AVX512)
+  if (kernel == LowPrecisionMatMulKernel::kAvx512 &&
+      HasAvx512BF16F32Kernel()) {
+    TiledMatMul<BF16F32>(&Avx512TileBF16F32, run_options_ptr, out, lhs, rhs, m,
+                         n, k, transpose_lhs, transpose_rhs);
+    return;
+  }
+#endif
+  EigenMatMul<BF16F32>(run_options_ptr, out, lhs, rhs, m, n, k, transpose_lhs,
+                       transpose_rhs);
+}
+
+}  // namespace internal
+}  // namespace cpu
+}  // namespace xla
+
+using xla::cpu::internal::LowPrecisionMatMulKernel;
+
+ABSL_ATTRIBUTE_NO_SANITIZE_MEMORY void __xla_cpu_runtime_MatMulS8S32(
+    const void* run_options_ptr, int32_t* out, int8_t* lhs, int8_t* rhs,
+    int64_t m, int64_t n, int64_t k, int32_t transpose_lhs,
+    int32_t transpose_rhs) {
+  xla::cpu::internal::MatMulS8S32(LowPrecisionMatMulKernel::kAvx512,
+                                  run_options_ptr, out, lhs, rhs, m, n, k,
+                                  transpose_lhs, transpose_rhs);
+}
+
+ABSL_ATTRIBUTE_NO_SANITIZE_MEMORY void __xla_cpu_runtime_MatMulBF16F32(
+    const void* run_options_ptr, float* out, Eigen::bfloat16* lhs,
+    Eigen::bfloat16* rhs, int64_t m, int64_t n, int64_t k,
+    int32_t transpose_lhs, int32_t transpose_rhs) {
+  xla::cpu::internal::MatMulBF16F32(LowPrecisionMatMulKernel::kAvx512,
+                                    run_options_ptr, out, lhs, rhs, m, n, k,
+                                    transpose_lhs, transpose_rhs);
+}
@@ -0,0 +1,74 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_COMPILER_XLA_SERVICE_CPU_RUNTIME_LOW_PRECISION_MATMUL_H_
+#define TENSORFLOW_COMPILER_XLA_SERVICE_CPU_RUNTIME_LOW_PRECISION_MATMUL_H_
+
+#include <stdint.h>
+
+#include "third_party/eigen3/Eigen/Core"
+
+extern "C" {
+
+// Matrix multiplications with narrow inputs and a wide accumulator, which
+// Eigen's contraction would otherwise have to run on upcast copies of the
+// inputs. As with __xla_cpu_runtime_EigenMatMulF32, 'lhs' is m x k, 'rhs' is
+// k x n and 'out' is m x n, all in column-major order.
+//
+// The AVX512-VNNI (s8) and AVX512-BF16 (bf16) dot product instructions are
+// used when the CPU supports them. Otherwise the inputs are widened to the
+// output type and multiplied with Eigen. Work is split over the intra-op
+// thread pool of 'run_options_ptr' if it is not null.
+extern void __xla_cpu_runtime_MatMulS8S32(
+    const void* /* xla::ExecutableRunOptions* */ run_options_ptr, int32_t* out,
+    int8_t* lhs, int8_t* rhs, int64_t m, int64_t n, int64_t k,
+    int32_t transpose_lhs, int32_t transpose_rhs);
+
+// bf16 products are accumulated in f32 and may be computed with denormal
+// inputs and outputs flushed to zero, as the AVX512-BF16 instructions do.
+extern void __xla_cpu_runtime_MatMulBF16F32(
+    const void* /* xla::ExecutableRunOptions* */ run_options_ptr, float* out,
+    Eigen::bfloat16* lhs, Eigen::bfloat16* rhs, int64_t m, int64_t n,
+    int64_t k, int32_t transpose_lhs, int32_t transpose_rhs);
+}  // extern "C"
+
+namespace xla {
+namespace cpu {
+namespace internal {
+
+// The kernels behind the runtime functions above, exposed so that tests can
+// run the Eigen fallback on CPUs with the AVX512 extensions too.
+enum class LowPrecisionMatMulKernel { kEigen, kAvx512 };
+
+// Returns whether this binary and CPU support the AVX512 kernel of
+// MatMulS8S32 and MatMulBF16F32 respectively.
+bool HasAvx512S8S32Kernel();
+bool HasAvx512BF16F32Kernel();
+
+void MatMulS8S32(LowPrecisionMatMulKernel kernel, const void* run_options_ptr,
+                 int32_t* out, const int8_t* lhs, const int8_t* rhs, int64_t m,
+                 int64_t n, int64_t k, bool transpose_lhs, bool transpose_rhs);
+
+void MatMulBF16F32(LowPrecisionMatMulKernel kernel,
+                   const void* run_options_ptr, float* out,
+                   const Eigen::bfloat16* lhs, const Eigen::bfloat16* rhs,
+                   int64_t m, int64_t n, int64_t k, bool transpose_lhs,
+                   bool transpose_rhs);
+
+}  // namespace internal
+}  // namespace cpu
+}  // namespace xla
+
+#endif  // TENSORFLOW_COMPILER_XLA_SERVICE_CPU_RUNTIME_LOW_PRECISION_MATMUL_H_
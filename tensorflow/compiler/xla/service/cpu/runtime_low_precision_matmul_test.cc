@@ -0,0 +1,244 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#define EIGEN_USE_THREADS
+#include "tensorflow/compiler/xla/service/cpu/runtime_low_precision_matmul.h"
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
+#include "tensorflow/compiler/xla/executable_run_options.h"
+#include "tensorflow/compiler/xla/service/cpu/runtime_matmul.h"
+#include "tensorflow/tsl/platform/cpu_info.h"
+#include "tensorflow/tsl/platform/env.h"
+#include "tensorflow/tsl/platform/test.h"
+#include "tensorflow/tsl/platform/test_benchmark.h"
+#include "tensorflow/tsl/platform/threadpool.h"
+
+namespace xla {
+namespace cpu {
+namespace internal {
+namespace {
+
+// Returns the kernels that can run on this CPU.
+std::vector<LowPrecisionMatMulKernel> Kernels(bool has_avx512_kernel) {
+  std::vector<LowPrecisionMatMulKernel> kernels = {
+      LowPrecisionMatMulKernel::kEigen};
+  if (has_avx512_kernel) kernels.push_back(LowPrecisionMatMulKernel::kAvx512);
+  return kernels;
+}
+
+// Returns element (i, j) of the column-major rows x cols matrix `data`, or of
+// its transpose if `transpose` is set.
+template <typename T>
+double Element(const std::vector<T>& data, int64_t rows, int64_t cols,
+               int64_t i, int64_t j, bool transpose) {
+  return static_cast<double>(transpose ? data[j + i * cols]
+                                       : data[i + j * rows]);
+}
+
+template <typename T>
+std::vector<double> ReferenceMatMul(const std::vector<T>& lhs,
+                                    const std::vector<T>& rhs, int64_t m,
+                                    int64_t n, int64_t k, bool transpose_lhs,
+                                    bool transpose_rhs) {
+  std::vector<double> out(m * n);
+  for (int64_t i = 0; i < m; ++i) {
+    for (int64_t j = 0; j < n; ++j) {
+      double sum = 0;
+      for (int64_t p = 0; p < k; ++p) {
+        sum += Element(lhs, m, k, i, p, transpose_lhs) *
+               Element(rhs, k, n, p, j, transpose_rhs);
+      }
+      out[i + j * m] = sum;
+    }
+  }
+  return out;
+}
+
+class LowPrecisionMatMulTest : public ::testing::Test {
+ protected:
+  LowPrecisionMatMulTest()
+      : pool_(tsl::Env::Default(), "XLAEigen", /*num_threads=*/4),
+        device_(pool_.AsEigenThreadPool(), pool_.NumThreads()) {
+    run_options_.set_intra_op_thread_pool(&device_);
+  }
+
+  // Sizes around the tile and block sizes of the kernels, and around the
+  // number of values the dot product instructions reduce at once.
+  static std::vector<int64_t> Sizes() {
+    return {1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 65, 257};
+  }
+
+  tsl::thread::ThreadPool pool_;
+  Eigen::ThreadPoolDevice device_;
+  ExecutableRunOptions run_options_;
+};
+
+TEST_F(LowPrecisionMatMulTest, S8S32MatchesReference) {
+  std::mt19937 generator(0);
+  std::uniform_int_distribution<int> distribution(-128, 127);
+  for (LowPrecisionMatMulKernel kernel : Kernels(HasAvx512S8S32Kernel())) {
+    for (int64_t m : Sizes()) {
+      for (int64_t n : {1, 2, 7, 8, 9, 63, 64, 65}) {
+        for (int64_t k : {1, 2, 3, 4, 5, 63, 300}) {
+          std::vector<int8_t> lhs(m * k);
+          std::vector<int8_t> rhs(k * n);
+          for (int8_t& x : lhs) x = distribution(generator);
+          for (int8_t& x : rhs) x = distribution(generator);
+          for (bool transpose_lhs : {false, true}) {
+            for (bool transpose_rhs : {false, true}) {
+              std::vector<double> expected = ReferenceMatMul(
+                  lhs, rhs, m, n, k, transpose_lhs, transpose_rhs);
+              std::vector<int32_t> out(m * n, -1);
+              MatMulS8S32(kernel, &run_options_, out.data(), lhs.data(),
+                          rhs.data(), m, n, k, transpose_lhs, transpose_rhs);
+              for (int64_t i = 0; i < m * n; ++i) {
+                ASSERT_EQ(out[i], expected[i])
+                    << "kernel " << static_cast<int>(kernel) << " m " << m
+                    << " n " << n << " k " << k << " transpose "
+                    << transpose_lhs << transpose_rhs << " at " << i;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST_F(LowPrecisionMatMulTest, S8S32ExtremeValues) {
+  const int64_t m = 40, n = 9, k = 1000;
+  std::vector<int8_t> lhs(m * k, -128);
+  std::vector<int8_t> rhs(k * n, -128);
+  for (int64_t i = 0; i < k; i += 3) rhs[i] = 127;
+  std::vector<double> expected = ReferenceMatMul(lhs, rhs, m, n, k, false,
+                                                 false);
+  for (LowPrecisionMatMulKernel kernel : Kernels(HasAvx512S8S32Kernel())) {
+    std::vector<int32_t> out(m * n);
+    MatMulS8S32(kernel, nullptr, out.data(), lhs.data(), rhs.data(), m, n, k,
+                false, false);
+    for (int64_t i = 0; i < m * n; ++i) ASSERT_EQ(out[i], expected[i]) << i;
+  }
+}
+
+TEST_F(LowPrecisionMatMulTest, BF16F32MatchesReference) {
+  std::mt19937 generator(0);
+  std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+  for (LowPrecisionMatMulKernel kernel : Kernels(HasAvx512BF16F32Kernel())) {
+    for (int64_t m : Sizes()) {
+      for (int64_t n : {1, 2, 7, 8, 9, 63, 64, 65}) {
+        for (int64_t k : {1, 2, 3, 4, 5, 63, 300}) {
+          std::vector<Eigen::bfloat16> lhs(m * k);
+          std::vector<Eigen::bfloat16> rhs(k * n);
+          for (auto& x : lhs) x = Eigen::bfloat16(distribution(generator));
+          for (auto& x : rhs) x = Eigen::bfloat16(distribution(generator));
+          for (bool transpose_lhs : {false, true}) {
+            for (bool transpose_rhs : {false, true}) {
+              std::vector<double> expected = ReferenceMatMul(
+                  lhs, rhs, m, n, k, transpose_lhs, transpose_rhs);
+              std::vector<float> out(m * n, NAN);
+              MatMulBF16F32(kernel, &run_options_, out.data(), lhs.data(),
+                            rhs.data(), m, n, k, transpose_lhs,
+                            transpose_rhs);
+              for (int64_t i = 0; i < m * n; ++i) {
+                // The products are exact in f32, so the error is that of
+                // summing k values of magnitude at most 1 in f32.
+                ASSERT_NEAR(out[i], expected[i], 1e-6 * k)
+                    << "kernel " << static_cast<int>(kernel) << " m " << m
+                    << " n " << n << " k " << k << " transpose "
+                    << transpose_lhs << transpose_rhs << " at " << i;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST_F(LowPrecisionMatMulTest, EmptyContraction) {
+  std::vector<int32_t> s32_out(6, -1);
+  MatMulS8S32(LowPrecisionMatMulKernel::kEigen, &run_options_,
+              s32_out.data(), nullptr, nullptr, /*m=*/2, /*n=*/3, /*k=*/0,
+              false, false);
+  EXPECT_EQ(s32_out, std::vector<int32_t>(6, 0));
+  std::vector<float> f32_out(6, NAN);
+  __xla_cpu_runtime_MatMulBF16F32(&run_options_, f32_out.data(), nullptr,
+                                  nullptr, /*m=*/2, /*n=*/3, /*k=*/0, 0, 0);
+  EXPECT_EQ(f32_out, std::vector<float>(6, 0.0f));
+}
+
+// Performance benchmarks below.
+
+// Multiplies square matrices of size `size` with the s8 (`type` = 0) or bf16
+// (`type` = 1) kernels, or with Eigen in f32 (`type` = 2), which is what bf16
+// dots are upcast to without them.
+void BM_LowPrecisionMatMul(::testing::benchmark::State& state) {
+  const int64_t size = state.range(0);
+  const int type = state.range(1);
+
+  tsl::thread::ThreadPool pool(tsl::Env::Default(), "XLAEigen",
+                               tsl::port::MaxParallelism());
+  Eigen::ThreadPoolDevice device(pool.AsEigenThreadPool(), pool.NumThreads());
+  ExecutableRunOptions run_options;
+  run_options.set_intra_op_thread_pool(&device);
+
+  std::vector<int8_t> s8(size * size, 3);
+  std::vector<int32_t> s32(size * size);
+  std::vector<Eigen::bfloat16> bf16(size * size, Eigen::bfloat16(0.5f));
+  std::vector<float> f32(size * size, 0.5f);
+  std::vector<float> f32_out(size * size);
+
+  for (auto s : state) {
+    switch (type) {
+      case 0:
+        __xla_cpu_runtime_MatMulS8S32(&run_options, s32.data(), s8.data(),
+                                      s8.data(), size, size, size, 0, 0);
+        break;
+      case 1:
+        __xla_cpu_runtime_MatMulBF16F32(&run_options, f32_out.data(),
+                                        bf16.data(), bf16.data(), size, size,
+                                        size, 0, 0);
+        break;
+      default:
+        __xla_cpu_runtime_EigenMatMulF32(&run_options, f32_out.data(),
+                                         f32.data(), f32.data(), size, size,
+                                         size, 0, 0);
+    }
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * 2 * size *
+                          size * size);
+}
+
+BENCHMARK(BM_LowPrecisionMatMul)
+    ->UseRealTime()
+    ->Args({64, 0})
+    ->Args({64, 1})
+    ->Args({64, 2})
+    ->Args({512, 0})
+    ->Args({512, 1})
+    ->Args({512, 2})
+    ->Args({2048, 0})
+    ->Args({2048, 1})
+    ->Args({2048, 2});
+
+}  // namespace
+}  // namespace internal
+}  // namespace cpu
+}  // namespace xla
@@ -40,9 +40,12 @@ limitations under the License.
 #include "tensorflow/compiler/xla/service/cpu/runtime_conv3d.h"
 #include "tensorflow/compiler/xla/service/cpu/runtime_custom_call_status.h"
 #include "tensorflow/compiler/xla/service/cpu/runtime_fft.h"
+#include "tensorflow/compiler/xla/service/cpu/runtime_flash_attention.h"
 #include "tensorflow/compiler/xla/service/cpu/runtime_fork_join.h"
 #include "tensorflow/compiler/xla/service/cpu/runtime_fp16.h"
 #include "tensorflow/compiler/xla/service/cpu/runtime_key_value_sort.h"
+#include "tensorflow/compiler/xla/service/cpu/runtime_low_precision_conv2d.h"
+#include "tensorflow/compiler/xla/service/cpu/runtime_low_precision_matmul.h"
 #include "tensorflow/compiler/xla/service/cpu/runtime_matmul.h"
 #include "tensorflow/compiler/xla/service/cpu/runtime_matmul_acl.h"
 #include "tensorflow/compiler/xla/service/cpu/runtime_matmul_mkl.h"
@@ -105,7 +108,8 @@ SimpleOrcJIT::SimpleOrcJIT(
     bool disable_expensive_passes, llvm::FastMathFlags fast_math_flags,
     LLVMCompiler::ModuleHook pre_optimization_hook,
     LLVMCompiler::ModuleHook post_optimization_hook,
-    std::function<void(const llvm::object::ObjectFile&)> post_codegen_hook)
+    std::function<void(const llvm::object::ObjectFile&)> post_codegen_hook,
+    const std::string& object_cache_dir)
     : target_machine_(InferTargetMachineForJIT(target_options, opt_level)),
       target_triple_(target_machine_->getTargetTriple()),
       data_layout_(target_machine_->createDataLayout()),
@@ -122,7 +126,9 @@ SimpleOrcJIT::SimpleOrcJIT(
               target_machine_.get(), opt_level, optimize_for_size,
               disable_expensive_passes, fast_math_flags,
               std::move(pre_optimization_hook),
-              std::move(post_optimization_hook), std::move(post_codegen_hook))),
+              std::move(post_optimization_hook), std::move(post_codegen_hook),
+              /*dfsan_enabled=*/false, /*dfsan_abi_list_files=*/{},
+              object_cache_dir)),
       main_jit_dylib_(&execution_session_->createBareJITDylib("<main>")),
       gdb_jit_event_listener_(
           llvm::JITEventListener::createGDBRegistrationListener()),
@@ -181,7 +187,8 @@ llvm::Expected<std::unique_ptr<SimpleOrcJIT>> SimpleOrcJIT::Create(
     bool disable_expensive_passes, llvm::FastMathFlags fast_math_flags,
     LLVMCompiler::ModuleHook pre_optimization_hook,
     LLVMCompiler::ModuleHook post_optimization_hook,
-    std::function<void(const llvm::object::ObjectFile&)> post_codegen_hook) {
+    std::function<void(const llvm::object::ObjectFile&)> post_codegen_hook,
+    const std::string& object_cache_dir) {
   auto SSP = std::make_shared<llvm::orc::SymbolStringPool>();
   auto target_process_control =
       llvm::orc::SelfExecutorProcessControl::Create(std::move(SSP));
@@ -195,7 +202,8 @@ llvm::Expected<std::unique_ptr<SimpleOrcJIT>> SimpleOrcJIT::Create(
       std::move(*target_process_control), std::move(execution_session),
       target_options, opt_level, optimize_for_size, disable_expensive_passes,
       fast_math_flags, std::move(pre_optimization_hook),
-      std::move(post_optimization_hook), std::move(post_codegen_hook));
+      std::move(post_optimization_hook), std::move(post_codegen_hook),
+      object_cache_dir);
 }
 
 llvm::JITEvaluatedSymbol SimpleOrcJIT::ResolveRuntimeSymbol(
@@ -321,6 +329,11 @@ bool RegisterKnownJITSymbols() {
   REGISTER_CPU_RUNTIME_SYMBOL(StatusIsSuccess);
   REGISTER_CPU_RUNTIME_SYMBOL(KeyValueSort);
   REGISTER_CPU_RUNTIME_SYMBOL(TopKF32);
+  REGISTER_CPU_RUNTIME_SYMBOL(FlashAttentionF32);
+  REGISTER_CPU_RUNTIME_SYMBOL(MatMulS8S32);
+  REGISTER_CPU_RUNTIME_SYMBOL(MatMulBF16F32);
+  REGISTER_CPU_RUNTIME_SYMBOL(ConvS8S32);
+  REGISTER_CPU_RUNTIME_SYMBOL(ConvBF16F32);
   REGISTER_CPU_RUNTIME_SYMBOL(TracingStart);
   REGISTER_CPU_RUNTIME_SYMBOL(TracingEnd);
 
@@ -52,7 +52,8 @@ class SimpleOrcJIT : public llvm::JITEventListener {
   //
   // {pre,post}_optimization_hook is invoked on the module before/after all
   // LLVM IR-level optimizations.  post_codegen_hook is invoked after
-  // compiling to machine code.
+  // compiling to machine code.  If object_cache_dir is not empty, object files
+  // are cached there across processes (see CompilerFunctor).
   SimpleOrcJIT(
       std::unique_ptr<llvm::orc::ExecutorProcessControl> target_process_control,
       std::unique_ptr<llvm::orc::ExecutionSession> execution_session,
@@ -61,7 +62,8 @@ class SimpleOrcJIT : public llvm::JITEventListener {
       bool disable_expensive_passes, llvm::FastMathFlags fast_math_flags,
       LLVMCompiler::ModuleHook pre_optimization_hook,
       LLVMCompiler::ModuleHook post_optimization_hook,
-      std::function<void(const llvm::object::ObjectFile&)> post_codegen_hook);
+      std::function<void(const llvm::object::ObjectFile&)> post_codegen_hook,
+      const std::string& object_cache_dir = "");
 
   static llvm::Expected<std::unique_ptr<SimpleOrcJIT>> Create(
       const llvm::TargetOptions& target_options,
@@ -69,7 +71,8 @@ class SimpleOrcJIT : public llvm::JITEventListener {
       bool disable_expensive_passes, llvm::FastMathFlags fast_math_flags,
       LLVMCompiler::ModuleHook pre_optimization_hook,
       LLVMCompiler::ModuleHook post_optimization_hook,
-      std::function<void(const llvm::object::ObjectFile&)> post_codegen_hook);
+      std::function<void(const llvm::object::ObjectFile&)> post_codegen_hook,
+      const std::string& object_cache_dir = "");
 
   ~SimpleOrcJIT() override;
 
@@ -0,0 +1,92 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/compiler/xla/service/cpu/temp_buffer_pool.h"
+
+#include <utility>
+
+#include "tensorflow/tsl/platform/logging.h"
+#include "tensorflow/tsl/platform/mem.h"
+
+namespace xla {
+namespace cpu {
+
+TempBufferPool::Block::Block(Block&& other)
+    : pool_(std::exchange(other.pool_, nullptr)),
+      slot_(std::exchange(other.slot_, -1)),
+      data_(std::exchange(other.data_, nullptr)) {}
+
+TempBufferPool::Block& TempBufferPool::Block::operator=(Block&& other) {
+  if (this != &other) {
+    if (pool_ != nullptr) pool_->Release(slot_);
+    pool_ = std::exchange(other.pool_, nullptr);
+    slot_ = std::exchange(other.slot_, -1);
+    data_ = std::exchange(other.data_, nullptr);
+  }
+  return *this;
+}
+
+TempBufferPool::Block::~Block() {
+  if (pool_ != nullptr) pool_->Release(slot_);
+}
+
+TempBufferPool::TempBufferPool(int64_t block_size, int64_t alignment,
+                               int capacity)
+    : block_size_(block_size),
+      alignment_(alignment),
+      capacity_(capacity),
+      slots_(std::make_unique<Slot[]>(capacity)) {
+  CHECK_GT(block_size_, 0);
+  CHECK_GT(capacity_, 0);
+}
+
+TempBufferPool::~TempBufferPool() {
+  for (int i = 0; i < capacity_; ++i) {
+    CHECK(!slots_[i].in_use.load(std::memory_order_acquire))
+        << "Temp buffer pool destroyed while a block is checked out";
+    tsl::port::AlignedFree(slots_[i].data);
+  }
+}
+
+TempBufferPool::Block TempBufferPool::Acquire() {
+  for (int i = 0; i < capacity_; ++i) {
+    Slot& slot = slots_[i];
+    // Cheap check first so that contended executions don't all bounce the
+    // same cache line with failing exchanges.
+    if (slot.in_use.load(std::memory_order_relaxed)) continue;
+    bool expected = false;
+    if (!slot.in_use.compare_exchange_strong(expected, true,
+                                             std::memory_order_acquire)) {
+      continue;
+    }
+    if (slot.data == nullptr) {
+      slot.data = static_cast<char*>(
+          tsl::port::AlignedMalloc(block_size_, alignment_));
+      if (slot.data == nullptr) {
+        slot.in_use.store(false, std::memory_order_release);
+        return Block();
+      }
+    }
+    return Block(this, i, slot.data);
+  }
+  return Block();
+}
+
+void TempBufferPool::Release(int slot) {
+  slots_[slot].in_use.store(false, std::memory_order_release);
+}
+
+}  // namespace cpu
+}  // namespace xla
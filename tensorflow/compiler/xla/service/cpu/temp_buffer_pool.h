@@ -0,0 +1,91 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_COMPILER_XLA_SERVICE_CPU_TEMP_BUFFER_POOL_H_
+#define TENSORFLOW_COMPILER_XLA_SERVICE_CPU_TEMP_BUFFER_POOL_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace xla {
+namespace cpu {
+
+// A fixed number of equally sized memory blocks that concurrent executions of
+// one executable check out for their temp buffers, so that executing a small
+// computation does not allocate and free its temp buffers every time.
+//
+// Blocks are allocated the first time they are checked out and are kept
+// until the pool is destroyed. Checking out and returning a block are
+// lock-free.
+class TempBufferPool {
+ public:
+  // A block checked out of the pool. Returns the block to the pool when
+  // destroyed.
+  class Block {
+   public:
+    Block() = default;
+    Block(Block&& other);
+    Block& operator=(Block&& other);
+    ~Block();
+
+    // Returns null if no block was available.
+    char* data() const { return data_; }
+
+   private:
+    friend class TempBufferPool;
+    Block(TempBufferPool* pool, int slot, char* data)
+        : pool_(pool), slot_(slot), data_(data) {}
+
+    TempBufferPool* pool_ = nullptr;
+    int slot_ = -1;
+    char* data_ = nullptr;
+  };
+
+  // Creates a pool of at most `capacity` blocks of `block_size` bytes each,
+  // aligned to `alignment` bytes.
+  TempBufferPool(int64_t block_size, int64_t alignment, int capacity);
+  ~TempBufferPool();
+
+  // Checks out a free block. Returns a null block if all `capacity` blocks
+  // are checked out, in which case the caller should allocate its buffers
+  // itself.
+  Block Acquire();
+
+  int64_t block_size() const { return block_size_; }
+  int capacity() const { return capacity_; }
+
+ private:
+  struct Slot {
+    std::atomic<bool> in_use{false};
+    // Only accessed by the execution that holds `in_use`.
+    char* data = nullptr;
+  };
+
+  void Release(int slot);
+
+  const int64_t block_size_;
+  const int64_t alignment_;
+  const int capacity_;
+  std::unique_ptr<Slot[]> slots_;
+
+  TempBufferPool(const TempBufferPool&) = delete;
+  TempBufferPool& operator=(const TempBufferPool&) = delete;
+};
+
+}  // namespace cpu
+}  // namespace xla
+
+#endif  // TENSORFLOW_COMPILER_XLA_SERVICE_CPU_TEMP_BUFFER_POOL_H_
@@ -0,0 +1,124 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/compiler/xla/service/cpu/temp_buffer_pool.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "tensorflow/tsl/platform/blocking_counter.h"
+#include "tensorflow/tsl/platform/env.h"
+#include "tensorflow/tsl/platform/mem.h"
+#include "tensorflow/tsl/platform/test.h"
+#include "tensorflow/tsl/platform/test_benchmark.h"
+#include "tensorflow/tsl/platform/threadpool.h"
+
+namespace xla {
+namespace cpu {
+namespace {
+
+TEST(TempBufferPoolTest, ChecksOutUpToCapacity) {
+  TempBufferPool pool(/*block_size=*/1000, /*alignment=*/64, /*capacity=*/2);
+  TempBufferPool::Block a = pool.Acquire();
+  TempBufferPool::Block b = pool.Acquire();
+  ASSERT_NE(a.data(), nullptr);
+  ASSERT_NE(b.data(), nullptr);
+  EXPECT_NE(a.data(), b.data());
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(a.data()) % 64, 0);
+  EXPECT_EQ(pool.Acquire().data(), nullptr);
+}
+
+TEST(TempBufferPoolTest, ReusesReturnedBlocks) {
+  TempBufferPool pool(/*block_size=*/1000, /*alignment=*/64, /*capacity=*/1);
+  char* data;
+  {
+    TempBufferPool::Block block = pool.Acquire();
+    data = block.data();
+    ASSERT_NE(data, nullptr);
+  }
+  EXPECT_EQ(pool.Acquire().data(), data);
+
+  TempBufferPool::Block block = pool.Acquire();
+  TempBufferPool::Block moved = std::move(block);
+  EXPECT_EQ(block.data(), nullptr);  // NOLINT(bugprone-use-after-move)
+  EXPECT_EQ(moved.data(), data);
+  EXPECT_EQ(pool.Acquire().data(), nullptr);
+  moved = TempBufferPool::Block();
+  EXPECT_EQ(pool.Acquire().data(), data);
+}
+
+TEST(TempBufferPoolTest, ConcurrentCheckoutsAreExclusive) {
+  const int kCapacity = 4;
+  const int kThreads = 8;
+  const int kIterations = 1000;
+  const int64_t kBlockSize = 256;
+  TempBufferPool pool(kBlockSize, /*alignment=*/64, kCapacity);
+  tsl::thread::ThreadPool threads(tsl::Env::Default(), "test", kThreads);
+
+  std::atomic<int> failures{0};
+  tsl::BlockingCounter done(kThreads);
+  for (int t = 0; t < kThreads; ++t) {
+    threads.Schedule([&, t]() {
+      for (int i = 0; i < kIterations; ++i) {
+        TempBufferPool::Block block = pool.Acquire();
+        if (block.data() == nullptr) continue;
+        // Any other thread holding the same block would overwrite the marker.
+        std::memset(block.data(), t, kBlockSize);
+        for (int64_t j = 0; j < kBlockSize; ++j) {
+          if (block.data()[j] != static_cast<char>(t)) {
+            failures.fetch_add(1);
+            break;
+          }
+        }
+      }
+      done.DecrementCount();
+    });
+  }
+  done.Wait();
+  EXPECT_EQ(failures.load(), 0);
+}
+
+// Performance benchmarks below.
+
+// Compares checking temp memory out of a pool with allocating and freeing it.
+void BM_TempBufferCheckout(::testing::benchmark::State& state) {
+  const int64_t block_size = state.range(0);
+  const bool pooled = state.range(1);
+  TempBufferPool pool(block_size, /*alignment=*/64, /*capacity=*/1);
+  for (auto s : state) {
+    if (pooled) {
+      TempBufferPool::Block block = pool.Acquire();
+      tsl::testing::DoNotOptimize(block.data());
+    } else {
+      void* data = tsl::port::AlignedMalloc(block_size, 64);
+      tsl::testing::DoNotOptimize(data);
+      tsl::port::AlignedFree(data);
+    }
+  }
+}
+
+BENCHMARK(BM_TempBufferCheckout)
+    ->UseRealTime()
+    ->ArgPair(64 << 10, 0)
+    ->ArgPair(64 << 10, 1)
+    ->ArgPair(16 << 20, 0)
+    ->ArgPair(16 << 20, 1);
+
+}  // namespace
+}  // namespace cpu
+}  // namespace xla
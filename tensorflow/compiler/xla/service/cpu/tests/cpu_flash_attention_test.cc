@@ -0,0 +1,164 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_format.h"
+#include "tensorflow/compiler/xla/client/client_library.h"
+#include "tensorflow/compiler/xla/client/local_client.h"
+#include "tensorflow/compiler/xla/client/xla_computation.h"
+#include "tensorflow/compiler/xla/service/cpu/ir_emission_utils.h"
+#include "tensorflow/compiler/xla/service/cpu/tests/cpu_codegen_test.h"
+#include "tensorflow/compiler/xla/service/hlo_parser.h"
+#include "tensorflow/compiler/xla/service/platform_util.h"
+#include "tensorflow/compiler/xla/tests/test_utils.h"
+#include "tensorflow/tsl/platform/test.h"
+#include "tensorflow/tsl/platform/test_benchmark.h"
+
+namespace xla {
+namespace cpu {
+namespace {
+
+// Returns scaled dot-product attention over [batch, heads, seq, head_dim]
+// queries, keys and values, with the softmax written out the way frontends
+// emit it.
+std::string AttentionHlo(int64_t batch, int64_t heads, int64_t query_length,
+                         int64_t key_length, int64_t head_dim) {
+  return absl::StrFormat(R"(
+HloModule Attention
+
+max {
+  a = f32[] parameter(0)
+  b = f32[] parameter(1)
+  ROOT m = f32[] maximum(a, b)
+}
+
+add {
+  a = f32[] parameter(0)
+  b = f32[] parameter(1)
+  ROOT s = f32[] add(a, b)
+}
+
+ENTRY main {
+  q = f32[%1$d,%2$d,%3$d,%5$d] parameter(0)
+  k = f32[%1$d,%2$d,%4$d,%5$d] parameter(1)
+  v = f32[%1$d,%2$d,%4$d,%5$d] parameter(2)
+  qk = f32[%1$d,%2$d,%3$d,%4$d] dot(q, k), lhs_batch_dims={0,1},
+    rhs_batch_dims={0,1}, lhs_contracting_dims={3}, rhs_contracting_dims={3}
+  c = f32[] constant(%6$f)
+  c_b = f32[%1$d,%2$d,%3$d,%4$d] broadcast(c), dimensions={}
+  scores = f32[%1$d,%2$d,%3$d,%4$d] multiply(qk, c_b)
+  neg_inf = f32[] constant(-inf)
+  row_max = f32[%1$d,%2$d,%3$d] reduce(scores, neg_inf), dimensions={3},
+    to_apply=max
+  row_max_b = f32[%1$d,%2$d,%3$d,%4$d] broadcast(row_max), dimensions={0,1,2}
+  centered = f32[%1$d,%2$d,%3$d,%4$d] subtract(scores, row_max_b)
+  e = f32[%1$d,%2$d,%3$d,%4$d] exponential(centered)
+  zero = f32[] constant(0)
+  row_sum = f32[%1$d,%2$d,%3$d] reduce(e, zero), dimensions={3}, to_apply=add
+  row_sum_b = f32[%1$d,%2$d,%3$d,%4$d] broadcast(row_sum), dimensions={0,1,2}
+  probs = f32[%1$d,%2$d,%3$d,%4$d] divide(e, row_sum_b)
+  ROOT out = f32[%1$d,%2$d,%3$d,%5$d] dot(probs, v), lhs_batch_dims={0,1},
+    rhs_batch_dims={0,1}, lhs_contracting_dims={3}, rhs_contracting_dims={2}
+}
+)",
+                         batch, heads, query_length, key_length, head_dim,
+                         1.0 / std::sqrt(static_cast<double>(head_dim)));
+}
+
+using CpuFlashAttentionTest = CpuCodegenTest;
+
+TEST_F(CpuFlashAttentionTest, UsesFlashAttention) {
+  TF_ASSERT_OK_AND_ASSIGN(auto module,
+                          GetOptimizedModule(AttentionHlo(1, 2, 8, 8, 4)));
+  const HloInstruction* root = module->entry_computation()->root_instruction();
+  EXPECT_EQ(root->opcode(), HloOpcode::kCustomCall);
+  EXPECT_EQ(root->custom_call_target(), kFlashAttentionCustomCallTarget);
+}
+
+TEST_F(CpuFlashAttentionTest, MatchesReference) {
+  // Covers partial query and key blocks, and keys spanning several blocks.
+  EXPECT_TRUE(RunAndCompare(AttentionHlo(1, 1, 1, 1, 4), ErrorSpec{1e-5}));
+  EXPECT_TRUE(RunAndCompare(AttentionHlo(2, 3, 17, 33, 8), ErrorSpec{1e-5}));
+  EXPECT_TRUE(
+      RunAndCompare(AttentionHlo(1, 2, 130, 600, 16), ErrorSpec{1e-5, 1e-4}));
+}
+
+// Performance benchmarks below.
+
+// Runs attention over 8 heads of `seq_len` queries and keys, with and without
+// the flash attention rewrite.
+void BM_Attention(::testing::benchmark::State& state) {
+  const int64_t seq_len = state.range(0);
+  const bool flash_attention = state.range(1);
+  const int64_t batch = 1, heads = 8, head_dim = 64;
+
+  se::Platform* platform = PlatformUtil::GetDefaultPlatform().value();
+  LocalClient* client = ClientLibrary::GetOrCreateLocalClient(platform).value();
+
+  auto module =
+      ParseAndReturnUnverifiedModule(
+          AttentionHlo(batch, heads, seq_len, seq_len, head_dim))
+          .value();
+  std::vector<Literal> args = MakeFakeArguments(module.get()).value();
+  std::vector<ScopedShapedBuffer> arg_buffers;
+  std::vector<const Shape*> arg_shapes;
+  std::vector<const ShapedBuffer*> arg_ptrs;
+  for (const Literal& arg : args) {
+    arg_buffers.push_back(
+        client->LiteralToShapedBuffer(arg, client->default_device_ordinal())
+            .value());
+    arg_shapes.push_back(&arg.shape());
+  }
+  for (const ScopedShapedBuffer& buffer : arg_buffers) {
+    arg_ptrs.push_back(&buffer);
+  }
+
+  ExecutableBuildOptions build_options;
+  build_options.mutable_debug_options()->set_xla_cpu_enable_flash_attention(
+      flash_attention);
+  auto executables =
+      client->Compile(XlaComputation(module->ToProto()), arg_shapes,
+                      build_options)
+          .value();
+  auto executable = std::move(executables[0]);
+
+  ExecutableRunOptions options;
+  options.set_allocator(client->backend().memory_allocator());
+  // Warm up.
+  CHECK(executable->Run(arg_ptrs, options).ok());
+
+  for (auto s : state) {
+    CHECK(executable->Run(arg_ptrs, options).ok());
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * batch *
+                          heads * seq_len);
+}
+
+BENCHMARK(BM_Attention)
+    ->UseRealTime()
+    ->ArgPair(256, 0)
+    ->ArgPair(256, 1)
+    ->ArgPair(1024, 0)
+    ->ArgPair(1024, 1)
+    ->ArgPair(4096, 0)
+    ->ArgPair(4096, 1);
+
+}  // namespace
+}  // namespace cpu
+}  // namespace xla
@@ -14,6 +14,8 @@ limitations under the License.
 ==============================================================================*/
 
 #include <memory>
+#include <string>
+#include <utility>
 
 #include "tensorflow/compiler/xla/service/cpu/cpu_compiler.h"
 #include "tensorflow/compiler/xla/service/cpu/test_target_triple_helper.h"
@@ -23,7 +25,24 @@ namespace xla {
 namespace cpu {
 namespace {
 
-using CpuKeyValueSortTest = CpuCodegenTest;
+class CpuKeyValueSortTest : public CpuCodegenTest {
+ protected:
+  void CompileAndVerifyIr(const std::string& hlo_text,
+                          const std::string& filecheck_pattern) {
+    TF_ASSERT_OK_AND_ASSIGN(auto module,
+                            ParseAndReturnVerifiedModule(hlo_text));
+
+    CpuAotCompilationOptions options{
+        /*triple=*/kTargetTripleForHost, /*cpu_name=*/kTargetCpuForHost,
+        /*features=*/"",
+        /*entry_point_name=*/"entry",
+        /*relocation_model=*/CpuAotCompilationOptions::RelocationModel::Static};
+
+    CompileAheadOfTimeAndVerifyIr(std::move(module), options,
+                                  filecheck_pattern,
+                                  /*match_optimized_ir=*/true);
+  }
+};
 
 TEST_F(CpuKeyValueSortTest, SortR1) {
   const std::string hlo_text = R"(
@@ -42,20 +61,69 @@ ENTRY main {
 }
 )";
 
+  // The keys are compared directly as floats in ascending order.
   std::string filecheck_pattern = R"(
-CHECK: call void @__xla_cpu_runtime_KeyValueSort
+CHECK: call void @__xla_cpu_runtime_KeyValueSort({{.*}}, i32 3, i1 false)
 )";
 
-  TF_ASSERT_OK_AND_ASSIGN(auto module, ParseAndReturnVerifiedModule(hlo_text));
+  CompileAndVerifyIr(hlo_text, filecheck_pattern);
+}
+
+TEST_F(CpuKeyValueSortTest, DescendingArgsort) {
+  const std::string hlo_text = R"(
+HloModule KeyValueSort
+
+compare {
+  p.0.lhs = s32[] parameter(0)
+  p.0.rhs = s32[] parameter(1)
+  p.1.lhs = s32[] parameter(2)
+  p.1.rhs = s32[] parameter(3)
+  ROOT lt = pred[] compare(p.0.rhs, p.0.lhs), direction=LT
+}
+
+ENTRY main {
+  a = s32[10] parameter(0)
+  iota = s32[10] iota(), iota_dimension=0
+
+  ROOT result = (s32[10], s32[10]) sort(a, iota), dimensions={0},
+    to_apply=compare
+}
+)";
+
+  std::string filecheck_pattern = R"(
+CHECK: call void @__xla_cpu_runtime_KeyValueSort({{.*}}, i32 1, i1 true)
+)";
+
+  CompileAndVerifyIr(hlo_text, filecheck_pattern);
+}
 
-  CpuAotCompilationOptions options{
-      /*triple=*/kTargetTripleForHost, /*cpu_name=*/kTargetCpuForHost,
-      /*features=*/"",
-      /*entry_point_name=*/"entry",
-      /*relocation_model=*/CpuAotCompilationOptions::RelocationModel::Static};
+TEST_F(CpuKeyValueSortTest, ComparatorOnPayload) {
+  const std::string hlo_text = R"(
+HloModule KeyValueSort
+
+compare {
+  p.0.lhs = f32[] parameter(0)
+  p.0.rhs = f32[] parameter(1)
+  p.1.lhs = f32[] parameter(2)
+  p.1.rhs = f32[] parameter(3)
+  ROOT lt = pred[] compare(p.1.lhs, p.1.rhs), direction=LT
+}
+
+ENTRY main {
+  a = f32[10] parameter(0)
+  b = f32[10] parameter(1)
+
+  ROOT result = (f32[10], f32[10]) sort(a, b), dimensions={0},
+    to_apply=compare
+}
+)";
+
+  // The comparator does not only compare the keys, so it has to be called.
+  std::string filecheck_pattern = R"(
+CHECK: call void @__xla_cpu_runtime_KeyValueSort({{.*}}, i32 0, i1 false)
+)";
 
-  CompileAheadOfTimeAndVerifyIr(std::move(module), options, filecheck_pattern,
-                                /*match_optimized_ir=*/true);
+  CompileAndVerifyIr(hlo_text, filecheck_pattern);
 }
 
 }  // namespace
@@ -0,0 +1,98 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "tensorflow/compiler/xla/service/cpu/tests/cpu_codegen_test.h"
+#include "tensorflow/tsl/platform/test.h"
+
+namespace xla {
+namespace cpu {
+namespace {
+
+using CpuLowPrecisionConvolutionTest = CpuCodegenTest;
+
+constexpr char kS8Convolution[] = R"(
+HloModule S8Convolution
+
+ENTRY main {
+  input = s8[2,9,7,5] parameter(0)
+  kernel = s8[3,3,5,8] parameter(1)
+  ROOT conv = s32[2,5,4,8] convolution(input, kernel),
+    window={size=3x3 stride=2x2 pad=1_1x1_1}, dim_labels=b01f_01io->b01f
+}
+)";
+
+// In NCHW / OIHW form, which ConvCanonicalization transposes.
+constexpr char kBF16Convolution[] = R"(
+HloModule BF16Convolution
+
+ENTRY main {
+  input = bf16[1,16,8,8] parameter(0)
+  kernel = bf16[24,16,3,3] parameter(1)
+  ROOT conv = bf16[1,24,8,8] convolution(input, kernel),
+    window={size=3x3 pad=1_1x1_1}, dim_labels=bf01_oi01->bf01
+}
+)";
+
+TEST_F(CpuLowPrecisionConvolutionTest, S8ConvolutionIsNotUpcast) {
+  TF_ASSERT_OK_AND_ASSIGN(auto module, GetOptimizedModule(kS8Convolution));
+  const HloInstruction* conv = module->entry_computation()->root_instruction();
+  ASSERT_EQ(conv->opcode(), HloOpcode::kConvolution);
+  EXPECT_EQ(conv->operand(0)->shape().element_type(), S8);
+  EXPECT_EQ(conv->operand(1)->shape().element_type(), S8);
+
+  TF_ASSERT_OK_AND_ASSIGN(auto unoptimized,
+                          ParseAndReturnVerifiedModule(kS8Convolution));
+  CompileAndVerifyIr(std::move(unoptimized),
+                     "CHECK: call void @__xla_cpu_runtime_ConvS8S32",
+                     /*match_optimized_ir=*/true);
+}
+
+TEST_F(CpuLowPrecisionConvolutionTest, BF16ConvolutionAccumulatesInF32) {
+  TF_ASSERT_OK_AND_ASSIGN(auto module,
+                          ParseAndReturnVerifiedModule(kBF16Convolution));
+  CompileAndVerifyIr(std::move(module),
+                     "CHECK: call void @__xla_cpu_runtime_ConvBF16F32",
+                     /*match_optimized_ir=*/true);
+}
+
+TEST_F(CpuLowPrecisionConvolutionTest, GroupedConvolutionIsUpcast) {
+  TF_ASSERT_OK_AND_ASSIGN(auto module, ParseAndReturnVerifiedModule(R"(
+HloModule S8GroupedConvolution
+
+ENTRY main {
+  input = s8[1,8,8,16] parameter(0)
+  kernel = s8[3,3,8,16] parameter(1)
+  ROOT conv = s32[1,8,8,16] convolution(input, kernel),
+    window={size=3x3 pad=1_1x1_1}, dim_labels=b01f_01io->b01f,
+    feature_group_count=2
+}
+)"));
+  CompileAndVerifyIr(std::move(module),
+                     "CHECK-NOT: call void @__xla_cpu_runtime_ConvS8S32",
+                     /*match_optimized_ir=*/true);
+}
+
+TEST_F(CpuLowPrecisionConvolutionTest, MatchesReference) {
+  EXPECT_TRUE(RunAndCompare(kS8Convolution, ErrorSpec{0}));
+  EXPECT_TRUE(RunAndCompare(kBF16Convolution, ErrorSpec{1e-2, 1e-2}));
+}
+
+}  // namespace
+}  // namespace cpu
+}  // namespace xla
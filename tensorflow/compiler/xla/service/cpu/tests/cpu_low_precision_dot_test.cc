@@ -0,0 +1,96 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "tensorflow/compiler/xla/service/cpu/tests/cpu_codegen_test.h"
+#include "tensorflow/tsl/platform/test.h"
+
+namespace xla {
+namespace cpu {
+namespace {
+
+using CpuLowPrecisionDotTest = CpuCodegenTest;
+
+constexpr char kS8Dot[] = R"(
+HloModule S8Dot
+
+ENTRY main {
+  lhs = s8[64,32] parameter(0)
+  rhs = s8[32,16] parameter(1)
+  ROOT dot = s32[64,16] dot(lhs, rhs), lhs_contracting_dims={1},
+    rhs_contracting_dims={0}
+}
+)";
+
+constexpr char kBF16Dot[] = R"(
+HloModule BF16Dot
+
+ENTRY main {
+  lhs = bf16[48,40] parameter(0)
+  rhs = bf16[24,40] parameter(1)
+  ROOT dot = bf16[48,24] dot(lhs, rhs), lhs_contracting_dims={1},
+    rhs_contracting_dims={1}
+}
+)";
+
+TEST_F(CpuLowPrecisionDotTest, S8DotIsNotUpcast) {
+  TF_ASSERT_OK_AND_ASSIGN(auto module, GetOptimizedModule(kS8Dot));
+  const HloInstruction* dot = module->entry_computation()->root_instruction();
+  ASSERT_EQ(dot->opcode(), HloOpcode::kDot);
+  EXPECT_EQ(dot->operand(0)->shape().element_type(), S8);
+  EXPECT_EQ(dot->operand(1)->shape().element_type(), S8);
+
+  TF_ASSERT_OK_AND_ASSIGN(auto unoptimized,
+                          ParseAndReturnVerifiedModule(kS8Dot));
+  CompileAndVerifyIr(std::move(unoptimized),
+                     "CHECK: call void @__xla_cpu_runtime_MatMulS8S32",
+                     /*match_optimized_ir=*/true);
+}
+
+TEST_F(CpuLowPrecisionDotTest, BF16DotAccumulatesInF32) {
+  // The transposed rhs is folded into the runtime call.
+  TF_ASSERT_OK_AND_ASSIGN(auto module, ParseAndReturnVerifiedModule(kBF16Dot));
+  CompileAndVerifyIr(std::move(module),
+                     "CHECK: call void @__xla_cpu_runtime_MatMulBF16F32",
+                     /*match_optimized_ir=*/true);
+}
+
+TEST_F(CpuLowPrecisionDotTest, BatchDotIsUpcast) {
+  TF_ASSERT_OK_AND_ASSIGN(auto module, ParseAndReturnVerifiedModule(R"(
+HloModule S8BatchDot
+
+ENTRY main {
+  lhs = s8[4,64,32] parameter(0)
+  rhs = s8[4,32,16] parameter(1)
+  ROOT dot = s32[4,64,16] dot(lhs, rhs), lhs_batch_dims={0},
+    rhs_batch_dims={0}, lhs_contracting_dims={2}, rhs_contracting_dims={1}
+}
+)"));
+  CompileAndVerifyIr(std::move(module),
+                     "CHECK-NOT: call void @__xla_cpu_runtime_MatMulS8S32",
+                     /*match_optimized_ir=*/true);
+}
+
+TEST_F(CpuLowPrecisionDotTest, MatchesReference) {
+  EXPECT_TRUE(RunAndCompare(kS8Dot, ErrorSpec{0}));
+  EXPECT_TRUE(RunAndCompare(kBF16Dot, ErrorSpec{1e-2, 1e-2}));
+}
+
+}  // namespace
+}  // namespace cpu
+}  // namespace xla
@@ -0,0 +1,98 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <memory>
+#include <utility>
+
+#include "absl/strings/match.h"
+#include "tensorflow/compiler/xla/hlo/ir/hlo_module.h"
+#include "tensorflow/compiler/xla/service/cpu/tests/cpu_codegen_test.h"
+#include "tensorflow/tsl/lib/core/status_test_util.h"
+#include "tensorflow/tsl/platform/test.h"
+
+namespace xla {
+namespace cpu {
+namespace {
+
+// `a` is live from the first dot to the root, across the other two dots, so
+// the peak is three 256 KiB temps. Recomputing `a` for the root lowers it to
+// two.
+constexpr char kDotChainHlo[] = R"(
+HloModule DotChain
+
+add {
+  x = f32[] parameter(0)
+  y = f32[] parameter(1)
+  ROOT sum = f32[] add(x, y)
+}
+
+ENTRY main {
+  p0 = f32[256,256] parameter(0)
+  p1 = f32[256,256] parameter(1)
+  a = f32[256,256] dot(p0, p1), lhs_contracting_dims={1},
+    rhs_contracting_dims={0}
+  b = f32[256,256] dot(a, p1), lhs_contracting_dims={1},
+    rhs_contracting_dims={0}
+  c = f32[256,256] dot(b, p1), lhs_contracting_dims={1},
+    rhs_contracting_dims={0}
+  d = f32[256,256] add(c, a)
+  zero = f32[] constant(0)
+  ROOT r = f32[256] reduce(d, zero), dimensions={1}, to_apply=add
+}
+)";
+
+class CpuMemoryLimitTest : public CpuCodegenTest {
+ protected:
+  std::unique_ptr<HloModule> ParseWithMemoryLimit(int64_t memory_limit_bytes) {
+    HloModuleConfig config = GetModuleConfigForTest();
+    DebugOptions debug_options = config.debug_options();
+    debug_options.set_xla_cpu_memory_limit_bytes(memory_limit_bytes);
+    config.set_debug_options(debug_options);
+    return ParseAndReturnVerifiedModule(kDotChainHlo, config).value();
+  }
+
+  static int64_t RematerializedCount(const HloModule& module) {
+    int64_t count = 0;
+    for (const HloInstruction* instruction :
+         module.entry_computation()->instructions()) {
+      count += absl::StrContains(instruction->name(), ".remat");
+    }
+    return count;
+  }
+};
+
+TEST_F(CpuMemoryLimitTest, RematerializesUnderLimit) {
+  TF_ASSERT_OK_AND_ASSIGN(
+      auto module, GetOptimizedModule(ParseWithMemoryLimit(640 * 1024)));
+  ASSERT_TRUE(module->has_schedule());
+  TF_EXPECT_OK(module->schedule().Verify());
+  EXPECT_GT(RematerializedCount(*module), 0);
+}
+
+TEST_F(CpuMemoryLimitTest, NoRematerializationWithoutLimit) {
+  TF_ASSERT_OK_AND_ASSIGN(auto module,
+                          GetOptimizedModule(ParseWithMemoryLimit(0)));
+  EXPECT_FALSE(module->has_schedule());
+  EXPECT_EQ(RematerializedCount(*module), 0);
+}
+
+TEST_F(CpuMemoryLimitTest, MatchesReference) {
+  EXPECT_TRUE(
+      RunAndCompare(ParseWithMemoryLimit(640 * 1024), ErrorSpec{1e-3, 1e-3}));
+}
+
+}  // namespace
+}  // namespace cpu
+}  // namespace xla
@@ -0,0 +1,208 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "tensorflow/compiler/xla/debug_options_flags.h"
+#include "tensorflow/compiler/xla/literal_util.h"
+#include "tensorflow/compiler/xla/service/cpu/cpu_compiler.h"
+#include "tensorflow/compiler/xla/service/cpu/tests/cpu_codegen_test.h"
+#include "tensorflow/compiler/xla/service/hlo_parser.h"
+#include "tensorflow/tsl/lib/core/status_test_util.h"
+#include "tensorflow/tsl/platform/env.h"
+#include "tensorflow/tsl/platform/path.h"
+#include "tensorflow/tsl/platform/statusor.h"
+#include "tensorflow/tsl/platform/test.h"
+#include "tensorflow/tsl/platform/test_benchmark.h"
+
+namespace xla {
+namespace cpu {
+namespace {
+
+// Returns the paths of the object files in `dir`.
+std::vector<std::string> CachedObjectFiles(const std::string& dir) {
+  std::vector<std::string> children;
+  if (!tsl::Env::Default()->GetChildren(dir, &children).ok()) {
+    return {};
+  }
+  std::vector<std::string> object_files;
+  for (const std::string& child : children) {
+    if (absl::EndsWith(child, ".o")) {
+      object_files.push_back(tsl::io::JoinPath(dir, child));
+    }
+  }
+  return object_files;
+}
+
+class CpuObjectCacheTest : public CpuCodegenTest {
+ protected:
+  CpuObjectCacheTest() {
+    CHECK(tsl::Env::Default()->LocalTempFilename(&cache_dir_));
+  }
+
+  ~CpuObjectCacheTest() override {
+    int64_t undeleted_files, undeleted_dirs;
+    tsl::Env::Default()
+        ->DeleteRecursively(cache_dir_, &undeleted_files, &undeleted_dirs)
+        .IgnoreError();
+  }
+
+  DebugOptions GetDebugOptionsForTest() override {
+    DebugOptions debug_options = CpuCodegenTest::GetDebugOptionsForTest();
+    debug_options.set_xla_cpu_object_cache_dir(cache_dir_);
+    return debug_options;
+  }
+
+  // Compiles and runs `kHloText` and checks the result.
+  void RunAndCheck() {
+    TF_ASSERT_OK_AND_ASSIGN(auto module,
+                            ParseAndReturnVerifiedModule(kHloText));
+    Literal x = LiteralUtil::CreateR1<float>({1, 2, 3, 4});
+    Literal y = LiteralUtil::CreateR1<float>({10, 20, 30, 40});
+    Literal result = ExecuteAndTransfer(std::move(module), {&x, &y});
+    EXPECT_EQ(result, LiteralUtil::CreateR1<float>({12, 24, 36, 48}));
+  }
+
+  static constexpr char kHloText[] = R"(
+HloModule ObjectCache
+
+ENTRY main {
+  x = f32[4] parameter(0)
+  y = f32[4] parameter(1)
+  two = f32[] constant(2)
+  two_b = f32[4] broadcast(two), dimensions={}
+  x2 = f32[4] multiply(x, two_b)
+  ROOT sum = f32[4] add(x2, y)
+}
+)";
+
+  std::string cache_dir_;
+};
+
+TEST_F(CpuObjectCacheTest, ReusesCachedObjectFile) {
+  EXPECT_TRUE(CachedObjectFiles(cache_dir_).empty());
+
+  RunAndCheck();
+  std::vector<std::string> object_files = CachedObjectFiles(cache_dir_);
+  EXPECT_EQ(object_files.size(), 1);
+
+  RunAndCheck();
+  EXPECT_EQ(CachedObjectFiles(cache_dir_), object_files);
+}
+
+TEST_F(CpuObjectCacheTest, RecompilesInvalidCachedObjectFile) {
+  RunAndCheck();
+  std::vector<std::string> object_files = CachedObjectFiles(cache_dir_);
+  ASSERT_EQ(object_files.size(), 1);
+  TF_ASSERT_OK(tsl::WriteStringToFile(tsl::Env::Default(), object_files[0],
+                                      "not an object file"));
+
+  RunAndCheck();
+
+  // The invalid entry is replaced by the recompiled object file.
+  std::string contents;
+  TF_ASSERT_OK(tsl::ReadFileToString(tsl::Env::Default(), object_files[0],
+                                     &contents));
+  EXPECT_NE(contents, "not an object file");
+}
+
+TEST_F(CpuObjectCacheTest, RunsPostOptimizationHookOnCachedModule) {
+  RunAndCheck();
+  std::vector<std::string> object_files = CachedObjectFiles(cache_dir_);
+  ASSERT_EQ(object_files.size(), 1);
+
+  // The optimized IR of a cached module still reaches the hook.
+  TF_ASSERT_OK_AND_ASSIGN(auto module, ParseAndReturnVerifiedModule(kHloText));
+  CompileAndVerifyIr(std::move(module), "CHECK: define",
+                     /*match_optimized_ir=*/true);
+  EXPECT_EQ(CachedObjectFiles(cache_dir_), object_files);
+}
+
+// Performance benchmarks below.
+
+// Returns an MLP with `num_layers` layers of `tanh(x * w + b)`, which emits
+// one dot and one fusion per layer.
+std::string MakeMlp(int num_layers) {
+  std::string body = "  x0 = f32[16,256] parameter(0)\n";
+  for (int i = 0; i < num_layers; ++i) {
+    absl::StrAppend(
+        &body, "  w", i, " = f32[256,256] parameter(", 2 * i + 1, ")\n",
+        "  b", i, " = f32[256] parameter(", 2 * i + 2, ")\n",
+        "  dot", i, " = f32[16,256] dot(x", i, ", w", i,
+        "), lhs_contracting_dims={1}, rhs_contracting_dims={0}\n",
+        "  bias", i, " = f32[16,256] broadcast(b", i, "), dimensions={1}\n",
+        "  add", i, " = f32[16,256] add(dot", i, ", bias", i, ")\n",
+        "  x", i + 1, " = f32[16,256] tanh(add", i, ")\n");
+  }
+  return absl::StrCat("HloModule Mlp\n\nENTRY main {\n", body,
+                      "  ROOT out = f32[16,256] copy(x", num_layers, ")\n}\n");
+}
+
+// Measures the backend compilation time of a large module, which is what a
+// restarted process pays to recreate its executables, with the object cache
+// disabled (`cached` = 0) and with a warm object cache (`cached` = 1).
+void BM_CompileMlp(::testing::benchmark::State& state) {
+  const int num_layers = state.range(0);
+  const bool cached = state.range(1);
+
+  std::string cache_dir;
+  if (cached) {
+    CHECK(tsl::Env::Default()->LocalTempFilename(&cache_dir));
+  }
+  DebugOptions debug_options = GetDebugOptionsFromFlags();
+  debug_options.set_xla_cpu_object_cache_dir(cache_dir);
+  HloModuleConfig config;
+  config.set_debug_options(debug_options);
+
+  CpuCompiler compiler;
+  auto module = compiler
+                    .RunHloPasses(ParseAndReturnUnverifiedModule(
+                                      MakeMlp(num_layers), config)
+                                      .value(),
+                                  /*stream_exec=*/nullptr, {})
+                    .value();
+  if (cached) {
+    // Populates the cache.
+    compiler.RunBackend(module->Clone(), /*stream_exec=*/nullptr, {}).value();
+  }
+
+  for (auto s : state) {
+    auto executable =
+        compiler.RunBackend(module->Clone(), /*stream_exec=*/nullptr, {});
+    CHECK(executable.ok());
+  }
+
+  if (cached) {
+    int64_t undeleted_files, undeleted_dirs;
+    tsl::Env::Default()
+        ->DeleteRecursively(cache_dir, &undeleted_files, &undeleted_dirs)
+        .IgnoreError();
+  }
+}
+
+BENCHMARK(BM_CompileMlp)
+    ->UseRealTime()
+    ->ArgPair(16, 0)
+    ->ArgPair(16, 1)
+    ->ArgPair(128, 0)
+    ->ArgPair(128, 1);
+
+}  // namespace
+}  // namespace cpu
+}  // namespace xla
@@ -0,0 +1,181 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_format.h"
+#include "tensorflow/compiler/xla/client/client_library.h"
+#include "tensorflow/compiler/xla/client/local_client.h"
+#include "tensorflow/compiler/xla/client/xla_computation.h"
+#include "tensorflow/compiler/xla/service/hlo_parser.h"
+#include "tensorflow/compiler/xla/service/platform_util.h"
+#include "tensorflow/compiler/xla/tests/test_utils.h"
+#include "tensorflow/tsl/lib/core/status_test_util.h"
+#include "tensorflow/tsl/platform/blocking_counter.h"
+#include "tensorflow/tsl/platform/env.h"
+#include "tensorflow/tsl/platform/test.h"
+#include "tensorflow/tsl/platform/test_benchmark.h"
+#include "tensorflow/tsl/platform/threadpool.h"
+
+namespace xla {
+namespace cpu {
+namespace {
+
+// Returns `tanh(x * w0) * w1` over [n, n] matrices, whose intermediate
+// results live in temp buffers.
+std::string TwoLayerHlo(int64_t n) {
+  return absl::StrFormat(R"(
+HloModule TwoLayer
+
+ENTRY main {
+  x = f32[%1$d,%1$d] parameter(0)
+  w0 = f32[%1$d,%1$d] parameter(1)
+  w1 = f32[%1$d,%1$d] parameter(2)
+  d0 = f32[%1$d,%1$d] dot(x, w0), lhs_contracting_dims={1}, rhs_contracting_dims={0}
+  t0 = f32[%1$d,%1$d] tanh(d0)
+  ROOT d1 = f32[%1$d,%1$d] dot(t0, w1), lhs_contracting_dims={1}, rhs_contracting_dims={0}
+}
+)",
+                         n);
+}
+
+// Compiles TwoLayerHlo(n) with the given temp buffer pool size and keeps its
+// arguments on the device.
+class TwoLayerExecutable {
+ public:
+  TwoLayerExecutable(int64_t n, int pool_size) {
+    se::Platform* platform = PlatformUtil::GetDefaultPlatform().value();
+    client_ = ClientLibrary::GetOrCreateLocalClient(platform).value();
+
+    auto module = ParseAndReturnUnverifiedModule(TwoLayerHlo(n)).value();
+    args_ = MakeFakeArguments(module.get()).value();
+    std::vector<const Shape*> arg_shapes;
+    for (const Literal& arg : args_) {
+      arg_buffers_.push_back(
+          client_->LiteralToShapedBuffer(arg, client_->default_device_ordinal())
+              .value());
+      arg_shapes.push_back(&arg.shape());
+    }
+    for (const ScopedShapedBuffer& buffer : arg_buffers_) {
+      arg_ptrs_.push_back(&buffer);
+    }
+
+    ExecutableBuildOptions build_options;
+    build_options.mutable_debug_options()->set_xla_cpu_temp_buffer_pool_size(
+        pool_size);
+    auto executables = client_
+                           ->Compile(XlaComputation(module->ToProto()),
+                                     arg_shapes, build_options)
+                           .value();
+    executable_ = std::move(executables[0]);
+  }
+
+  StatusOr<Literal> Run(ExecutionProfile* profile = nullptr) {
+    ExecutableRunOptions options;
+    options.set_allocator(client_->backend().memory_allocator());
+    options.set_execution_profile(profile);
+    TF_ASSIGN_OR_RETURN(ScopedShapedBuffer result,
+                        executable_->Run(arg_ptrs_, options));
+    return client_->ShapedBufferToLiteral(result);
+  }
+
+ private:
+  LocalClient* client_;
+  std::vector<Literal> args_;
+  std::vector<ScopedShapedBuffer> arg_buffers_;
+  std::vector<const ShapedBuffer*> arg_ptrs_;
+  std::unique_ptr<LocalExecutable> executable_;
+};
+
+TEST(CpuTempBufferPoolTest, ConcurrentExecutionsMatchUnpooled) {
+  TwoLayerExecutable unpooled(/*n=*/64, /*pool_size=*/0);
+  TwoLayerExecutable pooled(/*n=*/64, /*pool_size=*/2);
+  TF_ASSERT_OK_AND_ASSIGN(Literal expected, unpooled.Run());
+
+  // More concurrent executions than pooled blocks, so that some of them fall
+  // back to allocating their temp buffers.
+  const int kThreads = 8;
+  const int kIterations = 20;
+  tsl::thread::ThreadPool threads(tsl::Env::Default(), "test", kThreads);
+  std::vector<std::vector<Literal>> results(kThreads);
+  tsl::BlockingCounter done(kThreads);
+  for (int t = 0; t < kThreads; ++t) {
+    threads.Schedule([&, t]() {
+      for (int i = 0; i < kIterations; ++i) {
+        results[t].push_back(pooled.Run().value());
+      }
+      done.DecrementCount();
+    });
+  }
+  done.Wait();
+  for (const std::vector<Literal>& thread_results : results) {
+    for (const Literal& result : thread_results) {
+      EXPECT_EQ(result, expected);
+    }
+  }
+}
+
+TEST(CpuTempBufferPoolTest, ReportsBufferAllocationTime) {
+  TwoLayerExecutable executable(/*n=*/64, /*pool_size=*/1);
+  ExecutionProfile profile;
+  TF_ASSERT_OK(executable.Run(&profile).status());
+  EXPECT_GT(profile.buffer_allocation_time_ns(), 0);
+  EXPECT_GT(profile.compute_time_ns(), 0);
+}
+
+// Performance benchmarks below.
+
+// Runs a small model from `num_callers` concurrent callers, with temp
+// buffers allocated on every execution (`pooled` = 0) or checked out of a
+// pool with a block per caller (`pooled` = 1).
+void BM_ConcurrentTwoLayer(::testing::benchmark::State& state) {
+  const int64_t n = state.range(0);
+  const bool pooled = state.range(1);
+  const int num_callers = state.range(2);
+  TwoLayerExecutable executable(n, pooled ? num_callers : 0);
+  tsl::thread::ThreadPool callers(tsl::Env::Default(), "Callers", num_callers);
+  // Warm up.
+  CHECK(executable.Run().ok());
+
+  for (auto s : state) {
+    tsl::BlockingCounter done(num_callers);
+    for (int i = 0; i < num_callers; ++i) {
+      callers.Schedule([&]() {
+        CHECK(executable.Run().ok());
+        done.DecrementCount();
+      });
+    }
+    done.Wait();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          num_callers);
+}
+
+BENCHMARK(BM_ConcurrentTwoLayer)
+    ->UseRealTime()
+    ->Args({64, 0, 1})
+    ->Args({64, 1, 1})
+    ->Args({64, 0, 8})
+    ->Args({64, 1, 8})
+    ->Args({512, 0, 1})
+    ->Args({512, 1, 1})
+    ->Args({512, 0, 8})
+    ->Args({512, 1, 8});
+
+}  // namespace
+}  // namespace cpu
+}  // namespace xla
@@ -95,6 +95,7 @@ std::unique_ptr<HloProfilePrinterData> CreateHloProfilePrinterData(
     for (const HloInstruction* hlo : computation->instructions()) {
       HloInstructionInfo* instruction_info =
           computation_info->add_instruction_infos();
+      instruction_info->set_name(hlo->name());
       instruction_info->set_long_name(hlo->ToString());
       instruction_info->set_short_name(hlo->ToString(
           HloPrintOptions().set_compact_operands(true).set_print_operand_names(
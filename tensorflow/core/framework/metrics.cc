@@ -249,6 +249,11 @@ auto* xla_compilation_time_usecs = tsl::monitoring::Counter<0>::New(
     "/tensorflow/core/xla_compilation_time_usecs",
     "The total time spent on compiling XLA graphs in microseconds.");
 
+auto* xla_async_compilation_fallbacks = tsl::monitoring::Counter<0>::New(
+    "/tensorflow/core/xla_async_compilation_fallbacks",
+    "The number of XLA cluster executions that ran in the TF executor instead "
+    "of waiting for an asynchronous compilation of the cluster to finish.");
+
 auto* xla_tpu_spmd_cores_per_replica = tsl::monitoring::Counter<1>::New(
     "/tensorflow/tpu/xla_spmd_cores_per_replica",
     "The number of cores used by XLA SPMD-replicated models.", "cores");
@@ -532,6 +537,12 @@ void UpdateXlaCompilationTime(const uint64 compilation_time_usecs) {
   }
 }
 
+void IncrementXlaAsyncCompilationFallbacks() {
+  static auto* xla_async_compilation_fallbacks_cell =
+      xla_async_compilation_fallbacks->GetCell();
+  xla_async_compilation_fallbacks_cell->IncrementBy(1);
+}
+
 void RecordUnusedOutput(const string& op_name) {
   graph_unused_outputs->GetCell(op_name)->IncrementBy(1);
 }
@@ -315,6 +315,10 @@ void UpdateTpuVariableDistributionTime(const uint64 distribution_time_usecs);
 // Updates the metrics stored about time XLA spents compiling graphs.
 void UpdateXlaCompilationTime(const uint64 compilation_time_usecs);
 
+// Records that an XLA cluster ran in the TF executor instead of waiting for
+// its asynchronous compilation to finish.
+void IncrementXlaAsyncCompilationFallbacks();
+
 // Increments (by 1) a simple integer counter that is exposed for testing.
 void IncrementTestCounter(const string& name, const string& label);
 
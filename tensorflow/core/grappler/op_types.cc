@@ -580,6 +580,8 @@ bool IsStridedSliceGrad(const NodeDef& node) {
   return node.op() == "StridedSliceGrad";
 }
 
+bool IsStringNGrams(const NodeDef& node) { return node.op() == "StringNGrams"; }
+
 bool IsStringToHashBucketFast(const NodeDef& node) {
   return node.op() == "StringToHashBucketFast";
 }
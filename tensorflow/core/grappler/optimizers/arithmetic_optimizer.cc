@@ -3707,6 +3707,213 @@ class UnaryOpsComposition : public ArithmeticOptimizerStage {
   std::unordered_set<string> fused_nodes_;
 };
 
+// Replace a DAG of elementwise ops, whose intermediate results are not used
+// outside of the DAG, with a single '_FusedCwise' node that evaluates all of
+// them in one pass over memory. For example:
+//
+//   tanh(x * a + b) * x   =>   _FusedCwise(x, a, b)
+//
+// Every fused op must produce the output shape of the DAG root, and every
+// argument of the fused node must be a scalar or broadcast along the outer
+// dimensions only (e.g. a bias vector). Chains of unary ops only are left to
+// the UnaryOpsComposition stage.
+class FuseCwiseChainsStage : public ArithmeticOptimizerStage {
+ public:
+  explicit FuseCwiseChainsStage(const GraphOptimizerContext& ctx,
+                                const ArithmeticOptimizerContext& ctx_ext)
+      : ArithmeticOptimizerStage("FuseCwiseChains", ctx, ctx_ext) {
+    // WARN: This should be consistent with fused_cwise_op.cc.
+    unary_ops_ = {"Abs",  "Exp",     "Inv",  "Log",    "Neg",  "Reciprocal",
+                  "Relu", "Relu6",   "Rsqrt", "Sigmoid", "Sqrt", "Square",
+                  "Tanh"};
+    binary_ops_ = {"Add",     "AddV2", "Div",               "Maximum",
+                   "Minimum", "Mul",   "RealDiv", "SquaredDifference",
+                   "Sub"};
+  }
+  ~FuseCwiseChainsStage() override = default;
+
+  bool IsSupported(const NodeDef* node) const override {
+    return CanFuse(*node) &&
+           // Check that this node was not already a root of a fused DAG. If
+           // graph optimization runs twice without pruning in between,
+           // fused_nodes_ will not have this information.
+           !ctx().node_map->NodeExists(OptimizedNodeName(*node));
+  }
+
+  Status TrySimplify(NodeDef* root, string* simplified_node_name) override {
+    const OpInfo::TensorProperties* root_props;
+    TF_RETURN_IF_ERROR(GetTensorProperties(root->name(), &root_props));
+    if (!ShapeIsFullyDefined(root_props->shape())) return OkStatus();
+
+    FusedProgram program;
+    program.dtype = root->attr().at("T").type();
+    program.shape = &root_props->shape();
+    bool fusible = true;
+    AddToProgram(*root, &program, &fusible);
+    if (!fusible || program.op_names.size() < 2 || !program.has_binary_op) {
+      return OkStatus();
+    }
+
+    // Op results are numbered after all arguments in the '_FusedCwise' node.
+    const int num_args = program.args.size();
+    for (int& operand : program.operands) {
+      if (operand < 0) operand = num_args - 1 - operand;
+    }
+
+    // Do not add fused nodes to any other DAG.
+    for (const string& name : program.fused_nodes) AddToFusedNodes(name);
+
+    VLOG(2) << "Fuse cwise ops: root=" << root->name() << " op_names=["
+            << absl::StrJoin(program.op_names, ", ") << "]";
+
+    NodeDef* fused_node = ctx().optimized_graph->add_node();
+    fused_node->set_name(OptimizedNodeName(*root));
+    fused_node->set_op("_FusedCwise");
+    fused_node->set_device(root->device());
+    for (const string& arg : program.args) {
+      fused_node->add_input(arg);
+      ctx().node_map->AddOutput(NodeName(arg), fused_node->name());
+    }
+
+    auto* attr = fused_node->mutable_attr();
+    SetAttrValue(program.dtype, &(*attr)["T"]);
+    SetAttrValue(static_cast<int>(program.args.size()), &(*attr)["N"]);
+    SetAttrValue(program.op_names, &(*attr)["op_names"]);
+    SetAttrValue(program.operands, &(*attr)["operands"]);
+
+    ctx().node_map->AddNode(fused_node->name(), fused_node);
+    *simplified_node_name = fused_node->name();
+    return OkStatus();
+  }
+
+ private:
+  // Upper bound on the number of ops fused into a single node.
+  static constexpr int kMaxFusedOps = 32;
+
+  struct FusedProgram {
+    DataType dtype;
+    const TensorShapeProto* shape;  // Output shape of the DAG root.
+    std::vector<string> args;
+    std::vector<string> op_names;
+    std::vector<int> operands;
+    std::vector<string> fused_nodes;
+    absl::flat_hash_map<string, int> arg_index;
+    absl::flat_hash_map<string, int> op_index;
+    bool has_binary_op = false;
+  };
+
+  // Appends `node` and its fusible inputs to `program` in topological order
+  // and returns the operand that refers to its result, or sets `fusible` to
+  // false if the DAG cannot be fused. Arguments are referred to by their index
+  // and op results by `-1 - op index` until the number of arguments is known.
+  int AddToProgram(const NodeDef& node, FusedProgram* program,
+                   bool* fusible) {
+    auto it = program->op_index.find(node.name());
+    if (it != program->op_index.end()) return -1 - it->second;
+
+    std::vector<int> operands;
+    for (const string& input : node.input()) {
+      if (IsControlInput(input) || !*fusible) break;
+      operands.push_back(AddOperand(input, program, fusible));
+    }
+    if (!*fusible) return 0;
+
+    const int op_index = program->op_names.size();
+    program->op_index[node.name()] = op_index;
+    program->op_names.push_back(node.op());
+    program->operands.insert(program->operands.end(), operands.begin(),
+                             operands.end());
+    program->fused_nodes.push_back(node.name());
+    program->has_binary_op |= binary_ops_.count(node.op()) > 0;
+
+    if (program->op_names.size() > kMaxFusedOps) *fusible = false;
+    return -1 - op_index;
+  }
+
+  int AddOperand(const string& input, FusedProgram* program, bool* fusible) {
+    const NodeDef* input_node = ctx().node_map->GetNode(input);
+    const OpInfo::TensorProperties* props;
+    if (input_node == nullptr || !GetTensorProperties(input, &props).ok()) {
+      *fusible = false;
+      return 0;
+    }
+
+    // Fuse the producer if it computes the full output shape and this DAG is
+    // its only consumer.
+    if (ParseTensorName(input).index() == 0 && CanFuse(*input_node) &&
+        GetDataTypeFromAttr(*input_node, "T") == program->dtype &&
+        NumNonControlDataOutputs(*input_node, *ctx().node_map) == 1 &&
+        ShapesSymbolicallyEqual(props->shape(), *program->shape)) {
+      return AddToProgram(*input_node, program, fusible);
+    }
+
+    if (props->dtype() != program->dtype ||
+        !IsInnerBroadcast(props->shape(), *program->shape)) {
+      *fusible = false;
+      return 0;
+    }
+    auto it = program->arg_index.find(input);
+    if (it != program->arg_index.end()) return it->second;
+    const int arg_index = program->args.size();
+    program->arg_index[input] = arg_index;
+    program->args.push_back(input);
+    return arg_index;
+  }
+
+  // Returns true if `arg` is a scalar or matches the innermost dimensions of
+  // `out`, as required by the '_FusedCwise' kernel.
+  static bool IsInnerBroadcast(const TensorShapeProto& arg,
+                               const TensorShapeProto& out) {
+    if (!ShapeIsFullyDefined(arg) || arg.dim_size() > out.dim_size()) {
+      return false;
+    }
+    int first = 0;
+    while (first < arg.dim_size() && arg.dim(first).size() == 1) ++first;
+    const int rank = arg.dim_size() - first;
+    for (int i = 0; i < rank; ++i) {
+      if (arg.dim(first + i).size() !=
+          out.dim(out.dim_size() - rank + i).size()) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  static bool ShapeIsFullyDefined(const TensorShapeProto& shape) {
+    if (shape.unknown_rank()) return false;
+    for (const auto& dim : shape.dim()) {
+      if (dim.size() < 0) return false;
+    }
+    return true;
+  }
+
+  bool CanFuse(const NodeDef& node) const {
+    if (unary_ops_.count(node.op()) == 0 && binary_ops_.count(node.op()) == 0) {
+      return false;
+    }
+    const DataType dtype = GetDataTypeFromAttr(node, "T");
+    if (dtype != DT_FLOAT && dtype != DT_HALF && dtype != DT_DOUBLE) {
+      return false;
+    }
+    if (IsInPreserveSet(node) || !NodeIsOnCpu(node) ||
+        fused_nodes_.count(node.name()) > 0) {
+      return false;
+    }
+    return !(IsDrivenByControlDependency(node) ||
+             DrivesControlDependency(node));
+  }
+
+  string OptimizedNodeName(const NodeDef& node) const {
+    return strings::StrCat(node.name(), "/fused_cwise");
+  }
+
+  void AddToFusedNodes(const string& name) { fused_nodes_.insert(name); }
+
+  std::unordered_set<string> unary_ops_;
+  std::unordered_set<string> binary_ops_;
+  std::unordered_set<string> fused_nodes_;
+};
+
 // Replace operations of the form:
 //    x = stack((a_0, a_1, ..., a_{n-1}), axis=k)[:,...,i,...]
 // with
@@ -4358,6 +4565,8 @@ Status ArithmeticOptimizer::SimplifyArithmeticOps(bool can_use_shapes) {
     pipeline.AddStage<OptimizeMaxOrMinOfMonotonicStage>(ctx, ctx_ext);
   if (options_.convert_expm1)
     pipeline.AddStage<ConvertExpm1Stage>(ctx, ctx_ext);
+  if (options_.fuse_cwise_chains && can_use_shapes)
+    pipeline.AddStage<FuseCwiseChainsStage>(ctx, ctx_ext);
   if (options_.unary_ops_composition)
     pipeline.AddStage<UnaryOpsComposition>(ctx, ctx_ext);
   if (options_.remove_stack_slice_same_axis)
@@ -61,6 +61,7 @@ class ArithmeticOptimizer : public GraphOptimizer {
     bool fold_conjugate_into_transpose = true;
     bool fold_multiply_into_conv = true;
     bool fold_transpose_into_matmul = true;
+    bool fuse_cwise_chains = false;
     bool fuse_squared_diff = true;
     bool hoist_common_factor_out_of_aggregation = true;
     bool hoist_cwise_unary_chains = true;
@@ -94,6 +95,9 @@ class ArithmeticOptimizer : public GraphOptimizer {
     static ArithmeticOptimizerOptions Default(
         RewriterConfig::Toggle opt_level) {
       ArithmeticOptimizerOptions options;
+      // Fusing elementwise DAGs into a single CPU kernel changes the set of
+      // kernels that run, so it is only enabled for aggressive optimization.
+      options.fuse_cwise_chains = opt_level == RewriterConfig::AGGRESSIVE;
       return options;
     }
   };
@@ -4322,6 +4322,113 @@ TEST_F(ArithmeticOptimizerTest, UnaryOpsComposition) {
   test::ExpectTensorNear<float>(tensors[0], tensors_expected[0], 1e-6);
 }
 
+TEST_F(ArithmeticOptimizerTest, FuseCwiseChains) {
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+
+  auto x = ops::Placeholder(s.WithOpName("x"), DT_FLOAT,
+                            ops::Placeholder::Shape({2, 3}));
+  auto a = ops::Placeholder(s.WithOpName("a"), DT_FLOAT,
+                            ops::Placeholder::Shape({2, 3}));
+  auto bias = ops::Const(s.WithOpName("bias"), {0.1f, 0.2f, 0.3f}, {3});
+  Output mul = ops::Mul(s.WithOpName("mul"), x, a);
+  Output add = ops::AddV2(s.WithOpName("add"), mul, bias);
+  Output tanh = ops::Tanh(s.WithOpName("tanh"), add);
+  Output gated = ops::Mul(s.WithOpName("gated"), tanh, x);
+  Output final_out = ops::Identity(s.WithOpName("final_out"), gated);
+
+  GrapplerItem item;
+  item.fetch = {"final_out"};
+  TF_CHECK_OK(s.ToGraphDef(&item.graph));
+
+  // Place all nodes on CPU.
+  for (int i = 0; i < item.graph.node_size(); ++i) {
+    item.graph.mutable_node(i)->set_device("/device:CPU:0");
+  }
+
+  auto x_t = GenerateRandomTensor<DT_FLOAT>(TensorShape({2, 3}));
+  auto a_t = GenerateRandomTensor<DT_FLOAT>(TensorShape({2, 3}));
+  item.feed = {{"x", x_t}, {"a", a_t}};
+  auto tensors_expected = EvaluateNodes(item.graph, item.fetch, item.feed);
+  ASSERT_EQ(tensors_expected.size(), 1);
+
+  GraphDef output;
+  ArithmeticOptimizer optimizer;
+  EnableOnlyFuseCwiseChains(&optimizer);
+  OptimizeAndPrune(&optimizer, &item, &output);
+
+  // x, a, bias, the fused node and final_out.
+  EXPECT_EQ(output.node_size(), 5);
+
+  int required_node_count = 0;
+  for (int i = 0; i < output.node_size(); ++i) {
+    const NodeDef& node = output.node(i);
+    if (node.name() == "final_out") {
+      ASSERT_EQ(node.input_size(), 1);
+      EXPECT_EQ(node.input(0), "gated/fused_cwise");
+      ++required_node_count;
+    } else if (node.name() == "gated/fused_cwise") {
+      EXPECT_EQ(node.op(), "_FusedCwise");
+      ASSERT_EQ(node.input_size(), 3);
+      EXPECT_EQ(node.input(0), "x");
+      EXPECT_EQ(node.input(1), "a");
+      EXPECT_EQ(node.input(2), "bias");
+
+      auto op_names = node.attr().at("op_names").list().s();
+      ASSERT_EQ(op_names.size(), 4);
+      EXPECT_EQ(op_names[0], "Mul");
+      EXPECT_EQ(op_names[1], "AddV2");
+      EXPECT_EQ(op_names[2], "Tanh");
+      EXPECT_EQ(op_names[3], "Mul");
+
+      auto operands = node.attr().at("operands").list().i();
+      ASSERT_EQ(operands.size(), 7);
+      EXPECT_EQ(operands[0], 0);  // x
+      EXPECT_EQ(operands[1], 1);  // a
+      EXPECT_EQ(operands[2], 3);  // mul
+      EXPECT_EQ(operands[3], 2);  // bias
+      EXPECT_EQ(operands[4], 4);  // add
+      EXPECT_EQ(operands[5], 5);  // tanh
+      EXPECT_EQ(operands[6], 0);  // x
+      ++required_node_count;
+    }
+  }
+  EXPECT_EQ(required_node_count, 2);
+
+  auto tensors = EvaluateNodes(output, item.fetch, item.feed);
+  ASSERT_EQ(tensors.size(), 1);
+  test::ExpectTensorNear<float>(tensors[0], tensors_expected[0], 1e-6);
+}
+
+TEST_F(ArithmeticOptimizerTest, FuseCwiseChainsSkipsSharedIntermediates) {
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+
+  auto x = ops::Placeholder(s.WithOpName("x"), DT_FLOAT,
+                            ops::Placeholder::Shape({4}));
+  Output mul = ops::Mul(s.WithOpName("mul"), x, x);
+  Output add = ops::AddV2(s.WithOpName("add"), mul, x);
+  Output out1 = ops::Identity(s.WithOpName("out1"), add);
+  Output out2 = ops::Identity(s.WithOpName("out2"), mul);
+
+  GrapplerItem item;
+  item.fetch = {"out1", "out2"};
+  TF_CHECK_OK(s.ToGraphDef(&item.graph));
+  for (int i = 0; i < item.graph.node_size(); ++i) {
+    item.graph.mutable_node(i)->set_device("/device:CPU:0");
+  }
+
+  GraphDef output;
+  ArithmeticOptimizer optimizer;
+  EnableOnlyFuseCwiseChains(&optimizer);
+  OptimizeAndPrune(&optimizer, &item, &output);
+
+  // `mul` has a consumer outside of the DAG rooted at `add`, so only a single
+  // op would be fused and the graph is left unchanged.
+  NodeMap node_map(&output);
+  EXPECT_EQ(node_map.GetNode("add/fused_cwise"), nullptr);
+  ASSERT_NE(node_map.GetNode("add"), nullptr);
+  EXPECT_EQ(node_map.GetNode("add")->op(), "AddV2");
+}
+
 TEST_F(ArithmeticOptimizerTest, RemoveStackStridedSliceSameAxis) {
   tensorflow::Scope s = tensorflow::Scope::NewRootScope();
   auto a_in =
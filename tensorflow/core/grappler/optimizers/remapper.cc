@@ -81,6 +81,7 @@ constexpr char kFusedDepthwiseConv2dNative[] = "_FusedDepthwiseConv2dNative";
 constexpr char kFusedBatchNormEx[] = "_FusedBatchNormEx";
 constexpr char kFusedBatchNormGradEx[] = "_FusedBatchNormGradEx";
 constexpr char kTensorToHashBucket[] = "_TensorToHashBucketFast";
+constexpr char kStringNGramsHashBucket[] = "_StringNGramsHashBucketFast";
 
 constexpr char kDataFormat[] = "data_format";
 constexpr char kIsTraining[] = "is_training";
@@ -151,6 +152,13 @@ struct TensorToHashBucket {
   int string_to_hash_bucket = kMissingIndex;
 };
 
+// StringNGrams whose ngrams are only read by a StringToHashBucketFast, which can
+// be replaced with _StringNGramsHashBucketFast.
+struct StringNGramsHashBucket {
+  int string_ngrams = kMissingIndex;
+  int string_to_hash_bucket = kMissingIndex;
+};
+
 // Pad followed by Conv3D/FusedConv3D
 struct PadWithConv3D {
   PadWithConv3D() = default;
@@ -2319,6 +2327,35 @@ bool FindTensorToHashBucket(const RemapperContext& ctx, int node_index,
   return true;
 }
 
+bool FindStringNGramsHashBucket(const RemapperContext& ctx, int node_index,
+                               StringNGramsHashBucket* matched) {
+  // Root of the pattern must be a StringToHashBucketFast.
+  const auto* node_view = ctx.graph_view.GetNode(node_index);
+  const auto* node_def = node_view->node();
+
+  if (!IsStringToHashBucketFast(*node_def) ||
+      HasControlFaninOrFanout(*node_view) ||
+      node_view->NumRegularFanins() < 1) {
+    return false;
+  }
+
+  // Its input must be the ngrams of a StringNGrams, which are read by nothing
+  // else. The ngrams splits may have any number of fanouts.
+  const auto& regular_fanin_0 = node_view->GetRegularFanin(0);
+  const auto* ngrams_node_view = regular_fanin_0.node_view();
+  const auto* ngrams_node_def = ngrams_node_view->node();
+  if (regular_fanin_0.index() != 0 || !IsStringNGrams(*ngrams_node_def) ||
+      HasControlFaninOrFanout(*ngrams_node_view) ||
+      !HasAtMostOneFanoutAtPort0(*ngrams_node_view) ||
+      IsInPreserveSet(ctx, ngrams_node_def)) {
+    return false;
+  }
+
+  matched->string_ngrams = ngrams_node_view->node_index();
+  matched->string_to_hash_bucket = node_index;
+  return true;
+}
+
 bool FindFusedBatchMatMul(RemapperContext* ctx, int node_index,
                           std::map<string, int>* matched_nodes_map,
                           std::set<int>* remove_node_indices) {
@@ -3505,6 +3542,51 @@ Status AddBatchNormNodes(RemapperContext* ctx, const FusedBatchNorm& matched) {
   return mutation->Apply();
 }
 
+// The fused node replaces the StringNGrams, so that the fanouts of the ngrams
+// splits are kept, and the StringToHashBucketFast becomes an Identity of its
+// bucket ids.
+Status AddStringNGramsHashBucketNode(RemapperContext* ctx,
+                                     const StringNGramsHashBucket& matched,
+                                     std::vector<bool>* invalidated_nodes) {
+  const GraphDef* graph = ctx->graph_view.graph();
+  const NodeDef& string_ngrams = graph->node(matched.string_ngrams);
+  const NodeDef& string_to_hash_bucket =
+      graph->node(matched.string_to_hash_bucket);
+  VLOG(2) << "Fuse StringNGrams with StringToHashBucketFast:"
+          << " string_ngrams=" << string_ngrams.name()
+          << " string_to_hash_bucket=" << string_to_hash_bucket.name();
+
+  NodeDef fused_op;
+  fused_op.set_name(string_ngrams.name());
+  fused_op.set_device(string_ngrams.device());
+  fused_op.add_input(string_ngrams.input(0));  // 0: data
+  fused_op.add_input(string_ngrams.input(1));  // 1: data_splits
+  fused_op.set_op(kStringNGramsHashBucket);
+  *fused_op.mutable_attr() = string_ngrams.attr();
+  (*fused_op.mutable_attr())["num_buckets"] =
+      string_to_hash_bucket.attr().at("num_buckets");
+
+  NodeDef identity_op;
+  identity_op.set_name(string_to_hash_bucket.name());
+  identity_op.set_device(string_to_hash_bucket.device());
+  identity_op.add_input(string_ngrams.name());
+  identity_op.set_op("Identity");
+  SetAttrValue(DT_INT64, &(*identity_op.mutable_attr())["T"]);
+
+  utils::Mutation* mutation = ctx->graph_view.GetMutationBuilder();
+  Status status;
+  mutation->AddNode(std::move(fused_op), &status);
+  TF_RETURN_IF_ERROR(status);
+  mutation->AddNode(std::move(identity_op), &status);
+  TF_RETURN_IF_ERROR(status);
+  TF_RETURN_IF_ERROR(mutation->Apply());
+
+  (*invalidated_nodes)[matched.string_ngrams] = true;
+  (*invalidated_nodes)[matched.string_to_hash_bucket] = true;
+
+  return OkStatus();
+}
+
 Status AddTensorToHashBucketNode(RemapperContext* ctx,
                                  const TensorToHashBucket& matched,
                                  std::vector<bool>* invalidated_nodes,
@@ -4140,6 +4222,14 @@ Status Remapper::Optimize(Cluster* cluster, const GrapplerItem& item,
       continue;
     }
 
+    StringNGramsHashBucket string_ngrams_hash_bucket;
+    if (allow_non_differentiable_rewrites &&
+        FindStringNGramsHashBucket(ctx, i, &string_ngrams_hash_bucket)) {
+      TF_RETURN_IF_ERROR(AddStringNGramsHashBucketNode(
+          &ctx, string_ngrams_hash_bucket, &invalidated_nodes));
+      continue;
+    }
+
     // During inference, most of the inputs to FusedBatchNorm are constant, and
     // we can therefore replace the op with a much cheaper set of primitives.
     FusedBatchNorm fused_batch_norm;
@@ -1414,6 +1414,67 @@ TEST_F(RemapperTensorToHashBucketTest, I32) { RunTest<DT_INT32>(); }
 
 TEST_F(RemapperTensorToHashBucketTest, I64) { RunTest<DT_INT64>(); }
 
+TEST_F(RemapperTest, FuseStringNGramsWithStringToHashBucketFast) {
+  using ::tensorflow::ops::Placeholder;
+
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+
+  auto data = Placeholder(s.WithOpName("data"), DT_STRING,
+                          ops::Placeholder::Shape({-1}));
+  auto data_splits = Placeholder(s.WithOpName("data_splits"), DT_INT64,
+                                 ops::Placeholder::Shape({-1}));
+  const int num_buckets = 1000;
+  auto ngrams = ops::StringNGrams(s.WithOpName("ngrams"), data, data_splits,
+                                  /*separator=*/" ", /*ngram_widths=*/{1, 2},
+                                  /*left_pad=*/"<", /*right_pad=*/">",
+                                  /*pad_width=*/1,
+                                  /*preserve_short_sequences=*/false);
+  auto to_bucket = ops::StringToHashBucketFast(s.WithOpName("to_bucket"),
+                                               ngrams.ngrams, num_buckets);
+  auto fetch = ops::Identity(s.WithOpName("fetch"), to_bucket);
+  auto fetch_splits =
+      ops::Identity(s.WithOpName("fetch_splits"), ngrams.ngrams_splits);
+
+  GrapplerItem item;
+  item.fetch = {"fetch", "fetch_splits"};
+  item.feed = {
+      {"data", test::AsTensor<tstring>({"the", "quick", "brown", "fox", "a"})},
+      {"data_splits", test::AsTensor<int64_t>({0, 4, 4, 5})}};
+  TF_ASSERT_OK(s.ToGraphDef(&item.graph));
+  for (int i = 0; i < item.graph.node_size(); ++i) {
+    item.graph.mutable_node(i)->set_device("/device:CPU:0");
+  }
+
+  Remapper optimizer(RewriterConfig::ON);
+  GraphDef output;
+  TF_ASSERT_OK(optimizer.Optimize(nullptr, item, &output));
+
+  int found = 0;
+  for (const NodeDef& node : output.node()) {
+    if (node.name() == "ngrams") {
+      EXPECT_EQ(node.op(), "_StringNGramsHashBucketFast");
+      ASSERT_EQ(node.input_size(), 2);
+      EXPECT_EQ(node.input(0), "data");
+      EXPECT_EQ(node.input(1), "data_splits");
+      EXPECT_EQ(node.attr().at("num_buckets").i(), num_buckets);
+      found++;
+    } else if (node.name() == "to_bucket") {
+      EXPECT_EQ(node.op(), "Identity");
+      ASSERT_EQ(node.input_size(), 1);
+      EXPECT_EQ(node.input(0), "ngrams");
+      found++;
+    }
+  }
+  EXPECT_EQ(found, 2);
+
+  auto tensors_expected = EvaluateNodes(item.graph, item.fetch, item.feed);
+  ASSERT_EQ(tensors_expected.size(), 2);
+  auto tensors = EvaluateNodes(output, item.fetch, item.feed);
+  ASSERT_EQ(tensors.size(), 2);
+  test::ExpectTensorEqual<int64_t>(tensors[0], tensors_expected[0]);
+  test::ExpectTensorEqual<int64_t>(tensors[1], tensors_expected[1]);
+}
+
 class RemapperFuseMatMulWithBiasTest : public RemapperTest {
  public:
   template <DataType DTYPE>
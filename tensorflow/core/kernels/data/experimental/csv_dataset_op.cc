@@ -12,10 +12,14 @@ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
+#include <array>
+#include <cstring>
+
 #include "tensorflow/core/framework/common_shape_fns.h"
 #include "tensorflow/core/framework/dataset.h"
 #include "tensorflow/core/framework/op.h"
 #include "tensorflow/core/framework/shape_inference.h"
+#include "tensorflow/core/kernels/fast_parse_numbers.h"
 #include "tensorflow/core/lib/io/inputstream_interface.h"
 #include "tensorflow/core/lib/io/random_inputstream.h"
 #include "tensorflow/core/lib/io/zlib_compression_options.h"
@@ -184,7 +188,13 @@ class CSVDatasetOp : public DatasetOpKernel {
           op_version_(op_version),
           use_compression_(!compression_type.empty()),
           compression_type_(std::move(compression_type)),
-          options_(options) {}
+          options_(options) {
+      special_chars_.fill(false);
+      special_chars_[static_cast<uint8_t>(delim_)] = true;
+      special_chars_['\n'] = true;
+      special_chars_['\r'] = true;
+      if (use_quote_delim_) special_chars_['"'] = true;
+    }
 
     std::unique_ptr<IteratorBase> MakeIteratorInternal(
         const string& prefix) const override {
@@ -508,7 +518,7 @@ class CSVDatasetOp : public DatasetOpKernel {
         pos_++;  // Starting quotation mark
 
         Status parse_result;
-        while (true) {  // Each iter reads 1 char, filling buffer if necessary
+        while (true) {  // Each iter reads to a quote, filling buffer as needed
           if (pos_ >= buffer_.size()) {
             Status s = SaveAndFillBuffer(&earlier_pieces, &start, include);
             if (errors::IsOutOfRange(s)) {
@@ -562,7 +572,11 @@ class CSVDatasetOp : public DatasetOpKernel {
             }
 
           } else {
-            pos_++;
+            // Jump to the next quote, which either closes the field or starts
+            // an escaped quote.
+            const char* quote = static_cast<const char*>(
+                memchr(buffer_.data() + pos_, '"', buffer_.size() - pos_));
+            pos_ = quote == nullptr ? buffer_.size() : quote - buffer_.data();
           }
         }
       }
@@ -641,7 +655,7 @@ class CSVDatasetOp : public DatasetOpKernel {
         size_t start = pos_;
         Status parse_result;
 
-        while (true) {  // Each iter reads 1 char, filling buffer if necessary
+        while (true) {  // Each iter reads to a special char, filling buffer
           if (pos_ >= buffer_.size()) {
             Status s = SaveAndFillBuffer(&earlier_pieces, &start, include);
             // Handle errors
@@ -657,6 +671,17 @@ class CSVDatasetOp : public DatasetOpKernel {
             }
           }
 
+          // Skip to the next delimiter, line break or quote in the buffer.
+          const bool* special_chars = dataset()->special_chars_.data();
+          const char* data = buffer_.data();
+          size_t pos = pos_;
+          while (pos < buffer_.size() &&
+                 !special_chars[static_cast<uint8_t>(data[pos])]) {
+            pos++;
+          }
+          pos_ = pos;
+          if (pos_ >= buffer_.size()) continue;
+
           char ch = buffer_[pos_];
 
           if (ch == dataset()->delim_) {
@@ -730,7 +755,7 @@ class CSVDatasetOp : public DatasetOpKernel {
                   dataset()->record_defaults_[output_idx].flat<int32>()(0);
             } else {
               int32_t value;
-              if (!strings::safe_strto32(field, &value)) {
+              if (!FastParseInt32(field, &value)) {
                 return errors::InvalidArgument(
                     "Field ", output_idx,
                     " in record is not a valid int32: ", field);
@@ -745,7 +770,7 @@ class CSVDatasetOp : public DatasetOpKernel {
                   dataset()->record_defaults_[output_idx].flat<int64_t>()(0);
             } else {
               int64_t value;
-              if (!strings::safe_strto64(field, &value)) {
+              if (!FastParseInt64(field, &value)) {
                 return errors::InvalidArgument(
                     "Field ", output_idx,
                     " in record is not a valid int64: ", field);
@@ -760,7 +785,7 @@ class CSVDatasetOp : public DatasetOpKernel {
                   dataset()->record_defaults_[output_idx].flat<float>()(0);
             } else {
               float value;
-              if (!strings::safe_strtof(field, &value)) {
+              if (!FastParseFloat(field, &value)) {
                 return errors::InvalidArgument(
                     "Field ", output_idx,
                     " in record is not a valid float: ", field);
@@ -775,7 +800,7 @@ class CSVDatasetOp : public DatasetOpKernel {
                   dataset()->record_defaults_[output_idx].flat<double>()(0);
             } else {
               double value;
-              if (!strings::safe_strtod(field, &value)) {
+              if (!FastParseDouble(field, &value)) {
                 return errors::InvalidArgument(
                     "Field ", output_idx,
                     " in record is not a valid double: ", field);
@@ -920,6 +945,8 @@ class CSVDatasetOp : public DatasetOpKernel {
     const bool use_compression_;
     const tstring compression_type_;
     const io::ZlibCompressionOptions options_;
+    // Characters that end or invalidate an unquoted field.
+    std::array<bool, 256> special_chars_;
   };  // class Dataset
 
   const int op_version_;
@@ -0,0 +1,194 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <limits>
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def_builder.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/kernels/ops_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+
+namespace tensorflow {
+namespace {
+
+class DecodeCSVOpTest : public OpsTestBase {
+ protected:
+  void MakeOp(const std::vector<DataType>& out_types) {
+    TF_ASSERT_OK(NodeDefBuilder("decode_csv", "DecodeCSV")
+                     .Input(FakeInput(DT_STRING))
+                     .Input(FakeInput(out_types))
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+  }
+};
+
+TEST_F(DecodeCSVOpTest, QuotedAndMissingFields) {
+  MakeOp({DT_INT32, DT_STRING, DT_FLOAT});
+  AddInputFromArray<tstring>(TensorShape({3}),
+                             {"1,\"a,\"\"b\"\"\",2.5", "2,\"\",", "3,c,-1"});
+  AddInputFromArray<int32>(TensorShape({1}), {0});
+  AddInputFromArray<tstring>(TensorShape({1}), {"default"});
+  AddInputFromArray<float>(TensorShape({1}), {7.0f});
+  TF_ASSERT_OK(RunOpKernel());
+
+  test::ExpectTensorEqual<int32>(*GetOutput(0),
+                                 test::AsTensor<int32>({1, 2, 3}));
+  test::ExpectTensorEqual<tstring>(
+      *GetOutput(1), test::AsTensor<tstring>({"a,\"b\"", "default", "c"}));
+  test::ExpectTensorEqual<float>(*GetOutput(2),
+                                 test::AsTensor<float>({2.5f, 7.0f, -1.0f}));
+}
+
+TEST_F(DecodeCSVOpTest, ManyRecords) {
+  MakeOp({DT_INT64, DT_DOUBLE});
+  const int n = 10000;
+  std::vector<tstring> records;
+  for (int i = 0; i < n; ++i) {
+    records.push_back(strings::StrCat(i, ",", i, ".5"));
+  }
+  AddInputFromArray<tstring>(TensorShape({n}), records);
+  AddInputFromArray<int64_t>(TensorShape({0}), {});
+  AddInputFromArray<double>(TensorShape({0}), {});
+  TF_ASSERT_OK(RunOpKernel());
+
+  auto ints = GetOutput(0)->flat<int64_t>();
+  auto doubles = GetOutput(1)->flat<double>();
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(ints(i), i);
+    EXPECT_EQ(doubles(i), i + 0.5);
+  }
+}
+
+TEST_F(DecodeCSVOpTest, ParsesNumbersOutsideTheFastPath) {
+  MakeOp({DT_INT32, DT_INT64, DT_FLOAT, DT_DOUBLE});
+  AddInputFromArray<tstring>(
+      TensorShape({3}), {" 7 ,-9223372036854775808,+1.5, 0x10",
+                         "-2147483648,123456789012345678,-INF,1e400",
+                         "2147483647,-1234567890123456789,1e-50,.5 "});
+  AddInputFromArray<int32>(TensorShape({0}), {});
+  AddInputFromArray<int64_t>(TensorShape({0}), {});
+  AddInputFromArray<float>(TensorShape({0}), {});
+  AddInputFromArray<double>(TensorShape({0}), {});
+  TF_ASSERT_OK(RunOpKernel());
+
+  test::ExpectTensorEqual<int32>(
+      *GetOutput(0), test::AsTensor<int32>({7, -2147483647 - 1, 2147483647}));
+  test::ExpectTensorEqual<int64_t>(
+      *GetOutput(1),
+      test::AsTensor<int64_t>({std::numeric_limits<int64_t>::min(),
+                               123456789012345678, -1234567890123456789}));
+  test::ExpectTensorEqual<float>(
+      *GetOutput(2),
+      test::AsTensor<float>(
+          {1.5f, -std::numeric_limits<float>::infinity(), 0.0f}));
+  test::ExpectTensorEqual<double>(
+      *GetOutput(3),
+      test::AsTensor<double>(
+          {16.0, std::numeric_limits<double>::infinity(), 0.5}));
+}
+
+TEST_F(DecodeCSVOpTest, RejectsOutOfRangeIntegers) {
+  MakeOp({DT_INT32});
+  AddInputFromArray<tstring>(TensorShape({2}), {"2147483647", "2147483648"});
+  AddInputFromArray<int32>(TensorShape({0}), {});
+  Status s = RunOpKernel();
+  EXPECT_TRUE(absl::StrContains(
+      s.error_message(),
+      "Field 0 in record 1 is not a valid int32: 2147483648"))
+      << s;
+}
+
+TEST_F(DecodeCSVOpTest, ReportsFirstInvalidRecord) {
+  MakeOp({DT_INT32});
+  const int n = 10000;
+  std::vector<tstring> records(n, "1");
+  records[4000] = "x";
+  records[9000] = "y";
+  AddInputFromArray<tstring>(TensorShape({n}), records);
+  AddInputFromArray<int32>(TensorShape({0}), {});
+  Status s = RunOpKernel();
+  EXPECT_FALSE(s.ok());
+  EXPECT_TRUE(absl::StrContains(
+      s.error_message(), "Field 0 in record 4000 is not a valid int32: x"))
+      << s;
+}
+
+// Performance benchmarks below.
+
+// Builds a DecodeCSV node over `num_records` records with `num_columns`
+// alternating int64 and float columns. Sets `bytes` to the size of the input.
+static Graph* DecodeWideCSV(int num_records, int num_columns, int64_t* bytes) {
+  Graph* g = new Graph(OpRegistry::Global());
+
+  Tensor records(DT_STRING, TensorShape({num_records}));
+  auto records_flat = records.flat<tstring>();
+  for (int i = 0; i < num_records; ++i) {
+    string record;
+    for (int c = 0; c < num_columns; ++c) {
+      if (c > 0) record += ",";
+      if (c % 2 == 0) {
+        strings::StrAppend(&record, (i * 31 + c) % 100000);
+      } else {
+        strings::StrAppend(&record, (i + c) * 0.125f);
+      }
+    }
+    *bytes += record.size();
+    records_flat(i) = record;
+  }
+
+  std::vector<NodeBuilder::NodeOut> defaults;
+  for (int c = 0; c < num_columns; ++c) {
+    Tensor t(c % 2 == 0 ? DT_INT64 : DT_FLOAT, TensorShape({0}));
+    defaults.emplace_back(test::graph::Constant(g, t));
+  }
+
+  Node* node;
+  TF_CHECK_OK(NodeBuilder(g->NewName("n"), "DecodeCSV")
+                  .Input(test::graph::Constant(g, records))
+                  .Input(defaults)
+                  .Finalize(g, &node));
+  return g;
+}
+
+static void BM_DecodeWideCSV(::testing::benchmark::State& state) {
+  const int num_records = state.range(0);
+  const int num_columns = state.range(1);
+  int64_t bytes = 0;
+  Graph* g = DecodeWideCSV(num_records, num_columns, &bytes);
+
+  test::Benchmark("cpu", g, /*old_benchmark_api*/ false).Run(state);
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * bytes);
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          num_records);
+}
+
+BENCHMARK(BM_DecodeWideCSV)
+    ->UseRealTime()
+    ->ArgPair(1024, 16)
+    ->ArgPair(1024, 256)
+    ->ArgPair(16 * 1024, 16)
+    ->ArgPair(16 * 1024, 256);
+
+}  // namespace
+}  // namespace tensorflow
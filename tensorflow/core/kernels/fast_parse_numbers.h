@@ -0,0 +1,103 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_KERNELS_FAST_PARSE_NUMBERS_H_
+#define TENSORFLOW_CORE_KERNELS_FAST_PARSE_NUMBERS_H_
+
+#include <cstdint>
+#include <system_error>
+
+#include "absl/strings/charconv.h"
+#include "tensorflow/core/lib/strings/numbers.h"
+#include "tensorflow/core/platform/stringpiece.h"
+
+namespace tensorflow {
+
+// Numeric parsers for text fields such as CSV columns. They accept exactly
+// the inputs strings::safe_strto* accept and produce the same values, but
+// handle the common plain forms ("-123", "1.5e-3") inline and only call
+// into the general parsers for everything else (surrounding spaces, '+',
+// hex, inf/nan, overflow and underflow).
+
+namespace fast_parse_internal {
+
+// Parses an optional '-' followed by at most `max_digits` decimal digits,
+// which cannot overflow the result type. Returns false for any other input.
+template <typename T, int max_digits>
+inline bool ParseShortInteger(StringPiece str, T* value) {
+  const char* p = str.data();
+  const char* end = p + str.size();
+  const bool negative = p != end && *p == '-';
+  if (negative) ++p;
+  if (p == end || end - p > max_digits) return false;
+  uint64_t result = 0;
+  for (; p != end; ++p) {
+    const unsigned digit = static_cast<unsigned char>(*p) - '0';
+    if (digit > 9) return false;
+    result = result * 10 + digit;
+  }
+  *value = negative ? -static_cast<T>(result) : static_cast<T>(result);
+  return true;
+}
+
+// Parses a field made only of digits, '.', 'e', 'E', '+' and '-' that
+// absl::from_chars consumes entirely and without a range error. Both
+// absl::from_chars and double-conversion round correctly, so they agree on
+// every such input. Returns false for any other input.
+template <typename T>
+inline bool ParseShortDecimal(StringPiece str, T* value) {
+  // safe_strtof/d reject fields of 32 or more characters.
+  if (str.empty() || str.size() >= 32) return false;
+  for (const char c : str) {
+    if (!((c >= '0' && c <= '9') || c == '.' || c == 'e' || c == 'E' ||
+          c == '+' || c == '-')) {
+      return false;
+    }
+  }
+  T result;
+  const absl::from_chars_result parsed =
+      absl::from_chars(str.data(), str.data() + str.size(), result);
+  if (parsed.ec != std::errc() || parsed.ptr != str.data() + str.size()) {
+    return false;
+  }
+  *value = result;
+  return true;
+}
+
+}  // namespace fast_parse_internal
+
+inline bool FastParseInt32(StringPiece str, int32_t* value) {
+  return fast_parse_internal::ParseShortInteger<int32_t, 9>(str, value) ||
+         strings::safe_strto32(str, value);
+}
+
+inline bool FastParseInt64(StringPiece str, int64_t* value) {
+  return fast_parse_internal::ParseShortInteger<int64_t, 18>(str, value) ||
+         strings::safe_strto64(str, value);
+}
+
+inline bool FastParseFloat(StringPiece str, float* value) {
+  return fast_parse_internal::ParseShortDecimal(str, value) ||
+         strings::safe_strtof(str, value);
+}
+
+inline bool FastParseDouble(StringPiece str, double* value) {
+  return fast_parse_internal::ParseShortDecimal(str, value) ||
+         strings::safe_strtod(str, value);
+}
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_KERNELS_FAST_PARSE_NUMBERS_H_
@@ -0,0 +1,128 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/kernels/fast_parse_numbers.h"
+
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "tensorflow/core/lib/strings/numbers.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace {
+
+// Inputs covering the inline paths, their limits and the fallbacks.
+std::vector<std::string> Inputs() {
+  return {"",
+          "0",
+          "-0",
+          "7",
+          "-7",
+          "123456789",
+          "-123456789",
+          "1234567890",
+          "2147483647",
+          "2147483648",
+          "-2147483648",
+          "-2147483649",
+          "123456789012345678",
+          "9223372036854775807",
+          "9223372036854775808",
+          "-9223372036854775808",
+          "-9223372036854775809",
+          "99999999999999999999",
+          " 12",
+          "12 ",
+          "+12",
+          "1-2",
+          "-",
+          "--1",
+          "12a",
+          "1.5",
+          "-1.5",
+          ".5",
+          "5.",
+          ".",
+          "1e10",
+          "1E-10",
+          "1e+10",
+          "-2.5e-3",
+          "1e",
+          "e1",
+          "1e400",
+          "-1e400",
+          "1e-400",
+          "1e39",
+          "1e-45",
+          "1.17549435e-38",
+          "3.4028235e38",
+          "0.1",
+          "0.30000000000000004",
+          "123456789012345678901234567890.5",
+          "1234567890123456789012345678901",
+          "inf",
+          "-Infinity",
+          "nan",
+          "0x1p3",
+          " 1.5 ",
+          "1.5.5",
+          "1..5"};
+}
+
+// Compares by bits so that -0 and NaN are checked exactly.
+template <typename T>
+bool SameValue(T a, T b) {
+  return std::memcmp(&a, &b, sizeof(T)) == 0 ||
+         (std::isnan(static_cast<double>(a)) &&
+          std::isnan(static_cast<double>(b)));
+}
+
+template <typename T>
+void ExpectSameAsSafeParse(bool (*fast)(StringPiece, T*),
+                           bool (*safe)(StringPiece, T*)) {
+  for (const std::string& input : Inputs()) {
+    T fast_value = 0;
+    T safe_value = 0;
+    const bool fast_ok = fast(input, &fast_value);
+    const bool safe_ok = safe(input, &safe_value);
+    EXPECT_EQ(fast_ok, safe_ok) << "'" << input << "'";
+    if (fast_ok && safe_ok) {
+      EXPECT_TRUE(SameValue(fast_value, safe_value))
+          << "'" << input << "': " << fast_value << " vs " << safe_value;
+    }
+  }
+}
+
+TEST(FastParseNumbersTest, Int32MatchesSafeStrto32) {
+  ExpectSameAsSafeParse<int32_t>(FastParseInt32, strings::safe_strto32);
+}
+
+TEST(FastParseNumbersTest, Int64MatchesSafeStrto64) {
+  ExpectSameAsSafeParse<int64_t>(FastParseInt64, strings::safe_strto64);
+}
+
+TEST(FastParseNumbersTest, FloatMatchesSafeStrtof) {
+  ExpectSameAsSafeParse<float>(FastParseFloat, strings::safe_strtof);
+}
+
+TEST(FastParseNumbersTest, DoubleMatchesSafeStrtod) {
+  ExpectSameAsSafeParse<double>(FastParseDouble, strings::safe_strtod);
+}
+
+}  // namespace
+}  // namespace tensorflow
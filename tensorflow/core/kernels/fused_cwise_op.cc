@@ -0,0 +1,412 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// See docs in ../ops/math_ops.cc.
+
+#define EIGEN_USE_THREADS
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "absl/strings/str_join.h"
+#include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/kernels/cwise_ops.h"
+#include "tensorflow/core/lib/gtl/inlined_vector.h"
+
+namespace tensorflow {
+
+typedef Eigen::ThreadPoolDevice CPUDevice;
+
+namespace {
+
+// Elementwise ops that can be part of a `_FusedCwise` program.
+enum class CwiseOpcode {
+  // Unary ops.
+  kAbs,
+  kExp,
+  kLog,
+  kNeg,
+  kReciprocal,
+  kRelu,
+  kRelu6,
+  kRsqrt,
+  kSigmoid,
+  kSqrt,
+  kSquare,
+  kTanh,
+  // Binary ops.
+  kAdd,
+  kDiv,
+  kMaximum,
+  kMinimum,
+  kMul,
+  kSquaredDifference,
+  kSub,
+};
+
+struct CwiseOpInfo {
+  CwiseOpcode opcode;
+  int arity;
+};
+
+// WARN: This should be consistent with the FuseCwiseChains stage in
+// grappler/optimizers/arithmetic_optimizer.cc.
+Status LookupCwiseOp(const string& op_name, CwiseOpInfo* info) {
+  static const auto* const kCwiseOps =
+      new std::unordered_map<string, CwiseOpInfo>({
+          {"Abs", {CwiseOpcode::kAbs, 1}},
+          {"Exp", {CwiseOpcode::kExp, 1}},
+          {"Inv", {CwiseOpcode::kReciprocal, 1}},
+          {"Log", {CwiseOpcode::kLog, 1}},
+          {"Neg", {CwiseOpcode::kNeg, 1}},
+          {"Reciprocal", {CwiseOpcode::kReciprocal, 1}},
+          {"Relu", {CwiseOpcode::kRelu, 1}},
+          {"Relu6", {CwiseOpcode::kRelu6, 1}},
+          {"Rsqrt", {CwiseOpcode::kRsqrt, 1}},
+          {"Sigmoid", {CwiseOpcode::kSigmoid, 1}},
+          {"Sqrt", {CwiseOpcode::kSqrt, 1}},
+          {"Square", {CwiseOpcode::kSquare, 1}},
+          {"Tanh", {CwiseOpcode::kTanh, 1}},
+          {"Add", {CwiseOpcode::kAdd, 2}},
+          {"AddV2", {CwiseOpcode::kAdd, 2}},
+          {"Div", {CwiseOpcode::kDiv, 2}},
+          {"Maximum", {CwiseOpcode::kMaximum, 2}},
+          {"Minimum", {CwiseOpcode::kMinimum, 2}},
+          {"Mul", {CwiseOpcode::kMul, 2}},
+          {"RealDiv", {CwiseOpcode::kDiv, 2}},
+          {"SquaredDifference", {CwiseOpcode::kSquaredDifference, 2}},
+          {"Sub", {CwiseOpcode::kSub, 2}},
+      });
+  auto it = kCwiseOps->find(op_name);
+  if (it == kCwiseOps->end()) {
+    return errors::InvalidArgument("Unsupported op in _FusedCwise: ", op_name);
+  }
+  *info = it->second;
+  return OkStatus();
+}
+
+// `FusedCwiseOp` evaluates a DAG of elementwise ops given as a linear program.
+//
+// The program is decoded once at kernel construction. Evaluation walks the
+// output in cache-sized blocks and runs the whole program on each block, so
+// intermediate results never leave the L1 cache and each argument is read from
+// memory exactly once. Each op is evaluated on the block with the same Eigen
+// functor, and thus the same packet math, as the corresponding standalone
+// kernel.
+template <typename T>
+class FusedCwiseOp : public OpKernel {
+ public:
+  explicit FusedCwiseOp(OpKernelConstruction* context) : OpKernel(context) {
+    OP_REQUIRES_OK(context, context->GetAttr("N", &num_args_));
+    std::vector<string> op_names;
+    std::vector<int32> operands;
+    OP_REQUIRES_OK(context, context->GetAttr("op_names", &op_names));
+    OP_REQUIRES_OK(context, context->GetAttr("operands", &operands));
+    OP_REQUIRES(context, !op_names.empty(),
+                errors::InvalidArgument(
+                    "_FusedCwise must have at least one op in op_names"));
+
+    int next_operand = 0;
+    for (const string& op_name : op_names) {
+      CwiseOpInfo info;
+      OP_REQUIRES_OK(context, LookupCwiseOp(op_name, &info));
+      OP_REQUIRES(context,
+                  next_operand + info.arity <= static_cast<int>(operands.size()),
+                  errors::InvalidArgument(
+                      "_FusedCwise operands are missing for op ", op_name));
+      Instruction instruction;
+      instruction.opcode = info.opcode;
+      instruction.arity = info.arity;
+      const int num_regs = num_args_ + static_cast<int>(program_.size());
+      for (int i = 0; i < info.arity; ++i) {
+        const int operand = operands[next_operand++];
+        OP_REQUIRES(context, 0 <= operand && operand < num_regs,
+                    errors::InvalidArgument(
+                        "_FusedCwise operand ", operand, " of op ", op_name,
+                        " must refer to an argument or a preceding op"));
+        instruction.operands[i] = operand;
+      }
+      cost_ += OpCost(info.opcode);
+      program_.push_back(instruction);
+    }
+    OP_REQUIRES(context, next_operand == static_cast<int>(operands.size()),
+                errors::InvalidArgument("_FusedCwise has ",
+                                        operands.size() - next_operand,
+                                        " unused operands"));
+
+    VLOG(2) << "Fused cwise ops: [" << absl::StrJoin(op_names, ", ")
+            << "]; cost=" << cost_;
+  }
+
+  void Compute(OpKernelContext* ctx) override {
+    // Every argument must either have the output shape, be a scalar, or have
+    // the shape of the innermost output dimensions (e.g. a bias vector).
+    TensorShape shape;
+    for (int i = 0; i < num_args_; ++i) {
+      const TensorShape& arg_shape = ctx->input(i).shape();
+      if (arg_shape.num_elements() > shape.num_elements() ||
+          (arg_shape.num_elements() == shape.num_elements() &&
+           arg_shape.dims() > shape.dims())) {
+        shape = arg_shape;
+      }
+    }
+
+    std::vector<Argument> args(num_args_);
+    gtl::InlinedVector<int, 4> forwardable_inputs;
+    int num_full_args = 0;
+    for (int i = 0; i < num_args_; ++i) {
+      const Tensor& arg = ctx->input(i);
+      OP_REQUIRES(ctx,
+                  arg.dims() <= shape.dims() &&
+                      IsInnerBroadcast(arg.shape(), shape),
+                  errors::InvalidArgument(
+                      "_FusedCwise argument ", i, " of shape ",
+                      arg.shape().DebugString(),
+                      " is not broadcastable along the outer dimensions of ",
+                      shape.DebugString()));
+      args[i].data = arg.flat<T>().data();
+      args[i].size = arg.NumElements();
+      if (arg.shape() == shape) {
+        forwardable_inputs.push_back(i);
+        ++num_full_args;
+      }
+    }
+
+    Tensor* out = nullptr;
+    OP_REQUIRES_OK(ctx, ctx->forward_input_or_allocate_output(
+                            forwardable_inputs, 0, shape, &out));
+    const int64_t num_elements = shape.num_elements();
+    if (num_elements == 0) return;
+    for (Argument& arg : args) arg.is_full = arg.size == num_elements;
+
+    T* out_data = out->flat<T>().data();
+    auto compute_fn = [this, &args, out_data](int64_t begin, int64_t end) {
+      const int num_regs = num_args_ + static_cast<int>(program_.size());
+      // Block-sized scratch for broadcast arguments and intermediate results.
+      std::vector<T> scratch(num_regs * kBlockSize);
+      std::vector<const T*> regs(num_regs);
+
+      for (int64_t block = begin; block < end; block += kBlockSize) {
+        const int64_t len = std::min(kBlockSize, end - block);
+
+        for (int i = 0; i < num_args_; ++i) {
+          const Argument& arg = args[i];
+          if (arg.is_full) {
+            regs[i] = arg.data + block;
+            continue;
+          }
+          // Materialize the broadcast argument for this block.
+          T* dst = scratch.data() + i * kBlockSize;
+          if (arg.size == 1) {
+            if (block == begin) std::fill_n(dst, kBlockSize, arg.data[0]);
+          } else {
+            int64_t offset = block % arg.size;
+            for (int64_t j = 0; j < len;) {
+              const int64_t n = std::min(len - j, arg.size - offset);
+              std::copy_n(arg.data + offset, n, dst + j);
+              j += n;
+              offset = 0;
+            }
+          }
+          regs[i] = dst;
+        }
+
+        const int num_instructions = static_cast<int>(program_.size());
+        for (int k = 0; k < num_instructions; ++k) {
+          T* dst = k + 1 == num_instructions
+                       ? out_data + block
+                       : scratch.data() + (num_args_ + k) * kBlockSize;
+          Evaluate(program_[k], regs, len, dst);
+          regs[num_args_ + k] = dst;
+        }
+      }
+    };
+
+    const CPUDevice& device = ctx->eigen_device<CPUDevice>();
+    Eigen::TensorOpCost cost(/*bytes_loaded=*/sizeof(T) * num_full_args,
+                             /*bytes_stored=*/sizeof(T), cost_);
+    device.parallelFor(num_elements, cost, std::move(compute_fn));
+  }
+
+ private:
+  using ConstFlat = typename TTypes<T>::ConstFlat;
+  using Flat = typename TTypes<T>::Flat;
+
+  // Number of elements processed by one pass over the program. Chosen so that
+  // the scratch registers of typical programs fit in the L1 cache.
+  static constexpr int64_t kBlockSize = 512;
+
+  struct Instruction {
+    CwiseOpcode opcode;
+    int arity;
+    int operands[2];
+  };
+
+  struct Argument {
+    const T* data = nullptr;
+    int64_t size = 0;
+    bool is_full = false;
+  };
+
+  // Returns true if `arg` is a scalar or equals `out` after dropping leading
+  // dimensions of size one from `arg` and leading dimensions from `out`.
+  static bool IsInnerBroadcast(const TensorShape& arg, const TensorShape& out) {
+    int first = 0;
+    while (first < arg.dims() && arg.dim_size(first) == 1) ++first;
+    const int rank = arg.dims() - first;
+    if (rank > out.dims()) return false;
+    for (int i = 0; i < rank; ++i) {
+      if (arg.dim_size(first + i) != out.dim_size(out.dims() - rank + i)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  template <typename Functor>
+  static void Unary(const T* x, int64_t len, T* dst) {
+    Flat(dst, len) = ConstFlat(x, len).unaryExpr(typename Functor::func());
+  }
+
+  template <typename Functor>
+  static void Binary(const T* x, const T* y, int64_t len, T* dst) {
+    Flat(dst, len) =
+        ConstFlat(x, len).binaryExpr(ConstFlat(y, len),
+                                     typename Functor::func());
+  }
+
+  static void Evaluate(const Instruction& instruction,
+                       const std::vector<const T*>& regs, int64_t len,
+                       T* dst) {
+    const T* x = regs[instruction.operands[0]];
+    const T* y = instruction.arity > 1 ? regs[instruction.operands[1]] : nullptr;
+    switch (instruction.opcode) {
+      case CwiseOpcode::kAbs:
+        return Unary<functor::abs<T>>(x, len, dst);
+      case CwiseOpcode::kExp:
+        return Unary<functor::exp<T>>(x, len, dst);
+      case CwiseOpcode::kLog:
+        return Unary<functor::log<T>>(x, len, dst);
+      case CwiseOpcode::kNeg:
+        return Unary<functor::neg<T>>(x, len, dst);
+      case CwiseOpcode::kReciprocal:
+        return Unary<functor::inverse<T>>(x, len, dst);
+      case CwiseOpcode::kRelu:
+        Flat(dst, len) = ConstFlat(x, len).cwiseMax(static_cast<T>(0));
+        return;
+      case CwiseOpcode::kRelu6:
+        Flat(dst, len) = ConstFlat(x, len)
+                             .cwiseMax(static_cast<T>(0))
+                             .cwiseMin(static_cast<T>(6));
+        return;
+      case CwiseOpcode::kRsqrt:
+        return Unary<functor::rsqrt<T>>(x, len, dst);
+      case CwiseOpcode::kSigmoid:
+        return Unary<functor::sigmoid<T>>(x, len, dst);
+      case CwiseOpcode::kSqrt:
+        return Unary<functor::sqrt<T>>(x, len, dst);
+      case CwiseOpcode::kSquare:
+        return Unary<functor::square<T>>(x, len, dst);
+      case CwiseOpcode::kTanh:
+        return Unary<functor::tanh<T>>(x, len, dst);
+      case CwiseOpcode::kAdd:
+        return Binary<functor::add<T>>(x, y, len, dst);
+      case CwiseOpcode::kDiv:
+        return Binary<functor::div<T>>(x, y, len, dst);
+      case CwiseOpcode::kMaximum:
+        return Binary<functor::maximum<T>>(x, y, len, dst);
+      case CwiseOpcode::kMinimum:
+        return Binary<functor::minimum<T>>(x, y, len, dst);
+      case CwiseOpcode::kMul:
+        return Binary<functor::mul<T>>(x, y, len, dst);
+      case CwiseOpcode::kSquaredDifference:
+        return Binary<functor::squared_difference<T>>(x, y, len, dst);
+      case CwiseOpcode::kSub:
+        return Binary<functor::sub<T>>(x, y, len, dst);
+    }
+  }
+
+  template <typename Functor>
+  static int FunctorCost() {
+    return Eigen::internal::functor_traits<typename Functor::func>::Cost;
+  }
+
+  static int OpCost(CwiseOpcode opcode) {
+    switch (opcode) {
+      case CwiseOpcode::kAbs:
+        return FunctorCost<functor::abs<T>>();
+      case CwiseOpcode::kExp:
+        return FunctorCost<functor::exp<T>>();
+      case CwiseOpcode::kLog:
+        return FunctorCost<functor::log<T>>();
+      case CwiseOpcode::kNeg:
+        return FunctorCost<functor::neg<T>>();
+      case CwiseOpcode::kReciprocal:
+        return FunctorCost<functor::inverse<T>>();
+      case CwiseOpcode::kRelu:
+      case CwiseOpcode::kRelu6:
+        return 2 * Eigen::NumTraits<T>::AddCost;
+      case CwiseOpcode::kRsqrt:
+        return FunctorCost<functor::rsqrt<T>>();
+      case CwiseOpcode::kSigmoid:
+        return FunctorCost<functor::sigmoid<T>>();
+      case CwiseOpcode::kSqrt:
+        return FunctorCost<functor::sqrt<T>>();
+      case CwiseOpcode::kSquare:
+        return FunctorCost<functor::square<T>>();
+      case CwiseOpcode::kTanh:
+        return FunctorCost<functor::tanh<T>>();
+      case CwiseOpcode::kAdd:
+        return FunctorCost<functor::add<T>>();
+      case CwiseOpcode::kDiv:
+        return FunctorCost<functor::div<T>>();
+      case CwiseOpcode::kMaximum:
+        return FunctorCost<functor::maximum<T>>();
+      case CwiseOpcode::kMinimum:
+        return FunctorCost<functor::minimum<T>>();
+      case CwiseOpcode::kMul:
+        return FunctorCost<functor::mul<T>>();
+      case CwiseOpcode::kSquaredDifference:
+        return FunctorCost<functor::squared_difference<T>>();
+      case CwiseOpcode::kSub:
+        return FunctorCost<functor::sub<T>>();
+    }
+    return 1;
+  }
+
+  int num_args_ = 0;
+  std::vector<Instruction> program_;
+  int cost_ = 0;
+};
+
+}  // namespace
+
+#define REGISTER_CPU(T)                                              \
+  REGISTER_KERNEL_BUILDER(                                           \
+      Name("_FusedCwise").Device(DEVICE_CPU).TypeConstraint<T>("T"), \
+      FusedCwiseOp<T>);
+
+REGISTER_CPU(float);
+REGISTER_CPU(Eigen::half);
+REGISTER_CPU(double);
+
+#undef REGISTER_CPU
+
+}  // namespace tensorflow
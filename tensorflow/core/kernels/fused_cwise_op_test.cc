@@ -0,0 +1,174 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <cmath>
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def_builder.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/kernels/ops_testutil.h"
+#include "tensorflow/core/kernels/ops_util.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+
+namespace tensorflow {
+namespace {
+
+class FusedCwiseOpTest : public OpsTestBase {
+ protected:
+  Status MakeOp(int num_args, const std::vector<string>& op_names,
+                const std::vector<int>& operands) {
+    TF_RETURN_IF_ERROR(NodeDefBuilder("fused_cwise", "_FusedCwise")
+                           .Input(FakeInput(num_args, DT_FLOAT))
+                           .Attr("T", DT_FLOAT)
+                           .Attr("op_names", op_names)
+                           .Attr("operands", operands)
+                           .Finalize(node_def()));
+    return InitOp();
+  }
+};
+
+// tanh(x * a + b) * x, the typical gated activation chain.
+TEST_F(FusedCwiseOpTest, MulAddTanhMul) {
+  TF_ASSERT_OK(MakeOp(3, {"Mul", "AddV2", "Tanh", "Mul"},
+                      {/*Mul*/ 0, 1, /*AddV2*/ 3, 2, /*Tanh*/ 4,
+                       /*Mul*/ 5, 0}));
+
+  const int n = 3000;  // Spans several evaluation blocks.
+  std::vector<float> x(n), a(n);
+  for (int i = 0; i < n; ++i) {
+    x[i] = 0.01f * (i % 200) - 1.0f;
+    a[i] = 0.5f + 0.001f * i;
+  }
+  AddInputFromArray<float>(TensorShape({n}), x);
+  AddInputFromArray<float>(TensorShape({n}), a);
+  AddInputFromArray<float>(TensorShape({}), {0.25f});
+  TF_ASSERT_OK(RunOpKernel());
+
+  Tensor expected(allocator(), DT_FLOAT, TensorShape({n}));
+  auto expected_flat = expected.flat<float>();
+  for (int i = 0; i < n; ++i) {
+    expected_flat(i) = std::tanh(x[i] * a[i] + 0.25f) * x[i];
+  }
+  test::ExpectClose(expected, *GetOutput(0));
+}
+
+TEST_F(FusedCwiseOpTest, InnerBroadcastBias) {
+  // relu(x + bias) with a bias over the innermost dimension.
+  TF_ASSERT_OK(MakeOp(2, {"AddV2", "Relu"}, {0, 1, 2}));
+  AddInputFromArray<float>(TensorShape({2, 3}), {-1, 0, 1, 2, -3, 4});
+  AddInputFromArray<float>(TensorShape({3}), {1, -1, 0});
+  TF_ASSERT_OK(RunOpKernel());
+
+  Tensor expected(allocator(), DT_FLOAT, TensorShape({2, 3}));
+  test::FillValues<float>(&expected, {0, 0, 1, 3, 0, 4});
+  test::ExpectTensorEqual<float>(expected, *GetOutput(0));
+}
+
+TEST_F(FusedCwiseOpTest, SubSquareMaximumReusesInput) {
+  // max(square(x - y), y), where y is read by the first and the last op.
+  TF_ASSERT_OK(MakeOp(2, {"Sub", "Square", "Maximum"}, {0, 1, 2, 3, 1}));
+  AddInputFromArray<float>(TensorShape({4}), {1, 2, 3, 4});
+  AddInputFromArray<float>(TensorShape({4}), {2, 2, 0, 0});
+  TF_ASSERT_OK(RunOpKernel());
+
+  Tensor expected(allocator(), DT_FLOAT, TensorShape({4}));
+  test::FillValues<float>(&expected, {2, 2, 9, 16});
+  test::ExpectTensorEqual<float>(expected, *GetOutput(0));
+}
+
+TEST_F(FusedCwiseOpTest, RejectsForwardReference) {
+  Status s = MakeOp(1, {"Tanh", "Mul"}, {2, 0, 1});
+  EXPECT_FALSE(s.ok());
+  EXPECT_TRUE(absl::StrContains(s.error_message(), "preceding op")) << s;
+}
+
+TEST_F(FusedCwiseOpTest, RejectsUnsupportedOp) {
+  Status s = MakeOp(1, {"Cumsum"}, {0});
+  EXPECT_FALSE(s.ok());
+  EXPECT_TRUE(absl::StrContains(s.error_message(), "Unsupported op")) << s;
+}
+
+TEST_F(FusedCwiseOpTest, RejectsOuterBroadcast) {
+  TF_ASSERT_OK(MakeOp(2, {"AddV2"}, {0, 1}));
+  AddInputFromArray<float>(TensorShape({2, 3}), {1, 2, 3, 4, 5, 6});
+  AddInputFromArray<float>(TensorShape({2, 1}), {1, 2});
+  Status s = RunOpKernel();
+  EXPECT_FALSE(s.ok());
+  EXPECT_TRUE(absl::StrContains(s.error_message(), "not broadcastable")) << s;
+}
+
+// Performance benchmarks below.
+
+// Builds `tanh(x * a + b) * x`, either as separate graph nodes or as a single
+// `_FusedCwise` node.
+static Graph* GatedActivation(int tensor_size, bool fused) {
+  Graph* g = new Graph(OpRegistry::Global());
+
+  Tensor x(DT_FLOAT, TensorShape({tensor_size}));
+  x.flat<float>().setRandom();
+  Tensor a(DT_FLOAT, TensorShape({tensor_size}));
+  a.flat<float>().setRandom();
+  Tensor b(DT_FLOAT, TensorShape({}));
+  b.scalar<float>()() = 0.5f;
+
+  Node* x_node = test::graph::Constant(g, x);
+  Node* a_node = test::graph::Constant(g, a);
+  Node* b_node = test::graph::Constant(g, b);
+
+  Node* out;
+  if (fused) {
+    TF_CHECK_OK(NodeBuilder(g->NewName("n"), "_FusedCwise")
+                    .Input(std::vector<NodeBuilder::NodeOut>(
+                        {x_node, a_node, b_node}))
+                    .Attr("T", DT_FLOAT)
+                    .Attr("op_names",
+                          std::vector<string>({"Mul", "AddV2", "Tanh", "Mul"}))
+                    .Attr("operands", std::vector<int>({0, 1, 3, 2, 4, 5, 0}))
+                    .Finalize(g, &out));
+  } else {
+    Node* mul = test::graph::Binary(g, "Mul", x_node, a_node);
+    Node* add = test::graph::Binary(g, "AddV2", mul, b_node);
+    Node* tanh = test::graph::Unary(g, "Tanh", add);
+    out = test::graph::Binary(g, "Mul", tanh, x_node);
+  }
+  return g;
+}
+
+#define BM_GatedActivation(N, FUSED)                                       \
+  static void BM_GatedActivation##_##N##_##FUSED(                          \
+      ::testing::benchmark::State& state) {                                \
+    test::Benchmark("cpu", GatedActivation(N, FUSED),                      \
+                    /*old_benchmark_api*/ false)                           \
+        .Run(state);                                                       \
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * N); \
+  }                                                                        \
+  BENCHMARK(BM_GatedActivation##_##N##_##FUSED)->UseRealTime();
+
+BM_GatedActivation(1024, false);
+BM_GatedActivation(1024, true);
+BM_GatedActivation(1048576, false);
+BM_GatedActivation(1048576, true);
+BM_GatedActivation(16777216, false);
+BM_GatedActivation(16777216, true);
+
+}  // namespace
+}  // namespace tensorflow
@@ -49,16 +49,16 @@ Status InternalCompute(const RE2& regex, const string& rewrite,
     output_tensor->flat<tstring>() = input_tensor->flat<tstring>();
   }
   auto output_flat = output_tensor->flat<tstring>();
+  // Replace and GlobalReplace only accept std::string, so each element is
+  // copied to a buffer reused across elements, which only grows to the longest
+  // result, and is only copied back if it matched.
+  string buf;
   for (size_t i = 0; i < output_flat.size(); ++i) {
-    // TODO(dero): Mitigate copy; Global and GlobalReplace below currently only
-    // accept std::string.
-    string buf = output_flat(i);
-    if (replace_global) {
-      RE2::GlobalReplace(&buf, regex, rewrite);
-    } else {
-      RE2::Replace(&buf, regex, rewrite);
-    }
-    output_flat(i) = std::move(buf);
+    buf.assign(output_flat(i).data(), output_flat(i).size());
+    const bool replaced = replace_global
+                              ? RE2::GlobalReplace(&buf, regex, rewrite) > 0
+                              : RE2::Replace(&buf, regex, rewrite);
+    if (replaced) output_flat(i).assign(buf.data(), buf.size());
   }
   return OkStatus();
 }
@@ -19,11 +19,15 @@ limitations under the License.
 
 #include "tensorflow/core/kernels/sparse_tensor_dense_matmul_op.h"
 
+#include <algorithm>
+#include <vector>
+
 #include "tensorflow/core/framework/bounds_check.h"
 #include "tensorflow/core/framework/op.h"
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/kernels/fill_functor.h"
 #include "tensorflow/core/platform/bfloat16.h"
+#include "tensorflow/core/util/work_sharder.h"
 
 namespace tensorflow {
 
@@ -264,9 +268,8 @@ Status SparseTensorDenseMatMulImpl(
   const int lhs_index_a = ADJ_A ? 1 : 0;
   const int rhs_index_a = ADJ_A ? 0 : 1;
 
-  // TODO(ebrevdo): After many failed experiments, can't find a multi-threaded
-  // approach that achieves the performance of the single threaded
-  // one.  Perhaps Eigen threadpool implementation is just too slow?
+  // Large products are handled by SparseTensorDenseMatMulCsrImpl, which
+  // splits the work across threads; this loop is used for small ones.
 
   if (rhs_right < kNumVectorize) {
     // Disable vectorization if the RHS of output is too small
@@ -321,6 +324,138 @@ Status SparseTensorDenseMatMulImpl(
   }
   return OkStatus();
 }
+
+// Number of output columns processed by one unit of work in
+// SparseTensorDenseMatMulCsrImpl, so that rows holding a large share of the
+// nonzeros can still be spread across threads when the output is wide.
+static constexpr int64_t kCsrColumnBlockSize = 1024;
+
+// Computes `out += a * b` by first converting the COO matrix `a` into CSR form
+// keyed on the output row, then processing contiguous ranges of output rows
+// holding roughly equal numbers of nonzeros on separate threads. Entries of a
+// row keep their COO order, so every output element is accumulated in the same
+// order as in SparseTensorDenseMatMulImpl and the results are identical.
+template <typename T, typename Tsum, typename Tindices, bool ADJ_A, bool ADJ_B>
+Status SparseTensorDenseMatMulCsrImpl(
+    OpKernelContext* ctx, typename TTypes<Tsum>::Matrix out,
+    typename TTypes<Tindices>::ConstMatrix a_indices,
+    typename TTypes<T>::ConstVec a_values, typename TTypes<T>::ConstMatrix b) {
+  const int64_t nnz = a_values.size();
+  const int64_t num_rows = out.dimension(0);
+  const int64_t rhs_right = out.dimension(1);
+  const std::size_t lhs_right = (ADJ_B ? b.dimension(1) : b.dimension(0));
+  const int lhs_index_a = ADJ_A ? 1 : 0;
+  const int rhs_index_a = ADJ_A ? 0 : 1;
+
+  // Validate the indices once and count the nonzeros of each output row.
+  std::vector<Tindices> rows(nnz);
+  std::vector<Tindices> cols(nnz);
+  std::vector<int64_t> row_ptr(num_rows + 1, 0);
+  for (int64_t i = 0; i < nnz; ++i) {
+    const Tindices m = internal::SubtleMustCopy(a_indices(i, lhs_index_a));
+    const Tindices k = internal::SubtleMustCopy(a_indices(i, rhs_index_a));
+    if (!FastBoundsCheck(k, lhs_right)) {
+      return KOutOfBoundsError(k, i, rhs_index_a, lhs_right);
+    }
+    if (!FastBoundsCheck(m, num_rows)) {
+      return MOutOfBoundsError(m, i, lhs_index_a, num_rows);
+    }
+    rows[i] = m;
+    cols[i] = k;
+    ++row_ptr[m + 1];
+  }
+  for (int64_t m = 0; m < num_rows; ++m) {
+    row_ptr[m + 1] += row_ptr[m];
+  }
+
+  // Stable counting sort of the entries by output row.
+  std::vector<Tindices> csr_cols(nnz);
+  std::vector<T> csr_values(nnz);
+  {
+    std::vector<int64_t> next(row_ptr.begin(), row_ptr.end() - 1);
+    for (int64_t i = 0; i < nnz; ++i) {
+      const int64_t pos = next[rows[i]]++;
+      csr_cols[pos] = cols[i];
+      csr_values[pos] = ADJ_A ? MaybeConj(a_values(i)) : a_values(i);
+    }
+  }
+
+  // Every nonzero reads a row of B, so make those rows contiguous once.
+  const T* b_data = b.data();
+  Tensor b_adjoint_t;
+  if (ADJ_B) {
+    TF_RETURN_IF_ERROR(ctx->allocate_temp(
+        DataTypeToEnum<T>::value,
+        TensorShape({b.dimension(1), b.dimension(0)}), &b_adjoint_t));
+    Eigen::array<int, 2> shuffle(1, 0);
+    b_adjoint_t.matrix<T>().device(ctx->eigen_cpu_device()) =
+        b.shuffle(shuffle).conjugate();
+    b_data = b_adjoint_t.matrix<T>().data();
+  }
+
+  // Split the rows into shards of about the same number of nonzeros, and the
+  // columns into blocks; each (shard, block) pair is one unit of work. A row
+  // is never split, so a row holding most of the nonzeros makes its shard the
+  // bottleneck, and only its column blocks run in parallel.
+  const DeviceBase::CpuWorkerThreads* worker_threads =
+      ctx->device()->tensorflow_cpu_worker_threads();
+  const int64_t num_row_shards = std::max<int64_t>(
+      1, std::min<int64_t>(num_rows, 4 * worker_threads->num_threads));
+  std::vector<int64_t> row_bounds(num_row_shards + 1);
+  for (int64_t s = 0; s <= num_row_shards; ++s) {
+    row_bounds[s] =
+        std::lower_bound(row_ptr.begin(), row_ptr.end(),
+                         nnz * s / num_row_shards) -
+        row_ptr.begin();
+  }
+  row_bounds[num_row_shards] = num_rows;
+  const int64_t num_col_blocks =
+      (rhs_right + kCsrColumnBlockSize - 1) / kCsrColumnBlockSize;
+
+  auto work = [&](int64_t begin, int64_t end) {
+    for (int64_t unit = begin; unit < end; ++unit) {
+      const int64_t shard = unit / num_col_blocks;
+      const int64_t col_begin = (unit % num_col_blocks) * kCsrColumnBlockSize;
+      const int64_t col_size =
+          std::min(kCsrColumnBlockSize, rhs_right - col_begin);
+      for (int64_t m = row_bounds[shard]; m < row_bounds[shard + 1]; ++m) {
+        typename TTypes<Tsum>::Vec out_row(&out(m, col_begin), col_size);
+        for (int64_t j = row_ptr[m]; j < row_ptr[m + 1]; ++j) {
+          typename TTypes<T>::ConstVec b_row(
+              b_data + csr_cols[j] * rhs_right + col_begin, col_size);
+          out_row += b_row.template cast<Tsum>() *
+                     static_cast<Tsum>(csr_values[j]);
+        }
+      }
+    }
+  };
+  const int64_t cost_per_unit =
+      2 * std::max<int64_t>(1, nnz / num_row_shards) *
+      std::min(kCsrColumnBlockSize, rhs_right);
+  Shard(worker_threads->num_threads, worker_threads->workers,
+        num_row_shards * num_col_blocks, cost_per_unit, work);
+  return OkStatus();
+}
+
+// Below this many multiply-adds, building the CSR form and scheduling shards
+// costs more than the serial COO loop saves.
+static constexpr int64_t kMinCsrMultiplyAdds = 1 << 16;
+
+template <typename T, typename Tsum, typename Tindices, bool ADJ_A, bool ADJ_B>
+Status SparseTensorDenseMatMulCpu(
+    OpKernelContext* ctx, typename TTypes<Tsum>::Matrix out,
+    typename TTypes<Tindices>::ConstMatrix a_indices,
+    typename TTypes<T>::ConstVec a_values, typename TTypes<T>::ConstMatrix b) {
+  const int64_t multiply_adds =
+      static_cast<int64_t>(a_values.size()) * out.dimension(1);
+  if (ctx->device()->tensorflow_cpu_worker_threads()->num_threads > 1 &&
+      out.dimension(0) > 1 && multiply_adds >= kMinCsrMultiplyAdds) {
+    return SparseTensorDenseMatMulCsrImpl<T, Tsum, Tindices, ADJ_A, ADJ_B>(
+        ctx, out, a_indices, a_values, b);
+  }
+  return SparseTensorDenseMatMulImpl<T, Tsum, Tindices, ADJ_A, ADJ_B>(
+      out, a_indices, a_values, b);
+}
 }  // namespace
 
 template <typename T, typename Tindices, bool ADJ_A, bool ADJ_B>
@@ -338,8 +473,8 @@ struct SparseTensorDenseMatMulFunctor<CPUDevice, T, Tindices, ADJ_A, ADJ_B> {
       auto temp_out = temp_out_t.matrix<Tsum>();
       temp_out.setZero();
       TF_RETURN_IF_ERROR(
-          SparseTensorDenseMatMulImpl<T, Tsum, Tindices, ADJ_A, ADJ_B>(
-              temp_out, a_indices, a_values, b));
+          SparseTensorDenseMatMulCpu<T, Tsum, Tindices, ADJ_A, ADJ_B>(
+              ctx, temp_out, a_indices, a_values, b));
       out = temp_out.template cast<T>();
     } else {
       out.setZero();
@@ -348,8 +483,8 @@ struct SparseTensorDenseMatMulFunctor<CPUDevice, T, Tindices, ADJ_A, ADJ_B> {
       auto out_workaround =
           *reinterpret_cast<typename TTypes<Tsum>::Matrix*>(&out);
       TF_RETURN_IF_ERROR(
-          SparseTensorDenseMatMulImpl<T, Tsum, Tindices, ADJ_A, ADJ_B>(
-              out_workaround, a_indices, a_values, b));
+          SparseTensorDenseMatMulCpu<T, Tsum, Tindices, ADJ_A, ADJ_B>(
+              ctx, out_workaround, a_indices, a_values, b));
     }
     return OkStatus();
   }
@@ -13,16 +13,165 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
 
+#include <memory>
 #include <random>
+#include <vector>
 
+#include "tensorflow/core/common_runtime/device_factory.h"
 #include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def_builder.h"
 #include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
 #include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/kernels/ops_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/platform/test.h"
 #include "tensorflow/core/platform/test_benchmark.h"
+#include "tensorflow/core/platform/threadpool.h"
 
 namespace tensorflow {
 
+namespace {
+
+// Runs the op with a single worker thread, which takes the serial COO loop, and
+// with several, which takes the CSR path for products of at least 64K
+// multiply-adds.
+class SparseTensorDenseMatMulOpTest : public OpsTestBase {
+ protected:
+  SparseTensorDenseMatMulOpTest()
+      : workers_(Env::Default(), "sparse_tensor_dense_matmul_test",
+                 /*num_threads=*/4) {
+    std::unique_ptr<Device> device =
+        DeviceFactory::NewDevice("CPU", {}, "/job:a/replica:0/task:0");
+    worker_threads_.workers = &workers_;
+    device->set_tensorflow_cpu_worker_threads(&worker_threads_);
+    SetDevice(DEVICE_CPU, std::move(device));
+  }
+
+  // `a` is [m, k] (or [k, m] with `adjoint_a`) with the given indices and
+  // random values, and `b` is a random [k, n] (or [n, k] with `adjoint_b`).
+  void MakeInputs(int m, int k, int n, const std::vector<int64_t>& indices,
+                  bool adjoint_a, bool adjoint_b) {
+    TF_ASSERT_OK(NodeDefBuilder("matmul", "SparseTensorDenseMatMul")
+                     .Input(FakeInput(DT_INT64))
+                     .Input(FakeInput(DT_FLOAT))
+                     .Input(FakeInput(DT_INT64))
+                     .Input(FakeInput(DT_FLOAT))
+                     .Attr("adjoint_a", adjoint_a)
+                     .Attr("adjoint_b", adjoint_b)
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+
+    const int64_t nnz = indices.size() / 2;
+    a_indices_ = Tensor(DT_INT64, TensorShape({nnz, 2}));
+    test::FillValues<int64_t>(&a_indices_, indices);
+    a_values_ = Tensor(DT_FLOAT, TensorShape({nnz}));
+    a_values_.flat<float>().setRandom();
+    a_shape_ = test::AsTensor<int64_t>({adjoint_a ? k : m, adjoint_a ? m : k});
+    b_ = Tensor(DT_FLOAT,
+                adjoint_b ? TensorShape({n, k}) : TensorShape({k, n}));
+    b_.flat<float>().setRandom();
+  }
+
+  Status Run(int num_threads, Tensor* out) {
+    worker_threads_.num_threads = num_threads;
+    inputs_.clear();
+    AddInputFromArray<int64_t>(a_indices_.shape(), a_indices_.flat<int64_t>());
+    AddInputFromArray<float>(a_values_.shape(), a_values_.flat<float>());
+    AddInputFromArray<int64_t>(a_shape_.shape(), a_shape_.flat<int64_t>());
+    AddInputFromArray<float>(b_.shape(), b_.flat<float>());
+    TF_RETURN_IF_ERROR(RunOpKernel());
+    *out = *GetOutput(0);
+    return OkStatus();
+  }
+
+  // Expects the serial and the multi-threaded paths to return the same output.
+  void ExpectSameAsSerial() {
+    Tensor serial, parallel;
+    TF_ASSERT_OK(Run(/*num_threads=*/1, &serial));
+    TF_ASSERT_OK(Run(/*num_threads=*/4, &parallel));
+    test::ExpectClose(serial, parallel, /*atol=*/1e-5, /*rtol=*/1e-5);
+  }
+
+  thread::ThreadPool workers_;
+  DeviceBase::CpuWorkerThreads worker_threads_;
+  Tensor a_indices_, a_values_, a_shape_, b_;
+};
+
+// Returns the indices of `nnz` entries of an [m, k] matrix, or of a [k, m] one
+// if `adjoint_a`. With `skewed`, the rows follow a power law so that the first
+// row holds about a fifth of the entries and many rows are empty.
+std::vector<int64_t> RandomIndices(int m, int k, int nnz, bool adjoint_a,
+                                   bool skewed) {
+  std::mt19937 gen(1234);
+  std::uniform_real_distribution<> u(0, 1);
+  std::uniform_int_distribution<> k_dist(0, k - 1);
+  std::vector<int64_t> indices;
+  for (int i = 0; i < nnz; ++i) {
+    const double r = u(gen);
+    const int64_t row = m * (skewed ? r * r * r * r * r * r * r : r);
+    const int64_t col = k_dist(gen);
+    indices.push_back(adjoint_a ? col : row);
+    indices.push_back(adjoint_a ? row : col);
+  }
+  return indices;
+}
+
+TEST_F(SparseTensorDenseMatMulOpTest, MultiThreadedMatchesSerial) {
+  // 2500 rows of B of 1100 columns, which span two column blocks.
+  for (bool adjoint_a : {false, true}) {
+    for (bool adjoint_b : {false, true}) {
+      MakeInputs(/*m=*/64, /*k=*/48, /*n=*/1100,
+                 RandomIndices(64, 48, /*nnz=*/2500, adjoint_a,
+                               /*skewed=*/false),
+                 adjoint_a, adjoint_b);
+      ExpectSameAsSerial();
+    }
+  }
+}
+
+TEST_F(SparseTensorDenseMatMulOpTest, MultiThreadedMatchesSerialOnSkewedRows) {
+  for (bool adjoint_a : {false, true}) {
+    for (bool adjoint_b : {false, true}) {
+      MakeInputs(/*m=*/256, /*k=*/128, /*n=*/96,
+                 RandomIndices(256, 128, /*nnz=*/4000, adjoint_a,
+                               /*skewed=*/true),
+                 adjoint_a, adjoint_b);
+      ExpectSameAsSerial();
+    }
+  }
+}
+
+TEST_F(SparseTensorDenseMatMulOpTest, MultiThreadedReportsSameOutOfBounds) {
+  for (bool adjoint_a : {false, true}) {
+    for (bool adjoint_b : {false, true}) {
+      // An out of bounds k or m in an entry after valid ones, and before
+      // another invalid one.
+      for (bool bad_k : {true, false}) {
+        std::vector<int64_t> indices =
+            RandomIndices(64, 48, /*nnz=*/2000, adjoint_a, /*skewed=*/false);
+        const int k_index = adjoint_a ? 0 : 1;
+        if (bad_k) {
+          indices[2 * 1500 + k_index] = 48;
+        } else {
+          indices[2 * 1500 + 1 - k_index] = 64;
+        }
+        indices[2 * 1700] = 1000;
+        MakeInputs(/*m=*/64, /*k=*/48, /*n=*/64, indices, adjoint_a,
+                   adjoint_b);
+        Tensor out;
+        const Status serial = Run(/*num_threads=*/1, &out);
+        const Status parallel = Run(/*num_threads=*/4, &out);
+        EXPECT_TRUE(errors::IsInvalidArgument(serial)) << serial;
+        EXPECT_EQ(serial, parallel);
+      }
+    }
+  }
+}
+
+}  // namespace
+
 Node* SparseTensorDenseMatMulNode(Graph* g, Node* a_indices, Node* a_values,
                                   Node* a_shape, Node* b, bool adjoint_a,
                                   bool adjoint_b) {
@@ -120,4 +269,64 @@ BM_SparseTensorDenseMatmul(16384, 4096, 4096, 4096, false, true);
 BM_SparseTensorDenseMatmul(16384, 4096, 4096, 4096, true, false);
 BM_SparseTensorDenseMatmul(16384, 4096, 4096, 4096, true, true);
 
+// A sparse embedding layer: `a` is [m, k] at the given density in per mille,
+// with the nonzeros of each row drawn from a power law so that a few rows
+// hold most of them, as in the feature crosses of a wide-and-deep model.
+static Graph* SkewedSparseTensorDenseMatmul(int m, int k, int n,
+                                            int density_per_mille,
+                                            bool adjoint_a) {
+  Graph* g = new Graph(OpRegistry::Global());
+  const int nnz = static_cast<int64_t>(m) * k * density_per_mille / 1000;
+  Tensor a_values(DT_FLOAT, TensorShape({nnz}));
+  Tensor a_indices(DT_INT64, TensorShape({nnz, 2}));
+  Tensor a_shape(DT_INT64, TensorShape({2}));
+  auto a_shape_t = a_shape.vec<int64_t>();
+  a_shape_t(0) = adjoint_a ? k : m;
+  a_shape_t(1) = adjoint_a ? m : k;
+  a_values.flat<float>().setRandom();
+  auto a_indices_t = a_indices.matrix<int64_t>();
+  std::mt19937 gen(1234);
+  std::uniform_real_distribution<> u(0, 1);
+  std::uniform_int_distribution<> k_dist(0, k - 1);
+  const int row_dim = adjoint_a ? 1 : 0;
+  for (int32_t i = 0; i < nnz; ++i) {
+    const double r = u(gen);
+    a_indices_t(i, row_dim) = static_cast<int64_t>(m * r * r * r);
+    a_indices_t(i, 1 - row_dim) = k_dist(gen);
+  }
+  Tensor b(DT_FLOAT, TensorShape({k, n}));
+  b.flat<float>().setRandom();
+
+  SparseTensorDenseMatMulNode(
+      g, test::graph::Constant(g, a_indices),
+      test::graph::Constant(g, a_values), test::graph::HostConstant(g, a_shape),
+      test::graph::Constant(g, b), adjoint_a, /*adjoint_b=*/false);
+  return g;
+}
+
+static void BM_SkewedSparseTensorDenseMatmul(
+    ::testing::benchmark::State& state) {
+  const int m = state.range(0);
+  const int k = state.range(1);
+  const int n = state.range(2);
+  const int density_per_mille = state.range(3);
+  const bool adjoint_a = state.range(4);
+  const int64_t items_per_iter =
+      static_cast<int64_t>(m) * k * density_per_mille / 1000 * n;
+  test::Benchmark("cpu",
+                  SkewedSparseTensorDenseMatmul(m, k, n, density_per_mille,
+                                                adjoint_a),
+                  /*old_benchmark_api*/ false)
+      .Run(state);
+  state.SetItemsProcessed(state.iterations() * items_per_iter);
+}
+
+BENCHMARK(BM_SkewedSparseTensorDenseMatmul)
+    ->UseRealTime()
+    ->Args({1024, 16384, 64, 10, false})
+    ->Args({1024, 16384, 64, 10, true})
+    ->Args({4096, 16384, 256, 10, false})
+    ->Args({4096, 16384, 256, 10, true})
+    ->Args({4096, 16384, 256, 1, false});
+
 }  // end namespace tensorflow
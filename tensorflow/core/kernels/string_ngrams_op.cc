@@ -16,23 +16,33 @@ limitations under the License.
 #include <algorithm>
 #include <locale>
 #include <string>
+#include <type_traits>
 
 #include "absl/strings/ascii.h"
 #include "absl/strings/str_cat.h"
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/op_requires.h"
 #include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/fingerprint.h"
+#include "tensorflow/core/platform/threadpool.h"
 #include "tensorflow/core/platform/types.h"
 
 namespace tensorflow {
 namespace text {
 
 namespace {
-template <typename SPLITS_TYPE>
+// Computes the ngrams of StringNGrams. With an int64 OUTPUT_TYPE, computes
+// their StringToHashBucketFast buckets instead (_StringNGramsHashBucketFast),
+// hashing each ngram from a scratch buffer reused by the whole batch instead of
+// materializing it as a tstring.
+template <typename SPLITS_TYPE, typename OUTPUT_TYPE = tstring>
 class StringNGramsOp : public tensorflow::OpKernel {
  public:
   explicit StringNGramsOp(tensorflow::OpKernelConstruction* context)
       : tensorflow::OpKernel(context) {
+    if (std::is_same<OUTPUT_TYPE, int64_t>::value) {
+      OP_REQUIRES_OK(context, context->GetAttr("num_buckets", &num_buckets_));
+    }
     OP_REQUIRES_OK(context, context->GetAttr("separator", &separator_));
     OP_REQUIRES_OK(context, context->GetAttr("ngram_widths", &ngram_widths_));
     OP_REQUIRES_OK(context, context->GetAttr("left_pad", &left_pad_));
@@ -111,6 +121,7 @@ class StringNGramsOp : public tensorflow::OpKernel {
       tensorflow::Tensor* empty;
       OP_REQUIRES_OK(context,
                      context->allocate_output(0, data->shape(), &empty));
+      InitializeEmpty(empty->flat<OUTPUT_TYPE>());
       for (int i = 0; i <= num_batch_items; ++i) {
         ngrams_splits_data[i] = 0;
       }
@@ -127,42 +138,6 @@ class StringNGramsOp : public tensorflow::OpKernel {
         num_ngrams += ngrams_or.value();
       }
       if (preserve_short_ && length > 0 && num_ngrams == 0) {
-        num_ngrams = 1;
-      }
-      ngrams_splits_data[i] = ngrams_splits_data[i - 1] + num_ngrams;
-    }
-
-    tensorflow::Tensor* ngrams;
-    OP_REQUIRES_OK(
-        context,
-        context->allocate_output(
-            0, TensorShape({ngrams_splits_data[num_batch_items]}), &ngrams));
-    auto ngrams_data = ngrams->flat<tstring>().data();
-
-    for (int i = 0; i < num_batch_items; ++i) {
-      auto data_start = &input_data[splits_vec(i)];
-      int output_start_idx = ngrams_splits_data[i];
-      for (int ngram_width : ngram_widths_) {
-        auto output_start = &ngrams_data[output_start_idx];
-        int length = splits_vec(i + 1) - splits_vec(i);
-        auto ngrams_or = get_num_ngrams(length, ngram_width);
-        OP_REQUIRES_OK(context, ngrams_or.status());
-        int num_ngrams = ngrams_or.value();
-        CreateNgrams(data_start, output_start, num_ngrams, ngram_width);
-        output_start_idx += num_ngrams;
-      }
-      // If we're preserving short sequences, check to see if no sequence was
-      // generated by comparing the current output start idx to the original
-      // one (ngram_splits_data). If no ngrams were generated, then they will
-      // be equal (since we increment output_start_idx by num_ngrams every
-      // time we create a set of ngrams.)
-      if (preserve_short_ && output_start_idx == ngrams_splits_data[i]) {
-        int data_length = splits_vec(i + 1) - splits_vec(i);
-        // One legitimate reason to not have any ngrams when preserve_short_
-        // is true is if the sequence itself is empty. In that case, move on.
-        if (data_length == 0) {
-          continue;
-        }
         // We don't have to worry about dynamic padding sizes here: if padding
         // was dynamic, every sequence would have had sufficient padding to
         // generate at least one ngram.
@@ -176,78 +151,155 @@ class StringNGramsOp : public tensorflow::OpKernel {
                                     "preserve_short_sequences is True and "
                                     "ngram_widths are not provided, got ",
                                     pad_width_));
-        int ngram_width = data_length + 2 * pad_width_;
-        auto output_start = &ngrams_data[output_start_idx];
-        int num_ngrams = 1;
-        CreateNgrams(data_start, output_start, num_ngrams, ngram_width);
+        num_ngrams = 1;
       }
+      ngrams_splits_data[i] = ngrams_splits_data[i - 1] + num_ngrams;
     }
+
+    tensorflow::Tensor* ngrams;
+    OP_REQUIRES_OK(
+        context,
+        context->allocate_output(
+            0, TensorShape({ngrams_splits_data[num_batch_items]}), &ngrams));
+    auto ngrams_data = ngrams->flat<OUTPUT_TYPE>().data();
+
+    // The number of ngrams of each batch item and their widths were validated
+    // above, so the batch items can be processed independently.
+    auto work = [&](int64_t begin, int64_t end) {
+      // Scratch buffer the hashed ngrams are built in.
+      std::string scratch;
+      for (int64_t i = begin; i < end; ++i) {
+        auto data_start = &input_data[splits_vec(i)];
+        int length = splits_vec(i + 1) - splits_vec(i);
+        int output_start_idx = ngrams_splits_data[i];
+        for (int ngram_width : ngram_widths_) {
+          auto output_start = &ngrams_data[output_start_idx];
+          int num_ngrams = get_num_ngrams(length, ngram_width).value();
+          CreateNgrams(data_start, output_start, num_ngrams, ngram_width,
+                       &scratch);
+          output_start_idx += num_ngrams;
+        }
+        // If we're preserving short sequences, check to see if no sequence was
+        // generated by comparing the current output start idx to the original
+        // one (ngram_splits_data). If no ngrams were generated, then they will
+        // be equal (since we increment output_start_idx by num_ngrams every
+        // time we create a set of ngrams.) One legitimate reason to not have
+        // any ngrams when preserve_short_ is true is if the sequence itself is
+        // empty. In that case, move on.
+        if (preserve_short_ && output_start_idx == ngrams_splits_data[i] &&
+            length > 0) {
+          int ngram_width = length + 2 * pad_width_;
+          auto output_start = &ngrams_data[output_start_idx];
+          CreateNgrams(data_start, output_start, /*num_ngrams=*/1, ngram_width,
+                       &scratch);
+        }
+      }
+    };
+    // Building an ngram costs roughly a few cycles per byte of its tokens.
+    const int64_t num_ngrams = ngrams_splits_data[num_batch_items];
+    const int64_t cost_per_item =
+        50 * (input_data_size + num_ngrams) / std::max(num_batch_items, 1);
+    context->device()->tensorflow_cpu_worker_threads()->workers->ParallelFor(
+        num_batch_items, cost_per_item, work);
+  }
+
+  void InitializeEmpty(TTypes<tstring>::Flat ngrams) const {}
+
+  void InitializeEmpty(TTypes<int64_t>::Flat ngrams) const {
+    ngrams.setConstant(Bucket(""));
+  }
+
+  int64_t Bucket(StringPiece ngram) const {
+    // The number of buckets is always in the positive range of int64, so is
+    // the bucket id.
+    return static_cast<int64_t>(Fingerprint64(ngram) % num_buckets_);
   }
 
   void CreateNgrams(const tstring* data, tstring* output, int num_ngrams,
-                    int ngram_width) const {
+                    int ngram_width, std::string* scratch) const {
     for (int ngram_index = 0; ngram_index < num_ngrams; ++ngram_index) {
-      int pad_width = get_pad_width(ngram_width);
-      int left_padding = std::max(0, pad_width - ngram_index);
-      int right_padding =
-          std::max(0, pad_width - (num_ngrams - (ngram_index + 1)));
-      int num_tokens = ngram_width - (left_padding + right_padding);
-      int data_start_index = left_padding > 0 ? 0 : ngram_index - pad_width;
-
-      // Calculate the total expected size of the ngram so we can reserve the
-      // correct amount of space in the string.
-      int ngram_size = 0;
-      // Size of the left padding.
-      ngram_size += left_padding * left_pad_.length();
-      // Size of the tokens.
-      for (int n = 0; n < num_tokens; ++n) {
-        ngram_size += data[data_start_index + n].length();
-      }
-      // Size of the right padding.
-      ngram_size += right_padding * right_pad_.length();
-      // Size of the separators.
-      int num_separators = left_padding + right_padding + num_tokens - 1;
-      ngram_size += num_separators * separator_.length();
-
-      // Build the ngram.
-      tstring* ngram = &output[ngram_index];
-      ngram->reserve(ngram_size);
-      for (int n = 0; n < left_padding; ++n) {
-        ngram->append(left_pad_);
-        ngram->append(separator_);
-      }
-      // Only output first num_tokens - 1 pairs of data and separator
-      for (int n = 0; n < num_tokens - 1; ++n) {
-        ngram->append(data[data_start_index + n]);
+      BuildNgram(data, ngram_index, num_ngrams, ngram_width,
+                 &output[ngram_index]);
+    }
+  }
+
+  void CreateNgrams(const tstring* data, int64_t* output, int num_ngrams,
+                    int ngram_width, std::string* scratch) const {
+    for (int ngram_index = 0; ngram_index < num_ngrams; ++ngram_index) {
+      // Clearing keeps the capacity of the buffer, so that only the longest
+      // ngrams of the batch allocate.
+      scratch->clear();
+      BuildNgram(data, ngram_index, num_ngrams, ngram_width, scratch);
+      output[ngram_index] = Bucket(*scratch);
+    }
+  }
+
+  // Appends the ngram at `ngram_index` to `ngram`.
+  template <typename STRING_TYPE>
+  void BuildNgram(const tstring* data, int ngram_index, int num_ngrams,
+                  int ngram_width, STRING_TYPE* ngram) const {
+    int pad_width = get_pad_width(ngram_width);
+    int left_padding = std::max(0, pad_width - ngram_index);
+    int right_padding =
+        std::max(0, pad_width - (num_ngrams - (ngram_index + 1)));
+    int num_tokens = ngram_width - (left_padding + right_padding);
+    int data_start_index = left_padding > 0 ? 0 : ngram_index - pad_width;
+
+    // Calculate the total expected size of the ngram so we can reserve the
+    // correct amount of space in the string.
+    int ngram_size = 0;
+    // Size of the left padding.
+    ngram_size += left_padding * left_pad_.length();
+    // Size of the tokens.
+    for (int n = 0; n < num_tokens; ++n) {
+      ngram_size += data[data_start_index + n].length();
+    }
+    // Size of the right padding.
+    ngram_size += right_padding * right_pad_.length();
+    // Size of the separators.
+    int num_separators = left_padding + right_padding + num_tokens - 1;
+    ngram_size += num_separators * separator_.length();
+
+    // Build the ngram.
+    const size_t initial_size = ngram->size();
+    ngram->reserve(initial_size + ngram_size);
+    for (int n = 0; n < left_padding; ++n) {
+      ngram->append(left_pad_);
+      ngram->append(separator_);
+    }
+    // Only output first num_tokens - 1 pairs of data and separator
+    for (int n = 0; n < num_tokens - 1; ++n) {
+      ngram->append(data[data_start_index + n].data(),
+                    data[data_start_index + n].size());
+      ngram->append(separator_);
+    }
+    // Handle case when there are no tokens or no right padding as these can
+    // result in consecutive separators.
+    if (num_tokens > 0) {
+      // If we have tokens, then output last and then pair each separator with
+      // the right padding that follows, to ensure ngram ends either with the
+      // token or with the right pad.
+      const tstring& last_token = data[data_start_index + num_tokens - 1];
+      ngram->append(last_token.data(), last_token.size());
+      for (int n = 0; n < right_padding; ++n) {
         ngram->append(separator_);
+        ngram->append(right_pad_);
       }
-      // Handle case when there are no tokens or no right padding as these can
-      // result in consecutive separators.
-      if (num_tokens > 0) {
-        // If we have tokens, then output last and then pair each separator with
-        // the right padding that follows, to ensure ngram ends either with the
-        // token or with the right pad.
-        ngram->append(data[data_start_index + num_tokens - 1]);
-        for (int n = 0; n < right_padding; ++n) {
-          ngram->append(separator_);
-          ngram->append(right_pad_);
-        }
-      } else {
-        // If we don't have tokens, then the last item inserted into the ngram
-        // has been the separator from the left padding loop above. Hence,
-        // output right pad and separator and make sure to finish with a
-        // padding, not a separator.
-        for (int n = 0; n < right_padding - 1; ++n) {
-          ngram->append(right_pad_);
-          ngram->append(separator_);
-        }
+    } else {
+      // If we don't have tokens, then the last item inserted into the ngram
+      // has been the separator from the left padding loop above. Hence,
+      // output right pad and separator and make sure to finish with a
+      // padding, not a separator.
+      for (int n = 0; n < right_padding - 1; ++n) {
         ngram->append(right_pad_);
+        ngram->append(separator_);
       }
-
-      // In debug mode only: validate that we've reserved enough space for the
-      // ngram.
-      DCHECK_EQ(ngram_size, ngram->size());
+      ngram->append(right_pad_);
     }
+
+    // In debug mode only: validate that we've reserved enough space for the
+    // ngram.
+    DCHECK_EQ(ngram_size, ngram->size() - initial_size);
   }
 
   string separator_;
@@ -259,6 +311,7 @@ class StringNGramsOp : public tensorflow::OpKernel {
 
   std::vector<int> ngram_widths_;
   int pad_width_;
+  int64_t num_buckets_ = 0;
 };
 
 }  // namespace
@@ -270,6 +323,14 @@ REGISTER_KERNEL_BUILDER(Name("StringNGrams")
                             .Device(tensorflow::DEVICE_CPU)
                             .TypeConstraint<int64_t>("Tsplits"),
                         StringNGramsOp<int64_t>);
+REGISTER_KERNEL_BUILDER(Name("_StringNGramsHashBucketFast")
+                            .Device(tensorflow::DEVICE_CPU)
+                            .TypeConstraint<int32>("Tsplits"),
+                        StringNGramsOp<int32, int64_t>);
+REGISTER_KERNEL_BUILDER(Name("_StringNGramsHashBucketFast")
+                            .Device(tensorflow::DEVICE_CPU)
+                            .TypeConstraint<int64_t>("Tsplits"),
+                        StringNGramsOp<int64_t, int64_t>);
 
 }  // namespace text
 }  // namespace tensorflow
@@ -25,6 +25,7 @@ limitations under the License.
 #include "tensorflow/core/kernels/ops_testutil.h"
 #include "tensorflow/core/lib/core/status.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/fingerprint.h"
 
 namespace tensorflow {
 namespace text {
@@ -578,6 +579,39 @@ TEST_F(NgramKernelTest, TestNoTokensNoPad) {
   assert_int64_equal(expected_splits, *GetOutput(1));
 }
 
+TEST_F(NgramKernelTest, TestHashBucketsOfPaddedBigrams) {
+  constexpr int kNumBuckets = 1 << 20;
+  TF_ASSERT_OK(NodeDefBuilder("tested_op", "_StringNGramsHashBucketFast")
+                   .Attr("separator", "|")
+                   .Attr("ngram_widths", {1, 2})
+                   .Attr("left_pad", "LP")
+                   .Attr("right_pad", "RP")
+                   .Attr("pad_width", -1)
+                   .Attr("preserve_short_sequences", false)
+                   .Attr("num_buckets", kNumBuckets)
+                   .Input(FakeInput())
+                   .Input(FakeInput())
+                   .Finalize(node_def()));
+  TF_ASSERT_OK(InitOp());
+  // Batch items are:
+  // 0: "a", "b", "c"
+  // 1:
+  // 2: "d"
+  AddInputFromArray<tstring>(TensorShape({4}), {"a", "b", "c", "d"});
+  AddInputFromArray<int64_t>(TensorShape({4}), {0, 3, 3, 4});
+  TF_ASSERT_OK(RunOpKernel());
+
+  std::vector<int64_t> expected_values;
+  for (const char* ngram : {"a", "b", "c", "LP|a", "a|b", "b|c", "c|RP",
+                            "LP|RP", "d", "LP|d", "d|RP"}) {
+    expected_values.push_back(Fingerprint64(ngram) % kNumBuckets);
+  }
+  std::vector<int64_t> expected_splits({0, 7, 8, 11});
+
+  assert_int64_equal(expected_values, *GetOutput(0));
+  assert_int64_equal(expected_splits, *GetOutput(1));
+}
+
 TEST_F(NgramKernelTest, ShapeFn) {
   ShapeInferenceTestOp op("StringNGrams");
   INFER_OK(op, "?;?", "[?];[?]");
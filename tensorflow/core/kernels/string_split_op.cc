@@ -28,39 +28,39 @@ limitations under the License.
 namespace tensorflow {
 namespace {
 // Split input string `str` based on a character delimiter.
-// Returns a vector of StringPieces which are valid as long as input `str`
-// is valid.
+// Appends StringPieces, which are valid as long as input `str` is valid, to
+// `result` and returns the number of tokens appended.
 // Note: The single character delimiter is a common case and is implemented as
 // a series of finds in the input string, making it much more efficient than
 // SplitOnCharSet.
 template <typename Predicate>
-std::vector<StringPiece> SplitOnChar(const tstring& str, const char delim,
-                                     Predicate p) {
-  std::vector<StringPiece> result;
+int64_t SplitOnChar(const tstring& str, const char delim, Predicate p,
+                    std::vector<StringPiece>* result) {
+  const size_t start_size = result->size();
   StringPiece text(str);
   auto f = text.find(delim);
   while (f != StringPiece::npos) {
     StringPiece token = text.substr(0, f);
     if (p(token)) {
-      result.emplace_back(token);
+      result->emplace_back(token);
     }
     text.remove_prefix(f + 1);
     f = text.find(delim);
   }
   if (p(text)) {
-    result.push_back(text);
+    result->push_back(text);
   }
-  return result;
+  return result->size() - start_size;
 }
 
 // Split input string `str` based on a set of character delimiters.
-// Returns a vector of StringPieces which are valid as long as input `str`
-// is valid.
+// Appends StringPieces, which are valid as long as input `str` is valid, to
+// `result` and returns the number of tokens appended.
 // Based on str_util::Split.
 template <typename Predicate>
-std::vector<StringPiece> SplitOnCharSet(const tstring& str,
-                                        const tstring& delim_set, Predicate p) {
-  std::vector<StringPiece> result;
+int64_t SplitOnCharSet(const tstring& str, const tstring& delim_set,
+                       Predicate p, std::vector<StringPiece>* result) {
+  const size_t start_size = result->size();
   StringPiece text(str);
   StringPiece delims(delim_set);
   size_t token_start = 0;
@@ -68,39 +68,39 @@ std::vector<StringPiece> SplitOnCharSet(const tstring& str,
     if ((i == text.size()) || (delims.find(text[i]) != StringPiece::npos)) {
       StringPiece token(text.data() + token_start, i - token_start);
       if (p(token)) {
-        result.emplace_back(token);
+        result->emplace_back(token);
       }
       token_start = i + 1;
     }
   }
-  return result;
+  return result->size() - start_size;
 }
 
 // Split input string `str` based on given delimiter.
-// Returns a vector of StringPieces which are valid as long as input `str`
-// is valid.
+// Appends StringPieces, which are valid as long as input `str` is valid, to
+// `result` and returns the number of tokens appended. Tokens of all inputs are
+// appended to the same vector, so splitting a batch does not allocate a
+// separate vector per input string.
 template <typename Predicate>
-std::vector<StringPiece> Split(const tstring& str, const tstring& delimiter,
-                               Predicate predicate) {
+int64_t Split(const tstring& str, const tstring& delimiter, Predicate predicate,
+              std::vector<StringPiece>* result) {
   if (str.empty()) {
-    return std::vector<StringPiece>();
+    return 0;
   }
   if (delimiter.empty()) {
-    std::vector<StringPiece> result;
-    result.resize(str.size());
     for (size_t i = 0; i < str.size(); ++i) {
-      result[i] = StringPiece(str.data() + i, 1);
+      result->emplace_back(str.data() + i, 1);
     }
-    return result;
+    return str.size();
   }
   if (delimiter.size() == 1) {
-    return SplitOnChar(str, delimiter[0], predicate);
+    return SplitOnChar(str, delimiter[0], predicate, result);
   }
-  return SplitOnCharSet(str, delimiter, predicate);
+  return SplitOnCharSet(str, delimiter, predicate, result);
 }
 
-std::vector<StringPiece> SplitV2(const tstring& str, StringPiece sep,
-                                 int maxsplit) {
+int64_t SplitV2(const tstring& str, StringPiece sep, int maxsplit,
+                std::vector<StringPiece>* result) {
   // This SplitV2 method matches the behavior of python's str.split:
   //   If sep is given, consecutive delimiters are not grouped together
   //   and are deemed to delimit empty strings (for example, '1,,2'.split(',')
@@ -115,12 +115,12 @@ std::vector<StringPiece> SplitV2(const tstring& str, StringPiece sep,
   //   splitting an empty string or a string consisting of just whitespace
   //   with a None separator returns [].
 
-  std::vector<StringPiece> result;
+  const size_t start_size = result->size();
 
   StringPiece text(str);
   if (maxsplit == 0) {
-    result.emplace_back(text);
-    return result;
+    result->emplace_back(text);
+    return 1;
   }
 
   if (sep.empty()) {
@@ -129,32 +129,32 @@ std::vector<StringPiece> SplitV2(const tstring& str, StringPiece sep,
     str_util::RemoveLeadingWhitespace(&text);
     int split = 0;
     while (str_util::ConsumeNonWhitespace(&text, &token)) {
-      result.push_back(token);
+      result->push_back(token);
       str_util::RemoveLeadingWhitespace(&text);
       ++split;
       if (maxsplit > 0 && split == maxsplit) {
-        result.push_back(text);
-        return result;
+        result->push_back(text);
+        return result->size() - start_size;
       }
     }
-    return result;
+    return result->size() - start_size;
   }
   auto p = std::search(text.begin(), text.end(), sep.begin(), sep.end());
   int split = 0;
   while (p != text.end()) {
     StringPiece token = text.substr(0, p - text.begin());
-    result.push_back(token);
+    result->push_back(token);
     text.remove_prefix(token.size());
     text.remove_prefix(sep.size());
     ++split;
     if (maxsplit > 0 && split == maxsplit) {
-      result.push_back(StringPiece(text));
-      return result;
+      result->push_back(StringPiece(text));
+      return result->size() - start_size;
     }
     p = std::search(text.begin(), text.end(), sep.begin(), sep.end());
   }
-  result.push_back(text);
-  return result;
+  result->push_back(text);
+  return result->size() - start_size;
 }
 
 }  // namespace
@@ -199,15 +199,13 @@ class StringSplitOp : public OpKernel {
     int64_t max_num_entries = 0;
     std::vector<int64_t> num_indices(batch_size);
     for (int64_t i = 0; i < batch_size; ++i) {
-      std::vector<StringPiece> parts =
-          skip_empty_ ? Split(input_vec(i), delimiter, str_util::SkipEmpty())
-                      : Split(input_vec(i), delimiter, str_util::AllowEmpty());
-      int64_t n_entries = parts.size();
+      int64_t n_entries =
+          skip_empty_
+              ? Split(input_vec(i), delimiter, str_util::SkipEmpty(), &tokens)
+              : Split(input_vec(i), delimiter, str_util::AllowEmpty(), &tokens);
       num_indices[i] = n_entries;
       output_size += n_entries;
       max_num_entries = std::max(max_num_entries, n_entries);
-      tokens.insert(tokens.end(), std::make_move_iterator(parts.begin()),
-                    std::make_move_iterator(parts.end()));
     }
 
     Tensor* sp_indices_t;
@@ -272,12 +270,10 @@ class StringSplitV2Op : public OpKernel {
     int64_t max_num_entries = 0;
     std::vector<int64_t> num_indices(batch_size);
     for (int64_t i = 0; i < batch_size; ++i) {
-      std::vector<StringPiece> parts = SplitV2(input_vec(i), sep, maxsplit_);
-      int64_t n_entries = parts.size();
+      int64_t n_entries = SplitV2(input_vec(i), sep, maxsplit_, &tokens);
       num_indices[i] = n_entries;
       output_size += n_entries;
       max_num_entries = std::max(max_num_entries, n_entries);
-      tokens.insert(tokens.end(), parts.begin(), parts.end());
     }
 
     Tensor* sp_indices_t;
@@ -13,6 +13,10 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
 
+#include <vector>
+
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
 #include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
 #include "tensorflow/core/framework/allocator.h"
 #include "tensorflow/core/framework/fake_input.h"
@@ -126,4 +130,102 @@ BENCHMARK(BM_StringSplitV2)
     ->Arg(128)
     ->Arg(256);
 
+// A typical tokenization pipeline: split sentences on whitespace and map each
+// token to a vocabulary bucket.
+Graph* SetupTokenizationGraph(const Tensor& input) {
+  Graph* g = new Graph(OpRegistry::Global());
+  Tensor sep(DT_STRING, TensorShape({}));
+  sep.flat<tstring>().setConstant(" ");
+
+  Node* split;
+  TF_CHECK_OK(NodeBuilder("string_split_op", "StringSplitV2")
+                  .Input(test::graph::Constant(g, input))
+                  .Input(test::graph::Constant(g, sep))
+                  .Finalize(g, &split));
+  TF_CHECK_OK(NodeBuilder("hash_bucket_op", "StringToHashBucketFast")
+                  .Input(split, 1)
+                  .Attr("num_buckets", 1 << 20)
+                  .Finalize(g, nullptr /* node */));
+  return g;
+}
+
+static void BM_Tokenization(::testing::benchmark::State& state) {
+  const int batch_size = state.range(0);
+
+  Tensor input = GetTestTensor(batch_size);
+  Graph* g = SetupTokenizationGraph(input);
+  test::Benchmark("cpu", g, /*old_benchmark_api*/ false).Run(state);
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          batch_size);
+}
+
+BENCHMARK(BM_Tokenization)
+    ->UseRealTime()
+    ->Arg(1)
+    ->Arg(64)
+    ->Arg(1024)
+    ->Arg(16384);
+
+// Bigrams of whitespace tokens mapped to vocabulary buckets, either by
+// StringNGrams -> StringToHashBucketFast or by the fused
+// _StringNGramsHashBucketFast, which doesn't materialize the bigrams.
+Graph* SetupNGramsHashBucketGraph(int batch_size, bool fused) {
+  std::vector<tstring> tokens;
+  std::vector<int64_t> splits = {0};
+  const Tensor input = GetTestTensor(batch_size);
+  auto sentences = input.flat<tstring>();
+  for (int i = 0; i < sentences.size(); ++i) {
+    const absl::string_view line(sentences(i).data(), sentences(i).size());
+    for (absl::string_view token :
+         absl::StrSplit(line, ' ', absl::SkipEmpty())) {
+      tokens.emplace_back(token);
+    }
+    splits.push_back(tokens.size());
+  }
+
+  Graph* g = new Graph(OpRegistry::Global());
+  Node* data = test::graph::Constant(g, test::AsTensor<tstring>(tokens));
+  Node* data_splits = test::graph::Constant(g, test::AsTensor<int64_t>(splits));
+  constexpr int kNumBuckets = 1 << 20;
+  NodeBuilder ngrams_builder(
+      "ngrams_op", fused ? "_StringNGramsHashBucketFast" : "StringNGrams");
+  ngrams_builder.Input(data)
+      .Input(data_splits)
+      .Attr("separator", " ")
+      .Attr("ngram_widths", {2})
+      .Attr("left_pad", "")
+      .Attr("right_pad", "")
+      .Attr("pad_width", 0)
+      .Attr("preserve_short_sequences", false);
+  if (fused) ngrams_builder.Attr("num_buckets", kNumBuckets);
+  Node* ngrams;
+  TF_CHECK_OK(ngrams_builder.Finalize(g, &ngrams));
+  if (!fused) {
+    TF_CHECK_OK(NodeBuilder("hash_bucket_op", "StringToHashBucketFast")
+                    .Input(ngrams, 0)
+                    .Attr("num_buckets", kNumBuckets)
+                    .Finalize(g, nullptr /* node */));
+  }
+  return g;
+}
+
+static void BM_NGramsHashBucket(::testing::benchmark::State& state) {
+  const int batch_size = state.range(0);
+  const bool fused = state.range(1);
+
+  Graph* g = SetupNGramsHashBucketGraph(batch_size, fused);
+  test::Benchmark("cpu", g, /*old_benchmark_api*/ false).Run(state);
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          batch_size);
+}
+
+BENCHMARK(BM_NGramsHashBucket)
+    ->UseRealTime()
+    ->ArgPair(64, false)
+    ->ArgPair(64, true)
+    ->ArgPair(1024, false)
+    ->ArgPair(1024, true)
+    ->ArgPair(16384, false)
+    ->ArgPair(16384, true);
+
 }  // end namespace tensorflow
@@ -16,6 +16,7 @@ limitations under the License.
 #ifndef TENSORFLOW_CORE_KERNELS_STRING_TO_HASH_BUCKET_FAST_OP_H_
 #define TENSORFLOW_CORE_KERNELS_STRING_TO_HASH_BUCKET_FAST_OP_H_
 
+#include <algorithm>
 #include <string>
 
 #include "tensorflow/core/framework/op_kernel.h"
@@ -23,6 +24,7 @@ limitations under the License.
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/core/status.h"
 #include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/threadpool.h"
 
 namespace tensorflow {
 
@@ -44,15 +46,36 @@ class StringToHashBucketOp : public OpKernel {
                                             &output_tensor));
     auto output_flat = output_tensor->flat<int64_t>();
 
-    typedef decltype(input_flat.size()) Index;
-    for (Index i = 0; i < input_flat.size(); ++i) {
-      const uint64 input_hash = hash(input_flat(i));
-      const uint64 bucket_id = input_hash % num_buckets_;
-      // The number of buckets is always in the positive range of int64 so is
-      // the resulting bucket_id. Casting the bucket_id from uint64 to int64 is
-      // safe.
-      output_flat(i) = static_cast<int64_t>(bucket_id);
+    const int64_t num_elements = input_flat.size();
+    if (num_elements == 0) return;
+
+    // Hashing is linear in the string length, so estimate the per-element
+    // cost from the first few strings; this keeps short vocab tokens from
+    // being split into shards that cost more to schedule than to hash.
+    constexpr int64_t kSampleSize = 16;
+    constexpr int64_t kCyclesPerByte = 2;
+    constexpr int64_t kCyclesPerElement = 20;
+    const int64_t num_samples = std::min(num_elements, kSampleSize);
+    int64_t sample_bytes = 0;
+    for (int64_t i = 0; i < num_samples; ++i) {
+      sample_bytes += input_flat(i).size();
     }
+    const int64_t cost_per_unit =
+        kCyclesPerElement + kCyclesPerByte * sample_bytes / num_samples;
+
+    auto work = [&input_flat, &output_flat, this](int64_t start, int64_t end) {
+      for (int64_t i = start; i < end; ++i) {
+        const uint64 input_hash = hash(input_flat(i));
+        const uint64 bucket_id = input_hash % num_buckets_;
+        // The number of buckets is always in the positive range of int64 so
+        // is the resulting bucket_id. Casting the bucket_id from uint64 to
+        // int64 is safe.
+        output_flat(i) = static_cast<int64_t>(bucket_id);
+      }
+    };
+    thread::ThreadPool* thread_pool =
+        context->device()->tensorflow_cpu_worker_threads()->workers;
+    thread_pool->ParallelFor(num_elements, cost_per_unit, work);
   }
 
  private:
@@ -14,8 +14,10 @@ limitations under the License.
 ==============================================================================*/
 
 #include <functional>
+#include <type_traits>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "absl/container/flat_hash_map.h"
 #include "tensorflow/core/framework/bounds_check.h"
@@ -26,6 +28,7 @@ limitations under the License.
 #include "tensorflow/core/lib/core/status.h"
 #include "tensorflow/core/lib/hash/hash.h"
 #include "tensorflow/core/platform/bfloat16.h"
+#include "tensorflow/core/platform/threadpool.h"
 
 namespace tensorflow {
 namespace {
@@ -68,6 +71,206 @@ struct UniqueOpHashMap<bfloat16, TIndex> {
   using map_type = std::unordered_map<bfloat16, TIndex>;
 };
 
+// Inputs with at least this many elements are uniquified with
+// `ParallelUniqueFlat()` when the element type supports it.
+constexpr int64_t kParallelUniqueMinElements = 64 * 1024;
+
+// Upper bound on the number of hash partitions used by `ParallelUniqueFlat()`.
+constexpr int kMaxUniquePartitions = 256;
+
+// Only integral element types take the partitioned path: they hash cheaply
+// into a partition id and `absl::flat_hash_map` handles them directly.
+template <typename T>
+struct UseParallelUnique
+    : std::integral_constant<bool, std::is_integral<T>::value &&
+                                       !std::is_same<T, bool>::value> {};
+
+// Maps `x` to one of `1 << log2_partitions` partitions using multiplicative
+// (Fibonacci) hashing. The function is branch-free, so the loop that applies it
+// to the whole input vectorizes on targets with 64-bit vector multiplies.
+template <typename T>
+inline uint8 UniquePartitionOf(T x, int log2_partitions) {
+  const uint64 h = static_cast<uint64>(static_cast<int64_t>(x)) *
+                   uint64{0x9E3779B97F4A7C15};
+  return static_cast<uint8>(log2_partitions == 0 ? 0
+                                                 : h >> (64 - log2_partitions));
+}
+
+// Computes the unique elements of `in` in parallel on `thread_pool`.
+//
+// The input is radix-partitioned by hash so that equal values always land in
+// the same partition. Each partition is then deduplicated independently with
+// its own hash map, visiting elements in increasing input position, and the
+// per-partition results are stitched together so that unique values are
+// numbered by first occurrence, exactly as in the serial implementation.
+//
+// On return `idx(i)` holds the output index of `in(i)`, and `first_pos`
+// holds the input position of the first occurrence of every unique value in
+// output order.
+template <typename T, typename TIndex>
+void ParallelUniqueFlat(typename TTypes<T>::ConstFlat in,
+                        typename TTypes<TIndex>::Vec idx,
+                        thread::ThreadPool* thread_pool,
+                        std::vector<int64_t>* first_pos) {
+  const int64_t n = in.size();
+  const int num_threads = thread_pool->NumThreads() + 1;
+  int log2_partitions = 0;
+  while ((1 << log2_partitions) < 2 * num_threads &&
+         (1 << log2_partitions) < kMaxUniquePartitions) {
+    ++log2_partitions;
+  }
+  const int num_partitions = 1 << log2_partitions;
+  const int64_t num_chunks = num_threads;
+  const int64_t chunk_size = (n + num_chunks - 1) / num_chunks;
+
+  // Hash every element to its partition.
+  std::vector<uint8> partition_of(n);
+  thread_pool->ParallelFor(
+      n, /*cost_per_unit=*/4, [&](int64_t start, int64_t limit) {
+        for (int64_t i = start; i < limit; ++i) {
+          partition_of[i] = UniquePartitionOf(in(i), log2_partitions);
+        }
+      });
+
+  // Histogram partition sizes per chunk and derive a stable scatter order:
+  // partition-major, then chunk, then input position.
+  std::vector<int64_t> offsets(num_chunks * num_partitions, 0);
+  thread_pool->ParallelFor(
+      num_chunks, /*cost_per_unit=*/chunk_size,
+      [&](int64_t start, int64_t limit) {
+        for (int64_t c = start; c < limit; ++c) {
+          int64_t* counts = &offsets[c * num_partitions];
+          const int64_t end = std::min(n, (c + 1) * chunk_size);
+          for (int64_t i = c * chunk_size; i < end; ++i) {
+            ++counts[partition_of[i]];
+          }
+        }
+      });
+  std::vector<int64_t> partition_begin(num_partitions + 1, 0);
+  int64_t running = 0;
+  for (int p = 0; p < num_partitions; ++p) {
+    partition_begin[p] = running;
+    for (int64_t c = 0; c < num_chunks; ++c) {
+      const int64_t count = offsets[c * num_partitions + p];
+      offsets[c * num_partitions + p] = running;
+      running += count;
+    }
+  }
+  partition_begin[num_partitions] = running;
+
+  std::vector<int64_t> order(n);
+  thread_pool->ParallelFor(
+      num_chunks, /*cost_per_unit=*/chunk_size,
+      [&](int64_t start, int64_t limit) {
+        for (int64_t c = start; c < limit; ++c) {
+          int64_t* next = &offsets[c * num_partitions];
+          const int64_t end = std::min(n, (c + 1) * chunk_size);
+          for (int64_t i = c * chunk_size; i < end; ++i) {
+            order[next[partition_of[i]]++] = i;
+          }
+        }
+      });
+
+  // Deduplicate each partition. `order` is ascending within a partition, so
+  // the first insertion of a value is its first occurrence in the input.
+  std::vector<int64_t> local_id(n);
+  std::vector<std::vector<int64_t>> partition_first_pos(num_partitions);
+  std::vector<uint8> is_first(n, 0);
+  thread_pool->ParallelFor(
+      num_partitions, /*cost_per_unit=*/(n / num_partitions + 1) * 32,
+      [&](int64_t start, int64_t limit) {
+        for (int64_t p = start; p < limit; ++p) {
+          const int64_t begin = partition_begin[p];
+          const int64_t end = partition_begin[p + 1];
+          std::vector<int64_t>& firsts = partition_first_pos[p];
+          absl::flat_hash_map<T, int64_t> uniq;
+          uniq.reserve(end - begin);
+          for (int64_t k = begin; k < end; ++k) {
+            const int64_t i = order[k];
+            auto it = uniq.emplace(in(i), static_cast<int64_t>(firsts.size()));
+            if (it.second) {
+              firsts.push_back(i);
+              is_first[i] = 1;
+            }
+            local_id[k] = it.first->second;
+          }
+        }
+      });
+
+  // Number the first occurrences in input order with a chunked prefix sum,
+  // writing the output index of each first occurrence into `idx`.
+  std::vector<int64_t> chunk_base(num_chunks + 1, 0);
+  thread_pool->ParallelFor(
+      num_chunks, /*cost_per_unit=*/chunk_size,
+      [&](int64_t start, int64_t limit) {
+        for (int64_t c = start; c < limit; ++c) {
+          const int64_t end = std::min(n, (c + 1) * chunk_size);
+          int64_t count = 0;
+          for (int64_t i = c * chunk_size; i < end; ++i) count += is_first[i];
+          chunk_base[c + 1] = count;
+        }
+      });
+  for (int64_t c = 0; c < num_chunks; ++c) chunk_base[c + 1] += chunk_base[c];
+  const int64_t num_unique = chunk_base[num_chunks];
+  first_pos->resize(num_unique);
+  thread_pool->ParallelFor(
+      num_chunks, /*cost_per_unit=*/chunk_size,
+      [&](int64_t start, int64_t limit) {
+        for (int64_t c = start; c < limit; ++c) {
+          const int64_t end = std::min(n, (c + 1) * chunk_size);
+          int64_t next = chunk_base[c];
+          for (int64_t i = c * chunk_size; i < end; ++i) {
+            if (is_first[i]) {
+              idx(i) = static_cast<TIndex>(next);
+              (*first_pos)[next] = i;
+              ++next;
+            }
+          }
+        }
+      });
+
+  // Scatter the output index of every element. Each partition only touches
+  // positions it owns, and first occurrences already hold their final value.
+  thread_pool->ParallelFor(
+      num_partitions, /*cost_per_unit=*/(n / num_partitions + 1) * 4,
+      [&](int64_t start, int64_t limit) {
+        for (int64_t p = start; p < limit; ++p) {
+          const std::vector<int64_t>& firsts = partition_first_pos[p];
+          for (int64_t k = partition_begin[p]; k < partition_begin[p + 1];
+               ++k) {
+            idx(order[k]) = idx(firsts[local_id[k]]);
+          }
+        }
+      });
+}
+
+// Dispatches to `ParallelUniqueFlat()` for element types that support it.
+// Returns false when the caller should use the serial implementation.
+template <typename T, typename TIndex>
+typename std::enable_if<UseParallelUnique<T>::value, bool>::type
+MaybeParallelUniqueFlat(OpKernelContext* context,
+                        typename TTypes<T>::ConstFlat in,
+                        typename TTypes<TIndex>::Vec idx,
+                        std::vector<int64_t>* first_pos) {
+  thread::ThreadPool* thread_pool =
+      context->device()->tensorflow_cpu_worker_threads()->workers;
+  if (in.size() < kParallelUniqueMinElements || thread_pool == nullptr ||
+      thread_pool->NumThreads() < 1) {
+    return false;
+  }
+  ParallelUniqueFlat<T, TIndex>(in, idx, thread_pool, first_pos);
+  return true;
+}
+
+template <typename T, typename TIndex>
+typename std::enable_if<!UseParallelUnique<T>::value, bool>::type
+MaybeParallelUniqueFlat(OpKernelContext* context,
+                        typename TTypes<T>::ConstFlat in,
+                        typename TTypes<TIndex>::Vec idx,
+                        std::vector<int64_t>* first_pos) {
+  return false;
+}
+
 // `UniqueOp` computes the unique elements in the input tensor.
 //
 // * `T` is the element type.
@@ -150,26 +353,41 @@ class UniqueOp : public OpKernel {
       auto Tin = input.flat<T>();
       const int64_t N = static_cast<int64_t>(Tin.size());
 
-      typename UniqueOpHashMap<T, TIndex>::map_type uniq;
-      uniq.reserve(2 * N);
-      for (Eigen::Index i = 0, j = 0; i < N; ++i) {
-        auto it = uniq.emplace(Tin(i), j);
-        idx_vec(i) = it.first->second;
-        if (it.second) {
-          ++j;
+      std::vector<int64_t> first_pos;
+      if (MaybeParallelUniqueFlat<T, TIndex>(context, Tin, idx_vec,
+                                             &first_pos)) {
+        uniq_size = static_cast<int64_t>(first_pos.size());
+        TensorShape output_shape(input.shape());
+        output_shape.set_dim(axis, uniq_size);
+        Tensor* output = nullptr;
+        OP_REQUIRES_OK(context,
+                       context->allocate_output(0, output_shape, &output));
+        auto Tout = output->flat<T>();
+        for (int64_t j = 0; j < uniq_size; ++j) {
+          Tout(j) = Tin(first_pos[j]);
+        }
+      } else {
+        typename UniqueOpHashMap<T, TIndex>::map_type uniq;
+        uniq.reserve(2 * N);
+        for (Eigen::Index i = 0, j = 0; i < N; ++i) {
+          auto it = uniq.emplace(Tin(i), j);
+          idx_vec(i) = it.first->second;
+          if (it.second) {
+            ++j;
+          }
         }
-      }
 
-      uniq_size = static_cast<int64_t>(uniq.size());
-      TensorShape output_shape(input.shape());
-      output_shape.set_dim(axis, uniq_size);
-      Tensor* output = nullptr;
-      OP_REQUIRES_OK(context,
-                     context->allocate_output(0, output_shape, &output));
-      auto Tout = output->flat<T>();
+        uniq_size = static_cast<int64_t>(uniq.size());
+        TensorShape output_shape(input.shape());
+        output_shape.set_dim(axis, uniq_size);
+        Tensor* output = nullptr;
+        OP_REQUIRES_OK(context,
+                       context->allocate_output(0, output_shape, &output));
+        auto Tout = output->flat<T>();
 
-      for (const auto& it : uniq) {
-        Tout(it.second) = it.first;
+        for (const auto& it : uniq) {
+          Tout(it.second) = it.first;
+        }
       }
     } else {
       // General implementation when unique is run over multiple elements.
@@ -13,13 +13,20 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
 
+#include <algorithm>
 #include <functional>
 #include <memory>
+#include <random>
+#include <vector>
 
+#include "absl/container/flat_hash_map.h"
 #include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def_builder.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor.pb.h"
 #include "tensorflow/core/framework/tensor_shape.pb.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
 #include "tensorflow/core/framework/types.h"
 #include "tensorflow/core/framework/types.pb.h"
 #include "tensorflow/core/graph/algorithm.h"
@@ -37,6 +44,83 @@ namespace {
 
 const int kMaxStrLen = 40;
 
+class UniqueOpTest : public OpsTestBase {
+ protected:
+  void MakeOp(const string& op_name, DataType type, DataType out_idx) {
+    TF_ASSERT_OK(NodeDefBuilder("unique", op_name)
+                     .Input(FakeInput(type))
+                     .Attr("out_idx", out_idx)
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+  }
+};
+
+// Checks the outputs of `UniqueWithCounts` for `input` against a serial
+// reference that numbers unique values by first occurrence.
+template <typename T, typename TIndex>
+void ExpectUniqueWithCounts(const std::vector<T>& input, const Tensor& y,
+                            const Tensor& idx, const Tensor& count) {
+  absl::flat_hash_map<T, TIndex> first;
+  std::vector<T> expected_y;
+  std::vector<TIndex> expected_idx;
+  std::vector<TIndex> expected_count;
+  for (const T& x : input) {
+    auto it = first.emplace(x, static_cast<TIndex>(expected_y.size()));
+    if (it.second) {
+      expected_y.push_back(x);
+      expected_count.push_back(0);
+    }
+    expected_idx.push_back(it.first->second);
+    ++expected_count[it.first->second];
+  }
+  test::ExpectTensorEqual<T>(
+      test::AsTensor<T>(expected_y, {static_cast<int64_t>(expected_y.size())}),
+      y);
+  test::ExpectTensorEqual<TIndex>(test::AsTensor<TIndex>(expected_idx), idx);
+  test::ExpectTensorEqual<TIndex>(
+      test::AsTensor<TIndex>(expected_count,
+                             {static_cast<int64_t>(expected_count.size())}),
+      count);
+}
+
+TEST_F(UniqueOpTest, SmallInt64) {
+  MakeOp("UniqueWithCounts", DT_INT64, DT_INT32);
+  const std::vector<int64_t> input = {7, -1, 7, 3, -1, 0, 3, 7};
+  AddInputFromArray<int64_t>(TensorShape({8}), input);
+  TF_ASSERT_OK(RunOpKernel());
+  ExpectUniqueWithCounts<int64_t, int32>(input, *GetOutput(0), *GetOutput(1),
+                                         *GetOutput(2));
+}
+
+// Large inputs take the partitioned, multi-threaded path. The result must be
+// identical to the serial implementation, including output order.
+TEST_F(UniqueOpTest, LargeInt64Parallel) {
+  MakeOp("UniqueWithCounts", DT_INT64, DT_INT64);
+  const int64_t n = 1 << 20;
+  std::mt19937_64 rng(42);
+  std::vector<int64_t> input(n);
+  for (int64_t i = 0; i < n; ++i) {
+    input[i] = static_cast<int64_t>(rng() % (n / 8)) - n / 16;
+  }
+  AddInputFromArray<int64_t>(TensorShape({n}), input);
+  TF_ASSERT_OK(RunOpKernel());
+  ExpectUniqueWithCounts<int64_t, int64_t>(input, *GetOutput(0), *GetOutput(1),
+                                           *GetOutput(2));
+}
+
+TEST_F(UniqueOpTest, LargeInt32AllDistinct) {
+  MakeOp("UniqueWithCounts", DT_INT32, DT_INT32);
+  const int64_t n = 300 * 1000;
+  std::vector<int32> input(n);
+  for (int64_t i = 0; i < n; ++i) {
+    input[i] = static_cast<int32>((i * 7919) % n);
+  }
+  AddInputFromArray<int32>(TensorShape({n}), input);
+  TF_ASSERT_OK(RunOpKernel());
+  ExpectUniqueWithCounts<int32, int32>(input, *GetOutput(0), *GetOutput(1),
+                                       *GetOutput(2));
+}
+
 TensorProto GetRandomInt32TensorProto(int dim, int max_int) {
   TensorProto tensor_proto;
   tensor_proto.set_dtype(DT_INT32);
@@ -149,6 +233,38 @@ void BM_Unique_STRING(::testing::benchmark::State& state) {
                           sizeof(tstring));
 }
 
+// Benchmarks `Unique` on int64 ids, as produced ahead of an embedding lookup,
+// where `state.range(1)` is the percentage of duplicate ids in the input. The
+// default executor is used so that the kernel can use the device thread pool.
+void BM_Unique_INT64_DuplicateRate(::testing::benchmark::State& state) {
+  const int dim = state.range(0);
+  const int duplicate_percent = state.range(1);
+  const int64_t num_distinct =
+      std::max<int64_t>(1, dim * (100 - duplicate_percent) / 100);
+
+  Graph* g = new Graph(OpRegistry::Global());
+
+  Tensor input(DT_INT64, TensorShape({dim}));
+  auto input_flat = input.flat<int64_t>();
+  std::mt19937_64 rng(0);
+  for (int i = 0; i < dim; ++i) {
+    // Spread the ids over the whole int64 range.
+    input_flat(i) = static_cast<int64_t>((rng() % num_distinct) *
+                                         uint64{0x9E3779B97F4A7C15});
+  }
+
+  Node* node;
+  TF_CHECK_OK(NodeBuilder(g->NewName("n"), "Unique")
+                  .Input(test::graph::Constant(g, input))
+                  .Attr("T", DT_INT64)
+                  .Finalize(g, &node));
+  FixupSourceAndSinkEdges(g);
+
+  test::Benchmark("cpu", g, /*old_benchmark_api*/ false).Run(state);
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * dim *
+                          sizeof(int64_t));
+}
+
 BENCHMARK(BM_Unique_INT32)
     ->UseRealTime()
     ->ArgPair(32, 1024 * 1024)
@@ -193,6 +309,18 @@ BENCHMARK(BM_Unique_INT32_Repeat)
     ->ArgPair(64 * 1024, 64 * 1024 * 1024)
     ->ArgPair(1024 * 1024, 64 * 1024 * 1024);
 
+BENCHMARK(BM_Unique_INT64_DuplicateRate)
+    ->UseRealTime()
+    ->ArgPair(16 * 1024, 0)
+    ->ArgPair(16 * 1024, 50)
+    ->ArgPair(16 * 1024, 90)
+    ->ArgPair(1024 * 1024, 0)
+    ->ArgPair(1024 * 1024, 50)
+    ->ArgPair(1024 * 1024, 90)
+    ->ArgPair(1024 * 1024, 99)
+    ->ArgPair(4 * 1024 * 1024, 50)
+    ->ArgPair(4 * 1024 * 1024, 90);
+
 BENCHMARK(BM_Unique_STRING)
     ->UseRealTime()
     ->Arg(32)
@@ -339,6 +339,38 @@ REGISTER_OP("_UnaryOpsComposition")
 expected to create these operators.
 )doc");
 
+REGISTER_OP("_FusedCwise")
+    .Input("args: N * T")
+    .Output("y: T")
+    .Attr("T: {float, half, double}")
+    .Attr("N: int >= 1")
+    .Attr("op_names: list(string)")
+    .Attr("operands: list(int)")
+    .SetShapeFn([](InferenceContext* c) {
+      ShapeHandle out = c->Scalar();
+      for (int i = 0; i < c->num_inputs(); ++i) {
+        TF_RETURN_IF_ERROR(BroadcastBinaryOpOutputShapeFnHelper(
+            c, out, c->input(i), /*incompatible_shape_error=*/true, &out));
+      }
+      c->set_output(0, out);
+      return OkStatus();
+    })
+    .Doc(R"doc(
+Evaluates a DAG of elementwise ops in a single pass over memory.
+
+`op_names` lists the ops of the DAG in topological order. Their operands are
+given by `operands`, one entry per op argument, where `0 <= k < N` refers to
+`args[k]` and `k >= N` refers to the result of op `k - N`. The result of the
+last op is the output, whose shape is the broadcast shape of `args`. Every
+argument must either have the output shape, be a scalar, or be broadcast along
+the outer dimensions of the output: once its leading dimensions of size 1 are
+dropped, its shape must equal the innermost dimensions of the output (e.g. a
+bias vector of the size of the last dimension).
+
+*NOTE*: Do not invoke this operator directly in Python. Graph rewrite pass is
+expected to create these operators.
+)doc");
+
 #undef UNARY
 #undef UNARY_REAL
 #undef UNARY_COMPLEX
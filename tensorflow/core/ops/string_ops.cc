@@ -402,4 +402,35 @@ REGISTER_OP("StringNGrams")
       return OkStatus();
     });
 
+REGISTER_OP("_StringNGramsHashBucketFast")
+    .Attr("separator: string")
+    .Attr("ngram_widths: list(int) >= 0")
+    .Attr("left_pad: string")
+    .Attr("right_pad: string")
+    .Attr("pad_width: int")
+    .Attr("preserve_short_sequences: bool")
+    .Attr("Tsplits: {int32, int64} = DT_INT64")
+    .Attr("num_buckets: int >= 1")
+    .Input("data: string")
+    .Input("data_splits: Tsplits")
+    .Output("ngrams: int64")
+    .Output("ngrams_splits: Tsplits")
+    .SetShapeFn([](InferenceContext* c) {
+      c->set_output(0, c->UnknownShapeOfRank(1));
+      ShapeHandle data = c->input(0);
+      TF_RETURN_IF_ERROR(c->WithRank(data, 1, &data));
+      ShapeHandle data_splits = c->input(1);
+      TF_RETURN_IF_ERROR(c->WithRank(data_splits, 1, &data_splits));
+      c->set_output(1, data_splits);
+      return OkStatus();
+    })
+    .Doc(R"doc(
+Internal operation which is a composition of StringNGrams and
+StringToHashBucketFast on its ngrams: reserved for internal use. The ngrams are
+hashed as they are built instead of being materialized as a string tensor.
+
+Do not invoke this operator directly in Python. A fusion optimization is
+expected to create these operators.
+)doc");
+
 }  // namespace tensorflow
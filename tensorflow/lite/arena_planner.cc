@@ -34,16 +34,60 @@ namespace {
 constexpr int32_t kLastActiveNodeUndefined =
     std::numeric_limits<int32_t>::max();
 constexpr int32_t kNodeNotAssigned = std::numeric_limits<int32_t>::max();
-
-bool ShareFirstInputWithFirstOutputForNode(const TfLiteRegistration& node_reg) {
+// Number of arena layouts cached for different input shapes.
+constexpr size_t kMaxArenaLayouts = 8;
+
+// How the output of an op may share the buffer of one of its inputs.
+enum class TensorSharing {
+  kNone,
+  // The first output is a view of the first input, which is never modified.
+  // Both share the same buffer for as long as either of them is alive.
+  kAlias,
+  // The output is computed elementwise from inputs of the same shape, so it may
+  // be computed in place of an input that isn't used afterwards.
+  kInplace,
+};
+
+TensorSharing GetTensorSharing(const TfLiteRegistration& node_reg) {
   // TODO (b/254230751): add support for more ops which support forwarding.
   switch (node_reg.builtin_code) {
     case kTfLiteBuiltinExpandDims:
     case kTfLiteBuiltinReshape:
     case kTfLiteBuiltinSqueeze:
-      return true;
+      return TensorSharing::kAlias;
+    case kTfLiteBuiltinAbs:
+    case kTfLiteBuiltinAdd:
+    case kTfLiteBuiltinCeil:
+    case kTfLiteBuiltinCos:
+    case kTfLiteBuiltinDiv:
+    case kTfLiteBuiltinElu:
+    case kTfLiteBuiltinExp:
+    case kTfLiteBuiltinFloor:
+    case kTfLiteBuiltinGelu:
+    case kTfLiteBuiltinHardSwish:
+    case kTfLiteBuiltinLeakyRelu:
+    case kTfLiteBuiltinLog:
+    case kTfLiteBuiltinLogistic:
+    case kTfLiteBuiltinMaximum:
+    case kTfLiteBuiltinMinimum:
+    case kTfLiteBuiltinMul:
+    case kTfLiteBuiltinNeg:
+    case kTfLiteBuiltinQuantize:
+    case kTfLiteBuiltinRelu:
+    case kTfLiteBuiltinRelu0To1:
+    case kTfLiteBuiltinRelu6:
+    case kTfLiteBuiltinReluN1To1:
+    case kTfLiteBuiltinRound:
+    case kTfLiteBuiltinRsqrt:
+    case kTfLiteBuiltinSin:
+    case kTfLiteBuiltinSqrt:
+    case kTfLiteBuiltinSquare:
+    case kTfLiteBuiltinSquaredDifference:
+    case kTfLiteBuiltinSub:
+    case kTfLiteBuiltinTanh:
+      return TensorSharing::kInplace;
     default:
-      return false;
+      return TensorSharing::kNone;
   }
 }
 }  // namespace
@@ -51,14 +95,15 @@ bool ShareFirstInputWithFirstOutputForNode(const TfLiteRegistration& node_reg) {
 ArenaPlanner::ArenaPlanner(TfLiteContext* context,
                            std::unique_ptr<GraphInfo> graph_info,
                            bool preserve_all_tensors, int tensor_alignment,
-                           int subgraph_index)
+                           int subgraph_index, bool optimize_arena)
     : context_(context),
       graph_info_(std::move(graph_info)),
       arena_(kDefaultArenaAlignment, subgraph_index),
       persistent_arena_(kDefaultArenaAlignment, subgraph_index),
       preserve_all_tensors_(preserve_all_tensors),
       tensor_alignment_(tensor_alignment),
-      last_active_node_(kLastActiveNodeUndefined) {}
+      last_active_node_(kLastActiveNodeUndefined),
+      optimize_arena_(optimize_arena) {}
 
 ArenaPlanner::~ArenaPlanner() {
   arena_.ReleaseBuffer();
@@ -80,6 +125,8 @@ TfLiteStatus ArenaPlanner::ResetAllocations() {
   TF_LITE_ENSURE_STATUS(persistent_arena_.ClearPlan());
   allocs_.clear();
   allocs_.resize(graph_info_->num_tensors());
+  inplace_tensor_id_.clear();
+  inplace_last_node_.clear();
   // NOMUTANTS -- Setting last_active_node_ to kLastActiveNodeUndefined causes
   // all allocs to be cleared. if this is not set, the slow path is taken
   // (Purge) which inspects each alloc. Both paths give the exact same result.
@@ -104,6 +151,21 @@ TfLiteStatus ArenaPlanner::ResetAllocationsAfter(int node) {
     arena_.PurgeAfter(node);
   }
   last_active_node_ = node;
+
+  // Ops after `node` are computed in place again only if that's still valid
+  // for the new tensor sizes.
+  for (auto it = inplace_tensor_id_.begin(); it != inplace_tensor_id_.end();) {
+    if (alloc_node_[it->first] > node) {
+      it = inplace_tensor_id_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  inplace_last_node_.clear();
+  for (const auto& [output, owner] : inplace_tensor_id_) {
+    inplace_last_node_[owner] =
+        std::max(LastNodeOfBuffer(owner), dealloc_node_[output]);
+  }
   return kTfLiteOk;
 }
 
@@ -115,6 +177,23 @@ int ArenaPlanner::FindSharedTensor(int tensor_index) {
   return tensor_index;
 }
 
+int ArenaPlanner::FindBufferOwner(int tensor_index) {
+  // In-place tensors map to the owner of their buffer directly, but aliases
+  // may refer to in-place tensors, and the other way around.
+  while (true) {
+    tensor_index = FindSharedTensor(tensor_index);
+    auto inplace_tensor_it = inplace_tensor_id_.find(tensor_index);
+    if (inplace_tensor_it == inplace_tensor_id_.end()) return tensor_index;
+    tensor_index = inplace_tensor_it->second;
+  }
+}
+
+int32_t ArenaPlanner::LastNodeOfBuffer(int32_t tensor_index) const {
+  auto it = inplace_last_node_.find(tensor_index);
+  return it != inplace_last_node_.end() ? it->second
+                                        : dealloc_node_[tensor_index];
+}
+
 void ArenaPlanner::IdentifySharedTensors() {
   actual_tensor_id_.clear();
   TfLiteTensor* tensors = graph_info_->tensors();
@@ -122,7 +201,7 @@ void ArenaPlanner::IdentifySharedTensors() {
   for (int i = 0; i < num_execution_nodes; ++i) {
     const auto& reg = graph_info_->registration(i);
     const auto& tflite_node = graph_info_->node(i);
-    if (ShareFirstInputWithFirstOutputForNode(reg)) {
+    if (GetTensorSharing(reg) == TensorSharing::kAlias) {
       int32_t input_tensor = tflite_node.inputs->data[0];
       int32_t output_tensor = tflite_node.outputs->data[0];
       bool is_input_or_output_tensor = false;
@@ -157,10 +236,74 @@ void ArenaPlanner::IdentifySharedTensors() {
   }
 }
 
+void ArenaPlanner::IdentifyInplaceTensors(int first_node, int last_node) {
+  TfLiteTensor* tensors = graph_info_->tensors();
+  const int num_execution_nodes = graph_info_->num_execution_nodes();
+  for (int i = first_node; i <= last_node && i < num_execution_nodes; ++i) {
+    if (GetTensorSharing(graph_info_->registration(i)) !=
+        TensorSharing::kInplace) {
+      continue;
+    }
+    // Nodes running concurrently keep all their tensors alive.
+    const auto concurrent_nodes = graph_info_->concurrent_nodes(i);
+    if (concurrent_nodes.first != static_cast<size_t>(i) ||
+        concurrent_nodes.second != static_cast<size_t>(i)) {
+      continue;
+    }
+    const TfLiteNode& node = graph_info_->node(i);
+    if (node.outputs->size != 1) continue;
+    const int32_t output_tensor = node.outputs->data[0];
+    if (output_tensor == kTfLiteOptionalTensor) continue;
+    const TfLiteTensor& output = tensors[output_tensor];
+    // Graph outputs, and tensors which aren't used, are never deallocated.
+    if (output.allocation_type != kTfLiteArenaRw || output.bytes == 0 ||
+        allocs_[output_tensor].size != 0 ||
+        dealloc_node_[output_tensor] == kNodeNotAssigned ||
+        inplace_tensor_id_.count(output_tensor) != 0) {
+      continue;
+    }
+
+    // Ops broadcasting their inputs don't compute their output elementwise.
+    bool is_elementwise = true;
+    for (int j = 0; j < node.inputs->size; ++j) {
+      const int32_t input_tensor = node.inputs->data[j];
+      if (input_tensor != kTfLiteOptionalTensor &&
+          !TfLiteIntArrayEqual(tensors[input_tensor].dims, output.dims)) {
+        is_elementwise = false;
+      }
+    }
+    if (!is_elementwise) continue;
+
+    for (int j = 0; j < node.inputs->size; ++j) {
+      const int32_t input_tensor = node.inputs->data[j];
+      if (input_tensor == kTfLiteOptionalTensor) continue;
+      const int32_t owner = FindBufferOwner(input_tensor);
+      if (tensors[input_tensor].allocation_type != kTfLiteArenaRw ||
+          tensors[owner].allocation_type != kTfLiteArenaRw ||
+          tensors[input_tensor].bytes != output.bytes ||
+          tensors[owner].bytes != output.bytes) {
+        continue;
+      }
+      // The buffer must not be used by any other node afterwards. Graph inputs
+      // and variables are never deallocated, so they are never overwritten.
+      // The buffer must also be allocated along with the output, so that its
+      // usage interval can be extended to the one of the output.
+      if (LastNodeOfBuffer(owner) != i || allocs_[owner].size != 0 ||
+          alloc_node_[owner] < first_node) {
+        continue;
+      }
+      inplace_tensor_id_[output_tensor] = owner;
+      inplace_last_node_[owner] = dealloc_node_[output_tensor];
+      break;
+    }
+  }
+}
+
 TfLiteStatus ArenaPlanner::PlanAllocations() {
   // Invalidate any existing data.
   const size_t num_tensors = graph_info_->num_tensors();
   TF_LITE_ENSURE_STATUS(ResetAllocations());
+  arena_layouts_.clear();
   // Maybe other verb instead of 'Assigned'
   alloc_node_.assign(num_tensors, kNodeNotAssigned);
   dealloc_node_.assign(num_tensors, kNodeNotAssigned);
@@ -270,6 +413,21 @@ TfLiteStatus ArenaPlanner::PlanAllocations() {
       }
     }
   }
+
+  // The tensors of nodes which may run concurrently are allocated before the
+  // first of these nodes runs, and deallocated after the last one.
+  for (size_t tensor_index = 0; tensor_index < num_tensors; ++tensor_index) {
+    if (alloc_node_[tensor_index] != kNodeNotAssigned) {
+      const int32_t first_node =
+          graph_info_->concurrent_nodes(alloc_node_[tensor_index]).first;
+      alloc_node_[tensor_index] = first_node;
+      nodes_to_tensors_[first_node].insert(tensor_index);
+    }
+    if (dealloc_node_[tensor_index] != kNodeNotAssigned) {
+      dealloc_node_[tensor_index] =
+          graph_info_->concurrent_nodes(dealloc_node_[tensor_index]).second;
+    }
+  }
   // Note that graph outputs will never be scheduled for deallocation. We
   // could do that here for completeness, but it won't have any effect.
   return kTfLiteOk;
@@ -289,16 +447,21 @@ TfLiteStatus ArenaPlanner::ExecuteAllocations(int first_node, int last_node) {
        i <= static_cast<size_t>(last_node) && i < num_execution_nodes; ++i) {
     const TfLiteNode& node = graph_info_->node(i);
     TfLiteIntArray* node_temporaries = node.temporaries;
+    const auto concurrent_nodes = graph_info_->concurrent_nodes(i);
     for (int j = 0; j < node_temporaries->size; ++j) {
       int tensor_index = node_temporaries->data[j];
-      alloc_node_[tensor_index] = i;
-      nodes_to_tensors_[i].insert(tensor_index);
+      alloc_node_[tensor_index] = concurrent_nodes.first;
+      nodes_to_tensors_[concurrent_nodes.first].insert(tensor_index);
       if (!preserve_all_tensors_) {
-        dealloc_node_[tensor_index] = i;
+        dealloc_node_[tensor_index] = concurrent_nodes.second;
       }
     }
   }
 
+  if (optimize_arena_) {
+    IdentifyInplaceTensors(first_node, last_node);
+  }
+
   std::vector<int32_t> tensors_allocated;
   TF_LITE_ENSURE_STATUS(
       CalculateAllocations(first_node, last_node, &tensors_allocated));
@@ -407,6 +570,64 @@ void ArenaPlanner::CreateTensorAllocationVector(
             tensor_compare);
 }
 
+void ArenaPlanner::SortTensorsByBreadth(
+    std::vector<int32_t>* tensors_to_allocate) {
+  const TfLiteTensor* tensors = graph_info_->tensors();
+  const int32_t num_nodes =
+      std::max(static_cast<int32_t>(graph_info_->num_execution_nodes()), 1);
+  auto first_node = [&](int32_t tensor_index) {
+    return std::min(alloc_node_[tensor_index], num_nodes - 1);
+  };
+  auto last_node = [&](int32_t tensor_index) {
+    return std::max(std::min(LastNodeOfBuffer(tensor_index), num_nodes - 1),
+                    first_node(tensor_index));
+  };
+
+  // The breadth of a node is the total size of the tensors alive at the node.
+  std::vector<size_t> breadth(num_nodes + 1, 0);
+  for (int32_t tensor_index : *tensors_to_allocate) {
+    breadth[first_node(tensor_index)] += tensors[tensor_index].bytes;
+    breadth[last_node(tensor_index) + 1] -= tensors[tensor_index].bytes;
+  }
+  for (int32_t i = 1; i < num_nodes; ++i) breadth[i] += breadth[i - 1];
+  breadth.pop_back();
+
+  // Sparse table to find the widest node in the usage interval of a tensor.
+  std::vector<std::vector<size_t>> widest = {breadth};
+  for (int32_t k = 1; (1 << k) <= num_nodes; ++k) {
+    const std::vector<size_t>& previous = widest.back();
+    std::vector<size_t> current(num_nodes - (1 << k) + 1);
+    for (size_t i = 0; i < current.size(); ++i) {
+      current[i] = std::max(previous[i], previous[i + (1 << (k - 1))]);
+    }
+    widest.push_back(std::move(current));
+  }
+  std::unordered_map<int32_t, size_t> max_breadth;
+  for (int32_t tensor_index : *tensors_to_allocate) {
+    const int32_t first = first_node(tensor_index);
+    const int32_t last = last_node(tensor_index);
+    int32_t k = 0;
+    while ((2 << k) <= last - first + 1) ++k;
+    max_breadth[tensor_index] =
+        std::max(widest[k][first], widest[k][last - (1 << k) + 1]);
+  }
+
+  auto tensor_compare = [&](int idx1, int idx2) {
+    if (max_breadth[idx1] != max_breadth[idx2]) {
+      return max_breadth[idx1] > max_breadth[idx2];
+    }
+    if (tensors[idx1].bytes != tensors[idx2].bytes) {
+      return tensors[idx1].bytes > tensors[idx2].bytes;
+    }
+    if (alloc_node_[idx1] != alloc_node_[idx2]) {
+      return alloc_node_[idx1] < alloc_node_[idx2];
+    }
+    return idx1 < idx2;
+  };
+  std::sort(tensors_to_allocate->begin(), tensors_to_allocate->end(),
+            tensor_compare);
+}
+
 std::vector<int32_t> ArenaPlanner::GetTensorsToAllocate(int first_node,
                                                         int last_node) {
   int num_tensors = static_cast<int>(graph_info_->num_tensors());
@@ -445,7 +666,9 @@ TfLiteStatus ArenaPlanner::CalculateAllocations(
     last_active_node_ = last_node;
     return kTfLiteOk;
   }
-  if (first_node < last_active_node_) {
+  // The tensors of the first nodes to allocate are allocated in an empty arena.
+  const bool arena_is_empty = first_node < last_active_node_;
+  if (arena_is_empty) {
     arena_.ResetAllocs();
     last_active_node_ = first_node;
   } else {
@@ -454,9 +677,12 @@ TfLiteStatus ArenaPlanner::CalculateAllocations(
     arena_.PurgeActiveAllocs(first_node);
   }
   CreateTensorAllocationVector(tensors_allocated);
-  // Vector of ids of already allocated tensors, ordered by offset.
+  // Tensors to allocate in `arena_`, in the order of `tensors_allocated`.
+  std::vector<int32_t> arena_tensors;
   for (const auto& tensor_index : *tensors_allocated) {
     TfLiteTensor& tensor = tensors[tensor_index];
+    // Don't allocate the tensors computed in place of their input.
+    if (inplace_tensor_id_.count(tensor_index) != 0) continue;
     // Only allocate ArenaRw tensors which own their buffer.
     auto it = actual_tensor_id_.find(tensor_index);
     if (it != actual_tensor_id_.end()) {
@@ -475,10 +701,7 @@ TfLiteStatus ArenaPlanner::CalculateAllocations(
       }
     }
     if (tensor.allocation_type == kTfLiteArenaRw) {
-      TF_LITE_ENSURE_STATUS(
-          arena_.Allocate(context_, tensor_alignment_, tensor.bytes,
-                          tensor_index, alloc_node_[tensor_index],
-                          dealloc_node_[tensor_index], &allocs_[tensor_index]));
+      arena_tensors.push_back(tensor_index);
     }
     // Check allocs_[].size to prevent from reallocation of persistent tensors.
     // Only allocate ArenaRwPersistent tensors which own their buffer.
@@ -493,10 +716,98 @@ TfLiteStatus ArenaPlanner::CalculateAllocations(
       }
     }
   }
+
+  // Allocating the tensors in an empty arena only depends on their sizes and
+  // usage intervals, so reuse the offsets calculated for the same shapes.
+  std::vector<size_t> layout_key;
+  if (arena_is_empty) {
+    layout_key = GetArenaLayoutKey(arena_tensors);
+    if (RestoreArenaLayout(layout_key)) {
+      last_active_node_ = last_node;
+      return kTfLiteOk;
+    }
+  }
+
+  if (!optimize_arena_ || arena_tensors.size() < 2) {
+    TF_LITE_ENSURE_STATUS(AllocateArenaTensors(arena_tensors));
+  } else {
+    // Neither allocating tensors by size nor by breadth is always better, so
+    // keep the order which needs the smallest arena. The arena buffer is
+    // aligned anyway, so only switch orders if it saves an aligned block.
+    auto num_blocks = [](size_t size) {
+      return (size + kDefaultArenaAlignment - 1) / kDefaultArenaAlignment;
+    };
+    std::vector<int32_t> arena_tensors_by_breadth = arena_tensors;
+    SortTensorsByBreadth(&arena_tensors_by_breadth);
+    arena_.SaveAllocs();
+    TF_LITE_ENSURE_STATUS(AllocateArenaTensors(arena_tensors_by_breadth));
+    const size_t num_blocks_by_breadth = num_blocks(arena_.GetHighWaterMark());
+    arena_.RestoreAllocs();
+    TF_LITE_ENSURE_STATUS(AllocateArenaTensors(arena_tensors));
+    if (num_blocks(arena_.GetHighWaterMark()) > num_blocks_by_breadth) {
+      arena_.RestoreAllocs();
+      TF_LITE_ENSURE_STATUS(AllocateArenaTensors(arena_tensors_by_breadth));
+    }
+  }
+  if (arena_is_empty) {
+    SaveArenaLayout(std::move(layout_key), arena_tensors);
+  }
   last_active_node_ = last_node;
   return kTfLiteOk;
 }
 
+std::vector<size_t> ArenaPlanner::GetArenaLayoutKey(
+    const std::vector<int32_t>& arena_tensors) const {
+  const TfLiteTensor* tensors = graph_info_->tensors();
+  std::vector<size_t> key;
+  key.reserve(4 * arena_tensors.size());
+  for (int32_t tensor_index : arena_tensors) {
+    key.push_back(tensor_index);
+    key.push_back(tensors[tensor_index].bytes);
+    key.push_back(alloc_node_[tensor_index]);
+    key.push_back(LastNodeOfBuffer(tensor_index));
+  }
+  return key;
+}
+
+bool ArenaPlanner::RestoreArenaLayout(const std::vector<size_t>& key) {
+  for (auto it = arena_layouts_.begin(); it != arena_layouts_.end(); ++it) {
+    if (it->key != key) continue;
+    for (const ArenaAllocWithUsageInterval& alloc : it->allocs) {
+      allocs_[alloc.tensor] = alloc;
+    }
+    arena_.SetActiveAllocs(it->active_allocs);
+    std::rotate(arena_layouts_.begin(), it, it + 1);
+    return true;
+  }
+  return false;
+}
+
+void ArenaPlanner::SaveArenaLayout(std::vector<size_t> key,
+                                   const std::vector<int32_t>& arena_tensors) {
+  ArenaLayout layout;
+  layout.key = std::move(key);
+  layout.allocs.reserve(arena_tensors.size());
+  for (int32_t tensor_index : arena_tensors) {
+    layout.allocs.push_back(allocs_[tensor_index]);
+  }
+  layout.active_allocs = arena_.active_allocs();
+  if (arena_layouts_.size() == kMaxArenaLayouts) arena_layouts_.pop_back();
+  arena_layouts_.insert(arena_layouts_.begin(), std::move(layout));
+}
+
+TfLiteStatus ArenaPlanner::AllocateArenaTensors(
+    const std::vector<int32_t>& tensors_to_allocate) {
+  TfLiteTensor* tensors = graph_info_->tensors();
+  for (int32_t tensor_index : tensors_to_allocate) {
+    TF_LITE_ENSURE_STATUS(arena_.Allocate(
+        context_, tensor_alignment_, tensors[tensor_index].bytes, tensor_index,
+        alloc_node_[tensor_index], LastNodeOfBuffer(tensor_index),
+        &allocs_[tensor_index]));
+  }
+  return kTfLiteOk;
+}
+
 bool AreTensorsAllocatedInSameArena(int32_t root_tensor_index,
                                     int32_t tensor_index,
                                     const TfLiteTensor* tensors) {
@@ -513,6 +824,16 @@ bool AreTensorsAllocatedInSameArena(int32_t root_tensor_index,
 
 TfLiteStatus ArenaPlanner::ResolveTensorAllocation(int32_t tensor_index,
                                                    TfLiteTensor* tensors) {
+  // Tensors computed in place use the buffer of their input.
+  auto inplace_tensor_it = inplace_tensor_id_.find(tensor_index);
+  if (inplace_tensor_it != inplace_tensor_id_.end()) {
+    TF_LITE_ENSURE_STATUS(
+        ResolveTensorAllocation(inplace_tensor_it->second, tensors));
+    tensors[tensor_index].data.data =
+        tensors[inplace_tensor_it->second].data.data;
+    return kTfLiteOk;
+  }
+
   // Resolve allocation for tensors which share buffers.
   auto actual_tensor_it = actual_tensor_id_.find(tensor_index);
   TfLiteTensor& tensor = tensors[tensor_index];
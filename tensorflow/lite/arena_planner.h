@@ -50,10 +50,12 @@ class ArenaPlanner : public MemoryPlanner {
   // Ownership of 'context' is not taken and it must remain util the
   // ArenaPlanner is destroyed. The inputs to the graph will not share
   // memory with any other tensor, effectively preserving them until the end
-  // of inference.
+  // of inference. If 'optimize_arena' is true, elementwise ops are computed in
+  // place of an input that isn't used afterwards, and the tensor allocation
+  // order leading to the smallest arena is chosen among several heuristics.
   ArenaPlanner(TfLiteContext* context, std::unique_ptr<GraphInfo> graph_info,
                bool preserve_all_tensors, int tensor_alignment,
-               int subgraph_index = 0);
+               int subgraph_index = 0, bool optimize_arena = true);
   ~ArenaPlanner() override;
   ArenaPlanner(const ArenaPlanner&) = delete;
   ArenaPlanner& operator=(const ArenaPlanner&) = delete;
@@ -75,6 +77,12 @@ class ArenaPlanner : public MemoryPlanner {
  private:
   // Identify tensors which may share memory.
   void IdentifySharedTensors();
+
+  // Identify the outputs of elementwise ops in [first_node, last_node] that can
+  // be computed in place of one of their inputs. Unlike IdentifySharedTensors,
+  // this needs the sizes of the tensors, which are only known once the nodes
+  // are prepared.
+  void IdentifyInplaceTensors(int first_node, int last_node);
   // Make sure all the arenas have reserved enough memory to store all their
   // tensors.
   TfLiteStatus Commit(bool* arena_reallocated);
@@ -91,11 +99,34 @@ class ArenaPlanner : public MemoryPlanner {
   // `first_node` and `last_node`.
   std::vector<int32_t> GetTensorsToAllocate(int first_node, int last_node);
 
+  // Sorts `tensors_to_allocate` for the greedy-by-breadth strategy: tensors
+  // alive at the node with the largest total size of alive tensors go first,
+  // then tensors alive at the next widest node, and so on. Tensors alive at
+  // the same widest node are sorted from largest to smallest.
+  void SortTensorsByBreadth(std::vector<int32_t>* tensors_to_allocate);
+
   // Traverse the allocation queue and reserve space in the appropriate arena
   // for all tensors affected by ops in the interval [first_node, last_node].
   TfLiteStatus CalculateAllocations(int first_node, int last_node,
                                     std::vector<int32_t>* tensors_allocated);
 
+  // Reserve space in `arena_` for the `tensors`, in this order.
+  TfLiteStatus AllocateArenaTensors(const std::vector<int32_t>& tensors);
+
+  // Returns the sizes and usage intervals of `arena_tensors`, which determine
+  // their offsets when they are allocated in an empty arena.
+  std::vector<size_t> GetArenaLayoutKey(
+      const std::vector<int32_t>& arena_tensors) const;
+
+  // Restores the offsets calculated for the tensors of `key`, if they are
+  // cached. Returns false otherwise.
+  bool RestoreArenaLayout(const std::vector<size_t>& key);
+
+  // Caches the offsets of `arena_tensors`, evicting the least recently used
+  // layout if the cache is full.
+  void SaveArenaLayout(std::vector<size_t> key,
+                       const std::vector<int32_t>& arena_tensors);
+
   // Assign absolute memory location to a tensor, based on its relative
   // position inside the corresponding arena buffer.
   TfLiteStatus ResolveTensorAllocation(int32_t tensor_index,
@@ -112,6 +143,21 @@ class ArenaPlanner : public MemoryPlanner {
   // Return the index of the tensor owing `tensor_index's` buffer.
   int FindSharedTensor(int tensor_index);
 
+  // Same as FindSharedTensor, but also follows in-place tensors.
+  int FindBufferOwner(int tensor_index);
+
+  // Returns the last node using the buffer of `tensor_index`, including the
+  // tensors computed in place of it.
+  int32_t LastNodeOfBuffer(int32_t tensor_index) const;
+
+  // Offsets of the tensors allocated in an empty `arena_`, so that they aren't
+  // recalculated when the inputs are resized back to previous shapes.
+  struct ArenaLayout {
+    std::vector<size_t> key;
+    std::vector<ArenaAllocWithUsageInterval> allocs;
+    std::vector<ArenaAllocWithUsageInterval> active_allocs;
+  };
+
   TfLiteContext* context_;
   std::unique_ptr<GraphInfo> graph_info_;
 
@@ -153,6 +199,23 @@ class ArenaPlanner : public MemoryPlanner {
   // data with another tensor.
   // NOLINTNEXTLINE - absl::flat_hash_map increases binary size by 106kB.
   std::unordered_map<int32_t, int32_t> actual_tensor_id_;
+
+  // If true, compute elementwise ops in place and search for the allocation
+  // order with the smallest arena.
+  bool optimize_arena_;
+
+  // Holds index of the tensor whose buffer is reused by the output of an
+  // elementwise op computed in place.
+  // NOLINTNEXTLINE - absl::flat_hash_map increases binary size by 106kB.
+  std::unordered_map<int32_t, int32_t> inplace_tensor_id_;
+
+  // Last node using the buffer of the tensors in `inplace_tensor_id_` values.
+  // NOLINTNEXTLINE - absl::flat_hash_map increases binary size by 106kB.
+  std::unordered_map<int32_t, int32_t> inplace_last_node_;
+
+  // Layouts of `arena_` for the last shapes of the inputs, the most recently
+  // used first.
+  std::vector<ArenaLayout> arena_layouts_;
 };
 
 }  // namespace tflite
@@ -144,6 +144,16 @@ class TestGraph {
     variables_ = variables;
   }
 
+  const std::vector<std::pair<size_t, size_t>>& concurrent_nodes() {
+    return concurrent_nodes_;
+  }
+
+  // Sets the first and last concurrent nodes of each node.
+  void SetConcurrentNodes(
+      const std::vector<std::pair<size_t, size_t>>& concurrent_nodes) {
+    concurrent_nodes_ = concurrent_nodes;
+  }
+
   void Swap(TestGraph* other) {
     std::swap(nodes_, other->nodes_);
     std::swap(tensors_, other->tensors_);
@@ -159,6 +169,7 @@ class TestGraph {
   std::vector<int> inputs_;
   std::vector<int> outputs_;
   std::vector<int> variables_;
+  std::vector<std::pair<size_t, size_t>> concurrent_nodes_;
 };
 
 // The GraphInfo for a TestGraph.
@@ -185,6 +196,12 @@ class TestGraphInfo : public GraphInfo {
   const std::vector<int>& variables() const override {
     return graph_->variables();
   }
+  std::pair<size_t, size_t> concurrent_nodes(size_t index) const override {
+    if (index < graph_->concurrent_nodes().size()) {
+      return graph_->concurrent_nodes()[index];
+    }
+    return {index, index};
+  }
 
  private:
   TestGraph* graph_;
@@ -204,12 +221,14 @@ void ReportError(TfLiteContext* context, const char* format, ...) {
 
 class ArenaPlannerTest : public ::testing::Test {
  protected:
-  void SetGraph(TestGraph* graph, bool preserve_all_tensors = false) {
+  void SetGraph(TestGraph* graph, bool preserve_all_tensors = false,
+                bool optimize_arena = true) {
     graph_ = graph;
     context_.ReportError = ReportError;
     planner_ = std::make_unique<ArenaPlanner>(
         &context_, std::unique_ptr<GraphInfo>(new TestGraphInfo(graph)),
-        preserve_all_tensors, kTensorAlignment);
+        preserve_all_tensors, kTensorAlignment, /*subgraph_index=*/0,
+        optimize_arena);
     CHECK(planner_->ResetAllocations() == kTfLiteOk);
     CHECK(planner_->PlanAllocations() == kTfLiteOk);
   }
@@ -366,6 +385,57 @@ TEST_F(ArenaPlannerTest, AllocsCorrectlyReset) {
   EXPECT_EQ(GetOffset(1), 4);
 }
 
+TEST_F(ArenaPlannerTest, LayoutsReusedForPreviousSizes) {
+  TestGraph graph({0, 1},
+                  {
+                      /* in, out, tmp */
+                      {{0, 1}, {2}, {}},     // First op
+                      {{2, 0}, {4, 5}, {}},  // Second op
+                      {{4, 5}, {3}, {}}      // Third op
+                  },
+                  {3});
+  SetGraph(&graph);
+  std::vector<TfLiteTensor>& tensors = *graph.tensors();
+  auto get_offsets = [&]() {
+    std::vector<std::ptrdiff_t> offsets;
+    for (int i = 0; i <= 5; ++i) offsets.push_back(GetOffset(i));
+    return offsets;
+  };
+  auto resize = [&](int delta) {
+    ResetAllocations();
+    for (int i = 0; i <= 5; ++i) tensors[i].bytes += delta;
+    Execute(0, graph.nodes().size() - 1);
+  };
+  Execute(0, graph.nodes().size() - 1);
+  const std::vector<std::ptrdiff_t> small_offsets = get_offsets();
+  resize(100);
+  const std::vector<std::ptrdiff_t> large_offsets = get_offsets();
+  EXPECT_NE(large_offsets, small_offsets);
+
+  // Resizing the tensors back restores the layout calculated for their sizes.
+  resize(-100);
+  EXPECT_EQ(get_offsets(), small_offsets);
+  resize(100);
+  EXPECT_EQ(get_offsets(), large_offsets);
+
+  // A restored layout can be partially recalculated.
+  ResetAllocationsAfter(0);
+  tensors[4].bytes += 64;
+  Execute(1, graph.nodes().size() - 1);
+  EXPECT_EQ(GetOffset(0), large_offsets[0]);
+  EXPECT_EQ(GetOffset(2), large_offsets[2]);
+  // The tensors alive during the second op don't overlap.
+  const std::vector<int> alive = {0, 1, 2, 4, 5};
+  for (int i : alive) {
+    for (int j : alive) {
+      if (i == j) continue;
+      EXPECT_TRUE(GetOffsetAfter(i) <= GetOffset(j) ||
+                  GetOffsetAfter(j) <= GetOffset(i))
+          << "tensors " << i << " and " << j << " overlap";
+    }
+  }
+}
+
 TEST_F(ArenaPlannerTest, SimpleGraphInputsPreserved) {
   TestGraph graph({0, 1},
                   {
@@ -515,6 +585,118 @@ TEST_F(ArenaPlannerTest, SimpleGraphsWithReshapeDynamicInput) {
   EXPECT_NE(GetOffset(0), GetOffset(2));
 }
 
+TEST_F(ArenaPlannerTest, SimpleGraphWithChainOfElementwiseOps) {
+  TestGraph graph({0},
+                  {
+                      /* in, out, tmp */
+                      {{0}, {1}, {}, kTfLiteBuiltinConv2d},
+                      {{1}, {2}, {}, kTfLiteBuiltinRelu},
+                      {{2}, {3}, {}, kTfLiteBuiltinTanh},
+                      {{3}, {4}, {}, kTfLiteBuiltinConv2d},
+                  },
+                  {4});
+  for (int i = 1; i <= 3; ++i) (*graph.tensors())[i].bytes = 12;
+  SetGraph(&graph);
+  Execute(0, graph.nodes().size() - 1);
+
+  // Relu and Tanh are computed in place of their input.
+  EXPECT_EQ(GetOffset(1), GetOffset(2));
+  EXPECT_EQ(GetOffset(1), GetOffset(3));
+  // Their buffer is in use until the last op.
+  EXPECT_NE(GetOffset(1), GetOffset(4));
+
+  SetGraph(&graph, /*preserve_all_tensors=*/false, /*optimize_arena=*/false);
+  Execute(0, graph.nodes().size() - 1);
+
+  EXPECT_NE(GetOffset(1), GetOffset(2));
+  EXPECT_NE(GetOffset(2), GetOffset(3));
+}
+
+TEST_F(ArenaPlannerTest, SimpleGraphWithElementwiseOpInputUsedLater) {
+  TestGraph graph({0},
+                  {
+                      /* in, out, tmp */
+                      {{0}, {1}, {}, kTfLiteBuiltinConv2d},
+                      {{0}, {2}, {}, kTfLiteBuiltinConv2d},
+                      {{1, 2}, {3}, {}, kTfLiteBuiltinAdd},
+                      {{1, 3}, {4}, {}, kTfLiteBuiltinConv2d},
+                  },
+                  {4});
+  for (int i = 1; i <= 3; ++i) (*graph.tensors())[i].bytes = 12;
+  SetGraph(&graph);
+  Execute(0, graph.nodes().size() - 1);
+
+  // 1 is used by the last op, so Add is computed in place of 2.
+  EXPECT_NE(GetOffset(1), GetOffset(3));
+  EXPECT_EQ(GetOffset(2), GetOffset(3));
+}
+
+TEST_F(ArenaPlannerTest, SimpleGraphWithConcurrentNodes) {
+  TestGraph graph({0},
+                  {
+                      /* in, out, tmp */
+                      {{0}, {1}, {}, kTfLiteBuiltinConv2d},
+                      {{0}, {3}, {}, kTfLiteBuiltinConv2d},
+                      {{1}, {2}, {6}, kTfLiteBuiltinRelu},
+                      {{3}, {4}, {7}, kTfLiteBuiltinRelu},
+                      {{2, 4}, {5}, {}, kTfLiteBuiltinAdd},
+                  },
+                  {5});
+  for (int i = 1; i <= 4; ++i) (*graph.tensors())[i].bytes = 12;
+  // The two branches run concurrently.
+  graph.SetConcurrentNodes({{0, 1}, {0, 1}, {2, 3}, {2, 3}, {4, 4}});
+  SetGraph(&graph);
+  Execute(0, graph.nodes().size() - 1);
+
+  // All the tensors of the branches, and the temporaries, are alive while the
+  // second stage runs, so none of them share memory.
+  const std::vector<int> tensors = {1, 2, 3, 4, 6, 7};
+  for (int a : tensors) {
+    for (int b : tensors) {
+      if (a == b) continue;
+      EXPECT_TRUE(GetOffsetAfter(a) <= GetOffset(b) ||
+                  GetOffsetAfter(b) <= GetOffset(a))
+          << a << " and " << b << " overlap";
+    }
+  }
+}
+
+TEST_F(ArenaPlannerTest, SimpleGraphWithElementwiseOpNotInplace) {
+  TestGraph graph({0},
+                  {
+                      /* in, out, tmp */
+                      {{0}, {1}, {}, kTfLiteBuiltinRelu},
+                      {{1}, {2}, {}, kTfLiteBuiltinQuantize},
+                      {{2}, {3}, {}, kTfLiteBuiltinConv2d},
+                      {{3, 1}, {4}, {}, kTfLiteBuiltinMul},
+                      {{4}, {5}, {}, kTfLiteBuiltinConv2d},
+                  },
+                  {5});
+  (*graph.tensors())[0].bytes = 12;
+  (*graph.tensors())[1].bytes = 12;
+  (*graph.tensors())[3].bytes = 12;
+  (*graph.tensors())[4].bytes = 12;
+  TfLiteIntArray* dims = TfLiteIntArrayCreate(1);
+  dims->data[0] = 3;
+  TfLiteIntArray* broadcast_dims = TfLiteIntArrayCreate(1);
+  broadcast_dims->data[0] = 1;
+  (*graph.tensors())[1].dims = broadcast_dims;
+  (*graph.tensors())[3].dims = dims;
+  (*graph.tensors())[4].dims = dims;
+  SetGraph(&graph);
+  Execute(0, graph.nodes().size() - 1);
+
+  // Graph inputs are never overwritten.
+  EXPECT_NE(GetOffset(0), GetOffset(1));
+  // The output of Quantize doesn't have the size of its input.
+  EXPECT_NE(GetOffset(1), GetOffset(2));
+  // Mul broadcasts its second input.
+  EXPECT_NE(GetOffset(3), GetOffset(4));
+
+  TfLiteIntArrayFree(dims);
+  TfLiteIntArrayFree(broadcast_dims);
+}
+
 TEST_F(ArenaPlannerTest, SimpleGraphWithResetAllocationsAfter) {
   TestGraph graph({0, 1},
                   {
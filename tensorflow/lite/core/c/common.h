@@ -58,11 +58,12 @@ extern "C" {
 // need. Access to the external contexts is controlled by one of the
 // corresponding support files.
 typedef enum TfLiteExternalContextType {
-  kTfLiteEigenContext = 0,       // include eigen_support.h to use.
-  kTfLiteGemmLowpContext = 1,    // include gemm_support.h to use.
-  kTfLiteEdgeTpuContext = 2,     // Placeholder for Edge TPU support.
-  kTfLiteCpuBackendContext = 3,  // include cpu_backend_context.h to use.
-  kTfLiteMaxExternalContexts = 4
+  kTfLiteEigenContext = 0,          // include eigen_support.h to use.
+  kTfLiteGemmLowpContext = 1,       // include gemm_support.h to use.
+  kTfLiteEdgeTpuContext = 2,        // Placeholder for Edge TPU support.
+  kTfLiteCpuBackendContext = 3,     // include cpu_backend_context.h to use.
+  kTfLiteSharedWeightsContext = 4,  // include shared_weights_cache.h to use.
+  kTfLiteMaxExternalContexts = 5
 } TfLiteExternalContextType;
 
 // Forward declare so dependent structs and methods can reference these types
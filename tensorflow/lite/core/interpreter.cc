@@ -495,6 +495,21 @@ TfLiteStatus Interpreter::ApplyOptionsImpl(InterpreterOptions* options) {
           options->GetDynamicAllocationForLargeTensors());
     }
   }
+
+  // Handle `experimental_inter_op_parallelism_`.
+  const int inter_op_parallelism = options->GetInterOpParallelism();
+  if (inter_op_parallelism > 1) {
+    if (!inter_op_thread_pool_ ||
+        inter_op_thread_pool_->num_threads() != inter_op_parallelism) {
+      inter_op_thread_pool_ =
+          std::make_unique<InterOpThreadPool>(inter_op_parallelism);
+    }
+  } else {
+    inter_op_thread_pool_.reset();
+  }
+  for (auto& subgraph : subgraphs_) {
+    subgraph->SetInterOpThreadPool(inter_op_thread_pool_.get());
+  }
   return kTfLiteOk;
 }
 
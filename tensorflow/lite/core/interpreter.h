@@ -48,6 +48,7 @@ limitations under the License.
 #include "tensorflow/lite/experimental/resource/initialization_status.h"
 #include "tensorflow/lite/experimental/resource/resource_base.h"
 #include "tensorflow/lite/external_cpu_backend_context.h"
+#include "tensorflow/lite/inter_op_thread_pool.h"
 #include "tensorflow/lite/internal/signature_def.h"
 #include "tensorflow/lite/interpreter_options.h"
 #include "tensorflow/lite/portable_type_to_tflitetype.h"
@@ -956,6 +957,10 @@ class Interpreter {
   // InterpreterOptions object which is being used.
   std::unique_ptr<InterpreterOptions> options_;
 
+  // Pool running the independent nodes of the subgraphs concurrently, if
+  // enabled by `InterpreterOptions::SetInterOpParallelism`.
+  std::unique_ptr<InterOpThreadPool> inter_op_thread_pool_;
+
   // Stores control edges that are encoded in the metadata of the model. Updated
   // in SetMetadata; model_control_dependencies_.empty() means that there were
   // no control dependencies encoded in the metadata, or that we were unable to
@@ -401,7 +401,8 @@ TfLiteStatus InterpreterBuilder::ParseNodes(
 
 TfLiteStatus InterpreterBuilder::ParseQuantization(
     const QuantizationParameters* src_quantization,
-    TfLiteQuantization* quantization, const std::vector<int>& dims) {
+    TfLiteQuantization* quantization, const std::vector<int>& dims,
+    TfLiteType type) {
   quantization->type = kTfLiteNoQuantization;
   if (!src_quantization || !src_quantization->scale() ||
       src_quantization->scale()->size() == 0) {
@@ -437,8 +438,13 @@ TfLiteStatus InterpreterBuilder::ParseQuantization(
   }
 
   // Ensure that the number of scales is 1 for per-layer quantization, and
-  // matches number of quantization dimensions for per-axis quantization.
-  if (num_scales != 1 &&
+  // matches number of quantization dimensions for per-axis quantization. Int4
+  // tensors may also have a multiple of it for blockwise quantization.
+  const bool is_blockwise =
+      type == kTfLiteInt4 && !dims.empty() &&
+      dims[src_quantization->quantized_dimension()] > 0 &&
+      num_scales % dims[src_quantization->quantized_dimension()] == 0;
+  if (num_scales != 1 && !is_blockwise &&
       (!dims.empty() &&
        num_scales != dims[src_quantization->quantized_dimension()])) {
     error_reporter_->Report(
@@ -634,7 +640,8 @@ TfLiteStatus InterpreterBuilder::ParseTensors(
 
     const auto* src_quantization = tensor->quantization();
     TfLiteQuantization quantization;
-    if (ParseQuantization(src_quantization, &quantization, dims) != kTfLiteOk) {
+    if (ParseQuantization(src_quantization, &quantization, dims, type) !=
+        kTfLiteOk) {
       error_reporter_->Report("Tensor %d has invalid quantization parameters.",
                               i);
       status = kTfLiteError;
@@ -42,7 +42,9 @@ limitations under the License.
 #include "tensorflow/lite/core/macros.h"
 #include "tensorflow/lite/experimental/remat/metadata_util.h"
 #include "tensorflow/lite/experimental/resource/resource_base.h"
+#include "tensorflow/lite/external_cpu_backend_context.h"
 #include "tensorflow/lite/graph_info.h"
+#include "tensorflow/lite/inter_op_thread_pool.h"
 #include "tensorflow/lite/memory_planner.h"
 #include "tensorflow/lite/minimal_logging.h"
 #include "tensorflow/lite/profiling/telemetry/telemetry.h"
@@ -243,10 +245,23 @@ class InterpreterInfo : public GraphInfo {
     return subgraph_->variables();
   }
 
+  std::pair<size_t, size_t> concurrent_nodes(size_t index) const override {
+    return subgraph_->concurrent_nodes(index);
+  }
+
  public:
   Subgraph* subgraph_;
 };
 
+struct Subgraph::InterOpWorkerContext {
+  // A copy of the context of the subgraph, whose external CPU backend context
+  // is `cpu_backend_context`. The other external contexts are shared with the
+  // subgraph: the Eigen context hands out devices limited to the
+  // `recommended_num_threads` of the context asking for them.
+  TfLiteContext context;
+  ExternalCpuBackendContext cpu_backend_context;
+};
+
 Subgraph::Subgraph(ErrorReporter* error_reporter,
                    TfLiteExternalContext** external_contexts,
                    std::vector<std::unique_ptr<Subgraph>>* subgraphs,
@@ -598,6 +613,17 @@ TfLiteExternalContext* Subgraph::GetExternalContext(
   return static_cast<Subgraph*>(context->impl_)->GetExternalContext(type);
 }
 
+TfLiteExternalContext* Subgraph::GetWorkerExternalContext(
+    struct TfLiteContext* context, TfLiteExternalContextType type) {
+  auto* subgraph = static_cast<Subgraph*>(context->impl_);
+  if (type == kTfLiteCpuBackendContext) {
+    for (const auto& worker : subgraph->inter_op_worker_contexts_) {
+      if (&worker->context == context) return &worker->cpu_backend_context;
+    }
+  }
+  return subgraph->GetExternalContext(type);
+}
+
 void Subgraph::SetExternalContext(TfLiteExternalContextType type,
                                   TfLiteExternalContext* ctx) {
   if (static_cast<int>(type) >= 0 && type < kTfLiteMaxExternalContexts) {
@@ -878,6 +904,7 @@ TfLiteStatus Subgraph::AllocateTensors() {
   }
 
   TF_LITE_ENSURE_STATUS(PrepareOpsAndTensors());
+  TF_LITE_ENSURE_STATUS(PlanParallelStages());
 
   state_ = kStateInvokable;
 
@@ -1187,14 +1214,19 @@ TfLiteStatus Subgraph::OpPrepare(const TfLiteRegistration& op_reg,
 // Invoke the operator represented by 'node'.
 TfLiteStatus Subgraph::OpInvoke(const TfLiteRegistration& op_reg,
                                 TfLiteNode* node) {
+  return OpInvoke(op_reg, node, &context_);
+}
+
+TfLiteStatus Subgraph::OpInvoke(const TfLiteRegistration& op_reg,
+                                TfLiteNode* node, TfLiteContext* context) {
   if (op_reg.registration_external && op_reg.registration_external->invoke) {
     return op_reg.registration_external->invoke(
         op_reg.registration_external->invoke_data,
-        reinterpret_cast<TfLiteOpaqueContext*>(&context_),
+        reinterpret_cast<TfLiteOpaqueContext*>(context),
         reinterpret_cast<TfLiteOpaqueNode*>(node));
   }
   if (op_reg.invoke == nullptr) return kTfLiteError;
-  return op_reg.invoke(&context_, node);
+  return op_reg.invoke(context, node);
 }
 
 // Let 'op_reg' release any memory it might have allocated via 'OpInit'.
@@ -1247,11 +1279,28 @@ TfLiteStatus Subgraph::PrepareOpsStartingAt(
     tflite::OnTfLiteOpPrepare(GetTFLiteOpName(registration), subgraph_index_,
                               node_index);
 #endif  // TF_LITE_TENSORFLOW_PROFILER
-    const TfLiteStatus op_prepare_status = OpPrepare(registration, &node);
-    if (op_prepare_status != kTfLiteOk) {
-      ReportOpError(&context_, node, registration, node_index,
-                    "failed to prepare");
-      return op_prepare_status;
+    // Skip the ops whose tensors still have the types and shapes they were
+    // prepared for, e.g. the ones not depending on the inputs resized since
+    // the last AllocateTensors().
+    std::vector<int> signature;
+    if (!GetPrepareSignature(registration, node, &signature) ||
+        node_index >= static_cast<int>(prepared_node_signatures_.size()) ||
+        prepared_node_signatures_[node_index] != signature) {
+      const TfLiteStatus op_prepare_status = OpPrepare(registration, &node);
+      if (op_prepare_status != kTfLiteOk) {
+        ReportOpError(&context_, node, registration, node_index,
+                      "failed to prepare");
+        return op_prepare_status;
+      }
+      if (prepared_node_signatures_.size() < nodes_and_registration_.size()) {
+        prepared_node_signatures_.resize(nodes_and_registration_.size());
+      }
+      // Prepare() sets the shapes of the outputs and temporaries.
+      signature.clear();
+      if (!GetPrepareSignature(registration, node, &signature)) {
+        signature.clear();
+      }
+      prepared_node_signatures_[node_index] = std::move(signature);
     }
 
     *last_execution_plan_index_prepared = execution_plan_index;
@@ -1267,6 +1316,180 @@ TfLiteStatus Subgraph::PrepareOpsStartingAt(
   return kTfLiteOk;
 }
 
+bool Subgraph::GetPrepareSignature(const TfLiteRegistration& registration,
+                                   const TfLiteNode& node,
+                                   std::vector<int>* signature) const {
+  if (!ShouldPrepareIncrementally() || !delegates_applied_.empty() ||
+      registration.registration_external != nullptr) {
+    return false;
+  }
+  switch (registration.builtin_code) {
+    case kTfLiteBuiltinCallOnce:
+    case kTfLiteBuiltinCustom:
+    case kTfLiteBuiltinDelegate:
+    case kTfLiteBuiltinIf:
+    case kTfLiteBuiltinWhile:
+      return false;
+    default:
+      break;
+  }
+  // `is_input` is true for the inputs, whose values may be read by Prepare()
+  // if they are constant, and false for the outputs and temporaries, which
+  // Prepare() may fill.
+  auto add_tensors = [&](const TfLiteIntArray* indices, bool is_input) {
+    signature->push_back(indices->size);
+    for (int i = 0; i < indices->size; ++i) {
+      const int tensor_index = indices->data[i];
+      signature->push_back(tensor_index);
+      if (tensor_index == kTfLiteOptionalTensor) continue;
+      const TfLiteTensor& tensor = context_.tensors[tensor_index];
+      // Dynamic inputs may have different values for the same shape, and
+      // persistent read-only inputs are computed by Prepare() of other ops.
+      // Persistent arena tensors are reallocated, losing the values Prepare()
+      // may have written to them.
+      if ((is_input && (tensor.allocation_type == kTfLiteDynamic ||
+                        tensor.allocation_type == kTfLitePersistentRo)) ||
+          (!is_input && tensor.allocation_type == kTfLiteArenaRwPersistent)) {
+        return false;
+      }
+      signature->push_back(tensor.type);
+      signature->push_back(tensor.allocation_type);
+      if (tensor.dims == nullptr) {
+        signature->push_back(-1);
+        continue;
+      }
+      signature->push_back(tensor.dims->size);
+      signature->insert(signature->end(), tensor.dims->data,
+                        tensor.dims->data + tensor.dims->size);
+    }
+    return true;
+  };
+  return add_tensors(node.inputs, /*is_input=*/true) &&
+         add_tensors(node.outputs, /*is_input=*/false) &&
+         (node.temporaries == nullptr ||
+          add_tensors(node.temporaries, /*is_input=*/false));
+}
+
+bool Subgraph::IsInterOpBarrier(const TfLiteNode& node,
+                                const TfLiteRegistration& registration) const {
+  if (registration.registration_external != nullptr) return true;
+  switch (registration.builtin_code) {
+    case kTfLiteBuiltinCallOnce:
+    case kTfLiteBuiltinCustom:
+    case kTfLiteBuiltinDelegate:
+    case kTfLiteBuiltinIf:
+    case kTfLiteBuiltinWhile:
+      return true;
+    default:
+      break;
+  }
+  // Resource and variant tensors may be shared with other nodes, variable
+  // tensors are updated in place, and dynamic tensors are allocated while the
+  // node runs.
+  auto is_shared = [this](const TfLiteIntArray* indices) {
+    if (indices == nullptr) return false;
+    for (int i = 0; i < indices->size; ++i) {
+      if (indices->data[i] == kTfLiteOptionalTensor) continue;
+      const TfLiteTensor& tensor = context_.tensors[indices->data[i]];
+      if (tensor.type == kTfLiteResource || tensor.type == kTfLiteVariant ||
+          tensor.is_variable || tensor.allocation_type == kTfLiteDynamic) {
+        return true;
+      }
+    }
+    return false;
+  };
+  return is_shared(node.inputs) || is_shared(node.outputs) ||
+         is_shared(node.temporaries);
+}
+
+TfLiteStatus Subgraph::PlanParallelStages() {
+  std::vector<std::pair<int, int>> stages;
+  const int num_nodes = execution_plan_.size();
+  std::vector<int> plan = execution_plan_;
+  if (inter_op_thread_pool_ != nullptr &&
+      inter_op_thread_pool_->num_threads() > 1 && delegates_applied_.empty() &&
+      !has_dynamic_tensors_ &&
+      next_execution_plan_index_to_prepare_ == num_nodes) {
+    // The level of a node is the length of the longest path reaching it from
+    // the inputs, so the nodes of a level don't depend on each other. Barrier
+    // nodes get a level of their own, after all the nodes before them.
+    std::vector<int> tensor_levels(tensors_.size(), -1);
+    std::vector<int> node_levels(nodes_and_registration_.size(), -1);
+    std::vector<int> plan_levels(num_nodes);
+    int min_level = 0;
+    int max_level = -1;
+    for (int i = 0; i < num_nodes; ++i) {
+      const int node_index = execution_plan_[i];
+      const auto& [node, registration] = nodes_and_registration_[node_index];
+      int level = min_level;
+      if (IsInterOpBarrier(node, registration)) {
+        level = max_level + 1;
+        min_level = level + 1;
+      } else {
+        for (int j = 0; j < node.inputs->size; ++j) {
+          const int tensor_index = node.inputs->data[j];
+          if (tensor_index == kTfLiteOptionalTensor) continue;
+          level = std::max(level, tensor_levels[tensor_index] + 1);
+        }
+        if (control_edges_ != nullptr) {
+          for (const auto& [from, to] : *control_edges_) {
+            if (to == node_index && from >= 0 &&
+                from < static_cast<int>(node_levels.size())) {
+              level = std::max(level, node_levels[from] + 1);
+            }
+          }
+        }
+      }
+      for (int j = 0; j < node.outputs->size; ++j) {
+        const int tensor_index = node.outputs->data[j];
+        if (tensor_index == kTfLiteOptionalTensor) continue;
+        tensor_levels[tensor_index] = level;
+      }
+      node_levels[node_index] = level;
+      plan_levels[i] = level;
+      max_level = std::max(max_level, level);
+    }
+
+    std::vector<int> order(num_nodes);
+    for (int i = 0; i < num_nodes; ++i) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+      return plan_levels[a] < plan_levels[b];
+    });
+    stages.resize(num_nodes);
+    bool has_concurrent_nodes = false;
+    for (int first = 0; first < num_nodes;) {
+      int last = first;
+      while (last + 1 < num_nodes &&
+             plan_levels[order[last + 1]] == plan_levels[order[first]]) {
+        ++last;
+      }
+      for (int i = first; i <= last; ++i) {
+        plan[i] = execution_plan_[order[i]];
+        stages[i] = {first, last};
+      }
+      has_concurrent_nodes |= last > first;
+      first = last + 1;
+    }
+    if (!has_concurrent_nodes) {
+      stages.clear();
+      plan = execution_plan_;
+    }
+  }
+  if (stages == parallel_stages_) return kTfLiteOk;
+
+  // The tensors of the nodes of a stage are alive during the whole stage, so
+  // plan and allocate them again.
+  execution_plan_ = std::move(plan);
+  parallel_stages_ = std::move(stages);
+  next_execution_plan_index_to_prepare_ = 0;
+  next_execution_plan_index_to_plan_allocation_ = 0;
+  next_original_execution_plan_index_to_prepare_ = 0;
+  if (memory_planner_) {
+    TF_LITE_ENSURE_STATUS(memory_planner_->PlanAllocations());
+  }
+  return PrepareOpsAndTensors();
+}
+
 TfLiteStatus Subgraph::PrepareOpsAndTensors() {
   if (!memory_planner_) {
 #ifdef TFLITE_USE_SIMPLE_MEMORY_PLANNER
@@ -1274,7 +1497,7 @@ TfLiteStatus Subgraph::PrepareOpsAndTensors() {
 #else
     memory_planner_ = std::make_unique<ArenaPlanner>(
         &context_, CreateGraphInfo(), ShouldPreserveAllTensors(),
-        kDefaultTensorAlignment, subgraph_index_);
+        kDefaultTensorAlignment, subgraph_index_, ShouldOptimizeArena());
 #endif
     memory_planner_->PlanAllocations();
   }
@@ -1416,6 +1639,19 @@ TfLiteStatus Subgraph::InvokeImpl() {
       TF_LITE_ENSURE(&context_, next_execution_plan_index_to_prepare_ >=
                                     execution_plan_index);
     }
+    // Run the stages of independent nodes concurrently, unless the ops are
+    // profiled.
+    if (inter_op_thread_pool_ != nullptr && !profiler_ &&
+        !has_dynamic_tensors_ &&
+        parallel_stages_.size() == execution_plan_.size()) {
+      const auto [first, last] = parallel_stages_[execution_plan_index];
+      if (first == execution_plan_index && last > first &&
+          last < next_execution_plan_index_to_prepare_) {
+        TF_LITE_ENSURE_STATUS(InvokeConcurrently(first, last));
+        execution_plan_index = last;
+        continue;
+      }
+    }
     int node_index = execution_plan_[execution_plan_index];
     TfLiteNode& node = nodes_and_registration_[node_index].first;
     const TfLiteRegistration& registration =
@@ -1439,37 +1675,7 @@ TfLiteStatus Subgraph::InvokeImpl() {
     TFLITE_SCOPED_TAGGED_OPERATOR_PROFILE(
         profile_op ? profiler_.get() : nullptr, op_name, node_index);
 
-    for (int i = 0; i < node.inputs->size; ++i) {
-      int tensor_index = node.inputs->data[i];
-      if (tensor_index == kTfLiteOptionalTensor) {
-        continue;
-      }
-      TfLiteTensor* tensor = &tensors_[tensor_index];
-      if (tensor->delegate && tensor->delegate != node.delegate &&
-          tensor->data_is_stale) {
-        TF_LITE_ENSURE_STATUS(EnsureTensorDataIsReadable(tensor_index));
-      }
-      if (tensor->data.raw == nullptr && tensor->bytes > 0) {
-        if (registration.builtin_code == kTfLiteBuiltinReshape && i == 1 &&
-            tensor->dims->size != 1) {
-          // In general, having a tensor here with no buffer will be an error.
-          // However, for the reshape operator, the second input tensor is
-          // sometimes only used for the shape, not for the data. Thus, null
-          // buffer is ok in this situation.
-          // The situation where null buffer is not ok for reshape operator is
-          // only when there are 2 inputs given to the node and the one
-          // corresponding to the shape (i == 1) is a vector that contains all
-          // dimensions. See `GetOutputShape()` function in
-          // `tensorflow/lite/kernels/reshape.cc`
-          continue;
-        } else {
-          // In all other cases, we need to return an error as otherwise we will
-          // trigger a null pointer dereference (likely).
-          ReportError("Input tensor %d lacks data", tensor_index);
-          return kTfLiteError;
-        }
-      }
-    }
+    TF_LITE_ENSURE_STATUS(EnsureNodeInputsAreReadable(node, registration));
     // Allocate dynamic tensors which memory is required to be allocated
     // before executing the node.
     MayAllocateOpOutput(&node);
@@ -1526,6 +1732,115 @@ TfLiteStatus Subgraph::InvokeImpl() {
   return status;
 }
 
+TfLiteStatus Subgraph::EnsureNodeInputsAreReadable(
+    const TfLiteNode& node, const TfLiteRegistration& registration) {
+  for (int i = 0; i < node.inputs->size; ++i) {
+    int tensor_index = node.inputs->data[i];
+    if (tensor_index == kTfLiteOptionalTensor) {
+      continue;
+    }
+    TfLiteTensor* tensor = &tensors_[tensor_index];
+    if (tensor->delegate && tensor->delegate != node.delegate &&
+        tensor->data_is_stale) {
+      TF_LITE_ENSURE_STATUS(EnsureTensorDataIsReadable(tensor_index));
+    }
+    if (tensor->data.raw == nullptr && tensor->bytes > 0) {
+      if (registration.builtin_code == kTfLiteBuiltinReshape && i == 1 &&
+          tensor->dims->size != 1) {
+        // In general, having a tensor here with no buffer will be an error.
+        // However, for the reshape operator, the second input tensor is
+        // sometimes only used for the shape, not for the data. Thus, null
+        // buffer is ok in this situation.
+        // The situation where null buffer is not ok for reshape operator is
+        // only when there are 2 inputs given to the node and the one
+        // corresponding to the shape (i == 1) is a vector that contains all
+        // dimensions. See `GetOutputShape()` function in
+        // `tensorflow/lite/kernels/reshape.cc`
+        continue;
+      } else {
+        // In all other cases, we need to return an error as otherwise we will
+        // trigger a null pointer dereference (likely).
+        ReportError("Input tensor %d lacks data", tensor_index);
+        return kTfLiteError;
+      }
+    }
+  }
+  return kTfLiteOk;
+}
+
+TfLiteStatus Subgraph::InvokeConcurrently(int first_execution_plan_index,
+                                          int last_execution_plan_index) {
+  const int num_nodes =
+      last_execution_plan_index - first_execution_plan_index + 1;
+  for (int i = 0; i < num_nodes; ++i) {
+    const int node_index = execution_plan_[first_execution_plan_index + i];
+    auto& [node, registration] = nodes_and_registration_[node_index];
+    TF_LITE_ENSURE_STATUS(EnsureNodeInputsAreReadable(node, registration));
+    MayAllocateOpOutput(&node);
+  }
+
+  if (check_cancelled_func_ != nullptr &&
+      check_cancelled_func_(cancellation_data_)) {
+    ReportError("Client requested cancel during Invoke()");
+    return kTfLiteError;
+  }
+
+  if (continue_invocation_ && !continue_invocation_->test_and_set()) {
+    // `Cancel` is called and cancellation flag is flipped.
+    ReportError("Client requested cancel during Invoke()");
+    return kTfLiteCancelled;
+  }
+
+  EnsureTensorsVectorCapacity();
+  tensor_resized_since_op_invoke_ = false;
+
+  // Split the threads of the subgraph between the nodes running at the same
+  // time, so that the cores aren't oversubscribed by the ops. Each worker has
+  // its own CPU backend context with that budget, and ops using Eigen get a
+  // device with that budget on the Eigen pool of the subgraph.
+  const int num_workers =
+      std::min(num_nodes, inter_op_thread_pool_->num_threads());
+  while (static_cast<int>(inter_op_worker_contexts_.size()) <
+         num_workers) {
+    inter_op_worker_contexts_.push_back(
+        std::make_unique<InterOpWorkerContext>());
+  }
+  const int num_threads = context_.recommended_num_threads;
+  const int num_threads_per_node =
+      num_threads > 0 ? std::max(1, num_threads / num_workers) : -1;
+  for (int i = 0; i < num_workers; ++i) {
+    InterOpWorkerContext& worker = *inter_op_worker_contexts_[i];
+    worker.context = context_;
+    worker.context.GetExternalContext = GetWorkerExternalContext;
+    worker.context.recommended_num_threads = num_threads_per_node;
+    worker.cpu_backend_context.Refresh(&worker.context);
+  }
+
+  std::vector<TfLiteStatus> statuses(num_nodes, kTfLiteOk);
+  inter_op_thread_pool_->ParallelFor(num_nodes, [&](int task, int thread) {
+    const int node_index = execution_plan_[first_execution_plan_index + task];
+    auto& [node, registration] = nodes_and_registration_[node_index];
+    statuses[task] = OpInvoke(registration, &node,
+                              &inter_op_worker_contexts_[thread]->context);
+  });
+
+  for (int i = 0; i < num_nodes; ++i) {
+    const int node_index = execution_plan_[first_execution_plan_index + i];
+    const auto& [node, registration] = nodes_and_registration_[node_index];
+    if (statuses[i] != kTfLiteOk) {
+      auto err = ReportOpError(&context_, node, registration, node_index,
+                               "failed to invoke");
+      return statuses[i] == kTfLiteCancelled ? statuses[i] : err;
+    }
+  }
+  for (int i = 0; i < num_nodes; ++i) {
+    const int node_index = execution_plan_[first_execution_plan_index + i];
+    MaybeReleaseDynamicTensors(nodes_and_registration_[node_index].first,
+                               node_index);
+  }
+  return kTfLiteOk;
+}
+
 TfLiteStatus Subgraph::ResizeTensor(TfLiteContext* context,
                                     TfLiteTensor* tensor,
                                     TfLiteIntArray* new_size) {
@@ -1633,6 +1948,8 @@ TfLiteStatus Subgraph::SetTensorParametersReadOnly(
         "SetTensorParametersReadOnly is disallowed when graph is immutable.");
     return kTfLiteError;
   }
+  // The ops may depend on parameters missing from their prepare signature.
+  prepared_node_signatures_.clear();
 
   TF_LITE_ENSURE(&context_,
                  tensor_index < context_.tensors_size && tensor_index >= 0);
@@ -1690,6 +2007,8 @@ TfLiteStatus Subgraph::SetTensorParametersReadWrite(
         "SetTensorParametersReadWrite is disallowed when graph is immutable.");
     return kTfLiteError;
   }
+  // The ops may depend on parameters missing from their prepare signature.
+  prepared_node_signatures_.clear();
   TF_LITE_ENSURE(&context_,
                  tensor_index < context_.tensors_size && tensor_index >= 0);
   size_t required_bytes = 0;
@@ -1735,6 +2054,7 @@ TfLiteStatus Subgraph::SetExecutionPlan(const std::vector<int>& new_plan) {
                                   node_index < nodes_and_registration_.size());
   }
   execution_plan_ = new_plan;
+  parallel_stages_.clear();
   return kTfLiteOk;
 }
 
@@ -1979,6 +2299,11 @@ TfLiteStatus Subgraph::ModifyGraphWithDelegateImpl(TfLiteDelegate* delegate) {
     return kTfLiteDelegateError;
   }
 
+  // Delegates may change the types of the tensors and replace the nodes, so
+  // prepare all the nodes again once they are removed.
+  prepared_node_signatures_.clear();
+  parallel_stages_.clear();
+
   // Resets delegation & leaves graph in consistent state if delegate status is
   // not okay.
   auto reset_delegation_if_not_ok = [this](TfLiteStatus status) {
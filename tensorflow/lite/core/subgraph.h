@@ -38,6 +38,7 @@ limitations under the License.
 #include "tensorflow/lite/experimental/resource/initialization_status.h"
 #include "tensorflow/lite/experimental/resource/resource_base.h"
 #include "tensorflow/lite/graph_info.h"
+#include "tensorflow/lite/inter_op_thread_pool.h"
 #include "tensorflow/lite/interpreter_options.h"
 #include "tensorflow/lite/memory_planner.h"
 #include "tensorflow/lite/util.h"
@@ -456,6 +457,38 @@ class Subgraph {
     return (options_ && options_->GetDisableDelegateClustering());
   }
 
+  // WARNING: This is an experimental API and subject to change.
+  // True if the memory planner may compute elementwise ops in place and search
+  // for the tensor allocation order which needs the smallest arena.
+  bool ShouldOptimizeArena() const {
+    return !(options_ && options_->GetDisableArenaOptimizations());
+  }
+
+  // WARNING: This is an experimental API and subject to change.
+  // True if the ops whose inputs still have the types and shapes they were
+  // prepared for may be skipped when the tensors are reallocated.
+  bool ShouldPrepareIncrementally() const {
+    return !(options_ && options_->GetDisableIncrementalPrepare());
+  }
+
+  // WARNING: This is an experimental API and subject to change.
+  // Sets the pool running the nodes which don't depend on each other
+  // concurrently, or nullptr to run all the nodes one at a time. The pool is
+  // owned by the Interpreter, and is used from the next `AllocateTensors`.
+  void SetInterOpThreadPool(InterOpThreadPool* thread_pool) {
+    inter_op_thread_pool_ = thread_pool;
+  }
+
+  // WARNING: This is an experimental API and subject to change.
+  // Returns the first and last execution plan indices of the nodes which may
+  // run concurrently with the node at `execution_plan_index`.
+  std::pair<int, int> concurrent_nodes(int execution_plan_index) const {
+    if (parallel_stages_.size() != execution_plan_.size()) {
+      return {execution_plan_index, execution_plan_index};
+    }
+    return parallel_stages_[execution_plan_index];
+  }
+
  private:
 #ifndef DOXYGEN_SKIP
   friend class tflite::impl::InterpreterBuilder;
@@ -542,6 +575,11 @@ class Subgraph {
   // Invoke the operator represented by 'node'.
   TfLiteStatus OpInvoke(const TfLiteRegistration& op_reg, TfLiteNode* node);
 
+  // Invoke the operator represented by 'node' with the given 'context', which
+  // is either 'context_' or the context of an inter-op worker.
+  TfLiteStatus OpInvoke(const TfLiteRegistration& op_reg, TfLiteNode* node,
+                        TfLiteContext* context);
+
   // Call OpPrepare() for as many ops as possible, allocating memory for their
   // tensors. If an op containing dynamic tensors is found, preparation will be
   // postponed until this function is called again. This allows the interpreter
@@ -556,6 +594,38 @@ class Subgraph {
                                     const std::vector<int>& execution_plan,
                                     int* last_execution_plan_index_prepared);
 
+  // Returns true if preparing the node again would give the same result, and
+  // fills `signature` with the types and shapes of its tensors, which are
+  // compared with the ones it was last prepared with. Only builtin ops whose
+  // Prepare() depends on nothing but these are skipped: control flow ops,
+  // custom ops and delegate kernels are always prepared again.
+  bool GetPrepareSignature(const TfLiteRegistration& registration,
+                           const TfLiteNode& node,
+                           std::vector<int>* signature) const;
+
+  // Returns true if 'node' must not run concurrently with any other node:
+  // control flow ops, custom ops and delegate kernels, and the nodes using
+  // resource, variant, variable or dynamic tensors.
+  bool IsInterOpBarrier(const TfLiteNode& node,
+                        const TfLiteRegistration& registration) const;
+
+  // Groups the nodes which don't depend on each other into stages of nodes
+  // run concurrently by the inter-op thread pool, reordering the execution
+  // plan so that each stage is contiguous, and replans and prepares the
+  // tensors again if the stages changed. Only called once all the nodes have
+  // been prepared.
+  TfLiteStatus PlanParallelStages();
+
+  // Checks that the inputs of 'node' can be read before invoking it, copying
+  // the data of the tensors computed by a delegate if necessary.
+  TfLiteStatus EnsureNodeInputsAreReadable(
+      const TfLiteNode& node, const TfLiteRegistration& registration);
+
+  // Invokes the nodes of the stage between the given execution plan indices
+  // on the inter-op thread pool.
+  TfLiteStatus InvokeConcurrently(int first_execution_plan_index,
+                                  int last_execution_plan_index);
+
   // Tensors needed by the interpreter. Use `AddTensors` to add more blank
   // tensor entries. Note, `tensors_.data()` needs to be synchronized to the
   // `context_` whenever this std::vector is reallocated. Currently this
@@ -691,6 +761,11 @@ class Subgraph {
   static TfLiteExternalContext* GetExternalContext(
       struct TfLiteContext* context, TfLiteExternalContextType type);
 
+  // Retrieves an external context from the context of an inter-op worker,
+  // which has its own CPU backend context.
+  static TfLiteExternalContext* GetWorkerExternalContext(
+      struct TfLiteContext* context, TfLiteExternalContextType type);
+
   // Set the value of an external context.
   static void SetExternalContext(struct TfLiteContext* context,
                                  TfLiteExternalContextType type,
@@ -865,6 +940,24 @@ class Subgraph {
   // so that tensor shapes propagate.
   int next_original_execution_plan_index_to_prepare_;
 
+  // Signatures (see GetPrepareSignature()) of the nodes when they were last
+  // prepared, indexed by node. Empty if the node must be prepared again.
+  std::vector<std::vector<int>> prepared_node_signatures_;
+
+  // Pool running independent nodes concurrently, owned by the Interpreter.
+  // Can be nullptr.
+  InterOpThreadPool* inter_op_thread_pool_ = nullptr;
+
+  // The first and last execution plan indices of the stage of each node of
+  // the execution plan (see PlanParallelStages()). Empty if no nodes run
+  // concurrently.
+  std::vector<std::pair<int, int>> parallel_stages_;
+
+  // The contexts used by the threads of the inter-op thread pool, which have
+  // their own CPU backend context and thread budget. Indexed by thread.
+  struct InterOpWorkerContext;
+  std::vector<std::unique_ptr<InterOpWorkerContext>> inter_op_worker_contexts_;
+
   // This is similar to `next_execution_plan_index_to_prepare_`, but it tracks
   // which nodes' allocation is planned with the arena planner.
   //
@@ -16,10 +16,17 @@ limitations under the License.
 #include "tensorflow/lite/core/subgraph.h"
 
 #include <algorithm>
+#include <cstdlib>
+#include <utility>
+#include <vector>
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
+#include "tensorflow/lite/builtin_ops.h"
+#include "tensorflow/lite/core/c/builtin_op_data.h"
+#include "tensorflow/lite/core/c/common.h"
 #include "tensorflow/lite/core/interpreter.h"
+#include "tensorflow/lite/interpreter_options.h"
 
 namespace tflite {
 
@@ -27,6 +34,7 @@ namespace ops {
 namespace builtin {
 TfLiteRegistration* Register_PADV2();
 TfLiteRegistration* Register_NEG();
+TfLiteRegistration* Register_ADD();
 }  // namespace builtin
 }  // namespace ops
 
@@ -71,5 +79,149 @@ TEST(RemoveUnusedInputs, BypassInputsWithoutOp) {
   ASSERT_EQ(subgraph.inputs(), std::vector<int>({0, -1, 2}));
 }
 
+// Returns a builtin op whose output has the shape of its first input, and
+// which counts the calls to its Prepare() in its user data.
+TfLiteRegistration CountingPrepareOp() {
+  TfLiteRegistration reg = {};
+  reg.builtin_code = kTfLiteBuiltinNeg;
+  reg.init = [](TfLiteContext*, const char*, size_t) -> void* {
+    return new int(0);
+  };
+  reg.free = [](TfLiteContext*, void* buffer) {
+    delete static_cast<int*>(buffer);
+  };
+  reg.prepare = [](TfLiteContext* context, TfLiteNode* node) {
+    ++*static_cast<int*>(node->user_data);
+    const TfLiteTensor* input = &context->tensors[node->inputs->data[0]];
+    TfLiteTensor* output = &context->tensors[node->outputs->data[0]];
+    return context->ResizeTensor(context, output,
+                                 TfLiteIntArrayCopy(input->dims));
+  };
+  reg.invoke = [](TfLiteContext*, TfLiteNode*) { return kTfLiteOk; };
+  return reg;
+}
+
+// Builds a graph of two ops on inputs 0 and 1, followed by an op on both of
+// their outputs.
+void BuildCountingPrepareGraph(Subgraph* subgraph,
+                               const TfLiteRegistration* reg) {
+  subgraph->AddTensors(5);
+  subgraph->SetInputs({0, 1});
+  subgraph->SetOutputs({4});
+  for (int i = 0; i < 5; ++i) {
+    subgraph->SetTensorParametersReadWrite(i, kTfLiteFloat32, "", {1, 2},
+                                           TfLiteQuantization());
+  }
+  subgraph->AddNodeWithParameters({0}, {2}, {}, nullptr, 0, nullptr, reg);
+  subgraph->AddNodeWithParameters({1}, {3}, {}, nullptr, 0, nullptr, reg);
+  subgraph->AddNodeWithParameters({2, 3}, {4}, {}, nullptr, 0, nullptr, reg);
+}
+
+std::vector<int> GetPrepareCounts(const Subgraph& subgraph) {
+  std::vector<int> counts;
+  for (int i = 0; i < 3; ++i) {
+    counts.push_back(*static_cast<const int*>(
+        subgraph.node_and_registration(i)->first.user_data));
+  }
+  return counts;
+}
+
+TEST(IncrementalPrepare, OnlyOpsDependingOnResizedInputsArePrepared) {
+  Interpreter interpreter;
+  Subgraph& subgraph = interpreter.primary_subgraph();
+  TfLiteRegistration reg = CountingPrepareOp();
+  BuildCountingPrepareGraph(&subgraph, &reg);
+  ASSERT_EQ(subgraph.AllocateTensors(), kTfLiteOk);
+  EXPECT_THAT(GetPrepareCounts(subgraph), testing::ElementsAre(1, 1, 1));
+
+  ASSERT_EQ(subgraph.ResizeInputTensor(0, {3, 2}), kTfLiteOk);
+  ASSERT_EQ(subgraph.AllocateTensors(), kTfLiteOk);
+  EXPECT_THAT(GetPrepareCounts(subgraph), testing::ElementsAre(2, 1, 2));
+  EXPECT_EQ(subgraph.tensor(4)->dims->data[0], 3);
+
+  ASSERT_EQ(subgraph.ResizeInputTensor(1, {4, 2}), kTfLiteOk);
+  ASSERT_EQ(subgraph.AllocateTensors(), kTfLiteOk);
+  EXPECT_THAT(GetPrepareCounts(subgraph), testing::ElementsAre(2, 2, 3));
+  ASSERT_EQ(subgraph.Invoke(), kTfLiteOk);
+
+  // Resizing the inputs back prepares their ops again.
+  ASSERT_EQ(subgraph.ResizeInputTensor(0, {1, 2}), kTfLiteOk);
+  ASSERT_EQ(subgraph.AllocateTensors(), kTfLiteOk);
+  EXPECT_THAT(GetPrepareCounts(subgraph), testing::ElementsAre(3, 2, 4));
+  EXPECT_EQ(subgraph.tensor(4)->dims->data[0], 1);
+}
+
+TEST(IncrementalPrepare, Disabled) {
+  Interpreter interpreter;
+  InterpreterOptions options;
+  options.SetDisableIncrementalPrepare();
+  ASSERT_EQ(interpreter.ApplyOptions(&options), kTfLiteOk);
+  Subgraph& subgraph = interpreter.primary_subgraph();
+  TfLiteRegistration reg = CountingPrepareOp();
+  BuildCountingPrepareGraph(&subgraph, &reg);
+  ASSERT_EQ(subgraph.AllocateTensors(), kTfLiteOk);
+  ASSERT_EQ(subgraph.ResizeInputTensor(0, {3, 2}), kTfLiteOk);
+  ASSERT_EQ(subgraph.AllocateTensors(), kTfLiteOk);
+  EXPECT_THAT(GetPrepareCounts(subgraph), testing::ElementsAre(2, 2, 2));
+}
+
+// Builds a graph of two branches of two NEG ops on input 0, followed by an
+// ADD of the outputs of both branches.
+void BuildTwoBranchGraph(Subgraph* subgraph) {
+  subgraph->AddTensors(6);
+  subgraph->SetInputs({0});
+  subgraph->SetOutputs({5});
+  for (int i = 0; i < 6; ++i) {
+    subgraph->SetTensorParametersReadWrite(i, kTfLiteFloat32, "", {2},
+                                           TfLiteQuantization());
+  }
+  TfLiteRegistration* neg_op = tflite::ops::builtin::Register_NEG();
+  TfLiteRegistration* add_op = tflite::ops::builtin::Register_ADD();
+  subgraph->AddNodeWithParameters({0}, {1}, {}, nullptr, 0, nullptr, neg_op);
+  subgraph->AddNodeWithParameters({1}, {2}, {}, nullptr, 0, nullptr, neg_op);
+  subgraph->AddNodeWithParameters({0}, {3}, {}, nullptr, 0, nullptr, neg_op);
+  subgraph->AddNodeWithParameters({3}, {4}, {}, nullptr, 0, nullptr, neg_op);
+  auto* params =
+      static_cast<TfLiteAddParams*>(malloc(sizeof(TfLiteAddParams)));
+  params->activation = kTfLiteActNone;
+  params->pot_scale_int16 = false;
+  subgraph->AddNodeWithParameters({2, 4}, {5}, {}, nullptr, 0, params, add_op);
+}
+
+TEST(InterOpParallelism, IndependentNodesRunConcurrently) {
+  Interpreter interpreter;
+  InterpreterOptions options;
+  options.SetInterOpParallelism(2);
+  ASSERT_EQ(interpreter.ApplyOptions(&options), kTfLiteOk);
+  Subgraph& subgraph = interpreter.primary_subgraph();
+  BuildTwoBranchGraph(&subgraph);
+  ASSERT_EQ(subgraph.AllocateTensors(), kTfLiteOk);
+
+  // The first ops of both branches, then their second ops, run together.
+  EXPECT_THAT(subgraph.execution_plan(), testing::ElementsAre(0, 2, 1, 3, 4));
+  EXPECT_EQ(subgraph.concurrent_nodes(0), std::make_pair(0, 1));
+  EXPECT_EQ(subgraph.concurrent_nodes(3), std::make_pair(2, 3));
+  EXPECT_EQ(subgraph.concurrent_nodes(4), std::make_pair(4, 4));
+
+  for (int iteration = 0; iteration < 3; ++iteration) {
+    float* input = subgraph.tensor(0)->data.f;
+    input[0] = 1.f + iteration;
+    input[1] = -2.f;
+    ASSERT_EQ(subgraph.Invoke(), kTfLiteOk);
+    const float* output = subgraph.tensor(5)->data.f;
+    EXPECT_EQ(output[0], 2.f * (1.f + iteration));
+    EXPECT_EQ(output[1], -4.f);
+  }
+}
+
+TEST(InterOpParallelism, DisabledByDefault) {
+  Interpreter interpreter;
+  Subgraph& subgraph = interpreter.primary_subgraph();
+  BuildTwoBranchGraph(&subgraph);
+  ASSERT_EQ(subgraph.AllocateTensors(), kTfLiteOk);
+  EXPECT_THAT(subgraph.execution_plan(), testing::ElementsAre(0, 1, 2, 3, 4));
+  EXPECT_EQ(subgraph.concurrent_nodes(1), std::make_pair(1, 1));
+}
+
 }  // namespace
 }  // namespace tflite
@@ -0,0 +1,985 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/lite/delegates/elementwise_fusion/elementwise_fusion_delegate.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "tensorflow/lite/builtin_ops.h"
+#include "tensorflow/lite/context_util.h"
+#include "tensorflow/lite/core/c/builtin_op_data.h"
+#include "tensorflow/lite/core/c/common.h"
+#include "tensorflow/lite/delegates/utils/simple_delegate.h"
+#include "tensorflow/lite/kernels/cpu_backend_context.h"
+#include "tensorflow/lite/kernels/internal/optimized/depthwiseconv_multithread.h"
+#include "tensorflow/lite/kernels/internal/optimized/optimized_ops.h"
+#include "tensorflow/lite/kernels/internal/types.h"
+#include "tensorflow/lite/kernels/kernel_util.h"
+#include "tensorflow/lite/kernels/padding.h"
+#include "tensorflow/lite/util.h"
+
+namespace tflite {
+namespace elementwise_fusion {
+
+std::string FusionReport::ToString() const {
+  std::string result;
+  for (const Fusion& fusion : fusions) {
+    if (fusion.producer_node >= 0) {
+      result += fusion.producer_op + "(#" +
+                std::to_string(fusion.producer_node) + ") -> ";
+    }
+    result += "[";
+    for (size_t i = 0; i < fusion.nodes.size(); ++i) {
+      if (i > 0) result += fusion.folded[i] ? " + " : ", ";
+      result += fusion.ops[i] + "(#" + std::to_string(fusion.nodes[i]) + ")";
+    }
+    result += "]\n";
+  }
+  return result;
+}
+
+namespace {
+
+// Number of elements of each operand computed at once by the fused kernel.
+// The tiles of all the intermediate values of a chain stay in the L1 cache.
+constexpr int kTileSize = 512;
+
+// Returns the number of inputs of a fusible op, or 0 if it isn't fusible.
+int GetArity(int builtin_code) {
+  switch (builtin_code) {
+    case kTfLiteBuiltinAbs:
+    case kTfLiteBuiltinLogistic:
+    case kTfLiteBuiltinNeg:
+    case kTfLiteBuiltinRelu:
+    case kTfLiteBuiltinRelu6:
+    case kTfLiteBuiltinReluN1To1:
+    case kTfLiteBuiltinSquare:
+    case kTfLiteBuiltinTanh:
+      return 1;
+    case kTfLiteBuiltinAdd:
+    case kTfLiteBuiltinMaximum:
+    case kTfLiteBuiltinMinimum:
+    case kTfLiteBuiltinMul:
+    case kTfLiteBuiltinSub:
+      return 2;
+    default:
+      return 0;
+  }
+}
+
+TfLiteFusedActivation GetActivation(int builtin_code, const TfLiteNode* node) {
+  if (node->builtin_data == nullptr) return kTfLiteActNone;
+  switch (builtin_code) {
+    case kTfLiteBuiltinAdd:
+      return static_cast<const TfLiteAddParams*>(node->builtin_data)
+          ->activation;
+    case kTfLiteBuiltinMul:
+      return static_cast<const TfLiteMulParams*>(node->builtin_data)
+          ->activation;
+    case kTfLiteBuiltinSub:
+      return static_cast<const TfLiteSubParams*>(node->builtin_data)
+          ->activation;
+    default:
+      return kTfLiteActNone;
+  }
+}
+
+bool IsClampActivation(TfLiteFusedActivation activation) {
+  return activation == kTfLiteActNone || activation == kTfLiteActRelu ||
+         activation == kTfLiteActReluN1To1 || activation == kTfLiteActRelu6;
+}
+
+std::vector<int> GetDims(const TfLiteTensor& tensor) {
+  return std::vector<int>(tensor.dims->data,
+                          tensor.dims->data + tensor.dims->size);
+}
+
+// Whether the constant `tensor` can be broadcast to `dims` along the innermost
+// dimension, i.e. it's a scalar or a vector of the size of that dimension. Its
+// rank can't exceed the rank of `dims`, since broadcasting would then give the
+// output its rank.
+bool IsBroadcastable(const TfLiteTensor& tensor, const std::vector<int>& dims) {
+  if (tensor.dims->size > static_cast<int>(dims.size())) return false;
+  const int64_t num_elements = NumElements(&tensor);
+  if (num_elements == 1) return true;
+  return !dims.empty() && tensor.dims->size > 0 &&
+         num_elements == dims.back() &&
+         tensor.dims->data[tensor.dims->size - 1] == dims.back();
+}
+
+RuntimeShape GetRuntimeShape(const std::vector<int>& dims) {
+  return RuntimeShape(dims.size(), dims.data());
+}
+
+// Whether the node computes a linear function of its input plus a bias, into
+// which the constant ADD, SUB and MUL nodes reading its output can be folded.
+bool IsLinearOp(int builtin_code) {
+  return builtin_code == kTfLiteBuiltinConv2d ||
+         builtin_code == kTfLiteBuiltinDepthwiseConv2d ||
+         builtin_code == kTfLiteBuiltinFullyConnected;
+}
+
+// Returns the number of output channels of a linear node with `filter`.
+int GetNumChannels(int builtin_code, const TfLiteTensor& filter) {
+  return builtin_code == kTfLiteBuiltinDepthwiseConv2d
+             ? filter.dims->data[filter.dims->size - 1]
+             : filter.dims->data[0];
+}
+
+// Returns the index of the constant input of `node` if it's an ADD or MUL of
+// `tensor`, of `channels` channels, by a scalar or a vector of one value per
+// channel, or a SUB of such a constant from `tensor`. Returns -1 otherwise.
+int GetFoldedConstant(TfLiteContext* context, int builtin_code,
+                      const TfLiteNode* node, int tensor, int channels) {
+  if (builtin_code != kTfLiteBuiltinAdd && builtin_code != kTfLiteBuiltinMul &&
+      builtin_code != kTfLiteBuiltinSub) {
+    return -1;
+  }
+  if (node->inputs->size != 2 || node->outputs->size != 1 ||
+      !IsClampActivation(GetActivation(builtin_code, node))) {
+    return -1;
+  }
+  int index;
+  if (node->inputs->data[0] == tensor) {
+    index = 1;
+  } else if (node->inputs->data[1] == tensor &&
+             builtin_code != kTfLiteBuiltinSub) {
+    index = 0;
+  } else {
+    return -1;
+  }
+  const int constant_index = node->inputs->data[index];
+  if (constant_index < 0) return -1;
+  const TfLiteTensor& constant = context->tensors[constant_index];
+  if (constant.type != kTfLiteFloat32 || !IsConstantTensor(&constant)) {
+    return -1;
+  }
+  const int64_t num_elements = NumElements(&constant);
+  if (num_elements != 1 && num_elements != channels) return -1;
+  if (!IsBroadcastable(constant, GetDims(context->tensors[tensor]))) return -1;
+  return constant_index;
+}
+
+class ElementwiseFusionDelegate;
+
+// Computes the nodes of a partition in a loop over tiles of their operands.
+// Nodes whose outputs have different numbers of elements can't depend on each
+// other, so they're computed in separate loops.
+class ElementwiseFusionKernel : public SimpleDelegateKernelInterface {
+ public:
+  explicit ElementwiseFusionKernel(ElementwiseFusionDelegate* delegate)
+      : delegate_(delegate) {}
+
+  TfLiteStatus Init(TfLiteContext* context,
+                    const TfLiteDelegateParams* params) override;
+
+  TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) override;
+
+  TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) override;
+
+ private:
+  // A CONV_2D, DEPTHWISE_CONV_2D or FULLY_CONNECTED node, with copies of its
+  // weights and bias into which the ADD, SUB and MUL nodes by constants
+  // reading its output are folded.
+  struct LinearOp {
+    // The weights of each channel are contiguous, except for DEPTHWISE_CONV_2D
+    // whose channels are the innermost dimension.
+    bool is_depthwise;
+    std::vector<float> filter;
+    std::vector<int> filter_dims;
+    std::vector<float> bias;
+    // The activation of the node, or of the last node folded into it.
+    TfLiteFusedActivation activation;
+    TfLitePadding padding;
+    int stride_width;
+    int stride_height;
+    int dilation_width_factor;
+    int dilation_height_factor;
+    bool keep_num_dims;
+    // Computed by Prepare.
+    std::vector<int> input_dims;
+    TfLitePaddingValues padding_values;
+    int depth_multiplier;
+    std::vector<int> im2col_dims;
+    std::vector<float> im2col;
+  };
+
+  enum class OperandKind {
+    // Read at the same offsets from the value of another fused op.
+    kValue,
+    // Read at the same offsets from a tensor.
+    kTensor,
+    // A constant tensor broadcast along the innermost dimension.
+    kBroadcast,
+  };
+
+  struct Operand {
+    int tensor;
+    // Index of the fused op producing it, or -1 for an input of the partition.
+    int value = -1;
+    OperandKind kind = OperandKind::kTensor;
+    int broadcast_size = 1;
+  };
+
+  struct FusedOp {
+    int builtin_code;
+    // The fused activation of ADD, MUL and SUB.
+    ArithmeticParams params;
+    // Index of the linear op, or -1 for an elementwise op.
+    int linear = -1;
+    std::vector<Operand> inputs;
+    int output;
+    // Whether the output is read outside of the partition, and so written to
+    // its tensor rather than to a tile.
+    bool is_output;
+    // Whether the output is read by a linear op, or after one, and so written
+    // to `buffer` rather than to a tile if it isn't an output. The outputs of
+    // the linear ops are always stored.
+    bool is_stored = false;
+    // Number of linear ops up to this one, which can only read the values of
+    // the ops before them once these are stored.
+    int segment;
+    std::vector<int> dims;
+    std::vector<float> buffer;
+  };
+
+  struct Loop {
+    int64_t size;
+    std::vector<int> ops;
+  };
+
+  float* Tile(int op) { return scratch_.data() + (3 * op) * kTileSize; }
+  float* BroadcastTile(int op, int input) {
+    return scratch_.data() + (3 * op + 1 + input) * kTileSize;
+  }
+
+  // Returns all the values of `op`, which must be an output or stored.
+  float* GetStoredData(TfLiteContext* context, int op) {
+    return ops_[op].is_output ? context->tensors[ops_[op].output].data.f
+                              : ops_[op].buffer.data();
+  }
+
+  TfLiteStatus InitLinearOp(TfLiteContext* context, int builtin_code,
+                            const TfLiteNode* node, LinearOp* op);
+  void Fold(TfLiteContext* context, int builtin_code, int constant,
+            LinearOp* op);
+  TfLiteStatus PrepareLinearOp(TfLiteContext* context, FusedOp* op);
+  void EvalLinearOp(TfLiteContext* context, int op);
+  const float* GetOperandTile(TfLiteContext* context, int op, int input,
+                              int64_t start, int size);
+  void EvalTile(TfLiteContext* context, int op, int64_t start, int size);
+
+  ElementwiseFusionDelegate* delegate_;
+  std::vector<FusedOp> ops_;
+  std::vector<LinearOp> linear_ops_;
+  std::vector<Loop> loops_;
+  std::vector<float> scratch_;
+};
+
+// Claims the fusible nodes and reports the fusions applied.
+class ElementwiseFusionDelegate : public SimpleDelegateInterface {
+ public:
+  explicit ElementwiseFusionDelegate(
+      const ElementwiseFusionDelegateOptions& options)
+      : options_(options) {}
+
+  bool IsNodeSupportedByDelegate(const TfLiteRegistration* registration,
+                                 const TfLiteNode* node,
+                                 TfLiteContext* context) const override {
+    if (IsLinearOp(registration->builtin_code)) {
+      return IsFoldableLinearNode(registration->builtin_code, node, context);
+    }
+    const int arity = GetArity(registration->builtin_code);
+    if (arity == 0 || node->inputs->size != arity ||
+        node->outputs->size != 1) {
+      return false;
+    }
+    if (!IsClampActivation(GetActivation(registration->builtin_code, node))) {
+      return false;
+    }
+    if (context->tensors[node->outputs->data[0]].type != kTfLiteFloat32) {
+      return false;
+    }
+    // The non-constant inputs determine the shape of the output, and can't be
+    // broadcast.
+    const TfLiteTensor* shape_input = nullptr;
+    for (int i = 0; i < arity; ++i) {
+      const int tensor_index = node->inputs->data[i];
+      if (tensor_index < 0) return false;
+      const TfLiteTensor& input = context->tensors[tensor_index];
+      if (input.type != kTfLiteFloat32 || input.is_variable) return false;
+      if (IsConstantTensor(&input)) continue;
+      if (shape_input != nullptr &&
+          !TfLiteIntArrayEqual(shape_input->dims, input.dims)) {
+        return false;
+      }
+      shape_input = &input;
+    }
+    if (shape_input == nullptr) return false;
+    const std::vector<int> dims = GetDims(*shape_input);
+    for (int i = 0; i < arity; ++i) {
+      const TfLiteTensor& input = context->tensors[node->inputs->data[i]];
+      if (IsConstantTensor(&input) &&
+          !TfLiteIntArrayEqual(shape_input->dims, input.dims) &&
+          !IsBroadcastable(input, dims)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  TfLiteStatus Initialize(TfLiteContext* context) override {
+    // Remembers the node producing each tensor, to report the ops the fused
+    // chains are epilogues of, and the nodes reading each tensor, to find the
+    // nodes that can be folded into the linear node producing it.
+    producers_.clear();
+    consumers_.clear();
+    TfLiteIntArray* execution_plan;
+    TF_LITE_ENSURE_STATUS(context->GetExecutionPlan(context, &execution_plan));
+    for (int node_index : TfLiteIntArrayView(execution_plan)) {
+      TfLiteNode* node;
+      TfLiteRegistration* registration;
+      TF_LITE_ENSURE_STATUS(context->GetNodeAndRegistration(
+          context, node_index, &node, &registration));
+      for (int tensor_index : TfLiteIntArrayView(node->outputs)) {
+        producers_[tensor_index] = node_index;
+        producer_ops_[node_index] = GetOpNameByRegistration(*registration);
+      }
+      for (int tensor_index : TfLiteIntArrayView(node->inputs)) {
+        if (tensor_index >= 0) consumers_[tensor_index].push_back(node_index);
+      }
+    }
+    return kTfLiteOk;
+  }
+
+  const char* Name() const override {
+    static constexpr char kName[] = "ElementwiseFusion";
+    return kName;
+  }
+
+  std::unique_ptr<SimpleDelegateKernelInterface> CreateDelegateKernelInterface()
+      override {
+    return std::make_unique<ElementwiseFusionKernel>(this);
+  }
+
+  SimpleDelegateInterface::Options DelegateOptions() const override {
+    SimpleDelegateInterface::Options options;
+    options.min_nodes_per_partition = options_.min_nodes_per_fusion;
+    return options;
+  }
+
+  // Appends `fusion` to the report, if any, with the producer of the
+  // `input_tensor` of the chain.
+  void AddFusion(Fusion fusion, int input_tensor) {
+    if (options_.report == nullptr) return;
+    auto it = producers_.find(input_tensor);
+    if (it != producers_.end()) {
+      fusion.producer_node = it->second;
+      fusion.producer_op = producer_ops_[it->second];
+    }
+    options_.report->fusions.push_back(std::move(fusion));
+  }
+
+ private:
+  // Whether the float linear `node` is claimed, so that the ADD, SUB or MUL
+  // node by a constant reading its output is folded into its weights and bias.
+  bool IsFoldableLinearNode(int builtin_code, const TfLiteNode* node,
+                            TfLiteContext* context) const {
+    if (node->inputs->size < 2 || node->inputs->size > 3 ||
+        node->outputs->size != 1 || node->builtin_data == nullptr) {
+      return false;
+    }
+    const int input_index = node->inputs->data[0];
+    const int filter_index = node->inputs->data[1];
+    const int bias_index = node->inputs->size > 2 ? node->inputs->data[2] : -1;
+    if (input_index < 0 || filter_index < 0) return false;
+    const TfLiteTensor& input = context->tensors[input_index];
+    const TfLiteTensor& filter = context->tensors[filter_index];
+    const int output_index = node->outputs->data[0];
+    const TfLiteTensor& output = context->tensors[output_index];
+    if (input.type != kTfLiteFloat32 || filter.type != kTfLiteFloat32 ||
+        output.type != kTfLiteFloat32 || !IsConstantTensor(&filter) ||
+        filter.sparsity != nullptr || filter.dims->size < 1) {
+      return false;
+    }
+    const int channels = GetNumChannels(builtin_code, filter);
+    if (bias_index >= 0) {
+      const TfLiteTensor& bias = context->tensors[bias_index];
+      if (bias.type != kTfLiteFloat32 || !IsConstantTensor(&bias) ||
+          NumElements(&bias) != channels) {
+        return false;
+      }
+    }
+    // The folded nodes follow the activation, so the node can't have any.
+    switch (builtin_code) {
+      case kTfLiteBuiltinConv2d: {
+        const auto* params =
+            static_cast<const TfLiteConvParams*>(node->builtin_data);
+        if (params->activation != kTfLiteActNone) return false;
+        // Grouped convolutions aren't supported.
+        if (input.dims->size != 4 || filter.dims->size != 4 ||
+            input.dims->data[3] != filter.dims->data[3]) {
+          return false;
+        }
+        break;
+      }
+      case kTfLiteBuiltinDepthwiseConv2d: {
+        const auto* params =
+            static_cast<const TfLiteDepthwiseConvParams*>(node->builtin_data);
+        if (params->activation != kTfLiteActNone) return false;
+        if (input.dims->size != 4 || filter.dims->size != 4 ||
+            filter.dims->data[0] != 1) {
+          return false;
+        }
+        break;
+      }
+      case kTfLiteBuiltinFullyConnected: {
+        const auto* params =
+            static_cast<const TfLiteFullyConnectedParams*>(node->builtin_data);
+        if (params->activation != kTfLiteActNone ||
+            params->weights_format !=
+                kTfLiteFullyConnectedWeightsFormatDefault ||
+            filter.dims->size != 2) {
+          return false;
+        }
+        break;
+      }
+      default:
+        return false;
+    }
+    auto it = consumers_.find(output_index);
+    if (it == consumers_.end() || it->second.size() != 1) return false;
+    TfLiteNode* consumer;
+    TfLiteRegistration* registration;
+    if (context->GetNodeAndRegistration(context, it->second[0], &consumer,
+                                        &registration) != kTfLiteOk) {
+      return false;
+    }
+    return GetFoldedConstant(context, registration->builtin_code, consumer,
+                             output_index, channels) >= 0;
+  }
+
+  const ElementwiseFusionDelegateOptions options_;
+  std::unordered_map<int, int> producers_;
+  std::unordered_map<int, std::vector<int>> consumers_;
+  std::unordered_map<int, std::string> producer_ops_;
+};
+
+TfLiteStatus ElementwiseFusionKernel::Init(TfLiteContext* context,
+                                           const TfLiteDelegateParams* params) {
+  // A node is only folded into the linear op producing its input if it's the
+  // single reader of that input.
+  std::unordered_map<int, int> num_readers;
+  for (int node_index : TfLiteIntArrayView(params->nodes_to_replace)) {
+    TfLiteNode* node;
+    TfLiteRegistration* registration;
+    TF_LITE_ENSURE_STATUS(context->GetNodeAndRegistration(
+        context, node_index, &node, &registration));
+    for (int tensor_index : TfLiteIntArrayView(node->inputs)) {
+      ++num_readers[tensor_index];
+    }
+  }
+  const std::unordered_set<int> outputs(
+      params->output_tensors->data,
+      params->output_tensors->data + params->output_tensors->size);
+
+  std::unordered_map<int, int> values;
+  Fusion fusion;
+  int chain_input = -1;
+  int segment = 0;
+  for (int node_index : TfLiteIntArrayView(params->nodes_to_replace)) {
+    TfLiteNode* node;
+    TfLiteRegistration* registration;
+    TF_LITE_ENSURE_STATUS(context->GetNodeAndRegistration(
+        context, node_index, &node, &registration));
+    const int builtin_code = registration->builtin_code;
+    fusion.nodes.push_back(node_index);
+    fusion.ops.push_back(GetOpNameByRegistration(*registration));
+
+    // Folds the node into the linear op producing one of its inputs, if any.
+    bool folded = false;
+    for (int tensor_index : TfLiteIntArrayView(node->inputs)) {
+      auto it = values.find(tensor_index);
+      if (it == values.end()) continue;
+      FusedOp& producer = ops_[it->second];
+      if (producer.linear < 0 || producer.output != tensor_index ||
+          num_readers[tensor_index] != 1 || outputs.count(tensor_index) ||
+          linear_ops_[producer.linear].activation != kTfLiteActNone) {
+        continue;
+      }
+      LinearOp& linear = linear_ops_[producer.linear];
+      const int constant =
+          GetFoldedConstant(context, builtin_code, node, tensor_index,
+                            static_cast<int>(linear.bias.size()));
+      if (constant < 0) continue;
+      Fold(context, builtin_code, constant, &linear);
+      linear.activation = GetActivation(builtin_code, node);
+      producer.output = node->outputs->data[0];
+      producer.is_output = outputs.count(producer.output) > 0;
+      values[producer.output] = it->second;
+      folded = true;
+      break;
+    }
+    fusion.folded.push_back(folded);
+    if (folded) continue;
+
+    FusedOp op;
+    op.builtin_code = builtin_code;
+    if (IsLinearOp(builtin_code)) {
+      ++segment;
+      op.linear = linear_ops_.size();
+      op.is_stored = true;
+      linear_ops_.emplace_back();
+      TF_LITE_ENSURE_STATUS(
+          InitLinearOp(context, builtin_code, node, &linear_ops_.back()));
+    } else {
+      float activation_min, activation_max;
+      CalculateActivationRange(GetActivation(builtin_code, node),
+                               &activation_min, &activation_max);
+      SetActivationParams(activation_min, activation_max, &op.params);
+    }
+    op.segment = segment;
+    // Linear ops only read their input, the other inputs being constants.
+    const int num_inputs = op.linear >= 0 ? 1 : node->inputs->size;
+    for (int i = 0; i < num_inputs; ++i) {
+      Operand operand;
+      operand.tensor = node->inputs->data[i];
+      auto it = values.find(operand.tensor);
+      if (it != values.end()) {
+        operand.value = it->second;
+        operand.kind = OperandKind::kValue;
+        FusedOp& producer = ops_[operand.value];
+        if (op.linear >= 0 || producer.segment != op.segment) {
+          producer.is_stored = true;
+        }
+      } else if (chain_input < 0 &&
+                 !IsConstantTensor(&context->tensors[operand.tensor])) {
+        chain_input = operand.tensor;
+      }
+      op.inputs.push_back(operand);
+    }
+    op.output = node->outputs->data[0];
+    op.is_output = outputs.count(op.output) > 0;
+    values[op.output] = ops_.size();
+    ops_.push_back(std::move(op));
+  }
+  scratch_.resize(3 * ops_.size() * kTileSize);
+  delegate_->AddFusion(std::move(fusion), chain_input);
+  return kTfLiteOk;
+}
+
+TfLiteStatus ElementwiseFusionKernel::InitLinearOp(TfLiteContext* context,
+                                                   int builtin_code,
+                                                   const TfLiteNode* node,
+                                                   LinearOp* op) {
+  const TfLiteTensor& filter = context->tensors[node->inputs->data[1]];
+  op->is_depthwise = builtin_code == kTfLiteBuiltinDepthwiseConv2d;
+  op->filter.assign(filter.data.f, filter.data.f + NumElements(&filter));
+  op->filter_dims = GetDims(filter);
+  op->bias.assign(GetNumChannels(builtin_code, filter), 0.0f);
+  if (node->inputs->size > 2 && node->inputs->data[2] >= 0) {
+    const TfLiteTensor& bias = context->tensors[node->inputs->data[2]];
+    TF_LITE_ENSURE_EQ(context, NumElements(&bias), op->bias.size());
+    std::copy_n(bias.data.f, op->bias.size(), op->bias.begin());
+  }
+  switch (builtin_code) {
+    case kTfLiteBuiltinConv2d: {
+      const auto* params =
+          static_cast<const TfLiteConvParams*>(node->builtin_data);
+      op->activation = params->activation;
+      op->padding = params->padding;
+      op->stride_width = params->stride_width;
+      op->stride_height = params->stride_height;
+      op->dilation_width_factor = params->dilation_width_factor;
+      op->dilation_height_factor = params->dilation_height_factor;
+      break;
+    }
+    case kTfLiteBuiltinDepthwiseConv2d: {
+      const auto* params =
+          static_cast<const TfLiteDepthwiseConvParams*>(node->builtin_data);
+      op->activation = params->activation;
+      op->padding = params->padding;
+      op->stride_width = params->stride_width;
+      op->stride_height = params->stride_height;
+      op->dilation_width_factor = params->dilation_width_factor;
+      op->dilation_height_factor = params->dilation_height_factor;
+      break;
+    }
+    case kTfLiteBuiltinFullyConnected: {
+      const auto* params =
+          static_cast<const TfLiteFullyConnectedParams*>(node->builtin_data);
+      op->activation = params->activation;
+      op->keep_num_dims = params->keep_num_dims;
+      break;
+    }
+  }
+  return kTfLiteOk;
+}
+
+void ElementwiseFusionKernel::Fold(TfLiteContext* context, int builtin_code,
+                                   int constant, LinearOp* op) {
+  const TfLiteTensor& tensor = context->tensors[constant];
+  const bool is_scalar = NumElements(&tensor) == 1;
+  const int channels = op->bias.size();
+  const int depth = op->filter.size() / channels;
+  for (int c = 0; c < channels; ++c) {
+    const float value = tensor.data.f[is_scalar ? 0 : c];
+    switch (builtin_code) {
+      case kTfLiteBuiltinAdd:
+        op->bias[c] += value;
+        break;
+      case kTfLiteBuiltinSub:
+        op->bias[c] -= value;
+        break;
+      case kTfLiteBuiltinMul:
+        op->bias[c] *= value;
+        for (int i = 0; i < depth; ++i) {
+          op->filter[op->is_depthwise ? i * channels + c : c * depth + i] *= value;
+        }
+        break;
+    }
+  }
+}
+
+TfLiteStatus ElementwiseFusionKernel::Prepare(TfLiteContext* context,
+                                              TfLiteNode* node) {
+  loops_.clear();
+  // The loops after a linear op can't compute the ops before it.
+  int segment_start = 0;
+  for (int i = 0; i < static_cast<int>(ops_.size()); ++i) {
+    FusedOp& op = ops_[i];
+    if (op.linear >= 0) {
+      TF_LITE_ENSURE_STATUS(PrepareLinearOp(context, &op));
+    } else {
+      // The output has the shape of the operands that aren't broadcast.
+      bool has_dims = false;
+      for (const Operand& operand : op.inputs) {
+        if (operand.value >= 0) {
+          op.dims = ops_[operand.value].dims;
+          has_dims = true;
+          break;
+        }
+        const TfLiteTensor& tensor = context->tensors[operand.tensor];
+        if (!IsConstantTensor(&tensor)) {
+          op.dims = GetDims(tensor);
+          has_dims = true;
+          break;
+        }
+      }
+      TF_LITE_ENSURE(context, has_dims);
+      for (Operand& operand : op.inputs) {
+        if (operand.value >= 0) {
+          TF_LITE_ENSURE(context, ops_[operand.value].dims == op.dims);
+          continue;
+        }
+        const TfLiteTensor& tensor = context->tensors[operand.tensor];
+        if (GetDims(tensor) == op.dims) {
+          operand.kind = OperandKind::kTensor;
+        } else {
+          TF_LITE_ENSURE(context, IsConstantTensor(&tensor) &&
+                                      IsBroadcastable(tensor, op.dims));
+          operand.kind = OperandKind::kBroadcast;
+          operand.broadcast_size = NumElements(&tensor);
+        }
+      }
+    }
+
+    int64_t size = 1;
+    for (int dim : op.dims) size *= dim;
+    if (op.is_output) {
+      TF_LITE_ENSURE_OK(context,
+                        context->ResizeTensor(
+                            context, &context->tensors[op.output],
+                            ConvertVectorToTfLiteIntArray(op.dims)));
+    } else if (op.is_stored) {
+      op.buffer.resize(size);
+    }
+
+    if (op.linear >= 0) {
+      loops_.push_back({size, {i}});
+      segment_start = loops_.size();
+      continue;
+    }
+    auto loop =
+        std::find_if(loops_.begin() + segment_start, loops_.end(),
+                     [size](const Loop& other) { return other.size == size; });
+    if (loop == loops_.end()) {
+      loops_.push_back({size, {}});
+      loop = loops_.end() - 1;
+    }
+    loop->ops.push_back(i);
+  }
+  return kTfLiteOk;
+}
+
+TfLiteStatus ElementwiseFusionKernel::PrepareLinearOp(TfLiteContext* context,
+                                                      FusedOp* op) {
+  LinearOp& linear = linear_ops_[op->linear];
+  const Operand& input = op->inputs[0];
+  linear.input_dims = input.value >= 0
+                          ? ops_[input.value].dims
+                          : GetDims(context->tensors[input.tensor]);
+  const std::vector<int>& input_dims = linear.input_dims;
+  const std::vector<int>& filter_dims = linear.filter_dims;
+  const int channels = linear.bias.size();
+  if (op->builtin_code == kTfLiteBuiltinFullyConnected) {
+    const int input_size = filter_dims[1];
+    int64_t total_input_size = 1;
+    for (int dim : input_dims) total_input_size *= dim;
+    TF_LITE_ENSURE(context, input_size > 0 &&
+                                total_input_size % input_size == 0);
+    if (linear.keep_num_dims) {
+      TF_LITE_ENSURE(context,
+                     !input_dims.empty() && input_dims.back() == input_size);
+      op->dims = input_dims;
+      op->dims.back() = channels;
+    } else {
+      op->dims = {static_cast<int>(total_input_size / input_size), channels};
+    }
+    return kTfLiteOk;
+  }
+
+  TF_LITE_ENSURE_EQ(context, input_dims.size(), 4);
+  int out_height, out_width;
+  linear.padding_values = ComputePaddingHeightWidth(
+      linear.stride_height, linear.stride_width, linear.dilation_height_factor,
+      linear.dilation_width_factor, input_dims[1], input_dims[2],
+      filter_dims[1], filter_dims[2], linear.padding, &out_height, &out_width);
+  op->dims = {input_dims[0], out_height, out_width, channels};
+  if (linear.is_depthwise) {
+    TF_LITE_ENSURE(context, input_dims[3] > 0 && channels % input_dims[3] == 0);
+    linear.depth_multiplier = channels / input_dims[3];
+    return kTfLiteOk;
+  }
+
+  TF_LITE_ENSURE_EQ(context, input_dims[3], filter_dims[3]);
+  // As for the builtin kernel, the input patches are gathered unless the
+  // filter is 1x1 and applied to every pixel.
+  const bool need_im2col =
+      linear.stride_width != 1 || linear.stride_height != 1 ||
+      linear.dilation_width_factor != 1 ||
+      linear.dilation_height_factor != 1 || filter_dims[1] != 1 ||
+      filter_dims[2] != 1;
+  if (need_im2col) {
+    linear.im2col_dims = {input_dims[0], out_height, out_width,
+                          filter_dims[1] * filter_dims[2] * filter_dims[3]};
+    linear.im2col.resize(static_cast<int64_t>(input_dims[0]) * out_height *
+                         out_width * linear.im2col_dims[3]);
+  } else {
+    linear.im2col_dims.clear();
+    linear.im2col.clear();
+  }
+  return kTfLiteOk;
+}
+
+TfLiteStatus ElementwiseFusionKernel::Eval(TfLiteContext* context,
+                                           TfLiteNode* node) {
+  for (const Loop& loop : loops_) {
+    if (ops_[loop.ops[0]].linear >= 0) {
+      EvalLinearOp(context, loop.ops[0]);
+      continue;
+    }
+    for (int64_t start = 0; start < loop.size; start += kTileSize) {
+      const int size =
+          static_cast<int>(std::min<int64_t>(kTileSize, loop.size - start));
+      for (int op : loop.ops) EvalTile(context, op, start, size);
+    }
+  }
+  return kTfLiteOk;
+}
+
+void ElementwiseFusionKernel::EvalLinearOp(TfLiteContext* context,
+                                           int op_index) {
+  const FusedOp& op = ops_[op_index];
+  LinearOp& linear = linear_ops_[op.linear];
+  const Operand& operand = op.inputs[0];
+  const float* input = operand.value >= 0
+                           ? GetStoredData(context, operand.value)
+                           : context->tensors[operand.tensor].data.f;
+  float* output = GetStoredData(context, op_index);
+  const RuntimeShape input_shape = GetRuntimeShape(linear.input_dims);
+  const RuntimeShape filter_shape = GetRuntimeShape(linear.filter_dims);
+  const RuntimeShape bias_shape({static_cast<int>(linear.bias.size())});
+  const RuntimeShape output_shape = GetRuntimeShape(op.dims);
+  float activation_min, activation_max;
+  CalculateActivationRange(linear.activation, &activation_min,
+                           &activation_max);
+  CpuBackendContext* cpu_backend_context =
+      CpuBackendContext::GetFromContext(context);
+  switch (op.builtin_code) {
+    case kTfLiteBuiltinConv2d: {
+      ConvParams params;
+      params.padding_type = linear.padding == kTfLitePaddingSame
+                                ? PaddingType::kSame
+                                : PaddingType::kValid;
+      params.padding_values.width = linear.padding_values.width;
+      params.padding_values.height = linear.padding_values.height;
+      params.stride_width = linear.stride_width;
+      params.stride_height = linear.stride_height;
+      params.dilation_width_factor = linear.dilation_width_factor;
+      params.dilation_height_factor = linear.dilation_height_factor;
+      params.float_activation_min = activation_min;
+      params.float_activation_max = activation_max;
+      optimized_ops::Conv(
+          params, input_shape, input, filter_shape, linear.filter.data(),
+          bias_shape, linear.bias.data(), output_shape, output,
+          GetRuntimeShape(linear.im2col_dims),
+          linear.im2col.empty() ? nullptr : linear.im2col.data(),
+          cpu_backend_context);
+      break;
+    }
+    case kTfLiteBuiltinDepthwiseConv2d: {
+      DepthwiseParams params;
+      params.padding_type = PaddingType::kSame;
+      params.padding_values.width = linear.padding_values.width;
+      params.padding_values.height = linear.padding_values.height;
+      params.stride_width = linear.stride_width;
+      params.stride_height = linear.stride_height;
+      params.dilation_width_factor = linear.dilation_width_factor;
+      params.dilation_height_factor = linear.dilation_height_factor;
+      params.depth_multiplier = linear.depth_multiplier;
+      params.float_activation_min = activation_min;
+      params.float_activation_max = activation_max;
+      optimized_ops::DepthwiseConv<float, float>(
+          params, input_shape, input, filter_shape, linear.filter.data(),
+          bias_shape, linear.bias.data(), output_shape, output,
+          cpu_backend_context);
+      break;
+    }
+    case kTfLiteBuiltinFullyConnected: {
+      FullyConnectedParams params;
+      params.float_activation_min = activation_min;
+      params.float_activation_max = activation_max;
+      params.lhs_cacheable = true;
+      params.rhs_cacheable = false;
+      optimized_ops::FullyConnected(
+          params, input_shape, input, filter_shape, linear.filter.data(),
+          bias_shape, linear.bias.data(), output_shape, output,
+          cpu_backend_context);
+      break;
+    }
+  }
+}
+
+const float* ElementwiseFusionKernel::GetOperandTile(TfLiteContext* context,
+                                                     int op, int input,
+                                                     int64_t start, int size) {
+  const Operand& operand = ops_[op].inputs[input];
+  switch (operand.kind) {
+    case OperandKind::kValue: {
+      const FusedOp& value = ops_[operand.value];
+      if (!value.is_output && !value.is_stored) return Tile(operand.value);
+      return GetStoredData(context, operand.value) + start;
+    }
+    case OperandKind::kTensor:
+      return context->tensors[operand.tensor].data.f + start;
+    case OperandKind::kBroadcast: {
+      const float* data = context->tensors[operand.tensor].data.f;
+      float* tile = BroadcastTile(op, input);
+      if (operand.broadcast_size == 1) {
+        std::fill_n(tile, size, data[0]);
+        return tile;
+      }
+      int index = start % operand.broadcast_size;
+      for (int i = 0; i < size;) {
+        const int count = std::min(size - i, operand.broadcast_size - index);
+        std::copy_n(data + index, count, tile + i);
+        i += count;
+        index = 0;
+      }
+      return tile;
+    }
+  }
+  return nullptr;
+}
+
+void ElementwiseFusionKernel::EvalTile(TfLiteContext* context, int op_index,
+                                       int64_t start, int size) {
+  const FusedOp& op = ops_[op_index];
+  const float* x = GetOperandTile(context, op_index, 0, start, size);
+  const float* y = op.inputs.size() > 1
+                       ? GetOperandTile(context, op_index, 1, start, size)
+                       : nullptr;
+  float* out = op.is_output || op.is_stored
+                   ? GetStoredData(context, op_index) + start
+                   : Tile(op_index);
+  // The tile is computed by the same vectorized kernels as the builtin ops,
+  // or by Eigen for the ops that don't have an optimized float kernel.
+  const RuntimeShape shape({size});
+  const auto input = optimized_ops::MapAsVector(x, shape);
+  auto output = optimized_ops::MapAsVector(out, shape);
+  switch (op.builtin_code) {
+    case kTfLiteBuiltinAbs:
+      output = input.cwiseAbs();
+      break;
+    case kTfLiteBuiltinLogistic:
+      optimized_ops::Logistic(shape, x, shape, out);
+      break;
+    case kTfLiteBuiltinNeg:
+      output = -input;
+      break;
+    case kTfLiteBuiltinRelu:
+      optimized_ops::Relu(shape, x, shape, out);
+      break;
+    case kTfLiteBuiltinRelu6:
+      output = input.cwiseMax(0.0f).cwiseMin(6.0f);
+      break;
+    case kTfLiteBuiltinReluN1To1:
+      output = input.cwiseMax(-1.0f).cwiseMin(1.0f);
+      break;
+    case kTfLiteBuiltinSquare:
+      output = input.cwiseAbs2();
+      break;
+    case kTfLiteBuiltinTanh:
+      optimized_ops::Tanh(shape, x, shape, out);
+      break;
+    case kTfLiteBuiltinAdd:
+      optimized_ops::Add(op.params, shape, x, shape, y, shape, out);
+      break;
+    case kTfLiteBuiltinMaximum:
+      output = input.cwiseMax(optimized_ops::MapAsVector(y, shape));
+      break;
+    case kTfLiteBuiltinMinimum:
+      output = input.cwiseMin(optimized_ops::MapAsVector(y, shape));
+      break;
+    case kTfLiteBuiltinMul:
+      optimized_ops::Mul(op.params, shape, x, shape, y, shape, out);
+      break;
+    case kTfLiteBuiltinSub:
+      optimized_ops::SubNonBroadcast(op.params, shape, x, shape, y, shape,
+                                     out);
+      break;
+  }
+}
+
+}  // namespace
+
+TfLiteDelegateUniquePtr CreateElementwiseFusionDelegate(
+    const ElementwiseFusionDelegateOptions& options) {
+  return TfLiteDelegateUniquePtr(
+      TfLiteDelegateFactory::CreateSimpleDelegate(
+          std::make_unique<ElementwiseFusionDelegate>(options),
+          kTfLiteDelegateFlagsAllowDynamicTensors),
+      TfLiteDelegateFactory::DeleteSimpleDelegate);
+}
+
+}  // namespace elementwise_fusion
+}  // namespace tflite
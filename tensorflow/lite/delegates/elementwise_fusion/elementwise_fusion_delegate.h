@@ -0,0 +1,79 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_LITE_DELEGATES_ELEMENTWISE_FUSION_ELEMENTWISE_FUSION_DELEGATE_H_
+#define TENSORFLOW_LITE_DELEGATES_ELEMENTWISE_FUSION_ELEMENTWISE_FUSION_DELEGATE_H_
+
+#include <string>
+#include <vector>
+
+#include "tensorflow/lite/delegates/utils/simple_delegate.h"
+
+namespace tflite {
+namespace elementwise_fusion {
+
+// A chain of float elementwise ops replaced by a single fused kernel, which
+// computes all of them in one pass over memory.
+struct Fusion {
+  // Indices of the fused nodes in the original graph, in execution order.
+  std::vector<int> nodes;
+  // Names of the fused ops, e.g. "ADD".
+  std::vector<std::string> ops;
+  // Whether each node is folded into the weights and bias of the CONV_2D,
+  // DEPTHWISE_CONV_2D or FULLY_CONNECTED node before it.
+  std::vector<bool> folded;
+  // Index and op name of the node producing the input of the chain, whose
+  // output the chain is an epilogue of (e.g. a CONV_2D), or -1 and an empty
+  // name if the input of the chain isn't produced by a node.
+  int producer_node = -1;
+  std::string producer_op;
+};
+
+// The fusions applied by the delegate.
+struct FusionReport {
+  std::vector<Fusion> fusions;
+
+  // Returns one line per fusion, e.g.
+  // "[CONV_2D(#0) + ADD(#1) + MUL(#2), LOGISTIC(#3)]" where the nodes joined
+  // by "+" are folded into the first one, or "ADD(#0) -> [RELU(#1), TANH(#2)]"
+  // for a chain following a node that isn't fused.
+  std::string ToString() const;
+};
+
+struct ElementwiseFusionDelegateOptions {
+  // Minimum number of elementwise nodes replaced by a fused kernel.
+  int min_nodes_per_fusion = 2;
+  // If not null, the fusions applied to the graph are appended to it when the
+  // delegate is applied. Not owned.
+  FusionReport* report = nullptr;
+};
+
+// Creates a delegate merging the chains of float ADD, SUB, MUL, MAXIMUM,
+// MINIMUM, NEG, ABS, SQUARE, RELU, RELU6, RELU_N1_TO_1, TANH and LOGISTIC
+// nodes into a single loop over tiles of their operands, so that the
+// intermediate values stay in the cache and aren't written to memory. The
+// operands of each node are either of the same shape as its output, or
+// constants broadcast along the innermost dimension (e.g. a bias). A float
+// CONV_2D, DEPTHWISE_CONV_2D or FULLY_CONNECTED whose output is only read by
+// an ADD, SUB or MUL by such a constant is fused too: the constants are folded
+// into a copy of its weights and bias, so that they cost no pass over its
+// output, and the rest of the chain becomes a single epilogue pass.
+TfLiteDelegateUniquePtr CreateElementwiseFusionDelegate(
+    const ElementwiseFusionDelegateOptions& options =
+        ElementwiseFusionDelegateOptions());
+
+}  // namespace elementwise_fusion
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_DELEGATES_ELEMENTWISE_FUSION_ELEMENTWISE_FUSION_DELEGATE_H_
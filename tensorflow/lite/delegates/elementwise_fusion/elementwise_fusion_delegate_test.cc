@@ -0,0 +1,444 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/lite/delegates/elementwise_fusion/elementwise_fusion_delegate.h"
+
+#include <cmath>
+#include <initializer_list>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "benchmark/benchmark.h"  // from @com_google_benchmark
+#include "tensorflow/lite/kernels/test_util.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+
+namespace tflite {
+namespace elementwise_fusion {
+namespace {
+
+using ::testing::ElementsAreArray;
+
+// CONV_2D -> ADD(bias) -> MUL(scale) -> ADD(shift) -> LOGISTIC, where the
+// operands of the elementwise ops are constants broadcast along the channels,
+// and so folded into the weights and bias of the CONV_2D.
+class ConvEpilogueModel : public MultiOpModel {
+ public:
+  explicit ConvEpilogueModel(TfLiteDelegate* delegate) {
+    input_ = AddInput({TensorType_FLOAT32, {1, 4, 5, 2}});
+    const int filter =
+        AddConstInput(TensorType_FLOAT32,
+                      {1.0f, -1.0f, 0.5f, 0.25f, -2.0f, 1.5f}, {3, 1, 1, 2});
+    const int conv_bias =
+        AddConstInput(TensorType_FLOAT32, {0.0f, 0.0f, 0.0f}, {3});
+    const int bias =
+        AddConstInput(TensorType_FLOAT32, {0.5f, -1.0f, 2.0f}, {3});
+    const int scale = AddConstInput(TensorType_FLOAT32, {0.75f}, {1});
+    const int shift =
+        AddConstInput(TensorType_FLOAT32, {-0.25f, 0.125f, 1.0f}, {3});
+    const int conv = AddInnerTensor<float>({TensorType_FLOAT32, {}});
+    const int biased = AddInnerTensor<float>({TensorType_FLOAT32, {}});
+    const int scaled = AddInnerTensor<float>({TensorType_FLOAT32, {}});
+    const int shifted = AddInnerTensor<float>({TensorType_FLOAT32, {}});
+    output_ = AddOutput({TensorType_FLOAT32, {}});
+
+    AddBuiltinOp(BuiltinOperator_CONV_2D, BuiltinOptions_Conv2DOptions,
+                 CreateConv2DOptions(builder_, Padding_SAME, 1, 1).Union(),
+                 {input_, filter, conv_bias}, {conv});
+    AddBuiltinOp(BuiltinOperator_ADD, BuiltinOptions_AddOptions,
+                 CreateAddOptions(builder_).Union(), {conv, bias}, {biased});
+    AddBuiltinOp(BuiltinOperator_MUL, BuiltinOptions_MulOptions,
+                 CreateMulOptions(builder_).Union(), {scale, biased}, {scaled});
+    AddBuiltinOp(BuiltinOperator_ADD, BuiltinOptions_AddOptions,
+                 CreateAddOptions(builder_).Union(), {scaled, shift},
+                 {shifted});
+    AddBuiltinOp(BuiltinOperator_LOGISTIC, BuiltinOptions_NONE, 0, {shifted},
+                 {output_});
+
+    SetBypassDefaultDelegates();
+    SetDelegate(delegate);
+    BuildInterpreter({GetShape(input_), GetShape(filter), GetShape(conv_bias),
+                      GetShape(bias), GetShape(scale), GetShape(shift)});
+  }
+
+  void SetInput(const std::vector<float>& data) {
+    PopulateTensor(input_, data);
+  }
+  std::vector<float> GetOutput() { return ExtractVector<float>(output_); }
+  std::vector<int> GetOutputShape() { return GetTensorShape(output_); }
+
+ private:
+  int input_;
+  int output_;
+};
+
+// ADD(x, y) -> RELU -> MUL(x) with a RELU6 activation, and a TANH of the sum,
+// so that the sum is read by two fused nodes.
+class ElementwiseChainModel : public MultiOpModel {
+ public:
+  ElementwiseChainModel(TfLiteDelegate* delegate,
+                        std::initializer_list<int> y_shape) {
+    x_ = AddInput({TensorType_FLOAT32, {2, 300, 3}});
+    y_ = AddInput({TensorType_FLOAT32, y_shape});
+    const int sum = AddInnerTensor<float>({TensorType_FLOAT32, {}});
+    const int relu = AddInnerTensor<float>({TensorType_FLOAT32, {}});
+    sum_ = AddOutput({TensorType_FLOAT32, {}});
+    product_ = AddOutput({TensorType_FLOAT32, {}});
+
+    AddBuiltinOp(BuiltinOperator_ADD, BuiltinOptions_AddOptions,
+                 CreateAddOptions(builder_).Union(), {x_, y_}, {sum});
+    AddBuiltinOp(BuiltinOperator_RELU, BuiltinOptions_NONE, 0, {sum}, {relu});
+    AddBuiltinOp(
+        BuiltinOperator_MUL, BuiltinOptions_MulOptions,
+        CreateMulOptions(builder_, ActivationFunctionType_RELU6).Union(),
+        {relu, x_}, {product_});
+    AddBuiltinOp(BuiltinOperator_TANH, BuiltinOptions_NONE, 0, {sum}, {sum_});
+
+    SetBypassDefaultDelegates();
+    SetDelegate(delegate);
+    BuildInterpreter({GetShape(x_), GetShape(y_)});
+  }
+
+  int x() const { return x_; }
+  int y() const { return y_; }
+  std::vector<float> GetSum() { return ExtractVector<float>(sum_); }
+  std::vector<float> GetProduct() { return ExtractVector<float>(product_); }
+
+ private:
+  int x_;
+  int y_;
+  int sum_;
+  int product_;
+};
+
+// ADD(x, constant) -> RELU, where the constant of shape `constant_shape` holds
+// one value per channel of `x`.
+class ConstantAddModel : public MultiOpModel {
+ public:
+  ConstantAddModel(TfLiteDelegate* delegate,
+                   std::initializer_list<int> constant_shape) {
+    x_ = AddInput({TensorType_FLOAT32, {300, 3}});
+    const int constant = AddConstInput(TensorType_FLOAT32,
+                                       {1.0f, -2.0f, 0.5f}, constant_shape);
+    const int sum = AddInnerTensor<float>({TensorType_FLOAT32, {}});
+    output_ = AddOutput({TensorType_FLOAT32, {}});
+
+    AddBuiltinOp(BuiltinOperator_ADD, BuiltinOptions_AddOptions,
+                 CreateAddOptions(builder_).Union(), {x_, constant}, {sum});
+    AddBuiltinOp(BuiltinOperator_RELU, BuiltinOptions_NONE, 0, {sum},
+                 {output_});
+
+    SetBypassDefaultDelegates();
+    SetDelegate(delegate);
+    BuildInterpreter({GetShape(x_), GetShape(constant)});
+  }
+
+  int x() const { return x_; }
+  std::vector<float> GetOutput() { return ExtractVector<float>(output_); }
+  std::vector<int> GetOutputShape() { return GetTensorShape(output_); }
+
+ private:
+  int x_;
+  int output_;
+};
+
+std::vector<float> MakeData(int size, float frequency,
+                            float amplitude = 3.0f) {
+  std::vector<float> data(size);
+  for (int i = 0; i < size; ++i) {
+    data[i] = amplitude * std::sin(frequency * i);
+  }
+  return data;
+}
+
+TEST(ElementwiseFusionDelegateTest, FusesConvEpilogue) {
+  FusionReport report;
+  ElementwiseFusionDelegateOptions options;
+  options.report = &report;
+  auto delegate = CreateElementwiseFusionDelegate(options);
+  ConvEpilogueModel fused(delegate.get());
+  ConvEpilogueModel unfused(nullptr);
+  EXPECT_EQ(fused.CountNumberOfDelegatedPartitions(), 1);
+
+  const std::vector<float> input = MakeData(40, 0.7f);
+  fused.SetInput(input);
+  unfused.SetInput(input);
+  ASSERT_EQ(fused.Invoke(), kTfLiteOk);
+  ASSERT_EQ(unfused.Invoke(), kTfLiteOk);
+  EXPECT_THAT(fused.GetOutputShape(), ElementsAreArray({1, 4, 5, 3}));
+  EXPECT_THAT(fused.GetOutput(),
+              ElementsAreArray(ArrayFloatNear(unfused.GetOutput())));
+
+  ASSERT_EQ(report.fusions.size(), 1);
+  EXPECT_THAT(report.fusions[0].nodes, ElementsAreArray({0, 1, 2, 3, 4}));
+  EXPECT_EQ(report.ToString(),
+            "[CONV_2D(#0) + ADD(#1) + MUL(#2) + ADD(#3), LOGISTIC(#4)]\n");
+}
+
+// MUL(x, x) -> CONV_2D -> ADD(bias) with a RELU6 activation ->
+// DEPTHWISE_CONV_2D -> MUL(scale) -> FULLY_CONNECTED -> SUB(1) -> LOGISTIC.
+class LinearChainModel : public MultiOpModel {
+ public:
+  explicit LinearChainModel(TfLiteDelegate* delegate) {
+    input_ = AddInput({TensorType_FLOAT32, {1, 6, 5, 2}});
+    const int conv_filter = AddConstInput(
+        TensorType_FLOAT32, MakeData(32, 0.9f, 0.1f), {4, 2, 2, 2});
+    const int conv_bias =
+        AddConstInput(TensorType_FLOAT32, {0.1f, -0.2f, 0.3f, 0.0f}, {4});
+    const int bias =
+        AddConstInput(TensorType_FLOAT32, {0.5f, -1.0f, 2.0f, 0.25f}, {4});
+    const int depthwise_filter = AddConstInput(
+        TensorType_FLOAT32, MakeData(72, 0.5f, 0.1f), {1, 3, 3, 8});
+    const int depthwise_bias =
+        AddConstInput(TensorType_FLOAT32, std::vector<float>(8), {8});
+    const int scale =
+        AddConstInput(TensorType_FLOAT32, MakeData(8, 1.3f, 0.1f), {8});
+    const int fc_filter = AddConstInput(TensorType_FLOAT32,
+                                        MakeData(24, 0.7f, 0.1f), {3, 8});
+    const int fc_bias =
+        AddConstInput(TensorType_FLOAT32, {1.0f, 0.0f, -1.0f}, {3});
+    const int one = AddConstInput(TensorType_FLOAT32, {1.0f}, {1});
+    const int square = AddInnerTensor<float>({TensorType_FLOAT32, {}});
+    const int conv = AddInnerTensor<float>({TensorType_FLOAT32, {}});
+    const int biased = AddInnerTensor<float>({TensorType_FLOAT32, {}});
+    const int depthwise = AddInnerTensor<float>({TensorType_FLOAT32, {}});
+    const int scaled = AddInnerTensor<float>({TensorType_FLOAT32, {}});
+    const int fc = AddInnerTensor<float>({TensorType_FLOAT32, {}});
+    const int shifted = AddInnerTensor<float>({TensorType_FLOAT32, {}});
+    output_ = AddOutput({TensorType_FLOAT32, {}});
+
+    AddBuiltinOp(BuiltinOperator_MUL, BuiltinOptions_MulOptions,
+                 CreateMulOptions(builder_).Union(), {input_, input_},
+                 {square});
+    AddBuiltinOp(BuiltinOperator_CONV_2D, BuiltinOptions_Conv2DOptions,
+                 CreateConv2DOptions(builder_, Padding_SAME, 2, 2).Union(),
+                 {square, conv_filter, conv_bias}, {conv});
+    AddBuiltinOp(
+        BuiltinOperator_ADD, BuiltinOptions_AddOptions,
+        CreateAddOptions(builder_, ActivationFunctionType_RELU6).Union(),
+        {conv, bias}, {biased});
+    AddBuiltinOp(
+        BuiltinOperator_DEPTHWISE_CONV_2D,
+        BuiltinOptions_DepthwiseConv2DOptions,
+        CreateDepthwiseConv2DOptions(builder_, Padding_SAME, 1, 1, 2).Union(),
+        {biased, depthwise_filter, depthwise_bias}, {depthwise});
+    AddBuiltinOp(BuiltinOperator_MUL, BuiltinOptions_MulOptions,
+                 CreateMulOptions(builder_).Union(), {scale, depthwise},
+                 {scaled});
+    AddBuiltinOp(BuiltinOperator_FULLY_CONNECTED,
+                 BuiltinOptions_FullyConnectedOptions,
+                 CreateFullyConnectedOptions(
+                     builder_, ActivationFunctionType_NONE,
+                     FullyConnectedOptionsWeightsFormat_DEFAULT,
+                     /*keep_num_dims=*/true)
+                     .Union(),
+                 {scaled, fc_filter, fc_bias}, {fc});
+    AddBuiltinOp(BuiltinOperator_SUB, BuiltinOptions_SubOptions,
+                 CreateSubOptions(builder_).Union(), {fc, one}, {shifted});
+    AddBuiltinOp(BuiltinOperator_LOGISTIC, BuiltinOptions_NONE, 0, {shifted},
+                 {output_});
+
+    SetBypassDefaultDelegates();
+    SetDelegate(delegate);
+    BuildInterpreter({GetShape(input_), GetShape(conv_filter),
+                      GetShape(conv_bias), GetShape(bias),
+                      GetShape(depthwise_filter), GetShape(depthwise_bias),
+                      GetShape(scale), GetShape(fc_filter), GetShape(fc_bias),
+                      GetShape(one)});
+  }
+
+  void SetInput(const std::vector<float>& data) {
+    PopulateTensor(input_, data);
+  }
+  std::vector<float> GetOutput() { return ExtractVector<float>(output_); }
+  std::vector<int> GetOutputShape() { return GetTensorShape(output_); }
+
+ private:
+  int input_;
+  int output_;
+};
+
+TEST(ElementwiseFusionDelegateTest, FoldsIntoEachLinearNode) {
+  FusionReport report;
+  ElementwiseFusionDelegateOptions options;
+  options.report = &report;
+  auto delegate = CreateElementwiseFusionDelegate(options);
+  LinearChainModel fused(delegate.get());
+  LinearChainModel unfused(nullptr);
+  EXPECT_EQ(fused.CountNumberOfDelegatedPartitions(), 1);
+
+  const std::vector<float> input = MakeData(60, 0.37f, 0.3f);
+  fused.SetInput(input);
+  unfused.SetInput(input);
+  ASSERT_EQ(fused.Invoke(), kTfLiteOk);
+  ASSERT_EQ(unfused.Invoke(), kTfLiteOk);
+  EXPECT_THAT(fused.GetOutputShape(), ElementsAreArray({1, 3, 3, 3}));
+  EXPECT_THAT(fused.GetOutput(),
+              ElementsAreArray(ArrayFloatNear(unfused.GetOutput())));
+  EXPECT_EQ(report.ToString(),
+            "[MUL(#0), CONV_2D(#1) + ADD(#2), DEPTHWISE_CONV_2D(#3) + MUL(#4), "
+            "FULLY_CONNECTED(#5) + SUB(#6), LOGISTIC(#7)]\n");
+}
+
+TEST(ElementwiseFusionDelegateTest, FusesChainWithSeveralOutputs) {
+  FusionReport report;
+  ElementwiseFusionDelegateOptions options;
+  options.report = &report;
+  auto delegate = CreateElementwiseFusionDelegate(options);
+  ElementwiseChainModel fused(delegate.get(), {2, 300, 3});
+  ElementwiseChainModel unfused(nullptr, {2, 300, 3});
+  EXPECT_EQ(fused.CountNumberOfDelegatedPartitions(), 1);
+
+  for (ElementwiseChainModel* model : {&fused, &unfused}) {
+    model->PopulateTensor(model->x(), MakeData(1800, 0.3f));
+    model->PopulateTensor(model->y(), MakeData(1800, 0.11f));
+    ASSERT_EQ(model->Invoke(), kTfLiteOk);
+  }
+  EXPECT_THAT(fused.GetSum(),
+              ElementsAreArray(ArrayFloatNear(unfused.GetSum())));
+  EXPECT_THAT(fused.GetProduct(),
+              ElementsAreArray(ArrayFloatNear(unfused.GetProduct())));
+  EXPECT_EQ(report.ToString(), "[ADD(#0), RELU(#1), MUL(#2), TANH(#3)]\n");
+}
+
+TEST(ElementwiseFusionDelegateTest, DoesNotFuseBroadcastInputs) {
+  FusionReport report;
+  ElementwiseFusionDelegateOptions options;
+  options.report = &report;
+  auto delegate = CreateElementwiseFusionDelegate(options);
+  // `y` isn't constant, so the ADD broadcasting it along the channels isn't
+  // fused, and the nodes reading the sum are fused as its epilogue.
+  ElementwiseChainModel fused(delegate.get(), {3});
+  ElementwiseChainModel unfused(nullptr, {3});
+
+  for (ElementwiseChainModel* model : {&fused, &unfused}) {
+    model->PopulateTensor(model->x(), MakeData(1800, 0.3f));
+    model->PopulateTensor(model->y(), {1.0f, -2.0f, 0.5f});
+    ASSERT_EQ(model->Invoke(), kTfLiteOk);
+  }
+  EXPECT_THAT(fused.GetSum(),
+              ElementsAreArray(ArrayFloatNear(unfused.GetSum())));
+  EXPECT_THAT(fused.GetProduct(),
+              ElementsAreArray(ArrayFloatNear(unfused.GetProduct())));
+  EXPECT_EQ(report.ToString(), "ADD(#0) -> [RELU(#1), MUL(#2), TANH(#3)]\n");
+}
+
+TEST(ElementwiseFusionDelegateTest, FusesConstantsOfLowerRank) {
+  auto delegate = CreateElementwiseFusionDelegate();
+  ConstantAddModel fused(delegate.get(), {1, 3});
+  ConstantAddModel unfused(nullptr, {1, 3});
+  EXPECT_EQ(fused.CountNumberOfDelegatedPartitions(), 1);
+
+  for (ConstantAddModel* model : {&fused, &unfused}) {
+    model->PopulateTensor(model->x(), MakeData(900, 0.3f));
+    ASSERT_EQ(model->Invoke(), kTfLiteOk);
+  }
+  EXPECT_THAT(fused.GetOutputShape(), ElementsAreArray({300, 3}));
+  EXPECT_THAT(fused.GetOutput(),
+              ElementsAreArray(ArrayFloatNear(unfused.GetOutput())));
+}
+
+TEST(ElementwiseFusionDelegateTest, DoesNotFuseConstantsOfHigherRank) {
+  auto delegate = CreateElementwiseFusionDelegate();
+  // The output of the ADD has the rank of the constant, which the fused kernel
+  // doesn't support, so only the RELU could be fused, on its own.
+  ConstantAddModel fused(delegate.get(), {1, 1, 3});
+  ConstantAddModel unfused(nullptr, {1, 1, 3});
+  EXPECT_EQ(fused.CountNumberOfDelegatedPartitions(), 0);
+
+  for (ConstantAddModel* model : {&fused, &unfused}) {
+    model->PopulateTensor(model->x(), MakeData(900, 0.3f));
+    ASSERT_EQ(model->Invoke(), kTfLiteOk);
+  }
+  EXPECT_THAT(fused.GetOutputShape(), ElementsAreArray({1, 300, 3}));
+  EXPECT_THAT(fused.GetOutput(),
+              ElementsAreArray(ArrayFloatNear(unfused.GetOutput())));
+}
+
+// Benchmarks of the fused kernel against the builtin kernels of the unfused
+// graph, on the epilogue of a ResNet-style block: a 1x1 CONV_2D of 56x56x128 ->
+// 56x56x128, followed by ADD(bias) -> MUL(scale) and a SiLU, i.e. MUL(x,
+// LOGISTIC(x)). Run with --benchmark_filter=all. The first argument is whether
+// the delegate is applied, the second whether the CONV_2D is run, so that the
+// epilogue can be timed alone. With the CONV_2D, the ADD and MUL are folded
+// into its weights and bias.
+class EpilogueBenchmarkModel : public MultiOpModel {
+ public:
+  EpilogueBenchmarkModel(TfLiteDelegate* delegate, bool with_conv) {
+    constexpr int kChannels = 128;
+    input_ = AddInput({TensorType_FLOAT32, {1, 56, 56, kChannels}});
+    std::vector<std::vector<int>> input_shapes = {GetShape(input_)};
+    int epilogue_input = input_;
+    if (with_conv) {
+      const int filter = AddConstInput(
+          TensorType_FLOAT32, MakeData(kChannels * kChannels, 0.1f),
+          {kChannels, 1, 1, kChannels});
+      const int conv_bias = AddConstInput(
+          TensorType_FLOAT32, std::vector<float>(kChannels), {kChannels});
+      epilogue_input = AddInnerTensor<float>({TensorType_FLOAT32, {}});
+      AddBuiltinOp(BuiltinOperator_CONV_2D, BuiltinOptions_Conv2DOptions,
+                   CreateConv2DOptions(builder_, Padding_SAME, 1, 1).Union(),
+                   {input_, filter, conv_bias}, {epilogue_input});
+      input_shapes.push_back(GetShape(filter));
+      input_shapes.push_back(GetShape(conv_bias));
+    }
+    const int bias = AddConstInput(TensorType_FLOAT32,
+                                   MakeData(kChannels, 0.3f), {kChannels});
+    const int scale = AddConstInput(TensorType_FLOAT32,
+                                    MakeData(kChannels, 0.7f), {kChannels});
+    const int biased = AddInnerTensor<float>({TensorType_FLOAT32, {}});
+    const int scaled = AddInnerTensor<float>({TensorType_FLOAT32, {}});
+    const int gate = AddInnerTensor<float>({TensorType_FLOAT32, {}});
+    const int output = AddOutput({TensorType_FLOAT32, {}});
+    AddBuiltinOp(BuiltinOperator_ADD, BuiltinOptions_AddOptions,
+                 CreateAddOptions(builder_).Union(), {epilogue_input, bias},
+                 {biased});
+    AddBuiltinOp(BuiltinOperator_MUL, BuiltinOptions_MulOptions,
+                 CreateMulOptions(builder_).Union(), {biased, scale},
+                 {scaled});
+    AddBuiltinOp(BuiltinOperator_LOGISTIC, BuiltinOptions_NONE, 0, {scaled},
+                 {gate});
+    AddBuiltinOp(BuiltinOperator_MUL, BuiltinOptions_MulOptions,
+                 CreateMulOptions(builder_).Union(), {scaled, gate}, {output});
+    input_shapes.push_back(GetShape(bias));
+    input_shapes.push_back(GetShape(scale));
+
+    SetBypassDefaultDelegates();
+    SetDelegate(delegate);
+    BuildInterpreter(input_shapes, /*num_threads=*/1,
+                     /*allow_fp32_relax_to_fp16=*/false,
+                     /*apply_delegate=*/true);
+    PopulateTensor(input_, MakeData(56 * 56 * kChannels, 0.01f));
+  }
+
+ private:
+  int input_;
+};
+
+void BM_Epilogue(benchmark::State& state) {
+  auto delegate = CreateElementwiseFusionDelegate();
+  EpilogueBenchmarkModel model(state.range(0) ? delegate.get() : nullptr,
+                               state.range(1));
+  for (auto _ : state) {
+    if (model.Invoke() != kTfLiteOk) {
+      state.SkipWithError("Invoke failed");
+      break;
+    }
+  }
+}
+BENCHMARK(BM_Epilogue)->Args({0, 0})->Args({1, 0})->Args({0, 1})->Args({1, 1});
+
+}  // namespace
+}  // namespace elementwise_fusion
+}  // namespace tflite
@@ -0,0 +1,93 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/lite/inter_op_thread_pool.h"
+
+#include <algorithm>
+#include <functional>
+#include <mutex>  // NOLINT(build/c++11)
+#include <thread>  // NOLINT(build/c++11)
+
+namespace tflite {
+
+InterOpThreadPool::InterOpThreadPool(int num_threads) {
+  for (int thread = 1; thread < num_threads; ++thread) {
+    workers_.emplace_back([this, thread] { WorkerLoop(thread); });
+  }
+}
+
+InterOpThreadPool::~InterOpThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  work_cv_.notify_all();
+  for (std::thread& worker : workers_) worker.join();
+}
+
+void InterOpThreadPool::ParallelFor(
+    int num_tasks, const std::function<void(int task, int thread)>& task) {
+  std::unique_lock<std::mutex> run_lock(run_mutex_, std::try_to_lock);
+  if (num_tasks <= 1 || workers_.empty() || !run_lock.owns_lock()) {
+    for (int i = 0; i < num_tasks; ++i) task(i, 0);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    num_tasks_ = num_tasks;
+    task_ = &task;
+    next_task_.store(0, std::memory_order_relaxed);
+    num_participants_ =
+        std::min(num_tasks, static_cast<int>(workers_.size()) + 1) - 1;
+    num_running_ = num_participants_;
+    ++generation_;
+  }
+  work_cv_.notify_all();
+
+  RunTasks(/*thread=*/0);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_cv_.wait(lock, [this] { return num_running_ == 0; });
+  task_ = nullptr;
+}
+
+void InterOpThreadPool::WorkerLoop(int thread) {
+  uint64_t seen_generation = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      work_cv_.wait(lock, [&] {
+        return stopping_ || (generation_ != seen_generation &&
+                             thread <= num_participants_);
+      });
+      if (stopping_) return;
+      seen_generation = generation_;
+    }
+    RunTasks(thread);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--num_running_ == 0) done_cv_.notify_one();
+    }
+  }
+}
+
+void InterOpThreadPool::RunTasks(int thread) {
+  for (int i = next_task_.fetch_add(1); i < num_tasks_;
+       i = next_task_.fetch_add(1)) {
+    (*task_)(i, thread);
+  }
+}
+
+}  // namespace tflite
@@ -0,0 +1,79 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_LITE_INTER_OP_THREAD_POOL_H_
+#define TENSORFLOW_LITE_INTER_OP_THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>  // NOLINT(build/c++11)
+#include <cstdint>
+#include <functional>
+#include <mutex>  // NOLINT(build/c++11)
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+namespace tflite {
+
+// A pool of threads running independent nodes of a graph concurrently. The
+// calling thread takes part in the work, so a pool of `num_threads` threads
+// only starts `num_threads - 1` worker threads.
+//
+// The pool runs one ParallelFor() at a time: a ParallelFor() called while
+// another one is running (e.g. by a node of a subgraph invoked by another
+// node) runs its tasks sequentially on the calling thread.
+class InterOpThreadPool {
+ public:
+  explicit InterOpThreadPool(int num_threads);
+  ~InterOpThreadPool();
+
+  InterOpThreadPool(const InterOpThreadPool&) = delete;
+  InterOpThreadPool& operator=(const InterOpThreadPool&) = delete;
+
+  int num_threads() const { return static_cast<int>(workers_.size()) + 1; }
+
+  // Calls `task(i, thread)` for each `i` in [0, num_tasks), and returns once
+  // all the calls have returned. `thread` identifies the thread running the
+  // task, is smaller than min(num_tasks, num_threads()), and is 0 for the
+  // calling thread.
+  void ParallelFor(int num_tasks,
+                   const std::function<void(int task, int thread)>& task);
+
+ private:
+  void WorkerLoop(int thread);
+  // Runs tasks of the current ParallelFor() until there are none left.
+  void RunTasks(int thread);
+
+  std::vector<std::thread> workers_;
+  // Held for the duration of a ParallelFor() using the workers.
+  std::mutex run_mutex_;
+
+  std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+  // Incremented by each ParallelFor() to wake the workers up.
+  uint64_t generation_ = 0;
+  // Workers taking part in the current ParallelFor().
+  int num_participants_ = 0;
+  // Participating workers which haven't finished yet.
+  int num_running_ = 0;
+  bool stopping_ = false;
+
+  int num_tasks_ = 0;
+  const std::function<void(int, int)>* task_ = nullptr;
+  std::atomic<int> next_task_{0};
+};
+
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_INTER_OP_THREAD_POOL_H_
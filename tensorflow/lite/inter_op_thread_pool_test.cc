@@ -0,0 +1,81 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/lite/inter_op_thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace tflite {
+namespace {
+
+TEST(InterOpThreadPoolTest, RunsEachTaskOnce) {
+  InterOpThreadPool pool(4);
+  EXPECT_EQ(pool.num_threads(), 4);
+  for (int num_tasks : {0, 1, 3, 4, 17}) {
+    std::vector<std::atomic<int>> counts(num_tasks);
+    std::atomic<int> max_thread{0};
+    pool.ParallelFor(num_tasks, [&](int task, int thread) {
+      counts[task].fetch_add(1);
+      int current = max_thread.load();
+      while (thread > current &&
+             !max_thread.compare_exchange_weak(current, thread)) {
+      }
+    });
+    for (int i = 0; i < num_tasks; ++i) EXPECT_EQ(counts[i].load(), 1);
+    EXPECT_LT(max_thread.load(), std::max(1, std::min(num_tasks, 4)));
+  }
+}
+
+TEST(InterOpThreadPoolTest, RunsTasksConcurrently) {
+  InterOpThreadPool pool(2);
+  // Each task waits for the other one, so they only both finish if they run
+  // on different threads.
+  std::atomic<int> arrived{0};
+  pool.ParallelFor(2, [&](int task, int thread) {
+    arrived.fetch_add(1);
+    while (arrived.load() < 2) {
+    }
+  });
+  EXPECT_EQ(arrived.load(), 2);
+}
+
+TEST(InterOpThreadPoolTest, NestedCallsRunOnCallingThread) {
+  InterOpThreadPool pool(3);
+  std::atomic<int> total{0};
+  pool.ParallelFor(3, [&](int task, int thread) {
+    pool.ParallelFor(5, [&](int nested_task, int nested_thread) {
+      EXPECT_EQ(nested_thread, 0);
+      total.fetch_add(1);
+    });
+  });
+  EXPECT_EQ(total.load(), 15);
+}
+
+TEST(InterOpThreadPoolTest, SingleThread) {
+  InterOpThreadPool pool(1);
+  EXPECT_EQ(pool.num_threads(), 1);
+  int total = 0;
+  pool.ParallelFor(8, [&](int task, int thread) {
+    EXPECT_EQ(thread, 0);
+    total += task;
+  });
+  EXPECT_EQ(total, 28);
+}
+
+}  // namespace
+}  // namespace tflite
@@ -29,7 +29,10 @@ class InterpreterOptions {
       : experimental_preserve_all_tensors_(false),
         experimental_ensure_dynamic_tensors_are_released_(false),
         experimental_optimize_memory_for_large_tensors_(0),
-        experimental_disable_delegate_clustering_(false) {}
+        experimental_disable_delegate_clustering_(false),
+        experimental_disable_arena_optimizations_(false),
+        experimental_disable_incremental_prepare_(false),
+        experimental_inter_op_parallelism_(1) {}
 
   /// Preserving all intermediates tensors for debugging.
   /// WARNING: This is an experimental API and subject to change.
@@ -93,11 +96,60 @@ class InterpreterOptions {
     experimental_disable_delegate_clustering_ = value;
   }
 
+  // Returns true iff the arena optimizations (i.e., computing elementwise ops
+  // in place of their inputs, and searching for the tensor allocation order
+  // which needs the smallest arena) are disabled.
+  // WARNING: This is an experimental API and subject to change.
+  bool GetDisableArenaOptimizations() {
+    return experimental_disable_arena_optimizations_;
+  }
+
+  // If value == true, disable the arena optimizations (see above), otherwise,
+  // enable them. This must be set before `AllocateTensors` is called.
+  // WARNING: This is an experimental API and subject to change.
+  void SetDisableArenaOptimizations(bool value = true) {
+    experimental_disable_arena_optimizations_ = value;
+  }
+
+  // Returns true iff the incremental preparation of the graph (i.e., skipping
+  // the ops whose inputs still have the shapes they were prepared for when the
+  // tensors are reallocated after resizing the inputs) is disabled.
+  // WARNING: This is an experimental API and subject to change.
+  bool GetDisableIncrementalPrepare() {
+    return experimental_disable_incremental_prepare_;
+  }
+
+  // If value == true, prepare all the ops whenever the tensors are
+  // reallocated, otherwise, only prepare the ops whose inputs were resized.
+  // WARNING: This is an experimental API and subject to change.
+  void SetDisableIncrementalPrepare(bool value = true) {
+    experimental_disable_incremental_prepare_ = value;
+  }
+
+  // Returns the maximum number of independent ops run concurrently.
+  // WARNING: This is an experimental API and subject to change.
+  int GetInterOpParallelism() { return experimental_inter_op_parallelism_; }
+
+  // If value > 1, run up to `value` ops concurrently when they don't depend
+  // on each other (e.g. the branches of a multi-tower model), splitting the
+  // threads set with `SetNumThreads` between them. Graphs with delegates or
+  // dynamic tensors, and profiled invocations, still run their ops one at a
+  // time. Running ops concurrently keeps more tensors alive at once, so it
+  // may increase the size of the arena. This must be set before
+  // `AllocateTensors` is called.
+  // WARNING: This is an experimental API and subject to change.
+  void SetInterOpParallelism(int value) {
+    experimental_inter_op_parallelism_ = value;
+  }
+
  private:
   bool experimental_preserve_all_tensors_;
   bool experimental_ensure_dynamic_tensors_are_released_;
   int experimental_optimize_memory_for_large_tensors_;
   bool experimental_disable_delegate_clustering_;
+  bool experimental_disable_arena_optimizations_;
+  bool experimental_disable_incremental_prepare_;
+  int experimental_inter_op_parallelism_;
 };
 
 }  // namespace tflite
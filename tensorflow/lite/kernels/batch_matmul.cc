@@ -20,6 +20,7 @@ limitations under the License.
 #include <algorithm>
 #include <cstdint>
 #include <limits>
+#include <vector>
 
 #include "tensorflow/lite/core/c/builtin_op_data.h"
 #include "tensorflow/lite/core/c/common.h"
@@ -27,6 +28,9 @@ limitations under the License.
 #include "tensorflow/lite/kernels/internal/compatibility.h"
 #include "tensorflow/lite/kernels/internal/optimized/batch_matmul.h"
 #include "tensorflow/lite/kernels/internal/optimized/optimized_ops.h"
+#include "tensorflow/lite/kernels/internal/optimized/packed_int4_fully_connected.h"
+#include "tensorflow/lite/kernels/internal/optimized/sparse_ops/batch_matmul.h"
+#include "tensorflow/lite/kernels/internal/optimized/sparse_ops/block_sparse_matrix.h"
 #include "tensorflow/lite/kernels/internal/reference/reference_ops.h"
 #include "tensorflow/lite/kernels/internal/tensor.h"
 #include "tensorflow/lite/kernels/internal/tensor_ctypes.h"
@@ -65,6 +69,21 @@ struct OpData {
   int scratch_tensor_index;
   bool rhs_transposed;
   bool compute_row_sums = false;
+  // If the RHS is a sparse tensor, the [num_units, accum_depth] RHS matrix
+  // (i.e. the RHS transposed) in block sparse format, used instead of the RHS
+  // tensor by all kernel types.
+  bool is_sparse = false;
+  optimized_ops::BlockSparseMatrix<float> sparse_rhs_float;
+  optimized_ops::BlockSparseMatrix<int8_t> sparse_rhs_int8;
+  // If the RHS is int4, it's constant weights without batch dimensions
+  // multiplied with a float LHS, and dequantized on the fly. The RHS tensor is
+  // used directly if it's already transposed (adj_y), or else transposed once
+  // to `packed_int4_rhs`. `int4_scales` holds the scales of the blocks of
+  // `int4_block_size` values of each unit.
+  bool is_packed_int4 = false;
+  std::vector<int8_t> packed_int4_rhs;
+  std::vector<float> int4_scales;
+  int int4_block_size;
 };
 
 struct OpContext {
@@ -190,6 +209,11 @@ TfLiteStatus InitializeTemporaries(TfLiteContext* context, TfLiteNode* node,
     // Swap last two dimensions.
     scratch_buffer_size->data[rhs_rank - 2] = rhs->dims->data[rhs_rank - 1];
     scratch_buffer_size->data[rhs_rank - 1] = rhs->dims->data[rhs_rank - 2];
+    // A sparse or int4 RHS is never transposed in this buffer, as it's already
+    // in the layout of a transposed RHS.
+    if (op_data->is_sparse || op_data->is_packed_int4) {
+      scratch_buffer_size->data[rhs_rank - 1] = 0;
+    }
 
     if (IsConstantTensor(op_context->rhs)) {
       scratch_buffer->allocation_type = kTfLiteArenaRwPersistent;
@@ -291,13 +315,79 @@ TfLiteStatus InitializeTemporaries(TfLiteContext* context, TfLiteNode* node,
   return kTfLiteOk;
 }
 
+// Populates `matrix` with the [num_units, accum_depth] matrix of the sparse
+// `rhs`, whose batch dimensions are all 1.
+template <typename T>
+TfLiteStatus PopulateSparseRhs(TfLiteContext* context, const TfLiteTensor* rhs,
+                               bool adj_y,
+                               optimized_ops::BlockSparseMatrix<T>* matrix) {
+  // The RHS is constant, so it's only compressed on the first Prepare.
+  if (matrix->IsPopulated()) return kTfLiteOk;
+  const RuntimeShape rhs_shape = GetTensorShape(rhs);
+  const int rank = rhs_shape.DimensionsCount();
+  const int units_dim = adj_y ? rank - 2 : rank - 1;
+  const int depth_dim = adj_y ? rank - 1 : rank - 2;
+  const int num_units = rhs_shape.Dims(units_dim);
+  const int accum_depth = rhs_shape.Dims(depth_dim);
+  optimized_ops::PopulateBlockSparseMatrix(
+      *rhs->sparsity, rhs_shape, GetTensorData<T>(rhs), num_units, accum_depth,
+      /*row_stride=*/adj_y ? accum_depth : 1,
+      /*col_stride=*/adj_y ? 1 : num_units,
+      optimized_ops::GetSparsityBlockSize(*rhs->sparsity, rank, units_dim),
+      optimized_ops::GetSparsityBlockSize(*rhs->sparsity, rank, depth_dim),
+      matrix);
+  return kTfLiteOk;
+}
+
+// Populates the int4 fields of `op_data` from the int4 `rhs`, whose batch
+// dimensions are all 1.
+TfLiteStatus PopulatePackedInt4Rhs(TfLiteContext* context,
+                                   const TfLiteTensor* rhs, bool adj_y,
+                                   OpData* op_data) {
+  const int rank = NumDimensions(rhs);
+  const int units_dim = adj_y ? rank - 2 : rank - 1;
+  const int num_units = SizeOfDimension(rhs, units_dim);
+  const int accum_depth = SizeOfDimension(rhs, adj_y ? rank - 1 : rank - 2);
+  TF_LITE_ENSURE_STATUS(GetInt4WeightsBlockSize(context, rhs, units_dim,
+                                                num_units, accum_depth,
+                                                &op_data->int4_block_size));
+  // The packed values of each block must start on a byte boundary.
+  TF_LITE_ENSURE_EQ(context, op_data->int4_block_size % 2, 0);
+  const TfLiteFloatArray* rhs_scales =
+      reinterpret_cast<TfLiteAffineQuantization*>(rhs->quantization.params)
+          ->scale;
+  op_data->int4_scales.assign(rhs_scales->data,
+                              rhs_scales->data + rhs_scales->size);
+  if (rhs_scales->size == 1) {
+    op_data->int4_scales.resize(num_units, rhs_scales->data[0]);
+  }
+
+  // The RHS is constant, so it's only transposed on the first Prepare.
+  if (adj_y || !op_data->packed_int4_rhs.empty()) return kTfLiteOk;
+  const int num_values = num_units * accum_depth;
+  std::vector<int8_t> values(num_values);
+  tensor_utils::UnpackDenseInt4IntoInt8(GetTensorData<int8_t>(rhs), num_values,
+                                        values.data());
+  op_data->packed_int4_rhs.assign(num_values / 2, 0);
+  for (int unit = 0; unit < num_units; ++unit) {
+    for (int depth = 0; depth < accum_depth; ++depth) {
+      const int index = unit * accum_depth + depth;
+      const uint8_t value = values[depth * num_units + unit] & 0x0F;
+      op_data->packed_int4_rhs[index / 2] |= index % 2 ? value << 4 : value;
+    }
+  }
+  return kTfLiteOk;
+}
+
 TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
   TF_LITE_ENSURE_EQ(context, NumInputs(node), 2);
   TF_LITE_ENSURE_EQ(context, NumOutputs(node), 1);
 
   OpContext op_context(context, node);
-  TF_LITE_ENSURE_OK(context, InitializeTemporaries(context, node, &op_context));
   OpData* op_data = reinterpret_cast<OpData*>(node->user_data);
+  op_data->is_sparse = op_context.rhs->sparsity != nullptr;
+  op_data->is_packed_int4 = op_context.rhs->type == kTfLiteInt4;
+  TF_LITE_ENSURE_OK(context, InitializeTemporaries(context, node, &op_context));
 
   bool adj_x = op_context.params->adj_x;
   bool adj_y = op_context.params->adj_y;
@@ -344,12 +434,15 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
                               lhs_data->type == kTfLiteInt8 ||
                               lhs_data->type == kTfLiteInt16);
   TF_LITE_ENSURE(context, rhs_data->type == kTfLiteFloat32 ||
+                              rhs_data->type == kTfLiteInt4 ||
                               rhs_data->type == kTfLiteInt8 ||
                               rhs_data->type == kTfLiteInt16);
-  // Either we have a hybrid quantization with a float32 and an int8 input,
-  // otherwise both inputs should be of the same type.
+  // Either we have a hybrid quantization with a float32 and an int8 input, or
+  // a float32 input with int4 weights, otherwise both inputs should be of the
+  // same type.
   TF_LITE_ENSURE(context, (lhs_data->type == kTfLiteFloat32 &&
-                           rhs_data->type == kTfLiteInt8) ||
+                           (rhs_data->type == kTfLiteInt8 ||
+                            rhs_data->type == kTfLiteInt4)) ||
                               lhs_data->type == rhs_data->type);
   // Support dimensions between 2 and 5, inclusive.
   TF_LITE_ENSURE(context, NumDimensions(lhs_data) >= 2);
@@ -382,6 +475,46 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
                             : extended_rhs_shape.Dims(output_rank - 2);
 
   TF_LITE_ENSURE_EQ(context, accum_dim_lhs, accum_dim_rhs);
+
+  // A sparse RHS is only supported as constant weights without batch
+  // dimensions, multiplied with a float or int8 LHS of the same type that
+  // isn't transposed, as it's compressed once in block sparse format.
+  if (op_data->is_sparse) {
+    TF_LITE_ENSURE(context, lhs_data->type == kTfLiteFloat32 ||
+                                lhs_data->type == kTfLiteInt8);
+    TF_LITE_ENSURE_TYPES_EQ(context, rhs_data->type, lhs_data->type);
+    TF_LITE_ENSURE_TYPES_EQ(context, output->type, lhs_data->type);
+    TF_LITE_ENSURE(context, IsConstantTensor(rhs_data));
+    TF_LITE_ENSURE(context, !adj_x);
+    for (int i = 0; i < rhs_rank - 2; ++i) {
+      TF_LITE_ENSURE_EQ(context, SizeOfDimension(rhs_data, i), 1);
+    }
+    if (lhs_data->type == kTfLiteFloat32) {
+      TF_LITE_ENSURE_OK(context,
+                        PopulateSparseRhs(context, rhs_data, adj_y,
+                                          &op_data->sparse_rhs_float));
+    } else {
+      TF_LITE_ENSURE_EQ(context, rhs_data->params.zero_point, 0);
+      TF_LITE_ENSURE_OK(context,
+                        PopulateSparseRhs(context, rhs_data, adj_y,
+                                          &op_data->sparse_rhs_int8));
+    }
+  }
+
+  // An int4 RHS is only supported as constant dense weights without batch
+  // dimensions, multiplied with a float LHS that isn't transposed.
+  if (op_data->is_packed_int4) {
+    TF_LITE_ENSURE(context, !op_data->is_sparse);
+    TF_LITE_ENSURE_TYPES_EQ(context, output->type, kTfLiteFloat32);
+    TF_LITE_ENSURE(context, IsConstantTensor(rhs_data));
+    TF_LITE_ENSURE(context, !adj_x);
+    for (int i = 0; i < rhs_rank - 2; ++i) {
+      TF_LITE_ENSURE_EQ(context, SizeOfDimension(rhs_data, i), 1);
+    }
+    TF_LITE_ENSURE_OK(context,
+                      PopulatePackedInt4Rhs(context, rhs_data, adj_y, op_data));
+  }
+
   TfLiteStatus status =
       ResizeOutputTensor(context, extended_lhs_shape, extended_rhs_shape, adj_x,
                          adj_y, output_rank, output);
@@ -661,6 +794,51 @@ TfLiteStatus EvalQuantized(TfLiteContext* context, TfLiteNode* node,
   return kTfLiteOk;
 }
 
+TfLiteStatus EvalSparse(TfLiteContext* context, const OpData* data,
+                        const TfLiteTensor* lhs, TfLiteTensor* output) {
+  CpuBackendContext* cpu_backend_context =
+      CpuBackendContext::GetFromContext(context);
+  if (lhs->type == kTfLiteFloat32) {
+    optimized_ops::BatchMatMulSparseRhs(
+        GetTensorShape(lhs), GetTensorData<float>(lhs), data->sparse_rhs_float,
+        GetTensorShape(output), GetTensorData<float>(output),
+        cpu_backend_context);
+  } else {
+    FullyConnectedParams op_params;
+    op_params.input_offset = -lhs->params.zero_point;
+    op_params.weights_offset = 0;
+    op_params.output_offset = output->params.zero_point;
+    op_params.output_multiplier = data->output_multiplier;
+    op_params.output_shift = data->output_shift;
+    op_params.quantized_activation_min = data->output_activation_min;
+    op_params.quantized_activation_max = data->output_activation_max;
+    optimized_ops::BatchMatMulSparseRhs(
+        op_params, GetTensorShape(lhs), GetTensorData<int8_t>(lhs),
+        data->sparse_rhs_int8, GetTensorShape(output),
+        GetTensorData<int8_t>(output), cpu_backend_context);
+  }
+  return kTfLiteOk;
+}
+
+// The LHS is [..., rows, accum_depth] and the output [..., rows, num_units], so
+// all the batch dimensions of the LHS are flattened with its rows.
+TfLiteStatus EvalPackedInt4(TfLiteContext* context, const OpData* data,
+                            const TfLiteTensor* lhs, const TfLiteTensor* rhs,
+                            TfLiteTensor* output) {
+  const int accum_depth = SizeOfDimension(lhs, NumDimensions(lhs) - 1);
+  const int rows = NumElements(lhs) / accum_depth;
+  const int num_units = NumElements(output) / rows;
+  const int8_t* packed_rhs = data->packed_int4_rhs.empty()
+                                 ? GetTensorData<int8_t>(rhs)
+                                 : data->packed_int4_rhs.data();
+  std::fill_n(GetTensorData<float>(output), rows * num_units, 0.0f);
+  optimized_ops::PackedInt4FullyConnectedAccumulate(
+      GetTensorData<float>(lhs), rows, accum_depth, packed_rhs, num_units,
+      data->int4_scales.data(), data->int4_block_size,
+      GetTensorData<float>(output), CpuBackendContext::GetFromContext(context));
+  return kTfLiteOk;
+}
+
 TfLiteTensor* GetTempRhs(TfLiteContext* context, TfLiteNode* node,
                          const TfLiteTensor* rhs) {
   TfLiteTensor* transposed_rhs = GetTemporary(context, node, 1);
@@ -721,6 +899,13 @@ TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
   bool adj_y = op_context.params->adj_y;
   bool adj_x = op_context.params->adj_x;
 
+  if (op_data->is_sparse) {
+    return EvalSparse(context, op_data, lhs, output);
+  }
+  if (op_data->is_packed_int4) {
+    return EvalPackedInt4(context, op_data, lhs, rhs, output);
+  }
+
   const TfLiteTensor* rhs_tensor = adj_y ? rhs : GetTempRhs(context, node, rhs);
   const TfLiteTensor* lhs_tensor = adj_x ? GetTempLhs(context, node, lhs) : lhs;
   if (!adj_y) {
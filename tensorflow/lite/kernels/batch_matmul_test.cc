@@ -384,6 +384,76 @@ TEST(ConstRHSBatchMatMulOpModel, RHSNotAdjoint) {
   EXPECT_THAT(model.GetOutputShape(), ElementsAreArray({1, 6, 3}));
 }
 
+// A float LHS with constant int4 RHS weights, whose `scales` are either one
+// per unit or, for blockwise quantization, `scales.size() / units` per unit.
+class PackedInt4BatchMatMulOpModel : public SingleOpModel {
+ public:
+  PackedInt4BatchMatMulOpModel(const TensorData& lhs,
+                               std::initializer_list<int> rhs_shape,
+                               const std::vector<int8_t>& rhs_values,
+                               const std::vector<float>& scales,
+                               bool adj_y = false) {
+    // Two values are packed per byte, the first one in the low nibble.
+    std::vector<int8_t> packed_rhs((rhs_values.size() + 1) / 2, 0);
+    for (size_t i = 0; i < rhs_values.size(); ++i) {
+      const uint8_t value = rhs_values[i] & 0x0F;
+      packed_rhs[i / 2] |= i % 2 ? value << 4 : value;
+    }
+    lhs_id_ = AddInput(lhs);
+    const int units_dimension =
+        adj_y ? rhs_shape.size() - 2 : rhs_shape.size() - 1;
+    rhs_id_ = AddConstInput<int8_t>(
+        {TensorType_INT4, rhs_shape, 0, 0, 0, 0, true, scales,
+         std::vector<int64_t>(scales.size(), 0), units_dimension},
+        packed_rhs.data(), packed_rhs.size());
+    output_id_ = AddOutput(TensorType_FLOAT32);
+    SetBuiltinOp(BuiltinOperator_BATCH_MATMUL,
+                 BuiltinOptions_BatchMatMulOptions,
+                 CreateBatchMatMulOptions(builder_, /*adj_x=*/false, adj_y)
+                     .Union());
+    BuildInterpreter({GetShape(lhs_id_), GetShape(rhs_id_)});
+  }
+
+  int lhs() const { return lhs_id_; }
+  std::vector<float> GetOutput() { return ExtractVector<float>(output_id_); }
+  std::vector<int32_t> GetOutputShape() { return GetTensorShape(output_id_); }
+
+ protected:
+  int lhs_id_;
+  int rhs_id_;
+  int output_id_;
+};
+
+TEST(PackedInt4BatchMatMulOpModel, PerUnitScales) {
+  PackedInt4BatchMatMulOpModel model(
+      {TensorType_FLOAT32, {1, 2, 8}}, {8, 3},
+      {1, -1, 7, 2, -2, -7, 3, -3, 1,  4, -4, -1,
+       5, 5,  2, 6, 6,  -2, 7, 7,  3, -8, 0,  -3},
+      /*scales=*/{0.5, 1, 2});
+  model.PopulateTensor<float>(model.lhs(), {1, 2, 3, 4, 5, 6, 7, 8,  //
+                                           1, -1, 1, -1, 1, -1, 1, -1});
+  ASSERT_EQ(model.Invoke(), kTfLiteOk);
+  EXPECT_THAT(model.GetOutput(),
+              ElementsAreArray(ArrayFloatNear({38, 80, -26, 6, 8, 52})));
+  EXPECT_THAT(model.GetOutputShape(), ElementsAreArray({1, 2, 3}));
+}
+
+TEST(PackedInt4BatchMatMulOpModel, BlockwiseScalesAdjointRHS) {
+  // The RHS is [units, accum_depth] with two blocks of 4 values per unit.
+  PackedInt4BatchMatMulOpModel model(
+      {TensorType_FLOAT32, {1, 2, 8}}, {3, 8},
+      {1,  2,  3,  4,  5, 6,  7, -8,  //
+       -1, -2, -3, -4, 5, 6,  7, 0,   //
+       7,  -7, 1,  -1, 2, -2, 3, -3},
+      /*scales=*/{0.5, 0.25, 1, 2, 0.125, 1.5}, /*adj_y=*/true);
+  model.PopulateTensor<float>(model.lhs(), {1, 2, 3, 4, 5, 6, 7, 8,  //
+                                           1, -1, 1, -1, 1, -1, 1, -1});
+  ASSERT_EQ(model.Invoke(), kTfLiteOk);
+  EXPECT_THAT(model.GetOutput(), ElementsAreArray(ArrayFloatNear(
+                                     {26.5, 190, -8.5, 2.5, 14, 17})));
+  EXPECT_THAT(model.GetOutputShape(), ElementsAreArray({1, 2, 3}));
+}
+
 // In the hybrid model the weights are quantized int8. But the input
 // and output are expected to be in float precision.
 class HybridBatchMatMulOpModel : public SingleOpModel {
@@ -37,6 +37,8 @@ limitations under the License.
 #include "tensorflow/lite/kernels/internal/optimized/multithreaded_conv.h"
 #endif
 #include "tensorflow/lite/kernels/internal/optimized/optimized_ops.h"
+#include "tensorflow/lite/kernels/internal/optimized/sparse_ops/block_sparse_matrix.h"
+#include "tensorflow/lite/kernels/internal/optimized/sparse_ops/conv.h"
 #include "tensorflow/lite/kernels/internal/quantization_util.h"
 #include "tensorflow/lite/kernels/internal/reference/conv.h"
 #include "tensorflow/lite/kernels/internal/reference/integer_ops/conv.h"
@@ -45,6 +47,7 @@ limitations under the License.
 #include "tensorflow/lite/kernels/internal/tensor_utils.h"
 #include "tensorflow/lite/kernels/kernel_util.h"
 #include "tensorflow/lite/kernels/padding.h"
+#include "tensorflow/lite/shared_weights_cache.h"
 #include "tensorflow/lite/util.h"
 
 namespace tflite {
@@ -120,6 +123,13 @@ struct OpData {
 
   // Number of convolution groups.
   int32_t groups = 1;
+
+  // If the filter is a sparse tensor, the [output_depth, filter_height *
+  // filter_width * input_depth] filter matrix in block sparse format, used
+  // instead of the filter tensor by all kernel types.
+  bool is_sparse = false;
+  optimized_ops::BlockSparseMatrix<float> sparse_filter_float;
+  optimized_ops::BlockSparseMatrix<int8_t> sparse_filter_int8;
 };
 
 inline PaddingType RuntimePaddingType(TfLitePadding padding) {
@@ -168,6 +178,34 @@ void TransposeFloatTensor(const TfLiteTensor* input, TfLiteTensor* output) {
   }
 }
 
+// Transposes the constant filter once into a buffer shared with the other
+// interpreters of the model that use the same SharedWeightsCache, instead of
+// the persistent `hwcn_weights` tensor of each interpreter.
+TfLiteStatus PrepareSharedHwcnWeights(TfLiteContext* context,
+                                      const TfLiteTensor* filter,
+                                      TfLiteTensor* hwcn_weights,
+                                      TfLiteIntArray* hwcn_weights_size) {
+  // Sized like the unshared tensor, which the arena then doesn't allocate
+  // because it ends up kTfLiteMmapRo below.
+  hwcn_weights->allocation_type = kTfLiteArenaRwPersistent;
+  TF_LITE_ENSURE_OK(
+      context, context->ResizeTensor(context, hwcn_weights, hwcn_weights_size));
+  const void* weights = SharedWeightsCache::Get(context)->GetOrCreate(
+      filter->data.raw, kTfLiteBuiltinConv2d, hwcn_weights->bytes,
+      [&](void* buffer) {
+        hwcn_weights->data.raw = static_cast<char*>(buffer);
+        TransposeFloatTensor(filter, hwcn_weights);
+        return kTfLiteOk;
+      });
+  TF_LITE_ENSURE(context, weights != nullptr);
+  // As for the shared outputs of DEQUANTIZE, the weights are external
+  // read-only data rather than a custom allocation of the interpreter.
+  hwcn_weights->allocation_type = kTfLiteMmapRo;
+  hwcn_weights->data.raw =
+      const_cast<char*>(static_cast<const char*>(weights));
+  return kTfLiteOk;
+}
+
 // Check if im2col needs to be allocated, as some version of optimized Conv dont
 // use it. If any change is supporting im2col in any of the Conv versions, then
 // it should be updated here as well
@@ -177,6 +215,9 @@ bool IsIm2ColRequired(const TfLiteTensor* input, TfLiteConvParams* params,
   // If HWCN weights are required, Im2Col not required
   if (data->need_hwcn_weights) return false;
 
+  // The sparse kernels gather the input patches themselves.
+  if (data->is_sparse) return false;
+
   // segregate based on dilated conv & non-dialated conv
   const bool need_dilated_im2col =
       params->dilation_width_factor != 1 || params->dilation_height_factor != 1;
@@ -323,6 +364,27 @@ static TfLiteStatus AllocateTemporaryTensorsIfRequired(
   return kTfLiteOk;
 }
 
+// Populates `matrix` with the [output_depth, filter_height * filter_width *
+// input_depth] matrix of the sparse `filter`, with the blocks of its sparsity.
+template <typename T>
+TfLiteStatus PopulateSparseFilter(TfLiteContext* context,
+                                  const TfLiteTensor* filter,
+                                  optimized_ops::BlockSparseMatrix<T>* matrix) {
+  // The filter is constant, so it's only compressed on the first Prepare.
+  if (matrix->IsPopulated()) return kTfLiteOk;
+  const RuntimeShape filter_shape = GetTensorShape(filter);
+  const int rows = filter_shape.Dims(0);
+  const int cols = filter_shape.FlatSize() / rows;
+  const TfLiteSparsity& sparsity = *filter->sparsity;
+  optimized_ops::PopulateBlockSparseMatrix(
+      sparsity, filter_shape, GetTensorData<T>(filter), rows, cols,
+      /*row_stride=*/cols, /*col_stride=*/1,
+      optimized_ops::GetSparsityBlockSize(sparsity, /*rank=*/4, /*dim=*/0),
+      optimized_ops::GetSparsityBlockSize(sparsity, /*rank=*/4, /*dim=*/3),
+      matrix);
+  return kTfLiteOk;
+}
+
 TfLiteStatus Prepare(KernelType kernel_type, TfLiteContext* context,
                      TfLiteNode* node) {
   auto* params = reinterpret_cast<TfLiteConvParams*>(node->builtin_data);
@@ -418,11 +480,33 @@ TfLiteStatus Prepare(KernelType kernel_type, TfLiteContext* context,
     }
   }
 
+  // Sparse filters are only supported with float or int8 inputs of the same
+  // type, and are compressed once in block sparse format, so they must be
+  // constant.
+  data->is_sparse = filter->sparsity != nullptr;
+  if (data->is_sparse) {
+    TF_LITE_ENSURE(context, input_type == kTfLiteFloat32 ||
+                                input_type == kTfLiteInt8);
+    TF_LITE_ENSURE_TYPES_EQ(context, filter->type, input_type);
+    TF_LITE_ENSURE(context, IsConstantTensor(filter));
+    TF_LITE_ENSURE_EQ(context, data->groups, 1);
+    if (input_type == kTfLiteFloat32) {
+      TF_LITE_ENSURE_OK(context, PopulateSparseFilter(
+                                     context, filter,
+                                     &data->sparse_filter_float));
+    } else {
+      TF_LITE_ENSURE_OK(context,
+                        PopulateSparseFilter(context, filter,
+                                             &data->sparse_filter_int8));
+    }
+  }
+
   // The multi-threaded kernel supports neither dilation nor hybrid kernels, and
   // is incompatible with mutable input filters that might change between evals.
   data->supports_multithreaded_kernel =
       (kernel_type == kMultithreadOptimized) &&
       (context->recommended_num_threads != 1) && !is_hybrid &&
+      !data->is_sparse &&
       (params->dilation_width_factor == 1) &&
       (params->dilation_height_factor == 1) &&
       (filter->allocation_type != kTfLiteArenaRw) && !IsDynamicTensor(filter);
@@ -528,15 +612,22 @@ TfLiteStatus Prepare(KernelType kernel_type, TfLiteContext* context,
         &context->tensors[node->temporaries->data[data->hwcn_weights_index]];
     hwcn_weights->type = input_type;
     hwcn_weights->name = "Conv_hwcn_weights";
-    hwcn_weights->allocation_type = kTfLiteArenaRwPersistent;
+    if (IsConstantTensor(filter) && SharedWeightsCache::Get(context)) {
+      TF_LITE_ENSURE_OK(context,
+                        PrepareSharedHwcnWeights(context, filter, hwcn_weights,
+                                                 hwcn_weights_size));
+      data->have_weights_been_transposed = true;
+    } else {
+      hwcn_weights->allocation_type = kTfLiteArenaRwPersistent;
 
-    auto hwcn_weights_status =
-        context->ResizeTensor(context, hwcn_weights, hwcn_weights_size);
-    if (hwcn_weights_status != kTfLiteOk) return hwcn_weights_status;
+      auto hwcn_weights_status =
+          context->ResizeTensor(context, hwcn_weights, hwcn_weights_size);
+      if (hwcn_weights_status != kTfLiteOk) return hwcn_weights_status;
 
-    // TODO(petewarden): If Resize() is called when the size hasn't actually
-    // changed, this will do extra redundant work.
-    data->have_weights_been_transposed = false;
+      // TODO(petewarden): If Resize() is called when the size hasn't actually
+      // changed, this will do extra redundant work.
+      data->have_weights_been_transposed = false;
+    }
   }
 
   if (is_hybrid) {
@@ -1169,6 +1260,45 @@ TfLiteStatus EvalHybrid(TfLiteContext* context, TfLiteNode* node,
   return kTfLiteOk;
 }
 
+void EvalSparse(TfLiteContext* context, TfLiteConvParams* params,
+                OpData* data, const TfLiteTensor* input,
+                const TfLiteTensor* filter, const TfLiteTensor* bias,
+                TfLiteTensor* output) {
+  ConvParams op_params;
+  op_params.padding_type = RuntimePaddingType(params->padding);
+  op_params.padding_values.width = data->padding.width;
+  op_params.padding_values.height = data->padding.height;
+  op_params.stride_width = params->stride_width;
+  op_params.stride_height = params->stride_height;
+  op_params.dilation_width_factor = params->dilation_width_factor;
+  op_params.dilation_height_factor = params->dilation_height_factor;
+  CpuBackendContext* cpu_backend_context =
+      CpuBackendContext::GetFromContext(context);
+  if (input->type == kTfLiteFloat32) {
+    CalculateActivationRange(params->activation,
+                             &op_params.float_activation_min,
+                             &op_params.float_activation_max);
+    optimized_ops::ConvSparseWeight(
+        op_params, GetTensorShape(input), GetTensorData<float>(input),
+        GetTensorShape(filter), data->sparse_filter_float,
+        GetTensorShape(bias), GetTensorData<float>(bias),
+        GetTensorShape(output), GetTensorData<float>(output),
+        cpu_backend_context);
+  } else {
+    op_params.input_offset = -input->params.zero_point;
+    op_params.output_offset = output->params.zero_point;
+    op_params.quantized_activation_min = data->output_activation_min;
+    op_params.quantized_activation_max = data->output_activation_max;
+    optimized_ops::ConvPerChannelSparseWeight(
+        op_params, data->per_channel_output_multiplier.data(),
+        data->per_channel_output_shift.data(), GetTensorShape(input),
+        GetTensorData<int8_t>(input), GetTensorShape(filter),
+        data->sparse_filter_int8, GetTensorShape(bias),
+        GetTensorData<int32_t>(bias), GetTensorShape(output),
+        GetTensorData<int8_t>(output), cpu_backend_context);
+  }
+}
+
 template <KernelType kernel_type, TfLiteType input_type>
 TfLiteStatus EvalImpl(TfLiteContext* context, TfLiteNode* node) {
   auto* params = reinterpret_cast<TfLiteConvParams*>(node->builtin_data);
@@ -1182,6 +1312,10 @@ TfLiteStatus EvalImpl(TfLiteContext* context, TfLiteNode* node) {
   TF_LITE_ENSURE_OK(context, GetInputSafe(context, node, 1, &filter));
   bool has_bias = node->inputs->size == 3;
   const TfLiteTensor* bias = has_bias ? GetInput(context, node, 2) : nullptr;
+  if (data->is_sparse) {
+    EvalSparse(context, params, data, input, filter, bias, output);
+    return kTfLiteOk;
+  }
   TfLiteTensor* im2col =
       data->need_im2col
           ? &context->tensors[node->temporaries->data[data->im2col_index]]
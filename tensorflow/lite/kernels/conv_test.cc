@@ -27,7 +27,9 @@ limitations under the License.
 #include "tensorflow/lite/core/interpreter.h"
 #include "tensorflow/lite/kernels/test_util.h"
 #include "tensorflow/lite/schema/schema_generated.h"
+#include "tensorflow/lite/shared_weights_cache.h"
 #include "tensorflow/lite/string_type.h"
+#include "tensorflow/lite/util.h"
 
 namespace tflite {
 
@@ -223,6 +225,72 @@ TEST_P(ConvolutionOpTest, SimpleTestFloat32SingleThreaded) {
                              }));
 }
 
+#ifndef TFLITE_WITH_RUY
+// The model of SimpleTestFloat32 with a constant filter, whose transposed
+// weights the multi-threaded kernel keeps in `cache`, and with the input in
+// `input`, a custom allocation.
+class SharedWeightsConvolutionOpModel : public SingleOpModel {
+ public:
+  SharedWeightsConvolutionOpModel(SharedWeightsCache* cache, float* input,
+                                  size_t input_bytes) {
+    input_ = AddInput({TensorType_FLOAT32, {2, 2, 4, 1}});
+    filter_ = AddConstInput(TensorData{TensorType_FLOAT32, {3, 2, 2, 1}},
+                            {1, 2, 3, 4, -1, 1, -1, 1, -1, -1, 1, 1});
+    bias_ = AddConstInput(TensorData{TensorType_FLOAT32, {3}}, {1, 2, 3});
+    output_ = AddOutput({TensorType_FLOAT32, {}});
+    SetBuiltinOp(BuiltinOperator_CONV_2D, BuiltinOptions_Conv2DOptions,
+                 CreateConv2DOptions(builder_, Padding_VALID, 2, 2).Union());
+    resolver_ = std::make_unique<SingleOpResolver>(
+        BuiltinOperator_CONV_2D,
+        ops::builtin::Register_CONVOLUTION_MULTITHREADED_OPT());
+    BuildInterpreter({GetShape(input_), GetShape(filter_), GetShape(bias_)},
+                     /*num_threads=*/2, /*allow_fp32_relax_to_fp16=*/false,
+                     /*apply_delegate=*/false,
+                     /*allocate_and_delegate=*/false);
+    interpreter_->SetExternalContext(kTfLiteSharedWeightsContext, cache);
+    CHECK_EQ(interpreter_->SetCustomAllocationForTensor(
+                 input_, {input, input_bytes}),
+             kTfLiteOk);
+    AllocateAndDelegate(/*apply_delegate=*/false);
+  }
+
+  std::vector<float> GetOutput() { return ExtractVector<float>(output_); }
+
+ private:
+  int input_;
+  int filter_;
+  int bias_;
+  int output_;
+};
+
+TEST(ConvolutionOpTest, SharedWeightsWithCustomAllocation) {
+  SharedWeightsCache cache;
+  alignas(kDefaultTensorAlignment) float input1[16] = {
+      1, 1, 1, 1, 2, 2, 2, 2, 1, 2, 3, 4, 1, 2, 3, 4};
+  alignas(kDefaultTensorAlignment) float input2[16] = {
+      1, 2, 3, 4, 1, 2, 3, 4, 1, 1, 1, 1, 2, 2, 2, 2};
+  SharedWeightsConvolutionOpModel m1(&cache, input1, sizeof(input1));
+  SharedWeightsConvolutionOpModel m2(&cache, input2, sizeof(input2));
+  // Both interpreters use the transposed filter of the first one.
+  EXPECT_EQ(cache.num_buffers(), 1);
+
+  ASSERT_EQ(m1.Invoke(), kTfLiteOk);
+  ASSERT_EQ(m2.Invoke(), kTfLiteOk);
+  EXPECT_THAT(m1.GetOutput(), ElementsAreArray({
+                                  18, 2, 5,  // first batch, left
+                                  18, 2, 5,  // first batch, right
+                                  17, 4, 3,  // second batch, left
+                                  37, 4, 3,  // second batch, right
+                              }));
+  EXPECT_THAT(m2.GetOutput(), ElementsAreArray({
+                                  17, 4, 3,  // first batch, left
+                                  37, 4, 3,  // first batch, right
+                                  18, 2, 5,  // second batch, left
+                                  18, 2, 5,  // second batch, right
+                              }));
+}
+#endif
+
 // This test's output is equivalent to the SimpleTestFloat32
 // because we break each input into two channels, each with half of the value,
 // while keeping the filters for each channel equivalent.
@@ -2046,6 +2114,147 @@ TEST_P(ConvolutionOpTest, SimpleTestHybridWithDilationPerChannel) {
                                  0.16)));
 }
 
+// Conv with a constant filter, which is a sparse tensor if `filter` has a
+// traversal order and a dense tensor otherwise.
+class SparseConvolutionOpModel : public SingleOpModel {
+ public:
+  SparseConvolutionOpModel(TfLiteRegistration* registration,
+                           const TensorData& input, const TensorData& filter,
+                           const std::vector<float>& filter_data,
+                           const TensorData& output,
+                           enum Padding padding = Padding_SAME)
+      : is_quantized_(input.type != TensorType_FLOAT32) {
+    input_ = AddInput(input);
+    if (filter.traversal_order.empty()) {
+      filter_ = AddConstInput(filter, filter_data);
+    } else {
+      filter_ = AddConstSparseInput(filter, filter_data);
+    }
+    const int bias_size = filter.shape[0];
+    if (is_quantized_) {
+      TensorData bias{TensorType_INT32, {bias_size}, 0, 0,
+                      GetScale(input_) * GetScale(filter_)};
+      bias_ = AddInput(bias);
+    } else {
+      bias_ = AddInput({TensorType_FLOAT32, {bias_size}});
+    }
+    output_ = AddOutput(output);
+
+    SetBuiltinOp(BuiltinOperator_CONV_2D, BuiltinOptions_Conv2DOptions,
+                 CreateConv2DOptions(builder_, padding, /*stride_w=*/1,
+                                     /*stride_h=*/1)
+                     .Union());
+    resolver_ = std::make_unique<SingleOpResolver>(BuiltinOperator_CONV_2D,
+                                                   registration);
+    BuildInterpreter({GetShape(input_), GetShape(filter_), GetShape(bias_)});
+  }
+
+  void SetInput(const std::vector<float>& data) {
+    if (is_quantized_) {
+      QuantizeAndPopulate<int8_t>(input_, data);
+    } else {
+      PopulateTensor(input_, data);
+    }
+  }
+  void SetBias(const std::vector<float>& data) {
+    if (is_quantized_) {
+      QuantizeAndPopulate<int32_t>(bias_, data);
+    } else {
+      PopulateTensor(bias_, data);
+    }
+  }
+  std::vector<float> GetOutput() {
+    if (is_quantized_) {
+      return Dequantize<int8_t>(ExtractVector<int8_t>(output_),
+                                GetScale(output_), GetZeroPoint(output_));
+    }
+    return ExtractVector<float>(output_);
+  }
+
+ protected:
+  bool is_quantized_;
+  int input_;
+  int filter_;
+  int bias_;
+  int output_;
+};
+
+// Returns a filter of shape [8, 2, 2, 4] whose 1x4 blocks along the input depth
+// and 4x1 blocks along the output depth are zero in two cases out of three.
+std::vector<float> GetSparseConvFilter() {
+  std::vector<float> filter(8 * 2 * 2 * 4);
+  for (int o = 0; o < 8; ++o) {
+    for (int p = 0; p < 16; ++p) {
+      const bool is_zero = (o / 4 + p / 4) % 3 != 0;
+      filter[o * 16 + p] =
+          is_zero ? 0.0f : (p % 4 + 1) * (o % 2 == 0 ? 0.25f : -0.25f);
+    }
+  }
+  return filter;
+}
+
+std::vector<float> GetSparseConvInput() {
+  std::vector<float> input(2 * 3 * 3 * 4);
+  for (size_t i = 0; i < input.size(); ++i) {
+    input[i] = (static_cast<int>(i * 5 % 9) - 4) / 4.0f;
+  }
+  return input;
+}
+
+const std::vector<float>* const kSparseConvBias =
+    new std::vector<float>({0.5, -0.5, 1, -1, 0.25, -0.25, 0, 2});
+
+TEST_P(ConvolutionOpTest, SparseFloat32With1x4Blocks) {
+  const std::vector<float> filter = GetSparseConvFilter();
+  SparseConvolutionOpModel dense_op(
+      GetRegistration(), {TensorType_FLOAT32, {2, 3, 3, 4}},
+      {TensorType_FLOAT32, {8, 2, 2, 4}}, filter, {TensorType_FLOAT32, {}});
+  SparseConvolutionOpModel sparse_op(
+      GetRegistration(), {TensorType_FLOAT32, {2, 3, 3, 4}},
+      {TensorType_FLOAT32, {8, 2, 2, 4}, 0, 0, 0, 0, false, {}, {}, 0,
+       /*traversal_order=*/{0, 1, 2, 3, 4},
+       /*format=*/
+       {kTfLiteDimDense, kTfLiteDimDense, kTfLiteDimDense, kTfLiteDimSparseCSR},
+       /*block_size=*/{4}, /*block_map=*/{3}},
+      filter, {TensorType_FLOAT32, {}});
+
+  dense_op.SetInput(GetSparseConvInput());
+  dense_op.SetBias(*kSparseConvBias);
+  ASSERT_EQ(dense_op.Invoke(), kTfLiteOk);
+  sparse_op.SetInput(GetSparseConvInput());
+  sparse_op.SetBias(*kSparseConvBias);
+  ASSERT_EQ(sparse_op.Invoke(), kTfLiteOk);
+
+  EXPECT_THAT(sparse_op.GetOutput(),
+              ElementsAreArray(ArrayFloatNear(dense_op.GetOutput(), 1e-5)));
+}
+
+TEST_P(ConvolutionOpTest, SparseInt8With4x1Blocks) {
+  const std::vector<float> filter = GetSparseConvFilter();
+  SparseConvolutionOpModel float_op(
+      GetRegistration(), {TensorType_FLOAT32, {2, 3, 3, 4}},
+      {TensorType_FLOAT32, {8, 2, 2, 4}}, filter, {TensorType_FLOAT32, {}});
+  SparseConvolutionOpModel sparse_op(
+      GetRegistration(), {TensorType_INT8, {2, 3, 3, 4}, -1, 1},
+      {TensorType_INT8, {8, 2, 2, 4}, 0, 0, /*scale=*/1.0f / 100, 0, false, {},
+       {}, 0,
+       /*traversal_order=*/{0, 1, 2, 3, 4},
+       /*format=*/
+       {kTfLiteDimDense, kTfLiteDimDense, kTfLiteDimDense, kTfLiteDimSparseCSR},
+       /*block_size=*/{4}, /*block_map=*/{0}},
+      filter, {TensorType_INT8, {}, -8, 8});
+
+  float_op.SetInput(GetSparseConvInput());
+  float_op.SetBias(*kSparseConvBias);
+  ASSERT_EQ(float_op.Invoke(), kTfLiteOk);
+  sparse_op.SetInput(GetSparseConvInput());
+  sparse_op.SetBias(*kSparseConvBias);
+  ASSERT_EQ(sparse_op.Invoke(), kTfLiteOk);
+
+  EXPECT_THAT(sparse_op.GetOutput(),
+              ElementsAreArray(ArrayFloatNear(float_op.GetOutput(), 0.1)));
+}
+
 const auto kQuantizedKernelMap = new std::map<string, TfLiteRegistration*>({
     {"GenericOptimized", ops::builtin::Register_CONV_2D_UINT8()},
 });
@@ -21,6 +21,7 @@ limitations under the License.
 #include "tensorflow/lite/core/c/common.h"
 #include "tensorflow/lite/kernels/internal/tensor_ctypes.h"
 #include "tensorflow/lite/kernels/kernel_util.h"
+#include "tensorflow/lite/shared_weights_cache.h"
 
 namespace tflite {
 namespace ops {
@@ -50,6 +51,63 @@ void Free(TfLiteContext* context, void* buffer) {
   delete reinterpret_cast<OpData*>(buffer);
 }
 
+TfLiteStatus DensifyImpl(TfLiteContext* context, const TfLiteTensor* input,
+                         TfLiteTensor* output) {
+  switch (input->type) {
+    case kTfLiteFloat32:
+      reference_ops::Densify(input->sparsity, GetTensorShape(input),
+                             GetTensorData<float>(input),
+                             GetTensorShape(output),
+                             GetTensorData<float>(output), context);
+      break;
+    case kTfLiteFloat16:
+      reference_ops::Densify(input->sparsity, GetTensorShape(input),
+                             GetTensorData<Eigen::half>(input),
+                             GetTensorShape(output),
+                             GetTensorData<Eigen::half>(output), context);
+      break;
+    case kTfLiteInt8:
+      reference_ops::Densify(input->sparsity, GetTensorShape(input),
+                             GetTensorData<int8_t>(input),
+                             GetTensorShape(output),
+                             GetTensorData<int8_t>(output), context);
+      break;
+
+    default:
+      TF_LITE_KERNEL_LOG(context, "Type %d not supported.", input->type);
+      return kTfLiteError;
+  }
+  return kTfLiteOk;
+}
+
+// Densifies the weights once into a buffer shared with the other interpreters
+// of the model that use the same SharedWeightsCache.
+TfLiteStatus PrepareSharedWeights(TfLiteContext* context, TfLiteNode* node,
+                                  const OpContext& op_context) {
+  OpData* op_data = reinterpret_cast<OpData*>(node->user_data);
+  // Sized like the unshared output, which the arena then doesn't allocate
+  // because it ends up kTfLiteMmapRo below.
+  op_context.output->allocation_type = kTfLiteArenaRwPersistent;
+  TF_LITE_ENSURE_OK(
+      context, context->ResizeTensor(context, op_context.output,
+                                     TfLiteIntArrayCopy(op_context.input->dims)));
+  const void* weights = SharedWeightsCache::Get(context)->GetOrCreate(
+      op_context.input->data.raw, kTfLiteBuiltinDensify,
+      op_context.output->bytes, [&](void* buffer) {
+        op_context.output->data.raw = static_cast<char*>(buffer);
+        return DensifyImpl(context, op_context.input, op_context.output);
+      });
+  TF_LITE_ENSURE(context, weights != nullptr);
+  // The cache owns the weights, so the output is external read-only data like
+  // the constant tensors of the model. kTfLiteCustom is reserved for the
+  // allocations set with Interpreter::SetCustomAllocationForTensor().
+  op_context.output->allocation_type = kTfLiteMmapRo;
+  op_context.output->data.raw =
+      const_cast<char*>(static_cast<const char*>(weights));
+  op_data->dense_weights_initialized = true;
+  return kTfLiteOk;
+}
+
 TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
   TF_LITE_ENSURE_EQ(context, NumInputs(node), 1);
   TF_LITE_ENSURE_EQ(context, NumOutputs(node), 1);
@@ -62,6 +120,9 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
 
   op_context.output->type = op_context.input->type;
   op_context.output->name = "Densify_output";
+  if (SharedWeightsCache::Get(context)) {
+    return PrepareSharedWeights(context, node, op_context);
+  }
   op_context.output->allocation_type = kTfLiteArenaRwPersistent;
 
   return context->ResizeTensor(context, op_context.output,
@@ -75,34 +136,8 @@ TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
     return kTfLiteOk;
   }
 
-  switch (op_context.input->type) {
-    case kTfLiteFloat32:
-      reference_ops::Densify(op_context.input->sparsity,
-                             GetTensorShape(op_context.input),
-                             GetTensorData<float>(op_context.input),
-                             GetTensorShape(op_context.output),
-                             GetTensorData<float>(op_context.output), context);
-      break;
-    case kTfLiteFloat16:
-      reference_ops::Densify(
-          op_context.input->sparsity, GetTensorShape(op_context.input),
-          GetTensorData<Eigen::half>(op_context.input),
-          GetTensorShape(op_context.output),
-          GetTensorData<Eigen::half>(op_context.output), context);
-      break;
-    case kTfLiteInt8:
-      reference_ops::Densify(op_context.input->sparsity,
-                             GetTensorShape(op_context.input),
-                             GetTensorData<int8_t>(op_context.input),
-                             GetTensorShape(op_context.output),
-                             GetTensorData<int8_t>(op_context.output), context);
-      break;
-
-    default:
-      TF_LITE_KERNEL_LOG(context, "Type %d not supported.",
-                         op_context.input->type);
-      return kTfLiteError;
-  }
+  TF_LITE_ENSURE_OK(context,
+                    DensifyImpl(context, op_context.input, op_context.output));
 
   op_data->dense_weights_initialized = true;
   return kTfLiteOk;
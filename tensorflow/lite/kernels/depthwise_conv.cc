@@ -30,6 +30,8 @@ limitations under the License.
 #include "tensorflow/lite/kernels/internal/optimized/depthwiseconv_multithread.h"
 #include "tensorflow/lite/kernels/internal/optimized/integer_ops/depthwise_conv_hybrid.h"
 #include "tensorflow/lite/kernels/internal/optimized/neon_check.h"
+#include "tensorflow/lite/kernels/internal/optimized/sparse_ops/block_sparse_matrix.h"
+#include "tensorflow/lite/kernels/internal/optimized/sparse_ops/depthwise_conv.h"
 #include "tensorflow/lite/kernels/internal/quantization_util.h"
 #include "tensorflow/lite/kernels/internal/reference/depthwiseconv_float.h"
 #include "tensorflow/lite/kernels/internal/reference/depthwiseconv_uint8.h"
@@ -82,6 +84,13 @@ struct OpData {
   int32_t input_quantized_index;
   int32_t scaling_factors_index;
   int32_t input_offset_index;
+
+  // If the filter is a sparse tensor, the [output_depth, filter_height *
+  // filter_width] filter matrix in block sparse format, used instead of the
+  // filter tensor by all kernel types.
+  bool is_sparse = false;
+  optimized_ops::BlockSparseMatrix<float> sparse_filter_float;
+  optimized_ops::BlockSparseMatrix<int8_t> sparse_filter_int8;
 };
 
 void* Init(TfLiteContext* context, const char* buffer, size_t length) {
@@ -95,6 +104,27 @@ void Free(TfLiteContext* context, void* buffer) {
   delete reinterpret_cast<OpData*>(buffer);
 }
 
+// Populates `matrix` with the [output_depth, filter_height * filter_width]
+// matrix of the sparse `filter`. Only the blocks of the output depth dimension
+// are kept, so that each block is applied to a single input pixel.
+template <typename T>
+TfLiteStatus PopulateSparseFilter(TfLiteContext* context,
+                                  const TfLiteTensor* filter,
+                                  optimized_ops::BlockSparseMatrix<T>* matrix) {
+  // The filter is constant, so it's only compressed on the first Prepare.
+  if (matrix->IsPopulated()) return kTfLiteOk;
+  const RuntimeShape filter_shape = GetTensorShape(filter);
+  const int rows = filter_shape.Dims(3);
+  const int cols = filter_shape.FlatSize() / rows;
+  optimized_ops::PopulateBlockSparseMatrix(
+      *filter->sparsity, filter_shape, GetTensorData<T>(filter), rows, cols,
+      /*row_stride=*/1, /*col_stride=*/rows,
+      optimized_ops::GetSparsityBlockSize(*filter->sparsity, /*rank=*/4,
+                                          /*dim=*/3),
+      /*block_cols=*/1, matrix);
+  return kTfLiteOk;
+}
+
 TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
   auto* params =
       reinterpret_cast<TfLiteDepthwiseConvParams*>(node->builtin_data);
@@ -143,6 +173,26 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
   // Filter in DepthwiseConv is expected to be [1, H, W, O].
   TF_LITE_ENSURE_EQ(context, SizeOfDimension(filter, 0), 1);
 
+  // Sparse filters are only supported with float or int8 inputs of the same
+  // type, and are compressed once in block sparse format, so they must be
+  // constant.
+  data->is_sparse = filter->sparsity != nullptr;
+  if (data->is_sparse) {
+    TF_LITE_ENSURE(context,
+                   data_type == kTfLiteFloat32 || data_type == kTfLiteInt8);
+    TF_LITE_ENSURE_TYPES_EQ(context, filter_type, data_type);
+    TF_LITE_ENSURE(context, IsConstantTensor(filter));
+    if (data_type == kTfLiteFloat32) {
+      TF_LITE_ENSURE_OK(context,
+                        PopulateSparseFilter(context, filter,
+                                             &data->sparse_filter_float));
+    } else {
+      TF_LITE_ENSURE_OK(context,
+                        PopulateSparseFilter(context, filter,
+                                             &data->sparse_filter_int8));
+    }
+  }
+
   if (has_bias) {
     TF_LITE_ENSURE_OK(context, GetInputSafe(context, node, kBiasTensor, &bias));
     if (data_type == kTfLiteUInt8 || data_type == kTfLiteInt8) {
@@ -561,6 +611,48 @@ TfLiteStatus EvalHybridPerChannel(TfLiteContext* context, TfLiteNode* node,
   return kTfLiteOk;
 }
 
+TfLiteStatus EvalSparse(TfLiteContext* context,
+                        TfLiteDepthwiseConvParams* params, OpData* data,
+                        const TfLiteTensor* input, const TfLiteTensor* filter,
+                        const TfLiteTensor* bias, TfLiteTensor* output) {
+  DepthwiseParams op_params;
+  op_params.padding_type = PaddingType::kSame;
+  op_params.padding_values.width = data->padding.width;
+  op_params.padding_values.height = data->padding.height;
+  op_params.stride_width = params->stride_width;
+  op_params.stride_height = params->stride_height;
+  op_params.dilation_width_factor = params->dilation_width_factor;
+  op_params.dilation_height_factor = params->dilation_height_factor;
+  TF_LITE_ENSURE_STATUS(ComputeDepthMultiplier(context, input, filter,
+                                               &op_params.depth_multiplier));
+  CpuBackendContext* cpu_backend_context =
+      CpuBackendContext::GetFromContext(context);
+  if (input->type == kTfLiteFloat32) {
+    CalculateActivationRange(params->activation,
+                             &op_params.float_activation_min,
+                             &op_params.float_activation_max);
+    optimized_ops::DepthwiseConvSparseWeight(
+        op_params, GetTensorShape(input), GetTensorData<float>(input),
+        GetTensorShape(filter), data->sparse_filter_float,
+        GetTensorShape(bias), GetTensorData<float>(bias),
+        GetTensorShape(output), GetTensorData<float>(output),
+        cpu_backend_context);
+  } else {
+    op_params.input_offset = -input->params.zero_point;
+    op_params.output_offset = output->params.zero_point;
+    op_params.quantized_activation_min = data->output_activation_min;
+    op_params.quantized_activation_max = data->output_activation_max;
+    optimized_ops::DepthwiseConvPerChannelSparseWeight(
+        op_params, data->per_channel_output_multiplier.data(),
+        data->per_channel_output_shift.data(), GetTensorShape(input),
+        GetTensorData<int8_t>(input), GetTensorShape(filter),
+        data->sparse_filter_int8, GetTensorShape(bias),
+        GetTensorData<int32_t>(bias), GetTensorShape(output),
+        GetTensorData<int8_t>(output), cpu_backend_context);
+  }
+  return kTfLiteOk;
+}
+
 template <KernelType kernel_type, TfLiteType input_type>
 TfLiteStatus EvalImpl(TfLiteContext* context, TfLiteNode* node) {
   auto* params =
@@ -579,6 +671,10 @@ TfLiteStatus EvalImpl(TfLiteContext* context, TfLiteNode* node) {
       (NumInputs(node) == 3) ? GetInput(context, node, kBiasTensor) : nullptr;
   TFLITE_DCHECK_EQ(input_type, input->type);
 
+  if (data->is_sparse) {
+    return EvalSparse(context, params, data, input, filter, bias, output);
+  }
+
   switch (input_type) {  // Already know in/out types are same.
     case kTfLiteFloat32:
       if (filter->type == kTfLiteFloat32) {
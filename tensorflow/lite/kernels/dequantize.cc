@@ -19,6 +19,7 @@ limitations under the License.
 #include "tensorflow/lite/core/c/common.h"
 #include "tensorflow/lite/kernels/internal/optimized/neon_check.h"
 #include "tensorflow/lite/kernels/kernel_util.h"
+#include "tensorflow/lite/shared_weights_cache.h"
 
 namespace tflite {
 namespace ops {
@@ -49,6 +50,36 @@ void Free(TfLiteContext* context, void* buffer) {
   delete reinterpret_cast<OpData*>(buffer);
 }
 
+// Dequantizes the constant input once into a buffer shared with the other
+// interpreters of the model that use the same SharedWeightsCache.
+TfLiteStatus PrepareSharedWeights(TfLiteContext* context, TfLiteNode* node,
+                                  const OpContext& op_context) {
+  OpData* op_data = reinterpret_cast<OpData*>(node->user_data);
+  // Sized like the unshared output, which the arena then doesn't allocate
+  // because it ends up kTfLiteMmapRo below.
+  op_context.output->allocation_type = kTfLiteArenaRwPersistent;
+  TF_LITE_ENSURE_OK(
+      context, context->ResizeTensor(context, op_context.output,
+                                     TfLiteIntArrayCopy(op_context.input->dims)));
+  const void* weights = SharedWeightsCache::Get(context)->GetOrCreate(
+      op_context.input->data.raw, kTfLiteBuiltinDequantize,
+      op_context.output->bytes, [&](void* buffer) {
+        op_context.output->data.raw = static_cast<char*>(buffer);
+        return DequantizeImpl<kGenericOptimized>(context, node,
+                                                 op_context.input,
+                                                 op_context.output);
+      });
+  TF_LITE_ENSURE(context, weights != nullptr);
+  // The cache owns the weights, so the output is external read-only data like
+  // the constant tensors of the model. kTfLiteCustom is reserved for the
+  // allocations set with Interpreter::SetCustomAllocationForTensor().
+  op_context.output->allocation_type = kTfLiteMmapRo;
+  op_context.output->data.raw =
+      const_cast<char*>(static_cast<const char*>(weights));
+  op_data->float_dequantized_weights_initialized = true;
+  return kTfLiteOk;
+}
+
 TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
   TF_LITE_ENSURE_EQ(context, NumInputs(node), 1);
   TF_LITE_ENSURE_EQ(context, NumOutputs(node), 1);
@@ -68,6 +99,9 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
   // If the input tensor is constant, we can persist the dequantized value in
   // the output tensor. Otherwise we run dequantize upon each eval.
   if (IsConstantTensor(op_context.input)) {
+    if (SharedWeightsCache::Get(context)) {
+      return PrepareSharedWeights(context, node, op_context);
+    }
     op_context.output->allocation_type = kTfLiteArenaRwPersistent;
   }
   return context->ResizeTensor(context, op_context.output,
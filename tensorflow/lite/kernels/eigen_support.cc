@@ -14,8 +14,11 @@ limitations under the License.
 ==============================================================================*/
 #include "tensorflow/lite/kernels/eigen_support.h"
 
+#include <algorithm>
 #include <functional>
+#include <map>
 #include <memory>
+#include <mutex>  // NOLINT(build/c++11)
 #include <utility>
 
 #include "tensorflow/lite/arena_planner.h"
@@ -97,32 +100,45 @@ class LazyEigenThreadPoolHolder {
     SetNumThreads(num_threads);
   }
 
-  // Gets the ThreadPoolDevice, creating if necessary.
-  const Eigen::ThreadPoolDevice* GetThreadPoolDevice() {
-    if (!device_) {
+  // Gets a ThreadPoolDevice using at most `num_threads` threads of the pool,
+  // creating it if necessary. Nodes that the subgraph runs concurrently share
+  // the pool, each with the thread budget of its context, so this may be called
+  // from several threads at once.
+  const Eigen::ThreadPoolDevice* GetThreadPoolDevice(int num_threads) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!thread_pool_wrapper_) {
       thread_pool_wrapper_ =
           std::make_unique<EigenThreadPoolWrapper>(target_num_threads_);
-      device_ = std::make_unique<Eigen::ThreadPoolDevice>(
-          thread_pool_wrapper_.get(), target_num_threads_);
     }
-    return device_.get();
+    const int num_device_threads =
+        std::min(GetNumThreads(num_threads), target_num_threads_);
+    std::unique_ptr<Eigen::ThreadPoolDevice>& device =
+        devices_[num_device_threads];
+    if (!device) {
+      device = std::make_unique<Eigen::ThreadPoolDevice>(
+          thread_pool_wrapper_.get(), num_device_threads);
+    }
+    return device.get();
   }
 
-  // Updates the thread count, invalidating the ThreadPoolDevice if necessary.
+  // Updates the thread count, invalidating the ThreadPoolDevices if necessary.
   void SetNumThreads(int num_threads) {
+    std::lock_guard<std::mutex> lock(mutex_);
     const int target_num_threads = GetNumThreads(num_threads);
     if (target_num_threads_ != target_num_threads) {
       target_num_threads_ = target_num_threads;
-      // As the device references the thread pool wrapper, destroy it first.
-      device_.reset();
+      // As the devices reference the thread pool wrapper, destroy them first.
+      devices_.clear();
       thread_pool_wrapper_.reset();
     }
   }
 
  private:
+  std::mutex mutex_;
   int target_num_threads_ = kDefaultNumThreadpoolThreads;
-  // Both device_ and thread_pool_wrapper_ are lazily created.
-  std::unique_ptr<Eigen::ThreadPoolDevice> device_;
+  // The devices, keyed by their thread count, and thread_pool_wrapper_ are
+  // lazily created.
+  std::map<int, std::unique_ptr<Eigen::ThreadPoolDevice>> devices_;
   std::unique_ptr<Eigen::ThreadPoolInterface> thread_pool_wrapper_;
 };
 
@@ -187,7 +203,8 @@ const Eigen::ThreadPoolDevice* GetThreadPoolDevice(TfLiteContext* context) {
     TF_LITE_FATAL(
         "Call to GetFromContext() not preceded by IncrementUsageCounter()");
   }
-  return ptr->thread_pool_holder->GetThreadPoolDevice();
+  return ptr->thread_pool_holder->GetThreadPoolDevice(
+      context->recommended_num_threads);
 }
 
 }  // namespace eigen_support
@@ -34,6 +34,11 @@ void DecrementUsageCounter(TfLiteContext* context);
 
 // Fetch the ThreadPoolDevice associated with the provided context.
 //
+// The device uses at most |context->recommended_num_threads| threads of the
+// pool, which is shared by all the contexts with the same Eigen context, e.g.
+// the contexts of the nodes that a subgraph runs concurrently. It is safe to
+// call this from several threads at once.
+//
 // Note: The caller must ensure that |IncrementUsageCounter()| has already been
 // called. Moreover, it is *not* safe to cache the returned device; it may be
 // invalidated if the context thread count changes.
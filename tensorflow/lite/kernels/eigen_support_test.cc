@@ -15,7 +15,9 @@ limitations under the License.
 
 #include "tensorflow/lite/kernels/eigen_support.h"
 
+#include <thread>  // NOLINT(build/c++11)
 #include <utility>
+#include <vector>
 
 #include <gtest/gtest.h>
 #include "tensorflow/lite/core/c/common.h"
@@ -150,6 +152,41 @@ TEST(EigenSupport, NumThreadsChanged) {
   DecrementUsageCounter(&context);
 }
 
+TEST(EigenSupport, SharedWithSmallerThreadBudget) {
+  TestTfLiteContext context;
+  context.recommended_num_threads = 4;
+  IncrementUsageCounter(&context);
+
+  // The context of a node run concurrently with others shares the Eigen
+  // context with a smaller thread count.
+  TestTfLiteContext worker_context;
+  worker_context.recommended_num_threads = 2;
+  worker_context.external_context = context.external_context;
+
+  std::vector<const EigenForTFLite::ThreadPoolDevice*> devices(4);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < static_cast<int>(devices.size()); ++i) {
+    threads.emplace_back([&, i]() {
+      devices[i] = GetThreadPoolDevice(i % 2 ? &worker_context : &context);
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+
+  ASSERT_NE(devices[0], nullptr);
+  ASSERT_NE(devices[1], nullptr);
+  EXPECT_EQ(devices[0], devices[2]);
+  EXPECT_EQ(devices[1], devices[3]);
+  EXPECT_EQ(devices[0]->numThreads(), 4);
+  EXPECT_EQ(devices[1]->numThreads(), 2);
+  EXPECT_EQ(devices[1]->numThreadsInPool(), 4);
+
+  // The budget can't exceed the threads of the pool.
+  worker_context.recommended_num_threads = 8;
+  EXPECT_EQ(GetThreadPoolDevice(&worker_context)->numThreads(), 4);
+
+  DecrementUsageCounter(&context);
+}
+
 TEST(EigenSupport, RefCounting) {
   TestTfLiteContext context;
   EXPECT_EQ(context.external_context, nullptr);
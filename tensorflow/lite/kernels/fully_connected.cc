@@ -24,6 +24,7 @@ limitations under the License.
 #include "tensorflow/lite/core/c/common.h"
 #include "tensorflow/lite/kernels/cpu_backend_context.h"
 #include "tensorflow/lite/kernels/internal/optimized/optimized_ops.h"
+#include "tensorflow/lite/kernels/internal/optimized/packed_int4_fully_connected.h"
 #include "tensorflow/lite/kernels/internal/optimized/sparse_ops/fully_connected.h"
 #include "tensorflow/lite/kernels/internal/quantization_util.h"
 #include "tensorflow/lite/kernels/internal/reference/fully_connected.h"
@@ -122,6 +123,16 @@ struct OpData {
   bool compute_row_sums = false;
   // Only used for sparse hybrid fully connected kernels.
   bool ledger_initialized;
+  // Only used for float inputs with dense int4 weights: the scales of the
+  // blocks of `int4_block_size` values of each unit. The weights are
+  // dequantized on the fly if `use_packed_int4`, and otherwise unpacked for the
+  // hybrid kernels.
+  bool use_packed_int4 = false;
+  std::vector<float> int4_scales;
+  int int4_block_size;
+  // Only used for dense int4 weights on the hybrid kernels: whether the
+  // constant weights have already been unpacked into their temporary.
+  bool int4_filter_unpacked = false;
 };
 
 constexpr int kInputTensor = 0;
@@ -260,6 +271,30 @@ TfLiteStatus PrepareImpl(TfLiteContext* context, TfLiteNode* node) {
     TF_LITE_ENSURE_EQ(context, NumElements(bias), SizeOfDimension(filter, 0));
   }
 
+  // Float inputs with dense int4 weights are multiplied by the packed weights
+  // when the values of each block start on a byte boundary. Otherwise they go
+  // through the hybrid kernels, which only support a scale per tensor or unit.
+  data->use_packed_int4 = false;
+  if (input->type == kTfLiteFloat32 && filter->type == kTfLiteInt4 &&
+      filter->sparsity == nullptr) {
+    const int accum_depth = filter->dims->data[1];
+    TF_LITE_ENSURE_STATUS(GetInt4WeightsBlockSize(
+        context, filter, /*units_dimension=*/0, num_units, accum_depth,
+        &data->int4_block_size));
+    data->use_packed_int4 = data->int4_block_size % 2 == 0;
+    if (!data->use_packed_int4) {
+      TF_LITE_ENSURE_EQ(context, data->int4_block_size, accum_depth);
+    }
+    const TfLiteFloatArray* filter_scales =
+        reinterpret_cast<TfLiteAffineQuantization*>(filter->quantization.params)
+            ->scale;
+    data->int4_scales.assign(filter_scales->data,
+                             filter_scales->data + filter_scales->size);
+    if (filter_scales->size == 1) {
+      data->int4_scales.resize(num_units, filter_scales->data[0]);
+    }
+  }
+
   // Note that quantized inference requires that all tensors have their
   // parameters set. This is usually done during quantized training.
   if (input->type == kTfLiteUInt8 || input->type == kTfLiteInt8 ||
@@ -334,14 +369,19 @@ TfLiteStatus PrepareImpl(TfLiteContext* context, TfLiteNode* node) {
   // buffer to store the intermediate quantized values.
   // Additionally, we allocate a temporary buffer to store the accumulated
   // quantized values prior to multiplication by the scaling factor.
+  // Dense int4 weights that can't be multiplied packed are unpacked to int8
+  // once, into a persistent temporary, and then take the int8 path.
+  const bool is_sparse = filter->sparsity != nullptr;
+  const bool is_unpacked_int4 = filter->type == kTfLiteInt4 &&
+                                !data->use_packed_int4 && !is_sparse;
   const bool is_hybrid =
       (input->type == kTfLiteFloat32 &&
-       (filter->type == kTfLiteUInt8 || filter->type == kTfLiteInt8));
-  const bool is_sparse = filter->sparsity != nullptr;
+       (filter->type == kTfLiteUInt8 || filter->type == kTfLiteInt8 ||
+        is_unpacked_int4));
   if (is_hybrid) {
     TfLiteIntArrayFree(node->temporaries);
     data->compute_row_sums = true;
-    if (is_sparse) {
+    if (is_sparse || is_unpacked_int4) {
       node->temporaries = TfLiteIntArrayCreate(6);
     } else {
       node->temporaries = TfLiteIntArrayCreate(5);
@@ -351,7 +391,7 @@ TfLiteStatus PrepareImpl(TfLiteContext* context, TfLiteNode* node) {
     TfLiteTensor* input_quantized;
     TF_LITE_ENSURE_OK(context, GetTemporarySafe(context, node, /*index=*/0,
                                                 &input_quantized));
-    input_quantized->type = filter->type;
+    input_quantized->type = is_unpacked_int4 ? kTfLiteInt8 : filter->type;
     input_quantized->allocation_type = kTfLiteArenaRw;
 
     TfLiteIntArray* input_quantized_size = TfLiteIntArrayCopy(input->dims);
@@ -424,6 +464,21 @@ TfLiteStatus PrepareImpl(TfLiteContext* context, TfLiteNode* node) {
           CreateLedgerTensor(filter->sparsity, context, filter_ledger);
       if (status != kTfLiteOk) return status;
     }
+
+    if (is_unpacked_int4) {
+      data->int4_filter_unpacked = false;
+      node->temporaries->data[5] = data->scratch_tensor_index + 5;
+      TfLiteTensor* unpacked_filter;
+      TF_LITE_ENSURE_OK(context, GetTemporarySafe(context, node, /*index=*/5,
+                                                  &unpacked_filter));
+      unpacked_filter->type = kTfLiteInt8;
+      unpacked_filter->allocation_type = kTfLiteArenaRwPersistent;
+      if (!TfLiteIntArrayEqual(unpacked_filter->dims, filter->dims)) {
+        TF_LITE_ENSURE_OK(
+            context, context->ResizeTensor(context, unpacked_filter,
+                                           TfLiteIntArrayCopy(filter->dims)));
+      }
+    }
   }
 
   // Resize output.
@@ -559,16 +614,34 @@ TfLiteStatus EvalHybridDense(
   tensor_utils::BatchQuantizeFloats(
       input_ptr, batch_size, input_size, quant_data, scaling_factors_ptr,
       input_offset_ptr, params->asymmetric_quantize_inputs);
-  for (int b = 0; b < batch_size; ++b) {
-    // Incorporate scaling of the filter.
-    scaling_factors_ptr[b] *= filter->params.scale;
+
+  // Int4 weights are unpacked to int8, once if they are constant, and scaled
+  // per unit.
+  const float* per_channel_scale = nullptr;
+  if (filter->type == kTfLiteInt4) {
+    TfLiteTensor* unpacked_filter;
+    TF_LITE_ENSURE_OK(context, GetTemporarySafe(context, node, /*index=*/5,
+                                                &unpacked_filter));
+    if (!data->int4_filter_unpacked) {
+      tensor_utils::UnpackDenseInt4IntoInt8(
+          filter_data, num_units * input_size,
+          GetTensorData<int8_t>(unpacked_filter));
+      data->int4_filter_unpacked = IsConstantTensor(filter);
+    }
+    filter_data = GetTensorData<int8_t>(unpacked_filter);
+    per_channel_scale = data->int4_scales.data();
+  } else {
+    for (int b = 0; b < batch_size; ++b) {
+      // Incorporate scaling of the filter.
+      scaling_factors_ptr[b] *= filter->params.scale;
+    }
   }
 
   // Compute output += weight * quantized_input
   int32_t* scratch = GetTensorData<int32_t>(accum_scratch);
   tensor_utils::MatrixBatchVectorMultiplyAccumulate(
       filter_data, num_units, input_size, quant_data, scaling_factors_ptr,
-      batch_size, GetTensorData<float>(output), /*per_channel_scale=*/nullptr,
+      batch_size, GetTensorData<float>(output), per_channel_scale,
       input_offset_ptr, scratch, row_sums_ptr, &data->compute_row_sums,
       CpuBackendContext::GetFromContext(context));
 
@@ -790,6 +863,39 @@ TfLiteStatus EvalHybrid(TfLiteContext* context, TfLiteNode* node,
   return kTfLiteOk;
 }
 
+// Float inputs with int4 weights, dequantized on the fly. Unlike the hybrid
+// kernels, the inputs are not quantized.
+TfLiteStatus EvalPackedInt4(TfLiteContext* context,
+                            TfLiteFullyConnectedParams* params, OpData* data,
+                            const TfLiteTensor* input,
+                            const TfLiteTensor* filter,
+                            const TfLiteTensor* bias, TfLiteTensor* output) {
+  const int input_size = filter->dims->data[1];
+  const int batch_size = NumElements(input) / input_size;
+  const int num_units = filter->dims->data[0];
+
+  // Output = bias if bias tensor exists.
+  if (bias) {
+    tensor_utils::VectorBatchVectorAssign(GetTensorData<float>(bias), num_units,
+                                          batch_size,
+                                          GetTensorData<float>(output));
+  } else {
+    std::fill_n(GetTensorData<float>(output), batch_size * num_units, 0.0f);
+  }
+
+  optimized_ops::PackedInt4FullyConnectedAccumulate(
+      GetTensorData<float>(input), batch_size, input_size,
+      GetTensorData<int8_t>(filter), num_units, data->int4_scales.data(),
+      data->int4_block_size, GetTensorData<float>(output),
+      CpuBackendContext::GetFromContext(context));
+
+  // Apply activation function to floats.
+  tensor_utils::ApplyActivationToVector(
+      GetTensorData<float>(output), batch_size * num_units, params->activation,
+      GetTensorData<float>(output));
+  return kTfLiteOk;
+}
+
 namespace {
 template <KernelType kernel_type>
 void FullyConnectedInt8(const OpData* data, const TfLiteTensor* input,
@@ -1329,7 +1435,12 @@ TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
         return kTfLiteError;
       }
     case kTfLiteInt4:
-      if (params->weights_format == kTfLiteFullyConnectedWeightsFormatDefault) {
+      if (params->weights_format == kTfLiteFullyConnectedWeightsFormatDefault &&
+          data->use_packed_int4) {
+        return EvalPackedInt4(context, params, data, input, filter, bias,
+                              output);
+      } else if (params->weights_format ==
+                 kTfLiteFullyConnectedWeightsFormatDefault) {
         return EvalQuantized<kernel_type>(context, node, params, data, input,
                                           filter, bias, output);
       } else {
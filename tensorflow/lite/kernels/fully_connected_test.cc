@@ -473,6 +473,63 @@ class HybridFullyConnectedOpModel : public SingleOpModel {
   int input_size_;
 };
 
+// Float inputs and outputs with int4 weights, whose `scales` are either one
+// per unit or, for blockwise quantization, `scales.size() / units` per unit.
+class PackedInt4FullyConnectedOpModel : public SingleOpModel {
+ public:
+  PackedInt4FullyConnectedOpModel(TfLiteRegistration* registration, int units,
+                                  int batches, const TensorData& input,
+                                  const std::vector<float>& scales)
+      : batches_(batches), units_(units) {
+    int total_input_size = 1;
+    for (size_t i = 0; i < input.shape.size(); ++i) {
+      total_input_size *= input.shape[i];
+    }
+    input_size_ = total_input_size / batches_;
+
+    input_ = AddInput(input);
+    weights_ = AddInput({TensorType_INT4,
+                         {units_, input_size_},
+                         0,
+                         0,
+                         0,
+                         0,
+                         true,
+                         scales,
+                         std::vector<int64_t>(scales.size(), 0),
+                         0});
+    bias_ = AddInput({TensorType_FLOAT32, {units_}});
+    output_ = AddOutput({TensorType_FLOAT32});
+
+    SetBuiltinOp(BuiltinOperator_FULLY_CONNECTED,
+                 BuiltinOptions_FullyConnectedOptions,
+                 CreateFullyConnectedOptions(builder_,
+                                             ActivationFunctionType_RELU)
+                     .Union());
+    resolver_ = std::make_unique<SingleOpResolver>(
+        BuiltinOperator_FULLY_CONNECTED, registration);
+    BuildInterpreter({GetShape(input_), GetShape(weights_), GetShape(bias_)});
+  }
+  void SetBias(const std::vector<float>& f) { PopulateTensor(bias_, f); }
+  void SetWeights(std::vector<int8_t> values) {
+    PopulateTensor4bit(weights_, /*offset=*/0, values.data(),
+                       values.data() + values.size());
+  }
+  void SetInput(const std::vector<float>& f) { PopulateTensor(input_, f); }
+  std::vector<float> GetOutput() { return ExtractVector<float>(output_); }
+  std::vector<int> GetOutputShape() { return GetTensorShape(output_); }
+
+ protected:
+  int input_;
+  int weights_;
+  int bias_;
+  int output_;
+
+  int batches_;
+  int units_;
+  int input_size_;
+};
+
 const auto kKernelMap = new std::map<string, TfLiteRegistration*>({
     {"Reference", ops::builtin::Register_FULLY_CONNECTED_REF()},
     {"GenericOptimized", ops::builtin::Register_FULLY_CONNECTED_GENERIC_OPT()},
@@ -739,6 +796,89 @@ TEST_P(QuantizedFullyConnectedOpTest, SimpleTestQuantizedInt4) {
   EXPECT_THAT(m.GetOutput<int8_t>(), ElementsAre(63, 63, 67, 81, 81, 86));
 }
 
+TEST_P(FloatFullyConnectedOpTest, SimpleTestPackedInt4Weights) {
+  PackedInt4FullyConnectedOpModel m(GetRegistration(), /*units=*/3,
+                                    /*batches=*/2,
+                                    /*input=*/{TensorType_FLOAT32, {2, 8}},
+                                    /*scales=*/{0.5, 1, 2});
+  m.SetWeights({
+      1,  2,  3,  4,  5, 6,  7, -8,  // u = 0
+      -1, -2, -3, -4, 5, 6,  7, 0,   // u = 1
+      7,  -7, 1,  -1, 2, -2, 3, -3,  // u = 2
+  });
+  m.SetBias({1, 2, 3});
+
+  m.SetInput({
+      1, 2,  3, 4,  5, 6,  7, 8,   // b = 0
+      1, -1, 1, -1, 1, -1, 1, -1,  // b = 1
+  });
+
+  ASSERT_EQ(m.Invoke(), kTfLiteOk);
+  EXPECT_THAT(m.GetOutputShape(), ElementsAre(2, 3));
+  EXPECT_THAT(m.GetOutput(),
+              ElementsAreArray(ArrayFloatNear({39, 82, 0, 7, 10, 55})));
+}
+
+TEST_P(FloatFullyConnectedOpTest, SimpleTestBlockwisePackedInt4Weights) {
+  // Two blocks of 4 values per unit.
+  PackedInt4FullyConnectedOpModel m(
+      GetRegistration(), /*units=*/3, /*batches=*/2,
+      /*input=*/{TensorType_FLOAT32, {2, 8}},
+      /*scales=*/{0.5, 0.25, 1, 2, 0.125, 1.5});
+  m.SetWeights({
+      1,  2,  3,  4,  5, 6,  7, -8,  // u = 0
+      -1, -2, -3, -4, 5, 6,  7, 0,   // u = 1
+      7,  -7, 1,  -1, 2, -2, 3, -3,  // u = 2
+  });
+  m.SetBias({1, 2, 3});
+
+  m.SetInput({
+      1, 2,  3, 4,  5, 6,  7, 8,   // b = 0
+      1, -1, 1, -1, 1, -1, 1, -1,  // b = 1
+  });
+
+  ASSERT_EQ(m.Invoke(), kTfLiteOk);
+  EXPECT_THAT(m.GetOutputShape(), ElementsAre(2, 3));
+  EXPECT_THAT(m.GetOutput(),
+              ElementsAreArray(ArrayFloatNear({27.5, 192, 0, 3.5, 16, 20})));
+}
+
+TEST_P(FloatFullyConnectedOpTest, SimpleTestInt4WeightsWithOddInputDepth) {
+  // The rows of the packed weights don't start on a byte boundary, so the
+  // inputs are quantized by the hybrid kernels instead.
+  PackedInt4FullyConnectedOpModel m(GetRegistration(), /*units=*/3,
+                                    /*batches=*/2,
+                                    /*input=*/{TensorType_FLOAT32, {2, 5}},
+                                    /*scales=*/{0.5, 1, 2});
+  m.SetWeights({
+      1,  2,  3,  4,  5,  // u = 0
+      -1, -2, -3, -4, 7,  // u = 1
+      7,  -7, 1,  -1, 2,  // u = 2
+  });
+  m.SetBias({1, 2, 3});
+
+  m.SetInput({
+      1, 2,  3, 4,  5,  // b = 0
+      1, -1, 1, -1, 1,  // b = 1
+  });
+
+  ASSERT_EQ(m.Invoke(), kTfLiteOk);
+  EXPECT_THAT(m.GetOutputShape(), ElementsAre(2, 3));
+  EXPECT_THAT(m.GetOutput(),
+              ElementsAreArray(ArrayFloatNear({28.5, 7, 7, 2.5, 11, 39},
+                                              /*max_abs_error=*/0.5)));
+
+  // The weights unpacked by the first invocation are reused.
+  m.SetInput({
+      2, 4,  6, 8,  10,  // b = 0
+      2, -2, 2, -2, 2,   // b = 1
+  });
+  ASSERT_EQ(m.Invoke(), kTfLiteOk);
+  EXPECT_THAT(m.GetOutput(),
+              ElementsAreArray(ArrayFloatNear({56, 12, 11, 4, 20, 75},
+                                              /*max_abs_error=*/1)));
+}
+
 TEST_P(QuantizedFullyConnectedOpTest, SimpleTestQuantizedInt8) {
   QuantizedFullyConnectedOpModel m(
       GetRegistration(), /*units=*/3, /*batches*/ 2,
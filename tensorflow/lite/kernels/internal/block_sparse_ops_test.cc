@@ -0,0 +1,599 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "benchmark/benchmark.h"  // from @com_google_benchmark
+#include "tensorflow/lite/core/c/common.h"
+#include "tensorflow/lite/kernels/cpu_backend_context.h"
+#include "tensorflow/lite/kernels/internal/common.h"
+#include "tensorflow/lite/kernels/internal/optimized/batch_matmul.h"
+#include "tensorflow/lite/kernels/internal/optimized/optimized_ops.h"
+#include "tensorflow/lite/kernels/internal/optimized/sparse_ops/batch_matmul.h"
+#include "tensorflow/lite/kernels/internal/optimized/sparse_ops/block_sparse_matrix.h"
+#include "tensorflow/lite/kernels/internal/optimized/sparse_ops/conv.h"
+#include "tensorflow/lite/kernels/internal/optimized/sparse_ops/depthwise_conv.h"
+#include "tensorflow/lite/kernels/internal/reference/conv.h"
+#include "tensorflow/lite/kernels/internal/reference/depthwiseconv_float.h"
+#include "tensorflow/lite/kernels/internal/reference/integer_ops/conv.h"
+#include "tensorflow/lite/kernels/internal/reference/integer_ops/depthwise_conv.h"
+#include "tensorflow/lite/kernels/internal/test_util.h"
+#include "tensorflow/lite/kernels/internal/types.h"
+#include "tensorflow/lite/kernels/internal/utils/sparsity_format_converter.h"
+
+namespace tflite {
+namespace {
+
+using ::testing::ElementsAreArray;
+using ::testing::FloatNear;
+using ::testing::Pointwise;
+
+struct BlockShape {
+  int rows;
+  int cols;
+};
+
+// Returns the values of a [rows, cols] matrix, where value (i, j) is at
+// i * row_stride + j * col_stride, whose blocks of `block` are all zero with
+// probability `sparsity`.
+template <typename T>
+std::vector<T> RandomBlockSparseData(int rows, int cols, int row_stride,
+                                     int col_stride, BlockShape block,
+                                     float sparsity, T min, T max) {
+  std::vector<T> data(rows * cols);
+  FillRandom(&data, min, max);
+  for (int i0 = 0; i0 < rows; i0 += block.rows) {
+    for (int j0 = 0; j0 < cols; j0 += block.cols) {
+      if (UniformRandomFloat(0.0f, 1.0f) >= sparsity) continue;
+      for (int i = i0; i < std::min(rows, i0 + block.rows); ++i) {
+        for (int j = j0; j < std::min(cols, j0 + block.cols); ++j) {
+          data[i * row_stride + j * col_stride] = T(0);
+        }
+      }
+    }
+  }
+  return data;
+}
+
+ConvParams GetConvParams(int stride, int dilation, int padding) {
+  ConvParams params;
+  params.padding_type = PaddingType::kSame;
+  params.padding_values.width = padding;
+  params.padding_values.height = padding;
+  params.stride_width = stride;
+  params.stride_height = stride;
+  params.dilation_width_factor = dilation;
+  params.dilation_height_factor = dilation;
+  params.float_activation_min = -6.0f;
+  params.float_activation_max = 6.0f;
+  params.input_offset = 3;
+  params.weights_offset = 0;
+  params.output_offset = -2;
+  params.quantized_activation_min = -128;
+  params.quantized_activation_max = 127;
+  return params;
+}
+
+// 1x1 blocks are plain unstructured sparsity, 3x5 blocks don't divide the
+// weights and fall back to 1x1 blocks.
+const BlockShape kBlockShapes[] = {{1, 1}, {1, 4}, {1, 16}, {4, 4},
+                                   {16, 1}, {2, 8}, {3, 5}};
+
+// The sparsity of a tensor compressed by FormatConverter, with the last
+// dimension in CSR format and blocks of `block_size` along the dimensions of
+// `block_map`.
+class TensorSparsity {
+ public:
+  template <typename T>
+  TensorSparsity(const std::vector<T>& dense, const std::vector<int>& shape,
+                 const std::vector<int>& block_size,
+                 const std::vector<int>& block_map, std::vector<T>* data) {
+    const int rank = shape.size();
+    std::vector<int> traversal_order(rank + block_map.size());
+    for (int i = 0; i < traversal_order.size(); ++i) traversal_order[i] = i;
+    std::vector<TfLiteDimensionType> format(rank, kTfLiteDimDense);
+    format[rank - 1] = kTfLiteDimSparseCSR;
+    internal::sparsity::FormatConverter<T> converter(
+        shape, traversal_order, format, block_size, block_map);
+    converter.DenseToSparse(dense.data());
+    *data = converter.GetData();
+
+    const std::vector<std::vector<int>>& metadata = converter.GetDimMetadata();
+    dim_metadata_.resize(traversal_order.size());
+    for (int i = 0; i < traversal_order.size(); ++i) {
+      TfLiteDimensionMetadata& dim = dim_metadata_[i];
+      dim = {};
+      if (i < rank && format[i] == kTfLiteDimSparseCSR) {
+        dim.format = kTfLiteDimSparseCSR;
+        dim.array_segments = IntArray(metadata[2 * i]);
+        dim.array_indices = IntArray(metadata[2 * i + 1]);
+      } else {
+        dim.format = kTfLiteDimDense;
+        dim.dense_size = metadata[2 * i][0];
+      }
+    }
+    sparsity_ = {};
+    sparsity_.traversal_order = IntArray(traversal_order);
+    sparsity_.block_map = IntArray(block_map);
+    sparsity_.dim_metadata = dim_metadata_.data();
+    sparsity_.dim_metadata_size = dim_metadata_.size();
+  }
+
+  ~TensorSparsity() {
+    for (TfLiteIntArray* array : arrays_) TfLiteIntArrayFree(array);
+  }
+
+  const TfLiteSparsity& sparsity() const { return sparsity_; }
+
+ private:
+  TfLiteIntArray* IntArray(const std::vector<int>& values) {
+    TfLiteIntArray* array = TfLiteIntArrayCreate(values.size());
+    std::copy(values.begin(), values.end(), array->data);
+    arrays_.push_back(array);
+    return array;
+  }
+
+  std::vector<TfLiteIntArray*> arrays_;
+  std::vector<TfLiteDimensionMetadata> dim_metadata_;
+  TfLiteSparsity sparsity_;
+};
+
+template <typename T>
+void ExpectSameMatrix(const optimized_ops::BlockSparseMatrix<T>& matrix,
+                      const optimized_ops::BlockSparseMatrix<T>& expected) {
+  EXPECT_EQ(matrix.rows, expected.rows);
+  EXPECT_EQ(matrix.cols, expected.cols);
+  EXPECT_EQ(matrix.block_rows, expected.block_rows);
+  EXPECT_EQ(matrix.block_cols, expected.block_cols);
+  EXPECT_THAT(matrix.segments, ElementsAreArray(expected.segments));
+  EXPECT_THAT(matrix.indices, ElementsAreArray(expected.indices));
+  EXPECT_THAT(matrix.values, ElementsAreArray(expected.values));
+  EXPECT_THAT(matrix.row_sums, ElementsAreArray(expected.row_sums));
+}
+
+class BlockSparseMatrixTest : public ::testing::TestWithParam<BlockShape> {};
+
+// The matrix populated from a sparse Conv filter is the one populated from the
+// dense filter, with the blocks of the sparse filter when they fit.
+TEST_P(BlockSparseMatrixTest, PopulatedFromSparseConvFilter) {
+  const BlockShape block = GetParam();
+  const int depth = 3 * 3 * 16;
+  const std::vector<int8_t> filter = RandomBlockSparseData<int8_t>(
+      32, depth, depth, 1, block, /*sparsity=*/0.7f, -127, 127);
+  // The converter only supports blocks that divide the tensor.
+  if (32 % block.rows != 0 || 16 % block.cols != 0) return;
+  std::vector<int8_t> data;
+  const TensorSparsity tensor_sparsity(filter, {32, 3, 3, 16},
+                                       {block.rows, block.cols}, {0, 3},
+                                       &data);
+
+  optimized_ops::BlockSparseMatrix<int8_t> expected;
+  optimized_ops::PopulateBlockSparseMatrix(filter.data(), 32, depth, depth, 1,
+                                           block.rows, block.cols, &expected);
+  optimized_ops::BlockSparseMatrix<int8_t> matrix;
+  optimized_ops::PopulateBlockSparseMatrix(
+      tensor_sparsity.sparsity(), RuntimeShape({32, 3, 3, 16}), data.data(),
+      32, depth, depth, 1,
+      optimized_ops::GetSparsityBlockSize(tensor_sparsity.sparsity(), 4, 0),
+      optimized_ops::GetSparsityBlockSize(tensor_sparsity.sparsity(), 4, 3),
+      &matrix);
+  ExpectSameMatrix(matrix, expected);
+}
+
+// Same as above for the transposed view of a [accum_depth, num_units]
+// BatchMatMul RHS.
+TEST_P(BlockSparseMatrixTest, PopulatedFromSparseTransposedRhs) {
+  const BlockShape block = GetParam();
+  const int accum_depth = 64;
+  const int num_units = 48;
+  const std::vector<float> rhs = RandomBlockSparseData<float>(
+      num_units, accum_depth, 1, num_units, block, /*sparsity=*/0.8f, -1.0f,
+      1.0f);
+  if (accum_depth % block.cols != 0 || num_units % block.rows != 0) return;
+  std::vector<float> data;
+  const TensorSparsity tensor_sparsity(rhs, {accum_depth, num_units},
+                                       {block.cols, block.rows}, {0, 1},
+                                       &data);
+
+  optimized_ops::BlockSparseMatrix<float> expected;
+  optimized_ops::PopulateBlockSparseMatrix(rhs.data(), num_units, accum_depth,
+                                           1, num_units, block.rows,
+                                           block.cols, &expected);
+  optimized_ops::BlockSparseMatrix<float> matrix;
+  optimized_ops::PopulateBlockSparseMatrix(
+      tensor_sparsity.sparsity(), RuntimeShape({accum_depth, num_units}),
+      data.data(), num_units, accum_depth, 1, num_units,
+      optimized_ops::GetSparsityBlockSize(tensor_sparsity.sparsity(), 2, 1),
+      optimized_ops::GetSparsityBlockSize(tensor_sparsity.sparsity(), 2, 0),
+      &matrix);
+  ExpectSameMatrix(matrix, expected);
+}
+
+INSTANTIATE_TEST_SUITE_P(BlockSparseMatrixTest, BlockSparseMatrixTest,
+                         ::testing::ValuesIn(kBlockShapes));
+
+class BlockSparseConvTest : public ::testing::TestWithParam<BlockShape> {};
+
+TEST_P(BlockSparseConvTest, FloatMatchesReference) {
+  const BlockShape block = GetParam();
+  const RuntimeShape input_shape({2, 9, 7, 16});
+  const RuntimeShape filter_shape({32, 3, 3, 16});
+  const RuntimeShape bias_shape({32});
+  const RuntimeShape output_shape({2, 5, 4, 32});
+  const ConvParams params =
+      GetConvParams(/*stride=*/2, /*dilation=*/1, /*padding=*/1);
+  const int depth = 3 * 3 * 16;
+
+  std::vector<float> input(input_shape.FlatSize());
+  FillRandom(&input, -1.0f, 1.0f);
+  std::vector<float> bias(32);
+  FillRandom(&bias, -1.0f, 1.0f);
+  const std::vector<float> filter = RandomBlockSparseData<float>(
+      32, depth, depth, 1, block, /*sparsity=*/0.7f, -0.5f, 0.5f);
+  optimized_ops::BlockSparseMatrix<float> sparse_filter;
+  optimized_ops::PopulateBlockSparseMatrix(filter.data(), 32, depth, depth, 1,
+                                           block.rows, block.cols,
+                                           &sparse_filter);
+
+  std::vector<float> expected(output_shape.FlatSize());
+  reference_ops::Conv(params, input_shape, input.data(), filter_shape,
+                      filter.data(), bias_shape, bias.data(), output_shape,
+                      expected.data(), RuntimeShape(), nullptr);
+  std::vector<float> output(output_shape.FlatSize());
+  CpuBackendContext context;
+  context.SetMaxNumThreads(4);
+  optimized_ops::ConvSparseWeight(params, input_shape, input.data(),
+                                  filter_shape, sparse_filter, bias_shape,
+                                  bias.data(), output_shape, output.data(),
+                                  &context);
+
+  EXPECT_THAT(output, Pointwise(FloatNear(1e-4), expected));
+}
+
+TEST_P(BlockSparseConvTest, Int8MatchesReference) {
+  const BlockShape block = GetParam();
+  const RuntimeShape input_shape({2, 8, 8, 16});
+  const RuntimeShape filter_shape({32, 3, 3, 16});
+  const RuntimeShape bias_shape({32});
+  const RuntimeShape output_shape({2, 8, 8, 32});
+  const ConvParams params =
+      GetConvParams(/*stride=*/1, /*dilation=*/2, /*padding=*/2);
+  const int depth = 3 * 3 * 16;
+
+  std::vector<int8_t> input(input_shape.FlatSize());
+  FillRandom(&input);
+  std::vector<int32_t> bias(32);
+  FillRandom(&bias, -1000, 1000);
+  std::vector<int32_t> output_multiplier(32);
+  FillRandom(&output_multiplier, 1 << 30,
+             std::numeric_limits<int32_t>::max());
+  std::vector<int32_t> output_shift(32);
+  FillRandom(&output_shift, -9, -6);
+  const std::vector<int8_t> filter = RandomBlockSparseData<int8_t>(
+      32, depth, depth, 1, block, /*sparsity=*/0.7f, -127, 127);
+  optimized_ops::BlockSparseMatrix<int8_t> sparse_filter;
+  optimized_ops::PopulateBlockSparseMatrix(filter.data(), 32, depth, depth, 1,
+                                           block.rows, block.cols,
+                                           &sparse_filter);
+
+  std::vector<int8_t> expected(output_shape.FlatSize());
+  reference_integer_ops::ConvPerChannel(
+      params, output_multiplier.data(), output_shift.data(), input_shape,
+      input.data(), filter_shape, filter.data(), bias_shape, bias.data(),
+      output_shape, expected.data());
+  std::vector<int8_t> output(output_shape.FlatSize());
+  CpuBackendContext context;
+  context.SetMaxNumThreads(4);
+  optimized_ops::ConvPerChannelSparseWeight(
+      params, output_multiplier.data(), output_shift.data(), input_shape,
+      input.data(), filter_shape, sparse_filter, bias_shape, bias.data(),
+      output_shape, output.data(), &context);
+
+  EXPECT_THAT(output, ElementsAreArray(expected));
+}
+
+INSTANTIATE_TEST_SUITE_P(BlockSparseConvTest, BlockSparseConvTest,
+                         ::testing::ValuesIn(kBlockShapes));
+
+// Checks the DepthwiseConv kernels with a filter of 32 output channels.
+void TestBlockSparseDepthwiseConv(BlockShape block, int depth_multiplier) {
+  const RuntimeShape input_shape({2, 9, 9, 32 / depth_multiplier});
+  const RuntimeShape filter_shape({1, 3, 3, 32});
+  const RuntimeShape bias_shape({32});
+  const RuntimeShape output_shape({2, 9, 9, 32});
+  DepthwiseParams params;
+  params.padding_type = PaddingType::kSame;
+  params.padding_values.width = 1;
+  params.padding_values.height = 1;
+  params.stride_width = 1;
+  params.stride_height = 1;
+  params.dilation_width_factor = 1;
+  params.dilation_height_factor = 1;
+  params.depth_multiplier = depth_multiplier;
+  params.float_activation_min = -6.0f;
+  params.float_activation_max = 6.0f;
+  params.input_offset = -5;
+  params.weights_offset = 0;
+  params.output_offset = 4;
+  params.quantized_activation_min = -128;
+  params.quantized_activation_max = 127;
+  CpuBackendContext context;
+  context.SetMaxNumThreads(4);
+
+  // The filter matrix is [output_depth, filter_height * filter_width], with
+  // blocks along the output depth only.
+  const BlockShape filter_block = {block.rows, 1};
+  const std::vector<int8_t> filter = RandomBlockSparseData<int8_t>(
+      32, 9, 1, 32, filter_block, /*sparsity=*/0.6f, -127, 127);
+  optimized_ops::BlockSparseMatrix<int8_t> sparse_filter;
+  optimized_ops::PopulateBlockSparseMatrix(filter.data(), 32, 9, 1, 32,
+                                           block.rows, 1, &sparse_filter);
+  const std::vector<float> float_filter(filter.begin(), filter.end());
+  optimized_ops::BlockSparseMatrix<float> sparse_float_filter;
+  optimized_ops::PopulateBlockSparseMatrix(float_filter.data(), 32, 9, 1, 32,
+                                           block.rows, 1,
+                                           &sparse_float_filter);
+
+  std::vector<float> float_input(input_shape.FlatSize());
+  FillRandom(&float_input, -0.01f, 0.01f);
+  std::vector<float> float_bias(32);
+  FillRandom(&float_bias, -1.0f, 1.0f);
+  std::vector<float> float_expected(output_shape.FlatSize());
+  reference_ops::DepthwiseConv(params, input_shape, float_input.data(),
+                               filter_shape, float_filter.data(), bias_shape,
+                               float_bias.data(), output_shape,
+                               float_expected.data());
+  std::vector<float> float_output(output_shape.FlatSize());
+  optimized_ops::DepthwiseConvSparseWeight(
+      params, input_shape, float_input.data(), filter_shape,
+      sparse_float_filter, bias_shape, float_bias.data(), output_shape,
+      float_output.data(), &context);
+  EXPECT_THAT(float_output, Pointwise(FloatNear(1e-4), float_expected));
+
+  std::vector<int8_t> input(input_shape.FlatSize());
+  FillRandom(&input);
+  std::vector<int32_t> bias(32);
+  FillRandom(&bias, -1000, 1000);
+  std::vector<int32_t> output_multiplier(32);
+  FillRandom(&output_multiplier, 1 << 30,
+             std::numeric_limits<int32_t>::max());
+  std::vector<int32_t> output_shift(32);
+  FillRandom(&output_shift, -7, -4);
+  std::vector<int8_t> expected(output_shape.FlatSize());
+  reference_integer_ops::DepthwiseConvPerChannel(
+      params, output_multiplier.data(), output_shift.data(), input_shape,
+      input.data(), filter_shape, filter.data(), bias_shape, bias.data(),
+      output_shape, expected.data());
+  std::vector<int8_t> output(output_shape.FlatSize());
+  optimized_ops::DepthwiseConvPerChannelSparseWeight(
+      params, output_multiplier.data(), output_shift.data(), input_shape,
+      input.data(), filter_shape, sparse_filter, bias_shape, bias.data(),
+      output_shape, output.data(), &context);
+  EXPECT_THAT(output, ElementsAreArray(expected));
+}
+
+class BlockSparseDepthwiseConvTest
+    : public ::testing::TestWithParam<BlockShape> {};
+
+TEST_P(BlockSparseDepthwiseConvTest, MatchesReference) {
+  TestBlockSparseDepthwiseConv(GetParam(), /*depth_multiplier=*/2);
+}
+
+// Without depth multiplier, the blocks are applied to contiguous channels.
+TEST_P(BlockSparseDepthwiseConvTest, MatchesReferenceWithoutDepthMultiplier) {
+  TestBlockSparseDepthwiseConv(GetParam(), /*depth_multiplier=*/1);
+}
+
+INSTANTIATE_TEST_SUITE_P(BlockSparseDepthwiseConvTest,
+                         BlockSparseDepthwiseConvTest,
+                         ::testing::ValuesIn(kBlockShapes));
+
+class BlockSparseBatchMatMulTest
+    : public ::testing::TestWithParam<BlockShape> {};
+
+TEST_P(BlockSparseBatchMatMulTest, MatchesReference) {
+  const BlockShape block = GetParam();
+  const int rows = 37;
+  const int accum_depth = 64;
+  const int num_units = 48;
+  const RuntimeShape lhs_shape({1, rows, accum_depth});
+  const RuntimeShape output_shape({1, rows, num_units});
+  CpuBackendContext context;
+  context.SetMaxNumThreads(4);
+
+  // The RHS is [accum_depth, num_units], so its transpose has a row stride of
+  // 1 and a column stride of num_units.
+  const std::vector<int8_t> rhs = RandomBlockSparseData<int8_t>(
+      num_units, accum_depth, 1, num_units, block, /*sparsity=*/0.8f, -127,
+      127);
+  optimized_ops::BlockSparseMatrix<int8_t> sparse_rhs;
+  optimized_ops::PopulateBlockSparseMatrix(rhs.data(), num_units, accum_depth,
+                                           1, num_units, block.rows,
+                                           block.cols, &sparse_rhs);
+  const std::vector<float> float_rhs(rhs.begin(), rhs.end());
+  optimized_ops::BlockSparseMatrix<float> sparse_float_rhs;
+  optimized_ops::PopulateBlockSparseMatrix(
+      float_rhs.data(), num_units, accum_depth, 1, num_units, block.rows,
+      block.cols, &sparse_float_rhs);
+
+  std::vector<float> float_lhs(lhs_shape.FlatSize());
+  FillRandom(&float_lhs, -1.0f, 1.0f);
+  std::vector<int8_t> lhs(lhs_shape.FlatSize());
+  FillRandom(&lhs);
+  FullyConnectedParams params;
+  params.input_offset = 7;
+  params.weights_offset = 0;
+  params.output_offset = -1;
+  params.output_multiplier = 1 << 30;
+  params.output_shift = -8;
+  params.quantized_activation_min = -128;
+  params.quantized_activation_max = 127;
+
+  std::vector<float> float_expected(output_shape.FlatSize());
+  std::vector<int8_t> expected(output_shape.FlatSize());
+  for (int i = 0; i < rows; ++i) {
+    for (int n = 0; n < num_units; ++n) {
+      float float_acc = 0.0f;
+      int32_t acc = 0;
+      for (int k = 0; k < accum_depth; ++k) {
+        const int8_t w = rhs[k * num_units + n];
+        float_acc += w * float_lhs[i * accum_depth + k];
+        acc += w * (lhs[i * accum_depth + k] + params.input_offset);
+      }
+      float_expected[i * num_units + n] = float_acc;
+      acc = MultiplyByQuantizedMultiplier(acc, params.output_multiplier,
+                                          params.output_shift);
+      acc += params.output_offset;
+      acc = std::min(std::max(acc, params.quantized_activation_min),
+                     params.quantized_activation_max);
+      expected[i * num_units + n] = static_cast<int8_t>(acc);
+    }
+  }
+
+  std::vector<float> float_output(output_shape.FlatSize());
+  optimized_ops::BatchMatMulSparseRhs(lhs_shape, float_lhs.data(),
+                                      sparse_float_rhs, output_shape,
+                                      float_output.data(), &context);
+  EXPECT_THAT(float_output, Pointwise(FloatNear(1e-3), float_expected));
+  std::vector<int8_t> output(output_shape.FlatSize());
+  optimized_ops::BatchMatMulSparseRhs(params, lhs_shape, lhs.data(),
+                                      sparse_rhs, output_shape, output.data(),
+                                      &context);
+  EXPECT_THAT(output, ElementsAreArray(expected));
+}
+
+INSTANTIATE_TEST_SUITE_P(BlockSparseBatchMatMulTest,
+                         BlockSparseBatchMatMulTest,
+                         ::testing::ValuesIn(kBlockShapes));
+
+// Benchmarks of the block sparse kernels against the dense optimized kernels,
+// on a 3x3 Conv of 56x56x128 -> 56x56x128 and a BatchMatMul of 128x512 with
+// 512x512. Run with --benchmark_filter=all; the speedup at a given sparsity is
+// the ratio of the dense time to the sparse time with the same arguments. The
+// arguments are the percentage of zero blocks and the index of the block shape
+// in kBenchmarkBlockShapes.
+const BlockShape kBenchmarkBlockShapes[] = {{1, 4}, {4, 4}, {16, 1}};
+
+void SparsityArguments(benchmark::internal::Benchmark* b) {
+  for (int sparsity : {0, 50, 70, 80, 90, 95}) {
+    for (int block = 0; block < 3; ++block) {
+      b->Args({sparsity, block});
+    }
+  }
+}
+
+void BM_ConvDense(benchmark::State& state) {
+  const RuntimeShape input_shape({1, 56, 56, 128});
+  const RuntimeShape filter_shape({128, 3, 3, 128});
+  const RuntimeShape bias_shape({128});
+  const RuntimeShape output_shape({1, 56, 56, 128});
+  const RuntimeShape im2col_shape({1, 56, 56, 3 * 3 * 128});
+  const ConvParams params =
+      GetConvParams(/*stride=*/1, /*dilation=*/1, /*padding=*/1);
+  std::vector<float> input(input_shape.FlatSize());
+  FillRandom(&input, -1.0f, 1.0f);
+  std::vector<float> filter(filter_shape.FlatSize());
+  FillRandom(&filter, -1.0f, 1.0f);
+  std::vector<float> bias(128);
+  std::vector<float> output(output_shape.FlatSize());
+  std::vector<float> im2col(im2col_shape.FlatSize());
+  CpuBackendContext context;
+  context.SetMaxNumThreads(1);
+  for (auto _ : state) {
+    optimized_ops::Conv(params, input_shape, input.data(), filter_shape,
+                        filter.data(), bias_shape, bias.data(), output_shape,
+                        output.data(), im2col_shape, im2col.data(), &context);
+  }
+}
+BENCHMARK(BM_ConvDense);
+
+void BM_ConvBlockSparse(benchmark::State& state) {
+  const BlockShape block = kBenchmarkBlockShapes[state.range(1)];
+  const RuntimeShape input_shape({1, 56, 56, 128});
+  const RuntimeShape filter_shape({128, 3, 3, 128});
+  const RuntimeShape bias_shape({128});
+  const RuntimeShape output_shape({1, 56, 56, 128});
+  const ConvParams params =
+      GetConvParams(/*stride=*/1, /*dilation=*/1, /*padding=*/1);
+  const int depth = 3 * 3 * 128;
+  std::vector<float> input(input_shape.FlatSize());
+  FillRandom(&input, -1.0f, 1.0f);
+  const std::vector<float> filter = RandomBlockSparseData<float>(
+      128, depth, depth, 1, block, state.range(0) / 100.0f, -1.0f, 1.0f);
+  optimized_ops::BlockSparseMatrix<float> sparse_filter;
+  optimized_ops::PopulateBlockSparseMatrix(filter.data(), 128, depth, depth,
+                                           1, block.rows, block.cols,
+                                           &sparse_filter);
+  std::vector<float> bias(128);
+  std::vector<float> output(output_shape.FlatSize());
+  CpuBackendContext context;
+  context.SetMaxNumThreads(1);
+  for (auto _ : state) {
+    optimized_ops::ConvSparseWeight(params, input_shape, input.data(),
+                                    filter_shape, sparse_filter, bias_shape,
+                                    bias.data(), output_shape, output.data(),
+                                    &context);
+  }
+}
+BENCHMARK(BM_ConvBlockSparse)->Apply(SparsityArguments);
+
+void BM_BatchMatMulDense(benchmark::State& state) {
+  // As in the BatchMatMul op, the RHS and LHS are swapped, and the RHS is
+  // transposed.
+  const RuntimeShape lhs_shape({1, 512, 128});
+  const RuntimeShape rhs_shape({1, 512, 512});
+  const RuntimeShape output_shape({1, 128, 512});
+  std::vector<float> lhs(lhs_shape.FlatSize());
+  FillRandom(&lhs, -1.0f, 1.0f);
+  std::vector<float> rhs(rhs_shape.FlatSize());
+  FillRandom(&rhs, -1.0f, 1.0f);
+  std::vector<float> output(output_shape.FlatSize());
+  CpuBackendContext context;
+  context.SetMaxNumThreads(1);
+  for (auto _ : state) {
+    optimized_ops::BatchMatMul(rhs_shape, rhs.data(), lhs_shape, lhs.data(),
+                               output_shape, output.data(), &context);
+  }
+}
+BENCHMARK(BM_BatchMatMulDense);
+
+void BM_BatchMatMulBlockSparse(benchmark::State& state) {
+  const BlockShape block = kBenchmarkBlockShapes[state.range(1)];
+  const RuntimeShape lhs_shape({1, 128, 512});
+  const RuntimeShape output_shape({1, 128, 512});
+  std::vector<float> lhs(lhs_shape.FlatSize());
+  FillRandom(&lhs, -1.0f, 1.0f);
+  const std::vector<float> rhs = RandomBlockSparseData<float>(
+      512, 512, 512, 1, block, state.range(0) / 100.0f, -1.0f, 1.0f);
+  optimized_ops::BlockSparseMatrix<float> sparse_rhs;
+  optimized_ops::PopulateBlockSparseMatrix(rhs.data(), 512, 512, 512, 1,
+                                           block.rows, block.cols,
+                                           &sparse_rhs);
+  std::vector<float> output(output_shape.FlatSize());
+  CpuBackendContext context;
+  context.SetMaxNumThreads(1);
+  for (auto _ : state) {
+    optimized_ops::BatchMatMulSparseRhs(lhs_shape, lhs.data(), sparse_rhs,
+                                        output_shape, output.data(), &context);
+  }
+}
+BENCHMARK(BM_BatchMatMulBlockSparse)->Apply(SparsityArguments);
+
+}  // namespace
+}  // namespace tflite
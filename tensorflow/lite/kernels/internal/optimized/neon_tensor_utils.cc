@@ -258,6 +258,67 @@ void NeonMatrixBatchVectorMultiplyAccumulate(const float* matrix, int m_rows,
   }
 }
 
+void NeonPackedInt4MatrixBatchVectorMultiplyAccumulate(
+    const int8_t* __restrict__ packed_matrix, int m_rows, int m_cols,
+    const float* __restrict__ scales, int block_size,
+    const float* __restrict__ vectors, int n_batch,
+    float* __restrict__ result) {
+  const int num_blocks = m_cols / block_size;
+  // If block_size is not divisible by the number of int4 values unpacked at
+  // once, then we need to process the final few elements of each block
+  // sequentially. postamble_start shows the start index where this should
+  // happen.
+  const int postamble_start =
+      RoundDownVectors<kInt8ValuesPerNeonVector>(block_size);
+
+  // Each row is read once from memory for all the batches.
+  for (int row = 0; row < m_rows; ++row) {
+    const int8_t* row_ptr = packed_matrix + row * (m_cols / 2);
+    const float* row_scales = scales + row * num_blocks;
+    for (int batch = 0; batch < n_batch; ++batch) {
+      const float* vector_in_batch = vectors + batch * m_cols;
+      float dot_prod = 0.0f;
+      for (int block = 0; block < num_blocks; ++block) {
+        const int8_t* block_ptr = row_ptr + block * block_size / 2;
+        const float* vector_block = vector_in_batch + block * block_size;
+        float32x4_t acc_32x4 = vmovq_n_f32(0.0);
+        int col = 0;
+        for (; col < postamble_start; col += kInt8ValuesPerNeonVector) {
+          // Load 16 int4 values and sign extend their low and high nibbles.
+          const int8x8_t packed_8x8 = vld1_s8(block_ptr + col / 2);
+          const int8x8_t low_8x8 = vshr_n_s8(vshl_n_s8(packed_8x8, 4), 4);
+          const int8x8_t high_8x8 = vshr_n_s8(packed_8x8, 4);
+          // Interleave the nibbles back in column order.
+          const int8x8x2_t values_8x8x2 = vzip_s8(low_8x8, high_8x8);
+          const int16x8_t values_16x8_0 = vmovl_s8(values_8x8x2.val[0]);
+          const int16x8_t values_16x8_1 = vmovl_s8(values_8x8x2.val[1]);
+          acc_32x4 = vmlaq_f32(
+              acc_32x4, vcvtq_f32_s32(vmovl_s16(vget_low_s16(values_16x8_0))),
+              vld1q_f32(vector_block + col));
+          acc_32x4 = vmlaq_f32(
+              acc_32x4, vcvtq_f32_s32(vmovl_s16(vget_high_s16(values_16x8_0))),
+              vld1q_f32(vector_block + col + 4));
+          acc_32x4 = vmlaq_f32(
+              acc_32x4, vcvtq_f32_s32(vmovl_s16(vget_low_s16(values_16x8_1))),
+              vld1q_f32(vector_block + col + 8));
+          acc_32x4 = vmlaq_f32(
+              acc_32x4, vcvtq_f32_s32(vmovl_s16(vget_high_s16(values_16x8_1))),
+              vld1q_f32(vector_block + col + 12));
+        }
+        float block_dot_prod = AccumulateNeonLane(acc_32x4);
+        for (; TFLITE_UNLIKELY(col < block_size); col += 2) {
+          const int8_t packed = block_ptr[col / 2];
+          block_dot_prod +=
+              (static_cast<int8_t>(packed << 4) >> 4) * vector_block[col];
+          block_dot_prod += (packed >> 4) * vector_block[col + 1];
+        }
+        dot_prod += block_dot_prod * row_scales[block];
+      }
+      result[batch * m_rows + row] += dot_prod;
+    }
+  }
+}
+
 #ifdef __aarch64__
 
 // We interleave vector data to make the dot product logic more efficient.
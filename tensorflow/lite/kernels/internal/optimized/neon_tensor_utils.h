@@ -31,6 +31,16 @@ void MatrixBatchVectorMultiplyAccumulate(const float* matrix, int m_rows,
                    vector, n_batch, result);
 }
 
+void PackedInt4MatrixBatchVectorMultiplyAccumulate(
+    const int8_t* __restrict__ packed_matrix, int m_rows, int m_cols,
+    const float* __restrict__ scales, int block_size,
+    const float* __restrict__ vectors, int n_batch,
+    float* __restrict__ result) {
+  NEON_OR_PORTABLE(PackedInt4MatrixBatchVectorMultiplyAccumulate,
+                   packed_matrix, m_rows, m_cols, scales, block_size, vectors,
+                   n_batch, result);
+}
+
 void MatrixBatchVectorMultiplyAccumulate(const int8_t* __restrict__ matrix,
                                          const int m_rows, const int m_cols,
                                          const int8_t* __restrict__ vectors,
@@ -33,6 +33,14 @@ void NeonMatrixBatchVectorMultiplyAccumulate(const float* matrix, int m_rows,
                                              int m_cols, const float* vector,
                                              int n_batch, float* result);
 
+// Matrix multiplication for int4 values packed two per byte, dequantized on
+// the fly.
+void NeonPackedInt4MatrixBatchVectorMultiplyAccumulate(
+    const int8_t* __restrict__ packed_matrix, int m_rows, int m_cols,
+    const float* __restrict__ scales, int block_size,
+    const float* __restrict__ vectors, int n_batch,
+    float* __restrict__ result);
+
 // Matrix multiplication for quantized values using symmetric quantization.
 void NeonMatrixBatchVectorMultiplyAccumulate(const int8_t* __restrict__ matrix,
                                              const int m_rows, const int m_cols,
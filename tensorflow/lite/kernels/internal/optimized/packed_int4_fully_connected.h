@@ -0,0 +1,124 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_PACKED_INT4_FULLY_CONNECTED_H_
+#define TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_PACKED_INT4_FULLY_CONNECTED_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "ruy/profiler/instrumentation.h"  // from @ruy
+#include "tensorflow/lite/kernels/cpu_backend_context.h"
+#include "tensorflow/lite/kernels/cpu_backend_threadpool.h"
+#include "tensorflow/lite/kernels/internal/tensor_utils.h"
+
+namespace tflite {
+namespace optimized_ops {
+
+// Minimum number of weight rows (or batches) computed by each thread.
+constexpr int kPackedInt4MinRowsPerThread = 16;
+
+struct PackedInt4FullyConnectedTask : cpu_backend_threadpool::Task {
+  PackedInt4FullyConnectedTask(const float* input_data, int batch_start,
+                               int batch_end, int accum_depth,
+                               const int8_t* packed_weights, int unit_start,
+                               int unit_end, int num_units, const float* scales,
+                               int block_size, float* output_data)
+      : input_data(input_data),
+        batch_start(batch_start),
+        batch_end(batch_end),
+        accum_depth(accum_depth),
+        packed_weights(packed_weights),
+        unit_start(unit_start),
+        unit_end(unit_end),
+        num_units(num_units),
+        scales(scales),
+        block_size(block_size),
+        output_data(output_data) {}
+
+  void Run() override {
+    const int num_blocks = accum_depth / block_size;
+    tensor_utils::PackedInt4MatrixBatchVectorMultiplyAccumulate(
+        packed_weights + unit_start * accum_depth / 2, unit_end - unit_start,
+        accum_depth, scales + unit_start * num_blocks, block_size,
+        input_data + batch_start * accum_depth, batch_end - batch_start,
+        output_data + batch_start * num_units + unit_start);
+  }
+
+ private:
+  const float* input_data;
+  int batch_start;
+  int batch_end;
+  int accum_depth;
+  const int8_t* packed_weights;
+  int unit_start;
+  int unit_end;
+  int num_units;
+  const float* scales;
+  int block_size;
+  float* output_data;
+};
+
+// Accumulates into the [batches, num_units] `output_data` the product of the
+// float [batches, accum_depth] `input_data` with the transposed
+// [num_units, accum_depth] weights, quantized to int4 and packed two per byte
+// with the scales described in
+// tensor_utils::PackedInt4MatrixBatchVectorMultiplyAccumulate.
+// A single batch (e.g. generating a token) is bound by the bandwidth of
+// reading the weights, so it's split among the threads along the units, each
+// thread reading a slice of the weights. Larger batches are split along the
+// batches.
+inline void PackedInt4FullyConnectedAccumulate(
+    const float* input_data, int batches, int accum_depth,
+    const int8_t* packed_weights, int num_units, const float* scales,
+    int block_size, float* output_data,
+    CpuBackendContext* cpu_backend_context) {
+  ruy::profiler::ScopeLabel label("FullyConnected");
+  ruy::profiler::ScopeLabel inner_label("Packed Int4 Weights");
+  const bool split_units = batches == 1;
+  const int size = split_units ? num_units : batches;
+  const int max_threads =
+      cpu_backend_context ? cpu_backend_context->max_num_threads() : 1;
+  const int thread_count = std::max(
+      1, std::min(max_threads, size / kPackedInt4MinRowsPerThread));
+  std::vector<PackedInt4FullyConnectedTask> tasks;
+  tasks.reserve(thread_count);
+  int start = 0;
+  for (int i = 0; i < thread_count; ++i) {
+    // The first mod(size, thread_count) tasks process one more item.
+    int end = start + size / thread_count;
+    if (i < size % thread_count) end++;
+    if (split_units) {
+      tasks.emplace_back(input_data, 0, 1, accum_depth, packed_weights, start,
+                         end, num_units, scales, block_size, output_data);
+    } else {
+      tasks.emplace_back(input_data, start, end, accum_depth, packed_weights,
+                         0, num_units, num_units, scales, block_size,
+                         output_data);
+    }
+    start = end;
+  }
+  if (thread_count == 1) {
+    tasks[0].Run();
+    return;
+  }
+  cpu_backend_threadpool::Execute(tasks.size(), tasks.data(),
+                                  cpu_backend_context);
+}
+
+}  // namespace optimized_ops
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_PACKED_INT4_FULLY_CONNECTED_H_
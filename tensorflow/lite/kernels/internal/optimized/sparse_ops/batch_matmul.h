@@ -0,0 +1,108 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_SPARSE_OPS_BATCH_MATMUL_H_
+#define TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_SPARSE_OPS_BATCH_MATMUL_H_
+
+#include <algorithm>
+#include <cstdint>
+
+#include "ruy/profiler/instrumentation.h"  // from @ruy
+#include "tensorflow/lite/kernels/cpu_backend_context.h"
+#include "tensorflow/lite/kernels/internal/common.h"
+#include "tensorflow/lite/kernels/internal/optimized/sparse_ops/block_sparse_matrix.h"
+#include "tensorflow/lite/kernels/internal/types.h"
+
+namespace tflite {
+namespace optimized_ops {
+
+// Minimum number of LHS rows multiplied by each thread.
+constexpr int kSparseBatchMatMulMinRowsPerThread = 16;
+
+// BatchMatMul of a float LHS with a constant float RHS in block sparse format,
+// where `rhs` is the [num_units, accum_depth] view of the RHS (i.e. the RHS
+// transposed) and the RHS has no batch dimensions. All the batch dimensions of
+// the LHS are flattened with its rows, so the output is
+// [..., rows, num_units] like the LHS.
+inline void BatchMatMulSparseRhs(const RuntimeShape& lhs_shape,
+                                 const float* lhs_data,
+                                 const BlockSparseMatrix<float>& rhs,
+                                 const RuntimeShape& output_shape,
+                                 float* output_data,
+                                 CpuBackendContext* cpu_backend_context) {
+  ruy::profiler::ScopeLabel label("BatchMatMul");
+  ruy::profiler::ScopeLabel inner_label("Block Sparse");
+  const int accum_depth = lhs_shape.Dims(lhs_shape.DimensionsCount() - 1);
+  TFLITE_DCHECK_EQ(accum_depth, rhs.cols);
+  const int num_units = rhs.rows;
+  const int rows = lhs_shape.FlatSize() / accum_depth;
+  TFLITE_DCHECK_EQ(rows * num_units, output_shape.FlatSize());
+
+  auto matmul_fn = [&](int row_start, int row_end) {
+    BlockSparseMatMul<float, float>(
+        rhs, lhs_data + row_start * accum_depth, accum_depth,
+        row_end - row_start, [&](int row, int unit, float acc) {
+          output_data[(row_start + row) * num_units + unit] = acc;
+        });
+  };
+  BlockSparseParallelFor(rows, kSparseBatchMatMulMinRowsPerThread,
+                         cpu_backend_context, matmul_fn);
+}
+
+// Same as above for an int8 LHS and RHS, with the quantization parameters of
+// `params`. The RHS zero point must be 0.
+inline void BatchMatMulSparseRhs(const FullyConnectedParams& params,
+                                 const RuntimeShape& lhs_shape,
+                                 const int8_t* lhs_data,
+                                 const BlockSparseMatrix<int8_t>& rhs,
+                                 const RuntimeShape& output_shape,
+                                 int8_t* output_data,
+                                 CpuBackendContext* cpu_backend_context) {
+  ruy::profiler::ScopeLabel label("BatchMatMul/8bit");
+  ruy::profiler::ScopeLabel inner_label("Block Sparse");
+  const int accum_depth = lhs_shape.Dims(lhs_shape.DimensionsCount() - 1);
+  TFLITE_DCHECK_EQ(accum_depth, rhs.cols);
+  TFLITE_DCHECK_EQ(params.weights_offset, 0);
+  const int num_units = rhs.rows;
+  const int rows = lhs_shape.FlatSize() / accum_depth;
+  TFLITE_DCHECK_EQ(rows * num_units, output_shape.FlatSize());
+  const int32_t input_offset = params.input_offset;
+  const int32_t output_offset = params.output_offset;
+  const int32_t output_multiplier = params.output_multiplier;
+  const int output_shift = params.output_shift;
+  const int32_t output_activation_min = params.quantized_activation_min;
+  const int32_t output_activation_max = params.quantized_activation_max;
+
+  auto matmul_fn = [&](int row_start, int row_end) {
+    BlockSparseMatMul<int8_t, int32_t>(
+        rhs, lhs_data + row_start * accum_depth, accum_depth,
+        row_end - row_start, [&](int row, int unit, int32_t acc) {
+          acc += input_offset * rhs.row_sums[unit];
+          acc = MultiplyByQuantizedMultiplier(acc, output_multiplier,
+                                              output_shift);
+          acc += output_offset;
+          acc = std::max(acc, output_activation_min);
+          acc = std::min(acc, output_activation_max);
+          output_data[(row_start + row) * num_units + unit] =
+              static_cast<int8_t>(acc);
+        });
+  };
+  BlockSparseParallelFor(rows, kSparseBatchMatMulMinRowsPerThread,
+                         cpu_backend_context, matmul_fn);
+}
+
+}  // namespace optimized_ops
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_SPARSE_OPS_BATCH_MATMUL_H_
@@ -0,0 +1,804 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_SPARSE_OPS_BLOCK_SPARSE_MATRIX_H_
+#define TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_SPARSE_OPS_BLOCK_SPARSE_MATRIX_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <type_traits>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "tensorflow/lite/core/c/common.h"
+#include "tensorflow/lite/kernels/cpu_backend_context.h"
+#include "tensorflow/lite/kernels/cpu_backend_threadpool.h"
+#include "tensorflow/lite/kernels/internal/compatibility.h"
+#include "tensorflow/lite/kernels/internal/types.h"
+#include "tensorflow/lite/kernels/internal/utils/sparsity_format_converter.h"
+
+namespace tflite {
+namespace optimized_ops {
+
+// Largest block dimension of a BlockSparseMatrix. Larger blocks are split.
+constexpr int kMaxBlockSparseBlockSize = 16;
+
+// Number of vectors multiplied at once with each block of a BlockSparseMatrix,
+// so that the block is loaded once for all of them.
+constexpr int kBlockSparseBatchTile = 4;
+
+// A matrix in block compressed sparse row (BSR) format: the matrix is split in
+// blocks of block_rows x block_cols values, and only the blocks with a nonzero
+// value are stored.
+//
+// Unlike the TfLiteSparsity of a tensor, the blocks are always blocks of the 2D
+// view of the weights used by a kernel (e.g. [output_depth, filter_height *
+// filter_width * input_depth] for Conv), so the kernels don't depend on the
+// traversal order and the dimension formats of the sparse tensor.
+template <typename T>
+struct BlockSparseMatrix {
+  int rows = 0;
+  int cols = 0;
+  int block_rows = 1;
+  int block_cols = 1;
+  // The nonzero blocks of the i-th row of blocks are blocks [segments[i],
+  // segments[i + 1]).
+  std::vector<int32_t> segments;
+  // Column of blocks of each nonzero block.
+  std::vector<int32_t> indices;
+  // Values of the nonzero blocks, each one in row-major order.
+  std::vector<T> values;
+  // Sum of the values of each row, to apply the input offset of quantized
+  // kernels once per row instead of once per value. Empty for float matrices.
+  std::vector<int32_t> row_sums;
+
+  bool IsPopulated() const { return !segments.empty(); }
+};
+
+// Returns the size of the blocks of `sparsity` along dimension `dim` of a
+// tensor of rank `rank`, or 1 if this dimension isn't blocked.
+inline int GetSparsityBlockSize(const TfLiteSparsity& sparsity, int rank,
+                                int dim) {
+  if (sparsity.block_map == nullptr) return 1;
+  for (int i = 0; i < sparsity.block_map->size; ++i) {
+    if (sparsity.block_map->data[i] == dim &&
+        rank + i < sparsity.dim_metadata_size) {
+      return sparsity.dim_metadata[rank + i].dense_size;
+    }
+  }
+  return 1;
+}
+
+// Returns the block dimension used for a matrix dimension of `size`: the
+// block dimensions that don't divide the matrix dimension, or exceed
+// kMaxBlockSparseBlockSize, are reduced to 1.
+inline int GetBlockSparseBlockSize(int block_size, int size) {
+  if (block_size <= 0 || block_size > kMaxBlockSparseBlockSize ||
+      size % block_size != 0) {
+    return 1;
+  }
+  return block_size;
+}
+
+// Populates `matrix` with the rows x cols matrix whose value (i, j) is
+// dense_data[i * row_stride + j * col_stride], with blocks of block_rows x
+// block_cols values reduced by GetBlockSparseBlockSize.
+template <typename T>
+void PopulateBlockSparseMatrix(const T* dense_data, int rows, int cols,
+                               int row_stride, int col_stride, int block_rows,
+                               int block_cols, BlockSparseMatrix<T>* matrix) {
+  block_rows = GetBlockSparseBlockSize(block_rows, rows);
+  block_cols = GetBlockSparseBlockSize(block_cols, cols);
+  matrix->rows = rows;
+  matrix->cols = cols;
+  matrix->block_rows = block_rows;
+  matrix->block_cols = block_cols;
+  matrix->segments.assign(1, 0);
+  matrix->indices.clear();
+  matrix->values.clear();
+  matrix->row_sums.clear();
+  if (std::is_integral<T>::value) matrix->row_sums.assign(rows, 0);
+
+  auto value = [&](int i, int j) {
+    return dense_data[i * row_stride + j * col_stride];
+  };
+  for (int i0 = 0; i0 < rows; i0 += block_rows) {
+    for (int j0 = 0; j0 < cols; j0 += block_cols) {
+      bool is_zero = true;
+      for (int i = i0; i < i0 + block_rows && is_zero; ++i) {
+        for (int j = j0; j < j0 + block_cols && is_zero; ++j) {
+          is_zero = value(i, j) == T(0);
+        }
+      }
+      if (is_zero) continue;
+      matrix->indices.push_back(j0 / block_cols);
+      for (int i = i0; i < i0 + block_rows; ++i) {
+        for (int j = j0; j < j0 + block_cols; ++j) {
+          matrix->values.push_back(value(i, j));
+          if (!matrix->row_sums.empty()) matrix->row_sums[i] += value(i, j);
+        }
+      }
+    }
+    matrix->segments.push_back(matrix->indices.size());
+  }
+}
+
+// Same as above, but reads the values from `sparse_data`, the data of a
+// tensor of `shape` compressed with `sparsity`, without densifying it. The
+// rows x cols matrix must be a view of the whole tensor, with one of
+// row_stride and col_stride equal to 1.
+template <typename T>
+void PopulateBlockSparseMatrix(const TfLiteSparsity& sparsity,
+                               const RuntimeShape& shape, const T* sparse_data,
+                               int rows, int cols, int row_stride,
+                               int col_stride, int block_rows, int block_cols,
+                               BlockSparseMatrix<T>* matrix) {
+  TFLITE_DCHECK_EQ(rows * cols, shape.FlatSize());
+  TFLITE_DCHECK(row_stride == 1 || col_stride == 1);
+  block_rows = GetBlockSparseBlockSize(block_rows, rows);
+  block_cols = GetBlockSparseBlockSize(block_cols, cols);
+  const int block_size = block_rows * block_cols;
+  matrix->rows = rows;
+  matrix->cols = cols;
+  matrix->block_rows = block_rows;
+  matrix->block_cols = block_cols;
+  matrix->row_sums.clear();
+  if (std::is_integral<T>::value) matrix->row_sums.assign(rows, 0);
+
+  std::vector<int> dense_shape(shape.DimensionsCount());
+  for (int i = 0; i < shape.DimensionsCount(); ++i) {
+    dense_shape[i] = shape.Dims(i);
+  }
+  internal::sparsity::FormatConverter<T> converter(dense_shape, sparsity);
+  auto for_each_nonzero = [&](const std::function<void(int, int, T)>& fn) {
+    converter.ForEachValue(sparse_data, [&](uint64_t index, T value) {
+      if (value == T(0)) return;
+      if (row_stride > col_stride) {
+        fn(index / row_stride, (index % row_stride) / col_stride, value);
+      } else {
+        fn((index % col_stride) / row_stride, index / col_stride, value);
+      }
+    });
+  };
+
+  // The blocks with a nonzero value are listed first, and then filled.
+  std::vector<std::vector<int32_t>> row_block_indices(rows / block_rows);
+  for_each_nonzero([&](int i, int j, T) {
+    row_block_indices[i / block_rows].push_back(j / block_cols);
+  });
+  matrix->segments.assign(1, 0);
+  matrix->indices.clear();
+  for (std::vector<int32_t>& indices : row_block_indices) {
+    std::sort(indices.begin(), indices.end());
+    indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+    matrix->indices.insert(matrix->indices.end(), indices.begin(),
+                           indices.end());
+    matrix->segments.push_back(matrix->indices.size());
+    std::vector<int32_t>().swap(indices);
+  }
+  matrix->values.assign(matrix->indices.size() * block_size, T(0));
+  for_each_nonzero([&](int i, int j, T value) {
+    const int row_block = i / block_rows;
+    const auto begin = matrix->indices.begin() + matrix->segments[row_block];
+    const auto end = matrix->indices.begin() + matrix->segments[row_block + 1];
+    const int k = std::lower_bound(begin, end, j / block_cols) -
+                  matrix->indices.begin();
+    matrix->values[k * block_size + (i % block_rows) * block_cols +
+                   j % block_cols] = value;
+    if (!matrix->row_sums.empty()) matrix->row_sums[i] += value;
+  });
+}
+
+// Accumulates the products of the blocks of kBlockRows x kBlockCols values of
+// a BlockSparseMatrix with the kBlockCols input values each one is applied to.
+// If kBlockRows or kBlockCols is 0, the block dimension is given at runtime.
+// This generic version is scalar, the block shapes of the specializations
+// below use NEON or AVX2.
+template <typename T, typename AccumT, int kBlockRows, int kBlockCols>
+class BlockSparseAccumulator {
+ public:
+  BlockSparseAccumulator(int block_rows, int block_cols)
+      : block_rows_(block_rows), block_cols_(block_cols) {}
+
+  void Accumulate(const T* block, const T* input) {
+    const int block_rows = kBlockRows > 0 ? kBlockRows : block_rows_;
+    const int block_cols = kBlockCols > 0 ? kBlockCols : block_cols_;
+    for (int i = 0; i < block_rows; ++i) {
+      AccumT sum = 0;
+      for (int j = 0; j < block_cols; ++j) {
+        sum += static_cast<AccumT>(block[i * block_cols + j]) *
+               static_cast<AccumT>(input[j]);
+      }
+      sums_[i] += sum;
+    }
+  }
+
+  // Writes the accumulated sum of each of the block rows to `sums`.
+  void GetSums(AccumT* sums) const {
+    std::copy_n(sums_, kBlockRows > 0 ? kBlockRows : block_rows_, sums);
+  }
+
+ private:
+  int block_rows_;
+  int block_cols_;
+  AccumT sums_[kBlockRows > 0 ? kBlockRows : kMaxBlockSparseBlockSize] = {};
+};
+
+// Computes sums[i] += block[i] * (input[i] + input_offset) for i in
+// [start, size), for a block of one column applied to as many input values as
+// it has rows.
+template <typename T, typename AccumT>
+void BlockSparseVectorMultiplyAccumulate(const T* block, const T* input,
+                                         AccumT input_offset, int size,
+                                         AccumT* sums, int start = 0) {
+  for (int i = start; i < size; ++i) {
+    sums[i] += static_cast<AccumT>(block[i]) *
+               (static_cast<AccumT>(input[i]) + input_offset);
+  }
+}
+
+#if defined(__AVX2__)
+
+inline float BlockSparseReduceAdd(__m128 v) {
+  v = _mm_hadd_ps(v, v);
+  return _mm_cvtss_f32(_mm_hadd_ps(v, v));
+}
+
+inline float BlockSparseReduceAdd(__m256 v) {
+  return BlockSparseReduceAdd(
+      _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)));
+}
+
+inline int32_t BlockSparseReduceAdd(__m128i v) {
+  v = _mm_hadd_epi32(v, v);
+  return _mm_cvtsi128_si32(_mm_hadd_epi32(v, v));
+}
+
+inline int32_t BlockSparseReduceAdd(__m256i v) {
+  return BlockSparseReduceAdd(_mm_add_epi32(_mm256_castsi256_si128(v),
+                                            _mm256_extracti128_si256(v, 1)));
+}
+
+inline __m128i BlockSparseLoad16xInt8(const int8_t* data) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+}
+
+// Loads 4 int8 values, widened to int16, in the low half of the result.
+inline __m128i BlockSparseLoad4xInt8(const int8_t* data) {
+  int32_t value;
+  std::memcpy(&value, data, sizeof(value));
+  return _mm_cvtepi8_epi16(_mm_cvtsi32_si128(value));
+}
+
+template <>
+class BlockSparseAccumulator<float, float, 1, 4> {
+ public:
+  BlockSparseAccumulator(int, int) {}
+  void Accumulate(const float* block, const float* input) {
+    acc_ = _mm_add_ps(acc_,
+                      _mm_mul_ps(_mm_loadu_ps(block), _mm_loadu_ps(input)));
+  }
+  void GetSums(float* sums) const { sums[0] = BlockSparseReduceAdd(acc_); }
+
+ private:
+  __m128 acc_ = _mm_setzero_ps();
+};
+
+template <>
+class BlockSparseAccumulator<float, float, 1, 16> {
+ public:
+  BlockSparseAccumulator(int, int) {}
+  void Accumulate(const float* block, const float* input) {
+    for (int i = 0; i < 2; ++i) {
+      acc_[i] = _mm256_add_ps(acc_[i],
+                              _mm256_mul_ps(_mm256_loadu_ps(block + 8 * i),
+                                            _mm256_loadu_ps(input + 8 * i)));
+    }
+  }
+  void GetSums(float* sums) const {
+    sums[0] = BlockSparseReduceAdd(_mm256_add_ps(acc_[0], acc_[1]));
+  }
+
+ private:
+  __m256 acc_[2] = {_mm256_setzero_ps(), _mm256_setzero_ps()};
+};
+
+template <>
+class BlockSparseAccumulator<float, float, 4, 4> {
+ public:
+  BlockSparseAccumulator(int, int) {}
+  void Accumulate(const float* block, const float* input) {
+    const __m128 x = _mm_loadu_ps(input);
+    for (int i = 0; i < 4; ++i) {
+      acc_[i] = _mm_add_ps(acc_[i], _mm_mul_ps(_mm_loadu_ps(block + 4 * i), x));
+    }
+  }
+  void GetSums(float* sums) const {
+    _mm_storeu_ps(sums, _mm_hadd_ps(_mm_hadd_ps(acc_[0], acc_[1]),
+                                    _mm_hadd_ps(acc_[2], acc_[3])));
+  }
+
+ private:
+  __m128 acc_[4] = {_mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(),
+                    _mm_setzero_ps()};
+};
+
+template <>
+class BlockSparseAccumulator<float, float, 16, 1> {
+ public:
+  BlockSparseAccumulator(int, int) {}
+  void Accumulate(const float* block, const float* input) {
+    const __m256 x = _mm256_set1_ps(input[0]);
+    for (int i = 0; i < 2; ++i) {
+      acc_[i] = _mm256_add_ps(acc_[i],
+                              _mm256_mul_ps(_mm256_loadu_ps(block + 8 * i), x));
+    }
+  }
+  void GetSums(float* sums) const {
+    _mm256_storeu_ps(sums, acc_[0]);
+    _mm256_storeu_ps(sums + 8, acc_[1]);
+  }
+
+ private:
+  __m256 acc_[2] = {_mm256_setzero_ps(), _mm256_setzero_ps()};
+};
+
+template <>
+class BlockSparseAccumulator<int8_t, int32_t, 1, 4> {
+ public:
+  BlockSparseAccumulator(int, int) {}
+  void Accumulate(const int8_t* block, const int8_t* input) {
+    acc_ = _mm_add_epi32(acc_, _mm_madd_epi16(BlockSparseLoad4xInt8(block),
+                                              BlockSparseLoad4xInt8(input)));
+  }
+  void GetSums(int32_t* sums) const { sums[0] = BlockSparseReduceAdd(acc_); }
+
+ private:
+  __m128i acc_ = _mm_setzero_si128();
+};
+
+template <>
+class BlockSparseAccumulator<int8_t, int32_t, 1, 16> {
+ public:
+  BlockSparseAccumulator(int, int) {}
+  void Accumulate(const int8_t* block, const int8_t* input) {
+    acc_ = _mm256_add_epi32(
+        acc_,
+        _mm256_madd_epi16(_mm256_cvtepi8_epi16(BlockSparseLoad16xInt8(block)),
+                          _mm256_cvtepi8_epi16(BlockSparseLoad16xInt8(input))));
+  }
+  void GetSums(int32_t* sums) const { sums[0] = BlockSparseReduceAdd(acc_); }
+
+ private:
+  __m256i acc_ = _mm256_setzero_si256();
+};
+
+template <>
+class BlockSparseAccumulator<int8_t, int32_t, 4, 4> {
+ public:
+  BlockSparseAccumulator(int, int) {}
+  // The products are summed in pairs, so that lanes 2 * i and 2 * i + 1 of
+  // the accumulator hold the sum of row i.
+  void Accumulate(const int8_t* block, const int8_t* input) {
+    int32_t x;
+    std::memcpy(&x, input, sizeof(x));
+    acc_ = _mm256_add_epi32(
+        acc_,
+        _mm256_madd_epi16(_mm256_cvtepi8_epi16(BlockSparseLoad16xInt8(block)),
+                          _mm256_cvtepi8_epi16(_mm_set1_epi32(x))));
+  }
+  void GetSums(int32_t* sums) const {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(sums),
+                     _mm_hadd_epi32(_mm256_castsi256_si128(acc_),
+                                    _mm256_extracti128_si256(acc_, 1)));
+  }
+
+ private:
+  __m256i acc_ = _mm256_setzero_si256();
+};
+
+template <>
+class BlockSparseAccumulator<int8_t, int32_t, 16, 1> {
+ public:
+  BlockSparseAccumulator(int, int) {}
+  // The products of int8 values fit in int16.
+  void Accumulate(const int8_t* block, const int8_t* input) {
+    const __m256i products =
+        _mm256_mullo_epi16(_mm256_cvtepi8_epi16(BlockSparseLoad16xInt8(block)),
+                           _mm256_set1_epi16(input[0]));
+    acc_[0] = _mm256_add_epi32(
+        acc_[0], _mm256_cvtepi16_epi32(_mm256_castsi256_si128(products)));
+    acc_[1] = _mm256_add_epi32(
+        acc_[1], _mm256_cvtepi16_epi32(_mm256_extracti128_si256(products, 1)));
+  }
+  void GetSums(int32_t* sums) const {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(sums), acc_[0]);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(sums + 8), acc_[1]);
+  }
+
+ private:
+  __m256i acc_[2] = {_mm256_setzero_si256(), _mm256_setzero_si256()};
+};
+
+inline void BlockSparseVectorMultiplyAccumulate(const float* block,
+                                                const float* input,
+                                                float input_offset, int size,
+                                                float* sums) {
+  const __m256 offset = _mm256_set1_ps(input_offset);
+  int i = 0;
+  for (; i + 8 <= size; i += 8) {
+    const __m256 x = _mm256_add_ps(_mm256_loadu_ps(input + i), offset);
+    _mm256_storeu_ps(
+        sums + i, _mm256_add_ps(_mm256_loadu_ps(sums + i),
+                                _mm256_mul_ps(_mm256_loadu_ps(block + i), x)));
+  }
+  BlockSparseVectorMultiplyAccumulate<float, float>(block, input, input_offset,
+                                                    size, sums, i);
+}
+
+inline void BlockSparseVectorMultiplyAccumulate(const int8_t* block,
+                                                const int8_t* input,
+                                                int32_t input_offset, int size,
+                                                int32_t* sums) {
+  const __m256i offset = _mm256_set1_epi32(input_offset);
+  int i = 0;
+  for (; i + 8 <= size; i += 8) {
+    const __m256i a = _mm256_cvtepi8_epi32(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(block + i)));
+    const __m256i x = _mm256_add_epi32(
+        _mm256_cvtepi8_epi32(
+            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(input + i))),
+        offset);
+    __m256i* sum = reinterpret_cast<__m256i*>(sums + i);
+    _mm256_storeu_si256(sum, _mm256_add_epi32(_mm256_loadu_si256(sum),
+                                              _mm256_mullo_epi32(a, x)));
+  }
+  BlockSparseVectorMultiplyAccumulate<int8_t, int32_t>(
+      block, input, input_offset, size, sums, i);
+}
+
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+
+inline float BlockSparseReduceAdd(float32x4_t v) {
+  const float32x2_t sum = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+  return vget_lane_f32(vpadd_f32(sum, sum), 0);
+}
+
+inline int32_t BlockSparseReduceAdd(int32x4_t v) {
+  const int32x2_t sum = vadd_s32(vget_low_s32(v), vget_high_s32(v));
+  return vget_lane_s32(vpadd_s32(sum, sum), 0);
+}
+
+// Loads 4 int8 values in both halves of the result.
+inline int8x8_t BlockSparseLoad4xInt8(const int8_t* data) {
+  int32_t value;
+  std::memcpy(&value, data, sizeof(value));
+  return vreinterpret_s8_s32(vdup_n_s32(value));
+}
+
+template <>
+class BlockSparseAccumulator<float, float, 1, 4> {
+ public:
+  BlockSparseAccumulator(int, int) {}
+  void Accumulate(const float* block, const float* input) {
+    acc_ = vmlaq_f32(acc_, vld1q_f32(block), vld1q_f32(input));
+  }
+  void GetSums(float* sums) const { sums[0] = BlockSparseReduceAdd(acc_); }
+
+ private:
+  float32x4_t acc_ = vdupq_n_f32(0.0f);
+};
+
+template <>
+class BlockSparseAccumulator<float, float, 1, 16> {
+ public:
+  BlockSparseAccumulator(int, int) {}
+  void Accumulate(const float* block, const float* input) {
+    for (int i = 0; i < 4; ++i) {
+      acc_[i] = vmlaq_f32(acc_[i], vld1q_f32(block + 4 * i),
+                          vld1q_f32(input + 4 * i));
+    }
+  }
+  void GetSums(float* sums) const {
+    sums[0] = BlockSparseReduceAdd(
+        vaddq_f32(vaddq_f32(acc_[0], acc_[1]), vaddq_f32(acc_[2], acc_[3])));
+  }
+
+ private:
+  float32x4_t acc_[4] = {vdupq_n_f32(0.0f), vdupq_n_f32(0.0f),
+                         vdupq_n_f32(0.0f), vdupq_n_f32(0.0f)};
+};
+
+template <>
+class BlockSparseAccumulator<float, float, 4, 4> {
+ public:
+  BlockSparseAccumulator(int, int) {}
+  void Accumulate(const float* block, const float* input) {
+    const float32x4_t x = vld1q_f32(input);
+    for (int i = 0; i < 4; ++i) {
+      acc_[i] = vmlaq_f32(acc_[i], vld1q_f32(block + 4 * i), x);
+    }
+  }
+  void GetSums(float* sums) const {
+    for (int i = 0; i < 4; ++i) sums[i] = BlockSparseReduceAdd(acc_[i]);
+  }
+
+ private:
+  float32x4_t acc_[4] = {vdupq_n_f32(0.0f), vdupq_n_f32(0.0f),
+                         vdupq_n_f32(0.0f), vdupq_n_f32(0.0f)};
+};
+
+template <>
+class BlockSparseAccumulator<float, float, 16, 1> {
+ public:
+  BlockSparseAccumulator(int, int) {}
+  void Accumulate(const float* block, const float* input) {
+    for (int i = 0; i < 4; ++i) {
+      acc_[i] = vmlaq_n_f32(acc_[i], vld1q_f32(block + 4 * i), input[0]);
+    }
+  }
+  void GetSums(float* sums) const {
+    for (int i = 0; i < 4; ++i) vst1q_f32(sums + 4 * i, acc_[i]);
+  }
+
+ private:
+  float32x4_t acc_[4] = {vdupq_n_f32(0.0f), vdupq_n_f32(0.0f),
+                         vdupq_n_f32(0.0f), vdupq_n_f32(0.0f)};
+};
+
+template <>
+class BlockSparseAccumulator<int8_t, int32_t, 1, 4> {
+ public:
+  BlockSparseAccumulator(int, int) {}
+  void Accumulate(const int8_t* block, const int8_t* input) {
+    const int16x8_t products = vmull_s8(BlockSparseLoad4xInt8(block),
+                                        BlockSparseLoad4xInt8(input));
+    acc_ = vaddw_s16(acc_, vget_low_s16(products));
+  }
+  void GetSums(int32_t* sums) const { sums[0] = BlockSparseReduceAdd(acc_); }
+
+ private:
+  int32x4_t acc_ = vdupq_n_s32(0);
+};
+
+template <>
+class BlockSparseAccumulator<int8_t, int32_t, 1, 16> {
+ public:
+  BlockSparseAccumulator(int, int) {}
+  void Accumulate(const int8_t* block, const int8_t* input) {
+    const int8x16_t a = vld1q_s8(block);
+    const int8x16_t x = vld1q_s8(input);
+    acc_ = vpadalq_s16(acc_, vmull_s8(vget_low_s8(a), vget_low_s8(x)));
+    acc_ = vpadalq_s16(acc_, vmull_s8(vget_high_s8(a), vget_high_s8(x)));
+  }
+  void GetSums(int32_t* sums) const { sums[0] = BlockSparseReduceAdd(acc_); }
+
+ private:
+  int32x4_t acc_ = vdupq_n_s32(0);
+};
+
+template <>
+class BlockSparseAccumulator<int8_t, int32_t, 4, 4> {
+ public:
+  BlockSparseAccumulator(int, int) {}
+  // The products are summed in pairs, so that lanes 2 * i and 2 * i + 1 of
+  // acc_[0] hold the sum of row i, and those of acc_[1] the sum of row i + 2.
+  void Accumulate(const int8_t* block, const int8_t* input) {
+    const int8x16_t a = vld1q_s8(block);
+    const int8x8_t x = BlockSparseLoad4xInt8(input);
+    acc_[0] = vpadalq_s16(acc_[0], vmull_s8(vget_low_s8(a), x));
+    acc_[1] = vpadalq_s16(acc_[1], vmull_s8(vget_high_s8(a), x));
+  }
+  void GetSums(int32_t* sums) const {
+    vst1q_s32(sums, vcombine_s32(vpadd_s32(vget_low_s32(acc_[0]),
+                                           vget_high_s32(acc_[0])),
+                                 vpadd_s32(vget_low_s32(acc_[1]),
+                                           vget_high_s32(acc_[1]))));
+  }
+
+ private:
+  int32x4_t acc_[2] = {vdupq_n_s32(0), vdupq_n_s32(0)};
+};
+
+template <>
+class BlockSparseAccumulator<int8_t, int32_t, 16, 1> {
+ public:
+  BlockSparseAccumulator(int, int) {}
+  void Accumulate(const int8_t* block, const int8_t* input) {
+    const int8x16_t a = vld1q_s8(block);
+    const int8x8_t x = vdup_n_s8(input[0]);
+    const int16x8_t low = vmull_s8(vget_low_s8(a), x);
+    const int16x8_t high = vmull_s8(vget_high_s8(a), x);
+    acc_[0] = vaddw_s16(acc_[0], vget_low_s16(low));
+    acc_[1] = vaddw_s16(acc_[1], vget_high_s16(low));
+    acc_[2] = vaddw_s16(acc_[2], vget_low_s16(high));
+    acc_[3] = vaddw_s16(acc_[3], vget_high_s16(high));
+  }
+  void GetSums(int32_t* sums) const {
+    for (int i = 0; i < 4; ++i) vst1q_s32(sums + 4 * i, acc_[i]);
+  }
+
+ private:
+  int32x4_t acc_[4] = {vdupq_n_s32(0), vdupq_n_s32(0), vdupq_n_s32(0),
+                       vdupq_n_s32(0)};
+};
+
+inline void BlockSparseVectorMultiplyAccumulate(const float* block,
+                                                const float* input,
+                                                float input_offset, int size,
+                                                float* sums) {
+  const float32x4_t offset = vdupq_n_f32(input_offset);
+  int i = 0;
+  for (; i + 4 <= size; i += 4) {
+    const float32x4_t x = vaddq_f32(vld1q_f32(input + i), offset);
+    vst1q_f32(sums + i,
+              vmlaq_f32(vld1q_f32(sums + i), vld1q_f32(block + i), x));
+  }
+  BlockSparseVectorMultiplyAccumulate<float, float>(block, input, input_offset,
+                                                    size, sums, i);
+}
+
+// The input offset is the negated zero point of an int8 input, so the input
+// values plus the offset fit in int16.
+inline void BlockSparseVectorMultiplyAccumulate(const int8_t* block,
+                                                const int8_t* input,
+                                                int32_t input_offset, int size,
+                                                int32_t* sums) {
+  const int16x8_t offset = vdupq_n_s16(static_cast<int16_t>(input_offset));
+  int i = 0;
+  for (; i + 8 <= size; i += 8) {
+    const int16x8_t a = vmovl_s8(vld1_s8(block + i));
+    const int16x8_t x = vaddq_s16(vmovl_s8(vld1_s8(input + i)), offset);
+    vst1q_s32(sums + i, vmlal_s16(vld1q_s32(sums + i), vget_low_s16(a),
+                                  vget_low_s16(x)));
+    vst1q_s32(sums + i + 4, vmlal_s16(vld1q_s32(sums + i + 4),
+                                      vget_high_s16(a), vget_high_s16(x)));
+  }
+  BlockSparseVectorMultiplyAccumulate<int8_t, int32_t>(
+      block, input, input_offset, size, sums, i);
+}
+
+#endif
+
+// Multiplies `matrix` with `batches` vectors of matrix.cols values, and calls
+// `output_fn(batch, row, accumulator)` with the result of each row for each
+// vector. Vector b starts at input_data[b * input_stride]. If kBlockRows or
+// kBlockCols is 0, the block dimension is read from `matrix` at runtime.
+template <int kBlockRows, int kBlockCols, typename T, typename AccumT,
+          typename OutputFn>
+void BlockSparseMatMulImpl(const BlockSparseMatrix<T>& matrix,
+                           const T* input_data, int input_stride, int batches,
+                           const OutputFn& output_fn) {
+  using Accumulator =
+      BlockSparseAccumulator<T, AccumT, kBlockRows, kBlockCols>;
+  const int block_rows = kBlockRows > 0 ? kBlockRows : matrix.block_rows;
+  const int block_cols = kBlockCols > 0 ? kBlockCols : matrix.block_cols;
+  const int block_size = block_rows * block_cols;
+  const int32_t* segments = matrix.segments.data();
+  const int32_t* indices = matrix.indices.data();
+  const T* values = matrix.values.data();
+  static_assert(kBlockSparseBatchTile == 4,
+                "One accumulator is initialized for each vector of a tile.");
+
+  for (int b0 = 0; b0 < batches; b0 += kBlockSparseBatchTile) {
+    const int tile = std::min(kBlockSparseBatchTile, batches - b0);
+    const T* tile_input = input_data + b0 * input_stride;
+    for (int row_block = 0; row_block * block_rows < matrix.rows;
+         ++row_block) {
+      Accumulator accumulators[kBlockSparseBatchTile] = {
+          Accumulator(block_rows, block_cols),
+          Accumulator(block_rows, block_cols),
+          Accumulator(block_rows, block_cols),
+          Accumulator(block_rows, block_cols)};
+      for (int k = segments[row_block]; k < segments[row_block + 1]; ++k) {
+        const T* block = values + k * block_size;
+        const T* block_input = tile_input + indices[k] * block_cols;
+        for (int b = 0; b < tile; ++b) {
+          accumulators[b].Accumulate(block, block_input + b * input_stride);
+        }
+      }
+      for (int b = 0; b < tile; ++b) {
+        AccumT sums[kMaxBlockSparseBlockSize];
+        accumulators[b].GetSums(sums);
+        for (int i = 0; i < block_rows; ++i) {
+          output_fn(b0 + b, row_block * block_rows + i, sums[i]);
+        }
+      }
+    }
+  }
+}
+
+// Dispatches BlockSparseMatMulImpl to the accumulator of the block shape of
+// `matrix`. The 1x4, 1x16, 4x4 and 16x1 blocks have NEON and AVX2
+// accumulators, the other shapes are scalar.
+template <typename T, typename AccumT, typename OutputFn>
+void BlockSparseMatMul(const BlockSparseMatrix<T>& matrix, const T* input_data,
+                       int input_stride, int batches,
+                       const OutputFn& output_fn) {
+  const int block_rows = matrix.block_rows;
+  const int block_cols = matrix.block_cols;
+  if (block_rows == 1 && block_cols == 1) {
+    BlockSparseMatMulImpl<1, 1, T, AccumT>(matrix, input_data, input_stride,
+                                           batches, output_fn);
+  } else if (block_rows == 1 && block_cols == 4) {
+    BlockSparseMatMulImpl<1, 4, T, AccumT>(matrix, input_data, input_stride,
+                                           batches, output_fn);
+  } else if (block_rows == 1 && block_cols == 16) {
+    BlockSparseMatMulImpl<1, 16, T, AccumT>(matrix, input_data, input_stride,
+                                            batches, output_fn);
+  } else if (block_rows == 4 && block_cols == 4) {
+    BlockSparseMatMulImpl<4, 4, T, AccumT>(matrix, input_data, input_stride,
+                                           batches, output_fn);
+  } else if (block_rows == 16 && block_cols == 1) {
+    BlockSparseMatMulImpl<16, 1, T, AccumT>(matrix, input_data, input_stride,
+                                            batches, output_fn);
+  } else {
+    BlockSparseMatMulImpl<0, 0, T, AccumT>(matrix, input_data, input_stride,
+                                           batches, output_fn);
+  }
+}
+
+template <typename Fn>
+struct BlockSparseTask : cpu_backend_threadpool::Task {
+  BlockSparseTask(const Fn& fn, int start, int end)
+      : fn(fn), start(start), end(end) {}
+
+  void Run() override { fn(start, end); }
+
+ private:
+  const Fn& fn;
+  int start;
+  int end;
+};
+
+// Calls `fn(start, end)` on the threads of `cpu_backend_context` for disjoint
+// ranges covering [0, size), with at least `min_size_per_thread` items in each
+// range unless `size` is smaller.
+template <typename Fn>
+void BlockSparseParallelFor(int size, int min_size_per_thread,
+                            CpuBackendContext* cpu_backend_context,
+                            const Fn& fn) {
+  const int max_threads =
+      cpu_backend_context ? cpu_backend_context->max_num_threads() : 1;
+  const int thread_count = std::max(
+      1, std::min(max_threads, size / std::max(1, min_size_per_thread)));
+  if (thread_count == 1) {
+    fn(0, size);
+    return;
+  }
+  std::vector<BlockSparseTask<Fn>> tasks;
+  tasks.reserve(thread_count);
+  int start = 0;
+  for (int i = 0; i < thread_count; ++i) {
+    // The first mod(size, thread_count) tasks process one more item.
+    int end = start + size / thread_count;
+    if (i < size % thread_count) end++;
+    tasks.emplace_back(fn, start, end);
+    start = end;
+  }
+  cpu_backend_threadpool::Execute(tasks.size(), tasks.data(),
+                                  cpu_backend_context);
+}
+
+}  // namespace optimized_ops
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_SPARSE_OPS_BLOCK_SPARSE_MATRIX_H_
@@ -0,0 +1,174 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_SPARSE_OPS_CONV_H_
+#define TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_SPARSE_OPS_CONV_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "ruy/profiler/instrumentation.h"  // from @ruy
+#include "tensorflow/lite/kernels/cpu_backend_context.h"
+#include "tensorflow/lite/kernels/internal/common.h"
+#include "tensorflow/lite/kernels/internal/optimized/sparse_ops/block_sparse_matrix.h"
+#include "tensorflow/lite/kernels/internal/types.h"
+
+namespace tflite {
+namespace optimized_ops {
+
+// Number of output pixels whose input patches are gathered at once, and then
+// multiplied with the filter.
+constexpr int kSparseConvPixelTile = 16;
+
+// Computes the output pixels [pixel_start, pixel_end) of a Conv with a filter
+// in block sparse format, where `filter` is the [output_depth, filter_height *
+// filter_width * input_depth] view of the filter. The input patch of each
+// output pixel is gathered like im2col, with `pad_value` outside of the input,
+// and `output_fn(pixel, output_channel, accumulator)` is called for each
+// output value.
+template <typename T, typename AccumT, typename OutputFn>
+void ConvSparseWeightImpl(const ConvParams& params,
+                          const RuntimeShape& input_shape, const T* input_data,
+                          const RuntimeShape& filter_shape,
+                          const BlockSparseMatrix<T>& filter, T pad_value,
+                          const RuntimeShape& output_shape, int pixel_start,
+                          int pixel_end, const OutputFn& output_fn) {
+  const int input_height = input_shape.Dims(1);
+  const int input_width = input_shape.Dims(2);
+  const int input_depth = input_shape.Dims(3);
+  const int filter_height = filter_shape.Dims(1);
+  const int filter_width = filter_shape.Dims(2);
+  const int output_height = output_shape.Dims(1);
+  const int output_width = output_shape.Dims(2);
+  const int patch_size = filter_height * filter_width * input_depth;
+  TFLITE_DCHECK_EQ(patch_size, filter.cols);
+
+  std::vector<T> patches(kSparseConvPixelTile * patch_size);
+  for (int pixel0 = pixel_start; pixel0 < pixel_end;
+       pixel0 += kSparseConvPixelTile) {
+    const int tile = std::min(kSparseConvPixelTile, pixel_end - pixel0);
+    for (int p = 0; p < tile; ++p) {
+      const int pixel = pixel0 + p;
+      const int batch = pixel / (output_height * output_width);
+      const int out_y = (pixel / output_width) % output_height;
+      const int out_x = pixel % output_width;
+      const int in_y_origin =
+          out_y * params.stride_height - params.padding_values.height;
+      const int in_x_origin =
+          out_x * params.stride_width - params.padding_values.width;
+      T* patch = patches.data() + p * patch_size;
+      for (int filter_y = 0; filter_y < filter_height; ++filter_y) {
+        const int in_y =
+            in_y_origin + filter_y * params.dilation_height_factor;
+        for (int filter_x = 0; filter_x < filter_width; ++filter_x) {
+          const int in_x =
+              in_x_origin + filter_x * params.dilation_width_factor;
+          T* tap = patch + (filter_y * filter_width + filter_x) * input_depth;
+          if (in_y < 0 || in_y >= input_height || in_x < 0 ||
+              in_x >= input_width) {
+            std::fill(tap, tap + input_depth, pad_value);
+          } else {
+            std::memcpy(tap,
+                        input_data + Offset(input_shape, batch, in_y, in_x, 0),
+                        input_depth * sizeof(T));
+          }
+        }
+      }
+    }
+    BlockSparseMatMul<T, AccumT>(
+        filter, patches.data(), patch_size, tile,
+        [&](int p, int output_channel, AccumT acc) {
+          output_fn(pixel0 + p, output_channel, acc);
+        });
+  }
+}
+
+// Conv with a float filter in block sparse format. Each output pixel is
+// computed by one thread, so the threads share the filter but not the output.
+inline void ConvSparseWeight(
+    const ConvParams& params, const RuntimeShape& input_shape,
+    const float* input_data, const RuntimeShape& filter_shape,
+    const BlockSparseMatrix<float>& filter, const RuntimeShape& bias_shape,
+    const float* bias_data, const RuntimeShape& output_shape,
+    float* output_data, CpuBackendContext* cpu_backend_context) {
+  ruy::profiler::ScopeLabel label("Conv");
+  ruy::profiler::ScopeLabel inner_label("Block Sparse");
+  const int output_depth = MatchingDim(filter_shape, 0, output_shape, 3);
+  const int num_pixels = FlatSizeSkipDim(output_shape, 3);
+  const float output_activation_min = params.float_activation_min;
+  const float output_activation_max = params.float_activation_max;
+
+  auto output_fn = [&](int pixel, int output_channel, float acc) {
+    const float bias_value = bias_data ? bias_data[output_channel] : 0.0f;
+    output_data[pixel * output_depth + output_channel] =
+        ActivationFunctionWithMinMax(acc + bias_value, output_activation_min,
+                                     output_activation_max);
+  };
+  auto conv_fn = [&](int pixel_start, int pixel_end) {
+    ConvSparseWeightImpl<float, float>(
+        params, input_shape, input_data, filter_shape, filter,
+        /*pad_value=*/0.0f, output_shape, pixel_start, pixel_end, output_fn);
+  };
+  BlockSparseParallelFor(num_pixels, kSparseConvPixelTile, cpu_backend_context,
+                         conv_fn);
+}
+
+// Conv with an int8 per-channel quantized filter in block sparse format. The
+// filter zero points must be 0.
+inline void ConvPerChannelSparseWeight(
+    const ConvParams& params, const int32_t* output_multiplier,
+    const int32_t* output_shift, const RuntimeShape& input_shape,
+    const int8_t* input_data, const RuntimeShape& filter_shape,
+    const BlockSparseMatrix<int8_t>& filter, const RuntimeShape& bias_shape,
+    const int32_t* bias_data, const RuntimeShape& output_shape,
+    int8_t* output_data, CpuBackendContext* cpu_backend_context) {
+  ruy::profiler::ScopeLabel label("Conv/8bit");
+  ruy::profiler::ScopeLabel inner_label("Block Sparse");
+  const int output_depth = MatchingDim(filter_shape, 0, output_shape, 3);
+  const int num_pixels = FlatSizeSkipDim(output_shape, 3);
+  const int32_t input_offset = params.input_offset;
+  const int32_t output_offset = params.output_offset;
+  const int32_t output_activation_min = params.quantized_activation_min;
+  const int32_t output_activation_max = params.quantized_activation_max;
+
+  // The patches are padded with the input zero point, so that padded values
+  // don't contribute to sum((input + input_offset) * filter), which is
+  // computed as sum(input * filter) + input_offset * sum(filter).
+  auto output_fn = [&](int pixel, int output_channel, int32_t acc) {
+    acc += input_offset * filter.row_sums[output_channel];
+    if (bias_data) acc += bias_data[output_channel];
+    acc = MultiplyByQuantizedMultiplier(acc, output_multiplier[output_channel],
+                                        output_shift[output_channel]);
+    acc += output_offset;
+    acc = std::max(acc, output_activation_min);
+    acc = std::min(acc, output_activation_max);
+    output_data[pixel * output_depth + output_channel] =
+        static_cast<int8_t>(acc);
+  };
+  auto conv_fn = [&](int pixel_start, int pixel_end) {
+    ConvSparseWeightImpl<int8_t, int32_t>(
+        params, input_shape, input_data, filter_shape, filter,
+        /*pad_value=*/static_cast<int8_t>(-input_offset), output_shape,
+        pixel_start, pixel_end, output_fn);
+  };
+  BlockSparseParallelFor(num_pixels, kSparseConvPixelTile, cpu_backend_context,
+                         conv_fn);
+}
+
+}  // namespace optimized_ops
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_SPARSE_OPS_CONV_H_
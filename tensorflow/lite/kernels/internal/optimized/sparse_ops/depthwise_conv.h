@@ -0,0 +1,175 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_SPARSE_OPS_DEPTHWISE_CONV_H_
+#define TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_SPARSE_OPS_DEPTHWISE_CONV_H_
+
+#include <algorithm>
+#include <cstdint>
+
+#include "ruy/profiler/instrumentation.h"  // from @ruy
+#include "tensorflow/lite/kernels/cpu_backend_context.h"
+#include "tensorflow/lite/kernels/internal/common.h"
+#include "tensorflow/lite/kernels/internal/optimized/sparse_ops/block_sparse_matrix.h"
+#include "tensorflow/lite/kernels/internal/types.h"
+
+namespace tflite {
+namespace optimized_ops {
+
+// Minimum number of output pixels computed by each thread.
+constexpr int kSparseDepthwiseConvMinPixelsPerThread = 16;
+
+// Computes the output pixels [pixel_start, pixel_end) of a DepthwiseConv with
+// a filter in block sparse format, where `filter` is the [output_depth,
+// filter_height * filter_width] view of the filter, with blocks of 1 column.
+// `output_fn(pixel, output_channel, accumulator)` is called for each output
+// value. The filter taps that fall outside of the input are skipped, and
+// `input_offset` is added to each input value. Without depth multiplier, the
+// block of each tap is multiplied with the input channels with NEON or AVX2.
+template <typename T, typename AccumT, typename OutputFn>
+void DepthwiseConvSparseWeightImpl(const DepthwiseParams& params,
+                                   const RuntimeShape& input_shape,
+                                   const T* input_data,
+                                   const RuntimeShape& filter_shape,
+                                   const BlockSparseMatrix<T>& filter,
+                                   AccumT input_offset,
+                                   const RuntimeShape& output_shape,
+                                   int pixel_start, int pixel_end,
+                                   const OutputFn& output_fn) {
+  const int input_height = input_shape.Dims(1);
+  const int input_width = input_shape.Dims(2);
+  const int input_depth = input_shape.Dims(3);
+  const int filter_width = filter_shape.Dims(2);
+  const int output_height = output_shape.Dims(1);
+  const int output_width = output_shape.Dims(2);
+  const int depth_multiplier = params.depth_multiplier;
+  const int block_rows = filter.block_rows;
+  TFLITE_DCHECK_EQ(filter.block_cols, 1);
+  TFLITE_DCHECK_LE(block_rows, kMaxBlockSparseBlockSize);
+
+  for (int pixel = pixel_start; pixel < pixel_end; ++pixel) {
+    const int batch = pixel / (output_height * output_width);
+    const int out_y = (pixel / output_width) % output_height;
+    const int out_x = pixel % output_width;
+    const int in_y_origin =
+        out_y * params.stride_height - params.padding_values.height;
+    const int in_x_origin =
+        out_x * params.stride_width - params.padding_values.width;
+    for (int row_block = 0; row_block * block_rows < filter.rows;
+         ++row_block) {
+      const int output_channel0 = row_block * block_rows;
+      AccumT sums[kMaxBlockSparseBlockSize] = {};
+      for (int k = filter.segments[row_block];
+           k < filter.segments[row_block + 1]; ++k) {
+        const int tap = filter.indices[k];
+        const int in_y = in_y_origin +
+                         (tap / filter_width) * params.dilation_height_factor;
+        const int in_x =
+            in_x_origin + (tap % filter_width) * params.dilation_width_factor;
+        if (in_y < 0 || in_y >= input_height || in_x < 0 ||
+            in_x >= input_width) {
+          continue;
+        }
+        const T* x =
+            input_data + ((batch * input_height + in_y) * input_width + in_x) *
+                             input_depth;
+        const T* block = filter.values.data() + k * block_rows;
+        if (depth_multiplier == 1) {
+          BlockSparseVectorMultiplyAccumulate(block, x + output_channel0,
+                                              input_offset, block_rows, sums);
+          continue;
+        }
+        for (int i = 0; i < block_rows; ++i) {
+          const int in_channel = (output_channel0 + i) / depth_multiplier;
+          sums[i] += static_cast<AccumT>(block[i]) *
+                     (static_cast<AccumT>(x[in_channel]) + input_offset);
+        }
+      }
+      for (int i = 0; i < block_rows; ++i) {
+        output_fn(pixel, output_channel0 + i, sums[i]);
+      }
+    }
+  }
+}
+
+// DepthwiseConv with a float filter in block sparse format.
+inline void DepthwiseConvSparseWeight(
+    const DepthwiseParams& params, const RuntimeShape& input_shape,
+    const float* input_data, const RuntimeShape& filter_shape,
+    const BlockSparseMatrix<float>& filter, const RuntimeShape& bias_shape,
+    const float* bias_data, const RuntimeShape& output_shape,
+    float* output_data, CpuBackendContext* cpu_backend_context) {
+  ruy::profiler::ScopeLabel label("DepthwiseConv");
+  ruy::profiler::ScopeLabel inner_label("Block Sparse");
+  const int output_depth = MatchingDim(filter_shape, 3, output_shape, 3);
+  const int num_pixels = FlatSizeSkipDim(output_shape, 3);
+  const float output_activation_min = params.float_activation_min;
+  const float output_activation_max = params.float_activation_max;
+
+  auto output_fn = [&](int pixel, int output_channel, float acc) {
+    const float bias_value = bias_data ? bias_data[output_channel] : 0.0f;
+    output_data[pixel * output_depth + output_channel] =
+        ActivationFunctionWithMinMax(acc + bias_value, output_activation_min,
+                                     output_activation_max);
+  };
+  auto conv_fn = [&](int pixel_start, int pixel_end) {
+    DepthwiseConvSparseWeightImpl<float, float>(
+        params, input_shape, input_data, filter_shape, filter,
+        /*input_offset=*/0.0f, output_shape, pixel_start, pixel_end,
+        output_fn);
+  };
+  BlockSparseParallelFor(num_pixels, kSparseDepthwiseConvMinPixelsPerThread,
+                         cpu_backend_context, conv_fn);
+}
+
+// DepthwiseConv with an int8 per-channel quantized filter in block sparse
+// format. The filter zero points must be 0.
+inline void DepthwiseConvPerChannelSparseWeight(
+    const DepthwiseParams& params, const int32_t* output_multiplier,
+    const int32_t* output_shift, const RuntimeShape& input_shape,
+    const int8_t* input_data, const RuntimeShape& filter_shape,
+    const BlockSparseMatrix<int8_t>& filter, const RuntimeShape& bias_shape,
+    const int32_t* bias_data, const RuntimeShape& output_shape,
+    int8_t* output_data, CpuBackendContext* cpu_backend_context) {
+  ruy::profiler::ScopeLabel label("DepthwiseConvInt8");
+  ruy::profiler::ScopeLabel inner_label("Block Sparse");
+  const int output_depth = MatchingDim(filter_shape, 3, output_shape, 3);
+  const int num_pixels = FlatSizeSkipDim(output_shape, 3);
+  const int32_t output_offset = params.output_offset;
+  const int32_t output_activation_min = params.quantized_activation_min;
+  const int32_t output_activation_max = params.quantized_activation_max;
+
+  auto output_fn = [&](int pixel, int output_channel, int32_t acc) {
+    if (bias_data) acc += bias_data[output_channel];
+    acc = MultiplyByQuantizedMultiplier(acc, output_multiplier[output_channel],
+                                        output_shift[output_channel]);
+    acc += output_offset;
+    acc = std::max(acc, output_activation_min);
+    acc = std::min(acc, output_activation_max);
+    output_data[pixel * output_depth + output_channel] =
+        static_cast<int8_t>(acc);
+  };
+  auto conv_fn = [&](int pixel_start, int pixel_end) {
+    DepthwiseConvSparseWeightImpl<int8_t, int32_t>(
+        params, input_shape, input_data, filter_shape, filter,
+        params.input_offset, output_shape, pixel_start, pixel_end, output_fn);
+  };
+  BlockSparseParallelFor(num_pixels, kSparseDepthwiseConvMinPixelsPerThread,
+                         cpu_backend_context, conv_fn);
+}
+
+}  // namespace optimized_ops
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_SPARSE_OPS_DEPTHWISE_CONV_H_
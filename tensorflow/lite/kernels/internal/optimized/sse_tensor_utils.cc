@@ -286,6 +286,75 @@ void Avx2MatrixBatchVectorMultiplyAccumulateImpl(
   }  // for batch
 }
 
+void Avx2PackedInt4MatrixBatchVectorMultiplyAccumulateImpl(
+    const int8_t* __restrict__ packed_matrix, int m_rows, int m_cols,
+    const float* __restrict__ scales, int block_size,
+    const float* __restrict__ vectors, int n_batch,
+    float* __restrict__ result) {
+  constexpr int kInt4ValuesPerIteration = 2 * kFloatValuesPerAvx2Vector;
+  const int num_blocks = m_cols / block_size;
+  // If block_size is not divisible by the number of int4 values unpacked at
+  // once, then we need to process the final few elements of each block
+  // sequentially. postamble_start shows the start index where this should
+  // happen.
+  const int postamble_start =
+      RoundDownVectors<kInt4ValuesPerIteration>(block_size);
+  const __m128i nibble_mask_8x16 = _mm_set1_epi8(0x0F);
+  const __m128i sign_bit_8x16 = _mm_set1_epi8(0x08);
+
+  // Each row is read once from memory for all the batches.
+  for (int row = 0; row < m_rows; ++row) {
+    const int8_t* row_ptr = packed_matrix + row * (m_cols / 2);
+    const float* row_scales = scales + row * num_blocks;
+    for (int batch = 0; batch < n_batch; ++batch) {
+      const float* vector_in_batch = vectors + batch * m_cols;
+      float dot_prod = 0.0f;
+      for (int block = 0; block < num_blocks; ++block) {
+        const int8_t* block_ptr = row_ptr + block * block_size / 2;
+        const float* vector_block = vector_in_batch + block * block_size;
+        __m256 acc_32x8 = _mm256_setzero_ps();
+        int col = 0;
+        for (; col < postamble_start; col += kInt4ValuesPerIteration) {
+          // Load 16 int4 values and split their low and high nibbles.
+          const __m128i packed_8x16 = _mm_loadl_epi64(
+              reinterpret_cast<const __m128i*>(block_ptr + col / 2));
+          const __m128i low_8x16 = _mm_and_si128(packed_8x16, nibble_mask_8x16);
+          const __m128i high_8x16 =
+              _mm_and_si128(_mm_srli_epi16(packed_8x16, 4), nibble_mask_8x16);
+          // Interleave the nibbles back in column order, and sign extend them:
+          // (x ^ 8) - 8 maps [0, 15] to [-8, 7].
+          __m128i values_8x16 = _mm_unpacklo_epi8(low_8x16, high_8x16);
+          values_8x16 = _mm_sub_epi8(_mm_xor_si128(values_8x16, sign_bit_8x16),
+                                     sign_bit_8x16);
+          const __m256 values_f32x8_0 =
+              _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(values_8x16));
+          const __m256 values_f32x8_1 = _mm256_cvtepi32_ps(
+              _mm256_cvtepi8_epi32(_mm_srli_si128(values_8x16, 8)));
+
+          // Multiply the vector and matrix row and add to accumulator.
+          acc_32x8 = _mm256_add_ps(
+              acc_32x8, _mm256_mul_ps(values_f32x8_0,
+                                      _mm256_loadu_ps(vector_block + col)));
+          acc_32x8 = _mm256_add_ps(
+              acc_32x8,
+              _mm256_mul_ps(values_f32x8_1,
+                            _mm256_loadu_ps(vector_block + col +
+                                            kFloatValuesPerAvx2Vector)));
+        }
+        float block_dot_prod = ReduceFloat32x8(acc_32x8);
+        for (; col < block_size; col += 2) {
+          const int8_t packed = block_ptr[col / 2];
+          block_dot_prod +=
+              (static_cast<int8_t>(packed << 4) >> 4) * vector_block[col];
+          block_dot_prod += (packed >> 4) * vector_block[col + 1];
+        }
+        dot_prod += block_dot_prod * row_scales[block];
+      }
+      result[batch * m_rows + row] += dot_prod;
+    }
+  }
+}
+
 #endif  // __AVX2__
 
 void SseMatrixBatchVectorMultiplyAccumulateImpl(
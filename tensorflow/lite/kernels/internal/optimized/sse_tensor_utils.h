@@ -46,6 +46,22 @@ void MatrixBatchVectorMultiplyAccumulate(const float* matrix, int m_rows,
 #endif
 }
 
+void PackedInt4MatrixBatchVectorMultiplyAccumulate(
+    const int8_t* __restrict__ packed_matrix, int m_rows, int m_cols,
+    const float* __restrict__ scales, int block_size,
+    const float* __restrict__ vectors, int n_batch,
+    float* __restrict__ result) {
+#if defined(__AVX2__)
+  Avx2PackedInt4MatrixBatchVectorMultiplyAccumulateImpl(
+      packed_matrix, m_rows, m_cols, scales, block_size, vectors, n_batch,
+      result);
+#else
+  NEON_OR_PORTABLE(PackedInt4MatrixBatchVectorMultiplyAccumulate,
+                   packed_matrix, m_rows, m_cols, scales, block_size, vectors,
+                   n_batch, result);
+#endif
+}
+
 void MatrixBatchVectorMultiplyAccumulate(
     const int8_t* __restrict__ matrix, const int m_rows, const int m_cols,
     const int8_t* __restrict__ vectors,
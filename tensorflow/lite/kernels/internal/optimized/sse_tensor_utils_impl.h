@@ -40,6 +40,14 @@ void Avx2MatrixBatchVectorMultiplyAccumulateImpl(
     float* __restrict__ result, const float* per_channel_scale,
     const int32_t* input_offset, int32_t* scratch, int32_t* row_sums,
     bool* compute_row_sums, CpuBackendContext* context);
+
+// Matrix multiplication for int4 values packed two per byte, dequantized on
+// the fly.
+void Avx2PackedInt4MatrixBatchVectorMultiplyAccumulateImpl(
+    const int8_t* __restrict__ packed_matrix, int m_rows, int m_cols,
+    const float* __restrict__ scales, int block_size,
+    const float* __restrict__ vectors, int n_batch,
+    float* __restrict__ result);
 #endif  // defined(__AVX2__)
 
 #ifdef __SSSE3__
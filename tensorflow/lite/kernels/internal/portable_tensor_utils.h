@@ -208,6 +208,20 @@ void SparseMatrixBatchVectorMultiplyAccumulate(
     int m_rows, int m_cols, const float* __restrict__ vector, int n_batch,
     float* __restrict__ result);
 
+// Same as the float function above, but the matrix holds int4 values
+// quantized using symmetric quantization and packed two per byte (see
+// UnpackDenseInt4IntoInt8), which are dequantized on the fly. Each row is split
+// in blocks of `block_size` columns with their own scale, the scale of block
+// `i` of row `r` being `scales[r * (m_cols / block_size) + i]`: a `block_size`
+// of `m_cols` gives one scale per row.
+// This function assumes that `block_size` is even and divides `m_cols`, so
+// that all rows and blocks start on a byte boundary.
+void PackedInt4MatrixBatchVectorMultiplyAccumulate(
+    const int8_t* __restrict__ packed_matrix, int m_rows, int m_cols,
+    const float* __restrict__ scales, int block_size,
+    const float* __restrict__ vectors, int n_batch,
+    float* __restrict__ result);
+
 // Same as the function above, but for values quantized using symmetric
 // quantization (e.g. by calling SymmetricQuantizeFloats).
 // The passed scaling factors is a buffer of the quantization scaling factors
@@ -203,6 +203,39 @@ void PortableMatrixBatchVectorMultiplyAccumulate(
   }    // for batch
 }
 
+void PortablePackedInt4MatrixBatchVectorMultiplyAccumulate(
+    const int8_t* __restrict__ packed_matrix, int m_rows, int m_cols,
+    const float* __restrict__ scales, int block_size,
+    const float* __restrict__ vectors, int n_batch,
+    float* __restrict__ result) {
+  TFLITE_DCHECK_EQ(block_size % 2, 0);
+  TFLITE_DCHECK_EQ(m_cols % block_size, 0);
+  const int num_blocks = m_cols / block_size;
+  // Each row is read once from memory for all the batches.
+  for (int row = 0; row < m_rows; ++row) {
+    const int8_t* row_ptr = packed_matrix + row * (m_cols / 2);
+    const float* row_scales = scales + row * num_blocks;
+    for (int batch = 0; batch < n_batch; ++batch) {
+      const float* vector_in_batch = vectors + batch * m_cols;
+      float dot_prod = 0.0f;
+      for (int block = 0; block < num_blocks; ++block) {
+        float block_dot_prod = 0.0f;
+        for (int col = block * block_size; col < (block + 1) * block_size;
+             col += 2) {
+          const int8_t packed = row_ptr[col / 2];
+          // Shift left first so that sign is properly extended when shifted
+          // right.
+          block_dot_prod +=
+              (static_cast<int8_t>(packed << 4) >> 4) * vector_in_batch[col];
+          block_dot_prod += (packed >> 4) * vector_in_batch[col + 1];
+        }
+        dot_prod += block_dot_prod * row_scales[block];
+      }
+      result[batch * m_rows + row] += dot_prod;
+    }
+  }
+}
+
 void PortableSparseMatrixBatchVectorMultiplyAccumulate1x4(
     const float* __restrict__ matrix, const int32_t* __restrict__ segments,
     const int32_t* __restrict__ indices, int m_rows, int m_cols,
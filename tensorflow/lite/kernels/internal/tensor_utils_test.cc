@@ -360,6 +360,45 @@ TEST(uKernels, MatrixBatchVectorMultiplyAccumulateTest) {
                                                        -1., 7., 23.})));
 }
 
+// Blocks of 20 int4 values, each with a vectorized part and a postamble.
+TEST(uKernels, PackedInt4MatrixBatchVectorMultiplyAccumulateTest) {
+  constexpr int kRow = 3;
+  constexpr int kCol = 40;
+  constexpr int kBatch = 2;
+  constexpr int kBlockSize = 20;
+  constexpr int kNumBlocks = kCol / kBlockSize;
+  std::vector<int8_t> values(kRow * kCol);
+  for (int i = 0; i < kRow * kCol; ++i) {
+    values[i] = (i * 7 + 3) % 16 - 8;
+  }
+  std::vector<int8_t> packed_matrix(kRow * kCol / 2);
+  for (int i = 0; i < kRow * kCol; i += 2) {
+    packed_matrix[i / 2] = (values[i] & 0x0F) | (values[i + 1] << 4);
+  }
+  const std::vector<float> scales = {0.5, 0.25, 1.0, 2.0, 0.125, 1.5};
+  std::vector<float> vectors(kBatch * kCol);
+  for (int i = 0; i < kBatch * kCol; ++i) {
+    vectors[i] = (i % 9) * 0.5f - 2.0f;
+  }
+
+  std::vector<float> expected(kRow * kBatch, 1.0f);
+  for (int b = 0; b < kBatch; ++b) {
+    for (int r = 0; r < kRow; ++r) {
+      for (int c = 0; c < kCol; ++c) {
+        expected[b * kRow + r] += values[r * kCol + c] *
+                                  scales[r * kNumBlocks + c / kBlockSize] *
+                                  vectors[b * kCol + c];
+      }
+    }
+  }
+
+  std::vector<float> output(kRow * kBatch, 1.0f);
+  PackedInt4MatrixBatchVectorMultiplyAccumulate(
+      packed_matrix.data(), kRow, kCol, scales.data(), kBlockSize,
+      vectors.data(), kBatch, output.data());
+  EXPECT_THAT(output, ElementsAreArray(ArrayFloatNear(expected)));
+}
+
 // Quantized matmul with 2 * 30 input and 9 * 30 matrix.
 TEST(uKernels, QuantMatrixBatchVectorMultiplyAccumulate8x8_16Test) {
   CpuBackendContext context;
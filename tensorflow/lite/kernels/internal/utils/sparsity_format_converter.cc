@@ -16,6 +16,7 @@ limitations under the License.
 
 #include <algorithm>
 #include <cstdint>
+#include <functional>
 #include <utility>
 #include <vector>
 
@@ -298,7 +299,7 @@ void FormatConverter<T>::InitSparseToDenseConverter(
 template <typename T>
 void FormatConverter<T>::Populate(const T* src_data, std::vector<int> indices,
                                   int level, int prev_idx, int* src_data_ptr,
-                                  T* dest_data) {
+                                  const std::function<void(uint64_t, T)>& fn) {
   if (level == indices.size()) {
     int orig_rank = dense_shape_.size();
     std::vector<int> orig_idx;
@@ -316,8 +317,7 @@ void FormatConverter<T>::Populate(const T* src_data, std::vector<int> indices,
           orig_idx[orig_dim] * block_size_[block_idx] + indices[i];
     }
 
-    dest_data[GetFlattenedIndex(orig_idx, dense_shape_)] =
-        src_data[*src_data_ptr];
+    fn(GetFlattenedIndex(orig_idx, dense_shape_), src_data[*src_data_ptr]);
 
     *src_data_ptr = *src_data_ptr + 1;
     return;
@@ -329,7 +329,7 @@ void FormatConverter<T>::Populate(const T* src_data, std::vector<int> indices,
     for (int i = 0; i < shape_of_level; i++) {
       indices[level] = i;
       Populate(src_data, indices, level + 1, prev_idx * shape_of_level + i,
-               src_data_ptr, dest_data);
+               src_data_ptr, fn);
     }
   } else if (prev_idx + 1 < dim_metadata_[metadata_idx].size()) {
     const auto& array_segments = dim_metadata_[metadata_idx];
@@ -338,7 +338,7 @@ void FormatConverter<T>::Populate(const T* src_data, std::vector<int> indices,
          i++) {
       if (i < array_indices.size() && level < indices.size()) {
         indices[level] = array_indices[i];
-        Populate(src_data, indices, level + 1, i, src_data_ptr, dest_data);
+        Populate(src_data, indices, level + 1, i, src_data_ptr, fn);
       }
     }
   }
@@ -352,7 +352,9 @@ TfLiteStatus FormatConverter<T>::SparseToDense(const T* src_data) {
   int total_rank = traversal_order_.size();
   int src_data_ptr = 0;
   std::vector<int> indices(total_rank);
-  Populate(src_data, indices, 0, 0, &src_data_ptr, data_.data());
+  T* dest_data = data_.data();
+  Populate(src_data, indices, 0, 0, &src_data_ptr,
+           [dest_data](uint64_t index, T value) { dest_data[index] = value; });
 
   return kTfLiteOk;
 }
@@ -377,11 +379,21 @@ TfLiteStatus FormatConverter<T>::SparseToDense(const T* src_data,
   const int total_rank = traversal_order_.size();
   int src_data_ptr = 0;
   std::vector<int> indices(total_rank);
-  Populate(src_data, indices, 0, 0, &src_data_ptr, dest_data);
+  Populate(src_data, indices, 0, 0, &src_data_ptr,
+           [dest_data](uint64_t index, T value) { dest_data[index] = value; });
 
   return kTfLiteOk;
 }
 
+template <typename T>
+void FormatConverter<T>::ForEachValue(
+    const T* src_data, const std::function<void(uint64_t, T)>& fn) {
+  const int total_rank = traversal_order_.size();
+  int src_data_ptr = 0;
+  std::vector<int> indices(total_rank);
+  Populate(src_data, indices, 0, 0, &src_data_ptr, fn);
+}
+
 template <typename T>
 bool FormatConverter<T>::IsZero(const T val) {
   return (val == static_cast<T>(0));
@@ -15,6 +15,8 @@ limitations under the License.
 #ifndef TENSORFLOW_LITE_KERNELS_INTERNAL_UTILS_SPARSITY_FORMAT_CONVERTER_H_
 #define TENSORFLOW_LITE_KERNELS_INTERNAL_UTILS_SPARSITY_FORMAT_CONVERTER_H_
 
+#include <cstdint>
+#include <functional>
 #include <vector>
 
 #include "third_party/eigen3/Eigen/Core"
@@ -93,6 +95,11 @@ class FormatConverter {
   // to call GetData() with this method.
   TfLiteStatus SparseToDense(const T* src_data, const size_t dest_size,
                              T* dest_data, TfLiteContext* context = nullptr);
+  // Calls `fn(dense_index, value)` for each value of the sparse `src_data`,
+  // including the zeros stored in blocks, where dense_index is the index of
+  // the value in the dense tensor. Doesn't allocate the dense tensor.
+  void ForEachValue(const T* src_data,
+                    const std::function<void(uint64_t, T)>& fn);
 
  private:
   // Helper function for initializing this converter for sparse to dense
@@ -106,9 +113,10 @@ class FormatConverter {
                                   std::vector<int> block_map);
 
   // A recursive function to fetch data from the compressed src_data buffer and
-  // populate the dense buffer.
+  // pass each value with its index in the dense tensor to `fn`.
   void Populate(const T* src_data, std::vector<int> indices, int level,
-                int prev_idx, int* src_data_ptr, T* dest_data);
+                int prev_idx, int* src_data_ptr,
+                const std::function<void(uint64_t, T)>& fn);
 
   // Check if val is equal to zero.
   bool IsZero(const T val);
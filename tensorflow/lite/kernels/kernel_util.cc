@@ -336,6 +336,35 @@ TfLiteStatus GetQuantizedConvolutionMultipler(TfLiteContext* context,
   return kTfLiteOk;
 }
 
+TfLiteStatus GetInt4WeightsBlockSize(TfLiteContext* context,
+                                     const TfLiteTensor* weights,
+                                     int units_dimension, int num_units,
+                                     int accum_depth, int* block_size) {
+  TF_LITE_ENSURE_EQ(context, weights->quantization.type,
+                    kTfLiteAffineQuantization);
+  const auto* affine_quantization =
+      reinterpret_cast<const TfLiteAffineQuantization*>(
+          weights->quantization.params);
+  TF_LITE_ENSURE(context, affine_quantization);
+  TF_LITE_ENSURE(context, affine_quantization->scale);
+  TF_LITE_ENSURE(context, num_units > 0 && accum_depth > 0);
+  const int num_scales = affine_quantization->scale->size;
+  if (num_scales > 1) {
+    TF_LITE_ENSURE_EQ(context, affine_quantization->quantized_dimension,
+                      units_dimension);
+    TF_LITE_ENSURE_EQ(context, num_scales % num_units, 0);
+  }
+  const int num_blocks = num_scales > 1 ? num_scales / num_units : 1;
+  TF_LITE_ENSURE_EQ(context, accum_depth % num_blocks, 0);
+  *block_size = accum_depth / num_blocks;
+  if (affine_quantization->zero_point) {
+    for (int i = 0; i < affine_quantization->zero_point->size; ++i) {
+      TF_LITE_ENSURE_EQ(context, affine_quantization->zero_point->data[i], 0);
+    }
+  }
+  return kTfLiteOk;
+}
+
 namespace {
 
 inline TfLiteStatus Quantize(TfLiteContext* context, float scale,
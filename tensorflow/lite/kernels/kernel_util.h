@@ -260,6 +260,20 @@ TfLiteStatus GetQuantizedConvolutionMultipler(TfLiteContext* context,
                                               TfLiteTensor* output,
                                               double* multiplier);
 
+// Checks the quantization of the int4 `weights` of an op with float inputs and
+// outputs, which has `num_units` units along the `units_dimension` of the
+// weights and an accumulation depth of `accum_depth`. The weights are
+// symmetrically quantized with a single scale, a scale per unit, or
+// `num_units * num_blocks` scales (stored unit by unit) for blocks of
+// `accum_depth / num_blocks` values. Sets `block_size` to the number of values
+// sharing a scale along the accumulation depth. The packed int4 kernels also
+// need it to be even, so that the values of each block start on a byte
+// boundary.
+TfLiteStatus GetInt4WeightsBlockSize(TfLiteContext* context,
+                                     const TfLiteTensor* weights,
+                                     int units_dimension, int num_units,
+                                     int accum_depth, int* block_size);
+
 // Calculates the useful quantized range of an activation layer given its
 // activation tensor.
 TfLiteStatus CalculateActivationRangeQuantized(TfLiteContext* context,
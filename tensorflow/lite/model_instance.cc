@@ -0,0 +1,69 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/lite/model_instance.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "tensorflow/lite/allocation.h"
+#include "tensorflow/lite/core/c/common.h"
+#include "tensorflow/lite/interpreter_builder.h"
+#include "tensorflow/lite/minimal_logging.h"
+
+namespace tflite {
+
+ModelInstance::ModelInstance(const FlatBufferModel& model,
+                             const OpResolver& op_resolver,
+                             const InterpreterOptions* options_experimental)
+    : model_(model), op_resolver_(op_resolver) {
+  if (options_experimental) {
+    options_ = std::make_unique<InterpreterOptions>(*options_experimental);
+  }
+}
+
+TfLiteStatus ModelInstance::SetWeightsCacheFile(
+    const std::string& path, const std::string& model_token) {
+  const Allocation* allocation = model_.allocation();
+  if (allocation == nullptr) return kTfLiteError;
+  return weights_cache_.LoadFromFile(path, model_token, allocation->base(),
+                                     allocation->bytes());
+}
+
+TfLiteStatus ModelInstance::NewExecutionContext(
+    std::unique_ptr<Interpreter>* interpreter, int num_threads) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  InterpreterBuilder builder(model_, op_resolver_, options_.get());
+  TF_LITE_ENSURE_STATUS(builder.SetNumThreads(num_threads));
+  std::unique_ptr<Interpreter> new_interpreter;
+  TF_LITE_ENSURE_STATUS(builder(&new_interpreter));
+
+  // The cache must be set before AllocateTensors(), which prepares the kernels
+  // and applies the default delegates.
+  new_interpreter->SetExternalContext(kTfLiteSharedWeightsContext,
+                                      &weights_cache_);
+  TF_LITE_ENSURE_STATUS(new_interpreter->AllocateTensors());
+  TF_LITE_ENSURE_STATUS(weights_cache_.Finalize());
+  // The weights cache file only speeds up the next loads of the model, so the
+  // context is usable even if it can't be written.
+  if (weights_cache_.SaveToFile() != kTfLiteOk) {
+    TFLITE_LOG_PROD(TFLITE_LOG_WARNING, "Failed to save the weights cache.");
+  }
+
+  *interpreter = std::move(new_interpreter);
+  return kTfLiteOk;
+}
+
+}  // namespace tflite
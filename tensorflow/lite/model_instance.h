@@ -0,0 +1,91 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_LITE_MODEL_INSTANCE_H_
+#define TENSORFLOW_LITE_MODEL_INSTANCE_H_
+
+#include <memory>
+#include <mutex>  // NOLINT(build/c++11)
+#include <string>
+
+#include "tensorflow/lite/core/api/op_resolver.h"
+#include "tensorflow/lite/core/c/common.h"
+#include "tensorflow/lite/interpreter.h"
+#include "tensorflow/lite/interpreter_options.h"
+#include "tensorflow/lite/model_builder.h"
+#include "tensorflow/lite/shared_weights_cache.h"
+
+namespace tflite {
+
+/// A loaded model from which several execution contexts can be created, e.g.
+/// to serve concurrent requests. Every execution context is an `Interpreter`
+/// with its own activations and per-op state, while the weights derived from
+/// the model's constant tensors (dequantized, densified or packed by the
+/// default XNNPACK delegate) are computed once and shared by all contexts
+/// through a SharedWeightsCache. Sample usage:
+///
+/// <pre><code>
+/// tflite::ModelInstance instance(*model, resolver);
+/// std::unique_ptr<tflite::Interpreter> context1, context2;
+/// if (instance.NewExecutionContext(&context1) != kTfLiteOk) return;
+/// if (instance.NewExecutionContext(&context2) != kTfLiteOk) return;
+/// // context1 and context2 may now be invoked from different threads.
+/// </code></pre>
+///
+/// The model and the op resolver must outlive the instance, and the instance
+/// must outlive the contexts created from it. Each context must only be used
+/// by one thread at a time, like any interpreter.
+/// WARNING: This is an experimental API and subject to change.
+class ModelInstance {
+ public:
+  /// `options_experimental` is copied, and applied to every context.
+  ModelInstance(const FlatBufferModel& model, const OpResolver& op_resolver,
+                const InterpreterOptions* options_experimental = nullptr);
+
+  ModelInstance(const ModelInstance&) = delete;
+  ModelInstance& operator=(const ModelInstance&) = delete;
+
+  /// Builds a new execution context with `num_threads` threads (-1 lets TFLite
+  /// choose), and allocates its tensors. Resizing the inputs of the context
+  /// and calling AllocateTensors() again afterwards is allowed. Thread-safe.
+  TfLiteStatus NewExecutionContext(std::unique_ptr<Interpreter>* interpreter,
+                                   int num_threads = -1);
+
+  /// Persists the weights derived from the model in the file at `path`, so
+  /// that the next processes creating an instance of the same model map them
+  /// from the file instead of computing them again. `model_token` must
+  /// identify the content of the model, e.g. with delegates::StrFingerprint().
+  /// The file is written when a context computes weights that it doesn't hold
+  /// yet. Must be called before the first context is created. The weights
+  /// packed by the default XNNPACK delegate are not persisted.
+  TfLiteStatus SetWeightsCacheFile(const std::string& path,
+                                   const std::string& model_token);
+
+  /// Returns the cache holding the weights shared by the contexts.
+  const SharedWeightsCache& weights_cache() const { return weights_cache_; }
+
+ private:
+  const FlatBufferModel& model_;
+  const OpResolver& op_resolver_;
+  std::unique_ptr<InterpreterOptions> options_;
+
+  // Serializes the creation of contexts, so that delegate caches are only
+  // finalized once all contexts being created have packed their weights.
+  std::mutex mutex_;
+  SharedWeightsCache weights_cache_;
+};
+
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_MODEL_INSTANCE_H_
@@ -0,0 +1,261 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/lite/model_instance.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "flatbuffers/flatbuffers.h"  // from @flatbuffers
+#include "tensorflow/lite/allocation.h"
+#include "tensorflow/lite/core/c/common.h"
+#include "tensorflow/lite/core/kernels/register.h"
+#include "tensorflow/lite/interpreter.h"
+#include "tensorflow/lite/interpreter_builder.h"
+#include "tensorflow/lite/model_builder.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+#include "tensorflow/lite/testing/util.h"
+#include "tensorflow/lite/util.h"
+#include "tensorflow/lite/version.h"
+
+namespace tflite {
+namespace {
+
+using ::testing::ElementsAre;
+
+// Builds a model computing `input + dequantize(weights)`, where the weights
+// {1, 2, 3, 4} are stored as a constant fp16 tensor.
+class DequantizeAddModel {
+ public:
+  DequantizeAddModel() {
+    flatbuffers::FlatBufferBuilder builder;
+    const std::vector<uint16_t> weights = {0x3C00, 0x4000, 0x4200, 0x4400};
+    auto buffers = builder.CreateVector(std::vector<flatbuffers::Offset<Buffer>>{
+        CreateBuffer(builder),
+        CreateBuffer(builder,
+                     builder.CreateVector(
+                         reinterpret_cast<const uint8_t*>(weights.data()),
+                         weights.size() * sizeof(uint16_t)))});
+
+    const std::vector<int32_t> shape = {4};
+    auto tensors = builder.CreateVector(std::vector<flatbuffers::Offset<Tensor>>{
+        CreateTensor(builder, builder.CreateVector(shape), TensorType_FLOAT16,
+                     /*buffer=*/1, builder.CreateString("weights")),
+        CreateTensor(builder, builder.CreateVector(shape), TensorType_FLOAT32,
+                     /*buffer=*/0, builder.CreateString("dequantized")),
+        CreateTensor(builder, builder.CreateVector(shape), TensorType_FLOAT32,
+                     /*buffer=*/0, builder.CreateString("input")),
+        CreateTensor(builder, builder.CreateVector(shape), TensorType_FLOAT32,
+                     /*buffer=*/0, builder.CreateString("output"))});
+
+    auto operator_codes =
+        builder.CreateVector(std::vector<flatbuffers::Offset<OperatorCode>>{
+            CreateOperatorCode(builder, BuiltinOperator_DEQUANTIZE),
+            CreateOperatorCode(builder, BuiltinOperator_ADD)});
+    const std::vector<int32_t> dequantize_inputs = {0};
+    const std::vector<int32_t> dequantize_outputs = {1};
+    const std::vector<int32_t> add_inputs = {2, 1};
+    const std::vector<int32_t> add_outputs = {3};
+    auto operators =
+        builder.CreateVector(std::vector<flatbuffers::Offset<Operator>>{
+            CreateOperator(builder, /*opcode_index=*/0,
+                           builder.CreateVector(dequantize_inputs),
+                           builder.CreateVector(dequantize_outputs)),
+            CreateOperator(builder, /*opcode_index=*/1,
+                           builder.CreateVector(add_inputs),
+                           builder.CreateVector(add_outputs),
+                           BuiltinOptions_AddOptions,
+                           CreateAddOptions(builder).Union())});
+
+    const std::vector<int32_t> subgraph_inputs = {2};
+    const std::vector<int32_t> subgraph_outputs = {3};
+    auto subgraphs =
+        builder.CreateVector(std::vector<flatbuffers::Offset<SubGraph>>{
+            CreateSubGraph(builder, tensors,
+                           builder.CreateVector(subgraph_inputs),
+                           builder.CreateVector(subgraph_outputs), operators,
+                           builder.CreateString("main"))});
+    FinishModelBuffer(
+        builder, CreateModel(builder, TFLITE_SCHEMA_VERSION, operator_codes,
+                             subgraphs, builder.CreateString("test"), buffers));
+
+    buffer_.assign(builder.GetBufferPointer(),
+                   builder.GetBufferPointer() + builder.GetSize());
+    model_ = FlatBufferModel::BuildFromBuffer(
+        reinterpret_cast<const char*>(buffer_.data()), buffer_.size());
+  }
+
+  const FlatBufferModel& model() const { return *model_; }
+
+ private:
+  std::vector<uint8_t> buffer_;
+  std::unique_ptr<FlatBufferModel> model_;
+};
+
+std::vector<float> Run(Interpreter* interpreter, float value) {
+  float* input = interpreter->typed_input_tensor<float>(0);
+  for (int i = 0; i < 4; ++i) input[i] = value;
+  if (interpreter->Invoke() != kTfLiteOk) return {};
+  const float* output = interpreter->typed_output_tensor<float>(0);
+  return std::vector<float>(output, output + 4);
+}
+
+TEST(ModelInstanceTest, ContextsShareDequantizedWeights) {
+  DequantizeAddModel model;
+  ops::builtin::BuiltinOpResolverWithoutDefaultDelegates resolver;
+  ModelInstance instance(model.model(), resolver);
+
+  std::unique_ptr<Interpreter> context1, context2;
+  ASSERT_EQ(instance.NewExecutionContext(&context1), kTfLiteOk);
+  ASSERT_EQ(instance.NewExecutionContext(&context2), kTfLiteOk);
+
+  // Both contexts point to the single copy of the dequantized weights, and
+  // neither of them allocated it in its arena.
+  EXPECT_EQ(instance.weights_cache().num_buffers(), 1);
+  EXPECT_EQ(instance.weights_cache().size_in_bytes(), 4 * sizeof(float));
+  const TfLiteTensor* dequantized1 = context1->tensor(1);
+  const TfLiteTensor* dequantized2 = context2->tensor(1);
+  EXPECT_EQ(dequantized1->allocation_type, kTfLiteMmapRo);
+  EXPECT_EQ(dequantized1->data.raw, dequantized2->data.raw);
+
+  EXPECT_THAT(Run(context1.get(), 1.0f), ElementsAre(2, 3, 4, 5));
+  EXPECT_THAT(Run(context2.get(), 10.0f), ElementsAre(11, 12, 13, 14));
+  EXPECT_THAT(Run(context1.get(), 0.0f), ElementsAre(1, 2, 3, 4));
+}
+
+TEST(ModelInstanceTest, ContextsRunConcurrently) {
+  DequantizeAddModel model;
+  ops::builtin::BuiltinOpResolverWithoutDefaultDelegates resolver;
+  ModelInstance instance(model.model(), resolver);
+
+  constexpr int kNumContexts = 4;
+  std::vector<std::unique_ptr<Interpreter>> contexts(kNumContexts);
+  for (auto& context : contexts) {
+    ASSERT_EQ(instance.NewExecutionContext(&context, /*num_threads=*/1),
+              kTfLiteOk);
+  }
+
+  std::vector<bool> ok(kNumContexts, false);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kNumContexts; ++i) {
+    threads.emplace_back([&, i] {
+      bool all_ok = true;
+      for (int iteration = 0; iteration < 100; ++iteration) {
+        const float value = i * 100 + iteration;
+        all_ok &= Run(contexts[i].get(), value) ==
+                  std::vector<float>({value + 1, value + 2, value + 3,
+                                      value + 4});
+      }
+      ok[i] = all_ok;
+    });
+  }
+  for (auto& thread : threads) thread.join();
+
+  EXPECT_THAT(ok, ElementsAre(true, true, true, true));
+  EXPECT_EQ(instance.weights_cache().num_buffers(), 1);
+}
+
+TEST(ModelInstanceTest, ContextsWithCustomAllocations) {
+  DequantizeAddModel model;
+  ops::builtin::BuiltinOpResolverWithoutDefaultDelegates resolver;
+  ModelInstance instance(model.model(), resolver);
+
+  std::unique_ptr<Interpreter> context1, context2;
+  ASSERT_EQ(instance.NewExecutionContext(&context1), kTfLiteOk);
+  ASSERT_EQ(instance.NewExecutionContext(&context2), kTfLiteOk);
+
+  // The shared weights aren't mistaken for custom allocations when the custom
+  // allocations of the context are verified.
+  alignas(kDefaultTensorAlignment) float input[4];
+  ASSERT_EQ(context1->SetCustomAllocationForTensor(
+                context1->inputs()[0], {input, sizeof(input)}),
+            kTfLiteOk);
+  ASSERT_EQ(context1->AllocateTensors(), kTfLiteOk);
+  EXPECT_EQ(context1->typed_input_tensor<float>(0), input);
+  EXPECT_EQ(context1->tensor(1)->data.raw, context2->tensor(1)->data.raw);
+
+  EXPECT_THAT(Run(context1.get(), 1.0f), ElementsAre(2, 3, 4, 5));
+  EXPECT_THAT(Run(context2.get(), 10.0f), ElementsAre(11, 12, 13, 14));
+  EXPECT_EQ(instance.weights_cache().num_buffers(), 1);
+}
+
+TEST(ModelInstanceTest, InterpretersWithoutCacheOwnTheirWeights) {
+  DequantizeAddModel model;
+  ops::builtin::BuiltinOpResolverWithoutDefaultDelegates resolver;
+  std::unique_ptr<Interpreter> interpreter;
+  ASSERT_EQ(InterpreterBuilder(model.model(), resolver)(&interpreter),
+            kTfLiteOk);
+  ASSERT_EQ(interpreter->AllocateTensors(), kTfLiteOk);
+
+  EXPECT_EQ(interpreter->tensor(1)->allocation_type, kTfLiteArenaRwPersistent);
+  EXPECT_THAT(Run(interpreter.get(), 1.0f), ElementsAre(2, 3, 4, 5));
+}
+
+TEST(ModelInstanceTest, NextInstancesMapWeightsFromCacheFile) {
+  if (!MMAPAllocation::IsSupported()) GTEST_SKIP();
+  const std::string path = ::testing::TempDir() + "/weights_cache_mapped";
+  std::remove(path.c_str());
+  ops::builtin::BuiltinOpResolverWithoutDefaultDelegates resolver;
+  {
+    DequantizeAddModel model;
+    ModelInstance instance(model.model(), resolver);
+    ASSERT_EQ(instance.SetWeightsCacheFile(path, "model"), kTfLiteOk);
+    std::unique_ptr<Interpreter> context;
+    ASSERT_EQ(instance.NewExecutionContext(&context), kTfLiteOk);
+    EXPECT_EQ(instance.weights_cache().num_mapped_buffers(), 0);
+  }
+
+  // The same model loaded at another address, as in another process.
+  DequantizeAddModel model;
+  ModelInstance instance(model.model(), resolver);
+  ASSERT_EQ(instance.SetWeightsCacheFile(path, "model"), kTfLiteOk);
+  std::unique_ptr<Interpreter> context1, context2;
+  ASSERT_EQ(instance.NewExecutionContext(&context1), kTfLiteOk);
+  ASSERT_EQ(instance.NewExecutionContext(&context2), kTfLiteOk);
+  EXPECT_EQ(instance.weights_cache().num_buffers(), 1);
+  EXPECT_EQ(instance.weights_cache().num_mapped_buffers(), 1);
+  EXPECT_EQ(context1->tensor(1)->data.raw, context2->tensor(1)->data.raw);
+  EXPECT_THAT(Run(context1.get(), 1.0f), ElementsAre(2, 3, 4, 5));
+  EXPECT_THAT(Run(context2.get(), 10.0f), ElementsAre(11, 12, 13, 14));
+}
+
+TEST(ModelInstanceTest, CacheFileOfAnotherModelIsIgnored) {
+  if (!MMAPAllocation::IsSupported()) GTEST_SKIP();
+  const std::string path = ::testing::TempDir() + "/weights_cache_stale";
+  std::remove(path.c_str());
+  DequantizeAddModel model;
+  ops::builtin::BuiltinOpResolverWithoutDefaultDelegates resolver;
+  {
+    ModelInstance instance(model.model(), resolver);
+    ASSERT_EQ(instance.SetWeightsCacheFile(path, "model1"), kTfLiteOk);
+    std::unique_ptr<Interpreter> context;
+    ASSERT_EQ(instance.NewExecutionContext(&context), kTfLiteOk);
+  }
+
+  ModelInstance instance(model.model(), resolver);
+  ASSERT_EQ(instance.SetWeightsCacheFile(path, "model2"), kTfLiteOk);
+  std::unique_ptr<Interpreter> context;
+  ASSERT_EQ(instance.NewExecutionContext(&context), kTfLiteOk);
+  EXPECT_EQ(instance.weights_cache().num_mapped_buffers(), 0);
+  EXPECT_THAT(Run(context.get(), 1.0f), ElementsAre(2, 3, 4, 5));
+}
+
+}  // namespace
+}  // namespace tflite
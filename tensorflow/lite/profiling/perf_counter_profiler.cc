@@ -0,0 +1,255 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/lite/profiling/perf_counter_profiler.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "tensorflow/lite/profiling/profile_buffer.h"
+#include "tensorflow/lite/profiling/time.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace tflite {
+namespace profiling {
+
+// The counters of the thread which created it, read at once as a group.
+class PerfCounterProfiler::CounterGroup {
+ public:
+  CounterGroup() {
+#ifdef __linux__
+    // Cycles are the leader of the group: the other counters are optional,
+    // as e.g. cache misses aren't exposed by some virtual machines.
+    const uint64_t configs[kNumCounters] = {PERF_COUNT_HW_CPU_CYCLES,
+                                            PERF_COUNT_HW_INSTRUCTIONS,
+                                            PERF_COUNT_HW_CACHE_MISSES};
+    for (int i = 0; i < kNumCounters; ++i) {
+      perf_event_attr attr = {};
+      attr.size = sizeof(attr);
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = configs[i];
+      attr.disabled = i == 0;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_GROUP;
+      const int fd = syscall(__NR_perf_event_open, &attr, /*pid=*/0,
+                             /*cpu=*/-1, /*group_fd=*/i == 0 ? -1 : fds_[0],
+                             /*flags=*/0);
+      if (fd < 0) {
+        if (i == 0) return;
+        continue;
+      }
+      fds_[i] = fd;
+      read_order_[num_open_++] = i;
+    }
+    if (ioctl(fds_[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP) != 0 ||
+        ioctl(fds_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) != 0) {
+      Close();
+    }
+#endif
+  }
+
+  ~CounterGroup() { Close(); }
+
+  bool ok() const { return num_open_ > 0; }
+
+  // Reads the current values of the counters, leaving the counters which
+  // couldn't be opened to 0.
+  PerfCounters Read() const {
+    PerfCounters counters;
+#ifdef __linux__
+    if (!ok()) return counters;
+    uint64_t values[1 + kNumCounters] = {};
+    if (read(fds_[0], values, sizeof(values)) <= 0) return counters;
+    for (uint64_t i = 0; i < values[0] && i < num_open_; ++i) {
+      uint64_t* counter = read_order_[i] == 0   ? &counters.cycles
+                          : read_order_[i] == 1 ? &counters.instructions
+                                                : &counters.cache_misses;
+      *counter = values[1 + i];
+    }
+#endif
+    return counters;
+  }
+
+ private:
+  static constexpr int kNumCounters = 3;
+
+  void Close() {
+#ifdef __linux__
+    for (int i = kNumCounters - 1; i >= 0; --i) {
+      if (fds_[i] >= 0) close(fds_[i]);
+      fds_[i] = -1;
+    }
+#endif
+    num_open_ = 0;
+  }
+
+  int fds_[kNumCounters] = {-1, -1, -1};
+  // The indices in `fds_` of the values read for the group.
+  int read_order_[kNumCounters] = {};
+  uint64_t num_open_ = 0;
+};
+
+NodeMemoryTraffic EstimateNodeMemoryTraffic(const Interpreter& interpreter,
+                                            int subgraph_index,
+                                            int node_index) {
+  NodeMemoryTraffic traffic;
+  const Subgraph* subgraph = interpreter.subgraph(subgraph_index);
+  const auto* node_and_registration =
+      subgraph == nullptr ? nullptr
+                          : subgraph->node_and_registration(node_index);
+  if (node_and_registration == nullptr) return traffic;
+  const TfLiteNode& node = node_and_registration->first;
+  for (int i = 0; i < node.inputs->size; ++i) {
+    const TfLiteTensor* tensor = subgraph->tensor(node.inputs->data[i]);
+    if (tensor != nullptr) traffic.bytes_read += tensor->bytes;
+  }
+  for (int i = 0; i < node.outputs->size; ++i) {
+    const TfLiteTensor* tensor = subgraph->tensor(node.outputs->data[i]);
+    if (tensor != nullptr) traffic.bytes_written += tensor->bytes;
+  }
+  return traffic;
+}
+
+PerfCounterProfiler::PerfCounterProfiler() = default;
+
+PerfCounterProfiler::~PerfCounterProfiler() = default;
+
+bool PerfCounterProfiler::IsSupported() { return CounterGroup().ok(); }
+
+PerfCounterProfiler::CounterGroup* PerfCounterProfiler::GetCounterGroup() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::unique_ptr<CounterGroup>& group = groups_[std::this_thread::get_id()];
+  if (group == nullptr) group = std::make_unique<CounterGroup>();
+  return group.get();
+}
+
+uint32_t PerfCounterProfiler::BeginEvent(const char* tag, EventType event_type,
+                                         int64_t event_metadata1,
+                                         int64_t event_metadata2) {
+  if (!enabled_ || event_type != EventType::OPERATOR_INVOKE_EVENT) {
+    return kInvalidEventHandle;
+  }
+  OpenEvent event;
+  event.tag = tag;
+  event.node_index = static_cast<int>(event_metadata1);
+  event.subgraph_index = static_cast<int>(event_metadata2);
+  event.group = GetCounterGroup();
+  event.start_us = time::NowMicros();
+  // The counters are read last so that they include as little as possible of
+  // the profiler itself.
+  event.counters = event.group->Read();
+  std::lock_guard<std::mutex> lock(mutex_);
+  const uint32_t handle = next_event_handle_++;
+  if (next_event_handle_ == kInvalidEventHandle) next_event_handle_ = 0;
+  open_events_[handle] = event;
+  return handle;
+}
+
+void PerfCounterProfiler::EndEvent(uint32_t event_handle) {
+  if (event_handle == kInvalidEventHandle) return;
+  OpenEvent event;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = open_events_.find(event_handle);
+    if (it == open_events_.end()) return;
+    event = it->second;
+  }
+  // The event ends on the thread it began on, which owns `event.group`.
+  const PerfCounters counters = event.group->Read();
+  const uint64_t end_us = time::NowMicros();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  open_events_.erase(event_handle);
+  OpPerfStats& stats = stats_[{event.subgraph_index, event.node_index}];
+  stats.tag = event.tag;
+  stats.subgraph_index = event.subgraph_index;
+  stats.node_index = event.node_index;
+  ++stats.invocations;
+  stats.elapsed_us += end_us - event.start_us;
+  stats.counters.cycles += counters.cycles - event.counters.cycles;
+  stats.counters.instructions +=
+      counters.instructions - event.counters.instructions;
+  stats.counters.cache_misses +=
+      counters.cache_misses - event.counters.cache_misses;
+}
+
+void PerfCounterProfiler::Reset() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  open_events_.clear();
+  stats_.clear();
+}
+
+std::vector<OpPerfStats> PerfCounterProfiler::GetOpStats() const {
+  std::vector<OpPerfStats> result;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& stats : stats_) result.push_back(stats.second);
+  }
+  std::stable_sort(result.begin(), result.end(),
+                   [](const OpPerfStats& a, const OpPerfStats& b) {
+                     return a.elapsed_us > b.elapsed_us;
+                   });
+  return result;
+}
+
+std::string PerfCounterProfiler::GetOutputString(
+    const Interpreter& interpreter) const {
+  // Cache misses are counted in lines of (usually) 64 bytes.
+  constexpr int kCacheLineSize = 64;
+  std::stringstream stream;
+  stream << std::fixed << std::setprecision(3);
+  stream << "Per-op hardware counters (averaged per invocation):\n";
+  stream << std::setw(24) << "[node type]" << std::setw(12) << "[subgraph]"
+         << std::setw(8) << "[node]" << std::setw(12) << "[avg us]"
+         << std::setw(14) << "[cycles]" << std::setw(16) << "[instructions]"
+         << std::setw(8) << "[IPC]" << std::setw(14) << "[LLC misses]"
+         << std::setw(14) << "[bytes read]" << std::setw(16)
+         << "[bytes written]" << std::setw(14) << "[miss bytes]"
+         << std::setw(14) << "[instr/byte]" << std::setw(10) << "[MB/s]"
+         << "\n";
+  for (const OpPerfStats& stats : GetOpStats()) {
+    const double invocations = stats.invocations;
+    const double avg_us = stats.elapsed_us / invocations;
+    const double cycles = stats.counters.cycles / invocations;
+    const double instructions = stats.counters.instructions / invocations;
+    const double cache_misses = stats.counters.cache_misses / invocations;
+    const NodeMemoryTraffic traffic = EstimateNodeMemoryTraffic(
+        interpreter, stats.subgraph_index, stats.node_index);
+    const double bytes = traffic.bytes_read + traffic.bytes_written;
+    stream << std::setw(24) << stats.tag << std::setw(12)
+           << stats.subgraph_index << std::setw(8) << stats.node_index
+           << std::setw(12) << avg_us << std::setw(14) << cycles
+           << std::setw(16) << instructions << std::setw(8)
+           << (cycles > 0 ? instructions / cycles : 0.0) << std::setw(14)
+           << cache_misses << std::setw(14) << traffic.bytes_read
+           << std::setw(16) << traffic.bytes_written << std::setw(14)
+           << cache_misses * kCacheLineSize << std::setw(14)
+           << (bytes > 0 ? instructions / bytes : 0.0) << std::setw(10)
+           << (avg_us > 0 ? bytes / avg_us : 0.0) << "\n";
+  }
+  return stream.str();
+}
+
+}  // namespace profiling
+}  // namespace tflite
@@ -0,0 +1,126 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_LITE_PROFILING_PERF_COUNTER_PROFILER_H_
+#define TENSORFLOW_LITE_PROFILING_PERF_COUNTER_PROFILER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>  // NOLINT(build/c++11)
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "tensorflow/lite/core/api/profiler.h"
+#include "tensorflow/lite/core/interpreter.h"
+
+namespace tflite {
+namespace profiling {
+
+// Hardware counters of a thread.
+struct PerfCounters {
+  uint64_t cycles = 0;
+  uint64_t instructions = 0;
+  // Last-level cache misses.
+  uint64_t cache_misses = 0;
+};
+
+// The invocations of an op recorded by PerfCounterProfiler.
+struct OpPerfStats {
+  std::string tag;
+  int subgraph_index = 0;
+  int node_index = 0;
+  int64_t invocations = 0;
+  // Accumulated over the invocations.
+  int64_t elapsed_us = 0;
+  PerfCounters counters;
+};
+
+// Bytes read from the inputs and written to the outputs of a node by one
+// invocation.
+struct NodeMemoryTraffic {
+  int64_t bytes_read = 0;
+  int64_t bytes_written = 0;
+};
+
+// Estimates the memory traffic of a node from the sizes of its input and
+// output tensors, assuming each of them is accessed once.
+NodeMemoryTraffic EstimateNodeMemoryTraffic(const Interpreter& interpreter,
+                                            int subgraph_index,
+                                            int node_index);
+
+// Profiler reading the Linux perf_event counters of cycles, instructions and
+// last-level cache misses around each op invocation.
+//
+// Only the thread invoking an op is counted, not the threads of the CPU
+// backend it may dispatch work to, so the counters are most accurate with a
+// single intra-op thread. Where perf_event_open isn't available or permitted
+// (see /proc/sys/kernel/perf_event_paranoid), only the latencies are recorded.
+class PerfCounterProfiler : public tflite::Profiler {
+ public:
+  PerfCounterProfiler();
+  ~PerfCounterProfiler() override;
+
+  // Returns whether the counters can be read on the calling thread.
+  static bool IsSupported();
+
+  uint32_t BeginEvent(const char* tag, EventType event_type,
+                      int64_t event_metadata1,
+                      int64_t event_metadata2) override;
+
+  void EndEvent(uint32_t event_handle) override;
+
+  void StartProfiling() { enabled_ = true; }
+  void StopProfiling() { enabled_ = false; }
+  void Reset();
+
+  // Returns the stats of the invoked ops, by decreasing total latency.
+  std::vector<OpPerfStats> GetOpStats() const;
+
+  // Returns a table of the average latency and counters per invocation of
+  // each op, with its memory traffic estimated by EstimateNodeMemoryTraffic
+  // and its arithmetic intensity, in instructions per byte of that traffic.
+  std::string GetOutputString(const Interpreter& interpreter) const;
+
+ private:
+  class CounterGroup;
+
+  struct OpenEvent {
+    const char* tag;
+    int subgraph_index;
+    int node_index;
+    CounterGroup* group;
+    PerfCounters counters;
+    uint64_t start_us;
+  };
+
+  CounterGroup* GetCounterGroup();
+
+  std::atomic<bool> enabled_{false};
+  mutable std::mutex mutex_;
+  // Counters are opened lazily for each thread invoking ops.
+  std::unordered_map<std::thread::id, std::unique_ptr<CounterGroup>> groups_;
+  std::unordered_map<uint32_t, OpenEvent> open_events_;
+  uint32_t next_event_handle_ = 0;
+  std::map<std::pair<int, int>, OpPerfStats> stats_;
+};
+
+}  // namespace profiling
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_PROFILING_PERF_COUNTER_PROFILER_H_
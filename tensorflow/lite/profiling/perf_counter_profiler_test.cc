@@ -0,0 +1,101 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/lite/profiling/perf_counter_profiler.h"
+
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "tensorflow/lite/kernels/test_util.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+
+namespace tflite {
+namespace profiling {
+namespace {
+
+using ::testing::HasSubstr;
+
+class AddOpModel : public SingleOpModel {
+ public:
+  AddOpModel() {
+    input1_ = AddInput({TensorType_FLOAT32, {2, 8}});
+    input2_ = AddInput({TensorType_FLOAT32, {2, 8}});
+    output_ = AddOutput({TensorType_FLOAT32, {}});
+    SetBuiltinOp(BuiltinOperator_ADD, BuiltinOptions_AddOptions,
+                 CreateAddOptions(builder_).Union());
+    BuildInterpreter({GetShape(input1_), GetShape(input2_)});
+    PopulateTensor(input1_, std::vector<float>(16, 1.0f));
+    PopulateTensor(input2_, std::vector<float>(16, 2.0f));
+  }
+
+  Interpreter* GetInterpreter() { return interpreter_.get(); }
+
+ private:
+  int input1_;
+  int input2_;
+  int output_;
+};
+
+TEST(PerfCounterProfilerTest, EstimatesMemoryTraffic) {
+  AddOpModel m;
+  const NodeMemoryTraffic traffic =
+      EstimateNodeMemoryTraffic(*m.GetInterpreter(), 0, 0);
+  EXPECT_EQ(traffic.bytes_read, 2 * 16 * sizeof(float));
+  EXPECT_EQ(traffic.bytes_written, 16 * sizeof(float));
+
+  const NodeMemoryTraffic missing =
+      EstimateNodeMemoryTraffic(*m.GetInterpreter(), 0, 1);
+  EXPECT_EQ(missing.bytes_read, 0);
+  EXPECT_EQ(missing.bytes_written, 0);
+}
+
+TEST(PerfCounterProfilerTest, RecordsOpInvocations) {
+  AddOpModel m;
+  PerfCounterProfiler profiler;
+  m.GetInterpreter()->SetProfiler(&profiler);
+
+  // Nothing is recorded before profiling starts.
+  ASSERT_EQ(m.Invoke(), kTfLiteOk);
+  EXPECT_TRUE(profiler.GetOpStats().empty());
+
+  profiler.StartProfiling();
+  ASSERT_EQ(m.Invoke(), kTfLiteOk);
+  ASSERT_EQ(m.Invoke(), kTfLiteOk);
+  profiler.StopProfiling();
+  ASSERT_EQ(m.Invoke(), kTfLiteOk);
+
+  const std::vector<OpPerfStats> stats = profiler.GetOpStats();
+  ASSERT_EQ(stats.size(), 1);
+  EXPECT_EQ(stats[0].tag, "ADD");
+  EXPECT_EQ(stats[0].subgraph_index, 0);
+  EXPECT_EQ(stats[0].node_index, 0);
+  EXPECT_EQ(stats[0].invocations, 2);
+  EXPECT_GE(stats[0].elapsed_us, 0);
+  if (PerfCounterProfiler::IsSupported()) {
+    EXPECT_GT(stats[0].counters.cycles, 0);
+  }
+
+  const std::string output = profiler.GetOutputString(*m.GetInterpreter());
+  EXPECT_THAT(output, HasSubstr("[instr/byte]"));
+  EXPECT_THAT(output, HasSubstr("ADD"));
+
+  profiler.Reset();
+  EXPECT_TRUE(profiler.GetOpStats().empty());
+}
+
+}  // namespace
+}  // namespace profiling
+}  // namespace tflite
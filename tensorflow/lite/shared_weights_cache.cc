@@ -0,0 +1,306 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/lite/shared_weights_cache.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <utility>
+#include <vector>
+
+#include "tensorflow/lite/allocation.h"
+#include "tensorflow/lite/core/c/common.h"
+#include "tensorflow/lite/minimal_logging.h"
+#include "tensorflow/lite/stderr_reporter.h"
+#include "tensorflow/lite/version.h"
+
+namespace tflite {
+namespace {
+
+constexpr size_t kBufferAlignment = 64;
+
+// A weights cache file is made of a FileHeader, the file key (see FileKey()),
+// `num_entries` FileRecords, and the data of the buffers, each one aligned to
+// kBufferAlignment bytes from the start of the file.
+constexpr char kFileMagic[8] = {'T', 'F', 'L', 'W', 'C', 'A', 'C', 'H'};
+constexpr uint32_t kFileVersion = 1;
+
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t key_size;
+  uint64_t model_size;
+  uint64_t num_entries;
+};
+
+struct FileRecord {
+  uint64_t source_offset;
+  int64_t kind;
+  uint64_t data_offset;
+  uint64_t size;
+};
+
+size_t AlignTo(size_t offset) {
+  return (offset + kBufferAlignment - 1) & ~(kBufferAlignment - 1);
+}
+
+// The layout of the derived weights may change between TFLite versions, so the
+// files are only valid for the version that saved them.
+std::string FileKey(const std::string& model_token) {
+  return model_token + "@" + TFLITE_VERSION_STRING;
+}
+
+// Parses the `size` bytes of a weights cache file at `data`, and returns false
+// if the file is corrupted or wasn't saved for `key` and `model_size`.
+bool ParseFile(const char* data, size_t size, const std::string& key,
+               size_t model_size, std::vector<FileRecord>* records) {
+  FileHeader header;
+  if (size < sizeof(header)) return false;
+  std::memcpy(&header, data, sizeof(header));
+  if (std::memcmp(header.magic, kFileMagic, sizeof(kFileMagic)) != 0 ||
+      header.version != kFileVersion || header.key_size != key.size() ||
+      header.model_size != model_size) {
+    return false;
+  }
+  size_t offset = sizeof(header);
+  if (size - offset < key.size() ||
+      std::memcmp(data + offset, key.data(), key.size()) != 0) {
+    return false;
+  }
+  offset += key.size();
+  if (header.num_entries > (size - offset) / sizeof(FileRecord)) return false;
+  records->resize(header.num_entries);
+  std::memcpy(records->data(), data + offset,
+              header.num_entries * sizeof(FileRecord));
+  for (const FileRecord& record : *records) {
+    if (record.source_offset >= model_size ||
+        record.data_offset % kBufferAlignment != 0 ||
+        record.data_offset > size || record.size > size - record.data_offset) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+SharedWeightsCache::SharedWeightsCache() {
+  this->type = kTfLiteSharedWeightsContext;
+  this->Refresh = nullptr;
+}
+
+SharedWeightsCache::~SharedWeightsCache() {
+  for (auto& [name, delegate_cache] : delegate_caches_) {
+    if (delegate_cache.destroy) delegate_cache.destroy(delegate_cache.cache);
+  }
+}
+
+SharedWeightsCache* SharedWeightsCache::Get(TfLiteContext* context) {
+  return static_cast<SharedWeightsCache*>(
+      context->GetExternalContext(context, kTfLiteSharedWeightsContext));
+}
+
+const void* SharedWeightsCache::GetOrCreate(
+    const void* source, int kind, size_t size,
+    const std::function<TfLiteStatus(void*)>& init) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto key = std::make_tuple(source, kind);
+  auto it = buffers_.find(key);
+  if (it != buffers_.end()) {
+    return it->second.size == size ? it->second.data : nullptr;
+  }
+
+  size_t source_offset;
+  const bool is_model_data = GetModelDataOffset(source, &source_offset);
+  if (is_model_data) {
+    auto entry = file_entries_.find(std::make_tuple(source_offset, kind));
+    if (entry != file_entries_.end() && entry->second.size == size) {
+      Buffer buffer;
+      buffer.data = const_cast<char*>(static_cast<const char*>(file_->base()) +
+                                      entry->second.data_offset);
+      buffer.size = size;
+      size_in_bytes_ += size;
+      ++num_mapped_buffers_;
+      return buffers_.emplace(key, std::move(buffer)).first->second.data;
+    }
+  }
+
+  Buffer buffer;
+  buffer.storage.reset(new char[size + kBufferAlignment]);
+  auto address = reinterpret_cast<uintptr_t>(buffer.storage.get());
+  buffer.data = reinterpret_cast<void*>(
+      (address + kBufferAlignment - 1) & ~(kBufferAlignment - 1));
+  buffer.size = size;
+  if (init(buffer.data) != kTfLiteOk) return nullptr;
+
+  size_in_bytes_ += size;
+  if (is_model_data && !file_path_.empty()) has_unsaved_buffers_ = true;
+  return buffers_.emplace(key, std::move(buffer)).first->second.data;
+}
+
+void* SharedWeightsCache::GetOrCreateDelegateCache(
+    const std::string& name, const std::function<void*()>& create,
+    void (*destroy)(void*), bool (*finalize)(void*)) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = delegate_caches_.find(name);
+  if (it != delegate_caches_.end()) return it->second.cache;
+
+  void* cache = create();
+  if (cache == nullptr) return nullptr;
+  delegate_caches_.emplace(
+      name, DelegateCache{cache, destroy, finalize, /*finalized=*/false});
+  return cache;
+}
+
+TfLiteStatus SharedWeightsCache::Finalize() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto& [name, delegate_cache] : delegate_caches_) {
+    if (delegate_cache.finalized || !delegate_cache.finalize) continue;
+    if (!delegate_cache.finalize(delegate_cache.cache)) return kTfLiteError;
+    delegate_cache.finalized = true;
+  }
+  return kTfLiteOk;
+}
+
+TfLiteStatus SharedWeightsCache::LoadFromFile(const std::string& path,
+                                              const std::string& model_token,
+                                              const void* model_data,
+                                              size_t model_size) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!buffers_.empty() || !file_path_.empty()) return kTfLiteError;
+  file_path_ = path;
+  model_token_ = model_token;
+  model_data_ = static_cast<const char*>(model_data);
+  model_size_ = model_size;
+
+  // The first load of the model doesn't find the file, which isn't an error.
+  if (!MMAPAllocation::IsSupported() || !std::ifstream(path).good()) {
+    return kTfLiteOk;
+  }
+  auto file =
+      std::make_unique<MMAPAllocation>(path.c_str(), DefaultErrorReporter());
+  std::vector<FileRecord> records;
+  if (!file->valid() ||
+      !ParseFile(static_cast<const char*>(file->base()), file->bytes(),
+                 FileKey(model_token), model_size, &records)) {
+    TFLITE_LOG_PROD(TFLITE_LOG_WARNING,
+                    "Ignoring the stale weights cache file %s.", path.c_str());
+    return kTfLiteOk;
+  }
+  for (const FileRecord& record : records) {
+    file_entries_[std::make_tuple(static_cast<size_t>(record.source_offset),
+                                  static_cast<int>(record.kind))] =
+        FileEntry{static_cast<size_t>(record.data_offset),
+                  static_cast<size_t>(record.size)};
+  }
+  file_ = std::move(file);
+  return kTfLiteOk;
+}
+
+TfLiteStatus SharedWeightsCache::SaveToFile() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (file_path_.empty() || !has_unsaved_buffers_) return kTfLiteOk;
+
+  std::vector<FileRecord> records;
+  std::vector<const Buffer*> saved_buffers;
+  for (const auto& [key, buffer] : buffers_) {
+    size_t source_offset;
+    if (!GetModelDataOffset(std::get<0>(key), &source_offset)) continue;
+    records.push_back(FileRecord{source_offset, std::get<1>(key),
+                                 /*data_offset=*/0, buffer.size});
+    saved_buffers.push_back(&buffer);
+  }
+  const std::string key = FileKey(model_token_);
+  size_t offset = AlignTo(sizeof(FileHeader) + key.size() +
+                          records.size() * sizeof(FileRecord));
+  for (FileRecord& record : records) {
+    record.data_offset = offset;
+    offset = AlignTo(offset + record.size);
+  }
+
+  FileHeader header;
+  std::memcpy(header.magic, kFileMagic, sizeof(kFileMagic));
+  header.version = kFileVersion;
+  header.key_size = key.size();
+  header.model_size = model_size_;
+  header.num_entries = records.size();
+
+  // Write to a temporary file and rename it, as renaming is atomic in most
+  // systems.
+  const std::string temp_path =
+      file_path_ + "." + std::to_string(time(nullptr)) + "." +
+      std::to_string(reinterpret_cast<uintptr_t>(this));
+  {
+    std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+    const char padding[kBufferAlignment] = {};
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(key.data(), key.size());
+    out.write(reinterpret_cast<const char*>(records.data()),
+              records.size() * sizeof(FileRecord));
+    size_t position =
+        sizeof(header) + key.size() + records.size() * sizeof(FileRecord);
+    for (size_t i = 0; i < records.size(); ++i) {
+      out.write(padding, records[i].data_offset - position);
+      out.write(static_cast<const char*>(saved_buffers[i]->data),
+                records[i].size);
+      position = records[i].data_offset + records[i].size;
+    }
+    out.close();
+    if (!out) {
+      TFLITE_LOG_PROD(TFLITE_LOG_ERROR, "Could not write the weights cache %s.",
+                      temp_path.c_str());
+      std::remove(temp_path.c_str());
+      return kTfLiteError;
+    }
+  }
+  if (std::rename(temp_path.c_str(), file_path_.c_str()) != 0) {
+    TFLITE_LOG_PROD(TFLITE_LOG_ERROR, "Could not rename %s to %s.",
+                    temp_path.c_str(), file_path_.c_str());
+    std::remove(temp_path.c_str());
+    return kTfLiteError;
+  }
+  has_unsaved_buffers_ = false;
+  return kTfLiteOk;
+}
+
+bool SharedWeightsCache::GetModelDataOffset(const void* source,
+                                            size_t* offset) const {
+  const char* data = static_cast<const char*>(source);
+  if (model_data_ == nullptr || data < model_data_ ||
+      data >= model_data_ + model_size_) {
+    return false;
+  }
+  *offset = data - model_data_;
+  return true;
+}
+
+size_t SharedWeightsCache::num_buffers() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return buffers_.size();
+}
+
+size_t SharedWeightsCache::size_in_bytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return size_in_bytes_;
+}
+
+size_t SharedWeightsCache::num_mapped_buffers() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return num_mapped_buffers_;
+}
+
+}  // namespace tflite
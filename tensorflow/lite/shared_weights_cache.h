@@ -0,0 +1,158 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_LITE_SHARED_WEIGHTS_CACHE_H_
+#define TENSORFLOW_LITE_SHARED_WEIGHTS_CACHE_H_
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>  // NOLINT(build/c++11)
+#include <string>
+#include <tuple>
+
+#include "tensorflow/lite/allocation.h"
+#include "tensorflow/lite/core/c/common.h"
+
+namespace tflite {
+
+// This TfLiteExternalContext-derived class is the 'kTfLiteSharedWeightsContext'
+// context through which kernels share the weights they derive from constant
+// tensors (e.g. dequantized or densified weights, or weights packed by a
+// delegate) among all the interpreters running the same model. Constant
+// tensors of interpreters built from the same FlatBufferModel point into the
+// same model buffer, so derived weights are keyed by the address of the
+// constant data they are computed from.
+//
+// Kernels that find this context keep the derived weights in the cache instead
+// of their own persistent memory, so that each interpreter only owns its
+// activations and per-op state. See ModelInstance for the usual way of setting
+// up the sharing:
+//
+//  SharedWeightsCache* cache = new SharedWeightsCache();
+//  interpreter1->SetExternalContext(kTfLiteSharedWeightsContext, cache);
+//  interpreter2->SetExternalContext(kTfLiteSharedWeightsContext, cache);
+//
+// The cache is thread-safe, and must outlive all interpreters that use it.
+// Weights in the cache are never mutated after they are created, so the
+// interpreters may be invoked concurrently.
+//
+// The cache can also be backed by a file with LoadFromFile() and SaveToFile(),
+// so that the derived weights are computed by the first process that loads the
+// model, and memory-mapped from the file by the following ones.
+class SharedWeightsCache : public TfLiteExternalContext {
+ public:
+  SharedWeightsCache();
+  ~SharedWeightsCache();
+
+  // Returns the cache set on `context`, or nullptr if there is none.
+  static SharedWeightsCache* Get(TfLiteContext* context);
+
+  // Returns a buffer of `size` bytes with the weights of the given `kind`
+  // (usually the builtin code of the op that computes them) derived from the
+  // constant data at `source`. The first call for a key allocates the buffer
+  // and calls `init` to fill it; later calls return the same buffer. Returns
+  // nullptr if `init` fails, or if a buffer of a different size already exists
+  // for the key. The buffer is aligned to 64 bytes, like arena tensors.
+  const void* GetOrCreate(const void* source, int kind, size_t size,
+                          const std::function<TfLiteStatus(void*)>& init);
+
+  // Returns the delegate-specific cache registered with `name`, creating it
+  // with `create` on first use. The cache is destroyed with `destroy` when this
+  // cache is destroyed. `finalize`, if not null, is called once by Finalize().
+  void* GetOrCreateDelegateCache(const std::string& name,
+                                 const std::function<void*()>& create,
+                                 void (*destroy)(void*),
+                                 bool (*finalize)(void*));
+
+  // Finalizes the delegate caches that were created since the last call, e.g.
+  // because they must be finalized before the delegates that use them can run.
+  // Must be called after the delegates of an interpreter were applied (i.e.
+  // after AllocateTensors()) and before the interpreter is invoked.
+  TfLiteStatus Finalize();
+
+  // Backs the buffers derived from the constant data of a model with the file
+  // at `path`. The model data must be [model_data, model_data + model_size),
+  // and `model_token` must identify its content (see
+  // delegates::StrFingerprint()). If the file was saved for the same model
+  // token and TFLite version, its buffers are memory-mapped, and GetOrCreate()
+  // returns them instead of calling `init`. A missing or stale file is ignored.
+  // Must be called before the cache is used.
+  TfLiteStatus LoadFromFile(const std::string& path,
+                            const std::string& model_token,
+                            const void* model_data, size_t model_size);
+
+  // Writes the buffers derived from the model data to the file given to
+  // LoadFromFile(), if some of them were created since the file was loaded or
+  // last saved. The file is replaced atomically, so the buffers mapped from the
+  // previous file by this or other processes remain valid.
+  TfLiteStatus SaveToFile();
+
+  // Returns the number of shared buffers and their total size in bytes,
+  // excluding delegate caches.
+  size_t num_buffers() const;
+  size_t size_in_bytes() const;
+
+  // Returns the number of shared buffers mapped from the file given to
+  // LoadFromFile().
+  size_t num_mapped_buffers() const;
+
+ private:
+  struct Buffer {
+    // Null if the buffer is mapped from the file.
+    std::unique_ptr<char[]> storage;
+    void* data;
+    size_t size;
+  };
+
+  // A buffer saved in the file, keyed by the offset of its source in the model
+  // data and its kind.
+  struct FileEntry {
+    size_t data_offset;
+    size_t size;
+  };
+
+  struct DelegateCache {
+    void* cache;
+    void (*destroy)(void*);
+    bool (*finalize)(void*);
+    bool finalized;
+  };
+
+  // Returns true and sets `offset` if `source` points into the model data
+  // given to LoadFromFile().
+  bool GetModelDataOffset(const void* source, size_t* offset) const;
+
+  mutable std::mutex mutex_;
+  std::map<std::tuple<const void*, int>, Buffer> buffers_;
+  std::map<std::string, DelegateCache> delegate_caches_;
+  size_t size_in_bytes_ = 0;
+
+  std::string file_path_;
+  std::string model_token_;
+  const char* model_data_ = nullptr;
+  size_t model_size_ = 0;
+  std::unique_ptr<Allocation> file_;
+  std::map<std::tuple<size_t, int>, FileEntry> file_entries_;
+  size_t num_mapped_buffers_ = 0;
+  bool has_unsaved_buffers_ = false;
+
+  SharedWeightsCache(const SharedWeightsCache&) = delete;
+  SharedWeightsCache& operator=(const SharedWeightsCache&) = delete;
+};
+
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_SHARED_WEIGHTS_CACHE_H_
@@ -87,6 +87,24 @@ void SimpleMemoryArena::CalculateActiveAllocs(
 
 void SimpleMemoryArena::ResetAllocs() { active_allocs_.clear(); }
 
+void SimpleMemoryArena::SaveAllocs() {
+  saved_active_allocs_ = active_allocs_;
+  saved_high_water_mark_ = high_water_mark_;
+}
+
+void SimpleMemoryArena::RestoreAllocs() {
+  active_allocs_ = saved_active_allocs_;
+  high_water_mark_ = saved_high_water_mark_;
+}
+
+void SimpleMemoryArena::SetActiveAllocs(
+    const std::vector<ArenaAllocWithUsageInterval>& allocs) {
+  active_allocs_ = allocs;
+  for (const auto& alloc : active_allocs_) {
+    high_water_mark_ = std::max(high_water_mark_, alloc.offset + alloc.size);
+  }
+}
+
 TfLiteStatus SimpleMemoryArena::Allocate(
     TfLiteContext* context, size_t alignment, size_t size, int32_t tensor,
     int32_t first_node, int32_t last_node,
@@ -99,6 +99,23 @@ class SimpleMemoryArena {
                         int32_t tensor, int32_t first_node, int32_t last_node,
                         ArenaAllocWithUsageInterval* new_alloc);
 
+  // Saves the active allocs and the high water mark, so that the allocations
+  // made afterwards can be undone by RestoreAllocs(). This lets the caller
+  // compare the arena size resulting from different allocation orders.
+  void SaveAllocs();
+  void RestoreAllocs();
+
+  // Returns the active allocs, which can be restored by SetActiveAllocs() to
+  // reuse allocations calculated earlier for the same tensors.
+  const std::vector<ArenaAllocWithUsageInterval>& active_allocs() const {
+    return active_allocs_;
+  }
+  void SetActiveAllocs(const std::vector<ArenaAllocWithUsageInterval>& allocs);
+
+  // Returns the size of the arena needed by the allocations made so far,
+  // without padding.
+  size_t GetHighWaterMark() const { return high_water_mark_; }
+
   inline size_t RequiredBufferSize() {
     // Add in a small amount of padding to reduce the chance of resize events
     // for small allocations.
@@ -156,6 +173,8 @@ class SimpleMemoryArena {
   size_t underlying_buffer_size_;
   char* underlying_buffer_aligned_ptr_;
   std::vector<ArenaAllocWithUsageInterval> active_allocs_;
+  std::vector<ArenaAllocWithUsageInterval> saved_active_allocs_;
+  size_t saved_high_water_mark_ = 0;
 };
 
 }  // namespace tflite
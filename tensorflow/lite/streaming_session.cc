@@ -0,0 +1,315 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/lite/streaming_session.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "tensorflow/lite/core/api/error_reporter.h"
+#include "tensorflow/lite/core/c/common.h"
+#include "tensorflow/lite/core/subgraph.h"
+#include "tensorflow/lite/experimental/resource/resource_variable.h"
+#include "tensorflow/lite/util.h"
+
+namespace tflite {
+namespace {
+
+size_t AlignTo(size_t bytes) {
+  return (bytes + kDefaultTensorAlignment - 1) &
+         ~static_cast<size_t>(kDefaultTensorAlignment - 1);
+}
+
+template <typename T>
+void Fill(char* data, size_t bytes, int32_t value) {
+  std::fill_n(reinterpret_cast<T*>(data), bytes / sizeof(T),
+              static_cast<T>(value));
+}
+
+// Fills `bytes` bytes of the data of `tensor` with its zero point, which is 0
+// for the tensors that aren't quantized, so that it represents zeros.
+void FillWithZeroPoint(const TfLiteTensor* tensor, char* data, size_t bytes) {
+  const int32_t zero_point = tensor->params.zero_point;
+  switch (tensor->type) {
+    case kTfLiteUInt8:
+      Fill<uint8_t>(data, bytes, zero_point);
+      break;
+    case kTfLiteInt8:
+      Fill<int8_t>(data, bytes, zero_point);
+      break;
+    case kTfLiteInt16:
+      Fill<int16_t>(data, bytes, zero_point);
+      break;
+    case kTfLiteUInt16:
+      Fill<uint16_t>(data, bytes, zero_point);
+      break;
+    case kTfLiteInt32:
+      Fill<int32_t>(data, bytes, zero_point);
+      break;
+    default:
+      std::memset(data, 0, bytes);
+  }
+}
+
+}  // namespace
+
+size_t StreamingSession::Snapshot::size_in_bytes() const {
+  size_t size = 0;
+  for (const auto& state : states_) size += std::get<2>(state).size();
+  return size;
+}
+
+StreamingSession::StreamingSession(Interpreter* interpreter,
+                                   const Options& options)
+    : interpreter_(interpreter), options_(options) {}
+
+TfLiteStatus StreamingSession::Create(
+    Interpreter* interpreter, const Options& options,
+    std::unique_ptr<StreamingSession>* session) {
+  ErrorReporter* error_reporter = interpreter->error_reporter();
+  if (options.num_streams < 1) {
+    TF_LITE_REPORT_ERROR(error_reporter,
+                         "The number of streams must be positive, got %d.",
+                         options.num_streams);
+    return kTfLiteError;
+  }
+  if (options.num_streams > 1) {
+    for (int input : interpreter->inputs()) {
+      const TfLiteTensor* tensor = interpreter->tensor(input);
+      if (tensor->dims->size == 0) {
+        TF_LITE_REPORT_ERROR(error_reporter,
+                             "Input %s has no dimension for the streams.",
+                             tensor->name ? tensor->name : "");
+        return kTfLiteError;
+      }
+      std::vector<int> dims(tensor->dims->data,
+                            tensor->dims->data + tensor->dims->size);
+      dims[0] = options.num_streams;
+      TF_LITE_ENSURE_STATUS(interpreter->ResizeInputTensor(input, dims));
+    }
+  }
+  TF_LITE_ENSURE_STATUS(interpreter->AllocateTensors());
+
+  std::unique_ptr<StreamingSession> new_session(
+      new StreamingSession(interpreter, options));
+  const int num_inputs = interpreter->inputs().size();
+  const int num_outputs = interpreter->outputs().size();
+  for (const auto& [input_index, output_index] : options.state_pairs) {
+    if (input_index < 0 || input_index >= num_inputs || output_index < 0 ||
+        output_index >= num_outputs) {
+      TF_LITE_REPORT_ERROR(error_reporter, "Invalid state pair (%d, %d).",
+                           input_index, output_index);
+      return kTfLiteError;
+    }
+    StatePair pair;
+    pair.input_tensor = interpreter->inputs()[input_index];
+    pair.output_tensor = interpreter->outputs()[output_index];
+    const TfLiteTensor* input = interpreter->tensor(pair.input_tensor);
+    const TfLiteTensor* output = interpreter->tensor(pair.output_tensor);
+    if (input->type != output->type || input->bytes != output->bytes ||
+        input->bytes == 0) {
+      TF_LITE_REPORT_ERROR(error_reporter,
+                           "State input %d and output %d don't have the same "
+                           "type and size.",
+                           input_index, output_index);
+      return kTfLiteError;
+    }
+    pair.bytes = input->bytes;
+    const size_t aligned_bytes = AlignTo(pair.bytes);
+    pair.storage.reset(new char[2 * aligned_bytes + kDefaultTensorAlignment]);
+    auto address = reinterpret_cast<uintptr_t>(pair.storage.get());
+    pair.input_data = reinterpret_cast<char*>(AlignTo(address));
+    pair.output_data = pair.input_data + aligned_bytes;
+    new_session->state_pairs_.push_back(std::move(pair));
+  }
+  TF_LITE_ENSURE_STATUS(
+      new_session->BindStatePairs(/*for_invocation=*/false));
+  // The state tensors are no longer allocated in the arena.
+  TF_LITE_ENSURE_STATUS(interpreter->AllocateTensors());
+  TF_LITE_ENSURE_STATUS(new_session->Reset());
+
+  *session = std::move(new_session);
+  return kTfLiteOk;
+}
+
+TfLiteStatus StreamingSession::Invoke() {
+  can_roll_back_ = false;
+  if (options_.enable_rollback) {
+    TF_LITE_ENSURE_STATUS(
+        SaveStates(kAllStreams, /*include_pairs=*/false, &previous_states_));
+  }
+  TF_LITE_ENSURE_STATUS(BindStatePairs(/*for_invocation=*/true));
+  TF_LITE_ENSURE_STATUS(interpreter_->Invoke());
+
+  // The outputs of the state pairs become the inputs of the next invocation,
+  // and their previous inputs are overwritten by it.
+  for (StatePair& pair : state_pairs_) {
+    std::swap(pair.input_data, pair.output_data);
+  }
+  TF_LITE_ENSURE_STATUS(BindStatePairs(/*for_invocation=*/false));
+  can_roll_back_ = options_.enable_rollback;
+  return kTfLiteOk;
+}
+
+TfLiteStatus StreamingSession::RollBack() {
+  if (!can_roll_back_) {
+    TF_LITE_REPORT_ERROR(interpreter_->error_reporter(),
+                         "There is no invocation to roll back.");
+    return kTfLiteError;
+  }
+  for (StatePair& pair : state_pairs_) {
+    std::swap(pair.input_data, pair.output_data);
+  }
+  TF_LITE_ENSURE_STATUS(BindStatePairs(/*for_invocation=*/false));
+  TF_LITE_ENSURE_STATUS(RestoreSnapshot(previous_states_));
+  can_roll_back_ = false;
+  return kTfLiteOk;
+}
+
+TfLiteStatus StreamingSession::Reset(int stream) {
+  for (const State& state : GetStates(/*include_pairs=*/true)) {
+    if (state.kind == kResourceVariable) continue;
+    char* data = StreamData(state.tensor, stream);
+    if (data == nullptr) {
+      TF_LITE_REPORT_ERROR(interpreter_->error_reporter(),
+                           "Can't reset stream %d of state %s.", stream,
+                           state.tensor->name ? state.tensor->name : "");
+      return kTfLiteError;
+    }
+    FillWithZeroPoint(state.tensor, data, StreamBytes(state.tensor, stream));
+  }
+  can_roll_back_ = false;
+  return kTfLiteOk;
+}
+
+TfLiteStatus StreamingSession::SaveSnapshot(int stream,
+                                            Snapshot* snapshot) const {
+  return SaveStates(stream, /*include_pairs=*/true, snapshot);
+}
+
+TfLiteStatus StreamingSession::RestoreSnapshot(const Snapshot& snapshot,
+                                               int stream) {
+  if (stream == kAllStreams) stream = snapshot.stream_;
+  if ((stream == kAllStreams) != (snapshot.stream_ == kAllStreams)) {
+    TF_LITE_REPORT_ERROR(interpreter_->error_reporter(),
+                         "A snapshot of all streams can't be restored to a "
+                         "single stream.");
+    return kTfLiteError;
+  }
+  const std::vector<State> states = GetStates(/*include_pairs=*/true);
+  for (const auto& [kind, index, data] : snapshot.states_) {
+    const State* state = nullptr;
+    for (const State& candidate : states) {
+      if (candidate.kind == kind && candidate.index == index) {
+        state = &candidate;
+        break;
+      }
+    }
+    char* state_data =
+        state != nullptr ? StreamData(state->tensor, stream) : nullptr;
+    if (state_data == nullptr ||
+        StreamBytes(state->tensor, stream) != data.size()) {
+      TF_LITE_REPORT_ERROR(interpreter_->error_reporter(),
+                           "The snapshot doesn't match the state of the "
+                           "session.");
+      return kTfLiteError;
+    }
+    std::memcpy(state_data, data.data(), data.size());
+  }
+  can_roll_back_ = false;
+  return kTfLiteOk;
+}
+
+std::vector<StreamingSession::State> StreamingSession::GetStates(
+    bool include_pairs) const {
+  std::vector<State> states;
+  if (include_pairs) {
+    for (int i = 0; i < static_cast<int>(state_pairs_.size()); ++i) {
+      TfLiteTensor* tensor = interpreter_->tensor(state_pairs_[i].input_tensor);
+      states.push_back(State{kStatePair, i, tensor});
+    }
+  }
+  for (int variable : interpreter_->variables()) {
+    states.push_back(
+        State{kVariableTensor, variable, interpreter_->tensor(variable)});
+  }
+  // Resource variables are created by the first invocation of the model.
+  Subgraph& subgraph = interpreter_->primary_subgraph();
+  for (const auto& [name, id] : subgraph.resource_ids()) {
+    resource::ResourceVariable* variable =
+        resource::GetResourceVariable(&subgraph.resources(), id);
+    if (variable != nullptr && variable->GetTensor() != nullptr) {
+      states.push_back(State{kResourceVariable, id, variable->GetTensor()});
+    }
+  }
+  return states;
+}
+
+char* StreamingSession::StreamData(const TfLiteTensor* tensor,
+                                   int stream) const {
+  if (stream == kAllStreams) return tensor->data.raw;
+  if (stream < 0 || stream >= options_.num_streams ||
+      tensor->dims->size == 0 ||
+      tensor->dims->data[0] != options_.num_streams) {
+    return nullptr;
+  }
+  return tensor->data.raw + stream * StreamBytes(tensor, stream);
+}
+
+size_t StreamingSession::StreamBytes(const TfLiteTensor* tensor,
+                                     int stream) const {
+  return stream == kAllStreams ? tensor->bytes
+                               : tensor->bytes / options_.num_streams;
+}
+
+TfLiteStatus StreamingSession::SaveStates(int stream, bool include_pairs,
+                                          Snapshot* snapshot) const {
+  const std::vector<State> states = GetStates(include_pairs);
+  snapshot->stream_ = stream;
+  snapshot->states_.resize(states.size());
+  for (int i = 0; i < static_cast<int>(states.size()); ++i) {
+    const char* data = StreamData(states[i].tensor, stream);
+    if (data == nullptr) {
+      TF_LITE_REPORT_ERROR(interpreter_->error_reporter(),
+                           "Can't save stream %d of state %s.", stream,
+                           states[i].tensor->name ? states[i].tensor->name
+                                                  : "");
+      return kTfLiteError;
+    }
+    // Reuses the buffers of the snapshot, which are usually of the same size.
+    auto& [kind, index, saved_data] = snapshot->states_[i];
+    kind = states[i].kind;
+    index = states[i].index;
+    saved_data.assign(data, data + StreamBytes(states[i].tensor, stream));
+  }
+  return kTfLiteOk;
+}
+
+TfLiteStatus StreamingSession::BindStatePairs(bool for_invocation) {
+  for (const StatePair& pair : state_pairs_) {
+    TF_LITE_ENSURE_STATUS(interpreter_->SetCustomAllocationForTensor(
+        pair.input_tensor, {pair.input_data, pair.bytes}));
+    TF_LITE_ENSURE_STATUS(interpreter_->SetCustomAllocationForTensor(
+        pair.output_tensor,
+        {for_invocation ? pair.output_data : pair.input_data, pair.bytes}));
+  }
+  return kTfLiteOk;
+}
+
+}  // namespace tflite
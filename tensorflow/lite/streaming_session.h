@@ -0,0 +1,206 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_LITE_STREAMING_SESSION_H_
+#define TENSORFLOW_LITE_STREAMING_SESSION_H_
+
+#include <cstddef>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "tensorflow/lite/core/c/common.h"
+#include "tensorflow/lite/interpreter.h"
+
+namespace tflite {
+
+/// Runs a streaming sequence model (e.g. a speech or text model invoked on
+/// consecutive chunks of its input), keeping the recurrent state of the model
+/// in the interpreter between invocations. The state of the model can be held
+/// by:
+///
+/// - Pairs of a state input and a state output, where the output of an
+///   invocation is the input of the next one. The session allocates two
+///   buffers for each pair and swaps them after every invocation, so the state
+///   is never copied.
+/// - Variable tensors (e.g. of LSTM or SVDF ops) and resource variables (see
+///   VAR_HANDLE and ASSIGN_VARIABLE), which the kernels update in place.
+///
+/// The state can be saved and restored with snapshots, and the last invocation
+/// can be rolled back. A session may also run several independent streams in
+/// each invocation: the inputs, outputs and states then hold the streams
+/// stacked along their first dimension, and the state of each stream can be
+/// reset, saved and restored independently. Sample usage:
+///
+/// <pre><code>
+/// tflite::StreamingSession::Options options;
+/// options.state_pairs = {{1, 1}};  // Input 1 is the output 1 of the last
+///                                  // invocation.
+/// options.num_streams = 4;
+/// std::unique_ptr<tflite::StreamingSession> session;
+/// if (tflite::StreamingSession::Create(interpreter.get(), options,
+///                                      &session) != kTfLiteOk) return;
+/// for (...) {
+///   for (int s = 0; s < 4; ++s) {
+///     float* chunk = session->typed_input_stream<float>(0, s);
+///     ...
+///   }
+///   if (session->Invoke() != kTfLiteOk) return;
+/// }
+/// </code></pre>
+///
+/// The interpreter must outlive the session, and must neither be resized once
+/// the session is created nor be used after the session is destroyed, since
+/// the session owns the buffers of the state pairs.
+/// WARNING: This is an experimental API and subject to change.
+class StreamingSession {
+ public:
+  /// Selects all the streams in the methods taking a stream.
+  static constexpr int kAllStreams = -1;
+
+  struct Options {
+    /// Pairs of (input index, output index), in the order of
+    /// Interpreter::inputs() and Interpreter::outputs(), of the state inputs
+    /// and the state outputs computing their next value.
+    std::vector<std::pair<int, int>> state_pairs;
+    /// Number of independent streams. If greater than 1, the first dimension
+    /// of all the inputs is resized to it.
+    int num_streams = 1;
+    /// Whether RollBack() is supported. Rolling back the state pairs is free,
+    /// but the variable tensors and resource variables are copied before every
+    /// invocation.
+    bool enable_rollback = false;
+  };
+
+  /// A copy of the state of one or all streams of a session.
+  class Snapshot {
+   public:
+    /// Returns the total size of the saved state in bytes.
+    size_t size_in_bytes() const;
+
+   private:
+    friend class StreamingSession;
+
+    int stream_ = kAllStreams;
+    // The saved tensors, keyed by the kind of state and its index.
+    std::vector<std::tuple<int, int, std::vector<char>>> states_;
+  };
+
+  /// Creates a session running `interpreter`, whose tensors must have been
+  /// allocated. Sets the state to zero (or the zero point of quantized
+  /// states).
+  static TfLiteStatus Create(Interpreter* interpreter, const Options& options,
+                             std::unique_ptr<StreamingSession>* session);
+
+  StreamingSession(const StreamingSession&) = delete;
+  StreamingSession& operator=(const StreamingSession&) = delete;
+
+  /// Invokes the interpreter on the current chunk of all the streams, and
+  /// makes the new state the input state of the next invocation.
+  TfLiteStatus Invoke();
+
+  /// Undoes the state update of the last invocation. Only one invocation can
+  /// be rolled back, and only if Options::enable_rollback was set.
+  TfLiteStatus RollBack();
+
+  /// Resets the state of `stream`, or of all streams, to zero (or the zero
+  /// point of quantized states). Resource variables are initialized by the
+  /// model itself, so they are not reset: restore a snapshot saved after the
+  /// first invocation instead.
+  TfLiteStatus Reset(int stream = kAllStreams);
+
+  /// Saves the state of `stream`, or of all streams, to `snapshot`.
+  TfLiteStatus SaveSnapshot(int stream, Snapshot* snapshot) const;
+
+  /// Restores a state saved by SaveSnapshot() to the streams it was saved
+  /// from. A snapshot of a single stream may also be restored to another
+  /// `stream`.
+  TfLiteStatus RestoreSnapshot(const Snapshot& snapshot,
+                               int stream = kAllStreams);
+
+  int num_streams() const { return options_.num_streams; }
+
+  /// Returns the part of the input `input_index` (in the order of
+  /// Interpreter::inputs()) for `stream`.
+  template <class T>
+  T* typed_input_stream(int input_index, int stream) {
+    return reinterpret_cast<T*>(
+        StreamData(interpreter_->input_tensor(input_index), stream));
+  }
+
+  /// Returns the part of the output `output_index` (in the order of
+  /// Interpreter::outputs()) for `stream`.
+  template <class T>
+  const T* typed_output_stream(int output_index, int stream) const {
+    return reinterpret_cast<const T*>(
+        StreamData(interpreter_->output_tensor(output_index), stream));
+  }
+
+ private:
+  // A pair of state input and output, with the buffers they swap.
+  struct StatePair {
+    int input_tensor;
+    int output_tensor;
+    size_t bytes;
+    std::unique_ptr<char[]> storage;
+    char* input_data;
+    char* output_data;
+  };
+
+  // Kinds of state, used as keys in snapshots.
+  enum StateKind { kStatePair, kVariableTensor, kResourceVariable };
+
+  // A tensor holding state, with its kind and index in the kind.
+  struct State {
+    StateKind kind;
+    int index;
+    TfLiteTensor* tensor;
+  };
+
+  StreamingSession(Interpreter* interpreter, const Options& options);
+
+  // Returns the tensors holding the state before the next invocation. State
+  // pairs are only included if `include_pairs` is true.
+  std::vector<State> GetStates(bool include_pairs) const;
+
+  // Returns the part of `tensor` for `stream`, or nullptr if the first
+  // dimension of the tensor isn't the streams.
+  char* StreamData(const TfLiteTensor* tensor, int stream) const;
+
+  // Returns the size of the part of `tensor` for one stream, or of the whole
+  // tensor if `stream` is kAllStreams.
+  size_t StreamBytes(const TfLiteTensor* tensor, int stream) const;
+
+  // Saves the states returned by GetStates(include_pairs) to `snapshot`.
+  TfLiteStatus SaveStates(int stream, bool include_pairs,
+                          Snapshot* snapshot) const;
+
+  // Points the input tensors of the state pairs to their current state, and
+  // their output tensors to the buffers receiving the next state if
+  // `for_invocation` is true, or else to the current state, so that the outputs
+  // show the last state computed between invocations.
+  TfLiteStatus BindStatePairs(bool for_invocation);
+
+  Interpreter* interpreter_;
+  Options options_;
+  std::vector<StatePair> state_pairs_;
+  // The in-place states before the last invocation, if it can be rolled back.
+  Snapshot previous_states_;
+  bool can_roll_back_ = false;
+};
+
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_STREAMING_SESSION_H_
@@ -0,0 +1,328 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/lite/streaming_session.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "tensorflow/lite/core/c/builtin_op_data.h"
+#include "tensorflow/lite/core/c/common.h"
+#include "tensorflow/lite/core/kernels/builtin_op_kernels.h"
+#include "tensorflow/lite/experimental/resource/resource_variable.h"
+#include "tensorflow/lite/interpreter.h"
+
+namespace tflite {
+namespace {
+
+using ::testing::ElementsAre;
+
+constexpr int kChunkSize = 2;
+
+// Builds a model whose output is the sum of its inputs `chunk` and `state`, so
+// that feeding the output back as the state accumulates the chunks.
+std::unique_ptr<Interpreter> BuildAccumulatorModel() {
+  auto interpreter = std::make_unique<Interpreter>();
+  interpreter->AddTensors(3);
+  interpreter->SetInputs({0, 1});
+  interpreter->SetOutputs({2});
+  const char* names[] = {"chunk", "state", "new_state"};
+  for (int i = 0; i < 3; ++i) {
+    interpreter->SetTensorParametersReadWrite(i, kTfLiteFloat32, names[i],
+                                              {1, kChunkSize},
+                                              TfLiteQuantization());
+  }
+  auto* params =
+      reinterpret_cast<TfLiteAddParams*>(malloc(sizeof(TfLiteAddParams)));
+  params->activation = kTfLiteActNone;
+  params->pot_scale_int16 = false;
+  interpreter->AddNodeWithParameters({0, 1}, {2}, nullptr, 0, params,
+                                     ops::builtin::Register_ADD());
+  if (interpreter->AllocateTensors() != kTfLiteOk) return nullptr;
+  return interpreter;
+}
+
+// Builds the accumulator model with uint8 tensors whose zero point is 128.
+std::unique_ptr<Interpreter> BuildQuantizedAccumulatorModel() {
+  auto interpreter = std::make_unique<Interpreter>();
+  interpreter->AddTensors(3);
+  interpreter->SetInputs({0, 1});
+  interpreter->SetOutputs({2});
+  const char* names[] = {"chunk", "state", "new_state"};
+  for (int i = 0; i < 3; ++i) {
+    TfLiteQuantizationParams quantization = {/*scale=*/1.0f,
+                                             /*zero_point=*/128};
+    interpreter->SetTensorParametersReadWrite(i, kTfLiteUInt8, names[i],
+                                              {1, kChunkSize}, quantization);
+  }
+  auto* params =
+      reinterpret_cast<TfLiteAddParams*>(malloc(sizeof(TfLiteAddParams)));
+  params->activation = kTfLiteActNone;
+  params->pot_scale_int16 = false;
+  interpreter->AddNodeWithParameters({0, 1}, {2}, nullptr, 0, params,
+                                     ops::builtin::Register_ADD());
+  if (interpreter->AllocateTensors() != kTfLiteOk) return nullptr;
+  return interpreter;
+}
+
+// Builds a model accumulating its input `chunk` in the resource variable
+// "state", and returning the new value of the variable.
+std::unique_ptr<Interpreter> BuildResourceVariableAccumulatorModel() {
+  auto interpreter = std::make_unique<Interpreter>();
+  interpreter->AddTensors(4);
+  interpreter->SetInputs({0});
+  interpreter->SetOutputs({3});
+  interpreter->SetTensorParametersReadWrite(0, kTfLiteFloat32, "chunk",
+                                            {1, kChunkSize},
+                                            TfLiteQuantization());
+  interpreter->SetTensorParametersReadWrite(1, kTfLiteResource, "handle", {1},
+                                            TfLiteQuantization());
+  interpreter->SetTensorParametersReadWrite(2, kTfLiteFloat32, "state",
+                                            {1, kChunkSize},
+                                            TfLiteQuantization());
+  interpreter->SetTensorParametersReadWrite(3, kTfLiteFloat32, "new_state",
+                                            {1, kChunkSize},
+                                            TfLiteQuantization());
+  auto* var_params = reinterpret_cast<TfLiteVarHandleParams*>(
+      malloc(sizeof(TfLiteVarHandleParams)));
+  var_params->container = "";
+  var_params->shared_name = "state";
+  interpreter->AddNodeWithParameters({}, {1}, nullptr, 0, var_params,
+                                     ops::builtin::Register_VAR_HANDLE());
+  interpreter->AddNodeWithParameters({1}, {2}, nullptr, 0, nullptr,
+                                     ops::builtin::Register_READ_VARIABLE());
+  auto* add_params =
+      reinterpret_cast<TfLiteAddParams*>(malloc(sizeof(TfLiteAddParams)));
+  add_params->activation = kTfLiteActNone;
+  add_params->pot_scale_int16 = false;
+  interpreter->AddNodeWithParameters({2, 0}, {3}, nullptr, 0, add_params,
+                                     ops::builtin::Register_ADD());
+  interpreter->AddNodeWithParameters({1, 3}, {}, nullptr, 0, nullptr,
+                                     ops::builtin::Register_ASSIGN_VARIABLE());
+  if (interpreter->AllocateTensors() != kTfLiteOk) return nullptr;
+
+  // Initializes the variable to zero, as the initialization subgraph of a
+  // converted model would.
+  Subgraph& subgraph = interpreter->primary_subgraph();
+  const int id = subgraph.resource_ids().begin()->second;
+  resource::CreateResourceVariableIfNotAvailable(&subgraph.resources(), id);
+  float* chunk = interpreter->typed_input_tensor<float>(0);
+  std::fill(chunk, chunk + kChunkSize, 0.0f);
+  resource::GetResourceVariable(&subgraph.resources(), id)
+      ->AssignFrom(interpreter->input_tensor(0));
+  return interpreter;
+}
+
+void SetChunk(StreamingSession* session, int stream, float value) {
+  float* chunk = session->typed_input_stream<float>(0, stream);
+  std::fill(chunk, chunk + kChunkSize, value);
+}
+
+std::vector<float> GetState(StreamingSession* session, int stream) {
+  const float* state = session->typed_output_stream<float>(0, stream);
+  return std::vector<float>(state, state + kChunkSize);
+}
+
+TEST(StreamingSessionTest, StatePairsAreSwappedWithoutCopies) {
+  std::unique_ptr<Interpreter> interpreter = BuildAccumulatorModel();
+  ASSERT_NE(interpreter, nullptr);
+  StreamingSession::Options options;
+  options.state_pairs = {{1, 0}};
+  std::unique_ptr<StreamingSession> session;
+  ASSERT_EQ(StreamingSession::Create(interpreter.get(), options, &session),
+            kTfLiteOk);
+
+  EXPECT_EQ(interpreter->input_tensor(1)->allocation_type, kTfLiteCustom);
+  EXPECT_THAT(std::vector<float>(interpreter->typed_input_tensor<float>(1),
+                                 interpreter->typed_input_tensor<float>(1) +
+                                     kChunkSize),
+              ElementsAre(0, 0));
+  // The state alternates between two buffers, and the new state is the input
+  // of the next invocation.
+  const char* buffers[2] = {interpreter->input_tensor(1)->data.raw, nullptr};
+  for (int i = 1; i <= 3; ++i) {
+    SetChunk(session.get(), 0, 1.0f);
+    ASSERT_EQ(session->Invoke(), kTfLiteOk);
+    EXPECT_THAT(GetState(session.get(), 0), ElementsAre(i, i));
+    const char* state = interpreter->input_tensor(1)->data.raw;
+    EXPECT_EQ(state, interpreter->output_tensor(0)->data.raw);
+    if (i == 1) {
+      EXPECT_NE(state, buffers[0]);
+      buffers[1] = state;
+    }
+    EXPECT_EQ(state, buffers[i % 2]);
+  }
+}
+
+TEST(StreamingSessionTest, RollBackLastInvocation) {
+  std::unique_ptr<Interpreter> interpreter = BuildAccumulatorModel();
+  ASSERT_NE(interpreter, nullptr);
+  StreamingSession::Options options;
+  options.state_pairs = {{1, 0}};
+  options.enable_rollback = true;
+  std::unique_ptr<StreamingSession> session;
+  ASSERT_EQ(StreamingSession::Create(interpreter.get(), options, &session),
+            kTfLiteOk);
+
+  EXPECT_EQ(session->RollBack(), kTfLiteError);
+  SetChunk(session.get(), 0, 1.0f);
+  ASSERT_EQ(session->Invoke(), kTfLiteOk);
+  SetChunk(session.get(), 0, 10.0f);
+  ASSERT_EQ(session->Invoke(), kTfLiteOk);
+  EXPECT_THAT(GetState(session.get(), 0), ElementsAre(11, 11));
+
+  ASSERT_EQ(session->RollBack(), kTfLiteOk);
+  EXPECT_EQ(session->RollBack(), kTfLiteError);
+  SetChunk(session.get(), 0, 2.0f);
+  ASSERT_EQ(session->Invoke(), kTfLiteOk);
+  EXPECT_THAT(GetState(session.get(), 0), ElementsAre(3, 3));
+}
+
+TEST(StreamingSessionTest, StreamsAreIndependent) {
+  std::unique_ptr<Interpreter> interpreter = BuildAccumulatorModel();
+  ASSERT_NE(interpreter, nullptr);
+  StreamingSession::Options options;
+  options.state_pairs = {{1, 0}};
+  options.num_streams = 3;
+  std::unique_ptr<StreamingSession> session;
+  ASSERT_EQ(StreamingSession::Create(interpreter.get(), options, &session),
+            kTfLiteOk);
+  EXPECT_EQ(interpreter->input_tensor(0)->dims->data[0], 3);
+
+  for (int i = 0; i < 2; ++i) {
+    for (int s = 0; s < 3; ++s) SetChunk(session.get(), s, s + 1);
+    ASSERT_EQ(session->Invoke(), kTfLiteOk);
+  }
+  EXPECT_THAT(GetState(session.get(), 0), ElementsAre(2, 2));
+  EXPECT_THAT(GetState(session.get(), 1), ElementsAre(4, 4));
+  EXPECT_THAT(GetState(session.get(), 2), ElementsAre(6, 6));
+
+  ASSERT_EQ(session->Reset(/*stream=*/1), kTfLiteOk);
+  ASSERT_EQ(session->Invoke(), kTfLiteOk);
+  EXPECT_THAT(GetState(session.get(), 0), ElementsAre(3, 3));
+  EXPECT_THAT(GetState(session.get(), 1), ElementsAre(2, 2));
+  EXPECT_THAT(GetState(session.get(), 2), ElementsAre(9, 9));
+  EXPECT_EQ(session->Reset(/*stream=*/3), kTfLiteError);
+}
+
+TEST(StreamingSessionTest, QuantizedStatesAreResetToTheirZeroPoint) {
+  std::unique_ptr<Interpreter> interpreter = BuildQuantizedAccumulatorModel();
+  ASSERT_NE(interpreter, nullptr);
+  StreamingSession::Options options;
+  options.state_pairs = {{1, 0}};
+  options.num_streams = 2;
+  std::unique_ptr<StreamingSession> session;
+  ASSERT_EQ(StreamingSession::Create(interpreter.get(), options, &session),
+            kTfLiteOk);
+
+  for (int s = 0; s < 2; ++s) {
+    uint8_t* chunk = session->typed_input_stream<uint8_t>(0, s);
+    std::fill(chunk, chunk + kChunkSize, 129 + s);
+  }
+  ASSERT_EQ(session->Invoke(), kTfLiteOk);
+  ASSERT_EQ(session->Reset(/*stream=*/0), kTfLiteOk);
+  ASSERT_EQ(session->Invoke(), kTfLiteOk);
+  const uint8_t* state0 = session->typed_output_stream<uint8_t>(0, 0);
+  const uint8_t* state1 = session->typed_output_stream<uint8_t>(0, 1);
+  EXPECT_THAT(std::vector<uint8_t>(state0, state0 + kChunkSize),
+              ElementsAre(129, 129));
+  EXPECT_THAT(std::vector<uint8_t>(state1, state1 + kChunkSize),
+              ElementsAre(132, 132));
+}
+
+TEST(StreamingSessionTest, SnapshotsOfStreams) {
+  std::unique_ptr<Interpreter> interpreter = BuildAccumulatorModel();
+  ASSERT_NE(interpreter, nullptr);
+  StreamingSession::Options options;
+  options.state_pairs = {{1, 0}};
+  options.num_streams = 2;
+  std::unique_ptr<StreamingSession> session;
+  ASSERT_EQ(StreamingSession::Create(interpreter.get(), options, &session),
+            kTfLiteOk);
+
+  SetChunk(session.get(), 0, 1.0f);
+  SetChunk(session.get(), 1, 5.0f);
+  ASSERT_EQ(session->Invoke(), kTfLiteOk);
+  StreamingSession::Snapshot stream_snapshot, all_snapshot;
+  ASSERT_EQ(session->SaveSnapshot(0, &stream_snapshot), kTfLiteOk);
+  ASSERT_EQ(session->SaveSnapshot(StreamingSession::kAllStreams,
+                                  &all_snapshot),
+            kTfLiteOk);
+  EXPECT_EQ(stream_snapshot.size_in_bytes(), kChunkSize * sizeof(float));
+  EXPECT_EQ(all_snapshot.size_in_bytes(), 2 * kChunkSize * sizeof(float));
+  ASSERT_EQ(session->Invoke(), kTfLiteOk);
+
+  // Stream 0 is restored to stream 1, and then both streams are restored.
+  ASSERT_EQ(session->RestoreSnapshot(stream_snapshot, /*stream=*/1),
+            kTfLiteOk);
+  ASSERT_EQ(session->Invoke(), kTfLiteOk);
+  EXPECT_THAT(GetState(session.get(), 0), ElementsAre(3, 3));
+  EXPECT_THAT(GetState(session.get(), 1), ElementsAre(6, 6));
+  ASSERT_EQ(session->RestoreSnapshot(all_snapshot), kTfLiteOk);
+  ASSERT_EQ(session->Invoke(), kTfLiteOk);
+  EXPECT_THAT(GetState(session.get(), 0), ElementsAre(2, 2));
+  EXPECT_THAT(GetState(session.get(), 1), ElementsAre(10, 10));
+
+  EXPECT_EQ(session->RestoreSnapshot(all_snapshot, /*stream=*/0),
+            kTfLiteError);
+}
+
+TEST(StreamingSessionTest, ResourceVariableState) {
+  std::unique_ptr<Interpreter> interpreter =
+      BuildResourceVariableAccumulatorModel();
+  ASSERT_NE(interpreter, nullptr);
+  StreamingSession::Options options;
+  options.enable_rollback = true;
+  std::unique_ptr<StreamingSession> session;
+  ASSERT_EQ(StreamingSession::Create(interpreter.get(), options, &session),
+            kTfLiteOk);
+
+  SetChunk(session.get(), 0, 1.0f);
+  ASSERT_EQ(session->Invoke(), kTfLiteOk);
+  StreamingSession::Snapshot snapshot;
+  ASSERT_EQ(session->SaveSnapshot(0, &snapshot), kTfLiteOk);
+  EXPECT_EQ(snapshot.size_in_bytes(), kChunkSize * sizeof(float));
+  ASSERT_EQ(session->Invoke(), kTfLiteOk);
+  EXPECT_THAT(GetState(session.get(), 0), ElementsAre(2, 2));
+
+  ASSERT_EQ(session->RollBack(), kTfLiteOk);
+  ASSERT_EQ(session->Invoke(), kTfLiteOk);
+  EXPECT_THAT(GetState(session.get(), 0), ElementsAre(2, 2));
+
+  ASSERT_EQ(session->RestoreSnapshot(snapshot), kTfLiteOk);
+  ASSERT_EQ(session->Invoke(), kTfLiteOk);
+  EXPECT_THAT(GetState(session.get(), 0), ElementsAre(2, 2));
+}
+
+TEST(StreamingSessionTest, InvalidStatePairs) {
+  std::unique_ptr<Interpreter> interpreter = BuildAccumulatorModel();
+  ASSERT_NE(interpreter, nullptr);
+  StreamingSession::Options options;
+  options.state_pairs = {{2, 0}};
+  std::unique_ptr<StreamingSession> session;
+  EXPECT_EQ(StreamingSession::Create(interpreter.get(), options, &session),
+            kTfLiteError);
+  options.state_pairs = {};
+  options.num_streams = 0;
+  EXPECT_EQ(StreamingSession::Create(interpreter.get(), options, &session),
+            kTfLiteError);
+}
+
+}  // namespace
+}  // namespace tflite
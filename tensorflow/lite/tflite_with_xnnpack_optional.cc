@@ -18,6 +18,7 @@ limitations under the License.
 
 #include "tensorflow/lite/core/c/common.h"
 #include "tensorflow/lite/core/macros.h"
+#include "tensorflow/lite/shared_weights_cache.h"
 
 #ifdef TFLITE_BUILD_WITH_XNNPACK_DELEGATE
 #include "tensorflow/lite/delegates/xnnpack/xnnpack_delegate.h"
@@ -35,6 +36,25 @@ TfLiteDelegatePtr MaybeCreateXNNPACKDelegate(
   if (enable_xnnpack_unsigned_quantized) {
     opts.flags |= TFLITE_XNNPACK_DELEGATE_FLAG_QU8;
   }
+  // Interpreters sharing their weights also share the weights packed by XNNPACK.
+  if (SharedWeightsCache* shared_weights = SharedWeightsCache::Get(context)) {
+    opts.weights_cache =
+        static_cast<TfLiteXNNPackDelegateWeightsCache*>(
+            shared_weights->GetOrCreateDelegateCache(
+                "xnnpack",
+                [] {
+                  return static_cast<void*>(
+                      TfLiteXNNPackDelegateWeightsCacheCreate());
+                },
+                [](void* cache) {
+                  TfLiteXNNPackDelegateWeightsCacheDelete(
+                      static_cast<TfLiteXNNPackDelegateWeightsCache*>(cache));
+                },
+                [](void* cache) {
+                  return TfLiteXNNPackDelegateWeightsCacheFinalizeSoft(
+                      static_cast<TfLiteXNNPackDelegateWeightsCache*>(cache));
+                }));
+  }
   return TfLiteDelegatePtr(
       TfLiteXNNPackDelegateCreateWithThreadpool(&opts, context),
       TfLiteXNNPackDelegateDelete);
@@ -0,0 +1,110 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+// Reports the size of the tensor arenas of TFLite models, with and without the
+// arena optimizations of the memory planner (see
+// InterpreterOptions::SetDisableArenaOptimizations), e.g.:
+//
+//   arena_size_report --graphs=/tmp/mobilenet.tflite,/tmp/bert.tflite
+//
+// No delegate is applied, so that all the tensors of the models are planned
+// by the arena planner.
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_split.h"
+#include "tensorflow/lite/core/interpreter_builder.h"
+#include "tensorflow/lite/core/kernels/register.h"
+#include "tensorflow/lite/core/model_builder.h"
+#include "tensorflow/lite/interpreter.h"
+#include "tensorflow/lite/interpreter_options.h"
+#include "tensorflow/lite/tools/command_line_flags.h"
+
+namespace {
+
+const char kInputModelsFlag[] = "graphs";
+
+struct ArenaSizes {
+  size_t arena_size = 0;
+  size_t arena_persist_size = 0;
+};
+
+// Allocates the tensors of `model`, and returns the total size of the arenas
+// of all its subgraphs in `sizes`.
+bool GetArenaSizes(const tflite::FlatBufferModel& model,
+                   bool disable_arena_optimizations, ArenaSizes* sizes) {
+  tflite::ops::builtin::BuiltinOpResolverWithoutDefaultDelegates resolver;
+  tflite::InterpreterOptions options;
+  options.SetDisableArenaOptimizations(disable_arena_optimizations);
+  std::unique_ptr<tflite::Interpreter> interpreter;
+  if (tflite::InterpreterBuilder(model, resolver, &options)(&interpreter) !=
+          kTfLiteOk ||
+      interpreter->AllocateTensors() != kTfLiteOk) {
+    return false;
+  }
+  for (int i = 0; i < static_cast<int>(interpreter->subgraphs_size()); ++i) {
+    tflite::Subgraph::SubgraphAllocInfo alloc_info;
+    interpreter->subgraph(i)->GetMemoryAllocInfo(&alloc_info);
+    sizes->arena_size += alloc_info.arena_size;
+    sizes->arena_persist_size += alloc_info.arena_persist_size;
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string input_models;
+  std::vector<tflite::Flag> flag_list = {
+      tflite::Flag::CreateFlag(kInputModelsFlag, &input_models,
+                               "path to the tflite models, separated by comma.",
+                               tflite::Flag::kRequired),
+  };
+  if (!tflite::Flags::Parse(&argc, const_cast<const char**>(argv),
+                            flag_list)) {
+    return 1;
+  }
+
+  std::vector<std::string> models = absl::StrSplit(input_models, ',');
+  int status = 0;
+  std::printf("%-40s %14s %14s %10s %14s\n", "model", "baseline (B)",
+              "optimized (B)", "reduction", "persistent (B)");
+  for (const std::string& model_file : models) {
+    std::unique_ptr<tflite::FlatBufferModel> model =
+        tflite::FlatBufferModel::BuildFromFile(model_file.c_str());
+    ArenaSizes baseline, optimized;
+    if (!model ||
+        !GetArenaSizes(*model, /*disable_arena_optimizations=*/true,
+                       &baseline) ||
+        !GetArenaSizes(*model, /*disable_arena_optimizations=*/false,
+                       &optimized)) {
+      std::fprintf(stderr, "Failed to allocate the tensors of %s\n",
+                   model_file.c_str());
+      status = 1;
+      continue;
+    }
+    const double reduction =
+        baseline.arena_size == 0
+            ? 0.0
+            : 100.0 * (1.0 - static_cast<double>(optimized.arena_size) /
+                                 baseline.arena_size);
+    std::printf("%-40s %14zu %14zu %9.1f%% %14zu\n", model_file.c_str(),
+                baseline.arena_size, optimized.arena_size, reduction,
+                optimized.arena_persist_size);
+  }
+  return status;
+}
@@ -15,6 +15,7 @@ limitations under the License.
 
 #include "tensorflow/lite/tools/benchmark/benchmark_tflite_model.h"
 
+#include <condition_variable>  // NOLINT(build/c++11)
 #include <cstdarg>
 #include <cstdint>
 #include <cstdlib>
@@ -22,9 +23,11 @@ limitations under the License.
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <mutex>  // NOLINT(build/c++11)
 #include <random>
 #include <sstream>
 #include <string>
+#include <thread>  // NOLINT(build/c++11)
 #include <unordered_set>
 #include <utility>
 #include <vector>
@@ -40,8 +43,11 @@ limitations under the License.
 #include "tensorflow/lite/core/model.h"
 #include "tensorflow/lite/core/model_builder.h"
 #include "tensorflow/lite/core/subgraph.h"
+#include "tensorflow/lite/delegates/serialization.h"
+#include "tensorflow/lite/allocation.h"
 #include "tensorflow/lite/interpreter.h"
 #include "tensorflow/lite/kernels/cpu_backend_context.h"
+#include "tensorflow/lite/model_instance.h"
 #include "tensorflow/lite/op_resolver.h"
 #include "tensorflow/lite/optional_debug_tools.h"
 #include "tensorflow/lite/profiling/profile_summary_formatter.h"
@@ -305,8 +311,82 @@ CreateProfileSummaryFormatter(bool format_as_csv) {
              : std::make_shared<profiling::ProfileSummaryDefaultFormatter>();
 }
 
+InterpreterOptions GetInterpreterOptions(const BenchmarkParams& params) {
+  InterpreterOptions options;
+  options.SetEnsureDynamicTensorsAreReleased(
+      params.Get<bool>("release_dynamic_tensors"));
+  options.OptimizeMemoryForLargeTensors(
+      params.Get<int32_t>("optimize_memory_for_large_tensors"));
+  options.SetDisableDelegateClustering(
+      params.Get<bool>("disable_delegate_clustering"));
+  return options;
+}
+
 }  // namespace
 
+class ConcurrentInvoker {
+ public:
+  explicit ConcurrentInvoker(const std::vector<Interpreter*>& interpreters) {
+    for (Interpreter* interpreter : interpreters) {
+      threads_.emplace_back([this, interpreter] { Run(interpreter); });
+    }
+  }
+
+  ~ConcurrentInvoker() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopped_ = true;
+    }
+    start_cv_.notify_all();
+    for (auto& thread : threads_) thread.join();
+  }
+
+  // Starts one invocation of every interpreter.
+  void Start() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      num_running_ = threads_.size();
+      failed_ = false;
+      ++generation_;
+    }
+    start_cv_.notify_all();
+  }
+
+  // Waits for the invocations started by Start() to complete.
+  TfLiteStatus Wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this] { return num_running_ == 0; });
+    return failed_ ? kTfLiteError : kTfLiteOk;
+  }
+
+ private:
+  void Run(Interpreter* interpreter) {
+    int64_t generation = 0;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        start_cv_.wait(
+            lock, [&] { return stopped_ || generation_ != generation; });
+        if (stopped_) return;
+        generation = generation_;
+      }
+      const TfLiteStatus status = interpreter->Invoke();
+      std::lock_guard<std::mutex> lock(mutex_);
+      failed_ |= status != kTfLiteOk;
+      if (--num_running_ == 0) done_cv_.notify_one();
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable start_cv_;
+  std::condition_variable done_cv_;
+  int64_t generation_ = 0;
+  size_t num_running_ = 0;
+  bool failed_ = false;
+  bool stopped_ = false;
+  std::vector<std::thread> threads_;
+};
+
 TfLiteStatus SplitInputLayerNameAndValueFile(
     const std::string& name_and_value_file,
     std::pair<std::string, std::string>& name_file_pair) {
@@ -363,6 +443,8 @@ BenchmarkParams BenchmarkTfLiteModel::DefaultParams() {
                           BenchmarkParam::Create<bool>(false));
   default_params.AddParam("profiling_output_csv_file",
                           BenchmarkParam::Create<std::string>(""));
+  default_params.AddParam("enable_op_perf_counters",
+                          BenchmarkParam::Create<bool>(false));
 
   default_params.AddParam("print_preinvoke_state",
                           BenchmarkParam::Create<bool>(false));
@@ -376,6 +458,12 @@ BenchmarkParams BenchmarkTfLiteModel::DefaultParams() {
                           BenchmarkParam::Create<bool>(false));
   default_params.AddParam("output_filepath",
                           BenchmarkParam::Create<std::string>(""));
+  default_params.AddParam("num_concurrent_contexts",
+                          BenchmarkParam::Create<int32_t>(1));
+  default_params.AddParam("share_model_instance",
+                          BenchmarkParam::Create<bool>(true));
+  default_params.AddParam("weights_cache_file",
+                          BenchmarkParam::Create<std::string>(""));
 
   tools::ProvidedDelegateList delegate_providers(&default_params);
   delegate_providers.AddAllDelegateParams();
@@ -399,6 +487,8 @@ BenchmarkTfLiteModel::~BenchmarkTfLiteModel() {
 
   // Destory the owned interpreter earlier than other objects (specially
   // 'owned_delegates_').
+  concurrent_invoker_.reset();
+  concurrent_contexts_.clear();
   interpreter_.reset();
 }
 
@@ -438,6 +528,9 @@ std::vector<Flag> BenchmarkTfLiteModel::GetFlags() {
           "profiling_output_csv_file", &params_,
           "File path to export profile data as CSV, if not set "
           "prints to stdout."),
+      CreateFlag<bool>("enable_op_perf_counters", &params_,
+                       "report the hardware counters (cycles, instructions, "
+                       "LLC misses) and arithmetic intensity of each op"),
       CreateFlag<bool>(
           "print_preinvoke_state", &params_,
           "print out the interpreter internals just before calling Invoke. The "
@@ -457,7 +550,21 @@ std::vector<Flag> BenchmarkTfLiteModel::GetFlags() {
                        "Disable delegate clustering."),
       CreateFlag<std::string>(
           "output_filepath", &params_,
-          "File path to export outputs layer as binary data.")};
+          "File path to export outputs layer as binary data."),
+      CreateFlag<int32_t>(
+          "num_concurrent_contexts", &params_,
+          "Number of execution contexts of the model that are invoked "
+          "concurrently, each on its own thread, in every run."),
+      CreateFlag<bool>(
+          "share_model_instance", &params_,
+          "Whether the concurrent execution contexts share the weights of the "
+          "model (see tflite::ModelInstance), instead of each context being an "
+          "independent interpreter."),
+      CreateFlag<std::string>(
+          "weights_cache_file", &params_,
+          "File in which the weights derived from the model (e.g. dequantized "
+          "or transposed weights) are saved by the first run, and from which "
+          "they are memory-mapped by the next runs.")};
 
   flags.insert(flags.end(), specific_flags.begin(), specific_flags.end());
 
@@ -492,6 +599,8 @@ void BenchmarkTfLiteModel::LogParams() {
                       verbose);
   LOG_BENCHMARK_PARAM(std::string, "profiling_output_csv_file",
                       "CSV File to export profiling data to", verbose);
+  LOG_BENCHMARK_PARAM(bool, "enable_op_perf_counters",
+                      "Enable op hardware counters", verbose);
   LOG_BENCHMARK_PARAM(bool, "print_preinvoke_state",
                       "Print pre-invoke interpreter state", verbose);
   LOG_BENCHMARK_PARAM(bool, "print_postinvoke_state",
@@ -504,6 +613,12 @@ void BenchmarkTfLiteModel::LogParams() {
                       "Disable delegate clustering", verbose);
   LOG_BENCHMARK_PARAM(std::string, "output_filepath",
                       "File path to export outputs layer to", verbose);
+  LOG_BENCHMARK_PARAM(int32_t, "num_concurrent_contexts",
+                      "Number of concurrent execution contexts", verbose);
+  LOG_BENCHMARK_PARAM(bool, "share_model_instance",
+                      "Share model weights among execution contexts", verbose);
+  LOG_BENCHMARK_PARAM(std::string, "weights_cache_file",
+                      "Weights cache file", verbose);
 
   for (const auto& delegate_provider :
        tools::GetRegisteredDelegateProviders()) {
@@ -520,6 +635,11 @@ TfLiteStatus BenchmarkTfLiteModel::ValidateParams() {
     return kTfLiteError;
   }
 
+  if (params_.Get<int32_t>("num_concurrent_contexts") < 1) {
+    TFLITE_LOG(ERROR) << "--num_concurrent_contexts must be at least 1";
+    return kTfLiteError;
+  }
+
   return PopulateInputLayerInfo(
       params_.Get<std::string>("input_layer"),
       params_.Get<std::string>("input_layer_shape"),
@@ -642,56 +762,97 @@ TfLiteStatus BenchmarkTfLiteModel::PrepareInputData() {
 }
 
 TfLiteStatus BenchmarkTfLiteModel::ResetInputsAndOutputs() {
-  auto interpreter_inputs = interpreter_->inputs();
-  // Set the values of the input tensors from inputs_data_.
-  for (int j = 0; j < interpreter_inputs.size(); ++j) {
-    int i = interpreter_inputs[j];
-    TfLiteTensor* t = interpreter_->tensor(i);
-    if (t->type == kTfLiteString) {
-      if (inputs_data_[j].data) {
-        static_cast<DynamicBuffer*>(inputs_data_[j].data.get())
-            ->WriteToTensor(t, /*new_shape=*/nullptr);
+  // Set the values of the input tensors from inputs_data_, in every context.
+  auto reset_inputs = [this](Interpreter* interpreter) {
+    auto interpreter_inputs = interpreter->inputs();
+    for (int j = 0; j < interpreter_inputs.size(); ++j) {
+      int i = interpreter_inputs[j];
+      TfLiteTensor* t = interpreter->tensor(i);
+      if (t->type == kTfLiteString) {
+        if (inputs_data_[j].data) {
+          static_cast<DynamicBuffer*>(inputs_data_[j].data.get())
+              ->WriteToTensor(t, /*new_shape=*/nullptr);
+        } else {
+          tflite::DynamicBuffer buffer;
+          FillRandomString(&buffer, t->dims, []() {
+            return "we're have some friends over saturday to hang out in the "
+                   "yard";
+          });
+          buffer.WriteToTensor(t, /*new_shape=*/nullptr);
+        }
       } else {
-        tflite::DynamicBuffer buffer;
-        FillRandomString(&buffer, t->dims, []() {
-          return "we're have some friends over saturday to hang out in the "
-                 "yard";
-        });
-        buffer.WriteToTensor(t, /*new_shape=*/nullptr);
+        std::memcpy(t->data.raw, inputs_data_[j].data.get(),
+                    inputs_data_[j].bytes);
       }
-    } else {
-      std::memcpy(t->data.raw, inputs_data_[j].data.get(),
-                  inputs_data_[j].bytes);
     }
-  }
+  };
+  reset_inputs(interpreter_.get());
+  for (auto& context : concurrent_contexts_) reset_inputs(context.get());
 
   return kTfLiteOk;
 }
 
-TfLiteStatus BenchmarkTfLiteModel::InitInterpreter() {
-  auto resolver = GetOpResolver();
+TfLiteStatus BenchmarkTfLiteModel::CreateInterpreter(
+    std::unique_ptr<Interpreter>* interpreter) {
   const int32_t num_threads = params_.Get<int32_t>("num_threads");
-  const bool use_caching = params_.Get<bool>("use_caching");
-
-  InterpreterOptions options;
-  options.SetEnsureDynamicTensorsAreReleased(
-      params_.Get<bool>("release_dynamic_tensors"));
-  options.OptimizeMemoryForLargeTensors(
-      params_.Get<int32_t>("optimize_memory_for_large_tensors"));
-  options.SetDisableDelegateClustering(
-      params_.Get<bool>("disable_delegate_clustering"));
+  if (model_instance_) {
+    if (model_instance_->NewExecutionContext(interpreter, num_threads) !=
+        kTfLiteOk) {
+      TFLITE_LOG(ERROR) << "Failed to create an execution context";
+      return kTfLiteError;
+    }
+    return kTfLiteOk;
+  }
 
-  tflite::InterpreterBuilder builder(*model_, *resolver, &options);
+  InterpreterOptions options = GetInterpreterOptions(params_);
+  tflite::InterpreterBuilder builder(*model_, *resolver_, &options);
   if (builder.SetNumThreads(num_threads) != kTfLiteOk) {
     TFLITE_LOG(ERROR) << "Failed to set thread number";
     return kTfLiteError;
   }
 
-  builder(&interpreter_);
-  if (!interpreter_) {
+  builder(interpreter);
+  if (!*interpreter) {
     TFLITE_LOG(ERROR) << "Failed to initialize the interpreter";
     return kTfLiteError;
   }
+  return kTfLiteOk;
+}
+
+TfLiteStatus BenchmarkTfLiteModel::InitInterpreter() {
+  resolver_ = GetOpResolver();
+  const int32_t num_threads = params_.Get<int32_t>("num_threads");
+  const bool use_caching = params_.Get<bool>("use_caching");
+
+  model_instance_.reset();
+  const std::string weights_cache_file =
+      params_.Get<std::string>("weights_cache_file");
+  if ((params_.Get<int32_t>("num_concurrent_contexts") > 1 &&
+       params_.Get<bool>("share_model_instance")) ||
+      !weights_cache_file.empty()) {
+    InterpreterOptions options = GetInterpreterOptions(params_);
+    model_instance_ =
+        std::make_unique<ModelInstance>(*model_, *resolver_, &options);
+  }
+  if (!weights_cache_file.empty()) {
+    const Allocation* allocation = model_->allocation();
+    if (allocation == nullptr ||
+        model_instance_->SetWeightsCacheFile(
+            weights_cache_file,
+            delegates::StrFingerprint(allocation->base(),
+                                      allocation->bytes())) != kTfLiteOk) {
+      TFLITE_LOG(ERROR) << "Failed to use the weights cache file "
+                        << weights_cache_file;
+      return kTfLiteError;
+    }
+  }
+  TF_LITE_ENSURE_STATUS(CreateInterpreter(&interpreter_));
+  if (!weights_cache_file.empty()) {
+    TFLITE_LOG(INFO) << model_instance_->weights_cache().num_mapped_buffers()
+                     << " of " << model_instance_->weights_cache().num_buffers()
+                     << " derived weight buffers were mapped from "
+                     << weights_cache_file;
+  }
   // Manually enable caching behavior in TF Lite interpreter.
   if (use_caching) {
     external_context_ = std::make_unique<tflite::ExternalCpuBackendContext>();
@@ -729,6 +890,8 @@ TfLiteStatus BenchmarkTfLiteModel::Init() {
   }
 
   AddOwnedListener(MayCreateProfilingListener());
+  // Must follow the profiling listener, which replaces the profilers.
+  AddOwnedListener(MayCreatePerfCounterListener());
   AddOwnedListener(std::unique_ptr<BenchmarkListener>(
       new InterpreterStatePrinter(interpreter_.get())));
 
@@ -856,6 +1019,8 @@ TfLiteStatus BenchmarkTfLiteModel::Init() {
     return kTfLiteError;
   }
 
+  TF_LITE_ENSURE_STATUS(InitConcurrentContexts());
+
   AddOwnedListener(
       std::unique_ptr<BenchmarkListener>(new RuyProfileListener()));
   AddOwnedListener(
@@ -864,6 +1029,63 @@ TfLiteStatus BenchmarkTfLiteModel::Init() {
   return kTfLiteOk;
 }
 
+TfLiteStatus BenchmarkTfLiteModel::InitConcurrentContexts() {
+  concurrent_invoker_.reset();
+  concurrent_contexts_.clear();
+  const int32_t num_contexts = params_.Get<int32_t>("num_concurrent_contexts");
+  if (num_contexts <= 1) return kTfLiteOk;
+
+  std::vector<Interpreter*> contexts;
+  for (int c = 1; c < num_contexts; ++c) {
+    std::unique_ptr<Interpreter> context;
+    TF_LITE_ENSURE_STATUS(CreateInterpreter(&context));
+    context->SetAllowFp16PrecisionForFp32(params_.Get<bool>("allow_fp16"));
+
+    // Delegates can't be shared between interpreters, so every context gets
+    // its own instance of the delegates applied to 'interpreter_'.
+    tools::ProvidedDelegateList delegate_providers(&params_);
+    for (auto& created_delegate :
+         delegate_providers.CreateAllRankedDelegates()) {
+      TfLiteDelegate* delegate = created_delegate.delegate.get();
+      owned_delegates_.emplace_back(std::move(created_delegate.delegate));
+      if (context->ModifyGraphWithDelegate(delegate) != kTfLiteOk) {
+        TFLITE_LOG(ERROR) << "Failed to apply "
+                          << created_delegate.provider->GetName()
+                          << " delegate to execution context #" << c;
+        return kTfLiteError;
+      }
+    }
+
+    auto context_inputs = context->inputs();
+    for (int j = 0; j < inputs_.size(); ++j) {
+      int i = context_inputs[j];
+      if (context->tensor(i)->type != kTfLiteString) {
+        context->ResizeInputTensor(i, inputs_[j].shape);
+      }
+    }
+    if (context->AllocateTensors() != kTfLiteOk) {
+      TFLITE_LOG(ERROR) << "Failed to allocate tensors of execution context #"
+                        << c;
+      return kTfLiteError;
+    }
+    contexts.push_back(context.get());
+    concurrent_contexts_.push_back(std::move(context));
+  }
+
+  TFLITE_LOG(INFO) << "Running " << num_contexts
+                   << " execution contexts concurrently in every run.";
+  if (model_instance_) {
+    TFLITE_LOG(INFO) << "The contexts share "
+                     << model_instance_->weights_cache().num_buffers()
+                     << " weight buffers of "
+                     << model_instance_->weights_cache().size_in_bytes() /
+                            1024.0 / 1024.0
+                     << " MB.";
+  }
+  concurrent_invoker_ = std::make_unique<ConcurrentInvoker>(contexts);
+  return kTfLiteOk;
+}
+
 TfLiteStatus BenchmarkTfLiteModel::LoadModel() {
   std::string fd_or_graph_path = params_.Get<std::string>("graph");
   model_loader_ = tools::CreateModelLoaderFromPath(fd_or_graph_path);
@@ -912,7 +1134,21 @@ BenchmarkTfLiteModel::MayCreateProfilingListener() const {
           !params_.Get<std::string>("profiling_output_csv_file").empty())));
 }
 
-TfLiteStatus BenchmarkTfLiteModel::RunImpl() { return interpreter_->Invoke(); }
+std::unique_ptr<BenchmarkListener>
+BenchmarkTfLiteModel::MayCreatePerfCounterListener() const {
+  if (!params_.Get<bool>("enable_op_perf_counters")) return nullptr;
+  return std::unique_ptr<BenchmarkListener>(
+      new PerfCounterListener(interpreter_.get()));
+}
+
+TfLiteStatus BenchmarkTfLiteModel::RunImpl() {
+  if (!concurrent_invoker_) return interpreter_->Invoke();
+
+  concurrent_invoker_->Start();
+  const TfLiteStatus status = interpreter_->Invoke();
+  const TfLiteStatus concurrent_status = concurrent_invoker_->Wait();
+  return status != kTfLiteOk ? status : concurrent_status;
+}
 
 }  // namespace benchmark
 }  // namespace tflite
@@ -25,6 +25,7 @@ limitations under the License.
 #include <vector>
 
 #include "tensorflow/lite/core/model.h"
+#include "tensorflow/lite/model_instance.h"
 #include "tensorflow/lite/profiling/profiler.h"
 #include "tensorflow/lite/tools/benchmark/benchmark_model.h"
 #include "tensorflow/lite/tools/model_loader.h"
@@ -52,6 +53,9 @@ TfLiteStatus SplitInputLayerNameAndValueFile(
     const std::string& name_and_value_file,
     std::pair<std::string, std::string>& name_file_pair);
 
+// Invokes the extra execution contexts of a benchmark on dedicated threads.
+class ConcurrentInvoker;
+
 // Benchmarks a TFLite model by running tflite interpreter.
 class BenchmarkTfLiteModel : public BenchmarkModel {
  public:
@@ -103,6 +107,10 @@ class BenchmarkTfLiteModel : public BenchmarkModel {
   // necessary.
   virtual std::unique_ptr<BenchmarkListener> MayCreateProfilingListener() const;
 
+  // Create a BenchmarkListener reporting the hardware counters of each op if
+  // necessary.
+  std::unique_ptr<BenchmarkListener> MayCreatePerfCounterListener() const;
+
   void CleanUp();
 
   utils::InputTensorData LoadInputTensorData(
@@ -118,6 +126,14 @@ class BenchmarkTfLiteModel : public BenchmarkModel {
   utils::InputTensorData CreateRandomTensorData(
       const TfLiteTensor& t, const InputLayerInfo* layer_info);
 
+  // Creates an interpreter for the model, either from `model_instance_` or
+  // from its own InterpreterBuilder.
+  TfLiteStatus CreateInterpreter(std::unique_ptr<Interpreter>* interpreter);
+
+  // Creates the contexts that run concurrently with `interpreter_` when
+  // --num_concurrent_contexts is greater than 1.
+  TfLiteStatus InitConcurrentContexts();
+
   void AddOwnedListener(std::unique_ptr<BenchmarkListener> listener) {
     if (listener == nullptr) return;
     owned_listeners_.emplace_back(std::move(listener));
@@ -127,6 +143,12 @@ class BenchmarkTfLiteModel : public BenchmarkModel {
   std::vector<std::unique_ptr<BenchmarkListener>> owned_listeners_;
   std::mt19937 random_engine_;
   std::vector<Interpreter::TfLiteDelegatePtr> owned_delegates_;
+  std::unique_ptr<tflite::OpResolver> resolver_;
+  // Shares the weights of the model among `interpreter_` and
+  // `concurrent_contexts_` if --share_model_instance is set.
+  std::unique_ptr<ModelInstance> model_instance_;
+  std::vector<std::unique_ptr<Interpreter>> concurrent_contexts_;
+  std::unique_ptr<ConcurrentInvoker> concurrent_invoker_;
   // Always TFLITE_LOG the benchmark result.
   BenchmarkLoggingListener log_output_;
   std::unique_ptr<tools::ModelLoader> model_loader_;
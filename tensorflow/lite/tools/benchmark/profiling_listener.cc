@@ -89,5 +89,32 @@ void ProfilingListener::WriteOutput(const std::string& header,
   (*stream) << data << std::endl;
 }
 
+PerfCounterListener::PerfCounterListener(Interpreter* interpreter)
+    : interpreter_(interpreter) {
+  TFLITE_TOOLS_CHECK(interpreter);
+  // Added rather than set, so that it runs along the op profiler if any.
+  interpreter_->AddProfiler(&profiler_);
+}
+
+void PerfCounterListener::OnBenchmarkStart(const BenchmarkParams& params) {
+  if (!profiling::PerfCounterProfiler::IsSupported()) {
+    TFLITE_LOG(WARN) << "Hardware counters aren't available, only the op "
+                        "latencies will be reported.";
+  }
+  profiler_.Reset();
+}
+
+void PerfCounterListener::OnSingleRunStart(RunType run_type) {
+  if (run_type == REGULAR) profiler_.StartProfiling();
+}
+
+void PerfCounterListener::OnSingleRunEnd() { profiler_.StopProfiling(); }
+
+void PerfCounterListener::OnBenchmarkEnd(const BenchmarkResults& results) {
+  TFLITE_LOG(INFO) << "Operator-wise Hardware Counters for Regular Benchmark "
+                      "Runs:\n"
+                   << profiler_.GetOutputString(*interpreter_);
+}
+
 }  // namespace benchmark
 }  // namespace tflite
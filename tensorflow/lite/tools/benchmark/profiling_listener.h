@@ -20,6 +20,7 @@ limitations under the License.
 #include <string>
 
 #include "tensorflow/lite/profiling/buffered_profiler.h"
+#include "tensorflow/lite/profiling/perf_counter_profiler.h"
 #include "tensorflow/lite/profiling/profile_summarizer.h"
 #include "tensorflow/lite/profiling/profile_summary_formatter.h"
 #include "tensorflow/lite/tools/benchmark/benchmark_model.h"
@@ -56,6 +57,25 @@ class ProfilingListener : public BenchmarkListener {
   profiling::BufferedProfiler profiler_;
 };
 
+// Dumps the hardware counters of each op, and its arithmetic intensity, over
+// the regular benchmark runs.
+class PerfCounterListener : public BenchmarkListener {
+ public:
+  explicit PerfCounterListener(Interpreter* interpreter);
+
+  void OnBenchmarkStart(const BenchmarkParams& params) override;
+
+  void OnSingleRunStart(RunType run_type) override;
+
+  void OnSingleRunEnd() override;
+
+  void OnBenchmarkEnd(const BenchmarkResults& results) override;
+
+ private:
+  Interpreter* interpreter_;
+  profiling::PerfCounterProfiler profiler_;
+};
+
 }  // namespace benchmark
 }  // namespace tflite
 
@@ -155,6 +155,14 @@ int GetBuiltinOperatorVersion(const OpSignature& op_sig) {
       // | Quantized Int8  |                  4 |                        4 |
       // +-----------------+--------------------+--------------------------+
 
+      // Float inputs with int4 weights dequantized on the fly are supported at
+      // version 11.
+      if (op_sig.inputs.at(0).type == kTfLiteFloat32 &&
+          op_sig.inputs.at(1).type == kTfLiteInt4 &&
+          op_sig.outputs.at(0).type == kTfLiteFloat32) {
+        return 11;
+      }
+
       // FullyConnected with sparse weight is supported at version 8.
       if (op_sig.ext_options.fully_connected.sparse_weight) {
         return 8;
@@ -706,6 +714,11 @@ int GetBuiltinOperatorVersion(const OpSignature& op_sig) {
       return 1;
 
     case BuiltinOperator_BATCH_MATMUL: {
+      // In case of a float LHS with an int4 RHS, the version is 5.
+      if (op_sig.inputs.at(0).type == kTfLiteFloat32 &&
+          op_sig.inputs.at(1).type == kTfLiteInt4) {
+        return 5;
+      }
       // In case of int16 inputs, the version is 3.
       if (op_sig.inputs.at(0).type == kTfLiteInt16) {
         return 3;
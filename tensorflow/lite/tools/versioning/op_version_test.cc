@@ -590,6 +590,15 @@ TEST(OpVersionTest, VersioningFullyConnectedTest) {
   EXPECT_EQ(GetBuiltinOperatorVersion(fake_op_sig), 3);
   fully_connected_params.asymmetric_quantize_inputs = true;
   EXPECT_EQ(GetBuiltinOperatorVersion(fake_op_sig), 9);
+
+  fake_op_sig = {
+      .op = BuiltinOperator_FULLY_CONNECTED,
+      .inputs = CreateOpSignatureTensorSpecs(
+          std::vector<TfLiteType>{kTfLiteFloat32, kTfLiteInt4}),
+      .outputs = CreateOpSignatureTensorSpecs(kTfLiteFloat32),
+      .builtin_data = reinterpret_cast<void*>(&fully_connected_params),
+  };
+  EXPECT_EQ(GetBuiltinOperatorVersion(fake_op_sig), 11);
 }
 
 TEST(OpVersionTest, VersioningDequantizeTest) {
@@ -1113,6 +1122,17 @@ TEST(OpVersionTest, VersioningBatchMatMulTest) {
   };
   batch_mat_mul_params.asymmetric_quantize_inputs = true;
   EXPECT_EQ(GetBuiltinOperatorVersion(fake_op_sig), 4);
+
+  // Float LHS with int4 RHS is version 5.
+  batch_mat_mul_params = {};
+  fake_op_sig = {
+      .op = BuiltinOperator_BATCH_MATMUL,
+      .inputs = CreateOpSignatureTensorSpecs(
+          std::vector<TfLiteType>{kTfLiteFloat32, kTfLiteInt4}),
+      .outputs = CreateOpSignatureTensorSpecs(kTfLiteFloat32),
+      .builtin_data = reinterpret_cast<void*>(&batch_mat_mul_params),
+  };
+  EXPECT_EQ(GetBuiltinOperatorVersion(fake_op_sig), 5);
 }
 TEST(OpVersionTest, VersioningSquaredDifferenceTest) {
   // Default.
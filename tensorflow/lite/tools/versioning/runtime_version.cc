@@ -61,6 +61,7 @@ std::string FindMinimumRuntimeVersionForOp(tflite::BuiltinOperator op_code,
            {{BuiltinOperator_BATCH_MATMUL, 2}, "2.3.0"},
            {{BuiltinOperator_BATCH_MATMUL, 3}, "2.4.0"},
            {{BuiltinOperator_BATCH_MATMUL, 4}, "2.5.0"},
+           {{BuiltinOperator_BATCH_MATMUL, 5}, "2.14.0"},
            // The version one of broadcast to op won't be not supported since
            // the version one was rollbacked and the builtin op code number
            // has been changed because of builtin op code shortage problem.
@@ -125,6 +126,7 @@ std::string FindMinimumRuntimeVersionForOp(tflite::BuiltinOperator op_code,
            {{BuiltinOperator_FULLY_CONNECTED, 8}, "2.3.0"},
            {{BuiltinOperator_FULLY_CONNECTED, 9}, "2.3.0"},
            {{BuiltinOperator_FULLY_CONNECTED, 10}, "2.11.0"},
+           {{BuiltinOperator_FULLY_CONNECTED, 11}, "2.14.0"},
            {{BuiltinOperator_GATHER, 1}, "1.6.0"},
            {{BuiltinOperator_GATHER, 2}, "1.14.0"},
            {{BuiltinOperator_GATHER, 3}, "1.15.0"},